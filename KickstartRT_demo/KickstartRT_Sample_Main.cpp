@@ -26,12 +26,16 @@
 #include <chrono>
 
 #include <donut/core/vfs/VFS.h>
+#include <donut/core/frame_statistics.h>
 #include <donut/core/log.h>
+#include <donut/core/profiler.h>
 #include <donut/core/string_utils.h>
+#include <donut/engine/CameraPath.h>
 #include <donut/engine/CommonRenderPasses.h>
 #include <donut/engine/ConsoleInterpreter.h>
 #include <donut/engine/ConsoleObjects.h>
 #include <donut/engine/FramebufferFactory.h>
+#include <donut/engine/GpuProfiler.h>
 #include <donut/engine/Scene.h>
 #include <donut/engine/ShaderFactory.h>
 #include <donut/engine/TextureCache.h>
@@ -45,6 +49,7 @@
 #include <donut/render/GBufferFillPass.h>
 #include <donut/render/LightProbeProcessingPass.h>
 #include <donut/render/PixelReadbackPass.h>
+#include <donut/render/ShadowCache.h>
 #include <donut/render/SkyPass.h>
 #include <donut/render/SsaoPass.h>
 #include <donut/render/TemporalAntiAliasingPass.h>
@@ -54,6 +59,7 @@
 #include <donut/app/Camera.h>
 #include <donut/app/DeviceManager.h>
 #include <donut/app/imgui_console.h>
+#include <donut/app/imgui_profiler.h>
 #include <donut/app/imgui_renderer.h>
 #include <nvrhi/utils.h>
 #include <nvrhi/common/misc.h>
@@ -97,6 +103,14 @@ using namespace donut::render;
 
 static bool g_PrintSceneGraph = false;
 
+struct BenchmarkSettings
+{
+    std::string cameraPathFile;         // benchmark mode is active when this is not empty
+    std::string outputFile = "benchmark.csv";
+    uint32_t warmupFrames = 30;
+    float framesPerSecond = 60.f;       // determines the fixed animation time step
+};
+
 class RenderTargets : public GBufferRenderTargets
 {
 public:
@@ -266,6 +280,7 @@ struct UIData
 {
     bool                                ShowUI = true;
 	bool                                ShowConsole = false;
+    bool                                ShowProfiler = false;
     bool                                UseDeferredShading = true;
     bool                                Stereo = false;
     bool                                EnableSsao = true;
@@ -284,6 +299,7 @@ struct UIData
     bool                                EnableTranslucency = false;
     bool                                EnableMaterialEvents = false;
     bool                                EnableShadows = true;
+    bool                                EnableShadowCache = true;
     float                               AmbientIntensity = 0.05f;
     bool                                EnableLightProbe = false;
     float                               LightProbeDiffuseScale = 1.f;
@@ -561,6 +577,8 @@ private:
     std::shared_ptr<LightProbeProcessingPass> m_LightProbePass;
     std::unique_ptr<MaterialIDPass>     m_MaterialIDPass;
     std::unique_ptr<PixelReadbackPass>  m_PixelReadbackPass;
+    std::unique_ptr<GpuProfiler>        m_GpuProfiler;
+    std::filesystem::path               m_ShaderManifestFile;
 
     std::shared_ptr<IView>              m_View;
     std::shared_ptr<IView>              m_ViewPrevious;
@@ -585,6 +603,14 @@ private:
     nvrhi::TextureHandle                m_LightProbeSpecularTexture;
 
     float                               m_WallclockTime = 0.f;
+
+    std::unique_ptr<CameraPath>         m_BenchmarkPath;
+    std::unique_ptr<profiler::FrameStatistics> m_BenchmarkStats;
+    std::string                         m_BenchmarkOutputFile;
+    float                               m_BenchmarkTimeStep = 0.f;
+    uint32_t                            m_BenchmarkFrame = 0;
+    uint32_t                            m_BenchmarkEndFrame = 0;
+    std::vector<uint64_t>               m_BenchmarkPendingGpuFrames;
     
     UIData&                             m_ui;
 
@@ -624,6 +650,23 @@ public:
         m_TextureCache = std::make_shared<TextureCache>(GetDevice(), m_RootFs, nullptr);
 
         m_ShaderFactory = std::make_shared<ShaderFactory>(GetDevice(), m_RootFs, "/shaders");
+
+        // Load the shaders recorded by a previous run in parallel, before the render passes are created.
+        // If there is no list yet, record one when the application exits.
+        if (m_RootFs->fileExists("/shaders/donut/ShaderPrefetchList.txt"))
+        {
+#ifdef DONUT_WITH_TASKFLOW
+            tf::Executor executor;
+            m_ShaderFactory->PrefetchFromManifest("/shaders/donut/ShaderPrefetchList.txt", &executor);
+#else
+            m_ShaderFactory->PrefetchFromManifest("/shaders/donut/ShaderPrefetchList.txt", nullptr);
+#endif
+            ShaderFactoryStats stats = m_ShaderFactory->GetStats();
+            log::info("Prefetched %llu shaders (%llu KB)", (unsigned long long)stats.filesPrefetched, (unsigned long long)(stats.bytesLoaded / 1024));
+        }
+        else
+            m_ShaderManifestFile = frameworkShaderPath / "ShaderPrefetchList.txt";
+
         m_CommonPasses = std::make_shared<CommonRenderPasses>(GetDevice(), m_ShaderFactory);
 
         m_OpaqueDrawStrategy = std::make_shared<InstancedOpaqueDrawStrategy>();
@@ -631,6 +674,7 @@ public:
 
         m_ShadowMap = std::make_shared<CascadedShadowMap>(GetDevice(), 2048, 4, 0, nvrhi::Format::D24S8);
         m_ShadowMap->SetupProxyViews();
+        m_ShadowMap->EnableStaticCache(GetDevice());
         
         m_ShadowFramebuffer = std::make_shared<FramebufferFactory>(GetDevice());
         m_ShadowFramebuffer->DepthTarget = m_ShadowMap->GetTexture();
@@ -643,6 +687,9 @@ public:
 
         m_CommandList = GetDevice()->createCommandList();
         m_CommandListKS_PreLighting = GetDevice()->createCommandList();
+
+        m_GpuProfiler = std::make_unique<GpuProfiler>(GetDevice());
+        GpuProfiler::SetActive(m_GpuProfiler.get());
         m_CommandListKS = GetDevice()->createCommandList();
         m_CommandListKS_Post = GetDevice()->createCommandList();
 
@@ -771,6 +818,12 @@ public:
 #endif
     }
 
+    ~FeatureDemo() override
+    {
+        if (!m_ShaderManifestFile.empty())
+            m_ShaderFactory->WriteManifest(m_ShaderManifestFile);
+    }
+
 	std::shared_ptr<vfs::IFileSystem> GetRootFs() const
     {
 		return m_RootFs;
@@ -884,9 +937,99 @@ public:
         return true;
     }
 
+    bool StartBenchmark(const BenchmarkSettings& settings)
+    {
+        NativeFileSystem nativeFS;
+        auto path = std::make_unique<CameraPath>();
+        if (!path->Load(nativeFS, settings.cameraPathFile) || path->IsEmpty())
+        {
+            log::error("Cannot load the benchmark camera path '%s'", settings.cameraPathFile.c_str());
+            return false;
+        }
+
+        m_BenchmarkTimeStep = 1.f / std::max(settings.framesPerSecond, 1.f);
+        m_BenchmarkEndFrame = settings.warmupFrames + uint32_t(std::ceil(path->GetDuration() / m_BenchmarkTimeStep)) + 1;
+        m_BenchmarkPath = std::move(path);
+        m_BenchmarkStats = std::make_unique<profiler::FrameStatistics>(settings.warmupFrames);
+        m_BenchmarkOutputFile = settings.outputFile;
+        m_BenchmarkFrame = 0;
+        m_BenchmarkPendingGpuFrames.clear();
+
+        GetDeviceManager()->SetFixedFrameTime(m_BenchmarkTimeStep);
+        m_ui.EnableVsync = false;
+        m_ui.ActiveSceneCamera = nullptr;
+        m_ui.UseThirdPersonCamera = false;
+
+        return true;
+    }
+
+    void AnimateBenchmark()
+    {
+        // The frame statistics start at the first frame rendered with the loaded scene.
+        // Every call records the timings of the previous frame; the GPU timings come a few frames later.
+        const uint64_t previousFrame = profiler::Profiler::Get().GetFrameIndex() - 1;
+        if (m_BenchmarkFrame > 0)
+        {
+            const double frameMs = GetDeviceManager()->GetLastFrameTimeSeconds() * 1000.0;
+            const double cpuMs = GetDeviceManager()->GetLastFrameCpuTimeSeconds() * 1000.0;
+            if (m_BenchmarkStats->AddFrame(previousFrame, frameMs, cpuMs))
+                m_BenchmarkPendingGpuFrames.push_back(previousFrame);
+        }
+
+        auto it = m_BenchmarkPendingGpuFrames.begin();
+        while (it != m_BenchmarkPendingGpuFrames.end())
+        {
+            const double gpuMs = profiler::Profiler::Get().GetGpuFrameTimeMs(*it);
+            if (gpuMs >= 0.0)
+                m_BenchmarkStats->SetGpuTime(*it, gpuMs);
+            if (gpuMs >= 0.0 || *it + 2 * GpuProfiler::c_FrameSlots < previousFrame)
+                it = m_BenchmarkPendingGpuFrames.erase(it);
+            else
+                ++it;
+        }
+
+        if (m_BenchmarkFrame >= m_BenchmarkEndFrame)
+        {
+            FinishBenchmark();
+            return;
+        }
+
+        // The path starts after the warm-up frames, which all show its first pose.
+        const uint32_t warmupFrames = m_BenchmarkStats->GetWarmupFrames();
+        const uint32_t pathFrame = m_BenchmarkFrame > warmupFrames ? m_BenchmarkFrame - warmupFrames : 0;
+        const CameraPathPose pose = m_BenchmarkPath->Evaluate(float(pathFrame) * m_BenchmarkTimeStep);
+        m_FirstPersonCamera.LookAt(pose.position, pose.target, pose.up);
+        if (pose.verticalFov.has_value())
+            m_CameraVerticalFov = *pose.verticalFov;
+
+        ++m_BenchmarkFrame;
+    }
+
+    void FinishBenchmark()
+    {
+        if (m_BenchmarkStats->WriteToFile(m_BenchmarkOutputFile))
+            log::info("Benchmark results written to '%s'", m_BenchmarkOutputFile.c_str());
+        else
+            log::error("Cannot write the benchmark results to '%s'", m_BenchmarkOutputFile.c_str());
+
+        const profiler::FrameTimeSummary frame = m_BenchmarkStats->GetFrameTimeSummary();
+        const profiler::FrameTimeSummary gpu = m_BenchmarkStats->GetGpuSummary();
+        log::info("Benchmark: %zu frames, frame time mean %.3f ms, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms",
+            frame.count, frame.mean, frame.p50, frame.p95, frame.p99);
+        if (gpu.count > 0)
+            log::info("Benchmark: GPU time mean %.3f ms, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms",
+                gpu.mean, gpu.p50, gpu.p95, gpu.p99);
+
+        m_BenchmarkPath.reset();
+        GetDeviceManager()->SetFixedFrameTime(0.0);
+        glfwSetWindowShouldClose(GetDeviceManager()->GetWindow(), GLFW_TRUE);
+    }
+
     virtual void Animate(float fElapsedTimeSeconds) override
     { 
-        if (!m_ui.ActiveSceneCamera)
+        if (m_BenchmarkPath && IsSceneLoaded())
+            AnimateBenchmark();
+        else if (!m_ui.ActiveSceneCamera)
             GetActiveCamera().Animate(fElapsedTimeSeconds);
 
         if(m_ToneMappingPass)
@@ -4026,6 +4169,14 @@ public:
 
     virtual void RenderScene(nvrhi::IFramebuffer* framebuffer) override
     {
+        m_GpuProfiler->BeginFrame();
+
+        // no view is being rendered here: release the material binding sets superseded last frame
+        if (m_ForwardPass) m_ForwardPass->ReleaseDestroyedMaterials();
+        for (int i = 0; i < Layer::Count; ++i)
+            if (m_GBufferPass[i]) m_GBufferPass[i]->ReleaseDestroyedMaterials();
+        if (m_ShadowDepthPass) m_ShadowDepthPass->ReleaseDestroyedMaterials();
+
         int windowWidth, windowHeight;
         GetDeviceManager()->GetWindowDimensions(windowWidth, windowHeight);
         nvrhi::Viewport windowViewport = nvrhi::Viewport(float(windowWidth), float(windowHeight));
@@ -4178,19 +4329,37 @@ public:
             float zRange = length(sceneBounds.diagonal()) * 0.5f;
             m_ShadowMap->SetupForPlanarViewStable(*m_SunLight, projectionFrustum, viewMatrixInv, maxShadowDistance, zRange, zRange, m_ui.CsmExponent);
 
-            m_ShadowMap->Clear(m_CommandList);
-
             DepthPass::Context context;
 
-            RenderCompositeView(m_CommandList,
-                &m_ShadowMap->GetView(), nullptr,
-                *m_ShadowFramebuffer,
-                m_Scene->GetSceneGraph()->GetRootNode(),
-                *m_OpaqueDrawStrategy,
-                *m_ShadowDepthPass,
-                context,
-                "ShadowMap",
-                m_ui.EnableMaterialEvents);
+            if (m_ui.EnableShadowCache)
+            {
+                m_CommandList->beginMarker("ShadowMap");
+                m_ShadowMap->RenderCached(m_CommandList,
+                    *m_ShadowFramebuffer,
+                    m_Scene->GetSceneGraph()->GetRootNode(),
+                    *m_OpaqueDrawStrategy,
+                    *m_ShadowDepthPass,
+                    context,
+                    m_ui.EnableMaterialEvents);
+                m_CommandList->endMarker();
+            }
+            else
+            {
+                // the cache misses all changes while it's off
+                m_ShadowMap->GetCacheTracker()->Invalidate();
+
+                m_ShadowMap->Clear(m_CommandList);
+
+                RenderCompositeView(m_CommandList,
+                    &m_ShadowMap->GetView(), nullptr,
+                    *m_ShadowFramebuffer,
+                    m_Scene->GetSceneGraph()->GetRootNode(),
+                    *m_OpaqueDrawStrategy,
+                    *m_ShadowDepthPass,
+                    context,
+                    "ShadowMap",
+                    m_ui.EnableMaterialEvents);
+            }
         }
         else
         {
@@ -4657,7 +4826,8 @@ public:
 
             for (const auto& instance : m_Scene->GetSceneGraph()->GetMeshInstances())
             {
-                if (instance->GetInstanceIndex() == int(pixelValue.y))
+                int firstInstance = instance->GetInstanceIndex();
+                if (int(pixelValue.y) >= firstInstance && int(pixelValue.y) < firstInstance + int(instance->GetInstanceCount()))
                 {
                     m_ui.SelectedNode = instance->GetNodeSharedPtr();
                     m_ui.SelectedMeshInstance = instance;
@@ -4907,6 +5077,7 @@ private:
 	ImFont* m_FontDroidMono = nullptr;
 
 	std::unique_ptr<ImGui_Console> m_console;
+    std::unique_ptr<ImGui_Profiler> m_Profiler;
     std::shared_ptr<engine::Light> m_SelectedLight;
 
 	UIData& m_ui;
@@ -4928,6 +5099,8 @@ public:
         auto interpreter = std::make_shared<console::Interpreter>();
 		// m_console = std::make_unique<ImGui_Console>(interpreter,opts);
 
+        m_Profiler = std::make_unique<ImGui_Profiler>();
+
         ImGui::GetIO().IniFilename = nullptr;
     }
 
@@ -4963,6 +5136,11 @@ protected:
             m_console->Render(&m_ui.ShowConsole);
         }
 
+        if (m_ui.ShowProfiler)
+        {
+            m_Profiler->Render(&m_ui.ShowProfiler);
+        }
+
         ImGui::SetNextWindowPos(ImVec2(10.f, 10.f), 0);
         ImGui::Begin("Settings", 0, ImGuiWindowFlags_AlwaysAutoResize);
         ImGui::Text("Renderer: %s", GetDeviceManager()->GetRendererString());
@@ -4989,6 +5167,7 @@ protected:
             m_ui.ShaderReoladRequested = true;
 
         ImGui::Checkbox("VSync", &m_ui.EnableVsync);
+        ImGui::Checkbox("Profiler", &m_ui.ShowProfiler);
         //ImGui::Checkbox("Deferred Shading", &m_ui.UseDeferredShading);
         //if (m_ui.AntiAliasingMode >= AntiAliasingMode::MSAA_2X)
         //    m_ui.UseDeferredShading = false; // Deferred shading doesn't work with MSAA
@@ -5292,6 +5471,8 @@ protected:
         ImGui::Text("Raster features");
         ImGui::Checkbox("Enable SSAO", &m_ui.EnableSsao);
         ImGui::Checkbox("Enable Shadows", &m_ui.EnableShadows);
+        if (m_ui.EnableShadows)
+            ImGui::Checkbox("Cache Static Shadows", &m_ui.EnableShadowCache);
         ImGui::Checkbox("Enable Bloom", &m_ui.EnableBloom);
         if (m_ui.EnableBloom && ImGui::CollapsingHeader("Bloom Parameters")) {
             ImGui::DragFloat("Bloom Sigma", &m_ui.BloomSigma, 0.01f, 0.1f, 100.f);
@@ -5406,7 +5587,7 @@ protected:
     }
 };
 
-bool ProcessCommandLine(int argc, const char* const* argv, DeviceCreationParameters& deviceParams, std::string& sceneName)
+bool ProcessCommandLine(int argc, const char* const* argv, DeviceCreationParameters& deviceParams, std::string& sceneName, BenchmarkSettings& benchmark)
 {
     for (int i = 1; i < argc; i++)
     {
@@ -5438,6 +5619,23 @@ bool ProcessCommandLine(int argc, const char* const* argv, DeviceCreationParamet
         else if (!strcmp(argv[i], "-nv-adapter")) {
             deviceParams.adapterNameSubstring = L"NVIDIA";
         }
+        else if (!strcmp(argv[i], "-benchmark") && i + 1 < argc)
+        {
+            benchmark.cameraPathFile = argv[++i];
+            deviceParams.vsyncEnabled = false;
+        }
+        else if (!strcmp(argv[i], "-benchmark-warmup") && i + 1 < argc)
+        {
+            benchmark.warmupFrames = uint32_t(std::stoi(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "-benchmark-output") && i + 1 < argc)
+        {
+            benchmark.outputFile = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-benchmark-fps") && i + 1 < argc)
+        {
+            benchmark.framesPerSecond = std::stof(argv[++i]);
+        }
         else if (argv[i][0] == '-') {
             // It's not a scene name. Silently ignore it.
         }
@@ -5488,7 +5686,8 @@ int main(int __argc, const char* const* __argv)
 #endif
 
     std::string sceneName;
-    if (!ProcessCommandLine(__argc, __argv, deviceParams, sceneName))
+    BenchmarkSettings benchmark;
+    if (!ProcessCommandLine(__argc, __argv, deviceParams, sceneName, benchmark))
     {
         log::error("Failed to process the command line.");
         return 1;
@@ -5516,7 +5715,8 @@ int main(int __argc, const char* const* __argv)
         deviceManager->AddRenderPassToBack(demo.get());
         deviceManager->AddRenderPassToBack(gui.get());
 
-        deviceManager->RunMessageLoop();
+        if (benchmark.cameraPathFile.empty() || demo->StartBenchmark(benchmark))
+            deviceManager->RunMessageLoop();
     }
 
     deviceManager->Shutdown();
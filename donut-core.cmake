@@ -56,6 +56,10 @@ if(DONUT_WITH_LZ4)
     target_compile_definitions(donut_core PUBLIC DONUT_WITH_LZ4)
 endif()
 
+if(DONUT_WITH_PROFILER)
+    target_compile_definitions(donut_core PUBLIC DONUT_WITH_PROFILER)
+endif()
+
 if(DONUT_WITH_MINIZ)
     target_link_libraries(donut_core miniz)
     target_sources(donut_core PRIVATE
@@ -32,6 +32,11 @@ target_link_libraries(donut_render donut_core donut_engine)
 
 add_dependencies(donut_render donut_shaders)
 
+# GpuCulling.cpp mirrors gpu_culling_cs.hlsl bit for bit, which requires that multiply-adds are not fused
+if (NOT MSVC)
+set_source_files_properties(src/render/GpuCulling.cpp PROPERTIES COMPILE_OPTIONS -ffp-contract=off)
+endif()
+
 if(DONUT_WITH_DX11)
 target_compile_definitions(donut_render PUBLIC USE_DX11=1)
 endif()
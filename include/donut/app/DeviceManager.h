@@ -197,6 +197,9 @@ namespace donut::app
         double m_AverageTimeUpdateInterval = 0.5;
         double m_FrameTimeSum = 0.0;
         int m_NumberOfAccumulatedFrames = 0;
+        double m_LastFrameTime = 0.0;
+        double m_LastFrameCpuTime = 0.0;
+        double m_FixedFrameTime = 0.0;
 
         uint32_t m_FrameIndex = 0;
 
@@ -229,6 +232,13 @@ namespace donut::app
         [[nodiscard]] double GetAverageFrameTimeSeconds() const { return m_AverageFrameTime; }
         [[nodiscard]] double GetPreviousFrameTimestamp() const { return m_PreviousFrameTimestamp; }
         void SetFrameTimeUpdateInterval(double seconds) { m_AverageTimeUpdateInterval = seconds; }
+        // wall-clock duration of the previous frame
+        [[nodiscard]] double GetLastFrameTimeSeconds() const { return m_LastFrameTime; }
+        // time spent in Animate and Render in the previous frame, excluding Present
+        [[nodiscard]] double GetLastFrameCpuTimeSeconds() const { return m_LastFrameCpuTime; }
+        // when non-zero, Animate receives this time step instead of the wall-clock frame time
+        void SetFixedFrameTime(double seconds) { m_FixedFrameTime = seconds; }
+        [[nodiscard]] double GetFixedFrameTime() const { return m_FixedFrameTime; }
         [[nodiscard]] bool IsVsyncEnabled() const { return m_DeviceParams.vsyncEnabled; }
         virtual void SetVsyncEnabled(bool enabled) { m_RequestedVSync = enabled; /* will be processed later */ }
         virtual void ReportLiveObjects() {}
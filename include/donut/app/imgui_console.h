@@ -52,6 +52,7 @@ SOFTWARE.
 #include <imgui.h>
 
 #include <memory>
+#include <mutex>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -124,6 +125,8 @@ namespace donut::app
 
 		typedef donut::core::circular_buffer<LogItem, 5000> ItemsLog;
 		ItemsLog m_ItemsLog;
+		// the log callback runs on the logging thread when log::StartAsync is used
+		std::mutex m_ItemsLogMutex;
 
 	private:
 
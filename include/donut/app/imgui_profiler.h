@@ -0,0 +1,57 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/core/profiler.h>
+
+#include <filesystem>
+#include <string>
+
+namespace donut::app
+{
+    // ImGui window that displays the scope statistics collected by profiler::Profiler
+    // and triggers Chrome trace captures.
+    class ImGui_Profiler
+    {
+    public:
+        struct Options
+        {
+            bool showCpu = true;
+            bool showGpu = true;
+            bool showGraphs = true;
+            uint32_t captureFrameCount = 16;
+            std::filesystem::path traceFileName = "profile.json";
+        };
+
+        explicit ImGui_Profiler(Options const& options = Options());
+
+        void Render(bool* open = nullptr);
+
+    private:
+        void RenderScopes(profiler::Track track);
+
+        Options m_Options;
+        uint32_t m_ExportDelayFrames = 0;
+        std::string m_LastExportMessage;
+    };
+}
@@ -133,6 +133,9 @@ public:
     donut::math::box3 bbox;
 
     std::shared_ptr<donut::vfs::IBlob const> blob;
+
+    // owns the unpacked chunks & name-patched arrays of deserialized sets
+    std::shared_ptr<void const> storage;
 };
 
 struct MeshSet : public MeshSetBase
@@ -167,7 +170,7 @@ struct MeshletSet : public MeshSetBase
     MeshletInfo const * meshInfos;
 };
 
-std::shared_ptr<donut::vfs::IBlob const> serialize(MeshSetBase const & mset);
+std::shared_ptr<donut::vfs::IBlob const> serialize(MeshSetBase const & mset, bool compress = true);
 
 std::shared_ptr<MeshSetBase const> deserialize(std::weak_ptr<donut::vfs::IBlob const> blob, char const * assetpath);
 
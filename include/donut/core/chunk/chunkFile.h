@@ -89,6 +89,13 @@ struct Chunk
 //
 // ChunkFile
 //
+// Version 0x200 files store each chunk 16-byte aligned, optionally LZ4
+// compressed, with a CRC-32 of the stored bytes ; the chunk table carries its
+// own CRC-32. Every offset, size and checksum is validated on load before any
+// chunk data is exposed. Uncompressed chunks are served in place from the
+// blob, compressed chunks (and misaligned legacy chunks) are unpacked into an
+// aligned arena owned by the ChunkFile. Version 0x100 files are still read.
+//
 
 class ChunkFile
 {
@@ -106,7 +113,9 @@ public:
 
     // serialization interface
 
-    std::shared_ptr<donut::vfs::IBlob const> serialize() const;
+    // chunks are LZ4 compressed when 'compress' is set, donut was built with
+    // LZ4 and compression actually saves space
+    std::shared_ptr<donut::vfs::IBlob const> serialize(bool compress = true) const;
 
     template <typename ChunkDesc> ChunkId addChunk(void const * data, size_t size);
 
@@ -129,16 +138,25 @@ public:
 private:
 
     struct Header;
+    struct HeaderExt_0x200;
+
+    struct ChunkTableEntry_0x100;
+    struct ChunkTableEntry_0x200;
 
-    struct ChunkTableEntry;
+    struct alignas(16) ArenaBlock { uint8_t bytes[16]; };
 
     ChunkId addChunk(uint32_t type, uint32_t version, void const * data, size_t size);
 
+    bool load_0x100(Header const & header, uint8_t const * data, size_t size);
+    bool load_0x200(Header const & header, uint8_t const * data, size_t size);
+
     std::string _filepath;
 
     std::vector<std::unique_ptr<Chunk const>> _chunks;
 
     std::shared_ptr<donut::vfs::IBlob const> _data;
+
+    std::vector<ArenaBlock> _arena; // unpacked chunk data
 };
 
 
@@ -0,0 +1,94 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+namespace donut::profiler
+{
+    struct FrameTimeSummary
+    {
+        size_t count = 0;
+        double mean = 0.0;
+        double min = 0.0;
+        double max = 0.0;
+        double p50 = 0.0;
+        double p95 = 0.0;
+        double p99 = 0.0;
+    };
+
+    /*
+    FrameStatistics collects per-frame timings of a benchmark run and
+    summarizes them. The first 'warmupFrames' frames passed to AddFrame() are
+    discarded. GPU times usually become available a few frames after the CPU
+    times and are matched to the frames by index; frames without a GPU time
+    are excluded from the GPU summary.
+    */
+    class FrameStatistics
+    {
+    public:
+        struct Sample
+        {
+            uint64_t frameIndex = 0;
+            double frameMs = 0.0;   // wall-clock time between frames
+            double cpuMs = 0.0;     // time spent on the CPU in the frame
+            double gpuMs = -1.0;    // negative when unknown
+        };
+
+        explicit FrameStatistics(uint32_t warmupFrames = 0);
+
+        void Reset();
+
+        // returns false while the frame is part of the warm-up
+        bool AddFrame(uint64_t frameIndex, double frameMs, double cpuMs);
+        void SetGpuTime(uint64_t frameIndex, double gpuMs);
+
+        [[nodiscard]] bool IsWarmingUp() const { return m_WarmupRemaining > 0; }
+        [[nodiscard]] uint32_t GetWarmupFrames() const { return m_WarmupFrames; }
+        [[nodiscard]] const std::vector<Sample>& GetSamples() const { return m_Samples; }
+
+        [[nodiscard]] FrameTimeSummary GetFrameTimeSummary() const;
+        [[nodiscard]] FrameTimeSummary GetCpuSummary() const;
+        [[nodiscard]] FrameTimeSummary GetGpuSummary() const;
+
+        void WriteCsv(std::ostream& stream) const;
+        void WriteJson(std::ostream& stream) const;
+
+        // Picks the format from the file extension: .json, otherwise CSV.
+        bool WriteToFile(const std::filesystem::path& fileName) const;
+
+        // Linearly interpolated percentile, 'percentile' in [0, 100]. 'sortedValues' must be sorted.
+        static double Percentile(const std::vector<double>& sortedValues, double percentile);
+        static FrameTimeSummary Summarize(std::vector<double> values);
+
+    private:
+        uint32_t m_WarmupFrames;
+        uint32_t m_WarmupRemaining;
+        std::vector<Sample> m_Samples;
+        std::unordered_map<uint64_t, size_t> m_SampleIndex;
+    };
+}
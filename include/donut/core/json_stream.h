@@ -0,0 +1,157 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace Json
+{
+    class Value;
+    class CharReader;
+}
+
+// Streaming (pull) JSON reader.
+//
+// Walks a document held in memory token by token, without building a
+// Json::Value tree. The consumer drives the parse: it enters objects and
+// arrays, iterates over their members or elements and reads, skips or
+// captures each value. Object keys can be matched against a KeyTable so that
+// members dispatch on small integers instead of string comparisons.
+//
+// The accepted syntax is the one of json::LoadFromFile (jsoncpp defaults):
+// C and C++ style comments and trailing commas are allowed, and scalars
+// produce the same Json::Value types as jsoncpp does.
+
+namespace donut::json
+{
+    class KeyTable
+    {
+    public:
+        static constexpr int Unknown = -1;
+
+        // Key ids are the indices in the list. The strings must outlive the table.
+        KeyTable(std::initializer_list<const char*> keys);
+
+        [[nodiscard]] int Find(std::string_view key) const;
+
+    private:
+        std::unordered_map<std::string_view, int> m_Ids;
+    };
+
+    enum class TokenType : uint8_t
+    {
+        Null,
+        Boolean,
+        Number,
+        String,
+        Object,
+        Array,
+        Invalid     // parse error or end of the document
+    };
+
+    class StreamReader
+    {
+    public:
+        // Saved reader state, see Save() and Restore().
+        struct Position
+        {
+            size_t offset = 0;
+            size_t depth = 0;
+        };
+
+        StreamReader(const char* begin, const char* end);
+        ~StreamReader();
+
+        // Type of the next value ; skips whitespace and comments.
+        [[nodiscard]] TokenType Peek();
+
+        // Consumes the '{' of an object. Members are then read with NextMember()
+        // followed by one of the value functions.
+        bool EnterObject();
+
+        // Reads the next key of the current object. Returns false once the
+        // closing '}' has been consumed, or on error.
+        bool NextMember(std::string_view& key);
+        bool NextMember(const KeyTable& keys, int& keyId);
+
+        // Consumes the '[' of an array. Elements are read with NextElement()
+        // followed by one of the value functions.
+        bool EnterArray();
+
+        // Returns false once the closing ']' has been consumed, or on error.
+        bool NextElement();
+
+        // Reads a null, boolean, number or string. Objects and arrays are
+        // skipped and reported as an empty Json::objectValue / arrayValue, so
+        // that type checks on the result behave like on the full value.
+        bool ReadScalar(Json::Value& value);
+
+        // Reads any value, building a Json::Value tree for objects and arrays.
+        bool ReadValue(Json::Value& value);
+
+        // Skips over the next value.
+        bool Skip();
+
+        // Skips over the next value and returns its extent in the document.
+        bool SkipSpan(const char*& begin, const char*& end);
+
+        [[nodiscard]] Position Save() const;
+        void Restore(const Position& position);
+
+        [[nodiscard]] size_t GetOffset() const { return size_t(m_Current - m_Begin); }
+
+        [[nodiscard]] bool HasError() const { return !m_Error.empty(); }
+        [[nodiscard]] const std::string& GetError() const { return m_Error; }
+
+    private:
+        bool SkipWhitespace();
+        bool ReadString(std::string_view& result);
+        bool ScanString(const char*& contentBegin, const char*& contentEnd, bool& hasEscapes);
+        bool ScanNumber(const char*& numberEnd);
+        bool ScanLiteral(const char* literal);
+        bool SkipValue(size_t depth);
+        bool SetError(const char* message);
+
+        const char* m_Begin;
+        const char* m_Current;
+        const char* m_End;
+
+        // one entry per open container : true until its first member / element
+        std::vector<bool> m_First;
+
+        std::string m_Scratch;   // unescaped keys
+        std::string m_Error;
+
+        std::unique_ptr<Json::CharReader> m_DomReader;
+    };
+
+    // Parses a complete document with the settings of json::LoadFromFile.
+    bool Parse(const char* begin, const char* end, Json::Value& value, std::string* errors = nullptr);
+}
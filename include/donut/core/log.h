@@ -22,7 +22,11 @@
 
 #pragma once
 
+#include <cstdint>
 #include <functional>
+#include <memory>
+#include <string>
+#include <vector>
 
 namespace donut::log
 {
@@ -50,4 +54,59 @@ namespace donut::log
     void warning(const char* fmt...);
     void error(const char* fmt...);
     void fatal(const char* fmt...);
+
+    // Asynchronous backend.
+    //
+    // While it is running, the logging functions only format the message and push it into a
+    // bounded ring that belongs to the calling thread; no lock is taken unless the ring is full
+    // and the overflow policy is Block. A background thread drains the rings, applies the rate
+    // limit, and writes the records to the sinks. A callback installed with SetCallback keeps
+    // receiving every message, but it is called from the background thread; the default callback
+    // is only used when there are no sinks. Fatal messages are never dropped, and they are
+    // flushed before the process is aborted.
+
+    struct Record
+    {
+        Severity severity = Severity::None;
+        uint64_t timestampUs = 0;       // microseconds since the Unix epoch
+        uint32_t threadId = 0;          // sequential, in the order in which threads first log something
+        uint32_t suppressedRepeats = 0; // identical messages dropped by the rate limiter since the last one that got through
+        std::string text;
+    };
+
+    // Sinks are only called from the logging thread. See log_sinks.h for the standard ones.
+    class ISink
+    {
+    public:
+        virtual void Write(const Record& record) = 0;
+        virtual void Flush() { }
+        virtual ~ISink() = default;
+    };
+
+    // Formats a record as "hh:mm:ss.mmm [thread] SEVERITY: text" into the buffer, returns the length.
+    size_t FormatRecord(const Record& record, char* buffer, size_t bufferSize);
+
+    enum class OverflowPolicy
+    {
+        Drop,   // discard the message and count it, see GetDroppedMessageCount
+        Block   // wait until the logging thread has made room
+    };
+
+    struct AsyncDesc
+    {
+        std::vector<std::shared_ptr<ISink>> sinks;
+        uint32_t threadRingCapacity = 1024;     // records per thread, rounded up to a power of 2
+        OverflowPolicy overflowPolicy = OverflowPolicy::Drop;
+        uint32_t rateLimitWindowMs = 1000;      // 0 disables rate limiting
+        uint32_t rateLimitMaxRepeats = 10;      // identical messages let through per window
+    };
+
+    // Starts the backend, or restarts it with new settings.
+    void StartAsync(const AsyncDesc& desc);
+    // Writes out all pending messages and stops the logging thread.
+    void StopAsync();
+    [[nodiscard]] bool IsAsync();
+    // Blocks until all messages logged by the calling thread before the call have been written.
+    void Flush();
+    [[nodiscard]] uint64_t GetDroppedMessageCount();
 }
@@ -0,0 +1,82 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/core/log.h>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+
+namespace donut::log
+{
+    // Same output as the default callback: stderr, or the debugger output and message boxes on Windows
+    class ConsoleSink : public ISink
+    {
+    public:
+        void Write(const Record& record) override;
+    };
+
+    // Writes to a file and rotates it to <name>.1, <name>.2 ... when it grows beyond maxBytes.
+    class RotatingFileSink : public ISink
+    {
+    private:
+        std::filesystem::path m_Path;
+        size_t m_MaxBytes;
+        uint32_t m_MaxFiles;
+        FILE* m_File = nullptr;
+        size_t m_Bytes = 0;
+
+        void Rotate();
+
+    public:
+        RotatingFileSink(const std::filesystem::path& path, size_t maxBytes = 16 << 20, uint32_t maxFiles = 4);
+        ~RotatingFileSink() override;
+
+        [[nodiscard]] bool IsOpen() const { return m_File != nullptr; }
+
+        void Write(const Record& record) override;
+        void Flush() override;
+    };
+
+    // Keeps the most recent records, e.g. for an in-game console. Can be read from any thread.
+    class MemorySink : public ISink
+    {
+    private:
+        mutable std::mutex m_Mutex;
+        std::deque<Record> m_Records;
+        size_t m_Capacity;
+        uint64_t m_TotalCount = 0;
+
+    public:
+        explicit MemorySink(size_t capacity = 1024) : m_Capacity(capacity) { }
+
+        void Write(const Record& record) override;
+
+        // Returns the stored records written after the given total count, and updates the count.
+        // Use a count of 0 to get everything that is stored.
+        std::vector<Record> GetRecords(uint64_t& count) const;
+        [[nodiscard]] uint64_t GetTotalCount() const;
+        void Clear();
+    };
+}
@@ -0,0 +1,97 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace donut::math
+{
+    // Conversions between 32-bit floats and the bits of 16-bit (IEEE half precision) floats,
+    // for filling R16_FLOAT / RGBA16_FLOAT textures on the CPU. Rounds to nearest even.
+
+    inline uint16_t floatToHalf(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+
+        const uint32_t sign = (bits >> 16) & 0x8000;
+        const int32_t exponent = int32_t((bits >> 23) & 0xff) - 127 + 15;
+        uint32_t mantissa = bits & 0x007fffff;
+
+        if (((bits >> 23) & 0xff) == 0xff) // Inf, NaN
+            return uint16_t(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+        if (exponent >= 31) // overflow to Inf
+            return uint16_t(sign | 0x7c00);
+        if (exponent <= 0) // denormal or zero
+        {
+            if (exponent < -10)
+                return uint16_t(sign);
+            mantissa |= 0x00800000;
+            const uint32_t shift = uint32_t(14 - exponent);
+            uint32_t half = mantissa >> shift;
+            // round to nearest even
+            const uint32_t remainder = mantissa & ((1u << shift) - 1);
+            const uint32_t halfway = 1u << (shift - 1);
+            if (remainder > halfway || (remainder == halfway && (half & 1)))
+                ++half;
+            return uint16_t(sign | half);
+        }
+
+        uint32_t half = sign | (uint32_t(exponent) << 10) | (mantissa >> 13);
+        const uint32_t remainder = mantissa & 0x1fff;
+        if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+            ++half; // may carry into the exponent, which is the correct rounding
+        return uint16_t(half);
+    }
+
+    inline float halfToFloat(uint16_t value)
+    {
+        const uint32_t sign = uint32_t(value & 0x8000) << 16;
+        uint32_t exponent = (value >> 10) & 0x1f;
+        uint32_t mantissa = value & 0x3ff;
+
+        uint32_t bits;
+        if (exponent == 0x1f)
+            bits = sign | 0x7f800000 | (mantissa << 13);
+        else if (exponent != 0)
+            bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+        else if (mantissa == 0)
+            bits = sign;
+        else
+        {
+            // normalize the denormal
+            exponent = 127 - 15 + 1;
+            while ((mantissa & 0x400) == 0)
+            {
+                mantissa <<= 1;
+                --exponent;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+        }
+
+        float result;
+        memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+}
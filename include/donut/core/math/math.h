@@ -34,3 +34,4 @@ namespace dm = donut::math;
 #include "quat.h"
 #include "sphere.h"
 #include "frustum.h"
+#include "half.h"
@@ -0,0 +1,92 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#else
+namespace tf
+{
+    class Executor;
+}
+#endif
+
+namespace donut::core
+{
+    // Calls func(index) for every index in [0, count). With an executor and more than one index,
+    // the calls are spread over the executor's workers and this returns when all of them are done;
+    // otherwise they run in order on the calling thread. Without DONUT_WITH_TASKFLOW the executor is ignored.
+    template<typename Func>
+    void ParallelFor(tf::Executor* executor, size_t count, Func&& func)
+    {
+#ifdef DONUT_WITH_TASKFLOW
+        if (executor && count > 1)
+        {
+            tf::Taskflow taskflow;
+            taskflow.for_each_index(size_t(0), count, size_t(1), func);
+            executor->run(taskflow).wait();
+            return;
+        }
+#else
+        (void)executor;
+#endif
+
+        for (size_t i = 0; i < count; i++)
+            func(i);
+    }
+
+    // The same for code that has no executor, such as donut_core, which is built without TaskFlow:
+    // the calls are spread over at most maxThreads threads, one of which is the calling thread.
+    template<typename Func>
+    void ParallelFor(unsigned maxThreads, size_t count, Func&& func)
+    {
+        unsigned threadCount = unsigned(std::min<size_t>(std::min(maxThreads, std::max(1u, std::thread::hardware_concurrency())), count));
+
+        if (threadCount <= 1)
+        {
+            for (size_t i = 0; i < count; i++)
+                func(i);
+            return;
+        }
+
+        std::atomic<size_t> next = 0;
+        auto worker = [&]()
+        {
+            for (size_t i = next++; i < count; i = next++)
+                func(i);
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(threadCount - 1);
+        for (unsigned i = 0; i < threadCount - 1; i++)
+            threads.emplace_back(worker);
+        worker();
+        for (auto& thread : threads)
+            thread.join();
+    }
+}
@@ -0,0 +1,194 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/core/circular_buffer.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Hierarchical frame profiler.
+//
+// CPU scopes are recorded into per-thread single-producer rings, so opening
+// and closing a scope never takes a lock. The rings are drained once per frame
+// by Profiler::EndFrame(), which updates the rolling per-scope statistics and,
+// while a capture is active, keeps the raw events for Chrome trace export.
+//
+// GPU durations are produced elsewhere (see engine/GpuProfiler.h) and fed in
+// through Profiler::AddGpuEvents() once the timer queries have resolved.
+//
+// When DONUT_WITH_PROFILER is not defined, the scope macros and the hot-path
+// functions compile to nothing.
+
+namespace donut::profiler
+{
+    enum class Track : uint8_t
+    {
+        Cpu,
+        Gpu
+    };
+
+    constexpr size_t c_MaxEventNameLength = 48;
+    constexpr size_t c_MaxScopeDepth = 64;
+    constexpr size_t c_ThreadRingCapacity = 4096; // events, must be a power of 2
+    constexpr size_t c_HistoryLength = 128;       // frames
+
+    struct Event
+    {
+        char name[c_MaxEventNameLength];
+        uint64_t beginNs;
+        uint64_t endNs;
+        uint32_t threadId;
+        uint16_t depth;
+        Track track;
+    };
+
+    struct ScopeStats
+    {
+        std::string name;
+        Track track = Track::Cpu;
+        uint32_t depth = 0;
+        uint32_t callCount = 0;   // in the most recent frame that contained the scope
+        double lastMs = 0.0;
+        double averageMs = 0.0;   // over the history window
+        double maxMs = 0.0;       // over the history window
+        core::circular_buffer<float, c_HistoryLength> history;
+    };
+
+    struct CapturedFrame
+    {
+        uint64_t frameIndex = 0;
+        uint64_t beginNs = 0;
+        uint64_t endNs = 0;
+        std::vector<Event> events;
+    };
+
+    // nanoseconds since the profiler epoch (process start)
+    uint64_t GetTimestampNs();
+
+    class Profiler
+    {
+    public:
+        static Profiler& Get();
+
+        // Marks the start of a frame. Events recorded before the matching
+        // EndFrame() are attributed to this frame.
+        void BeginFrame();
+
+        // Drains all thread rings, updates scope statistics and the capture.
+        void EndFrame();
+
+        [[nodiscard]] uint64_t GetFrameIndex() const { return m_FrameIndex; }
+
+        // GPU events arrive a few frames late; their timestamps are relative to the
+        // start of the frame with the given index.
+        void AddGpuEvents(uint64_t frameIndex, const Event* events, size_t count);
+
+        // Sum of the top-level GPU scopes of a recent frame, or a negative value
+        // if the timings of that frame have not arrived (yet).
+        [[nodiscard]] double GetGpuFrameTimeMs(uint64_t frameIndex) const;
+
+        // Starts recording the raw events of the next 'frameCount' frames.
+        void BeginCapture(uint32_t frameCount);
+        [[nodiscard]] bool IsCapturing() const;
+        [[nodiscard]] size_t GetCapturedFrameCount() const;
+        void ClearCapture();
+
+        // Writes the captured frames in the Chrome trace event format
+        // (chrome://tracing, Perfetto).
+        void ExportChromeTrace(std::ostream& stream) const;
+        bool ExportChromeTrace(const std::filesystem::path& fileName) const;
+
+        // Returns a snapshot of the statistics, CPU scopes first, in first-seen order.
+        [[nodiscard]] std::vector<ScopeStats> GetScopeStats() const;
+        void ResetScopeStats();
+
+        [[nodiscard]] uint64_t GetDroppedEventCount() const;
+
+    private:
+        Profiler() = default;
+
+        void AccumulateFrame(const std::vector<Event>& events, Track track);
+        static void MakeStatsKey(const Event& event, std::string& key);
+
+        mutable std::mutex m_Mutex;
+
+        uint64_t m_FrameIndex = 0;
+        uint64_t m_FrameBeginNs = 0;
+        std::vector<Event> m_FrameEvents;
+
+        std::unordered_map<std::string, size_t> m_StatsIndex;
+        std::vector<ScopeStats> m_Stats;
+
+        uint32_t m_CaptureFramesRemaining = 0;
+        std::vector<CapturedFrame> m_Capture;
+
+        core::circular_buffer<std::pair<uint64_t, double>, 32> m_GpuFrameTimes;
+
+        uint64_t m_DroppedEvents = 0;
+    };
+
+#ifdef DONUT_WITH_PROFILER
+
+    void BeginScope(const char* name);
+    void EndScope();
+
+    // Names the calling thread in exported traces.
+    void SetThreadName(const char* name);
+
+#else
+
+    inline void BeginScope(const char*) { }
+    inline void EndScope() { }
+    inline void SetThreadName(const char*) { }
+
+#endif
+
+    class ScopedMarker
+    {
+    public:
+        explicit ScopedMarker(const char* name) { BeginScope(name); }
+        ~ScopedMarker() { EndScope(); }
+
+        ScopedMarker(const ScopedMarker&) = delete;
+        ScopedMarker& operator=(const ScopedMarker&) = delete;
+    };
+}
+
+#define DONUT_PROFILER_CONCAT_IMPL(a, b) a##b
+#define DONUT_PROFILER_CONCAT(a, b) DONUT_PROFILER_CONCAT_IMPL(a, b)
+
+#ifdef DONUT_WITH_PROFILER
+#define DONUT_PROFILE_SCOPE(name) donut::profiler::ScopedMarker DONUT_PROFILER_CONCAT(donutProfilerScope_, __LINE__)(name)
+#define DONUT_PROFILE_FUNCTION() DONUT_PROFILE_SCOPE(__FUNCTION__)
+#else
+#define DONUT_PROFILE_SCOPE(name) do { } while (false)
+#define DONUT_PROFILE_FUNCTION() do { } while (false)
+#endif
@@ -26,6 +26,8 @@
 #include <string>
 #include <filesystem>
 #include <functional>
+#include <mutex>
+#include <string_view>
 #include <vector>
 
 /* 
@@ -145,18 +147,70 @@ namespace donut::vfs
         int enumerateDirectories(const std::filesystem::path& path, enumerate_callback_t callback, bool allowDuplicates = false) override;
     };
 
+    // A virtual path that is normalized once, when it is created, see normalizePath.
+    // RootFileSystem resolves it without normalizing again, so keep it around for paths that are
+    // requested many times, e.g. by a cache.
+    class VirtualPath
+    {
+    private:
+        std::string m_Path;
+
+    public:
+        VirtualPath() = default;
+        explicit VirtualPath(std::string_view path);
+        explicit VirtualPath(const char* path) : VirtualPath(std::string_view(path)) { }
+        explicit VirtualPath(const std::filesystem::path& path);
+
+        [[nodiscard]] const std::string& str() const { return m_Path; }
+        [[nodiscard]] bool empty() const { return m_Path.empty(); }
+        [[nodiscard]] std::filesystem::path path() const { return m_Path; }
+
+        bool operator==(const VirtualPath& other) const { return m_Path == other.m_Path; }
+        bool operator!=(const VirtualPath& other) const { return m_Path != other.m_Path; }
+    };
+
     // A virtual file system that allows mounting, or attaching, other VFS objects to paths.
     // Does not have any file systems by default, all of them must be mounted first.
+    //
+    // Requests are resolved to the mount point with the longest matching path prefix, using a hash
+    // of the mount paths, one lookup per directory level. The mount table is an immutable snapshot
+    // that is replaced when mounts change, so concurrent requests don't take any locks.
+    //
+    // Several file systems can be mounted at the same path as overlay layers, e.g. for patches or mods.
+    // Reads go to the layer with the highest priority that has the file, writes to the top layer,
+    // and enumeration merges all layers.
     class RootFileSystem : public IFileSystem
     {
     private:
-        std::vector<std::pair<std::string, std::shared_ptr<IFileSystem>>> m_MountPoints;
+        struct MountTable;
+        struct MountLayer;
+
+        std::shared_ptr<const MountTable> m_MountTable;
+        std::mutex m_MountMutex; // serializes the changes to the mount table
+        uint64_t m_MountCounter = 0;
+
+        [[nodiscard]] std::shared_ptr<const MountTable> getMountTable() const;
+        bool addLayer(const std::filesystem::path& path, std::shared_ptr<IFileSystem> fs, int priority, bool overlay);
+        bool removeLayers(const std::filesystem::path& path, const IFileSystem* fs);
+
+        bool folderExistsNormalized(std::string_view name) const;
+        bool fileExistsNormalized(std::string_view name) const;
+        std::shared_ptr<IBlob> readFileNormalized(std::string_view name) const;
+        bool writeFileNormalized(std::string_view name, const void* data, size_t size) const;
 
-        bool findMountPoint(const std::filesystem::path& path, std::filesystem::path* pRelativePath, IFileSystem** ppFS);
     public:
+        RootFileSystem();
+        ~RootFileSystem() override;
+
         void mount(const std::filesystem::path& path, std::shared_ptr<IFileSystem> fs);
         void mount(const std::filesystem::path& path, const std::filesystem::path& nativePath);
+        // Adds a layer at 'path', which can already have a mount point. Layers with a higher priority
+        // take precedence; for equal priorities, the layer mounted last does.
+        bool mountOverlay(const std::filesystem::path& path, std::shared_ptr<IFileSystem> fs, int priority = 0);
+        // Removes all the layers mounted at 'path'.
         bool unmount(const std::filesystem::path& path);
+        // Removes one layer mounted at 'path'.
+        bool unmount(const std::filesystem::path& path, const std::shared_ptr<IFileSystem>& fs);
 
 		bool folderExists(const std::filesystem::path& name) override;
         bool fileExists(const std::filesystem::path& name) override;
@@ -164,7 +218,17 @@ namespace donut::vfs
         bool writeFile(const std::filesystem::path& name, const void* data, size_t size) override;
         int enumerateFiles(const std::filesystem::path& path, const std::vector<std::string>& extensions, enumerate_callback_t callback, bool allowDuplicates = false) override;
         int enumerateDirectories(const std::filesystem::path& path, enumerate_callback_t callback, bool allowDuplicates = false) override;
+
+        // Same as the functions above, for paths that are already normalized
+        bool folderExists(const VirtualPath& name);
+        bool fileExists(const VirtualPath& name);
+        std::shared_ptr<IBlob> readFile(const VirtualPath& name);
+        bool writeFile(const VirtualPath& name, const void* data, size_t size);
     };
 
+    // Lexical normalization of virtual paths: '/' separators, no empty or '.' components, '..' resolved
+    // where possible, no trailing separator. Writes into 'result', whose storage is reused.
+    void normalizePath(std::string_view path, std::string& result);
+
     std::string getFileSearchRegex(const std::filesystem::path& path, const std::vector<std::string>& extensions);
 }
\ No newline at end of file
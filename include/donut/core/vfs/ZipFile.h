@@ -23,7 +23,7 @@
 #pragma once
 
 #include <donut/core/vfs/VFS.h>
-#include <mutex>
+#include <cstdint>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -33,6 +33,11 @@ namespace donut::vfs
     A read-only file system that provides access to files in a zip archive.
     ZipFile can only operate on real files, i.e. underlying virtual file systems are not supported.
 
+    The central directory is parsed once when the archive is opened. After that, readFile keeps no
+    shared state: each call reads the compressed data with positional reads that don't move a shared
+    file cursor, and inflates it with its own decompressor, so any number of threads can read from
+    the same archive concurrently.
+
     Note: zip file support is provided because it's a ubiquitous standard. Reading large assets
     from zip files is very slow compared to other storage methods. Donut supports reading assets
     compressed with LZ4 and stored in tar archives, which is significantly faster, in part because 
@@ -42,16 +47,24 @@ namespace donut::vfs
     {
     private:
         std::string m_ArchivePath;
-        std::mutex m_Mutex;
 
-        // mz_zip_archive* really
-        // void* because we don't want to include miniz here and can't forward declare the mz_aip_archive struct
-        void* m_ZipArchive = nullptr;
-        
-        std::unordered_map<std::string, uint32_t> m_Files; // name -> index in zip file
+        // int file descriptor or HANDLE, depending on the platform
+        intptr_t m_FileHandle = -1;
+
+        struct FileEntry
+        {
+            uint64_t localHeaderOffset = 0;
+            uint64_t compressedSize = 0;
+            uint64_t uncompressedSize = 0;
+            uint32_t crc32 = 0;
+            uint16_t method = 0;
+        };
+
+        std::unordered_map<std::string, FileEntry> m_Files;
         std::unordered_set<std::string> m_Directories;
 
         void close();
+        bool readAt(void* buffer, uint64_t offset, size_t size) const;
         
     public:
         ZipFile(const std::filesystem::path& archivePath);
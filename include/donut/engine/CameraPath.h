@@ -0,0 +1,93 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/engine/KeyframeAnimation.h>
+#include <filesystem>
+#include <memory>
+#include <optional>
+
+namespace Json
+{
+    class Value;
+}
+
+namespace donut::vfs
+{
+    class IFileSystem;
+}
+
+namespace donut::engine
+{
+    struct CameraPathPose
+    {
+        dm::float3 position = 0.f;
+        dm::float3 target = dm::float3(0.f, 0.f, 1.f);
+        dm::float3 up = dm::float3(0.f, 1.f, 0.f);
+        std::optional<float> verticalFov; // degrees
+    };
+
+    /*
+    CameraPath is a camera fly-through stored as an animation::Sequence with
+    the tracks "position", "target", "up" and (optionally) "vfov".
+
+    The JSON format is:
+    {
+        "mode": "spline",  // or "linear", "step"; applies to all tracks
+        "keyframes": [
+            { "time": 0.0, "position": [0, 1, 0], "target": [0, 1, 1], "up": [0, 1, 0], "vfov": 60 },
+            ...
+        ]
+    }
+    "up" and "vfov" are optional on every keyframe.
+    */
+    class CameraPath
+    {
+    public:
+        CameraPath();
+
+        bool Load(vfs::IFileSystem& fs, const std::filesystem::path& fileName);
+        bool Load(const Json::Value& root);
+
+        void SetInterpolationMode(animation::InterpolationMode mode);
+
+        // Keyframes must be added in increasing time order.
+        void AddKeyframe(float time, const dm::float3& position, const dm::float3& target,
+            const dm::float3& up = dm::float3(0.f, 1.f, 0.f), std::optional<float> verticalFov = std::nullopt);
+
+        // The time is clamped to [0, duration].
+        [[nodiscard]] CameraPathPose Evaluate(float time) const;
+
+        [[nodiscard]] float GetDuration() const { return m_Sequence.GetDuration(); }
+        [[nodiscard]] bool IsEmpty() const { return m_Position->GetKeyframes().empty(); }
+
+        [[nodiscard]] const animation::Sequence& GetSequence() const { return m_Sequence; }
+
+    private:
+        animation::Sequence m_Sequence;
+        std::shared_ptr<animation::Sampler> m_Position;
+        std::shared_ptr<animation::Sampler> m_Target;
+        std::shared_ptr<animation::Sampler> m_Up;
+        std::shared_ptr<animation::Sampler> m_VerticalFov;
+    };
+}
@@ -42,4 +42,10 @@ namespace donut::engine
     nvrhi::TextureHandle CreateDDSTextureFromMemory(nvrhi::IDevice* device, nvrhi::ICommandList* commandList, std::shared_ptr<vfs::IBlob> data, const char* debugName = nullptr, bool forceSRGB = false);
 
     std::shared_ptr<vfs::IBlob> SaveStagingTextureAsDDS(nvrhi::IDevice* device, nvrhi::IStagingTexture* stagingTexture);
+
+    // Creates a DDS file for a 2D texture from the data of its mip levels, each one tightly packed (rows of pixels or blocks).
+    std::shared_ptr<vfs::IBlob> CreateDDSFromMemory(nvrhi::Format format, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& mipLevels);
+
+    // Creates a DDS file for a cubemap; 'subresources' holds the tightly packed mip levels of face +X, then -X, +Y, -Y, +Z, -Z.
+    std::shared_ptr<vfs::IBlob> CreateDDSCubemapFromMemory(nvrhi::Format format, uint32_t size, uint32_t mipLevels, const std::vector<std::vector<uint8_t>>& subresources);
 }
\ No newline at end of file
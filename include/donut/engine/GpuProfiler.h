@@ -0,0 +1,104 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/core/profiler.h>
+#include <nvrhi/nvrhi.h>
+
+#include <array>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace donut::engine
+{
+    /*
+    GpuProfiler measures the GPU duration of marked regions with timer queries
+    and forwards the resolved timings to profiler::Profiler, a few frames after
+    they were recorded.
+
+    Queries are pooled per frame slot. BeginFrame() must be called once per frame,
+    before any scope is recorded; it reads back the oldest slot and reuses it.
+
+    Only durations are available from nvrhi timer queries, so the events are laid
+    out back-to-back inside their parent scope, starting at the frame origin.
+    Scopes are expected to be recorded from the rendering thread.
+    */
+    class GpuProfiler
+    {
+    public:
+        static constexpr uint32_t c_FrameSlots = 4;
+
+        explicit GpuProfiler(nvrhi::IDevice* device, uint32_t maxScopesPerFrame = 256);
+        ~GpuProfiler();
+
+        void BeginFrame();
+
+        void BeginScope(nvrhi::ICommandList* commandList, const char* name);
+        void EndScope(nvrhi::ICommandList* commandList);
+
+        void SetEnabled(bool enabled) { m_Enabled = enabled; }
+        [[nodiscard]] bool IsEnabled() const { return m_Enabled; }
+
+        // number of frames whose queries had not resolved when their slot was reused
+        [[nodiscard]] uint64_t GetSkippedFrameCount() const { return m_SkippedFrames; }
+
+        // The active profiler receives the scopes from BeginMarker / EndMarker.
+        static void SetActive(GpuProfiler* profiler);
+        static GpuProfiler* GetActive();
+
+    private:
+        struct Scope
+        {
+            char name[profiler::c_MaxEventNameLength];
+            uint32_t queryIndex;
+            uint16_t depth;
+            bool closed;
+        };
+
+        struct FrameSlot
+        {
+            uint64_t frameIndex = 0;
+            std::vector<nvrhi::TimerQueryHandle> queries;
+            std::vector<Scope> scopes;
+            std::vector<uint32_t> openScopes;
+            bool pending = false;
+        };
+
+        bool ResolveSlot(FrameSlot& slot);
+
+        nvrhi::DeviceHandle m_Device;
+        uint32_t m_MaxScopesPerFrame;
+        std::array<FrameSlot, c_FrameSlots> m_Slots;
+        uint32_t m_CurrentSlot = 0;
+        bool m_FrameStarted = false;
+        bool m_Enabled = true;
+        uint64_t m_SkippedFrames = 0;
+        std::mutex m_Mutex;
+    };
+
+    // Opens a debug marker on the command list together with a CPU profiler scope
+    // and, when a GpuProfiler is active, a GPU timing scope.
+    void BeginMarker(nvrhi::ICommandList* commandList, const char* name);
+    void EndMarker(nvrhi::ICommandList* commandList);
+}
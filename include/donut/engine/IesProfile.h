@@ -23,11 +23,20 @@
 #pragma once
 
 #include <nvrhi/nvrhi.h>
+#include <cstdint>
 #include <memory>
 #include <filesystem>
+#include <unordered_map>
+#include <vector>
+
+namespace tf
+{
+    class Executor;
+}
 
 namespace donut::vfs
 {
+    class IBlob;
     class IFileSystem;
 }
 
@@ -36,14 +45,33 @@ namespace donut::engine
     class ShaderFactory;
     class DescriptorTableManager;
 
+    // Resolution of the resampled profiles: X is the vertical angle (0..180 degrees),
+    // Y is the horizontal angle (-180..180 degrees).
+    constexpr uint32_t c_IesProfileTextureSize = 128;
+
     struct IesProfile
     {
         std::string name;
         std::vector<float> rawData;
         nvrhi::TextureHandle texture;
-        int textureIndex;
+        int textureIndex = -1;
+        uint64_t contentHash = 0;   // hash of rawData, equal for identical profiles loaded from different files
+        int atlasSlice = -1;        // slice of 'texture' when the profile is part of an atlas
     };
 
+    // Parses the contents of an IES (LM-63) file. Returns nullptr if the file is not supported.
+    std::shared_ptr<IesProfile> ParseIesProfile(const vfs::IBlob& file, const std::string& name);
+
+    // Resamples the raw profile data into c_IesProfileTextureSize^2 texels, normalized to the maximum candela value.
+    // This is the CPU equivalent of ies_profile_cs.hlsl. Returns false if the data is malformed.
+    bool ResampleIesProfile(const std::vector<float>& rawData, float* output);
+
+    // Resamples the distinct profiles (by content hash) into consecutive atlas slices, in parallel if an executor
+    // is provided, and sets the atlasSlice of every profile. Returns the number of slices written to 'texels';
+    // profiles with malformed data get no slice. The results don't depend on the executor.
+    uint32_t BuildIesProfileAtlas(const std::vector<std::shared_ptr<IesProfile>>& profiles, std::vector<float>& texels,
+        tf::Executor* executor = nullptr);
+
     class IesProfileLoader
     {
         nvrhi::DeviceHandle m_Device;
@@ -54,15 +82,38 @@ namespace donut::engine
         std::shared_ptr<donut::engine::ShaderFactory> m_ShaderFactory;
         std::shared_ptr<donut::engine::DescriptorTableManager> m_DescriptorTableManager;
 
+        // Profiles by content hash, so that identical files share one profile object
+        std::unordered_map<uint64_t, std::weak_ptr<IesProfile>> m_LoadedProfiles;
+
+        nvrhi::TextureHandle m_Atlas;
+        int m_AtlasTextureIndex = -1;
+        std::vector<std::weak_ptr<IesProfile>> m_AtlasProfiles; // the profiles that reference m_Atlas
+
+        void ReleaseTextureDescriptor(IesProfile& profile);
+
     public:
         IesProfileLoader(
             nvrhi::IDevice* device,
             std::shared_ptr<donut::engine::ShaderFactory> shaderFactory,
             std::shared_ptr<donut::engine::DescriptorTableManager> descriptorTableManager);
+        ~IesProfileLoader();
 
+        // Returns the previously loaded profile if a file with the same contents was loaded from another path.
         std::shared_ptr<IesProfile> LoadIesProfile(donut::vfs::IFileSystem& fs, const std::filesystem::path& path);
 
+        // Creates a separate texture for the profile and resamples it on the GPU.
         void BakeIesProfile(IesProfile& profile, nvrhi::ICommandList* commandList);
+
+        // Resamples all profiles on the CPU and uploads them into one R16_FLOAT texture array, with one slice per
+        // distinct profile and one bindless descriptor for the whole array. Every profile gets the atlas as its
+        // texture, the atlas descriptor as its textureIndex, and its slice in atlasSlice.
+        // Replaces the atlas created by a previous call: the profiles of that atlas that are not in the new one,
+        // including the malformed ones, are left without a texture.
+        nvrhi::TextureHandle BakeIesProfileAtlas(const std::vector<std::shared_ptr<IesProfile>>& profiles,
+            nvrhi::ICommandList* commandList, tf::Executor* executor = nullptr);
+
+        [[nodiscard]] nvrhi::ITexture* GetAtlas() const { return m_Atlas; }
+        [[nodiscard]] int GetAtlasTextureIndex() const { return m_AtlasTextureIndex; }
     };
 
 }
\ No newline at end of file
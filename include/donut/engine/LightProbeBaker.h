@@ -0,0 +1,112 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/engine/SphericalHarmonics.h>
+#include <nvrhi/nvrhi.h>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+namespace tf
+{
+    class Executor;
+}
+
+namespace donut::vfs
+{
+    class IFileSystem;
+}
+
+namespace donut::engine
+{
+    struct LightProbe;
+
+    // Offline baking of light probes on the CPU. A probe is baked from its captured radiance into
+    // - diffuse irradiance as L2 spherical harmonics, which replaces the diffuse cubemap, and
+    // - a prefiltered specular cubemap with one roughness per mip level, computed with the same GGX importance
+    //   sampling as LightProbeProcessingPass::RenderSpecularMap.
+    // Baked probes are stored in a LightProbeCache and uploaded into LightProbe objects at runtime,
+    // so that the probes don't have to be rendered and filtered every time the application starts.
+
+    struct LightProbeBakeSettings
+    {
+        uint32_t specularSize = 128;        // face size of the first specular mip level
+        uint32_t specularMipLevels = 6;     // roughness goes from 0 at the first to 1 at the last level, squared
+        uint32_t sampleCount = 64;          // GGX samples per specular texel
+    };
+
+    struct BakedLightProbe
+    {
+        SphericalHarmonicsL2 diffuseIrradiance;     // see SphericalHarmonicsL2::ConvolveWithCosineLobe
+        std::vector<CubemapImage> specularMips;
+    };
+
+    // Roughness that the given specular mip level is filtered for.
+    float GetLightProbeMipRoughness(uint32_t mipLevel, uint32_t mipLevels);
+
+    BakedLightProbe BakeLightProbe(const CubemapImage& radiance, const LightProbeBakeSettings& settings, tf::Executor* executor = nullptr);
+
+    // Bakes many probes at once; the faces and mip levels of all probes are distributed over the executor.
+    std::vector<BakedLightProbe> BakeLightProbes(const std::vector<const CubemapImage*>& radiance,
+        const LightProbeBakeSettings& settings, tf::Executor* executor = nullptr);
+
+    // Reads a cubemap (6 array slices starting at 'baseArraySlice') from a staging texture
+    // with the RGBA16_FLOAT or RGBA32_FLOAT format, e.g. a rendered probe copied with copyTexture.
+    bool ReadCubemapFromStagingTexture(nvrhi::IDevice* device, nvrhi::IStagingTexture* stagingTexture,
+        uint32_t baseArraySlice, uint32_t mipLevel, CubemapImage& result);
+
+    // Writes the specular mip levels into the probe's specular cubemap array, at 'specularArrayIndex',
+    // and makes the probe use the baked diffuse irradiance. The face size must match the texture,
+    // which must have at least as many mip levels as the baked probe.
+    bool UploadBakedLightProbe(nvrhi::ICommandList* commandList, const BakedLightProbe& baked, LightProbe& probe);
+
+    // On-disk cache of baked probes. Each entry is stored under a 64-bit content key as two files:
+    // <key>.dds with the specular mip chain (RGBA16_FLOAT cubemap) and <key>.sh with the irradiance SH.
+    class LightProbeCache
+    {
+    private:
+        std::shared_ptr<vfs::IFileSystem> m_FS;
+        std::filesystem::path m_Directory;
+
+    public:
+        LightProbeCache(std::shared_ptr<vfs::IFileSystem> fs, const std::filesystem::path& directory);
+
+        // Hashes arbitrary content that determines the probe, e.g. the scene file and the probe position,
+        // together with the bake settings and the cache format version.
+        [[nodiscard]] static uint64_t ComputeKey(const void* content, size_t size, const LightProbeBakeSettings& settings);
+        [[nodiscard]] static uint64_t ComputeKey(const CubemapImage& radiance, const LightProbeBakeSettings& settings);
+
+        [[nodiscard]] std::filesystem::path GetSpecularPath(uint64_t key) const;
+        [[nodiscard]] std::filesystem::path GetIrradiancePath(uint64_t key) const;
+
+        // Returns false if the entry is missing or unreadable.
+        bool Load(uint64_t key, BakedLightProbe& result) const;
+        bool Store(uint64_t key, const BakedLightProbe& probe) const;
+
+        // Loads the probes whose radiance is in the cache, bakes the others in parallel and stores them.
+        std::vector<BakedLightProbe> BakeOrLoad(const std::vector<const CubemapImage*>& radiance,
+            const LightProbeBakeSettings& settings, tf::Executor* executor = nullptr, size_t* pBakedCount = nullptr) const;
+    };
+}
@@ -24,8 +24,12 @@
 
 #include <donut/engine/SceneTypes.h>
 #include <nvrhi/nvrhi.h>
-#include <unordered_map>
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <unordered_map>
+#include <vector>
 
 namespace donut::engine
 {
@@ -47,22 +51,67 @@ namespace donut::engine
         uint32_t slot; // type depends on resource
     };
 
+    // Caches one binding set per material.
+    //
+    // Entries are keyed by Material::uniqueID and remember the Material::version they
+    // were built for, so bumping the version of one material rebuilds only that
+    // material's binding set. Entries built while some of the material's textures were
+    // still loading (bound to the fallback texture) are rebuilt once the textures arrive.
+    //
+    // Lookups read an immutable snapshot of the cache without taking any locks. Misses
+    // create the binding set under a mutex and add it to the authoritative map, which is
+    // republished as a new snapshot after a number of slow-path lookups proportional to
+    // its size, so the copying cost stays amortized O(1) per created entry.
+    //
+    // Replaced entries and snapshots are kept alive until ReleaseDestroyedMaterials() or
+    // Clear(), which must not run concurrently with GetMaterialBindingSet(). The binding
+    // sets returned by GetMaterialBindingSet() stay valid until then as well.
     class MaterialBindingCache
     {
+    public:
+        typedef std::function<nvrhi::BindingSetHandle(const Material& material)> BindingSetFactory;
+
     private:
+        struct Entry
+        {
+            nvrhi::BindingSetHandle bindingSet;
+            std::weak_ptr<const Material> owner;
+            uint32_t version = 0;
+            bool ownerTracked = false;
+            bool texturesPending = false;
+        };
+
+        struct Snapshot
+        {
+            std::unordered_map<uint64_t, const Entry*> entries;
+        };
+
         nvrhi::DeviceHandle m_Device;
         nvrhi::BindingLayoutHandle m_BindingLayout;
-        std::unordered_map<const Material*, nvrhi::BindingSetHandle> m_BindingSets;
-        nvrhi::ShaderType m_ShaderType;
+        nvrhi::ShaderType m_ShaderType = nvrhi::ShaderType::None;
         std::vector<MaterialResourceBinding> m_BindingDesc;
         nvrhi::TextureHandle m_FallbackTexture;
         nvrhi::SamplerHandle m_Sampler;
-        std::mutex m_Mutex;
-        bool m_TrackLiveness;
+        bool m_TrackLiveness = true;
+        BindingSetFactory m_Factory;
+
+        std::atomic<const Snapshot*> m_Snapshot;
+        mutable std::mutex m_Mutex;
+        std::unordered_map<uint64_t, std::unique_ptr<Entry>> m_Entries;
+        std::unique_ptr<Snapshot> m_CurrentSnapshot;
+        std::vector<std::unique_ptr<Snapshot>> m_RetiredSnapshots;
+        std::vector<std::unique_ptr<Entry>> m_RetiredEntries;
+        size_t m_SlowLookupsSincePublish = 0;
+        size_t m_BindingSetsCreated = 0;
 
         nvrhi::BindingSetHandle CreateMaterialBindingSet(const Material* material);
         nvrhi::BindingSetItem GetTextureBindingSetItem(uint32_t slot, const std::shared_ptr<LoadedTexture>& texture) const;
 
+        nvrhi::IBindingSet* GetMaterialBindingSetSlow(const Material* material);
+        void PublishSnapshot();
+        static bool IsEntryCurrent(const Entry& entry, const Material& material);
+        static bool HasPendingTextures(const Material& material);
+
     public:
         MaterialBindingCache(
             nvrhi::IDevice* device, 
@@ -73,8 +122,27 @@ namespace donut::engine
             nvrhi::ITexture* fallbackTexture,
             bool trackLiveness = true);
 
+        // Creates a cache that gets its binding sets from 'factory' instead of building
+        // them from a list of MaterialResourceBinding items. The layout is only reported
+        // through GetLayout().
+        MaterialBindingCache(nvrhi::IBindingLayout* layout, BindingSetFactory factory);
+
+        MaterialBindingCache(const MaterialBindingCache&) = delete;
+        MaterialBindingCache& operator=(const MaterialBindingCache&) = delete;
+
         nvrhi::IBindingLayout* GetLayout() const;
+
+        // Thread-safe. Returns the binding set for the current version of the material.
         nvrhi::IBindingSet* GetMaterialBindingSet(const Material* material);
+
+        // Drops the entries of materials that have been destroyed, and the superseded
+        // entries and snapshots. Call it between frames; not thread-safe with lookups.
+        void ReleaseDestroyedMaterials();
+
+        // Drops all entries. Not thread-safe with lookups.
         void Clear();
+
+        [[nodiscard]] size_t GetEntryCount() const;
+        [[nodiscard]] size_t GetBindingSetsCreated() const;
     };
-}
\ No newline at end of file
+}
@@ -90,7 +90,7 @@ namespace donut::engine
             const std::filesystem::path& scenePath, 
             tf::Executor* executor);
 
-        void LoadSceneGraph(const Json::Value& nodeList, const std::shared_ptr<SceneGraphNode>& parent);
+        void LoadSceneGraph(const Json::Value& nodeList, const std::shared_ptr<SceneGraphNode>& parent, const std::filesystem::path& scenePath);
         void LoadAnimations(const Json::Value& nodeList);
         void LoadHelpers(const Json::Value& nodeList) const;
         
@@ -110,7 +110,13 @@ namespace donut::engine
         virtual nvrhi::BufferHandle CreateInstanceBuffer();
         virtual nvrhi::BufferHandle CreateMaterialConstantBuffer(const std::string& debugName);
 
-        virtual bool LoadCustomData(Json::Value& rootNode, tf::Executor* executor);
+        // Called with the top-level sections of the scene description, except for 'graph' and 'animations':
+        // those are streamed by SceneLoader and never exist as documents.
+        virtual bool LoadCustomSections(Json::Value& sections, tf::Executor* executor);
+
+        // Used to receive the whole document, including 'graph' and 'animations'. Final, so that the
+        // overrides written for that contract fail to compile instead of silently getting less data.
+        virtual bool LoadCustomData(Json::Value& rootNode, tf::Executor* executor) final;
     public:
         virtual ~Scene() = default;
 
@@ -144,5 +150,9 @@ namespace donut::engine
         [[nodiscard]] nvrhi::IBuffer* GetMaterialBuffer() const { return m_MaterialBuffer; }
         [[nodiscard]] nvrhi::IBuffer* GetGeometryBuffer() const { return m_GeometryBuffer; }
         [[nodiscard]] nvrhi::IBuffer* GetInstanceBuffer() const { return m_InstanceBuffer; }
+
+        // CPU copy of the instance buffer contents, valid after RefreshBuffers.
+        [[nodiscard]] const InstanceData* GetInstanceData() const;
+        [[nodiscard]] size_t GetInstanceDataCount() const;
     };
 }
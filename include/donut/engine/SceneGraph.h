@@ -30,6 +30,14 @@
 #include <utility>
 #include <functional>
 #include <filesystem>
+#include <string_view>
+
+struct InstanceData;
+
+namespace donut::vfs
+{
+    class IBlob;
+}
 
 namespace donut::engine
 {
@@ -94,11 +102,78 @@ namespace donut::engine
 
         [[nodiscard]] const std::shared_ptr<MeshInfo>& GetMesh() const { return m_Mesh; }
         [[nodiscard]] int GetInstanceIndex() const { return m_InstanceIndex; }
+        // Number of consecutive instance buffer entries used by this leaf, starting at GetInstanceIndex()
+        [[nodiscard]] virtual uint32_t GetInstanceCount() const { return 1; }
         [[nodiscard]] dm::box3 GetLocalBoundingBox() override { return m_Mesh->objectSpaceBounds; }
         [[nodiscard]] std::shared_ptr<SceneGraphLeaf> Clone() override;
         [[nodiscard]] SceneContentFlags GetContentFlags() const override;
         bool SetProperty(const std::string& name, const dm::float4& value) override;
         bool& Visibility() { return m_visibility; };
+        [[nodiscard]] bool Visibility() const { return m_visibility; }
+    };
+
+    struct InstanceArrayCell
+    {
+        uint32_t firstInstance = 0;
+        uint32_t instanceCount = 0;
+        dm::box3 bounds = dm::box3::empty(); // in the space of the owning node
+    };
+
+    /*
+    A leaf that places many copies of one mesh, such as foliage, rocks or debris, under a single node.
+
+    The copies are stored as a flat array of transforms relative to the owning node, with an optional
+    32-bit custom value per copy that ends up in InstanceData::customData. The array is split into
+    spatial cells of at most GetMaxInstancesPerCell() copies, and the copies are reordered so that
+    every cell is a contiguous range. Each copy takes one entry in the scene instance buffer, so a
+    cell can be drawn with a single instanced draw call.
+
+    The leaf can be filled through SetInstances, from the "instances" array of a JSON scene node
+    (see Load), or from the compact binary format produced by SaveBinary.
+    */
+    class MeshInstanceArray : public MeshInstance
+    {
+    private:
+        std::vector<dm::affine3> m_Transforms;
+        std::vector<uint32_t> m_CustomData;
+        std::vector<InstanceArrayCell> m_Cells;
+        dm::box3 m_Bounds = dm::box3::empty();
+        uint32_t m_MaxInstancesPerCell = 256;
+
+        void BuildCells();
+        void InvalidateNode() const;
+
+    public:
+        explicit MeshInstanceArray(std::shared_ptr<MeshInfo> mesh)
+            : MeshInstance(std::move(mesh))
+        { }
+
+        // The mesh can only be changed while the leaf is not attached to a node.
+        bool SetMesh(std::shared_ptr<MeshInfo> mesh);
+
+        // Replaces the instances. 'customData' must be empty or have one entry per transform.
+        // The instances are reordered into cell order.
+        void SetInstances(std::vector<dm::affine3> transforms, std::vector<uint32_t> customData = {});
+        void SetMaxInstancesPerCell(uint32_t count);
+
+        [[nodiscard]] uint32_t GetInstanceCount() const override { return uint32_t(m_Transforms.size()); }
+        [[nodiscard]] uint32_t GetMaxInstancesPerCell() const { return m_MaxInstancesPerCell; }
+        [[nodiscard]] const std::vector<dm::affine3>& GetInstanceTransforms() const { return m_Transforms; }
+        [[nodiscard]] const std::vector<uint32_t>& GetCustomData() const { return m_CustomData; }
+        [[nodiscard]] const std::vector<InstanceArrayCell>& GetCells() const { return m_Cells; }
+
+        // Appends the indices of the cells that intersect the frustum; 'localToWorld' is the transform of the owning node.
+        void GetVisibleCells(const dm::frustum& frustum, const dm::affine3& localToWorld, std::vector<uint32_t>& cellIndices) const;
+
+        // Fills GetInstanceCount() consecutive instance buffer entries.
+        void FillInstanceData(InstanceData* dst, const dm::affine3& localToWorld, const dm::affine3& prevLocalToWorld) const;
+
+        bool LoadBinary(const vfs::IBlob& blob);
+        [[nodiscard]] std::shared_ptr<vfs::IBlob> SaveBinary() const;
+
+        [[nodiscard]] dm::box3 GetLocalBoundingBox() override { return m_Bounds; }
+        [[nodiscard]] std::shared_ptr<SceneGraphLeaf> Clone() override;
+        void Load(const Json::Value& node) override;
     };
 
     struct SkinnedMeshJoint
@@ -177,6 +252,7 @@ namespace donut::engine
     };
 
     class IShadowMap;
+    struct IesProfile;
 
     class Light : public SceneGraphLeaf
     {
@@ -222,6 +298,7 @@ namespace donut::engine
         float range = 0.f;      // Range of influence for the light. 0 means infinite range.
         float innerAngle = 180.f;    // Apex angle of the full-bright cone, in degrees; constant intensity inside the inner cone, smooth falloff between inside and outside.
         float outerAngle = 180.f;    // Apex angle of the light cone, in degrees - everything outside of that cone is dark.
+        std::shared_ptr<IesProfile> iesProfile; // Optional photometric profile, must be baked into an atlas to be used.
 
         [[nodiscard]] std::shared_ptr<SceneGraphLeaf> Clone() override;
         [[nodiscard]] int GetLightType() const override { return LightType_Spot; }
@@ -237,6 +314,7 @@ namespace donut::engine
         float intensity = 1.f;  // Luminous intensity of the light (lm/sr); multiplied by `color`.
         float radius = 0.f;    // Radius of the light sphere, in world units.
         float range = 0.f;     // Range of influence for the light. 0 means infinite range.
+        std::shared_ptr<IesProfile> iesProfile; // Optional photometric profile, must be baked into an atlas to be used.
 
         [[nodiscard]] std::shared_ptr<SceneGraphLeaf> Clone() override;
         [[nodiscard]] int GetLightType() const override { return LightType_Point; }
@@ -264,12 +342,24 @@ namespace donut::engine
 
     private:
         friend class SceneGraph;
+        friend class MeshInstanceArray;
         std::weak_ptr<SceneGraph> m_Graph;
         SceneGraphNode* m_Parent = nullptr;
         std::shared_ptr<SceneGraphNode> m_FirstChild;
         std::shared_ptr<SceneGraphNode> m_NextSibling;
         std::shared_ptr<SceneGraphLeaf> m_Leaf;
 
+        // Maps child names to the first child with that name in sibling order.
+        // The keys point into the m_Name strings of the children.
+        std::unordered_map<std::string_view, SceneGraphNode*> m_ChildIndex;
+
+        // Children of the same parent that share a name are linked in sibling order,
+        // starting from the one in m_ChildIndex. m_SiblingOrder increases along the
+        // sibling list; it is only compared between children of the same parent.
+        SceneGraphNode* m_PrevSameName = nullptr;
+        SceneGraphNode* m_NextSameName = nullptr;
+        int64_t m_SiblingOrder = 0;
+
         std::string m_Name;
         dm::daffine3 m_LocalTransform = dm::daffine3::identity();
         dm::daffine3 m_GlobalTransform = dm::daffine3::identity();
@@ -283,12 +373,19 @@ namespace donut::engine
         dm::box3 m_GlobalBoundingBox = dm::box3::empty();
         bool m_HasLocalTransform = false;
         DirtyFlags m_Dirty = DirtyFlags::None;
+        uint32_t m_BoundsVersion = 0;
         SceneContentFlags m_LeafContent = SceneContentFlags::None;
         SceneContentFlags m_SubgraphContent = SceneContentFlags::None;
 
         void UpdateLocalTransform();
         void PropagateDirtyFlags(SceneGraphNode::DirtyFlags flags);
 
+        // Child list operations that keep m_ChildIndex in sync.
+        void LinkChild(const std::shared_ptr<SceneGraphNode>& child);
+        void UnlinkChild(SceneGraphNode* child);
+        void IndexChild(SceneGraphNode* child);
+        void UnindexChild(SceneGraphNode* child);
+
     public:
         SceneGraphNode() = default;
         /* non-virtual */ ~SceneGraphNode() = default;
@@ -305,6 +402,9 @@ namespace donut::engine
         [[nodiscard]] const dm::affine3& GetPrevLocalToWorldTransformFloat() const { return m_PrevGlobalTransformFloat; }
         [[nodiscard]] const dm::box3& GetGlobalBoundingBox() const { return m_GlobalBoundingBox; }
         [[nodiscard]] DirtyFlags GetDirtyFlags() const { return m_Dirty; }
+        // Changes whenever SceneGraph::Refresh recomputes the global bounding box, which includes
+        // all transform changes of the node and its ancestors. Equal versions imply equal bounds.
+        [[nodiscard]] uint32_t GetBoundsVersion() const { return m_BoundsVersion; }
         [[nodiscard]] SceneContentFlags GetLeafContentFlags() const { return m_LeafContent; }
         [[nodiscard]] SceneContentFlags GetSubgraphContentFlags() const { return m_SubgraphContent; }
 
@@ -313,6 +413,9 @@ namespace donut::engine
         [[nodiscard]] SceneGraphNode* GetNextSibling() const { return m_NextSibling.get(); }
         [[nodiscard]] const std::shared_ptr<SceneGraphLeaf>& GetLeaf() const { return m_Leaf; }
 
+        // Returns the first child with the given name in sibling order, or nullptr.
+        [[nodiscard]] SceneGraphNode* FindChild(std::string_view name) const;
+
         [[nodiscard]] const std::string& GetName() const { return m_Name; }
         [[nodiscard]] std::shared_ptr<SceneGraph> GetGraph() const { return m_Graph.lock(); }
 
@@ -525,6 +628,9 @@ namespace donut::engine
         ResourceTracker<Material> m_Materials;
         ResourceTracker<MeshInfo> m_Meshes;
         size_t m_GeometryCount = 0;
+        size_t m_InstanceDataCount = 0;
+        uint32_t m_RefreshCount = 0;
+        uint32_t m_StructureVersion = 0;
         std::vector<std::shared_ptr<MeshInstance>> m_MeshInstances;
         std::vector<std::shared_ptr<SkinnedMeshInstance>> m_SkinnedMeshInstances;
         std::vector<std::shared_ptr<SceneGraphAnimation>> m_Animations;
@@ -548,11 +654,15 @@ namespace donut::engine
         [[nodiscard]] const ResourceTracker<Material>& GetMaterials() const { return m_Materials; }
         [[nodiscard]] const ResourceTracker<MeshInfo>& GetMeshes() const { return m_Meshes; }
         [[nodiscard]] const size_t GetGeometryCount() const { return m_GeometryCount; }
+        // Number of instance buffer entries used by all mesh instances, valid after Refresh
+        [[nodiscard]] size_t GetInstanceDataCount() const { return m_InstanceDataCount; }
         [[nodiscard]] const std::vector<std::shared_ptr<MeshInstance>>& GetMeshInstances() const { return m_MeshInstances; }
         [[nodiscard]] const std::vector<std::shared_ptr<SkinnedMeshInstance>>& GetSkinnedMeshInstances() const { return m_SkinnedMeshInstances; }
         [[nodiscard]] const std::vector<std::shared_ptr<SceneGraphAnimation>>& GetAnimations() const { return m_Animations; }
         [[nodiscard]] const std::vector<std::shared_ptr<SceneCamera>>& GetCameras() const { return m_Cameras; }
         [[nodiscard]] const std::vector<std::shared_ptr<Light>>& GetLights() const { return m_Lights; }
+        // Incremented by every Refresh that applies structure changes: attached or detached nodes, leaf changes.
+        [[nodiscard]] uint32_t GetStructureVersion() const { return m_StructureVersion; }
         [[nodiscard]] bool HasPendingStructureChanges() const { return m_Root && (m_Root->m_Dirty & SceneGraphNode::DirtyFlags::SubgraphStructure) != 0; }
         [[nodiscard]] bool HasPendingTransformChanges() const { return m_Root && (m_Root->m_Dirty & (SceneGraphNode::DirtyFlags::SubgraphTransforms | SceneGraphNode::DirtyFlags::SubgraphPrevTransforms)) != 0; }
 
@@ -561,6 +671,12 @@ namespace donut::engine
         std::shared_ptr<SceneGraphNode> AttachLeafNode(const std::shared_ptr<SceneGraphNode>& parent, const std::shared_ptr<SceneGraphLeaf>& leaf);
         std::shared_ptr<SceneGraphNode> Detach(const std::shared_ptr<SceneGraphNode>& node);
 
+        // Resolves a '/'-separated node path. Absolute paths start at the root node, relative paths at 'context'.
+        // A '..' component moves to the parent; when siblings share a name, the first one in sibling order is used.
+        // Each component is a hash lookup in the parent's child index, and the string_view version does not allocate.
+        [[nodiscard]] std::shared_ptr<SceneGraphNode> FindNode(std::string_view path, SceneGraphNode* context = nullptr) const;
+        [[nodiscard]] std::shared_ptr<SceneGraphNode> FindNode(const std::string& path, SceneGraphNode* context = nullptr) const { return FindNode(std::string_view(path), context); }
+        [[nodiscard]] std::shared_ptr<SceneGraphNode> FindNode(const char* path, SceneGraphNode* context = nullptr) const { return FindNode(std::string_view(path), context); }
         [[nodiscard]] std::shared_ptr<SceneGraphNode> FindNode(const std::filesystem::path& path, SceneGraphNode* context = nullptr) const;
         
         void Refresh(uint32_t frameIndex);
@@ -0,0 +1,141 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/engine/SceneGraph.h>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace tf
+{
+    class Executor;
+}
+
+namespace Json
+{
+    class Value;
+}
+
+namespace donut::vfs
+{
+    class IBlob;
+    class IFileSystem;
+}
+
+namespace donut::json
+{
+    class StreamReader;
+}
+
+namespace donut::engine
+{
+    // Builds scene graph nodes, leaves and animations from the 'graph' and
+    // 'animations' sections of a scene description file.
+    //
+    // The graph and the animations are always built from compact node and
+    // animation records, in document order, by one builder each. The records
+    // come from either of two front ends:
+    //
+    // - Parse() streams the file without a document tree, with interned keys.
+    //   The members of a node that the graph doesn't use are captured in the
+    //   same pass for nodes with a leaf type. Build() then runs the builders
+    //   once the models are loaded.
+    //
+    // - LoadSceneGraph() / LoadAnimations() convert a jsoncpp document into
+    //   records and build them right away.
+    //
+    // SceneGraphLeaf::Load() receives the node members other than 'children',
+    // 'translation', 'rotation', 'euler' and 'scaling'. Animation samplers and
+    // channel targets are resolved in parallel before the animations are
+    // attached.
+    class SceneLoader
+    {
+    public:
+        SceneLoader(
+            std::shared_ptr<SceneGraph> sceneGraph,
+            std::shared_ptr<SceneTypeFactory> sceneTypeFactory,
+            std::shared_ptr<vfs::IFileSystem> fs,
+            std::filesystem::path scenePath);
+        ~SceneLoader();
+
+        // Document path, for graphs that are already parsed. Shares the builders with Build().
+        void LoadSceneGraph(const Json::Value& nodeList, const std::shared_ptr<SceneGraphNode>& parent,
+            const std::vector<SceneImportResult>& models);
+        void LoadAnimations(const Json::Value& nodeList);
+
+        // Streaming path. All top-level sections other than 'graph' and
+        // 'animations' (models, helpers, custom data) are returned in 'sections'.
+        // When the document root is not an object, 'sections' receives the root.
+        // The blob is referenced until Build() is done.
+        bool Parse(std::shared_ptr<vfs::IBlob const> data, const std::string& fileName, Json::Value& sections);
+
+        void Build(const std::shared_ptr<SceneGraphNode>& parent, const std::vector<SceneImportResult>& models,
+            tf::Executor* executor);
+
+    private:
+        struct NodeRecord;
+        struct KeyframeRecord;
+        struct ChannelRecord;
+        struct AnimationRecord;
+        struct ChannelTarget;
+
+        bool ParseNodeList(json::StreamReader& reader, uint32_t& firstNode);
+        bool ParseNode(json::StreamReader& reader, uint32_t& index);
+        bool ParseAnimation(json::StreamReader& reader, AnimationRecord& animation);
+        bool ParseChannel(json::StreamReader& reader, ChannelRecord& channel);
+        bool ParseKeyframe(json::StreamReader& reader, KeyframeRecord& keyframe);
+
+        uint32_t AppendNodeList(const Json::Value& nodeList);
+        uint32_t AppendNode(const Json::Value& src);
+        void AppendAnimations(const Json::Value& nodeList);
+
+        void BuildNodes(uint32_t firstNode, const std::shared_ptr<SceneGraphNode>& parent,
+            const std::vector<SceneImportResult>& models);
+        void BuildAnimations(tf::Executor* executor);
+
+        void LoadLeaf(const std::shared_ptr<SceneGraphNode>& dst, const Json::Value& src, const Json::Value& leafTypeNode) const;
+        bool LoadInstanceArrayMesh(const Json::Value& src, MeshInstanceArray& instanceArray, const std::string& nodeName) const;
+        [[nodiscard]] ChannelTarget ResolveTarget(const Json::Value& targetNode) const;
+        void AddChannel(SceneGraphAnimation& animation, const std::shared_ptr<animation::Sampler>& sampler,
+            AnimationAttribute attribute, const Json::Value& attributeNode, const Json::Value& targetNode,
+            const ChannelTarget& target, int channelIndex) const;
+        void AttachAnimation(const std::shared_ptr<SceneGraphAnimation>& animation, const std::shared_ptr<SceneGraphNode>& animationNode,
+            std::shared_ptr<SceneGraphNode>& animationContainer) const;
+
+        std::shared_ptr<SceneGraph> m_SceneGraph;
+        std::shared_ptr<SceneTypeFactory> m_SceneTypeFactory;
+        std::shared_ptr<vfs::IFileSystem> m_fs;
+        std::filesystem::path m_ScenePath;
+
+        // streaming state
+        std::shared_ptr<vfs::IBlob const> m_Data;
+        std::vector<NodeRecord> m_Nodes;
+        std::vector<AnimationRecord> m_Animations;
+        uint32_t m_FirstRootNode;
+        bool m_HasAnimations = false;
+        std::unique_ptr<Json::Value> m_AnimationsDocument;  // 'animations' when it is not an array, or when it has
+                                                            // values that the streaming parser doesn't convert
+    };
+}
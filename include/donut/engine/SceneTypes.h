@@ -24,6 +24,7 @@
 
 #include <donut/core/math/math.h>
 #include <donut/engine/DescriptorTableManager.h>
+#include <donut/engine/SphericalHarmonics.h>
 #include <donut/shaders/light_types.h>
 #include <nvrhi/nvrhi.h>
 #include <memory>
@@ -106,7 +107,7 @@ namespace donut::engine
 
     const char* MaterialDomainToString(MaterialDomain domain);
 
-    struct Material
+    struct Material : public std::enable_shared_from_this<Material>
     {
         std::string name;
         MaterialDomain domain = MaterialDomain::Opaque;
@@ -146,7 +147,30 @@ namespace donut::engine
         int materialID = 0;
         bool dirty = true; // set this to true to make Scene udpate the material data
 
+        // Holds Material::uniqueID. A copied or assigned material gets a new ID, because
+        // it may diverge from the source while having the same version.
+        class UniqueID
+        {
+        public:
+            UniqueID() : m_Value(AllocateUniqueID()) { }
+            UniqueID(const UniqueID&) : m_Value(AllocateUniqueID()) { }
+            UniqueID& operator=(const UniqueID&) { m_Value = AllocateUniqueID(); return *this; }
+            operator uint64_t() const { return m_Value; }
+
+        private:
+            uint64_t m_Value;
+        };
+
+        // Identifies the material in caches that outlive the scene structure, such as
+        // MaterialBindingCache. Unlike materialID, it is never reassigned or reused.
+        UniqueID uniqueID;
+
+        // Increment this when any of the textures or materialConstants is replaced,
+        // so that the binding sets built from the old resources are recreated.
+        uint32_t version = 0;
+
         virtual ~Material() = default;
+        static uint64_t AllocateUniqueID();
         void FillConstantBuffer(struct MaterialConstants& constants) const;
         bool SetProperty(const std::string& name, const dm::float4& value);
     };
@@ -175,6 +199,7 @@ namespace donut::engine
         std::vector<uint32_t> tangentData;
         std::vector<dm::vector<uint16_t, 4>> jointData;
         std::vector<dm::float4> weightData;
+        int globalBufferGroupIndex = -1; // assigned by SceneGraph::Refresh in the order of first use
 
         [[nodiscard]] bool hasAttribute(VertexAttribute attr) const { return vertexBufferRanges[int(attr)].byteSize != 0; }
         nvrhi::BufferRange& getVertexBufferRange(VertexAttribute attr) { return vertexBufferRanges[int(attr)]; }
@@ -221,6 +246,9 @@ namespace donut::engine
         uint32_t specularArrayIndex = 0;
         float diffuseScale = 1.f;
         float specularScale = 1.f;
+        // Baked diffuse irradiance (see LightProbeBaker.h), used instead of diffuseMap when enabled
+        SphericalHarmonicsL2 diffuseIrradianceSH;
+        bool useDiffuseIrradianceSH = false;
         bool enabled = true;
         dm::frustum bounds = dm::frustum::infinite();
 
@@ -26,9 +26,15 @@
 #include <vector>
 #include <unordered_map>
 #include <nvrhi/nvrhi.h>
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <filesystem>
 
+namespace tf
+{
+    class Executor;
+}
 
 namespace donut::vfs
 {
@@ -49,14 +55,48 @@ namespace donut::engine
         { }
     };
 
+    struct ShaderFactoryStats
+    {
+        uint64_t cacheHits = 0;
+        uint64_t cacheMisses = 0;       // GetBytecode calls that had to read the file
+        uint64_t filesLoaded = 0;       // including prefetched files
+        uint64_t bytesLoaded = 0;       // after decompression
+        uint64_t filesPrefetched = 0;
+    };
+
+    /*
+    ShaderFactory loads shader bytecode (.bin files) from a virtual file system and
+    creates shaders and shader permutations from it.
+
+    The bytecode cache is thread-safe, so GetBytecode and CreateShader can be called
+    from multiple threads. To avoid reading the files one by one while the render passes
+    are created, the bytecode can be prefetched in parallel from a manifest or a directory.
+    If the file system is a CompressionLayer, the files are decompressed on the prefetch
+    threads as well.
+
+    The manifest is a text file with one bytecode path per line, relative to the base path,
+    e.g. "passes/bloom_ps.bin". Empty lines and lines starting with '#' are ignored.
+    WriteManifest produces such a file listing the bytecode loaded so far.
+    */
     class ShaderFactory
     {
     private:
         nvrhi::DeviceHandle m_Device;
         std::unordered_map<std::string, std::shared_ptr<vfs::IBlob>> m_BytecodeCache;
+        std::vector<std::string> m_LoadedFiles; // relative to m_basePath, in load order
+        mutable std::mutex m_CacheMutex;
 		std::shared_ptr<vfs::IFileSystem> m_fs;
 		std::filesystem::path m_basePath;
 
+        std::atomic<uint64_t> m_CacheHits = 0;
+        std::atomic<uint64_t> m_CacheMisses = 0;
+        std::atomic<uint64_t> m_FilesLoaded = 0;
+        std::atomic<uint64_t> m_BytesLoaded = 0;
+        std::atomic<uint64_t> m_FilesPrefetched = 0;
+
+        std::shared_ptr<vfs::IBlob> FindInCache(const std::string& key);
+        std::shared_ptr<vfs::IBlob> LoadIntoCache(const std::string& relativePath);
+
     public:
         ShaderFactory(
             nvrhi::DeviceHandle rendererInterface,
@@ -65,6 +105,20 @@ namespace donut::engine
 
         void ClearCache();
 
+        // Loads the listed bytecode files (relative to the base path) that are not cached yet,
+        // in parallel when an executor is provided. Returns the number of files loaded.
+        size_t PrefetchBytecode(const std::vector<std::string>& files, tf::Executor* executor);
+        // The manifest is read through the factory's file system.
+        size_t PrefetchFromManifest(const std::filesystem::path& manifestFile, tf::Executor* executor);
+        // Prefetches all .bin files in a directory (relative to the base path) and its subdirectories.
+        size_t PrefetchDirectory(const std::filesystem::path& directory, tf::Executor* executor);
+
+        // Writes the list of bytecode files loaded so far, as a native file.
+        bool WriteManifest(const std::filesystem::path& fileName) const;
+
+        [[nodiscard]] ShaderFactoryStats GetStats() const;
+        void ResetStats();
+
         nvrhi::ShaderHandle CreateShader(const char* fileName, const char* entryName, const std::vector<ShaderMacro>* pDefines, nvrhi::ShaderType shaderType);
         nvrhi::ShaderHandle CreateShader(const char* fileName, const char* entryName, const std::vector<ShaderMacro>* pDefines, const nvrhi::ShaderDesc& desc);
         nvrhi::ShaderLibraryHandle CreateShaderLibrary(const char* fileName, const std::vector<ShaderMacro>* pDefines);
@@ -0,0 +1,75 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <cstdint>
+#include <vector>
+
+namespace donut::engine
+{
+    // A cubemap in CPU memory, e.g. radiance read back from a rendered light probe. Faces are stored in the
+    // D3D order (+X, -X, +Y, -Y, +Z, -Z), rows top to bottom, with the same texel-to-direction mapping as
+    // the light probe shaders. Texels are linear RGBA.
+    struct CubemapImage
+    {
+        uint32_t size = 0;
+        std::vector<dm::float4> texels; // 6 * size * size
+
+        void Resize(uint32_t faceSize);
+
+        [[nodiscard]] dm::float4* GetFace(uint32_t face) { return texels.data() + size_t(face) * size * size; }
+        [[nodiscard]] const dm::float4* GetFace(uint32_t face) const { return texels.data() + size_t(face) * size * size; }
+
+        // Normalized direction through the center of a texel of a cubemap with the given face size.
+        [[nodiscard]] static dm::float3 GetTexelDirection(uint32_t face, uint32_t x, uint32_t y, uint32_t size);
+
+        // Bilinear sample of the face that the direction points to. Texels are clamped at the face edges.
+        [[nodiscard]] dm::float4 Sample(const dm::float3& direction) const;
+    };
+
+    // Real spherical harmonics up to band 2, with 9 RGB coefficients. They reproduce diffuse irradiance
+    // from a smooth environment with a few percent of error, in 108 bytes instead of a cubemap.
+    struct SphericalHarmonicsL2
+    {
+        static constexpr int CoefficientCount = 9;
+
+        dm::float3 coefficients[CoefficientCount] = {};
+
+        static void EvaluateBasis(const dm::float3& direction, float basis[CoefficientCount]);
+
+        // Reconstructs the projected function in a (normalized) direction.
+        [[nodiscard]] dm::float3 Evaluate(const dm::float3& direction) const;
+
+        // Convolution with the clamped cosine lobe: for projected radiance, returns the coefficients of the
+        // irradiance E(n), so that Evaluate(n) yields the integral of L(w) * max(0, dot(n, w)) dw.
+        [[nodiscard]] SphericalHarmonicsL2 ConvolveWithCosineLobe() const;
+
+        SphericalHarmonicsL2& operator+=(const SphericalHarmonicsL2& other);
+        SphericalHarmonicsL2& operator*=(float scale);
+    };
+
+    // Projects the RGB channels of a cubemap onto spherical harmonics, weighting every texel by its solid angle.
+    // Four texels of a row are processed at once with SSE when the target supports it.
+    SphericalHarmonicsL2 ProjectCubemapToSH(const CubemapImage& cubemap);
+}
@@ -23,6 +23,7 @@
 #pragma once
 
 #include <donut/engine/SceneTypes.h>
+#include <donut/engine/TextureUploadScheduler.h>
 #include <donut/core/log.h>
 
 #include <nvrhi/nvrhi.h>
@@ -31,7 +32,6 @@
 #include <unordered_map>
 #include <memory>
 #include <shared_mutex>
-#include <queue>
 
 #ifdef DONUT_WITH_TASKFLOW
 namespace tf
@@ -72,6 +72,9 @@ namespace donut::engine
         bool isRenderTarget = false;
         bool forceSRGB = false;
 
+        // Textures with a higher priority are finalized first, see TextureCache::SetTextureUploadPriority
+        float uploadPriority = 0.f;
+
         // ArraySlice -> MipLevel -> TextureSubresourceData
         std::vector<std::vector<TextureSubresourceData>> dataLayout;
     };
@@ -84,7 +87,9 @@ namespace donut::engine
         std::unordered_map<std::string, std::shared_ptr<TextureData>> m_LoadedTextures;
         mutable std::shared_mutex m_LoadedTexturesMutex;
 
-        std::queue<std::shared_ptr<TextureData>> m_TexturesToFinalize;
+        class Uploader;
+        TextureUploadScheduler m_UploadScheduler;
+        uint64_t m_UploadBudgetBytes = 64 * 1024 * 1024;
         std::shared_ptr<DescriptorTableManager> m_DescriptorTable;
         std::mutex m_TexturesToFinalizeMutex;
 
@@ -105,6 +110,10 @@ namespace donut::engine
         std::shared_ptr<vfs::IBlob> ReadTextureFile(const std::filesystem::path& path) const;
         bool FillTextureData(const std::shared_ptr<vfs::IBlob>& fileData, const std::shared_ptr<TextureData>& texture, const std::string& extension, const std::string& mimeType) const;
         void FinalizeTexture(std::shared_ptr<TextureData> texture, CommonRenderPasses* passes, nvrhi::ICommandList* commandList);
+        // The two halves of FinalizeTexture. UploadTexture returns true if the texture needs GenerateMipmaps,
+        // which processes several textures level by level, so that consecutive blits of the same format share a pipeline.
+        bool UploadTexture(const std::shared_ptr<TextureData>& texture, CommonRenderPasses* passes, nvrhi::ICommandList* commandList);
+        void GenerateMipmaps(const std::vector<std::shared_ptr<TextureData>>& textures, CommonRenderPasses* passes, nvrhi::ICommandList* commandList);
         virtual void TextureLoaded(std::shared_ptr<TextureData> texture);
         virtual std::shared_ptr<TextureData> CreateTextureData();
 
@@ -151,11 +160,22 @@ namespace donut::engine
         //       Texture lifetimes are tracked by NVRHI and the texture object is only destroyed when no references exist.
         bool UnloadTexture(const std::shared_ptr<LoadedTexture>& texture);
 
-        // Process a portion of the upload queue, taking up to `timeLimitMilliseconds` CPU time.
-        // If `timeLimitMilliseconds` is 0, processes the entire queue.
+        // Process a portion of the upload queue in one command list, up to the upload budget and taking up to
+        // `timeLimitMilliseconds` CPU time, most important textures first.
+        // If `timeLimitMilliseconds` is 0, processes the entire queue, in command lists of up to the upload budget each.
         // Returns true if any textures have been processed.
         bool ProcessRenderingThreadCommands(CommonRenderPasses& passes, float timeLimitMilliseconds);
 
+        // Sets the number of texture data bytes that one ProcessRenderingThreadCommands call uploads, 0 for no limit.
+        // The first texture is always processed, even if it is larger.
+        void SetUploadBudget(uint64_t bytes) { m_UploadBudgetBytes = bytes; }
+
+        // Textures with a higher priority, such as the ones that cover more of the screen or are about to be used,
+        // are finalized before the others. Applies to textures that are already waiting, too. The default is 0.
+        void SetTextureUploadPriority(const std::shared_ptr<LoadedTexture>& texture, float priority);
+
+        [[nodiscard]] TextureUploadProgress GetUploadProgress() const { return m_UploadScheduler.GetProgress(); }
+
         // Destroys the internal command list in order to release the upload buffers used in it.
         void LoadingFinished();
 
@@ -0,0 +1,81 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <nvrhi/nvrhi.h>
+#include <cstdint>
+#include <memory>
+
+namespace tf
+{
+    class Executor;
+}
+
+namespace donut::vfs
+{
+    class IBlob;
+}
+
+namespace donut::engine
+{
+    // Block compression of 8-bit images on the CPU, used to cook textures that are authored as PNG/JPG/TGA
+    // into DDS files with BC formats. The encoders favor speed over the last fraction of a dB:
+    // endpoints come from the principal axis of each block, refined once with a least squares fit.
+    // BC7 uses mode 6 only (one subset, RGBA endpoints, 4-bit indices).
+
+    // What the texture is used for, which decides the format.
+    enum class TextureRole
+    {
+        BaseColor,                  // color with optional alpha: BC1 or BC3, or BC7
+        Normal,                     // tangent space XY in RG, Z is reconstructed by the material shader: BC5
+        OcclusionRoughnessMetallic, // three independent linear channels: BC1, or BC7
+        SingleChannel               // occlusion, height, masks in the red channel: BC4
+    };
+
+    struct TextureCompressionSettings
+    {
+        TextureRole role = TextureRole::BaseColor;
+        bool sRGB = true;           // for BaseColor, selects the sRGB format and gamma-correct mip filtering
+        bool allowBC7 = false;      // use BC7 instead of BC1/BC3 for color data
+        bool generateMips = true;
+    };
+
+    // Picks the format for a texture with the given settings. 'hasAlpha' selects BC3 over BC1 for base color.
+    nvrhi::Format ChooseCompressedFormat(const TextureCompressionSettings& settings, bool hasAlpha);
+
+    // Size of a 4x4 block of the format in bytes, or 0 if the format is not supported by the encoder.
+    uint32_t GetCompressedBlockSize(nvrhi::Format format);
+
+    bool HasTransparentPixels(const uint8_t* rgba, uint32_t width, uint32_t height, size_t rowPitch);
+
+    // Encodes an RGBA8 image into BC1, BC3, BC4 (red), BC5 (red, green) or BC7 blocks. The blocks are written
+    // row by row into 'blocks', which must hold ceil(width / 4) * ceil(height / 4) of them.
+    // Rows of blocks are distributed over the executor if one is provided.
+    bool CompressImage(nvrhi::Format format, const uint8_t* rgba, uint32_t width, uint32_t height, size_t rowPitch,
+        uint8_t* blocks, tf::Executor* executor = nullptr);
+
+    // Compresses an RGBA8 image and its mip chain, generated on the CPU, into the contents of a DDS file
+    // that LoadDDSTextureFromMemory and TextureCache can load. Returns nullptr on failure.
+    std::shared_ptr<vfs::IBlob> CompressTextureToDDS(const uint8_t* rgba, uint32_t width, uint32_t height, size_t rowPitch,
+        const TextureCompressionSettings& settings, tf::Executor* executor = nullptr);
+}
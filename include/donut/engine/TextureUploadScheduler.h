@@ -0,0 +1,123 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <nvrhi/nvrhi.h>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace donut::engine
+{
+    struct TextureData;
+
+    // Records the GPU work of finalizing textures for TextureUploadScheduler.
+    // TextureCache implements it with its command list, tests with a fake that records the calls.
+    class ITextureUploader
+    {
+    public:
+        virtual ~ITextureUploader() = default;
+
+        // Called before the first upload of a batch.
+        virtual void BeginBatch() = 0;
+
+        // Creates the texture and records the upload of its data. Returns the format of the texture
+        // if it needs mip generation, or Format::UNKNOWN if it does not.
+        virtual nvrhi::Format UploadTexture(const std::shared_ptr<TextureData>& texture) = 0;
+
+        // Generates the missing mip levels of uploaded textures that share a format.
+        virtual void GenerateMipmaps(nvrhi::Format format, const std::vector<std::shared_ptr<TextureData>>& textures) = 0;
+
+        // Called after the mip generation of a batch, submits the work.
+        virtual void EndBatch() = 0;
+    };
+
+    struct TextureUploadProgress
+    {
+        uint32_t texturesQueued = 0;
+        uint32_t texturesFinalized = 0;
+        uint64_t bytesQueued = 0;
+        uint64_t bytesUploaded = 0;
+        uint32_t batchesSubmitted = 0;
+
+        // Fraction of the queued bytes that have been uploaded, 1 when nothing is waiting.
+        [[nodiscard]] float GetFraction() const
+        {
+            uint64_t total = bytesQueued + bytesUploaded;
+            return total > 0 ? float(double(bytesUploaded) / double(total)) : 1.f;
+        }
+    };
+
+    // Size of the texture data that finalization uploads, used for budgeting.
+    [[nodiscard]] uint64_t GetTextureUploadSize(const TextureData& texture);
+
+    // Orders and batches the finalization of loaded textures.
+    //
+    // Textures are enqueued from any thread. ProcessBatch() runs on the rendering thread: it drains the
+    // incoming textures in bulk, picks the most important ones (TextureData::uploadPriority, higher first,
+    // then in arrival order) until the byte budget is reached, and hands all of them to the uploader in one
+    // batch, followed by one GenerateMipmaps call per format. The first texture of a batch is always taken,
+    // so that a texture larger than the budget still makes progress. Textures are never reordered around
+    // the budget: a batch stops at the first texture that does not fit.
+    class TextureUploadScheduler
+    {
+    private:
+        struct Entry
+        {
+            std::shared_ptr<TextureData> texture;
+            uint64_t bytes = 0;
+            float priority = 0.f;
+            uint64_t sequence = 0;
+        };
+
+        static bool IsLessImportant(const Entry& a, const Entry& b);
+
+        mutable std::mutex m_Mutex;
+        std::vector<Entry> m_Incoming;
+        bool m_PrioritiesChanged = false;
+        uint64_t m_NextSequence = 0;
+        TextureUploadProgress m_Progress;
+
+        // Max-heap ordered by IsLessImportant, only used by ProcessBatch()
+        std::vector<Entry> m_Pending;
+
+    public:
+        // Thread-safe.
+        void Enqueue(std::shared_ptr<TextureData> texture);
+
+        // Sets TextureData::uploadPriority, also for textures that are already queued. Thread-safe.
+        void SetPriority(TextureData& texture, float priority);
+
+        // Finalizes up to 'byteBudget' bytes of textures (0 means no limit) in one batch, stopping early
+        // when 'timeLimitMilliseconds' (if nonzero) have passed. Textures without data, which failed to load
+        // or have already been finalized, are dropped. Returns the number of textures finalized.
+        uint32_t ProcessBatch(ITextureUploader& uploader, uint64_t byteBudget, float timeLimitMilliseconds = 0.f);
+
+        [[nodiscard]] bool IsEmpty() const;
+        [[nodiscard]] TextureUploadProgress GetProgress() const;
+
+        // Drops all queued textures and resets the progress.
+        void Clear();
+    };
+}
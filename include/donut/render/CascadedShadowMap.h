@@ -28,9 +28,18 @@
 #include <nvrhi/nvrhi.h>
 #include <memory>
 
+namespace donut::engine
+{
+    class FramebufferFactory;
+}
+
 namespace donut::render
 {
     class PlanarShadowMap;
+    class ShadowCacheTracker;
+    class IDrawStrategy;
+    class IGeometryPass;
+    class GeometryPassContext;
 
     class CascadedShadowMap : public engine::IShadowMap
     {
@@ -41,6 +50,10 @@ namespace donut::render
         engine::CompositeView m_CompositeView;
         int m_NumberOfCascades;
 
+        nvrhi::TextureHandle m_StaticCacheTexture;
+        std::shared_ptr<engine::FramebufferFactory> m_StaticCacheFramebuffer;
+        std::shared_ptr<ShadowCacheTracker> m_CacheTracker;
+
     public:
         CascadedShadowMap(
             nvrhi::IDevice* device,
@@ -91,6 +104,27 @@ namespace donut::render
 
         void Clear(nvrhi::ICommandList* commandList);
 
+        // Keeps the static shadow casters of every cascade in a separate texture that is only re-rendered
+        // when the cascade projection or the static casters inside it change, see ShadowCacheTracker.
+        // Only SetupForPlanarViewStable snaps the cascades for caching; the other setup functions
+        // change the projections every frame and make the cache useless.
+        void EnableStaticCache(nvrhi::IDevice* device);
+        [[nodiscard]] bool IsStaticCacheEnabled() const { return m_CacheTracker != nullptr; }
+        [[nodiscard]] const std::shared_ptr<ShadowCacheTracker>& GetCacheTracker() const { return m_CacheTracker; }
+        [[nodiscard]] nvrhi::ITexture* GetStaticCacheTexture() const { return m_StaticCacheTexture; }
+
+        // Replaces Clear + RenderCompositeView when the static cache is enabled: re-renders the static casters
+        // of the dirty cascades into the cache, copies the cache into the shadow map, and draws the
+        // dynamic casters on top. Call after the cascades have been set up for the frame.
+        void RenderCached(
+            nvrhi::ICommandList* commandList,
+            engine::FramebufferFactory& framebufferFactory,
+            const std::shared_ptr<engine::SceneGraphNode>& rootNode,
+            IDrawStrategy& drawStrategy,
+            IGeometryPass& pass,
+            GeometryPassContext& passContext,
+            bool materialEvents = false);
+
         void SetLitOutOfBounds(bool litOutOfBounds);
         void SetFalloffDistance(float distance);
 		void SetNumberOfCascadesUnsafe(int cascades);
@@ -0,0 +1,213 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/render/GeometryPasses.h>
+#include <nvrhi/nvrhi.h>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace donut::engine
+{
+    class SceneGraphNode;
+}
+
+namespace tf
+{
+    class Executor;
+}
+
+namespace donut::render
+{
+    class IDrawStrategy;
+
+    enum class StreamCommand : uint8_t
+    {
+        SetView,            // framebuffer, shading rate, viewports and scissor rects
+        SetPipeline,
+        SetBindings,
+        SetVertexBuffers,
+        SetIndexBuffer,
+        DrawIndexed,
+        BeginMarker,
+        EndMarker
+    };
+
+    /*
+    A compact CPU-side recording of graphics state changes and draws, which can be recorded on any thread
+    and replayed into a command list later. Commands are a 4-byte header followed by plain data: object
+    pointers, draw arguments and viewports. The referenced objects must stay alive until the stream has
+    been replayed.
+
+    SetGraphicsState() only records the parts of the state that differ from the previously recorded state,
+    so materials that map to the same pipeline and bindings do not produce any commands. Only the state
+    that RenderView uses is recorded: framebuffer, viewport, shading rate, pipeline, bindings, vertex and
+    index buffers.
+
+    Push constants are not recorded: IGeometryPass::SetPushConstants is called at replay time, before
+    each draw, with the replayed state, like RenderView does.
+    */
+    class CommandStream
+    {
+    public:
+        struct Statistics
+        {
+            uint32_t drawCount = 0;
+            uint32_t stateCommandCount = 0;
+            uint32_t redundantStateCount = 0; // SetGraphicsState calls that recorded nothing
+        };
+
+    private:
+        std::vector<uint8_t> m_Data;
+        nvrhi::GraphicsState m_RecordedState;
+        bool m_HasRecordedState = false;
+        Statistics m_Statistics;
+
+        void WriteHeader(StreamCommand command, uint8_t count0 = 0, uint8_t count1 = 0);
+        template<typename T> void Write(const T& value);
+
+    public:
+        // Clears the commands, keeping the allocation.
+        void Reset();
+
+        void SetGraphicsState(const nvrhi::GraphicsState& state);
+        void DrawIndexed(const nvrhi::DrawArguments& args);
+        // 'name' is not copied, it must stay valid until the stream has been replayed.
+        void BeginMarker(const char* name);
+        void EndMarker();
+
+        [[nodiscard]] const std::vector<uint8_t>& GetData() const { return m_Data; }
+        [[nodiscard]] bool IsEmpty() const { return m_Data.empty(); }
+        [[nodiscard]] const Statistics& GetStatistics() const { return m_Statistics; }
+    };
+
+    // Receives the replayed commands.
+    class ICommandSink
+    {
+    public:
+        virtual ~ICommandSink() = default;
+        virtual void SetGraphicsState(const nvrhi::GraphicsState& state) = 0;
+        virtual void DrawIndexed(const nvrhi::DrawArguments& args) = 0;
+        virtual void BeginMarker(const char* name) = 0;
+        virtual void EndMarker() = 0;
+
+        // The command list that IGeometryPass::SetPushConstants records into, may be null.
+        [[nodiscard]] virtual nvrhi::ICommandList* GetCommandList() = 0;
+    };
+
+    class CommandListSink : public ICommandSink
+    {
+    private:
+        nvrhi::ICommandList* m_CommandList;
+
+    public:
+        explicit CommandListSink(nvrhi::ICommandList* commandList) : m_CommandList(commandList) { }
+
+        void SetGraphicsState(const nvrhi::GraphicsState& state) override { m_CommandList->setGraphicsState(state); }
+        void DrawIndexed(const nvrhi::DrawArguments& args) override { m_CommandList->drawIndexed(args); }
+        void BeginMarker(const char* name) override { m_CommandList->beginMarker(name); }
+        void EndMarker() override { m_CommandList->endMarker(); }
+        [[nodiscard]] nvrhi::ICommandList* GetCommandList() override { return m_CommandList; }
+    };
+
+    // Replays the streams in order into one sink. The state is carried from one stream to the next, and
+    // the sink only receives SetGraphicsState when the state has actually changed since the previous draw.
+    // To spread the streams over several command lists, replay consecutive ranges into one sink each and
+    // execute the command lists in the same order.
+    // 'pass' and 'passContext' receive the SetPushConstants calls, and may be null.
+    void ReplayCommandStreams(
+        const CommandStream* streams,
+        size_t streamCount,
+        ICommandSink& sink,
+        IGeometryPass* pass,
+        GeometryPassContext* passContext);
+
+    // Records what RenderView would record for 'items', after IGeometryPass::SetupView.
+    void RecordDrawItems(
+        CommandStream& stream,
+        const DrawItem* items,
+        size_t itemCount,
+        const engine::IView* view,
+        nvrhi::IFramebuffer* framebuffer,
+        IGeometryPass& pass,
+        GeometryPassContext& passContext,
+        bool materialEvents = false);
+
+    // Splits 'items' into contiguous ranges of at least 'minItemsPerStream' items and records them with
+    // RecordDrawItems, in parallel if an executor is provided. Resizes 'streams' to the number of ranges.
+    // The pass must support concurrent SetupMaterial and SetupInputBuffers calls on the same context,
+    // which the passes in this library do.
+    void RecordDrawItemsParallel(
+        tf::Executor* executor,
+        std::vector<CommandStream>& streams,
+        const DrawItem* items,
+        size_t itemCount,
+        const engine::IView* view,
+        nvrhi::IFramebuffer* framebuffer,
+        IGeometryPass& pass,
+        GeometryPassContext& passContext,
+        size_t minItemsPerStream = 256,
+        bool materialEvents = false);
+
+    // Equivalents of RenderView and RenderCompositeView that record the draws on the executor's
+    // worker threads and replay them into the command list. The object keeps the item and stream
+    // allocations from one call to the next, and must not be used by several threads at once.
+    class ParallelViewRenderer
+    {
+    private:
+        tf::Executor* m_Executor;
+        std::vector<DrawItem> m_Items;
+        std::vector<CommandStream> m_Streams;
+        size_t m_MinItemsPerStream = 256;
+
+    public:
+        explicit ParallelViewRenderer(tf::Executor* executor) : m_Executor(executor) { }
+
+        void SetMinItemsPerStream(size_t count) { m_MinItemsPerStream = std::max<size_t>(count, 1); }
+
+        void RenderView(
+            nvrhi::ICommandList* commandList,
+            const engine::IView* view,
+            const engine::IView* viewPrev,
+            nvrhi::IFramebuffer* framebuffer,
+            IDrawStrategy& drawStrategy,
+            IGeometryPass& pass,
+            GeometryPassContext& passContext,
+            bool materialEvents = false);
+
+        void RenderCompositeView(
+            nvrhi::ICommandList* commandList,
+            const engine::ICompositeView* compositeView,
+            const engine::ICompositeView* compositeViewPrev,
+            engine::FramebufferFactory& framebufferFactory,
+            const std::shared_ptr<engine::SceneGraphNode>& rootNode,
+            IDrawStrategy& drawStrategy,
+            IGeometryPass& pass,
+            GeometryPassContext& passContext,
+            const char* passEvent = nullptr,
+            bool materialEvents = false);
+
+        [[nodiscard]] const std::vector<CommandStream>& GetStreams() const { return m_Streams; }
+    };
+}
@@ -23,6 +23,7 @@
 #pragma once
 
 #include <donut/engine/SceneGraph.h>
+#include <donut/render/VisibilityCache.h>
 #include <memory>
 #include <vector>
 
@@ -31,9 +32,15 @@ namespace donut::engine
     class IView;
 }
 
+namespace tf
+{
+    class Executor;
+}
+
 namespace donut::render
 {
     struct DrawItem;
+    class IOcclusionFilter;
 
     class IDrawStrategy
     {
@@ -44,6 +51,17 @@ namespace donut::render
 
         virtual const DrawItem* GetNextItem() = 0;
 
+        // Optional multi-view path: culls all the given views in a single traversal of the scene graph.
+        // Returns false if the strategy doesn't support it or can't handle that many views,
+        // in which case the caller should use PrepareForView for each view instead.
+        // After a successful call, SelectView picks the view whose items GetNextItem returns.
+        virtual bool PrepareForViews(
+            const std::shared_ptr<engine::SceneGraphNode>& /*rootNode*/,
+            const engine::IView* const* /*views*/,
+            uint32_t /*viewCount*/) { return false; }
+
+        virtual void SelectView(uint32_t /*viewIndex*/) { }
+
         virtual ~IDrawStrategy() = default;
     };
 
@@ -70,12 +88,26 @@ namespace donut::render
         engine::SceneGraphWalker m_Walker;
         std::vector<DrawItem> m_InstanceChunk;
         std::vector<const DrawItem*> m_InstancePtrChunk;
+        std::vector<uint32_t> m_VisibleCells;
         size_t m_ReadPtr = 0;
         size_t m_ChunkSize = 128;
+        const IOcclusionFilter* m_OcclusionFilter = nullptr;
+        VisibilityCache* m_VisibilityCache = nullptr;
+        VisibilityCacheWalker m_CachedWalker;
+
+        // multi-view state, see PrepareForViews
+        std::vector<dm::frustum> m_ViewFrustums;
+        std::vector<std::vector<DrawItem>> m_ViewItems;
+        std::vector<uint32_t> m_ViewMaskStack;
+        bool m_MultiView = false;
 
         void FillChunk();
+        template<typename Walker> void FillChunk(Walker& walker);
+        void AppendMeshInstanceItems(const engine::MeshInstance* meshInstance, const dm::affine3& localToWorld,
+            const dm::frustum& frustum, bool geometriesVisible, std::vector<DrawItem>& items);
 
     public:
+        static constexpr uint32_t MaxMultiViews = 32;
 
         void PrepareForView(
             const std::shared_ptr<engine::SceneGraphNode>& rootNode,
@@ -83,8 +115,23 @@ namespace donut::render
 
         const DrawItem* GetNextItem() override;
 
+        // Walks the graph once and tests every node only against the views that see its parent,
+        // tracked as a bit mask per depth level. Subtrees outside of all frusta are skipped.
+        // Supports up to MaxMultiViews views.
+        bool PrepareForViews(
+            const std::shared_ptr<engine::SceneGraphNode>& rootNode,
+            const engine::IView* const* views,
+            uint32_t viewCount) override;
+
+        void SelectView(uint32_t viewIndex) override;
+
         [[nodiscard]] size_t GetChunkSize() const { return m_ChunkSize; }
         void SetChunkSize(size_t size) { m_ChunkSize = std::max<size_t>(size, 1u); }
+
+        // Only applies to PrepareForView, the multi-view path ignores it.
+        void SetOcclusionFilter(const IOcclusionFilter* filter) { m_OcclusionFilter = filter; }
+        // Only applies to PrepareForView, the multi-view path ignores it.
+        void SetVisibilityCache(VisibilityCache* cache) { m_VisibilityCache = cache; }
     };
 
     class TransparentDrawStrategy : public IDrawStrategy
@@ -92,7 +139,12 @@ namespace donut::render
     private:
         std::vector<DrawItem> m_InstancesToDraw;
         std::vector<const DrawItem*> m_InstancePtrsToDraw;
+        std::vector<uint32_t> m_VisibleCells;
         size_t m_ReadPtr = 0;
+        const IOcclusionFilter* m_OcclusionFilter = nullptr;
+        VisibilityCache* m_VisibilityCache = nullptr;
+
+        template<typename Walker> void CollectItems(Walker& walker, const dm::frustum& viewFrustum, const dm::float3& viewOrigin);
 
     public:
         bool DrawDoubleSidedMaterialsSeparately = true;
@@ -102,5 +154,88 @@ namespace donut::render
             const engine::IView& view) override;
 
         const DrawItem* GetNextItem() override;
+
+        void SetOcclusionFilter(const IOcclusionFilter* filter) { m_OcclusionFilter = filter; }
+        void SetVisibilityCache(VisibilityCache* cache) { m_VisibilityCache = cache; }
     };
-}
\ No newline at end of file
+
+    struct DrawPacket
+    {
+        uint64_t key;
+        uint32_t itemIndex;
+    };
+
+    // Stable LSD radix sort of the packets by key. Digits that are the same in all keys are skipped.
+    // With an executor, large arrays are histogrammed and scattered in parallel blocks;
+    // the result is identical to the serial sort.
+    void RadixSortDrawPackets(std::vector<DrawPacket>& packets, std::vector<DrawPacket>& scratch, tf::Executor* executor = nullptr);
+
+    /*
+    Opaque and alpha-tested draw strategy that compiles the whole draw list for a view up front.
+
+    The mesh instances are culled in parallel ranges, and every visible geometry becomes a packet with
+    a 64-bit sort key built from scene indices rather than pointers, so the order is the same from run
+    to run. The packets are radix sorted, and consecutive items that draw the same geometry with
+    adjacent instance indices are merged into one instanced DrawItem.
+
+    Key layout, from the most significant bit:
+        pass (2 bits):          0 = opaque, 1 = alpha tested
+        material (16 bits):     Material::materialID
+        buffer group (12 bits): BufferGroup::globalBufferGroupIndex
+        depth bucket (8 bits):  logarithmic distance from the view origin, front to back
+        geometry (26 bits):     MeshGeometry::globalGeometryIndex
+    Indices that don't fit are truncated, which only affects batching, not correctness.
+    */
+    class CompiledOpaqueDrawStrategy : public IDrawStrategy
+    {
+    private:
+        struct CullRange
+        {
+            std::vector<DrawItem> items;
+            std::vector<uint64_t> keys;
+            std::vector<uint32_t> visibleCells;
+        };
+
+        tf::Executor* m_Executor = nullptr;
+        const IOcclusionFilter* m_OcclusionFilter = nullptr;
+        size_t m_InstancesPerRange = 256;
+        dm::frustum m_ViewFrustum;
+        dm::float3 m_ViewOrigin = 0.f;
+        std::vector<const engine::MeshInstance*> m_CollectedInstances;
+        std::vector<CullRange> m_Ranges;
+        std::vector<DrawItem> m_Items;
+        std::vector<DrawPacket> m_Packets;
+        std::vector<DrawPacket> m_SortScratch;
+        std::vector<DrawItem> m_MergedItems;
+        size_t m_ReadPtr = 0;
+
+        void CullInstance(const engine::MeshInstance* meshInstance, CullRange& range) const;
+        void MergeSortedItems();
+
+    public:
+        bool SortByDepth = true;
+
+        explicit CompiledOpaqueDrawStrategy(tf::Executor* executor = nullptr)
+            : m_Executor(executor)
+        { }
+
+        void PrepareForView(
+            const std::shared_ptr<engine::SceneGraphNode>& rootNode,
+            const engine::IView& view) override;
+
+        const DrawItem* GetNextItem() override;
+
+        [[nodiscard]] static uint64_t MakeSortKey(const DrawItem& item, uint32_t depthBucket);
+        [[nodiscard]] static uint32_t GetDepthBucket(float distance);
+
+        // Results of the last PrepareForView, in submission order
+        [[nodiscard]] const std::vector<DrawItem>& GetDrawItems() const { return m_MergedItems; }
+        [[nodiscard]] size_t GetVisibleItemCount() const { return m_Items.size(); }
+
+        void SetExecutor(tf::Executor* executor) { m_Executor = executor; }
+        // The filter is called from the executor's threads.
+        void SetOcclusionFilter(const IOcclusionFilter* filter) { m_OcclusionFilter = filter; }
+        [[nodiscard]] size_t GetInstancesPerRange() const { return m_InstancesPerRange; }
+        void SetInstancesPerRange(size_t count) { m_InstancesPerRange = std::max<size_t>(count, 1u); }
+    };
+}
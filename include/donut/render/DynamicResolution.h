@@ -0,0 +1,106 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <donut/core/circular_buffer.h>
+#include <nvrhi/nvrhi.h>
+
+namespace donut::render
+{
+    /*
+    Picks the render resolution scale that keeps the frame time within a budget.
+
+    Every frame, the measured frame time (preferably the GPU time, since the CPU frame time of a
+    v-synced application sticks to the refresh interval) is added to a short history, and the median
+    of that history is compared against the budget. Rendering cost is assumed to be roughly
+    proportional to the pixel count, so a PID filter on the relative budget error adjusts the
+    rendered area, i.e. the square of the scale.
+
+    Hysteresis keeps the scale from flickering: frame times between (1 - Hysteresis) * budget and the
+    budget count as on target, the scale moves in multiples of ScaleStep only, and after a change the
+    scale is not raised again for CooldownFrames frames. Drops are never delayed, so load spikes are
+    handled within a few frames.
+
+    The render targets are meant to be allocated at the maximum size once and rendered into a
+    sub-rect given by GetDynamicRenderSize; TemporalAntiAliasingPass upsamples that sub-rect to the
+    output resolution.
+    */
+    class DynamicResolutionController
+    {
+    public:
+        static constexpr size_t c_HistoryLength = 16;
+
+    private:
+        core::circular_buffer<float, c_HistoryLength> m_FrameTimes;
+        float m_ContinuousScale = 1.f;
+        float m_Scale = 1.f;
+        float m_Integral = 0.f;
+        float m_PreviousError = 0.f;
+        float m_FilteredFrameTimeMs = 0.f;
+        uint32_t m_FramesSinceChange = 0;
+
+        [[nodiscard]] float GetMedianFrameTime() const;
+        [[nodiscard]] float Quantize(float scale) const;
+
+    public:
+        float TargetFrameTimeMs = 1000.f / 60.f;
+        float MinScale = 0.5f;
+        float MaxScale = 1.f;
+        float ScaleStep = 0.05f;
+        float Hysteresis = 0.1f;            // fraction of the budget below it that counts as on target
+        uint32_t FilterFrames = 5;          // frames in the median filter, up to c_HistoryLength
+        uint32_t CooldownFrames = 30;
+        float ProportionalGain = 0.5f;
+        float IntegralGain = 0.05f;
+        float DerivativeGain = 0.1f;
+        float MaxAreaChange = 0.25f;        // largest relative change of the rendered area per frame
+
+        DynamicResolutionController();
+
+        // Clears the history and the filter state and returns to MaxScale.
+        void Reset();
+
+        // Adds the time of the last frame and returns the scale to use for the next one.
+        float Update(float frameTimeMs);
+
+        // The scale that the next frame should be rendered at, in [MinScale, MaxScale]
+        [[nodiscard]] float GetScale() const { return m_Scale; }
+
+        // The median frame time used by the last update
+        [[nodiscard]] float GetFilteredFrameTimeMs() const { return m_FilteredFrameTimeMs; }
+
+        // Sets the scale directly, e.g. from a UI override, and restarts the cooldown.
+        void SetScale(float scale);
+    };
+
+    // Size of the sub-rect to render at the given scale, rounded to even sizes to keep the
+    // half-resolution passes aligned, and never larger than the render targets.
+    [[nodiscard]] dm::uint2 GetDynamicRenderSize(dm::uint2 maxSize, float scale);
+
+    // Viewport covering the sub-rect at the top-left corner of the render targets.
+    [[nodiscard]] nvrhi::Viewport GetDynamicRenderViewport(dm::uint2 maxSize, float scale);
+
+    // Factor that converts UVs relative to the sub-rect into UVs of the whole render target.
+    [[nodiscard]] dm::float2 GetDynamicRenderUVScale(dm::uint2 maxSize, dm::uint2 renderSize);
+}
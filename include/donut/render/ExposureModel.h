@@ -0,0 +1,127 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+namespace donut::render
+{
+    struct ToneMappingParameters
+    {
+        float histogramLowPercentile = 0.8f;
+        float histogramHighPercentile = 0.95f;
+        float eyeAdaptationSpeedUp = 1.f;
+        float eyeAdaptationSpeedDown = 0.5f;
+        float minAdaptedLuminance = 0.02f;
+        float maxAdaptedLuminance = 0.5f;
+        float exposureBias = -0.5f;
+        float whitePoint = 3.f;
+        bool enableColorLUT = true;
+    };
+
+    // Weights in the luminance histogram are fixed point numbers with this many fractional bits,
+    // see histogram_cs.hlsl.
+    constexpr uint32_t c_ExposureHistogramFracBits = 6;
+
+    // Log2 luminance range covered by the histogram bins.
+    struct ExposureHistogramRange
+    {
+        uint32_t bins = 256;
+        float minLogLuminance = -10.f;
+        float maxLogLuminance = 4.f;
+    };
+
+    /*
+    CPU implementation of the auto-exposure math of ToneMappingPass, matching histogram_cs.hlsl and
+    exposure_cs.hlsl operation for operation, so that exposure behaviour can be reproduced and tested
+    without a GPU: for readback frames, offline captures, and replays of recorded histograms.
+
+    Each frame, the target luminance is the average luminance of the histogram between the low and
+    high percentiles, clamped to the adapted luminance range. The adapted luminance moves towards the
+    target exponentially, with a half-life of 1 / eyeAdaptationSpeed seconds, so the result does not
+    depend on how a time span is divided into frames.
+    */
+    class ExposureModel
+    {
+    private:
+        ExposureHistogramRange m_Range;
+        float m_AdaptedLuminance = 0.f;
+
+    public:
+        explicit ExposureModel(const ExposureHistogramRange& range = ExposureHistogramRange());
+
+        [[nodiscard]] const ExposureHistogramRange& GetRange() const { return m_Range; }
+
+        // The value that ToneMappingPass keeps in its exposure buffer; 0 means not adapted yet.
+        [[nodiscard]] float GetAdaptedLuminance() const { return m_AdaptedLuminance; }
+        void Reset(float adaptedLuminance = 0.f) { m_AdaptedLuminance = adaptedLuminance; }
+
+        // Adapts to the histogram over 'frameTime' seconds and returns the new adapted luminance.
+        float AdvanceFrame(const uint32_t* histogram, const ToneMappingParameters& params, float frameTime);
+
+        // Percentiles as passed to the GPU: low in [0, 0.99], high in [low, 1].
+        static void GetClampedPercentiles(const ToneMappingParameters& params, float& lowPercentile, float& highPercentile);
+
+        // Average luminance between the percentiles, clamped to the adapted luminance range.
+        [[nodiscard]] static float ComputeTargetLuminance(const uint32_t* histogram, const ExposureHistogramRange& range,
+            const ToneMappingParameters& params);
+
+        // One adaptation step from 'adaptedLuminance' towards 'targetLuminance'.
+        [[nodiscard]] static float Adapt(float adaptedLuminance, float targetLuminance, const ToneMappingParameters& params, float frameTime);
+    };
+
+    // Adds the pixels of a float image to a histogram of range.bins fixed point weights, like histogram_cs.hlsl.
+    // 'channels' is 3 (RGB) or 4 (RGBA, alpha is ignored), 'rowPitch' is in bytes.
+    // Uses SSE2 where available; the results are the same as with the scalar code.
+    void AddImageToLuminanceHistogram(const float* pixels, uint32_t width, uint32_t height, size_t rowPitch, uint32_t channels,
+        const ExposureHistogramRange& range, uint32_t* histogram);
+
+    // Histograms and frame times of consecutive frames, to be replayed through ExposureModel.
+    struct ExposureRecording
+    {
+        struct Frame
+        {
+            float frameTime = 0.f;
+            std::vector<uint32_t> histogram;
+        };
+
+        ExposureHistogramRange range;
+        std::vector<Frame> frames;
+
+        void AddFrame(const uint32_t* histogram, float frameTime);
+
+        // Text format: a header line with the range, then one line per frame with the frame time and the bins.
+        // Frame times are written with full precision, so replays of a loaded recording are exact.
+        void Write(std::ostream& stream) const;
+        bool Read(std::istream& stream);
+    };
+
+    // Runs the recorded frames through a model that starts at 'initialAdaptedLuminance' and returns the adapted
+    // luminance after each frame. The results are deterministic.
+    std::vector<float> ReplayExposure(const ExposureRecording& recording, const ToneMappingParameters& params,
+        float initialAdaptedLuminance = 0.f);
+}
@@ -114,6 +114,10 @@ namespace donut::render
             const CreateParameters& params);
 
         void ResetBindingCache() const;
+
+        // Releases the binding sets of destroyed materials and the superseded ones.
+        // Call it once per frame, while no view of this pass is being rendered.
+        void ReleaseDestroyedMaterials() const;
         
         // IGeometryPass implementation
 
@@ -49,6 +49,9 @@ namespace donut::render
         const engine::BufferGroup* buffers;
         float distanceToCamera;
         nvrhi::RasterCullMode cullMode;
+        // Range of instances to draw, relative to instance->GetInstanceIndex()
+        uint32_t instanceOffset = 0;
+        uint32_t instanceCount = 1;
     };
 
     class GeometryPassContext
@@ -0,0 +1,231 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <nvrhi/nvrhi.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+struct InstanceData;
+struct GpuCullingConstants;
+struct GpuCullingDrawRecord;
+struct GpuCullingBucket;
+
+namespace donut::engine
+{
+    class ShaderFactory;
+    class CommonRenderPasses;
+    class SceneGraph;
+    class IView;
+    struct Material;
+    struct BufferGroup;
+}
+
+namespace tf
+{
+    class Executor;
+}
+
+namespace donut::render
+{
+    class IGeometryPass;
+    class GeometryPassContext;
+
+    // The farthest depth of a depth buffer and its 2x2 reductions, down to 1x1.
+    // Level sizes are max(1, size >> level), like texture mip levels.
+    struct DepthPyramid
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        bool reverseDepth = false;
+        std::vector<std::vector<float>> levels;
+
+        [[nodiscard]] uint32_t GetLevelWidth(uint32_t level) const { return std::max(width >> level, 1u); }
+        [[nodiscard]] uint32_t GetLevelHeight(uint32_t level) const { return std::max(height >> level, 1u); }
+        [[nodiscard]] float Load(uint32_t x, uint32_t y, uint32_t level) const { return levels[level][size_t(y) * GetLevelWidth(level) + x]; }
+    };
+
+    // Builds a pyramid from a depth buffer with 'width' x 'height' floats. When a level has an odd size,
+    // the last row or column is folded into the last texel of the next level, so the pyramid stays conservative.
+    // MipMapGenPass (MODE_MAX, or MODE_MIN for reverse depth) drops them instead; on the GPU, build the pyramid
+    // from a depth copy with power of two dimensions, where both produce the same texels.
+    void BuildDepthPyramid(const float* depth, uint32_t width, uint32_t height, bool reverseDepth, DepthPyramid& pyramid);
+
+    struct GpuDrawBucket
+    {
+        const engine::Material* material = nullptr;
+        const engine::BufferGroup* buffers = nullptr;
+        nvrhi::RasterCullMode cullMode = nvrhi::RasterCullMode::Back;
+        uint32_t firstRecord = 0;
+        uint32_t recordCount = 0;
+    };
+
+    /*
+    The persistent input of GPU-driven culling: one draw record per instance buffer entry and opaque or
+    alpha-tested geometry, with the object space bounds of the geometry, and the buckets of records that
+    share a material, buffer group and cull mode, which is all the state that RenderView changes between draws.
+
+    Buckets are ordered by pass (opaque, then alpha tested), Material::materialID, buffer group index and
+    cull mode; records inside a bucket by instance index and geometry index. The list only depends on the
+    structure of the scene: rebuild it when the scene graph structure or instance visibility changes,
+    transforms are read from the instance buffer at culling time.
+    */
+    class GpuDrawList
+    {
+    private:
+        std::vector<GpuCullingDrawRecord> m_Records;
+        std::vector<GpuCullingBucket> m_GpuBuckets;
+        std::vector<GpuDrawBucket> m_Buckets;
+        uint32_t m_InstanceCount = 0;
+
+    public:
+        GpuDrawList();
+        ~GpuDrawList();
+
+        // Requires a refreshed scene graph, for the instance, material and geometry indices.
+        void Build(const engine::SceneGraph& sceneGraph);
+
+        [[nodiscard]] const std::vector<GpuCullingDrawRecord>& GetRecords() const { return m_Records; }
+        [[nodiscard]] const std::vector<GpuCullingBucket>& GetGpuBuckets() const { return m_GpuBuckets; }
+        [[nodiscard]] const std::vector<GpuDrawBucket>& GetBuckets() const { return m_Buckets; }
+        [[nodiscard]] uint32_t GetRecordCount() const;
+
+        // Number of instance buffer entries in the scene when the list was built
+        [[nodiscard]] uint32_t GetInstanceCount() const { return m_InstanceCount; }
+    };
+
+    // The view that rendered the depth pyramid, usually the previous frame, and the size of the pyramid.
+    struct OcclusionCullingParameters
+    {
+        const engine::IView* view = nullptr;
+        uint32_t pyramidWidth = 0;
+        uint32_t pyramidHeight = 0;
+        uint32_t pyramidLevels = 0;
+    };
+
+    void FillGpuCullingConstants(GpuCullingConstants& constants, const engine::IView& view, uint32_t bucketCount,
+        uint32_t instanceCount, const OcclusionCullingParameters* occlusion = nullptr);
+
+    // CPU implementation of gpu_culling_cs.hlsl: the same tests and the same compaction, with every floating point
+    // operation in the same order, so the results are bit-exact as long as both sides see the same inputs.
+    // 'drawArguments' receives one entry per record, the visible records of each bucket first, in record order,
+    // followed by empty draws; 'drawCounts' receives the number of visible records per bucket.
+    // 'pyramid' is only used when the constants enable occlusion culling.
+    void CullDrawRecords(
+        const GpuCullingConstants& constants,
+        const InstanceData* instances,
+        const GpuCullingDrawRecord* records,
+        const GpuCullingBucket* buckets,
+        const DepthPyramid* pyramid,
+        nvrhi::DrawIndexedIndirectArguments* drawArguments,
+        uint32_t* drawCounts,
+        tf::Executor* executor = nullptr);
+
+    [[nodiscard]] bool IsDrawRecordVisible(
+        const GpuCullingConstants& constants,
+        const InstanceData* instances,
+        const GpuCullingDrawRecord& record,
+        const DepthPyramid* pyramid);
+
+    /*
+    GPU-driven culling and submission for a GpuDrawList. Cull() runs gpu_culling_cs.hlsl, which reads the
+    transforms from the scene's instance buffer, and writes compacted DrawIndexedIndirectArguments per bucket;
+    Render() then issues one drawIndexedIndirect per bucket instead of one drawIndexed per DrawItem.
+    CullOnCpu() is the fallback that produces the same arguments with CullDrawRecords and uploads them.
+
+    Every bucket is drawn with drawCount = recordCount, and the entries past the visible ones are empty draws,
+    which keeps the submission independent of the culling results without count buffer support.
+    Geometry passes that use the draw arguments in SetPushConstants, such as MaterialIDPass, are not supported.
+    */
+    class GpuCullingPass
+    {
+    private:
+        nvrhi::DeviceHandle m_Device;
+        std::shared_ptr<engine::CommonRenderPasses> m_CommonPasses;
+
+        nvrhi::ShaderHandle m_ComputeShader;
+        nvrhi::BindingLayoutHandle m_BindingLayout;
+        nvrhi::ComputePipelineHandle m_Pso;
+        nvrhi::BindingSetHandle m_BindingSet;
+        nvrhi::IBuffer* m_BoundInstanceBuffer = nullptr;
+        nvrhi::ITexture* m_BoundDepthPyramid = nullptr;
+
+        nvrhi::BufferHandle m_CullingCB;
+        nvrhi::BufferHandle m_RecordBuffer;
+        nvrhi::BufferHandle m_BucketBuffer;
+        nvrhi::BufferHandle m_DrawArgumentBuffer;
+        nvrhi::BufferHandle m_DrawCountBuffer;
+
+        const GpuDrawList* m_DrawList = nullptr;
+        std::vector<nvrhi::DrawIndexedIndirectArguments> m_CpuDrawArguments;
+        std::vector<uint32_t> m_CpuDrawCounts;
+
+        void CreateBuffers(uint32_t recordCount, uint32_t bucketCount);
+
+    public:
+        struct CreateParameters
+        {
+            uint32_t numConstantBufferVersions = 16;
+        };
+
+        GpuCullingPass(
+            nvrhi::IDevice* device,
+            std::shared_ptr<engine::ShaderFactory> shaderFactory,
+            std::shared_ptr<engine::CommonRenderPasses> commonPasses,
+            const CreateParameters& params);
+
+        // Uploads the records and buckets. The list must stay alive and unchanged until the next call.
+        void SetDrawList(nvrhi::ICommandList* commandList, const GpuDrawList& drawList);
+
+        // 'instanceBuffer' is Scene::GetInstanceBuffer(). The depth pyramid texture holds the farthest depth
+        // per texel in its mip levels, see BuildDepthPyramid; it is only used when 'occlusion' is provided.
+        void Cull(
+            nvrhi::ICommandList* commandList,
+            const engine::IView& view,
+            nvrhi::IBuffer* instanceBuffer,
+            const OcclusionCullingParameters* occlusion = nullptr,
+            nvrhi::ITexture* depthPyramid = nullptr);
+
+        // 'instances' is Scene::GetInstanceData().
+        void CullOnCpu(
+            nvrhi::ICommandList* commandList,
+            const engine::IView& view,
+            const InstanceData* instances,
+            const OcclusionCullingParameters* occlusion = nullptr,
+            const DepthPyramid* depthPyramid = nullptr,
+            tf::Executor* executor = nullptr);
+
+        void Render(
+            nvrhi::ICommandList* commandList,
+            const engine::IView* view,
+            const engine::IView* viewPrev,
+            nvrhi::IFramebuffer* framebuffer,
+            IGeometryPass& pass,
+            GeometryPassContext& passContext);
+
+        // DrawIndexedIndirectArguments per record, and the number of visible records per bucket as R32_UINT
+        [[nodiscard]] nvrhi::IBuffer* GetDrawArgumentBuffer() const { return m_DrawArgumentBuffer; }
+        [[nodiscard]] nvrhi::IBuffer* GetDrawCountBuffer() const { return m_DrawCountBuffer; }
+    };
+}
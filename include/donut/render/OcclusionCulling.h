@@ -0,0 +1,178 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/render/GpuCulling.h>
+#include <donut/core/math/math.h>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace donut::engine
+{
+    class IView;
+    class SceneGraphNode;
+    struct MeshInfo;
+}
+
+namespace tf
+{
+    class Executor;
+}
+
+namespace donut::render
+{
+    // Optional test that the draw strategies apply to the nodes that pass frustum culling.
+    // It must be prepared for the same view before PrepareForView.
+    class IOcclusionFilter
+    {
+    public:
+        [[nodiscard]] virtual bool IsBoxVisible(const dm::box3& worldBounds) const = 0;
+        virtual ~IOcclusionFilter() = default;
+    };
+
+    // Simplified geometry that stands in for a mesh when it is rasterized as an occluder.
+    // To keep the culling conservative, the proxy must lie inside the surface of the mesh it replaces.
+    struct OccluderMesh
+    {
+        std::vector<dm::float3> positions;
+        std::vector<uint32_t> indices;
+        bool doubleSided = false;
+    };
+
+    /*
+    Occlusion culling against a low resolution depth buffer that is rasterized on the CPU.
+
+    Designated occluder meshes, or their proxies, are rasterized with the view's projection into a depth buffer
+    that covers the whole viewport, 4 pixels at a time with SSE2 where available. Each pixel stores the farthest
+    depth of the triangle plane over the pixel, and only pixels whose center is covered are written. Triangle
+    setup is spread over the executor by occluder, rasterization by horizontal bands of the buffer; the result
+    does not depend on the number of threads. The buffer is then reduced into a DepthPyramid.
+
+    IsBoxVisible() projects the corners of a box, reads the farthest occluder depth over the covered texels,
+    grown by one texel on each side, from the pyramid level where that is at most 2x2 texels, and culls the
+    box only if all its corners are behind that depth. The result is conservative at the pixel centers of
+    the buffer; a box that is only visible through a gap between occluders thinner than a pixel may be culled.
+
+    Occluders follow the rasterizer state of the passes: single-sided geometry only occludes with its front
+    faces. Alpha-tested and alpha-blended geometry, skinned meshes and instance arrays are never occluders.
+
+    Typical use, once per view:
+        culler.RenderOccluders(rootNode, view);
+        drawStrategy.SetOcclusionFilter(&culler);
+        drawStrategy.PrepareForView(rootNode, view);
+    */
+    class SoftwareOcclusionCuller : public IOcclusionFilter
+    {
+    public:
+        struct Statistics
+        {
+            uint32_t occluderCount = 0;
+            uint32_t triangleCount = 0; // after back-face culling and near plane clipping
+        };
+
+    private:
+        struct QueuedOccluder
+        {
+            const dm::float3* positions;
+            const uint32_t* indices;
+            uint32_t vertexCount;
+            uint32_t indexCount;
+            dm::affine3 localToWorld;
+            bool doubleSided;
+        };
+
+        struct RasterTriangle;
+
+        struct DesignatedOccluder
+        {
+            std::shared_ptr<OccluderMesh> proxy;
+        };
+
+        tf::Executor* m_Executor;
+        uint32_t m_Width;
+        uint32_t m_Height;
+        uint32_t m_RowsPerBand = 16;
+
+        dm::float4x4 m_WorldToClip = dm::float4x4::identity();
+        dm::frustum m_ViewFrustum;
+        bool m_ReverseDepth = false;
+        bool m_MirroredView = false;
+        bool m_HasDepth = false;
+
+        std::unordered_map<const engine::MeshInfo*, DesignatedOccluder> m_Designated;
+        std::vector<QueuedOccluder> m_Queue;
+        std::vector<std::vector<RasterTriangle>> m_OccluderTriangles;
+        std::vector<std::vector<const RasterTriangle*>> m_Bands;
+        std::vector<float> m_Depth;
+        DepthPyramid m_Pyramid;
+        Statistics m_Statistics;
+
+        void SetupTriangles(const QueuedOccluder& occluder, std::vector<RasterTriangle>& triangles) const;
+        void RasterizeBand(uint32_t bandIndex);
+
+    public:
+        // The width is rounded up to a multiple of 4.
+        explicit SoftwareOcclusionCuller(uint32_t width = 256, uint32_t height = 128, tf::Executor* executor = nullptr);
+        ~SoftwareOcclusionCuller() override;
+
+        // Rasterizes the mesh as an occluder when it is found by AddSceneOccluders: the proxy if there is one,
+        // otherwise the opaque geometries of the mesh from BufferGroup::positionData and indexData.
+        // The mesh, and the data it refers to, must stay alive while it is designated.
+        void SetOccluder(const engine::MeshInfo* mesh, std::shared_ptr<OccluderMesh> proxy = nullptr);
+        void RemoveOccluder(const engine::MeshInfo* mesh);
+        void ClearOccluders();
+        [[nodiscard]] bool IsOccluder(const engine::MeshInfo* mesh) const { return m_Designated.find(mesh) != m_Designated.end(); }
+
+        // Clears the depth buffer and the queued occluders, and sets up the view for the following calls.
+        void BeginView(const engine::IView& view);
+
+        // Queues the designated meshes of the visible, non-skinned mesh instances under 'rootNode'.
+        void AddSceneOccluders(const std::shared_ptr<engine::SceneGraphNode>& rootNode);
+
+        // Queues an indexed triangle list. The data is read in Rasterize and must stay alive until then.
+        void AddOccluder(const dm::float3* positions, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount,
+            const dm::affine3& localToWorld, bool doubleSided);
+        void AddOccluder(const OccluderMesh& mesh, const dm::affine3& localToWorld);
+
+        // Rasterizes the queued occluders and builds the depth pyramid that IsBoxVisible reads.
+        void Rasterize();
+
+        // BeginView, AddSceneOccluders and Rasterize.
+        void RenderOccluders(const std::shared_ptr<engine::SceneGraphNode>& rootNode, const engine::IView& view);
+
+        // Returns false only if the box is entirely behind the occluders. Before Rasterize, every box is visible.
+        // Safe to call from several threads.
+        [[nodiscard]] bool IsBoxVisible(const dm::box3& worldBounds) const override;
+
+        [[nodiscard]] uint32_t GetWidth() const { return m_Width; }
+        [[nodiscard]] uint32_t GetHeight() const { return m_Height; }
+        // Row-major depth buffer, with the far plane depth where no occluder was rasterized
+        [[nodiscard]] const std::vector<float>& GetDepthBuffer() const { return m_Depth; }
+        [[nodiscard]] const DepthPyramid& GetDepthPyramid() const { return m_Pyramid; }
+        [[nodiscard]] const Statistics& GetStatistics() const { return m_Statistics; }
+
+        void SetExecutor(tf::Executor* executor) { m_Executor = executor; }
+        void SetRowsPerBand(uint32_t rows) { m_RowsPerBand = std::max(rows, 1u); }
+    };
+}
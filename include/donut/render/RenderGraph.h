@@ -0,0 +1,271 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <nvrhi/nvrhi.h>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace donut::render
+{
+    /*
+    Frame graph for the transient render targets of a frame.
+
+    Passes are added with a setup function that declares which textures the pass reads and
+    writes, and in which state, plus an execute function that records the pass. Textures are
+    either transient, i.e. created by the graph and only valid within the frame, or imported
+    from the application (swap chain images, history buffers, etc.).
+
+    RenderGraph::Compile does not touch the GPU and produces a RenderGraphPlan:
+     - Passes that do not contribute to an imported texture and are not marked as having side
+       effects are culled, along with the passes that only feed them.
+     - The lifetime of each transient texture is the range of surviving passes that access it.
+     - Transient textures are placed in a single heap. Textures whose lifetimes overlap interfere;
+       the textures are placed largest first at the lowest offset that does not overlap the
+       memory of any interfering texture, which colors the interval graph of the lifetimes with
+       memory ranges.
+     - Every pass gets one batch of state transitions that brings all of its textures into the
+       declared states. The first use of a transient texture is marked as a discard, since its
+       memory may have been used by another texture.
+
+    RenderGraphExecutor maps a plan onto nvrhi: it allocates the heap, creates placed textures
+    (cached across frames while their placement is stable), issues the transitions and runs
+    the passes. The first use of a render target or depth texture clears it, to the clear
+    value of its desc or to zero.
+    */
+
+    struct RenderGraphTextureHandle
+    {
+        uint32_t index = ~0u;
+
+        [[nodiscard]] bool IsValid() const { return index != ~0u; }
+        bool operator==(const RenderGraphTextureHandle& other) const { return index == other.index; }
+        bool operator!=(const RenderGraphTextureHandle& other) const { return index != other.index; }
+    };
+
+    struct RenderGraphMemoryRequirements
+    {
+        uint64_t size = 0;
+        uint64_t alignment = 1;
+    };
+
+    typedef std::function<RenderGraphMemoryRequirements(const nvrhi::TextureDesc& desc)> RenderGraphMemoryRequirementsFunc;
+
+    // Size of a texture computed from its format and dimensions, for compiling without a device.
+    // Uses the D3D12 placement alignment: 64 KB, or 4 MB for multisampled textures.
+    [[nodiscard]] RenderGraphMemoryRequirements EstimateTextureMemoryRequirements(const nvrhi::TextureDesc& desc);
+
+    struct RenderGraphCompileOptions
+    {
+        RenderGraphMemoryRequirementsFunc getMemoryRequirements; // EstimateTextureMemoryRequirements if empty
+        bool cullPasses = true;
+        bool enableAliasing = true;
+    };
+
+    struct RenderGraphBarrier
+    {
+        RenderGraphTextureHandle texture;
+        nvrhi::ResourceStates before = nvrhi::ResourceStates::Unknown;
+        nvrhi::ResourceStates after = nvrhi::ResourceStates::Unknown;
+        bool discard = false; // first use of a transient texture, the previous contents are undefined
+    };
+
+    struct RenderGraphPlannedPass
+    {
+        uint32_t passIndex = 0;
+        std::vector<RenderGraphBarrier> barriers; // issued as one batch before the pass
+    };
+
+    struct RenderGraphTexturePlacement
+    {
+        bool allocated = false;     // false for imported textures and for textures only used by culled passes
+        uint32_t firstPass = 0;     // lifetime, as indices into RenderGraphPlan::passes
+        uint32_t lastPass = 0;
+        uint64_t offset = 0;        // in the heap
+        uint64_t size = 0;
+    };
+
+    struct RenderGraphPlan
+    {
+        std::vector<RenderGraphPlannedPass> passes;         // surviving passes, in the order they were added
+        std::vector<bool> passCulled;                       // for every pass added to the graph
+        std::vector<RenderGraphTexturePlacement> textures;  // for every texture in the graph
+        std::vector<RenderGraphBarrier> finalBarriers;      // imported textures to their final states
+
+        uint64_t heapSize = 0;          // memory needed by the placement
+        uint64_t unaliasedSize = 0;     // memory needed without aliasing
+        uint64_t peakLiveSize = 0;      // largest total size of the textures live at one pass, a lower bound for heapSize
+        uint32_t barrierCount = 0;
+    };
+
+    class RenderGraphResources
+    {
+    private:
+        std::vector<nvrhi::ITexture*> m_Textures;
+
+        friend class RenderGraphExecutor;
+
+    public:
+        // Only valid while the pass that declared the access executes.
+        [[nodiscard]] nvrhi::ITexture* GetTexture(RenderGraphTextureHandle handle) const;
+    };
+
+    typedef std::function<void(nvrhi::ICommandList* commandList, const RenderGraphResources& resources)> RenderGraphExecuteFunc;
+
+    class RenderGraph;
+
+    class RenderGraphPassBuilder
+    {
+    private:
+        RenderGraph& m_Graph;
+        uint32_t m_PassIndex;
+
+        RenderGraphPassBuilder(RenderGraph& graph, uint32_t passIndex) : m_Graph(graph), m_PassIndex(passIndex) { }
+
+        friend class RenderGraph;
+
+    public:
+        RenderGraphTextureHandle CreateTexture(const nvrhi::TextureDesc& desc);
+
+        void Read(RenderGraphTextureHandle texture, nvrhi::ResourceStates state = nvrhi::ResourceStates::ShaderResource);
+        void Write(RenderGraphTextureHandle texture, nvrhi::ResourceStates state = nvrhi::ResourceStates::RenderTarget);
+
+        // Keeps the pass even if nothing reads its outputs, e.g. for readbacks.
+        void SetSideEffects();
+    };
+
+    class RenderGraph
+    {
+    private:
+        struct TextureAccess
+        {
+            uint32_t texture;
+            nvrhi::ResourceStates state;
+            bool write;
+        };
+
+        struct PassNode
+        {
+            std::string name;
+            std::vector<TextureAccess> accesses;
+            RenderGraphExecuteFunc execute;
+            bool sideEffects = false;
+        };
+
+        struct TextureNode
+        {
+            nvrhi::TextureDesc desc;
+            nvrhi::TextureHandle importedTexture;
+            nvrhi::ResourceStates initialState = nvrhi::ResourceStates::Unknown;
+            nvrhi::ResourceStates finalState = nvrhi::ResourceStates::Unknown;
+            bool imported = false;
+        };
+
+        std::vector<PassNode> m_Passes;
+        std::vector<TextureNode> m_Textures;
+
+        void AddAccess(uint32_t passIndex, RenderGraphTextureHandle texture, nvrhi::ResourceStates state, bool write);
+
+        friend class RenderGraphPassBuilder;
+        friend class RenderGraphExecutor;
+
+    public:
+        RenderGraphTextureHandle CreateTexture(const nvrhi::TextureDesc& desc);
+
+        // The texture must be in 'currentState' when the graph executes; if 'finalState' is not
+        // Unknown, the graph transitions the texture into it after the last pass. Passes writing
+        // imported textures are never culled.
+        RenderGraphTextureHandle ImportTexture(nvrhi::ITexture* texture,
+            nvrhi::ResourceStates currentState, nvrhi::ResourceStates finalState = nvrhi::ResourceStates::Unknown);
+
+        // Calls 'setup' immediately and returns the index of the pass.
+        uint32_t AddPass(const std::string& name, const std::function<void(RenderGraphPassBuilder& builder)>& setup,
+            RenderGraphExecuteFunc execute);
+
+        // Returns false and logs an error if the declarations are inconsistent.
+        bool Compile(const RenderGraphCompileOptions& options, RenderGraphPlan& plan) const;
+
+        void Reset();
+
+        [[nodiscard]] size_t GetPassCount() const { return m_Passes.size(); }
+        [[nodiscard]] size_t GetTextureCount() const { return m_Textures.size(); }
+        [[nodiscard]] const std::string& GetPassName(uint32_t passIndex) const { return m_Passes[passIndex].name; }
+        [[nodiscard]] const nvrhi::TextureDesc& GetTextureDesc(RenderGraphTextureHandle texture) const { return m_Textures[texture.index].desc; }
+        [[nodiscard]] bool IsImported(RenderGraphTextureHandle texture) const { return m_Textures[texture.index].imported; }
+    };
+
+    class RenderGraphExecutor
+    {
+    private:
+        struct TextureKey
+        {
+            nvrhi::TextureDesc desc;
+            uint64_t offset = 0;
+
+            bool operator==(const TextureKey& other) const;
+        };
+
+        struct TextureKeyHash
+        {
+            size_t operator()(const TextureKey& key) const;
+        };
+
+        struct PlacedTexture
+        {
+            nvrhi::TextureHandle texture;
+            uint64_t lastUsedFrame = 0;
+        };
+
+        nvrhi::DeviceHandle m_Device;
+        nvrhi::HeapHandle m_Heap;
+        uint64_t m_HeapCapacity = 0;
+        uint64_t m_FrameIndex = 0;
+        std::unordered_map<TextureKey, PlacedTexture, TextureKeyHash> m_PlacedTextures;
+        std::unordered_map<TextureKey, RenderGraphMemoryRequirements, TextureKeyHash> m_MemoryRequirements;
+
+        nvrhi::ITexture* GetPlacedTexture(const nvrhi::TextureDesc& desc, uint64_t offset);
+        static nvrhi::TextureDesc GetPlacedTextureDesc(const nvrhi::TextureDesc& desc);
+
+    public:
+        // Placed textures that were not used by the last few graphs are released.
+        uint32_t MaxUnusedFrames = 2;
+
+        explicit RenderGraphExecutor(nvrhi::IDevice* device);
+
+        // Memory requirements reported by the device, cached per texture description.
+        [[nodiscard]] RenderGraphMemoryRequirements GetMemoryRequirements(const nvrhi::TextureDesc& desc);
+
+        // Compiles the graph with the device's memory requirements and executes it.
+        bool Execute(const RenderGraph& graph, nvrhi::ICommandList* commandList, RenderGraphPlan* outPlan = nullptr);
+
+        // Executes a plan compiled from 'graph' with the memory requirements of this executor.
+        void Execute(const RenderGraph& graph, const RenderGraphPlan& plan, nvrhi::ICommandList* commandList);
+
+        // Releases the heap and all placed textures.
+        void ReleaseMemory();
+
+        [[nodiscard]] uint64_t GetHeapCapacity() const { return m_HeapCapacity; }
+    };
+}
@@ -0,0 +1,162 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <donut/render/DrawStrategy.h>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace donut::engine
+{
+    class SceneGraph;
+    class SceneGraphNode;
+    class MeshInstance;
+}
+
+namespace donut::render
+{
+    /*
+    CPU side of the static shadow cache: decides which cascades of a cached shadow map need their
+    static casters re-rendered, without touching the GPU.
+
+    Mesh instances start out as static casters. An instance whose world bounds change becomes a
+    dynamic caster and returns to the static set after it has been still for DynamicFrames updates;
+    skinned instances are always dynamic. Every change to the static set (an instance added, removed,
+    hidden, starting or stopping to move) records the affected world bounds as a dirty region, and
+    the cascades whose light-space boxes overlap a dirty region are marked dirty.
+
+    The scene graph versions drive the updates: all mesh instances are only scanned after a structure
+    change, otherwise only the subgraphs whose bounds were recomputed by SceneGraph::Refresh are
+    visited. The casters hold weak references, so an instance allocated at the address of a
+    destroyed one is never mistaken for it.
+
+    Cascade projections are snapped to a coarse light-space grid of SnapFraction times the cascade
+    size, and the cascades are enlarged by half a grid step to keep the coverage. The projection of a
+    cached cascade therefore only changes when the camera crosses a grid line, the cascade size
+    changes, or the light turns, and that is the other reason for a cascade to become dirty.
+
+    Usage per frame: UpdateCasters, then SnapCascade for each cascade while setting up the views,
+    then re-render the static casters of the dirty cascades and call MarkCascadeRendered.
+    */
+    class ShadowCacheTracker
+    {
+    private:
+        struct CasterState
+        {
+            std::weak_ptr<const engine::MeshInstance> instance;
+            dm::box3 bounds;
+            uint64_t lastSeenUpdate = 0;
+            uint64_t lastMovedUpdate = 0;
+            bool isDynamic = false;
+            bool alwaysDynamic = false;
+            bool visible = true;
+        };
+
+        struct CascadeState
+        {
+            dm::float3x3 worldToLight = dm::float3x3::identity();
+            dm::float3 centerLight = 0.f;
+            dm::float3 halfSize = 0.f;
+            dm::float3 grid = 0.f;
+            bool valid = false;
+            bool dirty = true;
+        };
+
+        std::unordered_map<const engine::MeshInstance*, CasterState> m_Casters;
+        std::vector<CascadeState> m_Cascades;
+        std::vector<dm::box3> m_DirtyRegions;
+        uint64_t m_UpdateIndex = 0;
+        size_t m_StaticCasterCount = 0;
+        size_t m_DynamicCasterCount = 0;
+        const engine::SceneGraph* m_Graph = nullptr;
+        uint32_t m_StructureVersion = 0;
+        uint32_t m_BoundsVersion = 0;
+
+        void AddDirtyRegion(const dm::box3& bounds);
+        void UpdateCaster(const std::shared_ptr<engine::MeshInstance>& meshInstance, const engine::SceneGraphNode& node);
+        void RemoveCaster(const CasterState& state);
+        [[nodiscard]] static dm::box3 GetCascadeBox(const CascadeState& cascade);
+
+    public:
+        float SnapFraction = 0.125f;
+        uint32_t DynamicFrames = 8;
+
+        explicit ShadowCacheTracker(uint32_t numCascades = 0);
+
+        void SetNumberOfCascades(uint32_t count);
+        [[nodiscard]] uint32_t GetNumberOfCascades() const { return uint32_t(m_Cascades.size()); }
+
+        // Drops all cached state, e.g. after the cache texture has been recreated.
+        void Invalidate();
+
+        // Updates the static and dynamic sets from the changes to the graph since the last call,
+        // and marks the cascades that overlap the changes as dirty. Call it after SceneGraph::Refresh.
+        void UpdateCasters(const engine::SceneGraph& graph);
+
+        // Replaces the cascade box, given in world space as a center and light-space half size,
+        // with its snapped version, and marks the cascade dirty if that differs from the cached one.
+        // Returns true if the cascade is dirty.
+        bool SnapCascade(uint32_t cascade, const dm::affine3& worldToLight, dm::float3& center, dm::float3& halfSize);
+
+        [[nodiscard]] bool IsCascadeDirty(uint32_t cascade) const;
+        void MarkCascadeRendered(uint32_t cascade);
+
+        [[nodiscard]] bool IsStaticCaster(const engine::MeshInstance* instance) const;
+        [[nodiscard]] size_t GetStaticCasterCount() const { return m_StaticCasterCount; }
+        [[nodiscard]] size_t GetDynamicCasterCount() const { return m_DynamicCasterCount; }
+
+        // The regions recorded by the last UpdateCasters call, in world space
+        [[nodiscard]] const std::vector<dm::box3>& GetDirtyRegions() const { return m_DirtyRegions; }
+    };
+
+    // Passes through the items of another strategy that belong to either the static or the dynamic casters.
+    class ShadowCasterDrawStrategy : public IDrawStrategy
+    {
+    private:
+        IDrawStrategy& m_Inner;
+        const ShadowCacheTracker& m_Tracker;
+        bool m_StaticCasters;
+
+    public:
+        ShadowCasterDrawStrategy(IDrawStrategy& inner, const ShadowCacheTracker& tracker, bool staticCasters)
+            : m_Inner(inner)
+            , m_Tracker(tracker)
+            , m_StaticCasters(staticCasters)
+        { }
+
+        void PrepareForView(
+            const std::shared_ptr<engine::SceneGraphNode>& rootNode,
+            const engine::IView& view) override;
+
+        const DrawItem* GetNextItem() override;
+
+        bool PrepareForViews(
+            const std::shared_ptr<engine::SceneGraphNode>& rootNode,
+            const engine::IView* const* views,
+            uint32_t viewCount) override;
+
+        void SelectView(uint32_t viewIndex) override;
+    };
+}
@@ -54,6 +54,14 @@ namespace donut::render
         bool enableHistoryClamping = true;
     };
 
+    // Number of jitter phases needed to cover the output pixels when upscaling by the given ratio
+    // of the output and input view sizes (per axis). 16 at native resolution, up to 256.
+    [[nodiscard]] uint32_t GetTemporalAntiAliasingJitterPhaseCount(float upscalingRatio);
+
+    // Subpixel offset of the given frame in input pixels, in [-0.5, 0.5).
+    // The Halton sequence repeats after 'phaseCount' frames, the MSAA pattern after 8 frames.
+    [[nodiscard]] dm::float2 GetTemporalAntiAliasingJitterOffset(TemporalAntiAliasingJitter jitter, uint32_t frameIndex, uint32_t phaseCount = 16);
+
     class TemporalAntiAliasingPass
     {
     private:
@@ -78,10 +86,14 @@ namespace donut::render
         uint32_t m_StencilMask;
         dm::float2 m_ResolvedColorSize;
 
-        dm::float2 m_R2Jitter;
         TemporalAntiAliasingJitter m_Jitter;
+        uint32_t m_JitterPhaseCount;
 
     public:
+        // The resolve upsamples when the input view is smaller than the output view. With dynamic resolution,
+        // unresolvedColor, motionVectors and sourceDepth are allocated at the largest render size, and the input
+        // view's viewport selects the sub-rect that was rendered in the current frame. The feedback textures
+        // must have the size of resolvedColor.
         struct CreateParameters
         {
             nvrhi::ITexture* sourceDepth = nullptr;
@@ -117,6 +129,11 @@ namespace donut::render
 
         void AdvanceFrame();
         void SetJitter(TemporalAntiAliasingJitter jitter);
+
+        // Lengthens the jitter sequence for upscaling, see GetTemporalAntiAliasingJitterPhaseCount.
+        // Call before GetCurrentPixelOffset whenever the input resolution changes.
+        void SetUpscalingRatio(float upscalingRatio);
+
         dm::float2 GetCurrentPixelOffset();
     };
 }
@@ -22,6 +22,7 @@
 
 #pragma once
 
+#include <donut/render/ExposureModel.h>
 #include <nvrhi/nvrhi.h>
 #include <memory>
 #include <unordered_map>
@@ -36,19 +37,6 @@ namespace donut::engine
 
 namespace donut::render
 {
-    struct ToneMappingParameters
-    {
-        float histogramLowPercentile = 0.8f;
-        float histogramHighPercentile = 0.95f;
-        float eyeAdaptationSpeedUp = 1.f;
-        float eyeAdaptationSpeedDown = 0.5f;
-        float minAdaptedLuminance = 0.02f;
-        float maxAdaptedLuminance = 0.5f;
-        float exposureBias = -0.5f;
-        float whitePoint = 3.f;
-        bool enableColorLUT = true;
-    };
-
     class ToneMappingPass
     {
     private:
@@ -57,7 +45,7 @@ namespace donut::render
         nvrhi::ShaderHandle m_PixelShader;
         nvrhi::ShaderHandle m_HistogramComputeShader;
         nvrhi::ShaderHandle m_ExposureComputeShader;
-        uint32_t m_HistogramBins;
+        ExposureHistogramRange m_HistogramRange;
 
         nvrhi::BufferHandle m_ToneMappingCB;
         nvrhi::BufferHandle m_HistogramBuffer;
@@ -88,6 +76,8 @@ namespace donut::render
         {
             bool isTextureArray = false;
             uint32_t histogramBins = 256;
+            float histogramMinLogLuminance = -10.f;
+            float histogramMaxLogLuminance = 4.f;
             uint32_t numConstantBufferVersions = 16;
             nvrhi::IBuffer* exposureBufferOverride = nullptr;
             nvrhi::ITexture* colorLUT = nullptr;
@@ -114,6 +104,11 @@ namespace donut::render
             nvrhi::ITexture* sourceTexture);
 
         nvrhi::BufferHandle GetExposureBuffer();
+
+        // The histogram built by AddFrameToHistogram, as range.bins R32_UINT fixed point weights.
+        // Copy it to a staging buffer to feed an ExposureModel or an ExposureRecording.
+        nvrhi::BufferHandle GetHistogramBuffer();
+        [[nodiscard]] const ExposureHistogramRange& GetHistogramRange() const { return m_HistogramRange; }
         
         void AdvanceFrame(float frameTime);
 
@@ -0,0 +1,119 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/engine/SceneGraph.h>
+#include <memory>
+#include <unordered_map>
+
+namespace donut::engine
+{
+    class IView;
+    class MeshInstance;
+}
+
+namespace donut::render
+{
+    class VisibilityCache;
+
+    // Walks the nodes of a subgraph like SceneGraphWalker, with frustum tests that are cached by VisibilityCache.
+    class VisibilityCacheWalker
+    {
+    private:
+        friend class VisibilityCache;
+        struct ViewState;
+
+        ViewState* m_View = nullptr;
+        uint32_t m_Index = 0;
+
+    public:
+        VisibilityCacheWalker() = default;
+
+        [[nodiscard]] operator bool() const;
+        [[nodiscard]] engine::SceneGraphNode* Get() const;
+        engine::SceneGraphNode* operator->() const { return Get(); }
+
+        // Same as SceneGraphWalker::Next, except that it does not return the depth change.
+        void Next(bool allowChildren);
+
+        // Returns whether the bounding box of the current node intersects the view frustum.
+        [[nodiscard]] bool IsVisible() const;
+
+        // The leaf of the current node as a mesh instance, or nullptr.
+        [[nodiscard]] engine::MeshInstance* GetMeshInstance() const;
+
+        // Returns true when the bounding boxes of all geometries of a visible mesh instance with several geometries
+        // are known to intersect the view frustum, as if each one was tested. The geometry bounds are treated like
+        // the mesh bounds, which the graph does not track either: changing them requires a structure change.
+        [[nodiscard]] bool AreGeometriesVisible() const;
+    };
+
+    /*
+    Frustum culling results that are carried over from frame to frame, for each view.
+
+    The nodes of the subgraph are kept in a flat list in the order of SceneGraphWalker, which is rebuilt when the
+    structure version of the graph changes. Each node remembers the result of its last frustum test together with
+    the bounds version of the node and a margin: how far the box was from changing the result, measured as the
+    smallest plane distance for a visible box or the largest one for a culled box. The view accumulates how much
+    its frustum planes have moved since; a plane moving by dn (L1 norm of the normal change) and dd (change of the
+    distance) changes the plane distance of a box whose coordinates are at most R in magnitude by at most
+    dn * R + dd. A result is reused while that bound over all the frames since the test stays below the margin,
+    which makes the cached results identical to testing every node, so only nodes whose bounds changed or that
+    are near the frustum boundary are tested again. A large rotation of the view is treated as a camera cut and
+    invalidates all results, and so does ResetView.
+
+    The cache is not thread safe. It can be shared by the draw strategies that draw the same views.
+    */
+    class VisibilityCache
+    {
+    public:
+        struct Statistics
+        {
+            uint32_t testedNodes = 0; // frustum tests since the last BeginView
+            uint32_t cachedNodes = 0; // results reused since the last BeginView
+        };
+
+        VisibilityCache();
+        ~VisibilityCache();
+
+        // Starts a frame of the view, after the graph has been refreshed. Views are identified by their address.
+        // Returns an empty walker when the subgraph does not belong to a graph, which must be culled without the cache.
+        [[nodiscard]] VisibilityCacheWalker BeginView(const std::shared_ptr<engine::SceneGraphNode>& rootNode, const engine::IView& view);
+
+        // Invalidates all results of the view, for camera cuts.
+        void ResetView(const engine::IView& view);
+        void RemoveView(const engine::IView& view);
+        void Clear();
+
+        // Rotations of a frustum plane by more than this L1 norm of the normal change between two frames
+        // are treated as camera cuts.
+        [[nodiscard]] float GetCameraCutThreshold() const { return m_CameraCutThreshold; }
+        void SetCameraCutThreshold(float threshold) { m_CameraCutThreshold = threshold; }
+
+        [[nodiscard]] Statistics GetStatistics(const engine::IView& view) const;
+
+    private:
+        std::unordered_map<const engine::IView*, std::unique_ptr<VisibilityCacheWalker::ViewState>> m_Views;
+        float m_CameraCutThreshold = 0.25f;
+    };
+}
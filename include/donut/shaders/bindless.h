@@ -46,7 +46,8 @@ struct GeometryData
 
 struct InstanceData
 {
-    uint2 padding;
+    uint customData; // per-instance value of a MeshInstanceArray element, 0 otherwise
+    uint padding;
     uint firstGeometryIndex;
     uint numGeometries;
 
@@ -96,7 +97,8 @@ InstanceData LoadInstanceData(ByteAddressBuffer buffer, uint offset)
     uint4 g = buffer.Load4(offset + 16 * 6);
 
     InstanceData ret;
-    ret.padding = a.xy;
+    ret.customData = a.x;
+    ret.padding = a.y;
     ret.firstGeometryIndex = a.z;
     ret.numGeometries = a.w;
     ret.transform = float3x4(asfloat(b), asfloat(c), asfloat(d));
@@ -0,0 +1,77 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef GPU_CULLING_CB_H
+#define GPU_CULLING_CB_H
+
+#define GPU_CULLING_GROUP_SIZE 64
+
+// Dispatches are limited to 65535 thread groups per dimension, so the buckets are laid out in rows of this many groups
+#define GPU_CULLING_DISPATCH_WIDTH 65535
+
+#define GPU_CULLING_FLAG_OCCLUSION 0x01
+#define GPU_CULLING_FLAG_REVERSE_DEPTH 0x02
+
+// The record is always visible, for example a skinned mesh whose object space bounds are not reliable
+#define GPU_CULLING_RECORD_NO_CULLING 0x01
+
+struct GpuCullingConstants
+{
+    // xyz = outward normal, w = distance; a point p is outside of a plane if dot(normal, p) > distance
+    float4 frustumPlanes[6];
+
+    // Projection of the view that produced the depth pyramid, row vector convention
+    float4x4 matWorldToClipOcclusion;
+
+    uint bucketCount;
+    uint instanceCount;
+    uint flags;
+    uint pyramidLevels;
+
+    uint pyramidWidth;
+    uint pyramidHeight;
+    float pyramidTexelSizeX; // 2 / pyramidWidth, the size of a level 0 texel in NDC
+    float pyramidTexelSizeY; // 2 / pyramidHeight
+};
+
+struct GpuCullingDrawRecord
+{
+    float3 boundsMin; // object space
+    uint instanceIndex;
+    float3 boundsMax;
+    uint flags;
+    uint indexCount;
+    uint startIndexLocation;
+    int baseVertexLocation;
+    uint padding;
+};
+
+struct GpuCullingBucket
+{
+    // The records of a bucket are consecutive, and so are its DrawIndexedIndirectArguments entries
+    uint firstRecord;
+    uint recordCount;
+    uint padding0;
+    uint padding1;
+};
+
+#endif // GPU_CULLING_CB_H
@@ -60,6 +60,10 @@ struct LightConstants
     int4 perObjectShadows;
 
     int4 shadowChannel;
+
+    int iesProfileSlice;    // slice of the IES profile atlas (see IesProfileLoader::BakeIesProfileAtlas), or -1
+    int iesProfileTextureIndex; // bindless index of the atlas, or -1
+    int2 padding;
 };
 
 struct LightProbeConstants
@@ -71,9 +75,13 @@ struct LightProbeConstants
 
     uint diffuseArrayIndex;
     uint specularArrayIndex;
-    uint2 padding2;
+    uint diffuseFromSH;     // use diffuseSH instead of the diffuse cubemap
+    uint padding2;
 
     float4 frustumPlanes[6];
+
+    // L2 spherical harmonics of the diffuse irradiance, in the scale of the diffuse cubemaps; xyz = RGB
+    float4 diffuseSH[9];
 };
 
 #endif // LIGHT_CB_H
\ No newline at end of file
@@ -166,3 +166,17 @@ float GetLightProbeWeight(LightProbeConstants lightProbe, float3 position)
 
     return weight;
 }
+
+float3 EvaluateLightProbeDiffuseSH(LightProbeConstants lightProbe, float3 N)
+{
+    float3 result = lightProbe.diffuseSH[0].xyz * 0.282095;
+    result += lightProbe.diffuseSH[1].xyz * (0.488603 * N.y);
+    result += lightProbe.diffuseSH[2].xyz * (0.488603 * N.z);
+    result += lightProbe.diffuseSH[3].xyz * (0.488603 * N.x);
+    result += lightProbe.diffuseSH[4].xyz * (1.092548 * N.x * N.y);
+    result += lightProbe.diffuseSH[5].xyz * (1.092548 * N.y * N.z);
+    result += lightProbe.diffuseSH[6].xyz * (0.315392 * (3.0 * N.z * N.z - 1.0));
+    result += lightProbe.diffuseSH[7].xyz * (1.092548 * N.x * N.z);
+    result += lightProbe.diffuseSH[8].xyz * (0.546274 * (N.x * N.x - N.y * N.y));
+    return max(result, 0);
+}
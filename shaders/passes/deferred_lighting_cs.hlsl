@@ -178,7 +178,9 @@ void main(int2 i_globalIdx : SV_DispatchThreadID)
                 continue;
 
             float specularMipLevel = sqrt(saturate(surfaceMaterial.roughness)) * (lightProbe.mipLevels - 1);
-            float3 diffuseProbe = t_DiffuseLightProbe.SampleLevel(s_LightProbeSampler, float4(N.xyz, lightProbe.diffuseArrayIndex), 0).rgb;
+            float3 diffuseProbe = lightProbe.diffuseFromSH != 0
+                ? EvaluateLightProbeDiffuseSH(lightProbe, N)
+                : t_DiffuseLightProbe.SampleLevel(s_LightProbeSampler, float4(N.xyz, lightProbe.diffuseArrayIndex), 0).rgb;
             float3 specularProbe = t_SpecularLightProbe.SampleLevel(s_LightProbeSampler, float4(R.xyz, lightProbe.specularArrayIndex), specularMipLevel).rgb;
 
             lightProbeDiffuse += (weight * lightProbe.diffuseScale) * diffuseProbe;
@@ -0,0 +1,268 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma pack_matrix(row_major)
+
+#include <donut/shaders/bindless.h>
+#include <donut/shaders/gpu_culling_cb.h>
+
+// This shader has a C++ twin in src/render/GpuCulling.cpp that is used as the test oracle and the CPU fallback.
+// Both sides evaluate every floating point expression in the same order, and 'precise' keeps the compiler
+// from fusing or reordering the operations, so the results are bit-exact. Keep them in sync.
+
+cbuffer c_Culling : register(b0)
+{
+    GpuCullingConstants g_Culling;
+};
+
+ByteAddressBuffer t_Instances : register(t0);
+StructuredBuffer<GpuCullingDrawRecord> t_Records : register(t1);
+StructuredBuffer<GpuCullingBucket> t_Buckets : register(t2);
+Texture2D<float> t_DepthPyramid : register(t3);
+
+RWBuffer<uint> u_DrawArguments : register(u0);
+RWBuffer<uint> u_DrawCounts : register(u1);
+
+static const uint c_SizeOfInstanceData = 112;
+static const uint c_DrawArgumentsStride = 5; // DrawIndexedIndirectArguments, in uints
+
+groupshared uint s_Prefix[GPU_CULLING_GROUP_SIZE];
+
+void TransformBounds(float3x4 transform, float3 boundsMin, float3 boundsMax, out float3 worldMin, out float3 worldMax)
+{
+    precise float3 center = (boundsMin + boundsMax) * 0.5;
+    precise float3 extent = (boundsMax - boundsMin) * 0.5;
+
+    precise float3 worldCenter;
+    precise float3 worldExtent;
+
+    [unroll]
+    for (uint row = 0; row < 3; row++)
+    {
+        float4 m = transform[row];
+        worldCenter[row] = m.x * center.x + m.y * center.y + m.z * center.z + m.w;
+        worldExtent[row] = abs(m.x) * extent.x + abs(m.y) * extent.y + abs(m.z) * extent.z;
+    }
+
+    worldMin = worldCenter - worldExtent;
+    worldMax = worldCenter + worldExtent;
+}
+
+bool IsOutsideFrustum(float3 worldMin, float3 worldMax)
+{
+    [unroll]
+    for (uint i = 0; i < 6; i++)
+    {
+        float4 plane = g_Culling.frustumPlanes[i];
+        float3 p = float3(
+            plane.x > 0 ? worldMin.x : worldMax.x,
+            plane.y > 0 ? worldMin.y : worldMax.y,
+            plane.z > 0 ? worldMin.z : worldMax.z);
+
+        precise float distance = plane.x * p.x + plane.y * p.y + plane.z * p.z - plane.w;
+        if (distance > 0)
+            return true;
+    }
+
+    return false;
+}
+
+// Largest texel index i < size whose left edge, i * texelSize - 1 in NDC, is at or left of x / w.
+// The division only provides a starting point; the result is determined by the exact comparisons.
+uint GetTexelIndex(float x, float w, uint size, float texelSize)
+{
+    precise float estimate = floor((x / w + 1.0) / texelSize);
+    int i = int(clamp(estimate, 0.0, float(size - 1)));
+
+    precise float edge = (float(i) * texelSize - 1.0) * w;
+    while (i > 0 && edge > x)
+    {
+        --i;
+        edge = (float(i) * texelSize - 1.0) * w;
+    }
+
+    precise float nextEdge = (float(i + 1) * texelSize - 1.0) * w;
+    while (uint(i + 1) < size && nextEdge <= x)
+    {
+        ++i;
+        nextEdge = (float(i + 1) * texelSize - 1.0) * w;
+    }
+
+    return uint(i);
+}
+
+bool IsOccluded(float3 worldMin, float3 worldMax)
+{
+    bool reverseDepth = (g_Culling.flags & GPU_CULLING_FLAG_REVERSE_DEPTH) != 0;
+    float4x4 m = g_Culling.matWorldToClipOcclusion;
+
+    precise float4 clip[8];
+    uint2 rectMin = uint2(~0u, ~0u);
+    uint2 rectMax = uint2(0, 0);
+
+    [unroll]
+    for (uint corner = 0; corner < 8; corner++)
+    {
+        float3 p = float3(
+            (corner & 1) ? worldMax.x : worldMin.x,
+            (corner & 2) ? worldMax.y : worldMin.y,
+            (corner & 4) ? worldMax.z : worldMin.z);
+
+        clip[corner] = p.x * m[0] + p.y * m[1] + p.z * m[2] + m[3];
+
+        // a corner on or behind the eye plane: the projection is unbounded, treat as visible
+        if (!(clip[corner].w > 0))
+            return false;
+
+        uint2 texel = uint2(
+            GetTexelIndex(clip[corner].x, clip[corner].w, g_Culling.pyramidWidth, g_Culling.pyramidTexelSizeX),
+            GetTexelIndex(-clip[corner].y, clip[corner].w, g_Culling.pyramidHeight, g_Culling.pyramidTexelSizeY));
+
+        rectMin = min(rectMin, texel);
+        rectMax = max(rectMax, texel);
+    }
+
+    // the finest level where the rectangle covers at most 2x2 texels
+    uint level = 0;
+    while (level + 1 < g_Culling.pyramidLevels && (
+        (rectMax.x >> level) - (rectMin.x >> level) > 1 ||
+        (rectMax.y >> level) - (rectMin.y >> level) > 1))
+    {
+        ++level;
+    }
+
+    uint2 levelSize = max(uint2(g_Culling.pyramidWidth, g_Culling.pyramidHeight) >> level, 1);
+    uint2 first = min(rectMin >> level, levelSize - 1);
+    uint2 last = min(rectMax >> level, levelSize - 1);
+
+    float farthest = t_DepthPyramid.Load(int3(first, level));
+    for (uint y = first.y; y <= last.y; y++)
+    {
+        for (uint x = first.x; x <= last.x; x++)
+        {
+            float depth = t_DepthPyramid.Load(int3(x, y, level));
+            farthest = reverseDepth ? min(farthest, depth) : max(farthest, depth);
+        }
+    }
+
+    // occluded if every corner is behind the farthest depth in the rectangle
+    [unroll]
+    for (uint i = 0; i < 8; i++)
+    {
+        precise float occluderDepth = farthest * clip[i].w;
+        bool behind = reverseDepth ? (clip[i].z < occluderDepth) : (clip[i].z > occluderDepth);
+        if (!behind)
+            return false;
+    }
+
+    return true;
+}
+
+bool IsRecordVisible(GpuCullingDrawRecord record)
+{
+    if (record.flags & GPU_CULLING_RECORD_NO_CULLING)
+        return true;
+
+    if (record.instanceIndex >= g_Culling.instanceCount)
+        return false;
+
+    InstanceData instance = LoadInstanceData(t_Instances, record.instanceIndex * c_SizeOfInstanceData);
+
+    float3 worldMin, worldMax;
+    TransformBounds(instance.transform, record.boundsMin, record.boundsMax, worldMin, worldMax);
+
+    if (IsOutsideFrustum(worldMin, worldMax))
+        return false;
+
+    if ((g_Culling.flags & GPU_CULLING_FLAG_OCCLUSION) != 0 && IsOccluded(worldMin, worldMax))
+        return false;
+
+    return true;
+}
+
+void WriteDrawArguments(uint slot, uint indexCount, uint instanceCount, uint startIndexLocation, int baseVertexLocation, uint startInstanceLocation)
+{
+    uint offset = slot * c_DrawArgumentsStride;
+    u_DrawArguments[offset + 0] = indexCount;
+    u_DrawArguments[offset + 1] = instanceCount;
+    u_DrawArguments[offset + 2] = startIndexLocation;
+    u_DrawArguments[offset + 3] = asuint(baseVertexLocation);
+    u_DrawArguments[offset + 4] = startInstanceLocation;
+}
+
+// One thread group per bucket, in rows of GPU_CULLING_DISPATCH_WIDTH groups. The visible records are
+// compacted in record order with a group-wide prefix sum, so the output does not depend on thread scheduling.
+[numthreads(GPU_CULLING_GROUP_SIZE, 1, 1)]
+void main(uint3 groupIdx : SV_GroupID, uint threadIdx : SV_GroupIndex)
+{
+    uint bucketIndex = groupIdx.y * GPU_CULLING_DISPATCH_WIDTH + groupIdx.x;
+    if (bucketIndex >= g_Culling.bucketCount)
+        return;
+
+    GpuCullingBucket bucket = t_Buckets[bucketIndex];
+    uint visibleCount = 0;
+
+    for (uint base = 0; base < bucket.recordCount; base += GPU_CULLING_GROUP_SIZE)
+    {
+        uint recordOffset = base + threadIdx;
+        bool visible = false;
+        GpuCullingDrawRecord record = (GpuCullingDrawRecord)0;
+
+        if (recordOffset < bucket.recordCount)
+        {
+            record = t_Records[bucket.firstRecord + recordOffset];
+            visible = IsRecordVisible(record);
+        }
+
+        // inclusive prefix sum of the visibility bits
+        s_Prefix[threadIdx] = visible ? 1 : 0;
+        GroupMemoryBarrierWithGroupSync();
+
+        for (uint offset = 1; offset < GPU_CULLING_GROUP_SIZE; offset <<= 1)
+        {
+            uint value = s_Prefix[threadIdx];
+            if (threadIdx >= offset)
+                value += s_Prefix[threadIdx - offset];
+            GroupMemoryBarrierWithGroupSync();
+            s_Prefix[threadIdx] = value;
+            GroupMemoryBarrierWithGroupSync();
+        }
+
+        if (visible)
+        {
+            uint slot = bucket.firstRecord + visibleCount + s_Prefix[threadIdx] - 1;
+            WriteDrawArguments(slot, record.indexCount, 1, record.startIndexLocation, record.baseVertexLocation, record.instanceIndex);
+        }
+
+        visibleCount += s_Prefix[GPU_CULLING_GROUP_SIZE - 1];
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    // drawIndexedIndirect is issued for the whole bucket, so the unused entries become empty draws
+    for (uint slot = visibleCount + threadIdx; slot < bucket.recordCount; slot += GPU_CULLING_GROUP_SIZE)
+    {
+        WriteDrawArguments(bucket.firstRecord + slot, 0, 0, 0, 0, 0);
+    }
+
+    if (threadIdx == 0)
+        u_DrawCounts[bucketIndex] = visibleCount;
+}
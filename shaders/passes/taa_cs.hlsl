@@ -114,6 +114,11 @@ float3 BicubicSampleCatmullRom(Texture2D tex, SamplerState samp, float2 samplePo
 
 void Preload(int2 sharedID, int2 globalID)
 {
+    // Stay inside the input view: with dynamic resolution, the texels outside of it belong to older frames
+    int2 inputMin = int2(g_TemporalAA.inputViewOrigin);
+    int2 inputMax = inputMin + int2(g_TemporalAA.inputViewSize) - 1;
+    globalID = clamp(globalID, inputMin, inputMax);
+
 #if SAMPLE_COUNT == 1
 	float3 color = PQEncode(t_UnfilteredRT[globalID].rgb);
 	float2 motion = t_MotionVectors[globalID].rg;
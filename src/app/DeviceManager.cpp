@@ -50,6 +50,7 @@ freely, subject to the following restrictions:
 #include <donut/app/DeviceManager.h>
 #include <donut/core/math/math.h>
 #include <donut/core/log.h>
+#include <donut/core/profiler.h>
 #include <nvrhi/utils.h>
 
 #include <cstdio>
@@ -423,23 +424,39 @@ void DeviceManager::RunMessageLoop()
 {
     m_PreviousFrameTimestamp = glfwGetTime();
 
+    profiler::SetThreadName("Main");
+
     while(!glfwWindowShouldClose(m_Window))
     {
+        profiler::Profiler::Get().BeginFrame();
+
         glfwPollEvents();
 
         UpdateWindowSize();
 
         double curTime = glfwGetTime();
         double elapsedTime = curTime - m_PreviousFrameTimestamp;
+        m_LastFrameTime = elapsedTime;
 
 		JoyStickManager::Singleton().EraseDisconnectedJoysticks();
 		JoyStickManager::Singleton().UpdateAllJoysticks(m_vRenderPasses);
 
         if (m_windowVisible)
         {
-            Animate(elapsedTime);
-            Render();
-            Present();
+            const double cpuStartTime = glfwGetTime();
+            {
+                DONUT_PROFILE_SCOPE("Animate");
+                Animate(m_FixedFrameTime > 0.0 ? m_FixedFrameTime : elapsedTime);
+            }
+            {
+                DONUT_PROFILE_SCOPE("Render");
+                Render();
+            }
+            m_LastFrameCpuTime = glfwGetTime() - cpuStartTime;
+            {
+                DONUT_PROFILE_SCOPE("Present");
+                Present();
+            }
         }
 
         std::this_thread::sleep_for(std::chrono::milliseconds(0));
@@ -449,6 +466,8 @@ void DeviceManager::RunMessageLoop()
         UpdateAverageFrameTime(elapsedTime);
         m_PreviousFrameTimestamp = curTime;
 
+        profiler::Profiler::Get().EndFrame();
+
         ++m_FrameIndex;
     }
 
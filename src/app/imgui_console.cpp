@@ -80,6 +80,7 @@ ImGui_Console::ImGui_Console(std::shared_ptr<console::Interpreter> interpreter,
 	{
 		donut::log::SetCallback([&](donut::log::Severity severity, char const* msg) {			
 				ImVec4 color = getSeverityColor(severity);
+				std::lock_guard<std::mutex> lockGuard(this->m_ItemsLogMutex);
 				this->m_ItemsLog.push_back({severity, color, msg});
 			});
 	}
@@ -99,6 +100,7 @@ void ImGui_Console::Print(char const* fmt, ...)
 
 	LogItem item;
 	item.text = buf.data();
+	std::lock_guard<std::mutex> lockGuard(m_ItemsLogMutex);
 	m_ItemsLog.push_back(item);
 }
 
@@ -106,11 +108,13 @@ void ImGui_Console::Print(std::string_view line)
 {
 	LogItem item;
 	item.text = line;
+	std::lock_guard<std::mutex> lockGuard(m_ItemsLogMutex);
 	m_ItemsLog.push_back(item);
 }
 
 void ImGui_Console::ClearLog()
 {
+	std::lock_guard<std::mutex> lockGuard(m_ItemsLogMutex);
 	m_ItemsLog.clear();
 }
 
@@ -172,6 +176,7 @@ void ImGui_Console::Render(bool* open)
 
 	if (m_Options.font)
 		ImGui::PushFont(m_Options.font);
+	std::unique_lock<std::mutex> itemsLock(m_ItemsLogMutex);
 	for (auto const& item : m_ItemsLog)
 	{
 		using namespace donut::log;
@@ -192,6 +197,7 @@ void ImGui_Console::Render(bool* open)
 			ImGui::PopStyleColor();
 		}
 	}
+	itemsLock.unlock();
 
 	if (m_Options.scroll_to_bottom || (m_Options.auto_scroll && ImGui::GetScrollY() >= ImGui::GetScrollMaxY()))
 	{
@@ -0,0 +1,142 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/app/imgui_profiler.h>
+#include <donut/engine/GpuProfiler.h>
+
+#include <imgui.h>
+
+#include <algorithm>
+
+using namespace donut::app;
+using namespace donut::profiler;
+
+ImGui_Profiler::ImGui_Profiler(Options const& options)
+    : m_Options(options)
+{
+}
+
+void ImGui_Profiler::RenderScopes(Track track)
+{
+    std::vector<ScopeStats> stats = Profiler::Get().GetScopeStats();
+
+    ImGui::Columns(4, track == Track::Gpu ? "GpuScopes" : "CpuScopes");
+    ImGui::Text("Scope"); ImGui::NextColumn();
+    ImGui::Text("Last, ms"); ImGui::NextColumn();
+    ImGui::Text("Avg, ms"); ImGui::NextColumn();
+    ImGui::Text("Max, ms"); ImGui::NextColumn();
+    ImGui::Separator();
+
+    for (const ScopeStats& scope : stats)
+    {
+        if (scope.track != track)
+            continue;
+
+        ImGui::SetCursorPosX(ImGui::GetCursorPosX() + float(scope.depth) * 10.f);
+        if (scope.callCount > 1)
+            ImGui::Text("%s (x%u)", scope.name.c_str(), scope.callCount);
+        else
+            ImGui::TextUnformatted(scope.name.c_str());
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", scope.lastMs); ImGui::NextColumn();
+        ImGui::Text("%.3f", scope.averageMs); ImGui::NextColumn();
+        ImGui::Text("%.3f", scope.maxMs); ImGui::NextColumn();
+
+        if (m_Options.showGraphs && scope.depth == 0 && !scope.history.empty())
+        {
+            float values[c_HistoryLength];
+            const size_t count = scope.history.size();
+            for (size_t i = 0; i < count; i++)
+                values[i] = scope.history[i];
+
+            ImGui::Columns(1);
+            std::string label = "##" + scope.name;
+            ImGui::PlotLines(label.c_str(), values, int(count), 0, nullptr, 0.f, float(scope.maxMs) * 1.1f, ImVec2(0.f, 30.f));
+            ImGui::Columns(4, track == Track::Gpu ? "GpuScopes" : "CpuScopes");
+        }
+    }
+
+    ImGui::Columns(1);
+}
+
+void ImGui_Profiler::Render(bool* open)
+{
+    ImGui::SetNextWindowSize(ImVec2(500, 600), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Profiler", open))
+    {
+        ImGui::End();
+        return;
+    }
+
+    Profiler& profiler = Profiler::Get();
+
+#ifndef DONUT_WITH_PROFILER
+    ImGui::TextColored(ImVec4(1.f, .5f, 0.f, 1.f), "CPU markers are disabled (DONUT_WITH_PROFILER)");
+#endif
+
+    ImGui::Checkbox("CPU", &m_Options.showCpu);
+    ImGui::SameLine();
+    ImGui::Checkbox("GPU", &m_Options.showGpu);
+    ImGui::SameLine();
+    ImGui::Checkbox("Graphs", &m_Options.showGraphs);
+    ImGui::SameLine();
+    if (ImGui::Button("Reset"))
+        profiler.ResetScopeStats();
+
+    if (profiler.IsCapturing())
+    {
+        ImGui::Text("Capturing... %d / %u frames", int(profiler.GetCapturedFrameCount()), m_Options.captureFrameCount);
+    }
+    else if (m_ExportDelayFrames > 0)
+    {
+        // give the GPU timings of the last captured frames time to resolve before writing the trace
+        if (--m_ExportDelayFrames == 0)
+        {
+            if (profiler.ExportChromeTrace(m_Options.traceFileName))
+                m_LastExportMessage = "Saved " + m_Options.traceFileName.generic_string();
+            else
+                m_LastExportMessage = "Failed to save " + m_Options.traceFileName.generic_string();
+            profiler.ClearCapture();
+        }
+        else
+            ImGui::Text("Waiting for GPU timings...");
+    }
+    else if (ImGui::Button("Capture Trace"))
+    {
+        profiler.BeginCapture(m_Options.captureFrameCount);
+        m_ExportDelayFrames = engine::GpuProfiler::c_FrameSlots + 1;
+    }
+
+    if (!m_LastExportMessage.empty())
+        ImGui::TextUnformatted(m_LastExportMessage.c_str());
+
+    if (uint64_t dropped = profiler.GetDroppedEventCount())
+        ImGui::TextColored(ImVec4(1.f, .5f, 0.f, 1.f), "Dropped events: %llu", (unsigned long long)dropped);
+
+    if (m_Options.showCpu && ImGui::CollapsingHeader("CPU", ImGuiTreeNodeFlags_DefaultOpen))
+        RenderScopes(Track::Cpu);
+
+    if (m_Options.showGpu && ImGui::CollapsingHeader("GPU", ImGuiTreeNodeFlags_DefaultOpen))
+        RenderScopes(Track::Gpu);
+
+    ImGui::End();
+}
@@ -22,13 +22,88 @@
 
 #include <donut/core/chunk/chunkFile.h>
 #include <donut/core/vfs/VFS.h>
+#include <donut/core/parallel.h>
 
+#include <array>
+#include <atomic>
 #include <cassert>
 #include <cstring>
 
+#ifdef DONUT_WITH_LZ4
+#include <lz4.h>
+#endif
+
 namespace donut::chunk
 {
 
+static constexpr uint32_t const c_MaxChunkCount = 1000000;
+
+static constexpr size_t const c_ChunkAlignment = 16;
+
+// chunks smaller than this are never compressed
+static constexpr size_t const c_MinCompressedChunkSize = 256;
+
+// below this amount of stored data, chunks are validated & unpacked serially
+static constexpr size_t const c_ParallelUnpackThreshold = 1 << 20;
+static constexpr unsigned const c_MaxUnpackThreads = 16;
+
+static constexpr size_t alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// true if [offset, offset+size) lies within [0, total) ; immune to overflows
+static bool inRange(uint64_t offset, uint64_t size, uint64_t total)
+{
+    return offset <= total && size <= total - offset;
+}
+
+//
+// CRC-32 (IEEE 802.3 polynomial, same results as zlib's crc32)
+//
+// The format does not depend on optional libraries for its checksums, so
+// that files written with and without LZ4 / miniz support are identical.
+//
+
+static std::array<std::array<uint32_t, 256>, 4> const & crc32Tables()
+{
+    static std::array<std::array<uint32_t, 256>, 4> const tables = []()
+    {
+        std::array<std::array<uint32_t, 256>, 4> t;
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; ++i)
+            for (size_t k = 1; k < t.size(); ++k)
+                t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+        return t;
+    }();
+    return tables;
+}
+
+static uint32_t crc32(void const * data, size_t size)
+{
+    auto const & t = crc32Tables();
+
+    uint8_t const * p = reinterpret_cast<uint8_t const *>(data);
+    uint32_t c = ~0u;
+
+    // slicing-by-4
+    for (; size >= 4; size -= 4, p += 4)
+    {
+        c ^= uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+        c = t[3][c & 0xFF] ^ t[2][(c >> 8) & 0xFF] ^ t[1][(c >> 16) & 0xFF] ^ t[0][c >> 24];
+    }
+    for (; size > 0; --size, ++p)
+        c = t[0][(c ^ *p) & 0xFF] ^ (c >> 8);
+
+    return ~c;
+}
+
 //
 // Header
 //
@@ -43,7 +118,7 @@ struct ChunkFile::Header
 
     static char const * validSignature() { return "NVDACHNK"; }
 
-    static uint32_t currentVersion() { return 0x100; }
+    static uint32_t currentVersion() { return 0x200; }
 
     bool isValid() const
     {
@@ -52,11 +127,19 @@ struct ChunkFile::Header
     }
 };
 
+// follows the header in version 0x200 files
+struct ChunkFile::HeaderExt_0x200
+{
+    uint32_t tableChecksum, // CRC-32 of the chunk table
+             flags;         // reserved, 0
+};
+
 //
 // Chunks Table
 //
 
-struct ChunkFile::ChunkTableEntry
+// legacy layout : native size_t offsets, data packed without alignment
+struct ChunkFile::ChunkTableEntry_0x100
 {
     ChunkId  chunkId;
     uint32_t chunkType,
@@ -65,6 +148,26 @@ struct ChunkFile::ChunkTableEntry
            size;
 };
 
+struct ChunkFile::ChunkTableEntry_0x200
+{
+    enum Flags : uint32_t
+    {
+        LZ4_COMPRESSED = 1 << 0,
+
+        ALL_FLAGS = LZ4_COMPRESSED,
+    };
+
+    uint32_t chunkId,
+             chunkType,
+             chunkVersion,
+             flags;
+    uint64_t offset,        // 16-bytes aligned
+             storedSize,    // size of the data in the file
+             size;          // size of the (decompressed) chunk data
+    uint32_t checksum,      // CRC-32 of the stored data
+             reserved;
+};
+
 //
 // Implementation
 //
@@ -110,10 +213,208 @@ void ChunkFile::reset()
     _filepath.clear();
     _chunks.clear();
     _data.reset();
+    _arena.clear();
 }
 
 typedef typename vfs::IBlob IBlob;
 
+//
+// Deserialization
+//
+
+bool ChunkFile::load_0x100(Header const & header, uint8_t const * data, size_t size)
+{
+    char const * filepath = _filepath.c_str();
+
+    uint32_t nchunks = header.chunkCount;
+
+    if (!inRange(header.chunkTableOffset, uint64_t(nchunks) * sizeof(ChunkTableEntry_0x100), size))
+    {
+        log::error("ChunkFile '%s' : invalid chunks table", filepath);
+        return false;
+    }
+
+    std::vector<ChunkTableEntry_0x100> table(nchunks);
+    memcpy(table.data(), data + header.chunkTableOffset, nchunks * sizeof(ChunkTableEntry_0x100));
+
+    // legacy files pack chunks back to back : misaligned chunks are copied
+    size_t arenaSize = 0;
+    for (auto const & e : table)
+    {
+        if (!e.chunkId.valid() || !inRange(e.offset, e.size, size))
+        {
+            log::error("ChunkFile '%s' : chunk %d invalid size/offset", filepath, e.chunkId._chunkId);
+            return false;
+        }
+        if ((reinterpret_cast<uintptr_t>(data + e.offset) % c_ChunkAlignment) != 0)
+            arenaSize += alignUp(e.size, c_ChunkAlignment);
+    }
+
+    _arena.resize(arenaSize / sizeof(ArenaBlock));
+
+    uint8_t * arena = reinterpret_cast<uint8_t *>(_arena.data());
+
+    _chunks.reserve(nchunks);
+    for (auto const & e : table)
+    {
+        void const * chunkData = data + e.offset;
+        if ((reinterpret_cast<uintptr_t>(chunkData) % c_ChunkAlignment) != 0)
+        {
+            memcpy(arena, chunkData, e.size);
+            chunkData = arena;
+            arena += alignUp(e.size, c_ChunkAlignment);
+        }
+        _chunks.push_back(std::make_unique<Chunk>(
+            Chunk({e.chunkId, e.chunkType, e.chunkVersion, e.offset, e.size, chunkData})));
+    }
+    return true;
+}
+
+bool ChunkFile::load_0x200(Header const & header, uint8_t const * data, size_t size)
+{
+    char const * filepath = _filepath.c_str();
+
+    uint32_t nchunks = header.chunkCount;
+
+    HeaderExt_0x200 ext;
+    if (!inRange(sizeof(Header), sizeof(HeaderExt_0x200), size))
+    {
+        log::error("ChunkFile '%s' : invalid header", filepath);
+        return false;
+    }
+    memcpy(&ext, data + sizeof(Header), sizeof(HeaderExt_0x200));
+
+    size_t const tableSize = size_t(nchunks) * sizeof(ChunkTableEntry_0x200);
+
+    if (header.chunkTableOffset < sizeof(Header) + sizeof(HeaderExt_0x200)
+        || !inRange(header.chunkTableOffset, tableSize, size))
+    {
+        log::error("ChunkFile '%s' : invalid chunks table", filepath);
+        return false;
+    }
+
+    if (crc32(data + header.chunkTableOffset, tableSize) != ext.tableChecksum)
+    {
+        log::error("ChunkFile '%s' : chunks table checksum mismatch", filepath);
+        return false;
+    }
+
+    std::vector<ChunkTableEntry_0x200> table(nchunks);
+    memcpy(table.data(), data + header.chunkTableOffset, tableSize);
+
+    // validate the table before touching any chunk data
+
+    size_t arenaSize = 0,
+           storedSize = 0;
+    for (auto const & e : table)
+    {
+        bool compressed = (e.flags & ChunkTableEntry_0x200::LZ4_COMPRESSED) != 0;
+
+        bool valid = e.chunkId != ChunkId::INVALID_CHUNK_ID
+            && (e.flags & ~ChunkTableEntry_0x200::ALL_FLAGS) == 0
+            && inRange(e.offset, e.storedSize, size)
+            && (e.offset % c_ChunkAlignment) == 0
+            && e.size <= SIZE_MAX;
+
+        if (valid && !compressed)
+            valid = e.storedSize == e.size;
+
+        // LZ4 cannot expand data by more than ~255:1 ; this also bounds the
+        // arena allocation by the size of the file
+        if (valid && compressed)
+            valid = e.storedSize > 0 && e.storedSize <= INT32_MAX && e.size <= INT32_MAX
+                && e.size <= e.storedSize * 256;
+
+        if (!valid)
+        {
+            log::error("ChunkFile '%s' : chunk %d invalid size/offset", filepath, e.chunkId);
+            return false;
+        }
+
+        if (compressed)
+        {
+#ifdef DONUT_WITH_LZ4
+            arenaSize += alignUp(size_t(e.size), c_ChunkAlignment);
+#else
+            log::error("ChunkFile '%s' : chunk %d is LZ4 compressed, but donut was built without LZ4 support",
+                filepath, e.chunkId);
+            return false;
+#endif
+        }
+        storedSize += e.storedSize;
+    }
+
+    // assign arena ranges to compressed chunks
+
+    _arena.resize(arenaSize / sizeof(ArenaBlock));
+
+    std::vector<uint8_t *> destinations(nchunks, nullptr);
+    {
+        uint8_t * arena = reinterpret_cast<uint8_t *>(_arena.data());
+        for (uint32_t i = 0; i < nchunks; ++i)
+        {
+            if (table[i].flags & ChunkTableEntry_0x200::LZ4_COMPRESSED)
+            {
+                destinations[i] = arena;
+                arena += alignUp(size_t(table[i].size), c_ChunkAlignment);
+            }
+        }
+    }
+
+    // verify checksums & decompress ; chunks are independent so this runs
+    // in parallel for large files
+
+    std::atomic<bool> success = true;
+
+    auto unpack = [&](size_t index)
+    {
+        if (!success)
+            return;
+
+        ChunkTableEntry_0x200 const & e = table[index];
+
+        uint8_t const * stored = data + e.offset;
+
+        if (crc32(stored, e.storedSize) != e.checksum)
+        {
+            log::error("ChunkFile '%s' : chunk %d checksum mismatch", filepath, e.chunkId);
+            success = false;
+            return;
+        }
+
+        if (destinations[index])
+        {
+#ifdef DONUT_WITH_LZ4
+            int result = LZ4_decompress_safe(reinterpret_cast<char const *>(stored),
+                reinterpret_cast<char *>(destinations[index]), int(e.storedSize), int(e.size));
+
+            if (result < 0 || uint64_t(result) != e.size)
+            {
+                log::error("ChunkFile '%s' : chunk %d LZ4 decompression failed", filepath, e.chunkId);
+                success = false;
+                return;
+            }
+#endif
+        }
+    };
+
+    core::ParallelFor(storedSize < c_ParallelUnpackThreshold ? 1u : c_MaxUnpackThreads, nchunks, unpack);
+    if (!success)
+        return false;
+
+    _chunks.reserve(nchunks);
+    for (uint32_t i = 0; i < nchunks; ++i)
+    {
+        ChunkTableEntry_0x200 const & e = table[i];
+
+        void const * chunkData = destinations[i] ? destinations[i] : data + e.offset;
+
+        _chunks.push_back(std::make_unique<Chunk>(
+            Chunk({e.chunkId, e.chunkType, e.chunkVersion, size_t(e.offset), size_t(e.size), chunkData})));
+    }
+    return true;
+}
+
 std::shared_ptr<ChunkFile const> ChunkFile::deserialize(
     std::weak_ptr<IBlob const> blobPtr, char const * filepath)
 {
@@ -128,50 +429,39 @@ std::shared_ptr<ChunkFile const> ChunkFile::deserialize(
 
         uint8_t const * data = reinterpret_cast<uint8_t const *>(blob->data());
 
-        Header const & header = *(Header const *)(data);
+        Header header;
+        memcpy(&header, data, sizeof(Header));
 
         if (!header.isValid())
         {
             log::error("ChunkFile '%s' : invalid chunkfile signature", filepath);
+            return nullptr;
         }
 
         uint32_t nchunks = header.chunkCount;
-        if (nchunks == 0 || nchunks > 1000000)
+        if (nchunks == 0 || nchunks > c_MaxChunkCount)
         {
             log::error("ChunkFile '%s' : invalid number of chunks in file", filepath);
             return nullptr;
         }
 
-        if (blob->size() < header.chunkTableOffset + nchunks * sizeof(ChunkTableEntry))
-        {
-            log::error("ChunkFile '%s' : invalid chunks table", filepath);
-            return nullptr;
-        }
-
-        ChunkTableEntry const * chunktable =
-            (ChunkTableEntry const *)(data + header.chunkTableOffset);
-
         auto result = std::make_shared<ChunkFile>();
 
-        result->_chunks.reserve(nchunks);
+        result->_filepath = filepath;
 
-        for (uint32_t index = 0; index < nchunks; index++)
+        bool loaded = false;
+        switch (header.version)
         {
-
-            ChunkTableEntry const & e = chunktable[index];
-
-            if (blob->size() < e.offset + e.size) {
-                log::error("ChunkFile '%s' : chunk %d invalid size/offset", filepath, e.chunkId);
-                return nullptr;
-            }
-
-            std::unique_ptr<Chunk> chunk = std::make_unique<Chunk>(
-                Chunk({e.chunkId, e.chunkType, e.chunkVersion, e.offset, e.size, data+e.offset}));
-
-            result->_chunks.push_back(std::move(chunk));
+            case 0x100: loaded = result->load_0x100(header, data, blob->size()); break;
+            case 0x200: loaded = result->load_0x200(header, data, blob->size()); break;
+            default:
+                log::error("ChunkFile '%s' : unsupported version 0x%x", filepath, header.version);
+                break;
         }
 
-        result->_filepath = filepath;
+        if (!loaded)
+            return nullptr;
+
         result->_data = blob;
         return result;
     }
@@ -182,61 +472,109 @@ std::shared_ptr<ChunkFile const> ChunkFile::deserialize(
     return nullptr;
 }
 
-std::shared_ptr<IBlob const> ChunkFile::serialize() const {
+//
+// Serialization
+//
 
-    uint32_t nchunks = (uint32_t)_chunks.size();
+std::shared_ptr<IBlob const> ChunkFile::serialize(bool compress) const {
 
-    size_t chunkTableSize = nchunks*sizeof(ChunkTableEntry);
+    uint32_t nchunks = (uint32_t)_chunks.size();
 
-    size_t blobSize = 0;
-    blobSize += sizeof(Header);
-    blobSize += chunkTableSize;
-    for (auto const & chunk : _chunks)
-        blobSize += chunk->size;
+    // compress chunks
 
-    if (uint8_t * data = (uint8_t *)malloc(blobSize))
+    struct StoredChunk
     {
-        size_t offset = 0;
+        uint8_t const * data = nullptr;
+        size_t size = 0;
+        uint32_t flags = 0;
+        std::unique_ptr<char[]> buffer;
+    };
 
-        // write header
-        {
-            Header & header = *(Header *)(data+offset);
-            header = {{}, Header::currentVersion(), nchunks, sizeof(Header)};
-            memcpy(header.signature, Header::validSignature(), 8);
+    std::vector<StoredChunk> stored(nchunks);
 
-            offset += sizeof(Header);
-        }
+    for (uint32_t i = 0; i < nchunks; ++i)
+    {
+        Chunk const & chunk = *_chunks[i];
 
-        // write chunks table
+        StoredChunk & s = stored[i];
+        s.data = reinterpret_cast<uint8_t const *>(chunk.data);
+        s.size = chunk.size;
 
+#ifdef DONUT_WITH_LZ4
+        if (compress && chunk.size >= c_MinCompressedChunkSize && chunk.size <= LZ4_MAX_INPUT_SIZE)
         {
-            ChunkTableEntry * chunkTable = (ChunkTableEntry *)(data+offset);
+            int bound = LZ4_compressBound(int(chunk.size));
+            s.buffer = std::make_unique<char[]>(bound);
+
+            int csize = LZ4_compress_default(reinterpret_cast<char const *>(chunk.data),
+                s.buffer.get(), int(chunk.size), bound);
 
-            for (size_t i=0, chunkOffset=offset+chunkTableSize; i<nchunks; ++i)
+            // only keep the compressed data if it saves at least 1/8th
+            if (csize > 0 && size_t(csize) < chunk.size - chunk.size / 8)
             {
-                Chunk * chunk = const_cast<Chunk *>(_chunks[i].get());
-
-                chunkTable[i] = {
-                    chunk->chunkId,
-                    chunk->chunkType,
-                    chunk->chunkVersion,
-                    chunk->offset = chunkOffset, // set chunk offset
-                    chunk->size
-                };
-                chunkOffset += chunk->size;
+                s.data = reinterpret_cast<uint8_t const *>(s.buffer.get());
+                s.size = size_t(csize);
+                s.flags = ChunkTableEntry_0x200::LZ4_COMPRESSED;
             }
-
-            offset += chunkTableSize;
+            else
+                s.buffer.reset();
         }
+#else
+        (void)compress;
+#endif
+    }
 
-        // write chunks
-        for (auto const & chunk : _chunks) 
+    // layout
+
+    size_t const chunkTableOffset = alignUp(sizeof(Header) + sizeof(HeaderExt_0x200), c_ChunkAlignment);
+    size_t const chunkTableSize = nchunks * sizeof(ChunkTableEntry_0x200);
+
+    size_t blobSize = alignUp(chunkTableOffset + chunkTableSize, c_ChunkAlignment);
+
+    std::vector<ChunkTableEntry_0x200> table(nchunks);
+    for (uint32_t i = 0; i < nchunks; ++i)
+    {
+        Chunk * chunk = const_cast<Chunk *>(_chunks[i].get());
+
+        chunk->offset = blobSize; // set chunk offset
+
+        table[i] = {
+            chunk->chunkId._chunkId,
+            chunk->chunkType,
+            chunk->chunkVersion,
+            stored[i].flags,
+            blobSize,
+            stored[i].size,
+            chunk->size,
+            crc32(stored[i].data, stored[i].size),
+            0
+        };
+        blobSize = alignUp(blobSize + stored[i].size, c_ChunkAlignment);
+    }
+
+    if (uint8_t * data = (uint8_t *)malloc(blobSize))
+    {
+        // zero the padding so that output is deterministic
+        memset(data, 0, blobSize);
+
+        // write header
         {
-//            assert(offset == chunk->offset);
-            memcpy(data+chunk->offset, chunk->data, chunk->size);
-//            offset += chunk->size;
+            Header header = {{}, Header::currentVersion(), nchunks, uint32_t(chunkTableOffset)};
+            memcpy(header.signature, Header::validSignature(), 8);
+            memcpy(data, &header, sizeof(Header));
+
+            HeaderExt_0x200 ext = { crc32(table.data(), chunkTableSize), 0 };
+            memcpy(data + sizeof(Header), &ext, sizeof(HeaderExt_0x200));
         }
 
+        // write chunks table
+        memcpy(data + chunkTableOffset, table.data(), chunkTableSize);
+
+        // write chunks
+        for (uint32_t i = 0; i < nchunks; ++i)
+            if (stored[i].size)
+                memcpy(data + table[i].offset, stored[i].data, stored[i].size);
+
         return std::make_shared<donut::vfs::Blob const>(data, blobSize);
     }
     else
@@ -248,4 +586,3 @@ std::shared_ptr<IBlob const> ChunkFile::serialize() const {
 }
 
 };
-
@@ -27,13 +27,40 @@
 #include "./chunkDescs.h"
 
 #include <cassert>
+#include <cstring>
 #include <memory>
 #include <vector>
 
 namespace donut::chunk
 {
 
+// keeps alive everything a deserialized MeshSet points to
+struct MeshSetStorage
+{
+    std::shared_ptr<ChunkFile const> cfile;
+
+    // name-patched copies of the infos, instances & nodes chunks
+    std::vector<std::shared_ptr<void const>> arrays;
+};
+
+// true if 'count' elements of 'elemSize' bytes starting at 'offset' fit in the chunk
+static bool arrayFits(Chunk const * chunk, size_t offset, size_t count, size_t elemSize)
+{
+    if (offset > chunk->size)
+        return false;
+    return elemSize == 0 || count <= (chunk->size - offset) / elemSize;
+}
+
+// true if [first, first+count) lies within [0, total)
+static bool rangeFits(uint32_t first, uint32_t count, uint32_t total)
+{
+    return first <= total && count <= total - first;
+}
+
 // helper class to deserialize chunks blob
+//
+// note : chunk data is never written to ; descriptors are copied out of the
+// chunks and every count, offset & index is validated before use.
 struct ChunkReader
 {
     bool loadStringsTableChunk_0x100(Chunk const * chunk);
@@ -48,19 +75,55 @@ struct ChunkReader
 
     std::shared_ptr<MeshSetBase> loadMeshSetChunk_0x100(Chunk const * chunk);
 
+    bool validateMeshSet(MeshSetBase const & mset) const;
+
+    template <typename Desc> bool readDesc(Chunk const * chunk, Desc & desc) const;
+
+    template <typename T> T * copyArray(Chunk const * chunk, size_t offset, size_t count);
+
     std::shared_ptr<ChunkFile const> cfile;
 
+    std::shared_ptr<MeshSetStorage> storage;
+
     inline char const * uncacheString(size_t index)
     {
-        if (index!=~size_t(0) && index<stringsmap.size())
-            return stringsmap[index];
-
+        if (index!=~size_t(0))
+        {
+            if (index<stringsmap.size())
+                return stringsmap[index];
+            ++badStrings;
+        }
         return nullptr;
     }
 
     std::vector<char const *> stringsmap;
+
+    size_t badStrings = 0;
 };
 
+template <typename Desc> bool ChunkReader::readDesc(Chunk const * chunk, Desc & desc) const
+{
+    if (chunk->size < sizeof(Desc))
+    {
+        log::error("chunk (%d) : truncated descriptor in asset '%s'",
+            chunk->chunkId, cfile->getFilePath().c_str());
+        return false;
+    }
+    memcpy(&desc, chunk->data, sizeof(Desc));
+    return true;
+}
+
+template <typename T> T * ChunkReader::copyArray(Chunk const * chunk, size_t offset, size_t count)
+{
+    assert(arrayFits(chunk, offset, count, sizeof(T)));
+
+    T * array = new T[count];
+    storage->arrays.push_back(std::shared_ptr<T const>(array, std::default_delete<T[]>()));
+
+    memcpy(array, (uint8_t const *)chunk->data + offset, count * sizeof(T));
+    return array;
+}
+
 bool ChunkReader::loadStringsTableChunk_0x100(Chunk const * chunk)
 {
     typedef StringsTable_ChunkDesc_0x100 Desc;
@@ -68,22 +131,43 @@ bool ChunkReader::loadStringsTableChunk_0x100(Chunk const * chunk)
     if (!cfile->validateChunk<Desc>(chunk))
         return false;
 
-    uint8_t const * data = (uint8_t const *)chunk->data;
-
-    auto const & desc = *(Desc const *)data;
+    Desc desc;
+    if (!readDesc(chunk, desc))
+        return false;
 
     size_t nstrings = desc.nstrings,
            descSize = sizeof(Desc),
            tableSize = nstrings * sizeof(Desc::TableEntry);
 
-    stringsmap.resize(nstrings);
+    if (!arrayFits(chunk, descSize, nstrings, sizeof(Desc::TableEntry)))
+    {
+        log::error("strings table chunk : invalid size in asset '%s'", cfile->getFilePath().c_str());
+        return false;
+    }
+
+    uint8_t const * data = (uint8_t const *)chunk->data;
 
-    char const * stringsData = (char *)(data + descSize + tableSize);
+    char const * stringsData = (char const *)(data + descSize + tableSize);
 
-    Desc::TableEntry const * table = (Desc::TableEntry *)(data + descSize);
+    size_t stringsSize = chunk->size - descSize - tableSize;
+
+    stringsmap.resize(nstrings);
 
     for (size_t i=0; i<nstrings; ++i)
-        stringsmap[i] = stringsData + table[i].offset;
+    {
+        Desc::TableEntry e;
+        memcpy(&e, data + descSize + i * sizeof(Desc::TableEntry), sizeof(e));
+
+        // strings must be in bounds and nul-terminated
+        if (e.length==0 || e.offset>stringsSize || e.length>stringsSize-e.offset
+            || stringsData[e.offset+e.length-1]!='\0')
+        {
+            log::error("strings table chunk : invalid string (%d) in asset '%s'",
+                (int)i, cfile->getFilePath().c_str());
+            return false;
+        }
+        stringsmap[i] = stringsData + e.offset;
+    }
 
     return true;
 }
@@ -100,28 +184,35 @@ bool ChunkReader::loadMeshInfosChunk_0x100(
 
     if (Chunk const * chunk = cfile->getChunk<Desc>(chunkId))
     {
-        uint8_t const * chunkData = (uint8_t const *)chunk->data;
-
-        Desc const & desc = *(Desc const *)chunkData;
+        Desc desc;
+        if (!readDesc(chunk, desc))
+            return false;
 
+        size_t elemSize = 0;
         switch (desc.getType())
         {
             case Desc::MESH :
                 if (mset->type!=MeshSetBase::MESH)
                     return false;
+                elemSize = sizeof(MeshInfo);
                 break;
             case Desc::MESHLET :
                 if (mset->type!=MeshSetBase::MESHLET)
                     return false;
+                elemSize = sizeof(MeshletInfo);
                 break;
             default:
                 log::error("incorrect meshinfo type in asset '%s'", cfile->getFilePath().c_str());
                 return false;
         }
 
-        mset->nmeshInfos = desc.nelems;
+        if (!arrayFits(chunk, sizeof(Desc), desc.nelems, elemSize))
+        {
+            log::error("bad MeshInfo chunk size in asset '%s'", cfile->getFilePath().c_str());
+            return false;
+        }
 
-        uint8_t const * minfosData = (uint8_t *)chunkData+sizeof(Desc);
+        mset->nmeshInfos = desc.nelems;
 
         auto setStrings = [&] (auto * minfos) {
             for (uint32_t i=0; i<mset->nmeshInfos; ++i) {
@@ -133,13 +224,13 @@ bool ChunkReader::loadMeshInfosChunk_0x100(
         switch (desc.getType())
         {
             case Desc::MESH : {
-                MeshInfo * minfos = (MeshInfo *)minfosData;
+                MeshInfo * minfos = copyArray<MeshInfo>(chunk, sizeof(Desc), desc.nelems);
                 setStrings(minfos);
                 std::static_pointer_cast<MeshSet>(mset)->meshInfos = minfos;
             } break;
 
             case Desc::MESHLET : {
-                MeshletInfo * minfos = (MeshletInfo *)minfosData;
+                MeshletInfo * minfos = copyArray<MeshletInfo>(chunk, sizeof(Desc), desc.nelems);
                 setStrings(minfos);
                 std::static_pointer_cast<MeshletSet>(mset)->meshInfos = minfos;
             } break;
@@ -167,13 +258,19 @@ bool ChunkReader::loadMeshInstancesChunk_0x100(
 
     if (Chunk const * chunk = cfile->getChunk<Desc>(chunkId))
     {
-        uint8_t const * chunkData = (uint8_t const *)chunk->data;
-
-        Desc const & desc = *(Desc const *)chunkData;
+        Desc desc;
+        if (!readDesc(chunk, desc))
+            return false;
 
         uint32_t ninstances = desc.ninstances;
 
-        MeshInstance * instancesData = (MeshInstance *)(chunkData+sizeof(Desc));
+        if (!arrayFits(chunk, sizeof(Desc), ninstances, sizeof(MeshInstance)))
+        {
+            log::error("bad MeshInstance chunk size in asset '%s'", cfile->getFilePath().c_str());
+            return false;
+        }
+
+        MeshInstance * instancesData = copyArray<MeshInstance>(chunk, sizeof(Desc), ninstances);
         for (uint32_t i=0; i<ninstances; ++i) {
             instancesData[i].name = uncacheString((size_t)instancesData[i].name);
         }
@@ -197,11 +294,17 @@ bool ChunkReader::loadMeshNodesChunk_0x100(
 
     if (Chunk const * chunk = cfile->getChunk<Desc>(chunkId))
     {
-        uint8_t const * chunkData = (uint8_t const *)chunk->data;
+        Desc desc;
+        if (!readDesc(chunk, desc))
+            return false;
 
-        Desc const & desc = *(Desc const *)chunkData;
+        if (!arrayFits(chunk, sizeof(Desc), desc.nnodes, sizeof(MeshNode)))
+        {
+            log::error("bad MeshNode chunk size in asset '%s'", cfile->getFilePath().c_str());
+            return false;
+        }
 
-        MeshNode * nodesData = (MeshNode *)(chunkData+sizeof(Desc));
+        MeshNode * nodesData = copyArray<MeshNode>(chunk, sizeof(Desc), desc.nnodes);
         for (uint32_t i=0; i<desc.nnodes; ++i) {
             nodesData[i].name = uncacheString((size_t)(nodesData[i].name));
         }
@@ -226,9 +329,11 @@ bool ChunkReader::loadStreamChunk_0x100(ChunkId chunkId, StreamHandle * handle)
 
     if (Chunk const * chunk = cfile->getChunk<Desc>(chunkId))
     {
-        uint8_t const * chunkData = (uint8_t const *)chunk->data;
+        Desc desc;
+        if (!readDesc(chunk, desc))
+            return false;
 
-        Desc const & desc = *(Desc const *)chunkData;
+        size_t expectedCount = handle->elemCount;
 
         handle->elemCount = 0;
         handle->data = nullptr;
@@ -258,16 +363,23 @@ bool ChunkReader::loadStreamChunk_0x100(ChunkId chunkId, StreamHandle * handle)
                 chunkId, cfile->getFilePath().c_str());
             return false;
         }
-        if (handle->elemCount!=0 && desc.elemCount!=handle->elemCount)
+        if (expectedCount!=0 && desc.elemCount!=expectedCount)
         {
             log::error("datastream chunk (%d) : bad elemCount in asset '%s'",
                 chunkId, cfile->getFilePath().c_str());
             return false;
         }
+        if (desc.elemSize==0 || desc.elemCount>UINT32_MAX
+            || !arrayFits(chunk, sizeof(Desc), desc.elemCount, desc.elemSize))
+        {
+            log::error("datastream chunk (%d) : bad data size in asset '%s'",
+                chunkId, cfile->getFilePath().c_str());
+            return false;
+        }
 
         handle->elemCount = desc.elemCount;
         handle->elemSize = desc.elemSize;
-        handle->data = chunkData+sizeof(Desc);
+        handle->data = (uint8_t const *)chunk->data+sizeof(Desc);
         return true;
     }
     else
@@ -286,7 +398,9 @@ std::shared_ptr<MeshSetBase> ChunkReader::loadMeshSetChunk_0x100(Chunk const * c
 
     std::shared_ptr<MeshSetBase> mset;
 
-    Desc const & desc = *(Desc const *)chunk->data;
+    Desc desc;
+    if (!readDesc(chunk, desc))
+        return nullptr;
 
     Desc::Type stype = desc.getType();
 
@@ -361,6 +475,9 @@ std::shared_ptr<MeshSetBase> ChunkReader::loadMeshSetChunk_0x100(Chunk const * c
 
         set->meshInfos=nullptr;
 
+        set->maxVerts = desc.meshletMaxVerts;
+        set->maxPrims = desc.meshletMaxPrims;
+
         handle = {"Indices32", UINT32, VARY_NONE, INDEX, 0, sizeof(uint32_t), nullptr};
         if (loadStreamChunk_0x100(desc.streamChunkIds[Desc::MESHLET_INDICES32], &handle))
         {
@@ -380,6 +497,12 @@ std::shared_ptr<MeshSetBase> ChunkReader::loadMeshSetChunk_0x100(Chunk const * c
         handle = {"Meshlet Headers", UINT32, VARY_NONE, MESHLET_INFO, 0, 0, nullptr};
         if (loadStreamChunk_0x100(desc.streamChunkIds[Desc::MESHLET_INFO], &handle))
         {
+            if ((handle.elemSize % sizeof(uint32_t))!=0 || handle.elemSize>255*sizeof(uint32_t))
+            {
+                log::error("bad meshlet header size (%d) in asset '%s'",
+                    (int)handle.elemSize, cfile->getFilePath().c_str());
+                return nullptr;
+            }
             set->meshlets = (uint32_t *)handle.data;
             set->nmeshlets = (uint32_t)handle.elemCount;
             set->meshletSize = (uint8_t)(handle.elemSize / sizeof(uint32_t));
@@ -397,9 +520,104 @@ std::shared_ptr<MeshSetBase> ChunkReader::loadMeshSetChunk_0x100(Chunk const * c
         if (!loadMeshNodesChunk_0x100(desc.nodesChunkId, mset))
             return nullptr;
 
+    if (!validateMeshSet(*mset))
+        return nullptr;
+
     return mset;
 }
 
+// cross-chunk checks : every range & index must reference existing data
+bool ChunkReader::validateMeshSet(MeshSetBase const & mset) const
+{
+    char const * assetpath = cfile->getFilePath().c_str();
+
+    uint32_t const invalidId = ~uint32_t(0);
+
+    auto validId = [](uint32_t id, uint32_t count) { return id < count || id == ~uint32_t(0); };
+
+    if (badStrings > 0)
+    {
+        log::error("invalid string references in asset '%s'", assetpath);
+        return false;
+    }
+
+    auto checkIndices = [&](uint32_t const * indices, uint32_t nindices)
+    {
+        for (uint32_t i=0; i<nindices; ++i)
+            if (indices[i]>=mset.nverts)
+                return false;
+        return true;
+    };
+
+    if (mset.type==MeshSetBase::MESH)
+    {
+        MeshSet const & set = static_cast<MeshSet const &>(mset);
+
+        if (!checkIndices(set.indices, set.nindices))
+        {
+            log::error("vertex index out of range in asset '%s'", assetpath);
+            return false;
+        }
+        for (uint32_t i=0; i<set.nmeshInfos; ++i)
+        {
+            MeshInfo const & minfo = set.meshInfos[i];
+            if (!rangeFits(minfo.firstVertex, minfo.numVertices, set.nverts)
+                || !rangeFits(minfo.firstIndex, minfo.numIndices, set.nindices))
+            {
+                log::error("MeshInfo (%d) out of range in asset '%s'", i, assetpath);
+                return false;
+            }
+        }
+    }
+    else if (mset.type==MeshSetBase::MESHLET)
+    {
+        MeshletSet const & set = static_cast<MeshletSet const &>(mset);
+
+        if (!checkIndices(set.indices32, set.nindices32))
+        {
+            log::error("vertex index out of range in asset '%s'", assetpath);
+            return false;
+        }
+        for (uint32_t i=0; i<set.nmeshInfos; ++i)
+        {
+            MeshletInfo const & minfo = set.meshInfos[i];
+            if (!rangeFits(minfo.firstMeshlet, minfo.numMeshlets, set.nmeshlets))
+            {
+                log::error("MeshletInfo (%d) out of range in asset '%s'", i, assetpath);
+                return false;
+            }
+        }
+    }
+
+    for (uint32_t i=0; i<mset.ninstances; ++i)
+    {
+        MeshInstance const & instance = mset.instances[i];
+        if (instance.minfoId>=mset.nmeshInfos || !validId(instance.nodeId, mset.nnodes))
+        {
+            log::error("MeshInstance (%d) invalid references in asset '%s'", i, assetpath);
+            return false;
+        }
+    }
+
+    if (mset.nnodes>0 && mset.rootId>=mset.nnodes && mset.rootId!=invalidId)
+    {
+        log::error("invalid root node in asset '%s'", assetpath);
+        return false;
+    }
+
+    for (uint32_t i=0; i<mset.nnodes; ++i)
+    {
+        MeshNode const & node = mset.nodes[i];
+        if (!validId(node.parentId, mset.nnodes) || !validId(node.siblingId, mset.nnodes)
+            || !validId(node.instanceId, mset.ninstances))
+        {
+            log::error("MeshNode (%d) invalid references in asset '%s'", i, assetpath);
+            return false;
+        }
+    }
+    return true;
+}
+
 //
 // implementation
 //
@@ -414,6 +632,9 @@ std::shared_ptr<MeshSetBase const> deserialize(
     {
         if ((reader.cfile = ChunkFile::deserialize(blob, assetpath)))
         {
+            reader.storage = std::make_shared<MeshSetStorage>();
+            reader.storage->cfile = reader.cfile;
+
             std::vector<Chunk const *> chunks(1);
 
             // load strings table chunk
@@ -441,6 +662,7 @@ std::shared_ptr<MeshSetBase const> deserialize(
             if (mset)
             {
                 mset->blob = blob;
+                mset->storage = reader.storage;
                 return mset;
             }
         }
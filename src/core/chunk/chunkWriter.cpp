@@ -27,6 +27,8 @@
 #include "./chunkDescs.h"
 
 #include <map>
+#include <memory>
+#include <vector>
 
 namespace donut::chunk
 {
@@ -43,7 +45,12 @@ public:
 
     ChunkId createStringsTableChunk();
 
+    // chunk data is referenced by cfile until it is serialized
+    uint8_t * allocateChunk(size_t size);
+
 private:
+    std::vector<std::unique_ptr<uint8_t[]>> m_chunkBuffers;
+
     std::map<std::string, size_t> m_stringsmap;
 };
 
@@ -67,6 +74,13 @@ size_t ChunkWriter::cacheString(char const * str)
     }
 }
 
+uint8_t * ChunkWriter::allocateChunk(size_t size)
+{
+    // zero-initialized so that padding bytes are deterministic
+    m_chunkBuffers.push_back(std::make_unique<uint8_t[]>(size));
+    return m_chunkBuffers.back().get();
+}
+
 ChunkId ChunkWriter::createStringsTableChunk()
 {
     typedef StringsTable_ChunkDesc_0x100 Desc;
@@ -101,7 +115,7 @@ ChunkId ChunkWriter::createStringsTableChunk()
 
     size_t chunkSize = descSize + tableSize + stringsSize;
 
-    uint8_t * chunkData = new uint8_t[chunkSize];
+    uint8_t * chunkData = allocateChunk(chunkSize);
 
     Desc * desc = (Desc *)chunkData;
     desc->flags = 0;
@@ -142,7 +156,7 @@ static ChunkId chunkStream(StreamHandle const & handle, ChunkWriter & writer)
            dataSize = handle.elemSize * handle.elemCount,
            chunkSize = descSize + dataSize;
 
-    uint8_t * chunkData = new uint8_t[chunkSize];
+    uint8_t * chunkData = writer.allocateChunk(chunkSize);
 
     // fill descriptor
 
@@ -177,7 +191,7 @@ template <typename T> static ChunkId chunkMeshInfos(
     Desc::Type type =
         std::is_same<T, MeshletInfo>::value ? Desc::MESHLET : Desc::MESH;
 
-    uint8_t * chunkData = new uint8_t[chunkSize];
+    uint8_t * chunkData = writer.allocateChunk(chunkSize);
 
     // fill descriptor
 
@@ -212,7 +226,7 @@ static ChunkId chunkMeshInstances(
            dataSize = ninstances * sizeof(MeshInstance),
            chunkSize = descSize + dataSize;
 
-    uint8_t * chunkData = new uint8_t[chunkSize];
+    uint8_t * chunkData = writer.allocateChunk(chunkSize);
 
     // fill descriptor
 
@@ -221,14 +235,14 @@ static ChunkId chunkMeshInstances(
 
     // process instances entries
 
-    MeshInstance * instanceData = (MeshInstance *)(chunkData + descSize);
-
-    memcpy(instanceData, instances, ninstances * sizeof(MeshInstance));
+    // note : the 4 bytes descriptor leaves the instances misaligned
+    uint8_t * instanceData = chunkData + descSize;
 
     for (uint32_t i=0; i<ninstances; ++i)
     {
-        MeshInstance & instance = instanceData[i];
+        MeshInstance instance = instances[i];
         instance.name = (char *)writer.cacheString(instance.name);
+        memcpy(instanceData + i * sizeof(MeshInstance), &instance, sizeof(MeshInstance));
     }
     return writer.cfile.addChunk<Desc>(chunkData, chunkSize);
 }
@@ -245,7 +259,7 @@ static ChunkId chunkMeshNodes(
            dataSize = nnodes * sizeof(MeshNode),
            chunkSize = descSize + dataSize;
 
-    uint8_t * chunkData = new uint8_t[chunkSize];
+    uint8_t * chunkData = writer.allocateChunk(chunkSize);
 
     // fill descriptor
 
@@ -269,7 +283,7 @@ static ChunkId chunkMeshNodes(
 }
 
 // serialize MeshSets
-std::shared_ptr<donut::vfs::IBlob const> serialize(MeshSetBase const & mset)
+std::shared_ptr<donut::vfs::IBlob const> serialize(MeshSetBase const & mset, bool compress)
 {
 
     ChunkWriter writer;
@@ -380,7 +394,7 @@ std::shared_ptr<donut::vfs::IBlob const> serialize(MeshSetBase const & mset)
 
     size_t chunkSize = sizeof(Desc);
 
-    uint8_t * chunkData = new uint8_t[chunkSize];
+    uint8_t * chunkData = writer.allocateChunk(chunkSize);
 
     memcpy(chunkData, &desc, chunkSize);
 
@@ -390,7 +404,7 @@ std::shared_ptr<donut::vfs::IBlob const> serialize(MeshSetBase const & mset)
     if (!writer.createStringsTableChunk().valid())
         return nullptr;
 
-    return writer.cfile.serialize();
+    return writer.cfile.serialize(compress);
 }
 
 }
@@ -0,0 +1,201 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/core/frame_statistics.h>
+#include <donut/core/log.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+namespace donut::profiler
+{
+    FrameStatistics::FrameStatistics(uint32_t warmupFrames)
+        : m_WarmupFrames(warmupFrames)
+        , m_WarmupRemaining(warmupFrames)
+    {
+    }
+
+    void FrameStatistics::Reset()
+    {
+        m_WarmupRemaining = m_WarmupFrames;
+        m_Samples.clear();
+        m_SampleIndex.clear();
+    }
+
+    bool FrameStatistics::AddFrame(uint64_t frameIndex, double frameMs, double cpuMs)
+    {
+        if (m_WarmupRemaining > 0)
+        {
+            --m_WarmupRemaining;
+            return false;
+        }
+
+        Sample sample;
+        sample.frameIndex = frameIndex;
+        sample.frameMs = frameMs;
+        sample.cpuMs = cpuMs;
+
+        m_SampleIndex[frameIndex] = m_Samples.size();
+        m_Samples.push_back(sample);
+        return true;
+    }
+
+    void FrameStatistics::SetGpuTime(uint64_t frameIndex, double gpuMs)
+    {
+        auto found = m_SampleIndex.find(frameIndex);
+        if (found != m_SampleIndex.end())
+            m_Samples[found->second].gpuMs = gpuMs;
+    }
+
+    double FrameStatistics::Percentile(const std::vector<double>& sortedValues, double percentile)
+    {
+        if (sortedValues.empty())
+            return 0.0;
+
+        const double rank = std::clamp(percentile, 0.0, 100.0) * 0.01 * double(sortedValues.size() - 1);
+        const size_t lower = size_t(std::floor(rank));
+        const size_t upper = std::min(lower + 1, sortedValues.size() - 1);
+        const double fraction = rank - double(lower);
+
+        return sortedValues[lower] + (sortedValues[upper] - sortedValues[lower]) * fraction;
+    }
+
+    FrameTimeSummary FrameStatistics::Summarize(std::vector<double> values)
+    {
+        FrameTimeSummary summary;
+        if (values.empty())
+            return summary;
+
+        std::sort(values.begin(), values.end());
+
+        double sum = 0.0;
+        for (double value : values)
+            sum += value;
+
+        summary.count = values.size();
+        summary.mean = sum / double(values.size());
+        summary.min = values.front();
+        summary.max = values.back();
+        summary.p50 = Percentile(values, 50.0);
+        summary.p95 = Percentile(values, 95.0);
+        summary.p99 = Percentile(values, 99.0);
+        return summary;
+    }
+
+    FrameTimeSummary FrameStatistics::GetFrameTimeSummary() const
+    {
+        std::vector<double> values;
+        values.reserve(m_Samples.size());
+        for (const Sample& sample : m_Samples)
+            values.push_back(sample.frameMs);
+        return Summarize(std::move(values));
+    }
+
+    FrameTimeSummary FrameStatistics::GetCpuSummary() const
+    {
+        std::vector<double> values;
+        values.reserve(m_Samples.size());
+        for (const Sample& sample : m_Samples)
+            values.push_back(sample.cpuMs);
+        return Summarize(std::move(values));
+    }
+
+    FrameTimeSummary FrameStatistics::GetGpuSummary() const
+    {
+        std::vector<double> values;
+        values.reserve(m_Samples.size());
+        for (const Sample& sample : m_Samples)
+        {
+            if (sample.gpuMs >= 0.0)
+                values.push_back(sample.gpuMs);
+        }
+        return Summarize(std::move(values));
+    }
+
+    void FrameStatistics::WriteCsv(std::ostream& stream) const
+    {
+        char line[256];
+
+        stream << "frame,frame_ms,cpu_ms,gpu_ms\n";
+        for (const Sample& sample : m_Samples)
+        {
+            if (sample.gpuMs >= 0.0)
+                snprintf(line, sizeof(line), "%llu,%.4f,%.4f,%.4f\n", (unsigned long long)sample.frameIndex, sample.frameMs, sample.cpuMs, sample.gpuMs);
+            else
+                snprintf(line, sizeof(line), "%llu,%.4f,%.4f,\n", (unsigned long long)sample.frameIndex, sample.frameMs, sample.cpuMs);
+            stream << line;
+        }
+    }
+
+    static void WriteJsonSummary(std::ostream& stream, const char* name, const FrameTimeSummary& summary)
+    {
+        char buf[512];
+        snprintf(buf, sizeof(buf), "    \"%s\": { \"count\": %llu, \"mean\": %.4f, \"min\": %.4f, \"max\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f }",
+            name, (unsigned long long)summary.count, summary.mean, summary.min, summary.max, summary.p50, summary.p95, summary.p99);
+        stream << buf;
+    }
+
+    void FrameStatistics::WriteJson(std::ostream& stream) const
+    {
+        stream << "{\n  \"summary\": {\n";
+        WriteJsonSummary(stream, "frame", GetFrameTimeSummary());
+        stream << ",\n";
+        WriteJsonSummary(stream, "cpu", GetCpuSummary());
+        stream << ",\n";
+        WriteJsonSummary(stream, "gpu", GetGpuSummary());
+        stream << "\n  },\n  \"frames\": [";
+
+        char line[256];
+        for (size_t i = 0; i < m_Samples.size(); i++)
+        {
+            const Sample& sample = m_Samples[i];
+            if (sample.gpuMs >= 0.0)
+                snprintf(line, sizeof(line), "\n    { \"frame\": %llu, \"frame_ms\": %.4f, \"cpu_ms\": %.4f, \"gpu_ms\": %.4f }",
+                    (unsigned long long)sample.frameIndex, sample.frameMs, sample.cpuMs, sample.gpuMs);
+            else
+                snprintf(line, sizeof(line), "\n    { \"frame\": %llu, \"frame_ms\": %.4f, \"cpu_ms\": %.4f, \"gpu_ms\": null }",
+                    (unsigned long long)sample.frameIndex, sample.frameMs, sample.cpuMs);
+            stream << line << (i + 1 < m_Samples.size() ? "," : "");
+        }
+
+        stream << "\n  ]\n}\n";
+    }
+
+    bool FrameStatistics::WriteToFile(const std::filesystem::path& fileName) const
+    {
+        std::ofstream file(fileName, std::ios::out | std::ios::trunc);
+        if (!file.is_open())
+        {
+            log::error("Couldn't open file '%s' for writing", fileName.generic_string().c_str());
+            return false;
+        }
+
+        if (fileName.extension() == ".json")
+            WriteJson(file);
+        else
+            WriteCsv(file);
+
+        return file.good();
+    }
+}
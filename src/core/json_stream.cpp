@@ -0,0 +1,691 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/core/json_stream.h>
+#include <json/reader.h>
+#include <json/value.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+namespace donut::json
+{
+    // same as the jsoncpp default
+    static constexpr size_t c_MaxDepth = 1000;
+
+    KeyTable::KeyTable(std::initializer_list<const char*> keys)
+    {
+        int id = 0;
+        for (const char* key : keys)
+            m_Ids.emplace(std::string_view(key), id++);
+    }
+
+    int KeyTable::Find(std::string_view key) const
+    {
+        auto it = m_Ids.find(key);
+        return it != m_Ids.end() ? it->second : Unknown;
+    }
+
+    static void AppendUTF8(std::string& str, uint32_t codePoint)
+    {
+        if (codePoint < 0x80)
+            str += char(codePoint);
+        else if (codePoint < 0x800)
+        {
+            str += char(0xC0 | (codePoint >> 6));
+            str += char(0x80 | (codePoint & 0x3F));
+        }
+        else if (codePoint < 0x10000)
+        {
+            str += char(0xE0 | (codePoint >> 12));
+            str += char(0x80 | ((codePoint >> 6) & 0x3F));
+            str += char(0x80 | (codePoint & 0x3F));
+        }
+        else
+        {
+            str += char(0xF0 | (codePoint >> 18));
+            str += char(0x80 | ((codePoint >> 12) & 0x3F));
+            str += char(0x80 | ((codePoint >> 6) & 0x3F));
+            str += char(0x80 | (codePoint & 0x3F));
+        }
+    }
+
+    static bool ParseHex4(const char* p, const char* end, uint32_t& value)
+    {
+        if (end - p < 4)
+            return false;
+
+        value = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            char c = p[i];
+            value <<= 4;
+            if (c >= '0' && c <= '9') value |= uint32_t(c - '0');
+            else if (c >= 'a' && c <= 'f') value |= uint32_t(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') value |= uint32_t(c - 'A' + 10);
+            else return false;
+        }
+        return true;
+    }
+
+    // Decodes the escape sequences of a string that has already been scanned.
+    static bool Unescape(const char* p, const char* end, std::string& result)
+    {
+        result.clear();
+        result.reserve(end - p);
+
+        while (p < end)
+        {
+            char c = *p++;
+            if (c != '\\')
+            {
+                result += c;
+                continue;
+            }
+
+            switch (*p++)
+            {
+            case '"': result += '"'; break;
+            case '/': result += '/'; break;
+            case '\\': result += '\\'; break;
+            case 'b': result += '\b'; break;
+            case 'f': result += '\f'; break;
+            case 'n': result += '\n'; break;
+            case 'r': result += '\r'; break;
+            case 't': result += '\t'; break;
+            case 'u': {
+                uint32_t codePoint;
+                if (!ParseHex4(p, end, codePoint))
+                    return false;
+                p += 4;
+
+                if (codePoint >= 0xD800 && codePoint <= 0xDBFF)
+                {
+                    // surrogate pair
+                    uint32_t low;
+                    if (end - p < 6 || p[0] != '\\' || p[1] != 'u' || !ParseHex4(p + 2, end, low))
+                        return false;
+                    if (low < 0xDC00 || low > 0xDFFF)
+                        return false;
+                    p += 6;
+                    codePoint = 0x10000 + ((codePoint & 0x3FF) << 10) + (low & 0x3FF);
+                }
+                AppendUTF8(result, codePoint);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Number decoding rules of jsoncpp : integers that fit are stored as Int64,
+    // larger positive ones as UInt64, everything else as a double.
+    // Returns false for malformed numbers and doubles out of range, which jsoncpp rejects.
+    static bool DecodeNumber(const char* begin, const char* end, Json::Value& value)
+    {
+        const char* p = begin;
+        bool negative = *p == '-';
+        if (negative)
+            ++p;
+
+        bool integral = true;
+        uint64_t magnitude = 0;
+        for (const char* q = p; q < end && integral; ++q)
+        {
+            if (*q < '0' || *q > '9')
+            {
+                integral = false;
+                break;
+            }
+            uint32_t digit = uint32_t(*q - '0');
+            if (magnitude > (std::numeric_limits<uint64_t>::max() - digit) / 10)
+                integral = false;
+            else
+                magnitude = magnitude * 10 + digit;
+        }
+
+        if (integral)
+        {
+            constexpr uint64_t maxInt64 = uint64_t(std::numeric_limits<int64_t>::max());
+            if (negative && magnitude <= maxInt64 + 1)
+            {
+                value = Json::Value(Json::Value::Int64(magnitude == maxInt64 + 1
+                    ? std::numeric_limits<int64_t>::min() : -int64_t(magnitude)));
+                return true;
+            }
+            if (!negative)
+            {
+                if (magnitude <= maxInt64)
+                    value = Json::Value(Json::Value::Int64(magnitude));
+                else
+                    value = Json::Value(Json::Value::UInt64(magnitude));
+                return true;
+            }
+        }
+
+        std::string str(begin, end);
+        char* numberEnd;
+        double number = strtod(str.c_str(), &numberEnd);
+        if (numberEnd != str.c_str() + str.size() || std::isinf(number))
+            return false;
+
+        value = Json::Value(number);
+        return true;
+    }
+
+    // Validates a number without storing it. Short integers always convert.
+    static bool IsValidNumber(const char* begin, const char* end)
+    {
+        if (end - begin < 300 && std::all_of(begin, end, [](char c) { return c == '-' || (c >= '0' && c <= '9'); }))
+            return true;
+
+        Json::Value value;
+        return DecodeNumber(begin, end, value);
+    }
+
+    StreamReader::StreamReader(const char* begin, const char* end)
+        : m_Begin(begin)
+        , m_Current(begin)
+        , m_End(end)
+    {
+        // UTF-8 byte order mark
+        if (m_End - m_Current >= 3 && memcmp(m_Current, "\xEF\xBB\xBF", 3) == 0)
+            m_Current += 3;
+    }
+
+    StreamReader::~StreamReader() = default;
+
+    bool StreamReader::SetError(const char* message)
+    {
+        if (!m_Error.empty())
+            return false;
+
+        int line = 1;
+        const char* lineStart = m_Begin;
+        for (const char* p = m_Begin; p < m_Current && p < m_End; ++p)
+        {
+            if (*p == '\n')
+            {
+                ++line;
+                lineStart = p + 1;
+            }
+        }
+
+        m_Error = "Line " + std::to_string(line) + ", Column " + std::to_string(m_Current - lineStart + 1) + "\n  " + message;
+
+        // stop all further reads
+        m_Current = m_End;
+        return false;
+    }
+
+    bool StreamReader::SkipWhitespace()
+    {
+        while (m_Current < m_End)
+        {
+            char c = *m_Current;
+            if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+            {
+                ++m_Current;
+            }
+            else if (c == '/' && m_End - m_Current >= 2 && m_Current[1] == '/')
+            {
+                while (m_Current < m_End && *m_Current != '\n' && *m_Current != '\r')
+                    ++m_Current;
+            }
+            else if (c == '/' && m_End - m_Current >= 2 && m_Current[1] == '*')
+            {
+                const char* close = nullptr;
+                for (const char* p = m_Current + 2; p + 1 < m_End; ++p)
+                {
+                    if (p[0] == '*' && p[1] == '/')
+                    {
+                        close = p;
+                        break;
+                    }
+                }
+                if (!close)
+                    return SetError("Unterminated comment");
+                m_Current = close + 2;
+            }
+            else
+                break;
+        }
+        return true;
+    }
+
+    TokenType StreamReader::Peek()
+    {
+        if (!SkipWhitespace() || m_Current >= m_End)
+            return TokenType::Invalid;
+
+        switch (*m_Current)
+        {
+        case '{': return TokenType::Object;
+        case '[': return TokenType::Array;
+        case '"': return TokenType::String;
+        case 't':
+        case 'f': return TokenType::Boolean;
+        case 'n': return TokenType::Null;
+        case '-':
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+            return TokenType::Number;
+        default:
+            return TokenType::Invalid;
+        }
+    }
+
+    bool StreamReader::ScanString(const char*& contentBegin, const char*& contentEnd, bool& hasEscapes)
+    {
+        // m_Current is on the opening quote
+        const char* p = m_Current + 1;
+        contentBegin = p;
+        hasEscapes = false;
+
+        while (p < m_End)
+        {
+            char c = *p;
+            if (c == '"')
+            {
+                contentEnd = p;
+                m_Current = p + 1;
+                return true;
+            }
+            if (c == '\\')
+            {
+                hasEscapes = true;
+                if (++p >= m_End)
+                    break;
+            }
+            ++p;
+        }
+
+        return SetError("Missing '\"' at the end of a string");
+    }
+
+    bool StreamReader::ReadString(std::string_view& result)
+    {
+        const char* begin;
+        const char* end;
+        bool hasEscapes;
+        if (!ScanString(begin, end, hasEscapes))
+            return false;
+
+        if (!hasEscapes)
+        {
+            result = std::string_view(begin, end - begin);
+            return true;
+        }
+
+        if (!Unescape(begin, end, m_Scratch))
+            return SetError("Bad escape sequence in string");
+
+        result = m_Scratch;
+        return true;
+    }
+
+    bool StreamReader::ScanNumber(const char*& numberEnd)
+    {
+        // Same extent as jsoncpp, which accepts empty digit sequences here ("-", "1.")
+        // and leaves the rest to the conversion
+        const char* p = m_Current;
+        if (*p == '-')
+            ++p;
+
+        while (p < m_End && *p >= '0' && *p <= '9')
+            ++p;
+
+        if (p < m_End && *p == '.')
+        {
+            ++p;
+            while (p < m_End && *p >= '0' && *p <= '9')
+                ++p;
+        }
+
+        if (p < m_End && (*p == 'e' || *p == 'E'))
+        {
+            ++p;
+            if (p < m_End && (*p == '+' || *p == '-'))
+                ++p;
+            while (p < m_End && *p >= '0' && *p <= '9')
+                ++p;
+        }
+
+        numberEnd = p;
+        return true;
+    }
+
+    bool StreamReader::ScanLiteral(const char* literal)
+    {
+        size_t length = strlen(literal);
+        if (size_t(m_End - m_Current) < length || memcmp(m_Current, literal, length) != 0)
+            return SetError("Syntax error: value, object or array expected.");
+
+        m_Current += length;
+        return true;
+    }
+
+    bool StreamReader::EnterObject()
+    {
+        if (Peek() != TokenType::Object)
+            return SetError("Syntax error: object expected.");
+        if (m_First.size() >= c_MaxDepth)
+            return SetError("Exceeded stackLimit in readValue().");
+
+        ++m_Current;
+        m_First.push_back(true);
+        return true;
+    }
+
+    bool StreamReader::EnterArray()
+    {
+        if (Peek() != TokenType::Array)
+            return SetError("Syntax error: array expected.");
+        if (m_First.size() >= c_MaxDepth)
+            return SetError("Exceeded stackLimit in readValue().");
+
+        ++m_Current;
+        m_First.push_back(true);
+        return true;
+    }
+
+    bool StreamReader::NextMember(std::string_view& key)
+    {
+        if (m_First.empty() || !SkipWhitespace())
+            return false;
+
+        if (m_Current < m_End && *m_Current == '}')
+        {
+            ++m_Current;
+            m_First.pop_back();
+            return false;
+        }
+
+        if (!m_First.back())
+        {
+            if (m_Current >= m_End || *m_Current != ',')
+                return SetError("Missing ',' or '}' in object declaration");
+            ++m_Current;
+
+            // trailing comma
+            if (!SkipWhitespace())
+                return false;
+            if (m_Current < m_End && *m_Current == '}')
+            {
+                ++m_Current;
+                m_First.pop_back();
+                return false;
+            }
+        }
+        m_First.back() = false;
+
+        if (m_Current >= m_End || *m_Current != '"')
+            return SetError("Missing '}' or object member name");
+
+        if (!ReadString(key))
+            return false;
+
+        // jsoncpp allows comments everywhere except between a name and its colon
+        while (m_Current < m_End && (*m_Current == ' ' || *m_Current == '\t' || *m_Current == '\n' || *m_Current == '\r'))
+            ++m_Current;
+        if (m_Current >= m_End || *m_Current != ':')
+            return SetError("Missing ':' after object member name");
+        ++m_Current;
+
+        return true;
+    }
+
+    bool StreamReader::NextMember(const KeyTable& keys, int& keyId)
+    {
+        std::string_view key;
+        if (!NextMember(key))
+            return false;
+
+        keyId = keys.Find(key);
+        return true;
+    }
+
+    bool StreamReader::NextElement()
+    {
+        if (m_First.empty() || !SkipWhitespace())
+            return false;
+
+        if (m_Current < m_End && *m_Current == ']')
+        {
+            ++m_Current;
+            m_First.pop_back();
+            return false;
+        }
+
+        if (!m_First.back())
+        {
+            if (m_Current >= m_End || *m_Current != ',')
+                return SetError("Missing ',' or ']' in array declaration");
+            ++m_Current;
+
+            // trailing comma
+            if (!SkipWhitespace())
+                return false;
+            if (m_Current < m_End && *m_Current == ']')
+            {
+                ++m_Current;
+                m_First.pop_back();
+                return false;
+            }
+        }
+        m_First.back() = false;
+
+        return true;
+    }
+
+    bool StreamReader::ReadScalar(Json::Value& value)
+    {
+        switch (Peek())
+        {
+        case TokenType::Null:
+            value = Json::Value();
+            return ScanLiteral("null");
+
+        case TokenType::Boolean:
+            if (*m_Current == 't')
+            {
+                value = Json::Value(true);
+                return ScanLiteral("true");
+            }
+            value = Json::Value(false);
+            return ScanLiteral("false");
+
+        case TokenType::Number: {
+            const char* end;
+            if (!ScanNumber(end))
+                return false;
+            if (!DecodeNumber(m_Current, end, value))
+                return SetError(("'" + std::string(m_Current, end) + "' is not a number.").c_str());
+            m_Current = end;
+            return true;
+        }
+
+        case TokenType::String: {
+            const char* begin;
+            const char* end;
+            bool hasEscapes;
+            if (!ScanString(begin, end, hasEscapes))
+                return false;
+
+            if (!hasEscapes)
+            {
+                value = Json::Value(begin, end);
+                return true;
+            }
+
+            std::string str;
+            if (!Unescape(begin, end, str))
+                return SetError("Bad escape sequence in string");
+            value = Json::Value(str);
+            return true;
+        }
+
+        case TokenType::Object:
+            value = Json::Value(Json::objectValue);
+            return Skip();
+
+        case TokenType::Array:
+            value = Json::Value(Json::arrayValue);
+            return Skip();
+
+        default:
+            return SetError("Syntax error: value, object or array expected.");
+        }
+    }
+
+    bool StreamReader::ReadValue(Json::Value& value)
+    {
+        TokenType type = Peek();
+        if (type != TokenType::Object && type != TokenType::Array)
+            return ReadScalar(value);
+
+        const char* begin;
+        const char* end;
+        if (!SkipSpan(begin, end))
+            return false;
+
+        if (!m_DomReader)
+        {
+            Json::CharReaderBuilder builder;
+            builder["collectComments"] = false;
+            m_DomReader.reset(builder.newCharReader());
+        }
+
+        std::string errors;
+        if (!m_DomReader->parse(begin, end, &value, &errors))
+        {
+            m_Current = begin;
+            return SetError(errors.c_str());
+        }
+        return true;
+    }
+
+    bool StreamReader::SkipValue(size_t depth)
+    {
+        switch (Peek())
+        {
+        case TokenType::Null:
+            return ScanLiteral("null");
+
+        case TokenType::Boolean:
+            return ScanLiteral(*m_Current == 't' ? "true" : "false");
+
+        case TokenType::Number: {
+            const char* end;
+            if (!ScanNumber(end))
+                return false;
+            if (!IsValidNumber(m_Current, end))
+                return SetError(("'" + std::string(m_Current, end) + "' is not a number.").c_str());
+            m_Current = end;
+            return true;
+        }
+
+        case TokenType::String: {
+            const char* begin;
+            const char* end;
+            bool hasEscapes;
+            if (!ScanString(begin, end, hasEscapes))
+                return false;
+            if (hasEscapes && !Unescape(begin, end, m_Scratch))
+                return SetError("Bad escape sequence in string");
+            return true;
+        }
+
+        case TokenType::Object: {
+            if (depth >= c_MaxDepth)
+                return SetError("Exceeded stackLimit in readValue().");
+            if (!EnterObject())
+                return false;
+            std::string_view key;
+            while (NextMember(key))
+            {
+                if (!SkipValue(depth + 1))
+                    return false;
+            }
+            return !HasError();
+        }
+
+        case TokenType::Array: {
+            if (depth >= c_MaxDepth)
+                return SetError("Exceeded stackLimit in readValue().");
+            if (!EnterArray())
+                return false;
+            while (NextElement())
+            {
+                if (!SkipValue(depth + 1))
+                    return false;
+            }
+            return !HasError();
+        }
+
+        default:
+            return SetError("Syntax error: value, object or array expected.");
+        }
+    }
+
+    bool StreamReader::Skip()
+    {
+        return SkipValue(m_First.size());
+    }
+
+    bool StreamReader::SkipSpan(const char*& begin, const char*& end)
+    {
+        if (Peek() == TokenType::Invalid)
+            return SetError("Syntax error: value, object or array expected.");
+
+        begin = m_Current;
+        if (!Skip())
+            return false;
+        end = m_Current;
+        return true;
+    }
+
+    StreamReader::Position StreamReader::Save() const
+    {
+        return Position{ GetOffset(), m_First.size() };
+    }
+
+    void StreamReader::Restore(const Position& position)
+    {
+        m_Current = m_Begin + position.offset;
+        m_First.resize(position.depth);
+    }
+
+    bool Parse(const char* begin, const char* end, Json::Value& value, std::string* errors)
+    {
+        Json::CharReaderBuilder builder;
+        builder["collectComments"] = false;
+        std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+
+        return reader->parse(begin, end, &value, errors);
+    }
+}
@@ -21,10 +21,19 @@
 */
 
 #include <donut/core/log.h>
+#include <donut/core/log_sinks.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <ctime>
 #include <iterator>
 #include <mutex>
+#include <thread>
+#include <unordered_map>
 #if _WIN32
 #include <Windows.h>
 #endif
@@ -36,39 +45,48 @@ namespace donut::log
     static std::string g_ErrorMessageCaption = "Error";
 
     static std::mutex g_LogMutex;
-    
-    void DefaultCallback(Severity severity, const char* message)
+
+    static const char* GetSeverityText(Severity severity)
     {
-        const char* severityText = "";
         switch (severity)
         {
-        case Severity::Debug: severityText = "DEBUG";  break;
-        case Severity::Info: severityText = "INFO";  break;
-        case Severity::Warning: severityText = "WARNING"; break;
-        case Severity::Error: severityText = "ERROR"; break;
-        case Severity::Fatal: severityText = "FATAL ERROR"; break;
-		default:
-			break;
+        case Severity::Debug: return "DEBUG";
+        case Severity::Info: return "INFO";
+        case Severity::Warning: return "WARNING";
+        case Severity::Error: return "ERROR";
+        case Severity::Fatal: return "FATAL ERROR";
+        default: return "";
         }
+    }
 
-        char buf[g_MessageBufferSize];
-        snprintf(buf, std::size(buf), "%s: %s", severityText, message);
-
-        {
-            std::lock_guard<std::mutex> lockGuard(g_LogMutex);
+    static void WriteToConsole([[maybe_unused]] Severity severity, const char* text)
+    {
+        std::lock_guard<std::mutex> lockGuard(g_LogMutex);
 
 #if _WIN32
-            OutputDebugStringA(buf);
-            OutputDebugStringA("\n");
+        OutputDebugStringA(text);
+        OutputDebugStringA("\n");
 
-            if (severity == Severity::Error || severity == Severity::Fatal)
-            {
-                MessageBoxA(0, buf, g_ErrorMessageCaption.c_str(), MB_ICONERROR);
-            }
+        if (severity == Severity::Error || severity == Severity::Fatal)
+        {
+            MessageBoxA(0, text, g_ErrorMessageCaption.c_str(), MB_ICONERROR);
+        }
 #else
-            fprintf(stderr, "%s\n", buf);
+        fprintf(stderr, "%s\n", text);
 #endif
-        }
+    }
+    
+    static void WriteMessageToConsole(Severity severity, const char* message)
+    {
+        char buf[g_MessageBufferSize];
+        snprintf(buf, std::size(buf), "%s: %s", GetSeverityText(severity), message);
+
+        WriteToConsole(severity, buf);
+    }
+
+    void DefaultCallback(Severity severity, const char* message)
+    {
+        WriteMessageToConsole(severity, message);
 
         if (severity == Severity::Fatal)
             abort();
@@ -82,6 +100,9 @@ namespace donut::log
     static Callback g_Callback = &DefaultCallback;
     static Severity g_MinSeverity = Severity::Info;
 
+    // guards g_Callback against the logging thread, see StartAsync
+    static std::mutex g_CallbackMutex;
+
     void SetMinSeverity(Severity severity)
     {
         g_MinSeverity = severity;
@@ -89,19 +110,620 @@ namespace donut::log
 
     void SetCallback(Callback func)
     {
+        std::lock_guard<std::mutex> lockGuard(g_CallbackMutex);
         g_Callback = func;
     }
 
 	Callback GetCallback()
 	{
+        std::lock_guard<std::mutex> lockGuard(g_CallbackMutex);
 		return g_Callback;
 	}
 
     void ResetCallback()
     {
+        std::lock_guard<std::mutex> lockGuard(g_CallbackMutex);
         g_Callback = &DefaultCallback;
     }
 
+    static bool IsDefaultCallback(const Callback& callback)
+    {
+        auto target = callback.target<void(*)(Severity, const char*)>();
+        return target && *target == &DefaultCallback;
+    }
+
+    // Asynchronous backend
+
+    static constexpr size_t c_InlineTextSize = 224;
+
+    static uint64_t GetTimestampUs()
+    {
+        auto now = std::chrono::system_clock::now().time_since_epoch();
+        return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+    }
+
+    struct QueuedRecord
+    {
+        Severity severity = Severity::None;
+        uint32_t length = 0;
+        uint64_t timestampUs = 0;
+        char* longText = nullptr; // heap copy for messages that don't fit into 'text'
+        char text[c_InlineTextSize];
+    };
+
+    // Per-thread record storage: a single-producer / single-consumer ring.
+    // The owning thread advances 'head', the logging thread advances 'tail'.
+    struct ThreadRing
+    {
+        std::unique_ptr<QueuedRecord[]> slots;
+        uint64_t mask = 0;
+        std::atomic<uint64_t> head = 0;
+        std::atomic<uint64_t> tail = 0;
+        std::atomic<bool> retired = false;
+        uint32_t threadId = 0;
+        uint64_t generation = 0;
+
+        ~ThreadRing()
+        {
+            // records that were never drained, e.g. enqueued after a restart
+            for (uint64_t t = tail.load(); t != head.load(); ++t)
+                delete[] slots[t & mask].longText;
+        }
+    };
+
+    struct AsyncState
+    {
+        std::mutex mutex;
+        std::condition_variable wake;    // wakes up the logging thread
+        std::condition_variable flushed; // signals flushCompleted changes
+        std::vector<std::shared_ptr<ThreadRing>> rings;
+        std::thread thread;
+        AsyncDesc desc;
+        uint64_t flushRequested = 0;
+        uint64_t flushCompleted = 0;
+        bool stopRequested = false;
+        uint32_t nextThreadId = 1;
+
+        std::atomic<bool> running = false;
+        std::atomic<bool> pending = false;
+        std::atomic<uint32_t> activeProducers = 0;
+        std::atomic<uint64_t> dropped = 0;
+        std::atomic<uint64_t> generation = 0;
+
+        struct RepeatState
+        {
+            uint64_t windowStartUs = 0;
+            uint32_t count = 0;
+            uint32_t suppressed = 0;
+        };
+
+        // logging thread only
+        std::unordered_map<std::string, RepeatState> repeats;
+        std::vector<QueuedRecord> batch;
+
+        static AsyncState& Get()
+        {
+            static AsyncState state;
+            return state;
+        }
+
+        ~AsyncState()
+        {
+            // in case the application didn't stop the backend before exiting
+            if (thread.joinable())
+            {
+                {
+                    std::lock_guard<std::mutex> lockGuard(mutex);
+                    stopRequested = true;
+                }
+                wake.notify_one();
+                thread.join();
+            }
+        }
+    };
+
+    static thread_local bool t_IsLoggingThread = false;
+
+    struct ThreadRingHolder
+    {
+        std::shared_ptr<ThreadRing> ring;
+
+        ~ThreadRingHolder()
+        {
+            // the logging thread drops the ring once it's empty
+            if (ring)
+                ring->retired.store(true, std::memory_order_release);
+        }
+    };
+
+    static ThreadRing& GetThreadRing(AsyncState& state)
+    {
+        static thread_local ThreadRingHolder holder;
+
+        uint64_t generation = state.generation.load(std::memory_order_acquire);
+        if (!holder.ring || holder.ring->generation != generation)
+        {
+            if (holder.ring)
+                holder.ring->retired.store(true, std::memory_order_release);
+
+            auto ring = std::make_shared<ThreadRing>();
+
+            std::lock_guard<std::mutex> lockGuard(state.mutex);
+            uint64_t capacity = 1;
+            while (capacity < state.desc.threadRingCapacity)
+                capacity <<= 1;
+            ring->slots = std::make_unique<QueuedRecord[]>(capacity);
+            ring->mask = capacity - 1;
+            ring->generation = generation;
+            // keep the thread id across restarts
+            ring->threadId = holder.ring ? holder.ring->threadId : state.nextThreadId++;
+            state.rings.push_back(ring);
+            holder.ring = ring;
+        }
+
+        return *holder.ring;
+    }
+
+    // Returns false if the backend isn't running and the message has to be handled synchronously.
+    static bool Enqueue(Severity severity, const char* text)
+    {
+        AsyncState& state = AsyncState::Get();
+
+        if (!state.running.load(std::memory_order_acquire) || t_IsLoggingThread)
+            return false;
+
+        state.activeProducers.fetch_add(1, std::memory_order_acq_rel);
+
+        // StopAsync may have started in between, it waits for activeProducers to drop to 0
+        if (!state.running.load(std::memory_order_acquire))
+        {
+            state.activeProducers.fetch_sub(1, std::memory_order_acq_rel);
+            return false;
+        }
+
+        ThreadRing& ring = GetThreadRing(state);
+
+        const uint64_t h = ring.head.load(std::memory_order_relaxed);
+        while (h - ring.tail.load(std::memory_order_acquire) > ring.mask)
+        {
+            // fatal messages are never dropped, they wait for room like with the Block policy
+            if (state.desc.overflowPolicy == OverflowPolicy::Drop && severity != Severity::Fatal)
+            {
+                state.dropped.fetch_add(1, std::memory_order_relaxed);
+                state.activeProducers.fetch_sub(1, std::memory_order_acq_rel);
+                return true;
+            }
+
+            state.pending.store(true, std::memory_order_release);
+            state.wake.notify_one();
+            std::this_thread::yield();
+        }
+
+        QueuedRecord& record = ring.slots[h & ring.mask];
+        size_t length = strlen(text);
+        record.severity = severity;
+        record.timestampUs = GetTimestampUs();
+        record.length = uint32_t(length);
+        if (length < c_InlineTextSize)
+        {
+            memcpy(record.text, text, length + 1);
+            record.longText = nullptr;
+        }
+        else
+        {
+            record.longText = new char[length + 1];
+            memcpy(record.longText, text, length + 1);
+        }
+
+        ring.head.store(h + 1, std::memory_order_release);
+
+        if (!state.pending.exchange(true, std::memory_order_acq_rel))
+            state.wake.notify_one();
+
+        state.activeProducers.fetch_sub(1, std::memory_order_acq_rel);
+        return true;
+    }
+
+    // Rate limiter: returns false if the record should be dropped, otherwise fills in suppressedRepeats
+    static bool PassRateLimit(AsyncState& state, Record& record)
+    {
+        if (state.desc.rateLimitWindowMs == 0)
+            return true;
+
+        const uint64_t windowUs = uint64_t(state.desc.rateLimitWindowMs) * 1000;
+
+        // forget the messages that haven't been seen for a while
+        if (state.repeats.size() > 4096)
+        {
+            for (auto it = state.repeats.begin(); it != state.repeats.end(); )
+            {
+                if (it->second.suppressed == 0 && record.timestampUs - it->second.windowStartUs >= windowUs)
+                    it = state.repeats.erase(it);
+                else
+                    ++it;
+            }
+        }
+
+        std::string key;
+        key.reserve(record.text.size() + 1);
+        key.push_back(char('0' + int(record.severity)));
+        key.append(record.text);
+
+        AsyncState::RepeatState& repeat = state.repeats[key];
+        if (record.timestampUs - repeat.windowStartUs >= windowUs || record.timestampUs < repeat.windowStartUs)
+        {
+            repeat.windowStartUs = record.timestampUs;
+            repeat.count = 0;
+        }
+
+        if (repeat.count >= state.desc.rateLimitMaxRepeats)
+        {
+            ++repeat.suppressed;
+            return false;
+        }
+
+        ++repeat.count;
+        record.suppressedRepeats = repeat.suppressed;
+        repeat.suppressed = 0;
+        return true;
+    }
+
+    static void DrainRings(AsyncState& state, const std::vector<std::shared_ptr<ThreadRing>>& rings)
+    {
+        state.batch.clear();
+
+        std::vector<uint32_t> threadIds;
+        for (const auto& ring : rings)
+        {
+            const uint64_t h = ring->head.load(std::memory_order_acquire);
+            uint64_t t = ring->tail.load(std::memory_order_relaxed);
+            for (; t != h; ++t)
+            {
+                QueuedRecord& queued = ring->slots[t & ring->mask];
+                state.batch.push_back(queued);
+                queued.longText = nullptr; // owned by the batch now
+                threadIds.push_back(ring->threadId);
+            }
+            ring->tail.store(h, std::memory_order_release);
+        }
+
+        // merge the threads in time order; records of one thread are already ordered
+        std::vector<uint32_t> order(state.batch.size());
+        for (uint32_t i = 0; i < uint32_t(order.size()); i++)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&state](uint32_t a, uint32_t b) {
+            return state.batch[a].timestampUs < state.batch[b].timestampUs;
+        });
+
+        // the default callback is replaced by the sinks; without any sinks it still writes to the console,
+        // but doesn't abort on fatal messages, that happens on the thread that logged them
+        Callback callback;
+        {
+            std::lock_guard<std::mutex> lockGuard(g_CallbackMutex);
+            if (!IsDefaultCallback(g_Callback))
+                callback = g_Callback;
+            else if (state.desc.sinks.empty())
+                callback = &WriteMessageToConsole;
+        }
+
+        Record record;
+        for (uint32_t index : order)
+        {
+            QueuedRecord& queued = state.batch[index];
+            record.severity = queued.severity;
+            record.timestampUs = queued.timestampUs;
+            record.threadId = threadIds[index];
+            record.suppressedRepeats = 0;
+            record.text.assign(queued.longText ? queued.longText : queued.text, queued.length);
+            delete[] queued.longText;
+            queued.longText = nullptr;
+
+            if (!PassRateLimit(state, record))
+                continue;
+
+            for (const auto& sink : state.desc.sinks)
+                sink->Write(record);
+
+            if (callback)
+                callback(record.severity, record.text.c_str());
+        }
+    }
+
+    static void LoggingThreadProc()
+    {
+        AsyncState& state = AsyncState::Get();
+        t_IsLoggingThread = true;
+
+        std::vector<std::shared_ptr<ThreadRing>> rings;
+
+        while (true)
+        {
+            bool stop;
+            uint64_t flushTicket;
+            {
+                std::unique_lock<std::mutex> lock(state.mutex);
+                // the timeout covers the rare notification that arrives before the wait starts
+                state.wake.wait_for(lock, std::chrono::milliseconds(20), [&state]() {
+                    return state.stopRequested || state.flushRequested != state.flushCompleted || state.pending.load(std::memory_order_acquire);
+                });
+
+                state.pending.store(false, std::memory_order_release);
+                stop = state.stopRequested;
+                flushTicket = state.flushRequested;
+                rings = state.rings;
+            }
+
+            DrainRings(state, rings);
+
+            bool anyRetired = false;
+            for (const auto& ring : rings)
+                anyRetired |= ring->retired.load(std::memory_order_acquire);
+
+            if (anyRetired)
+            {
+                std::lock_guard<std::mutex> lockGuard(state.mutex);
+                state.rings.erase(std::remove_if(state.rings.begin(), state.rings.end(), [](const std::shared_ptr<ThreadRing>& ring) {
+                    return ring->retired.load(std::memory_order_acquire) && ring->tail.load() == ring->head.load();
+                }), state.rings.end());
+            }
+
+            if (flushTicket != state.flushCompleted || stop)
+            {
+                for (const auto& sink : state.desc.sinks)
+                    sink->Flush();
+
+                std::lock_guard<std::mutex> lockGuard(state.mutex);
+                state.flushCompleted = flushTicket;
+                state.flushed.notify_all();
+            }
+
+            if (stop)
+                break;
+        }
+
+        t_IsLoggingThread = false;
+    }
+
+    void StartAsync(const AsyncDesc& desc)
+    {
+        StopAsync();
+
+        AsyncState& state = AsyncState::Get();
+        {
+            std::lock_guard<std::mutex> lockGuard(state.mutex);
+            state.desc = desc;
+            state.desc.threadRingCapacity = std::max(desc.threadRingCapacity, 2u);
+            state.stopRequested = false;
+            state.repeats.clear();
+            state.rings.clear();
+            state.generation.fetch_add(1, std::memory_order_acq_rel);
+        }
+
+        state.thread = std::thread(LoggingThreadProc);
+        state.running.store(true, std::memory_order_release);
+    }
+
+    void StopAsync()
+    {
+        AsyncState& state = AsyncState::Get();
+
+        if (!state.thread.joinable())
+            return;
+
+        state.running.store(false, std::memory_order_release);
+
+        // let the threads that are in the middle of enqueueing finish
+        while (state.activeProducers.load(std::memory_order_acquire) != 0)
+            std::this_thread::yield();
+
+        {
+            std::lock_guard<std::mutex> lockGuard(state.mutex);
+            state.stopRequested = true;
+        }
+        state.wake.notify_one();
+        state.thread.join();
+
+        std::lock_guard<std::mutex> lockGuard(state.mutex);
+        state.rings.clear();
+        state.desc.sinks.clear();
+    }
+
+    bool IsAsync()
+    {
+        return AsyncState::Get().running.load(std::memory_order_acquire);
+    }
+
+    void Flush()
+    {
+        AsyncState& state = AsyncState::Get();
+
+        if (!state.running.load(std::memory_order_acquire) || t_IsLoggingThread)
+            return;
+
+        std::unique_lock<std::mutex> lock(state.mutex);
+        uint64_t ticket = ++state.flushRequested;
+        state.wake.notify_one();
+        state.flushed.wait(lock, [&state, ticket]() {
+            return state.flushCompleted >= ticket || state.stopRequested;
+        });
+    }
+
+    uint64_t GetDroppedMessageCount()
+    {
+        return AsyncState::Get().dropped.load(std::memory_order_relaxed);
+    }
+
+    size_t FormatRecord(const Record& record, char* buffer, size_t bufferSize)
+    {
+        time_t seconds = time_t(record.timestampUs / 1000000);
+        uint32_t milliseconds = uint32_t(record.timestampUs / 1000 % 1000);
+
+        tm localTime = {};
+#if _WIN32
+        localtime_s(&localTime, &seconds);
+#else
+        localtime_r(&seconds, &localTime);
+#endif
+
+        int length;
+        if (record.suppressedRepeats > 0)
+        {
+            length = snprintf(buffer, bufferSize, "%02d:%02d:%02d.%03u [%u] %s: %s (%u identical messages suppressed)",
+                localTime.tm_hour, localTime.tm_min, localTime.tm_sec, milliseconds, record.threadId,
+                GetSeverityText(record.severity), record.text.c_str(), record.suppressedRepeats);
+        }
+        else
+        {
+            length = snprintf(buffer, bufferSize, "%02d:%02d:%02d.%03u [%u] %s: %s",
+                localTime.tm_hour, localTime.tm_min, localTime.tm_sec, milliseconds, record.threadId,
+                GetSeverityText(record.severity), record.text.c_str());
+        }
+
+        if (length < 0)
+            return 0;
+
+        return std::min(size_t(length), bufferSize - 1);
+    }
+
+    void ConsoleSink::Write(const Record& record)
+    {
+        char buf[g_MessageBufferSize];
+        FormatRecord(record, buf, std::size(buf));
+        WriteToConsole(record.severity, buf);
+    }
+
+    RotatingFileSink::RotatingFileSink(const std::filesystem::path& path, size_t maxBytes, uint32_t maxFiles)
+        : m_Path(path)
+        , m_MaxBytes(maxBytes)
+        , m_MaxFiles(std::max(maxFiles, 1u))
+    {
+        m_File = fopen(m_Path.generic_string().c_str(), "w");
+        if (!m_File)
+            fprintf(stderr, "Cannot open log file '%s'\n", m_Path.generic_string().c_str());
+    }
+
+    RotatingFileSink::~RotatingFileSink()
+    {
+        if (m_File)
+            fclose(m_File);
+    }
+
+    void RotatingFileSink::Rotate()
+    {
+        fclose(m_File);
+        m_File = nullptr;
+
+        auto numbered = [this](uint32_t index) {
+            std::filesystem::path path = m_Path;
+            path += "." + std::to_string(index);
+            return path;
+        };
+
+        // file -> file.1 -> file.2 ... the oldest one is deleted
+        std::error_code ec;
+        if (m_MaxFiles > 1)
+        {
+            std::filesystem::remove(numbered(m_MaxFiles - 1), ec);
+            for (uint32_t index = m_MaxFiles - 1; index > 1; index--)
+                std::filesystem::rename(numbered(index - 1), numbered(index), ec);
+            std::filesystem::rename(m_Path, numbered(1), ec);
+        }
+
+        m_File = fopen(m_Path.generic_string().c_str(), "w");
+        m_Bytes = 0;
+    }
+
+    void RotatingFileSink::Write(const Record& record)
+    {
+        if (!m_File)
+            return;
+
+        char buf[g_MessageBufferSize];
+        size_t length = FormatRecord(record, buf, std::size(buf) - 1);
+        buf[length++] = '\n';
+
+        if (m_Bytes > 0 && m_Bytes + length > m_MaxBytes)
+        {
+            Rotate();
+            if (!m_File)
+                return;
+        }
+
+        fwrite(buf, 1, length, m_File);
+        m_Bytes += length;
+    }
+
+    void RotatingFileSink::Flush()
+    {
+        if (m_File)
+            fflush(m_File);
+    }
+
+    void MemorySink::Write(const Record& record)
+    {
+        std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+        if (m_Records.size() >= m_Capacity)
+            m_Records.pop_front();
+
+        m_Records.push_back(record);
+        ++m_TotalCount;
+    }
+
+    std::vector<Record> MemorySink::GetRecords(uint64_t& count) const
+    {
+        std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+        uint64_t firstStored = m_TotalCount - m_Records.size();
+        uint64_t first = std::max(count, firstStored);
+
+        std::vector<Record> result(m_Records.begin() + ptrdiff_t(first - firstStored), m_Records.end());
+        count = m_TotalCount;
+        return result;
+    }
+
+    uint64_t MemorySink::GetTotalCount() const
+    {
+        std::lock_guard<std::mutex> lockGuard(m_Mutex);
+        return m_TotalCount;
+    }
+
+    void MemorySink::Clear()
+    {
+        std::lock_guard<std::mutex> lockGuard(m_Mutex);
+        m_Records.clear();
+    }
+
+    static void Dispatch(Severity severity, const char* text)
+    {
+        if (Enqueue(severity, text))
+        {
+            if (severity == Severity::Fatal)
+            {
+                Flush();
+
+                if (IsDefaultCallback(GetCallback()))
+                    abort();
+            }
+            return;
+        }
+
+        // on the logging thread itself, e.g. from a sink, avoid recursing into the callback
+        if (t_IsLoggingThread)
+        {
+            DefaultCallback(severity, text);
+            return;
+        }
+
+        Callback callback;
+        {
+            std::lock_guard<std::mutex> lockGuard(g_CallbackMutex);
+            callback = g_Callback;
+        }
+
+        callback(severity, text);
+    }
+
     void message(Severity severity, const char* fmt...)
     {
         if (static_cast<int>(g_MinSeverity) > static_cast<int>(severity))
@@ -112,7 +734,7 @@ namespace donut::log
         va_start(args, fmt);
         vsnprintf(buffer, std::size(buffer), fmt, args);
 
-        g_Callback(severity, buffer);
+        Dispatch(severity, buffer);
 
         va_end(args);
     }
@@ -127,7 +749,7 @@ namespace donut::log
         va_start(args, fmt);
         vsnprintf(buffer, std::size(buffer), fmt, args);
 
-        g_Callback(Severity::Debug, buffer);
+        Dispatch(Severity::Debug, buffer);
 
         va_end(args);
     }
@@ -142,7 +764,7 @@ namespace donut::log
         va_start(args, fmt);
         vsnprintf(buffer, std::size(buffer), fmt, args);
 
-        g_Callback(Severity::Info, buffer);
+        Dispatch(Severity::Info, buffer);
 
         va_end(args);
     }
@@ -157,7 +779,7 @@ namespace donut::log
         va_start(args, fmt);
         vsnprintf(buffer, std::size(buffer), fmt, args);
 
-        g_Callback(Severity::Warning, buffer);
+        Dispatch(Severity::Warning, buffer);
 
         va_end(args);
     }
@@ -172,7 +794,7 @@ namespace donut::log
         va_start(args, fmt);
         vsnprintf(buffer, std::size(buffer), fmt, args);
 
-        g_Callback(Severity::Error, buffer);
+        Dispatch(Severity::Error, buffer);
 
         va_end(args);
     }
@@ -184,7 +806,7 @@ namespace donut::log
         va_start(args, fmt);
         vsnprintf(buffer, std::size(buffer), fmt, args);
 
-        g_Callback(Severity::Fatal, buffer);
+        Dispatch(Severity::Fatal, buffer);
 
         va_end(args);
     }
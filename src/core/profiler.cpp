@@ -0,0 +1,525 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/core/profiler.h>
+#include <donut/core/log.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <unordered_map>
+
+namespace donut::profiler
+{
+    static constexpr uint32_t c_GpuThreadId = 0xffff;
+    static constexpr uint32_t c_FrameThreadId = 0;
+
+    static std::chrono::steady_clock::time_point GetEpoch()
+    {
+        static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+        return epoch;
+    }
+
+    uint64_t GetTimestampNs()
+    {
+        auto elapsed = std::chrono::steady_clock::now() - GetEpoch();
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+    static void CopyEventName(char* dst, const char* src)
+    {
+        if (!src)
+            src = "";
+        size_t length = strnlen(src, c_MaxEventNameLength - 1);
+        memcpy(dst, src, length);
+        dst[length] = 0;
+    }
+
+    // Per-thread event storage: a single-producer / single-consumer ring.
+    // The owning thread advances 'head', Profiler::EndFrame advances 'tail'.
+    struct ThreadBuffer
+    {
+        static_assert((c_ThreadRingCapacity & (c_ThreadRingCapacity - 1)) == 0, "ring capacity must be a power of 2");
+
+        std::array<Event, c_ThreadRingCapacity> ring;
+        std::atomic<uint64_t> head = 0;
+        std::atomic<uint64_t> tail = 0;
+        std::atomic<uint64_t> dropped = 0;
+        std::atomic<bool> retired = false;
+        uint32_t threadId = 0;
+
+        // only touched by the owning thread; names are copied on entry so that
+        // temporary strings can be used as scope names
+        struct OpenScope
+        {
+            char name[c_MaxEventNameLength];
+            uint64_t beginNs;
+        };
+        std::array<OpenScope, c_MaxScopeDepth> stack;
+        uint32_t depth = 0;
+
+        void Push(const OpenScope& scope, uint64_t endNs)
+        {
+            const uint64_t h = head.load(std::memory_order_relaxed);
+            const uint64_t t = tail.load(std::memory_order_acquire);
+            if (h - t >= c_ThreadRingCapacity)
+            {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            Event& event = ring[h & (c_ThreadRingCapacity - 1)];
+            memcpy(event.name, scope.name, sizeof(event.name));
+            event.beginNs = scope.beginNs;
+            event.endNs = endNs;
+            event.threadId = threadId;
+            event.depth = uint16_t(depth);
+            event.track = Track::Cpu;
+
+            head.store(h + 1, std::memory_order_release);
+        }
+
+        void Drain(std::vector<Event>& output)
+        {
+            const uint64_t h = head.load(std::memory_order_acquire);
+            uint64_t t = tail.load(std::memory_order_relaxed);
+            for (; t != h; ++t)
+                output.push_back(ring[t & (c_ThreadRingCapacity - 1)]);
+            tail.store(h, std::memory_order_release);
+        }
+    };
+
+    struct ThreadRegistry
+    {
+        std::mutex mutex;
+        std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+        std::map<uint32_t, std::string> threadNames;
+        uint32_t nextThreadId = 1;
+        uint64_t droppedFromRetired = 0;
+
+        static ThreadRegistry& Get()
+        {
+            static ThreadRegistry registry;
+            return registry;
+        }
+    };
+
+#ifdef DONUT_WITH_PROFILER
+
+    struct ThreadBufferHolder
+    {
+        std::shared_ptr<ThreadBuffer> buffer;
+
+        ~ThreadBufferHolder()
+        {
+            // the registry keeps the buffer alive until its remaining events are drained
+            if (buffer)
+                buffer->retired.store(true, std::memory_order_release);
+        }
+    };
+
+    static ThreadBuffer& GetThreadBuffer()
+    {
+        static thread_local ThreadBufferHolder holder;
+
+        if (!holder.buffer)
+        {
+            holder.buffer = std::make_shared<ThreadBuffer>();
+
+            ThreadRegistry& registry = ThreadRegistry::Get();
+            std::lock_guard<std::mutex> lockGuard(registry.mutex);
+            holder.buffer->threadId = registry.nextThreadId++;
+            registry.buffers.push_back(holder.buffer);
+        }
+
+        return *holder.buffer;
+    }
+
+    void BeginScope(const char* name)
+    {
+        ThreadBuffer& buffer = GetThreadBuffer();
+
+        if (buffer.depth < c_MaxScopeDepth)
+        {
+            ThreadBuffer::OpenScope& scope = buffer.stack[buffer.depth];
+            CopyEventName(scope.name, name);
+            scope.beginNs = GetTimestampNs();
+        }
+
+        ++buffer.depth;
+    }
+
+    void EndScope()
+    {
+        ThreadBuffer& buffer = GetThreadBuffer();
+
+        if (buffer.depth == 0)
+            return;
+
+        --buffer.depth;
+
+        if (buffer.depth < c_MaxScopeDepth)
+            buffer.Push(buffer.stack[buffer.depth], GetTimestampNs());
+    }
+
+    void SetThreadName(const char* name)
+    {
+        ThreadBuffer& buffer = GetThreadBuffer();
+
+        ThreadRegistry& registry = ThreadRegistry::Get();
+        std::lock_guard<std::mutex> lockGuard(registry.mutex);
+        registry.threadNames[buffer.threadId] = name ? name : "";
+    }
+
+#endif
+
+    Profiler& Profiler::Get()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    void Profiler::BeginFrame()
+    {
+        std::lock_guard<std::mutex> lockGuard(m_Mutex);
+        m_FrameBeginNs = GetTimestampNs();
+    }
+
+    void Profiler::EndFrame()
+    {
+        const uint64_t frameEndNs = GetTimestampNs();
+
+        std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+        m_FrameEvents.clear();
+
+        {
+            ThreadRegistry& registry = ThreadRegistry::Get();
+            std::lock_guard<std::mutex> registryLock(registry.mutex);
+
+            for (auto it = registry.buffers.begin(); it != registry.buffers.end(); )
+            {
+                ThreadBuffer& buffer = **it;
+
+                // read the flag before draining so that no event pushed before retirement is lost
+                const bool retired = buffer.retired.load(std::memory_order_acquire);
+                buffer.Drain(m_FrameEvents);
+
+                if (retired)
+                {
+                    registry.droppedFromRetired += buffer.dropped.load(std::memory_order_relaxed);
+                    it = registry.buffers.erase(it);
+                }
+                else
+                    ++it;
+            }
+
+            m_DroppedEvents = registry.droppedFromRetired;
+            for (const auto& buffer : registry.buffers)
+                m_DroppedEvents += buffer->dropped.load(std::memory_order_relaxed);
+        }
+
+        // make the event order independent of the thread registration order
+        std::sort(m_FrameEvents.begin(), m_FrameEvents.end(), [](const Event& a, const Event& b)
+        {
+            if (a.beginNs != b.beginNs)
+                return a.beginNs < b.beginNs;
+            return a.depth < b.depth;
+        });
+
+        AccumulateFrame(m_FrameEvents, Track::Cpu);
+
+        if (m_CaptureFramesRemaining > 0)
+        {
+            CapturedFrame frame;
+            frame.frameIndex = m_FrameIndex;
+            frame.beginNs = m_FrameBeginNs;
+            frame.endNs = frameEndNs;
+            frame.events = m_FrameEvents;
+            m_Capture.push_back(std::move(frame));
+
+            --m_CaptureFramesRemaining;
+        }
+
+        ++m_FrameIndex;
+    }
+
+    void Profiler::AddGpuEvents(uint64_t frameIndex, const Event* events, size_t count)
+    {
+        std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+        std::vector<Event> gpuEvents(events, events + count);
+        for (Event& event : gpuEvents)
+        {
+            event.track = Track::Gpu;
+            event.threadId = c_GpuThreadId;
+        }
+
+        AccumulateFrame(gpuEvents, Track::Gpu);
+
+        double gpuFrameMs = 0.0;
+        for (const Event& event : gpuEvents)
+        {
+            if (event.depth == 0)
+                gpuFrameMs += double(event.endNs - event.beginNs) * 1e-6;
+        }
+        m_GpuFrameTimes.push_back({ frameIndex, gpuFrameMs });
+
+        for (CapturedFrame& frame : m_Capture)
+        {
+            if (frame.frameIndex != frameIndex)
+                continue;
+
+            for (Event event : gpuEvents)
+            {
+                event.beginNs += frame.beginNs;
+                event.endNs += frame.beginNs;
+                frame.events.push_back(event);
+            }
+            break;
+        }
+    }
+
+    double Profiler::GetGpuFrameTimeMs(uint64_t frameIndex) const
+    {
+        std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+        for (size_t i = 0; i < m_GpuFrameTimes.size(); i++)
+        {
+            if (m_GpuFrameTimes[i].first == frameIndex)
+                return m_GpuFrameTimes[i].second;
+        }
+        return -1.0;
+    }
+
+    void Profiler::MakeStatsKey(const Event& event, std::string& key)
+    {
+        key.assign(event.track == Track::Gpu ? "G:" : "C:");
+        key.append(event.name);
+    }
+
+    void Profiler::AccumulateFrame(const std::vector<Event>& events, Track track)
+    {
+        struct FrameTotal
+        {
+            double ms = 0.0;
+            uint32_t calls = 0;
+        };
+        std::unordered_map<size_t, FrameTotal> totals;
+        std::string key;
+
+        for (const Event& event : events)
+        {
+            MakeStatsKey(event, key);
+
+            auto found = m_StatsIndex.find(key);
+            size_t index;
+            if (found == m_StatsIndex.end())
+            {
+                index = m_Stats.size();
+                m_StatsIndex[key] = index;
+
+                ScopeStats stats;
+                stats.name = event.name;
+                stats.track = track;
+                stats.depth = event.depth;
+                m_Stats.push_back(std::move(stats));
+            }
+            else
+                index = found->second;
+
+            ScopeStats& stats = m_Stats[index];
+            stats.depth = std::min<uint32_t>(stats.depth, event.depth);
+
+            FrameTotal& total = totals[index];
+            total.ms += double(event.endNs - event.beginNs) * 1e-6;
+            total.calls += 1;
+        }
+
+        for (const auto& [index, total] : totals)
+        {
+            ScopeStats& stats = m_Stats[index];
+            stats.lastMs = total.ms;
+            stats.callCount = total.calls;
+            stats.history.push_back(float(total.ms));
+
+            double sum = 0.0;
+            double maximum = 0.0;
+            for (size_t i = 0; i < stats.history.size(); i++)
+            {
+                sum += stats.history[i];
+                maximum = std::max(maximum, double(stats.history[i]));
+            }
+            stats.averageMs = sum / double(stats.history.size());
+            stats.maxMs = maximum;
+        }
+    }
+
+    void Profiler::BeginCapture(uint32_t frameCount)
+    {
+        std::lock_guard<std::mutex> lockGuard(m_Mutex);
+        m_Capture.clear();
+        m_CaptureFramesRemaining = frameCount;
+    }
+
+    bool Profiler::IsCapturing() const
+    {
+        std::lock_guard<std::mutex> lockGuard(m_Mutex);
+        return m_CaptureFramesRemaining > 0;
+    }
+
+    size_t Profiler::GetCapturedFrameCount() const
+    {
+        std::lock_guard<std::mutex> lockGuard(m_Mutex);
+        return m_Capture.size();
+    }
+
+    void Profiler::ClearCapture()
+    {
+        std::lock_guard<std::mutex> lockGuard(m_Mutex);
+        m_Capture.clear();
+        m_CaptureFramesRemaining = 0;
+    }
+
+    static void WriteJsonString(std::ostream& stream, const char* str)
+    {
+        stream << '"';
+        for (const char* c = str; *c; ++c)
+        {
+            switch (*c)
+            {
+            case '"': stream << "\\\""; break;
+            case '\\': stream << "\\\\"; break;
+            case '\n': stream << "\\n"; break;
+            case '\t': stream << "\\t"; break;
+            default:
+                if (uint8_t(*c) < 0x20)
+                {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", uint8_t(*c));
+                    stream << buf;
+                }
+                else
+                    stream << *c;
+            }
+        }
+        stream << '"';
+    }
+
+    static void WriteThreadName(std::ostream& stream, uint32_t threadId, const char* name, bool& first)
+    {
+        stream << (first ? "\n" : ",\n");
+        first = false;
+        stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << threadId << ",\"args\":{\"name\":";
+        WriteJsonString(stream, name);
+        stream << "}}";
+    }
+
+    static void WriteCompleteEvent(std::ostream& stream, const char* name, const char* category, uint32_t threadId, uint64_t beginNs, uint64_t endNs, bool& first)
+    {
+        char timing[96];
+        snprintf(timing, sizeof(timing), "\"ts\":%.3f,\"dur\":%.3f", double(beginNs) * 1e-3, double(endNs - beginNs) * 1e-3);
+
+        stream << (first ? "\n" : ",\n");
+        first = false;
+        stream << "{\"name\":";
+        WriteJsonString(stream, name);
+        stream << ",\"cat\":\"" << category << "\",\"ph\":\"X\"," << timing << ",\"pid\":1,\"tid\":" << threadId << "}";
+    }
+
+    void Profiler::ExportChromeTrace(std::ostream& stream) const
+    {
+        std::map<uint32_t, std::string> threadNames;
+        {
+            ThreadRegistry& registry = ThreadRegistry::Get();
+            std::lock_guard<std::mutex> registryLock(registry.mutex);
+            threadNames = registry.threadNames;
+        }
+
+        std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+        bool first = true;
+        stream << "{\"traceEvents\":[";
+
+        WriteThreadName(stream, c_FrameThreadId, "Frames", first);
+        WriteThreadName(stream, c_GpuThreadId, "GPU", first);
+        for (const auto& [threadId, name] : threadNames)
+            WriteThreadName(stream, threadId, name.c_str(), first);
+
+        for (const CapturedFrame& frame : m_Capture)
+        {
+            char frameName[32];
+            snprintf(frameName, sizeof(frameName), "Frame %llu", (unsigned long long)frame.frameIndex);
+            WriteCompleteEvent(stream, frameName, "frame", c_FrameThreadId, frame.beginNs, frame.endNs, first);
+
+            for (const Event& event : frame.events)
+            {
+                WriteCompleteEvent(stream, event.name, event.track == Track::Gpu ? "gpu" : "cpu",
+                    event.threadId, event.beginNs, event.endNs, first);
+            }
+        }
+
+        stream << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    }
+
+    bool Profiler::ExportChromeTrace(const std::filesystem::path& fileName) const
+    {
+        std::ofstream file(fileName, std::ios::out | std::ios::trunc);
+        if (!file.is_open())
+        {
+            log::error("Couldn't open file '%s' for writing", fileName.generic_string().c_str());
+            return false;
+        }
+
+        ExportChromeTrace(file);
+        return file.good();
+    }
+
+    std::vector<ScopeStats> Profiler::GetScopeStats() const
+    {
+        std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+        std::vector<ScopeStats> result = m_Stats;
+        std::stable_sort(result.begin(), result.end(), [](const ScopeStats& a, const ScopeStats& b)
+        {
+            return a.track < b.track;
+        });
+        return result;
+    }
+
+    void Profiler::ResetScopeStats()
+    {
+        std::lock_guard<std::mutex> lockGuard(m_Mutex);
+        m_Stats.clear();
+        m_StatsIndex.clear();
+    }
+
+    uint64_t Profiler::GetDroppedEventCount() const
+    {
+        std::lock_guard<std::mutex> lockGuard(m_Mutex);
+        return m_DroppedEvents;
+    }
+}
@@ -130,9 +130,13 @@ TarFile::TarFile(const std::filesystem::path& archivePath)
             entry.size = fileSize;
             m_Files[fileName] = entry;
 
+            // register all parent directories, so that nested directories can be enumerated
             std::filesystem::path filePath = fileName;
-            if (filePath.has_parent_path())
-                m_Directories.insert(filePath.parent_path().generic_string());
+            for (std::filesystem::path dirPath = filePath.parent_path(); !dirPath.empty(); dirPath = dirPath.parent_path())
+            {
+                if (!m_Directories.insert(dirPath.generic_string()).second)
+                    break;
+            }
 
             // advance to the next file
             currentPosition += (fileSize + 511) & ~511;
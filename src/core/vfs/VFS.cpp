@@ -28,6 +28,8 @@
 #include <algorithm>
 #include <utility>
 #include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 
 #ifdef WIN32
 #include <Shlwapi.h>
@@ -286,124 +288,463 @@ int RelativeFileSystem::enumerateDirectories(const std::filesystem::path& path,
     return m_UnderlyingFS->enumerateDirectories(m_BasePath / path.relative_path(), callback, allowDuplicates);
 }
 
-void RootFileSystem::mount(const std::filesystem::path& path, std::shared_ptr<IFileSystem> fs)
+void donut::vfs::normalizePath(std::string_view path, std::string& result)
 {
-    if (findMountPoint(path, nullptr, nullptr))
+    auto isSeparator = [](char c)
+    {
+#ifdef WIN32
+        return c == '/' || c == '\\';
+#else
+        return c == '/';
+#endif
+    };
+
+    result.clear();
+
+    const bool absolute = !path.empty() && isSeparator(path[0]);
+    if (absolute)
+        result.push_back('/');
+    const size_t rootLength = result.size();
+
+    size_t position = 0;
+    while (position < path.size())
     {
-        log::error("Cannot mount a filesystem at %s: there is another FS that includes this path", path.c_str());
-        return;
+        while (position < path.size() && isSeparator(path[position]))
+            ++position;
+
+        size_t end = position;
+        while (end < path.size() && !isSeparator(path[end]))
+            ++end;
+
+        std::string_view component = path.substr(position, end - position);
+        position = end;
+
+        if (component.empty() || component == ".")
+            continue;
+
+        if (component == "..")
+        {
+            if (result.size() > rootLength)
+            {
+                size_t separator = result.rfind('/');
+                size_t lastStart = (separator == std::string::npos || separator < rootLength) ? rootLength : separator + 1;
+                if (std::string_view(result).substr(lastStart) != "..")
+                {
+                    result.resize(lastStart > rootLength ? lastStart - 1 : rootLength);
+                    continue;
+                }
+            }
+            else if (absolute)
+            {
+                // "/.." is "/"
+                continue;
+            }
+        }
+
+        if (result.size() > rootLength)
+            result.push_back('/');
+        result.append(component);
     }
+}
 
-    m_MountPoints.push_back(std::make_pair(path.lexically_normal().generic_string(), fs));
+VirtualPath::VirtualPath(std::string_view path)
+{
+    normalizePath(path, m_Path);
 }
 
-void donut::vfs::RootFileSystem::mount(const std::filesystem::path& path, const std::filesystem::path& nativePath)
+VirtualPath::VirtualPath(const std::filesystem::path& path)
 {
-    mount(path, std::make_shared<RelativeFileSystem>(std::make_shared<NativeFileSystem>(), nativePath));
+    normalizePath(path.generic_string(), m_Path);
 }
 
-bool RootFileSystem::unmount(const std::filesystem::path& path)
+struct RootFileSystem::MountLayer
+{
+    std::shared_ptr<IFileSystem> fs;
+    int priority = 0;
+    uint64_t order = 0;
+};
+
+struct RootFileSystem::MountTable
 {
-    std::string spath = path.lexically_normal().generic_string();
+    struct MountPoint
+    {
+        std::string path; // normalized, empty for the root
+        std::vector<MountLayer> layers; // highest priority first
+    };
+
+    std::vector<MountPoint> mountPoints;
+    std::unordered_map<std::string_view, const MountPoint*> index; // views of mountPoints[i].path
+    std::vector<bool> prefixLengths; // prefixLengths[n] is set if some mount path has n characters
 
-    for (size_t index = 0; index < m_MountPoints.size(); index++)
+    MountTable() = default;
+
+    explicit MountTable(std::vector<MountPoint>&& points)
+        : mountPoints(std::move(points))
     {
-        if (m_MountPoints[index].first == spath)
+        for (const MountPoint& mountPoint : mountPoints)
         {
-            m_MountPoints.erase(m_MountPoints.begin() + index);
-            return true;
+            index[mountPoint.path] = &mountPoint;
+
+            if (prefixLengths.size() <= mountPoint.path.size())
+                prefixLengths.resize(mountPoint.path.size() + 1, false);
+            prefixLengths[mountPoint.path.size()] = true;
         }
     }
 
-    return false;
-}
-
-bool RootFileSystem::findMountPoint(const std::filesystem::path& path, std::filesystem::path* pRelativePath, IFileSystem** ppFS)
-{
-    std::string spath = path.lexically_normal().generic_string();
+    MountTable(const MountTable&) = delete;
+    MountTable& operator=(const MountTable&) = delete;
 
-    for (auto it : m_MountPoints)
+    // Finds the mount point with the longest path that is a prefix of the normalized 'path',
+    // trying each parent directory of the path from the deepest one
+    const MountPoint* find(std::string_view path, std::string_view& relativePath) const
     {
-        if (spath.find(it.first, 0) == 0 && ((spath.length() == it.first.length()) || (spath[it.first.length()] == '/')))
+        size_t length = path.size();
+        while (true)
         {
-            if (pRelativePath)
+            if (length < prefixLengths.size() && prefixLengths[length])
             {
-                std::string relative = spath.substr(it.first.size() + 1);
-                *pRelativePath = relative;
-            }
+                auto it = index.find(path.substr(0, length));
 
-            if (ppFS)
-            {
-                *ppFS = it.second.get();
+                // the root mount point only covers absolute paths
+                if (it != index.end() && (length > 0 || (!path.empty() && path[0] == '/')))
+                {
+                    relativePath = (length < path.size()) ? path.substr(length + 1) : std::string_view();
+                    return it->second;
+                }
             }
 
-            return true;
+            if (length == 0)
+                return nullptr;
+
+            size_t separator = path.rfind('/', length - 1);
+            if (separator == std::string_view::npos)
+                return nullptr;
+
+            length = separator;
         }
     }
 
-    return false;
+    const MountPoint* resolve(std::string_view normalizedPath, std::filesystem::path& relativePath) const
+    {
+        std::string_view relative;
+        const MountPoint* mountPoint = find(normalizedPath, relative);
+        if (mountPoint)
+            relativePath = relative;
+
+        return mountPoint;
+    }
+};
+
+// Normalizes a request path into a buffer that is reused by all requests on the thread,
+// so that the normalization doesn't allocate. The result is valid until the next call.
+static std::string_view normalizeRequestPath(const std::filesystem::path& path)
+{
+    static thread_local std::string normalizedPath;
+
+#ifdef WIN32
+    normalizePath(path.generic_string(), normalizedPath);
+#else
+    normalizePath(path.native(), normalizedPath);
+#endif
+
+    return normalizedPath;
 }
 
-bool RootFileSystem::folderExists(const std::filesystem::path& name)
+static std::string normalizeMountPath(const std::filesystem::path& path)
 {
-	std::filesystem::path relativePath;
-	IFileSystem* fs = nullptr;
+    std::string result;
+    normalizePath(path.generic_string(), result);
 
-	if (findMountPoint(name, &relativePath, &fs))
-	{
-		return fs->folderExists(relativePath);
-	}
+    // "/" and "" both mean the root
+    if (result == "/")
+        result.clear();
 
-	return false;
+    return result;
 }
 
-bool RootFileSystem::fileExists(const std::filesystem::path& name)
+RootFileSystem::RootFileSystem()
+    : m_MountTable(std::make_shared<MountTable>())
+{
+}
+
+RootFileSystem::~RootFileSystem() = default;
+
+std::shared_ptr<const RootFileSystem::MountTable> RootFileSystem::getMountTable() const
+{
+    return std::atomic_load_explicit(&m_MountTable, std::memory_order_acquire);
+}
+
+bool RootFileSystem::addLayer(const std::filesystem::path& path, std::shared_ptr<IFileSystem> fs, int priority, bool overlay)
+{
+    if (!fs)
+        return false;
+
+    std::string key = normalizeMountPath(path);
+
+    std::lock_guard<std::mutex> lockGuard(m_MountMutex);
+
+    std::shared_ptr<const MountTable> table = getMountTable();
+    std::vector<MountTable::MountPoint> mountPoints = table->mountPoints;
+
+    auto it = std::find_if(mountPoints.begin(), mountPoints.end(),
+        [&key](const MountTable::MountPoint& mountPoint) { return mountPoint.path == key; });
+
+    if (!overlay)
+    {
+        // a mount nested under the root mount point doesn't conflict with it, the longest prefix wins
+        std::string_view relativePath;
+        const MountTable::MountPoint* parent = table->find(key, relativePath);
+        if (it != mountPoints.end() || (parent && !parent->path.empty()))
+        {
+            log::error("Cannot mount a filesystem at %s: there is another FS that includes this path", path.generic_string().c_str());
+            return false;
+        }
+    }
+
+    if (it == mountPoints.end())
+    {
+        mountPoints.emplace_back();
+        it = mountPoints.end() - 1;
+        it->path = key;
+    }
+
+    MountLayer layer;
+    layer.fs = std::move(fs);
+    layer.priority = priority;
+    layer.order = ++m_MountCounter;
+    it->layers.push_back(std::move(layer));
+
+    std::sort(it->layers.begin(), it->layers.end(), [](const MountLayer& a, const MountLayer& b)
+    {
+        return (a.priority != b.priority) ? (a.priority > b.priority) : (a.order > b.order);
+    });
+
+    std::atomic_store_explicit(&m_MountTable, std::shared_ptr<const MountTable>(std::make_shared<MountTable>(std::move(mountPoints))), std::memory_order_release);
+    return true;
+}
+
+bool RootFileSystem::removeLayers(const std::filesystem::path& path, const IFileSystem* fs)
+{
+    std::string key = normalizeMountPath(path);
+
+    std::lock_guard<std::mutex> lockGuard(m_MountMutex);
+
+    std::vector<MountTable::MountPoint> mountPoints = getMountTable()->mountPoints;
+
+    auto it = std::find_if(mountPoints.begin(), mountPoints.end(),
+        [&key](const MountTable::MountPoint& mountPoint) { return mountPoint.path == key; });
+
+    if (it == mountPoints.end())
+        return false;
+
+    if (fs)
+    {
+        auto layer = std::find_if(it->layers.begin(), it->layers.end(),
+            [fs](const MountLayer& layer) { return layer.fs.get() == fs; });
+
+        if (layer == it->layers.end())
+            return false;
+
+        it->layers.erase(layer);
+    }
+    else
+    {
+        it->layers.clear();
+    }
+
+    if (it->layers.empty())
+        mountPoints.erase(it);
+
+    std::atomic_store_explicit(&m_MountTable, std::shared_ptr<const MountTable>(std::make_shared<MountTable>(std::move(mountPoints))), std::memory_order_release);
+    return true;
+}
+
+void RootFileSystem::mount(const std::filesystem::path& path, std::shared_ptr<IFileSystem> fs)
+{
+    addLayer(path, std::move(fs), 0, false);
+}
+
+void donut::vfs::RootFileSystem::mount(const std::filesystem::path& path, const std::filesystem::path& nativePath)
+{
+    mount(path, std::make_shared<RelativeFileSystem>(std::make_shared<NativeFileSystem>(), nativePath));
+}
+
+bool RootFileSystem::mountOverlay(const std::filesystem::path& path, std::shared_ptr<IFileSystem> fs, int priority)
+{
+    return addLayer(path, std::move(fs), priority, true);
+}
+
+bool RootFileSystem::unmount(const std::filesystem::path& path)
+{
+    return removeLayers(path, nullptr);
+}
+
+bool RootFileSystem::unmount(const std::filesystem::path& path, const std::shared_ptr<IFileSystem>& fs)
 {
+    return fs ? removeLayers(path, fs.get()) : false;
+}
+
+bool RootFileSystem::folderExistsNormalized(std::string_view name) const
+{
+    std::shared_ptr<const MountTable> table = getMountTable();
     std::filesystem::path relativePath;
-    IFileSystem* fs = nullptr;
 
-    if (findMountPoint(name, &relativePath, &fs))
+    if (auto mountPoint = table->resolve(name, relativePath))
     {
-        return fs->fileExists(relativePath);
+        for (const MountLayer& layer : mountPoint->layers)
+        {
+            if (layer.fs->folderExists(relativePath))
+                return true;
+        }
     }
 
     return false;
 }
 
-std::shared_ptr<IBlob> RootFileSystem::readFile(const std::filesystem::path& name)
+bool RootFileSystem::fileExistsNormalized(std::string_view name) const
 {
+    std::shared_ptr<const MountTable> table = getMountTable();
     std::filesystem::path relativePath;
-    IFileSystem* fs = nullptr;
 
-    if (findMountPoint(name, &relativePath, &fs))
+    if (auto mountPoint = table->resolve(name, relativePath))
     {
-        return fs->readFile(relativePath);
+        for (const MountLayer& layer : mountPoint->layers)
+        {
+            if (layer.fs->fileExists(relativePath))
+                return true;
+        }
+    }
+
+    return false;
+}
+
+std::shared_ptr<IBlob> RootFileSystem::readFileNormalized(std::string_view name) const
+{
+    std::shared_ptr<const MountTable> table = getMountTable();
+    std::filesystem::path relativePath;
+
+    if (auto mountPoint = table->resolve(name, relativePath))
+    {
+        for (const MountLayer& layer : mountPoint->layers)
+        {
+            if (auto blob = layer.fs->readFile(relativePath))
+                return blob;
+        }
     }
 
     return nullptr;
 }
 
-bool RootFileSystem::writeFile(const std::filesystem::path& name, const void* data, size_t size)
+bool RootFileSystem::writeFileNormalized(std::string_view name, const void* data, size_t size) const
 {
+    std::shared_ptr<const MountTable> table = getMountTable();
     std::filesystem::path relativePath;
-    IFileSystem* fs = nullptr;
 
-    if (findMountPoint(name, &relativePath, &fs))
+    // writes go to the top layer
+    if (auto mountPoint = table->resolve(name, relativePath))
     {
-        return fs->writeFile(relativePath, data, size);
+        return mountPoint->layers.front().fs->writeFile(relativePath, data, size);
     }
 
     return false;
 }
 
+bool RootFileSystem::folderExists(const std::filesystem::path& name)
+{
+    return folderExistsNormalized(normalizeRequestPath(name));
+}
+
+bool RootFileSystem::fileExists(const std::filesystem::path& name)
+{
+    return fileExistsNormalized(normalizeRequestPath(name));
+}
+
+std::shared_ptr<IBlob> RootFileSystem::readFile(const std::filesystem::path& name)
+{
+    return readFileNormalized(normalizeRequestPath(name));
+}
+
+bool RootFileSystem::writeFile(const std::filesystem::path& name, const void* data, size_t size)
+{
+    return writeFileNormalized(normalizeRequestPath(name), data, size);
+}
+
+bool RootFileSystem::folderExists(const VirtualPath& name)
+{
+    return folderExistsNormalized(name.str());
+}
+
+bool RootFileSystem::fileExists(const VirtualPath& name)
+{
+    return fileExistsNormalized(name.str());
+}
+
+std::shared_ptr<IBlob> RootFileSystem::readFile(const VirtualPath& name)
+{
+    return readFileNormalized(name.str());
+}
+
+bool RootFileSystem::writeFile(const VirtualPath& name, const void* data, size_t size)
+{
+    return writeFileNormalized(name.str(), data, size);
+}
+
+// Runs the enumeration on each overlay layer. Names that exist in several layers are reported once,
+// unless duplicates are allowed. Fails only if all layers fail, with the result of the top layer.
+static int enumerateLayers(size_t layerCount, const std::function<int(size_t layer, enumerate_callback_t callback)>& enumerateLayer,
+    enumerate_callback_t callback, bool allowDuplicates)
+{
+    std::unordered_set<std::string> resultSet;
+    std::function<void(std::string_view)> collect = [&resultSet](std::string_view name)
+    {
+        resultSet.insert(std::string(name));
+    };
+
+    int firstResult = status::PathNotFound;
+    int total = 0;
+    bool anySucceeded = false;
+
+    for (size_t layer = 0; layer < layerCount; layer++)
+    {
+        int result = enumerateLayer(layer, allowDuplicates ? callback : collect);
+
+        if (layer == 0)
+            firstResult = result;
+
+        if (result >= 0)
+        {
+            anySucceeded = true;
+            total += result;
+        }
+    }
+
+    if (!anySucceeded)
+        return firstResult;
+
+    if (!allowDuplicates)
+    {
+        std::for_each(resultSet.begin(), resultSet.end(), callback);
+        return int(resultSet.size());
+    }
+
+    return total;
+}
+
 int RootFileSystem::enumerateFiles(const std::filesystem::path& path, const std::vector<std::string>& extensions, enumerate_callback_t callback, bool allowDuplicates)
 {
+    std::shared_ptr<const MountTable> table = getMountTable();
     std::filesystem::path relativePath;
-    IFileSystem* fs = nullptr;
 
-    if (findMountPoint(path, &relativePath, &fs))
+    if (auto mountPoint = table->resolve(normalizeRequestPath(path), relativePath))
     {
-        return fs->enumerateFiles(relativePath, extensions, callback, allowDuplicates);
+        const auto& layers = mountPoint->layers;
+        if (layers.size() == 1)
+            return layers[0].fs->enumerateFiles(relativePath, extensions, callback, allowDuplicates);
+
+        return enumerateLayers(layers.size(), [&](size_t layer, enumerate_callback_t layerCallback)
+        {
+            return layers[layer].fs->enumerateFiles(relativePath, extensions, layerCallback, true);
+        }, callback, allowDuplicates);
     }
 
     return status::PathNotFound;
@@ -411,12 +752,19 @@ int RootFileSystem::enumerateFiles(const std::filesystem::path& path, const std:
 
 int RootFileSystem::enumerateDirectories(const std::filesystem::path& path, enumerate_callback_t callback, bool allowDuplicates)
 {
+    std::shared_ptr<const MountTable> table = getMountTable();
     std::filesystem::path relativePath;
-    IFileSystem* fs = nullptr;
 
-    if (findMountPoint(path, &relativePath, &fs))
+    if (auto mountPoint = table->resolve(normalizeRequestPath(path), relativePath))
     {
-        return fs->enumerateDirectories(relativePath, callback, allowDuplicates);
+        const auto& layers = mountPoint->layers;
+        if (layers.size() == 1)
+            return layers[0].fs->enumerateDirectories(relativePath, callback, allowDuplicates);
+
+        return enumerateLayers(layers.size(), [&](size_t layer, enumerate_callback_t layerCallback)
+        {
+            return layers[layer].fs->enumerateDirectories(relativePath, layerCallback, true);
+        }, callback, allowDuplicates);
     }
 
     return status::PathNotFound;
@@ -25,43 +25,104 @@
 #include <donut/core/string_utils.h>
 #include <miniz.h> // declares mz_alloc_func etc. used in miniz_zip.h
 #include <miniz_zip.h>
+#include <cstring>
 #include <regex>
 
+#ifdef WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 using namespace donut::vfs;
 
+namespace
+{
+    // see the "local file header" section of the zip specification
+    constexpr uint32_t c_LocalHeaderSignature = 0x04034b50;
+    constexpr size_t c_LocalHeaderSize = 30;
+    constexpr size_t c_LocalHeaderNameLengthOffset = 26;
+    constexpr size_t c_LocalHeaderExtraLengthOffset = 28;
+
+    constexpr uint16_t c_MethodStored = 0;
+    constexpr uint16_t c_MethodDeflated = 8;
+
+    uint16_t readLE16(const uint8_t* p) { return uint16_t(p[0] | (p[1] << 8)); }
+    uint32_t readLE32(const uint8_t* p) { return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24); }
+}
+
 ZipFile::ZipFile(const std::filesystem::path& archivePath)
 {
     m_ArchivePath = archivePath.lexically_normal().generic_string();
 
-    m_ZipArchive = malloc(sizeof(mz_zip_archive));
-    memset(m_ZipArchive, 0, sizeof(mz_zip_archive));
+    // miniz is only used to parse the central directory, the reads don't go through it
+    mz_zip_archive zipArchive;
+    memset(&zipArchive, 0, sizeof(zipArchive));
 
-    if (!mz_zip_reader_init_file((mz_zip_archive*)m_ZipArchive, m_ArchivePath.c_str(), 
+    if (!mz_zip_reader_init_file(&zipArchive, m_ArchivePath.c_str(), 
         MZ_ZIP_FLAG_DO_NOT_SORT_CENTRAL_DIRECTORY | MZ_ZIP_FLAG_VALIDATE_HEADERS_ONLY))
     {
-        const char* errorString = mz_zip_get_error_string(mz_zip_get_last_error((mz_zip_archive*)m_ZipArchive));
-        log::warning("Cannot open zip archive '%s': ", m_ArchivePath.c_str(), errorString);
-
-        close();
+        const char* errorString = mz_zip_get_error_string(mz_zip_get_last_error(&zipArchive));
+        log::warning("Cannot open zip archive '%s': %s", m_ArchivePath.c_str(), errorString);
+        return;
     }
 
-    mz_uint numFiles = mz_zip_reader_get_num_files((mz_zip_archive*)m_ZipArchive);
+    mz_uint numFiles = mz_zip_reader_get_num_files(&zipArchive);
+    m_Files.reserve(numFiles);
+
     for (mz_uint i = 0; i < numFiles; i++)
     {
-        mz_uint nameLength = mz_zip_reader_get_filename((mz_zip_archive*)m_ZipArchive, i, nullptr, 0);
+        mz_zip_archive_file_stat stat;
+        if (!mz_zip_reader_file_stat(&zipArchive, i, &stat))
+            continue;
+
+        mz_uint nameLength = mz_zip_reader_get_filename(&zipArchive, i, nullptr, 0);
         std::string name;
         name.resize(nameLength - 1); // exclude the trailing zero
-        mz_zip_reader_get_filename((mz_zip_archive*)m_ZipArchive, i, name.data(), nameLength);
+        mz_zip_reader_get_filename(&zipArchive, i, name.data(), nameLength);
 
         if (string_utils::ends_with(name, "/"))
             name.erase(name.size() - 1);
 
-        if (mz_zip_reader_is_file_a_directory((mz_zip_archive*)m_ZipArchive, i))
+        if (mz_zip_reader_is_file_a_directory(&zipArchive, i))
+        {
             m_Directories.insert(name);
-        else
-            m_Files[name] = i;
+            continue;
+        }
+
+        if ((stat.m_bit_flag & 1) != 0 || (stat.m_method != c_MethodStored && stat.m_method != c_MethodDeflated))
+        {
+            log::warning("File '%s' in zip archive '%s' is encrypted or uses an unsupported compression method",
+                name.c_str(), m_ArchivePath.c_str());
+            continue;
+        }
+
+        FileEntry entry;
+        entry.localHeaderOffset = stat.m_local_header_ofs;
+        entry.compressedSize = stat.m_comp_size;
+        entry.uncompressedSize = stat.m_uncomp_size;
+        entry.crc32 = stat.m_crc32;
+        entry.method = stat.m_method;
+        m_Files[name] = entry;
+    }
+
+    mz_zip_reader_end(&zipArchive);
+
+#ifdef WIN32
+    HANDLE file = CreateFileA(m_ArchivePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    m_FileHandle = (file == INVALID_HANDLE_VALUE) ? -1 : intptr_t(file);
+#else
+    m_FileHandle = open(m_ArchivePath.c_str(), O_RDONLY);
+#endif
+
+    if (m_FileHandle == -1)
+    {
+        log::warning("Cannot open zip archive '%s' for reading", m_ArchivePath.c_str());
+        m_Files.clear();
+        m_Directories.clear();
     }
-;}
+}
 
 ZipFile::~ZipFile()
 {
@@ -70,20 +131,48 @@ ZipFile::~ZipFile()
 
 void ZipFile::close()
 {
-    // make sure we're not closing the file while some other thread is reading from it
-    std::lock_guard<std::mutex> lockGuard(m_Mutex);
-
-    if (m_ZipArchive)
+    if (m_FileHandle != -1)
     {
-        mz_zip_reader_end((mz_zip_archive*)m_ZipArchive);
-        free(m_ZipArchive);
-        m_ZipArchive = nullptr;
+#ifdef WIN32
+        CloseHandle(HANDLE(m_FileHandle));
+#else
+        ::close(int(m_FileHandle));
+#endif
+        m_FileHandle = -1;
     }
 }
 
 bool ZipFile::isOpen() const
 {
-    return m_ZipArchive != nullptr;
+    return m_FileHandle != -1;
+}
+
+bool ZipFile::readAt(void* buffer, uint64_t offset, size_t size) const
+{
+    uint8_t* dst = static_cast<uint8_t*>(buffer);
+
+    // positional reads may return less than requested, keep going until done
+    while (size > 0)
+    {
+#ifdef WIN32
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = DWORD(offset);
+        overlapped.OffsetHigh = DWORD(offset >> 32);
+        DWORD bytesToRead = (size > (1u << 30)) ? DWORD(1u << 30) : DWORD(size);
+        DWORD bytesRead = 0;
+        if (!ReadFile(HANDLE(m_FileHandle), dst, bytesToRead, &bytesRead, &overlapped) || bytesRead == 0)
+            return false;
+#else
+        ssize_t bytesRead = pread(int(m_FileHandle), dst, size, off_t(offset));
+        if (bytesRead <= 0)
+            return false;
+#endif
+        dst += bytesRead;
+        offset += uint64_t(bytesRead);
+        size -= size_t(bytesRead);
+    }
+
+    return true;
 }
 
 bool ZipFile::folderExists(const std::filesystem::path& name)
@@ -113,45 +202,71 @@ std::shared_ptr<IBlob> ZipFile::readFile(const std::filesystem::path& name)
     if (normalizedName.empty())
         return nullptr;
     
-    auto entry = m_Files.find(normalizedName);
+    auto found = m_Files.find(normalizedName);
 
-    if (entry == m_Files.end())
+    if (found == m_Files.end())
         return nullptr;
 
-    uint32_t fileIndex = entry->second;
+    const FileEntry& entry = found->second;
 
-    // working with the archive from now on, requires synchronous access
-    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+    if (entry.uncompressedSize == 0)
+        return nullptr;
 
-    // get information about the file, including its uncompressed size
-    mz_zip_archive_file_stat stat;
-    if (!mz_zip_reader_file_stat((mz_zip_archive*)m_ZipArchive, fileIndex , &stat))
+    // the local header has variable-length fields that may differ from the central directory
+    uint8_t localHeader[c_LocalHeaderSize];
+    if (!readAt(localHeader, entry.localHeaderOffset, sizeof(localHeader)) || readLE32(localHeader) != c_LocalHeaderSignature)
     {
-        const char* errorString = mz_zip_get_error_string(mz_zip_get_last_error((mz_zip_archive*)m_ZipArchive));
-        log::warning("Cannot stat file '%s' in zip archive '%s': %s",
-            normalizedName.c_str(), m_ArchivePath.c_str(), errorString);
+        log::warning("Invalid local header for file '%s' in zip archive '%s'",
+            normalizedName.c_str(), m_ArchivePath.c_str());
 
         return nullptr;
     }
 
-    if (stat.m_uncomp_size == 0)
+    uint64_t dataOffset = entry.localHeaderOffset + c_LocalHeaderSize
+        + readLE16(localHeader + c_LocalHeaderNameLengthOffset)
+        + readLE16(localHeader + c_LocalHeaderExtraLengthOffset);
+
+    void* uncompressedData = malloc(entry.uncompressedSize);
+    if (!uncompressedData)
         return nullptr;
 
-    // extract the file
-    void* uncompressedData = malloc(stat.m_uncomp_size);
-    if (!mz_zip_reader_extract_to_mem((mz_zip_archive*)m_ZipArchive, fileIndex, uncompressedData, stat.m_uncomp_size, 0))
+    bool success;
+    if (entry.method == c_MethodStored)
+    {
+        success = entry.compressedSize == entry.uncompressedSize && readAt(uncompressedData, dataOffset, entry.uncompressedSize);
+    }
+    else
+    {
+        void* compressedData = malloc(entry.compressedSize);
+        success = compressedData && readAt(compressedData, dataOffset, entry.compressedSize);
+
+        if (success)
+        {
+            // the decompressor lives on the stack of this call, nothing is shared between threads
+            size_t decompressedSize = tinfl_decompress_mem_to_mem(uncompressedData, entry.uncompressedSize,
+                compressedData, entry.compressedSize, 0);
+
+            success = decompressedSize == entry.uncompressedSize;
+        }
+
+        free(compressedData);
+    }
+
+    if (success && mz_crc32(MZ_CRC32_INIT, static_cast<const uint8_t*>(uncompressedData), entry.uncompressedSize) != entry.crc32)
+        success = false;
+
+    if (!success)
     {
         free(uncompressedData);
 
-        const char* errorString = mz_zip_get_error_string(mz_zip_get_last_error((mz_zip_archive*)m_ZipArchive));
-        log::warning("Cannot extract file '%s' from zip archive '%s': %s",
-            normalizedName.c_str(), m_ArchivePath.c_str(), errorString);
+        log::warning("Cannot extract file '%s' from zip archive '%s'",
+            normalizedName.c_str(), m_ArchivePath.c_str());
 
         return nullptr;
     }
 
     // package the extracted data into a blob and return
-    std::shared_ptr<Blob> blob = std::make_shared<Blob>(uncompressedData, stat.m_uncomp_size);
+    std::shared_ptr<Blob> blob = std::make_shared<Blob>(uncompressedData, entry.uncompressedSize);
 
     return std::static_pointer_cast<IBlob>(blob);
 }
@@ -0,0 +1,171 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/engine/CameraPath.h>
+#include <donut/core/json.h>
+#include <donut/core/log.h>
+#include <json/value.h>
+#include <limits>
+
+using namespace donut::math;
+using namespace donut::engine;
+using namespace donut::engine::animation;
+
+CameraPath::CameraPath()
+    : m_Position(std::make_shared<Sampler>())
+    , m_Target(std::make_shared<Sampler>())
+    , m_Up(std::make_shared<Sampler>())
+    , m_VerticalFov(std::make_shared<Sampler>())
+{
+    SetInterpolationMode(InterpolationMode::CatmullRomSpline);
+}
+
+void CameraPath::SetInterpolationMode(InterpolationMode mode)
+{
+    m_Position->SetInterpolationMode(mode);
+    m_Target->SetInterpolationMode(mode);
+    m_Up->SetInterpolationMode(mode);
+    m_VerticalFov->SetInterpolationMode(mode == InterpolationMode::Step ? InterpolationMode::Step : InterpolationMode::Linear);
+}
+
+void CameraPath::AddKeyframe(float time, const float3& position, const float3& target, const float3& up, std::optional<float> verticalFov)
+{
+    Keyframe keyframe;
+    keyframe.time = time;
+
+    keyframe.value = float4(position, 0.f);
+    m_Position->AddKeyframe(keyframe);
+
+    keyframe.value = float4(target, 0.f);
+    m_Target->AddKeyframe(keyframe);
+
+    keyframe.value = float4(up, 0.f);
+    m_Up->AddKeyframe(keyframe);
+
+    if (verticalFov.has_value())
+    {
+        keyframe.value = float4(*verticalFov, 0.f, 0.f, 0.f);
+        m_VerticalFov->AddKeyframe(keyframe);
+    }
+
+    // re-adding the tracks updates the sequence duration
+    m_Sequence.AddTrack("position", m_Position);
+    m_Sequence.AddTrack("target", m_Target);
+    m_Sequence.AddTrack("up", m_Up);
+    if (!m_VerticalFov->GetKeyframes().empty())
+        m_Sequence.AddTrack("vfov", m_VerticalFov);
+}
+
+bool CameraPath::Load(vfs::IFileSystem& fs, const std::filesystem::path& fileName)
+{
+    Json::Value root;
+    if (!json::LoadFromFile(fs, fileName, root))
+        return false;
+
+    if (!Load(root))
+    {
+        log::error("Camera path file '%s' doesn't contain any valid keyframes", fileName.generic_string().c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool CameraPath::Load(const Json::Value& root)
+{
+    const std::string mode = json::Read<std::string>(root["mode"], "spline");
+    if (mode == "step")
+        SetInterpolationMode(InterpolationMode::Step);
+    else if (mode == "linear")
+        SetInterpolationMode(InterpolationMode::Linear);
+    else if (mode == "spline")
+        SetInterpolationMode(InterpolationMode::CatmullRomSpline);
+    else
+        log::warning("Unknown camera path interpolation mode '%s', using 'spline'", mode.c_str());
+
+    const Json::Value& keyframesNode = root["keyframes"];
+    if (!keyframesNode.isArray())
+        return false;
+
+    float lastTime = -std::numeric_limits<float>::infinity();
+    float3 up = float3(0.f, 1.f, 0.f);
+
+    for (const Json::Value& keyframeNode : keyframesNode)
+    {
+        const Json::Value& timeNode = keyframeNode["time"];
+        const Json::Value& positionNode = keyframeNode["position"];
+        const Json::Value& targetNode = keyframeNode["target"];
+
+        if (!timeNode.isNumeric() || !positionNode.isArray() || !targetNode.isArray())
+        {
+            log::warning("Skipping a camera path keyframe without 'time', 'position' or 'target'");
+            continue;
+        }
+
+        float time = timeNode.asFloat();
+        if (time <= lastTime)
+        {
+            log::warning("Skipping a camera path keyframe at time %f: keyframes must be ordered in time", time);
+            continue;
+        }
+        lastTime = time;
+
+        float3 position = json::Read<float3>(positionNode, 0.f);
+        float3 target = json::Read<float3>(targetNode, 0.f);
+        up = json::Read<float3>(keyframeNode["up"], up);
+
+        std::optional<float> verticalFov;
+        keyframeNode["vfov"] >> verticalFov;
+
+        AddKeyframe(time, position, target, up, verticalFov);
+    }
+
+    return !IsEmpty();
+}
+
+CameraPathPose CameraPath::Evaluate(float time) const
+{
+    CameraPathPose pose;
+
+    if (IsEmpty())
+        return pose;
+
+    time = clamp(time, 0.f, GetDuration());
+
+    if (auto value = m_Position->Evaluate(time, true))
+        pose.position = value->xyz();
+
+    if (auto value = m_Target->Evaluate(time, true))
+        pose.target = value->xyz();
+
+    if (auto value = m_Up->Evaluate(time, true))
+    {
+        float3 up = value->xyz();
+        if (lengthSquared(up) > 0.f)
+            pose.up = normalize(up);
+    }
+
+    if (auto value = m_VerticalFov->Evaluate(time, true))
+        pose.verticalFov = value->x;
+
+    return pose;
+}
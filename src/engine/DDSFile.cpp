@@ -887,4 +887,104 @@ namespace donut::engine
 
         return std::make_shared<Blob>(data, dataSize);
     }
-}
\ No newline at end of file
+
+    // Writes a 2D texture or cubemap, 'subresources' are ordered by array slice, then mip level
+    static std::shared_ptr<IBlob> CreateDDSFromSubresources(nvrhi::Format format, uint32_t width, uint32_t height, uint32_t mipLevels,
+        bool isCubemap, const std::vector<std::vector<uint8_t>>& subresources)
+    {
+        const uint32_t arraySize = isCubemap ? 6 : 1;
+        if (mipLevels == 0 || width == 0 || height == 0 || subresources.size() != size_t(arraySize) * mipLevels)
+            return nullptr;
+
+        DXGI_FORMAT dxgiFormat = DXGI_FORMAT_UNKNOWN;
+        for (const FormatMapping& mapping : g_FormatMappings)
+        {
+            if (mapping.nvrhiFormat == format)
+            {
+                dxgiFormat = mapping.dxgiFormat;
+                break;
+            }
+        }
+
+        if (dxgiFormat == DXGI_FORMAT_UNKNOWN)
+            return nullptr;
+
+        DDS_HEADER header = {};
+        header.size = sizeof(DDS_HEADER);
+        header.flags = DDS_HEADER_FLAGS_TEXTURE;
+        header.caps = DDS_SURFACE_FLAGS_TEXTURE;
+        if (mipLevels > 1)
+        {
+            header.flags |= DDS_HEADER_FLAGS_MIPMAP;
+            header.caps |= DDS_SURFACE_FLAGS_MIPMAP;
+        }
+        if (isCubemap)
+        {
+            header.caps |= DDS_SURFACE_FLAGS_CUBEMAP;
+            header.caps2 = DDS_CUBEMAP_ALLFACES;
+        }
+        header.width = width;
+        header.height = height;
+        header.depth = 1;
+        header.mipMapCount = mipLevels;
+        header.ddspf.size = sizeof(DDS_PIXELFORMAT);
+        header.ddspf.flags = DDS_FOURCC;
+        header.ddspf.fourCC = MAKEFOURCC('D', 'X', '1', '0');
+
+        DDS_HEADER_DXT10 dx10header = {};
+        dx10header.dxgiFormat = dxgiFormat;
+        dx10header.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+        dx10header.arraySize = 1;
+        if (isCubemap)
+            dx10header.miscFlag |= D3D11_RESOURCE_MISC_TEXTURECUBE;
+
+        TextureData textureInfo = {};
+        textureInfo.format = format;
+        textureInfo.width = width;
+        textureInfo.height = height;
+        textureInfo.arraySize = arraySize;
+        textureInfo.mipLevels = mipLevels;
+        textureInfo.dimension = isCubemap ? nvrhi::TextureDimension::TextureCube : nvrhi::TextureDimension::Texture2D;
+
+        ptrdiff_t dataOffset = sizeof(uint32_t)
+            + sizeof(DDS_HEADER)
+            + sizeof(DDS_HEADER_DXT10);
+
+        size_t dataSize = FillTextureInfoOffsets(textureInfo, 0, dataOffset);
+
+        for (uint32_t arraySlice = 0; arraySlice < arraySize; arraySlice++)
+        {
+            for (uint32_t mipLevel = 0; mipLevel < mipLevels; mipLevel++)
+            {
+                if (subresources[arraySlice * mipLevels + mipLevel].size() != textureInfo.dataLayout[arraySlice][mipLevel].dataSize)
+                    return nullptr;
+            }
+        }
+
+        char* data = reinterpret_cast<char*>(malloc(dataSize));
+        *reinterpret_cast<uint32_t*>(data) = DDS_MAGIC;
+        *reinterpret_cast<DDS_HEADER*>(data + sizeof(uint32_t)) = header;
+        *reinterpret_cast<DDS_HEADER_DXT10*>(data + sizeof(uint32_t) + sizeof(DDS_HEADER)) = dx10header;
+
+        for (uint32_t arraySlice = 0; arraySlice < arraySize; arraySlice++)
+        {
+            for (uint32_t mipLevel = 0; mipLevel < mipLevels; mipLevel++)
+            {
+                const TextureSubresourceData& subresourceData = textureInfo.dataLayout[arraySlice][mipLevel];
+                memcpy(data + subresourceData.dataOffset, subresources[arraySlice * mipLevels + mipLevel].data(), subresourceData.dataSize);
+            }
+        }
+
+        return std::make_shared<Blob>(data, dataSize);
+    }
+
+    std::shared_ptr<IBlob> CreateDDSFromMemory(nvrhi::Format format, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& mipLevels)
+    {
+        return CreateDDSFromSubresources(format, width, height, uint32_t(mipLevels.size()), false, mipLevels);
+    }
+
+    std::shared_ptr<IBlob> CreateDDSCubemapFromMemory(nvrhi::Format format, uint32_t size, uint32_t mipLevels, const std::vector<std::vector<uint8_t>>& subresources)
+    {
+        return CreateDDSFromSubresources(format, size, size, mipLevels, true, subresources);
+    }
+}
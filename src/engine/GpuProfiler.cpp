@@ -0,0 +1,199 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/engine/GpuProfiler.h>
+
+#include <atomic>
+#include <cstring>
+
+using namespace donut::engine;
+
+static std::atomic<GpuProfiler*> g_ActiveGpuProfiler = nullptr;
+
+GpuProfiler::GpuProfiler(nvrhi::IDevice* device, uint32_t maxScopesPerFrame)
+    : m_Device(device)
+    , m_MaxScopesPerFrame(maxScopesPerFrame)
+{
+}
+
+GpuProfiler::~GpuProfiler()
+{
+    GpuProfiler* self = this;
+    g_ActiveGpuProfiler.compare_exchange_strong(self, nullptr);
+}
+
+void GpuProfiler::SetActive(GpuProfiler* profiler)
+{
+    g_ActiveGpuProfiler.store(profiler);
+}
+
+GpuProfiler* GpuProfiler::GetActive()
+{
+    return g_ActiveGpuProfiler.load(std::memory_order_relaxed);
+}
+
+bool GpuProfiler::ResolveSlot(FrameSlot& slot)
+{
+    for (const Scope& scope : slot.scopes)
+    {
+        if (scope.closed && scope.queryIndex != ~0u && !m_Device->pollTimerQuery(slot.queries[scope.queryIndex]))
+            return false;
+    }
+
+    struct Parent
+    {
+        uint64_t beginNs;
+        uint64_t consumedNs;
+    };
+    std::vector<Parent> parents;
+    uint64_t frameCursorNs = 0;
+
+    std::vector<profiler::Event> events;
+    events.reserve(slot.scopes.size());
+
+    for (const Scope& scope : slot.scopes)
+    {
+        if (!scope.closed || scope.queryIndex == ~0u)
+            continue;
+
+        const float seconds = m_Device->getTimerQueryTime(slot.queries[scope.queryIndex]);
+        const uint64_t durationNs = uint64_t(double(seconds) * 1e9);
+
+        while (parents.size() > scope.depth)
+            parents.pop_back();
+
+        uint64_t beginNs;
+        if (parents.empty())
+        {
+            beginNs = frameCursorNs;
+            frameCursorNs += durationNs;
+        }
+        else
+        {
+            beginNs = parents.back().beginNs + parents.back().consumedNs;
+            parents.back().consumedNs += durationNs;
+        }
+        parents.push_back({ beginNs, 0 });
+
+        profiler::Event event = {};
+        memcpy(event.name, scope.name, sizeof(event.name));
+        event.beginNs = beginNs;
+        event.endNs = beginNs + durationNs;
+        event.depth = scope.depth;
+        event.track = profiler::Track::Gpu;
+        events.push_back(event);
+    }
+
+    profiler::Profiler::Get().AddGpuEvents(slot.frameIndex, events.data(), events.size());
+    return true;
+}
+
+void GpuProfiler::BeginFrame()
+{
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    m_CurrentSlot = (m_CurrentSlot + 1) % c_FrameSlots;
+    FrameSlot& slot = m_Slots[m_CurrentSlot];
+
+    if (slot.pending)
+    {
+        if (!ResolveSlot(slot))
+            ++m_SkippedFrames;
+
+        for (const Scope& scope : slot.scopes)
+        {
+            if (scope.queryIndex != ~0u)
+                m_Device->resetTimerQuery(slot.queries[scope.queryIndex]);
+        }
+    }
+
+    slot.scopes.clear();
+    slot.openScopes.clear();
+    slot.frameIndex = profiler::Profiler::Get().GetFrameIndex();
+    slot.pending = false;
+
+    m_FrameStarted = true;
+}
+
+void GpuProfiler::BeginScope(nvrhi::ICommandList* commandList, const char* name)
+{
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    if (!m_Enabled || !m_FrameStarted)
+        return;
+
+    FrameSlot& slot = m_Slots[m_CurrentSlot];
+
+    Scope scope = {};
+    strncpy(scope.name, name ? name : "", sizeof(scope.name) - 1);
+    scope.depth = uint16_t(slot.openScopes.size());
+    scope.queryIndex = ~0u;
+
+    // scopes past the budget keep the nesting consistent but are not timed
+    if (slot.scopes.size() < m_MaxScopesPerFrame)
+    {
+        scope.queryIndex = uint32_t(slot.scopes.size());
+        if (scope.queryIndex >= slot.queries.size())
+            slot.queries.push_back(m_Device->createTimerQuery());
+
+        commandList->beginTimerQuery(slot.queries[scope.queryIndex]);
+    }
+
+    slot.openScopes.push_back(uint32_t(slot.scopes.size()));
+    slot.scopes.push_back(scope);
+    slot.pending = true;
+}
+
+void GpuProfiler::EndScope(nvrhi::ICommandList* commandList)
+{
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    FrameSlot& slot = m_Slots[m_CurrentSlot];
+
+    if (slot.openScopes.empty())
+        return;
+
+    Scope& scope = slot.scopes[slot.openScopes.back()];
+    slot.openScopes.pop_back();
+    scope.closed = true;
+
+    if (scope.queryIndex != ~0u)
+        commandList->endTimerQuery(slot.queries[scope.queryIndex]);
+}
+
+void donut::engine::BeginMarker(nvrhi::ICommandList* commandList, const char* name)
+{
+    commandList->beginMarker(name);
+    profiler::BeginScope(name);
+
+    if (GpuProfiler* gpuProfiler = GpuProfiler::GetActive())
+        gpuProfiler->BeginScope(commandList, name);
+}
+
+void donut::engine::EndMarker(nvrhi::ICommandList* commandList)
+{
+    if (GpuProfiler* gpuProfiler = GpuProfiler::GetActive())
+        gpuProfiler->EndScope(commandList);
+
+    profiler::EndScope();
+    commandList->endMarker();
+}
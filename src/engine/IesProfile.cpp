@@ -26,11 +26,13 @@
 #include <donut/core/vfs/VFS.h>
 #include <donut/core/math/math.h>
 #include <donut/core/log.h>
+#include <donut/core/parallel.h>
 #include <nvrhi/utils.h>
 #include <sstream>
 
 using namespace donut;
 using namespace donut::engine;
+using namespace donut::core;
 
 IesProfileLoader::IesProfileLoader(
     nvrhi::IDevice* device, 
@@ -56,6 +58,12 @@ IesProfileLoader::IesProfileLoader(
     m_ComputePipeline = device->createComputePipeline(pipelineDesc);
 }
 
+IesProfileLoader::~IesProfileLoader()
+{
+    if (m_DescriptorTableManager && m_AtlasTextureIndex >= 0)
+        m_DescriptorTableManager->ReleaseDescriptor(m_AtlasTextureIndex);
+}
+
 static const char* c_SupportedProfiles[] = {
     "IESNA:LM-63-1986",
     "IESNA:LM-63-1991",
@@ -193,52 +201,252 @@ static IesStatus ParseIesFile(char* fileData,
     return IesStatus::Success;
 }
 
-std::shared_ptr<IesProfile> IesProfileLoader::LoadIesProfile(donut::vfs::IFileSystem& fs, const std::filesystem::path& path)
+static constexpr int c_IesHeaderSize = 13;
+
+static uint64_t HashIesData(const std::vector<float>& rawData)
 {
-    auto fileBlob = fs.readFile(path);
+    uint64_t hash = 0xcbf29ce484222325ull;
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(rawData.data());
+    for (size_t i = 0; i < rawData.size() * sizeof(float); i++)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    return hash;
+}
 
-    if (!fileBlob)
-        return nullptr;
+static bool ValidateIesData(const std::vector<float>& rawData)
+{
+    if (rawData.size() < c_IesHeaderSize)
+        return false;
 
-    if (fileBlob->size() == 0)
-        return nullptr;
+    int numVerticalAngles = int(rawData[3]);
+    int numHorizontalAngles = int(rawData[4]);
+    if (numVerticalAngles < 1 || numHorizontalAngles < 1)
+        return false;
 
-    // make a copy of the data because we need to modify it, and blobs are immutable
-    char* fileData = (char*)malloc(fileBlob->size() + 1);
-    if (!fileData)
-        return nullptr;
+    size_t expectedDataSize = size_t(c_IesHeaderSize) + numHorizontalAngles + numVerticalAngles + size_t(numHorizontalAngles) * numVerticalAngles;
+    return rawData.size() == expectedDataSize;
+}
+
+namespace donut::engine
+{
+    std::shared_ptr<IesProfile> ParseIesProfile(const vfs::IBlob& file, const std::string& name)
+    {
+        if (file.size() == 0)
+            return nullptr;
 
-    memcpy(fileData, fileBlob->data(), fileBlob->size());
-    fileData[fileBlob->size()] = 0;
+        // make a copy of the data because we need to modify it, and blobs are immutable
+        char* fileData = (char*)malloc(file.size() + 1);
+        if (!fileData)
+            return nullptr;
 
-    fileBlob = nullptr;
+        memcpy(fileData, file.data(), file.size());
+        fileData[file.size()] = 0;
 
-    std::vector<float> numericData;
-    float maxCandelas;
+        std::vector<float> numericData;
+        float maxCandelas;
 
-    IesStatus status = ParseIesFile(fileData, numericData, maxCandelas);
+        IesStatus status = ParseIesFile(fileData, numericData, maxCandelas);
 
-    free(fileData);
+        free(fileData);
+
+        if (status != IesStatus::Success)
+            return nullptr;
+
+        // Stash the normalization factor in data[0], we don't use that anyway
+        numericData[0] = 1.f / maxCandelas;
+
+        std::shared_ptr<IesProfile> profile = std::make_shared<IesProfile>();
+        profile->name = name;
+        profile->textureIndex = -1;
+        profile->rawData = std::move(numericData);
+        profile->contentHash = HashIesData(profile->rawData);
+
+        return profile;
+    }
+
+    // Same as FindAngleIndex in ies_profile_cs.hlsl
+    static float FindAngleIndex(const float* angles, float angle, int count)
+    {
+        if (count == 1)
+            return 0;
+
+        float left;
+        float right = angles[0];
+
+        if (angle <= right)
+            return 0;
+
+        for (int i = 1; i < count; i++)
+        {
+            left = right;
+            right = angles[i];
+
+            if (angle >= left && angle <= right)
+                return float(i - 1) + ((right > left) ? (angle - left) / (right - left) : 0.f);
+        }
+
+        return float(count - 1);
+    }
 
-    if (status != IesStatus::Success)
+    bool ResampleIesProfile(const std::vector<float>& rawData, float* output)
+    {
+        if (!ValidateIesData(rawData))
+            return false;
+
+        const int numVerticalAngles = int(rawData[3]);
+        const int numHorizontalAngles = int(rawData[4]);
+        const float* verticalAngles = rawData.data() + c_IesHeaderSize;
+        const float* horizontalAngles = verticalAngles + numVerticalAngles;
+        const float* candelaValues = horizontalAngles + numHorizontalAngles;
+
+        const float lastVerticalAngle = verticalAngles[numVerticalAngles - 1];
+        const float lastHorizontalAngle = horizontalAngles[numHorizontalAngles - 1];
+        const float normalization = rawData[0];
+
+        const uint32_t size = c_IesProfileTextureSize;
+        for (uint32_t y = 0; y < size; y++)
+        {
+            for (uint32_t x = 0; x < size; x++)
+            {
+                float verticalAngle = float(x) * (180.f / float(size));
+                float horizontalAngle = float(y) * (360.f / float(size)) - 180.f;
+
+                if (verticalAngle > lastVerticalAngle)
+                {
+                    output[y * size + x] = 0.f;
+                    continue;
+                }
+
+                if (lastHorizontalAngle <= 180.f)
+                {
+                    // Apply symmetry
+                    horizontalAngle = fabsf(horizontalAngle);
+                    if (lastHorizontalAngle == 90.f && horizontalAngle > 90.f)
+                        horizontalAngle = 180.f - horizontalAngle;
+                }
+                else
+                {
+                    // No symmetry, but the profile has data in 0..360 degree range, convert our -180..180 range to that
+                    if (horizontalAngle < 0.f)
+                        horizontalAngle += 360.f;
+                }
+
+                const float verticalAngleIndex = FindAngleIndex(verticalAngles, verticalAngle, numVerticalAngles);
+                const float horizontalAngleIndex = FindAngleIndex(horizontalAngles, horizontalAngle, numHorizontalAngles);
+
+                const int v0 = int(floorf(verticalAngleIndex));
+                const int v1 = int(ceilf(verticalAngleIndex));
+                const int h0 = int(floorf(horizontalAngleIndex));
+                const int h1 = int(ceilf(horizontalAngleIndex));
+                const float vFraction = verticalAngleIndex - floorf(verticalAngleIndex);
+                const float hFraction = horizontalAngleIndex - floorf(horizontalAngleIndex);
+
+                const float a = candelaValues[h0 * numVerticalAngles + v0];
+                const float b = candelaValues[h0 * numVerticalAngles + v1];
+                const float c = candelaValues[h1 * numVerticalAngles + v0];
+                const float d = candelaValues[h1 * numVerticalAngles + v1];
+
+                const float candelas = dm::lerp(dm::lerp(a, b, vFraction), dm::lerp(c, d, vFraction), hFraction);
+
+                output[y * size + x] = candelas * normalization;
+            }
+        }
+
+        return true;
+    }
+
+    uint32_t BuildIesProfileAtlas(const std::vector<std::shared_ptr<IesProfile>>& profiles, std::vector<float>& texels,
+        tf::Executor* executor)
+    {
+        // Assign the slices first, in the order of the profiles, so that the layout is deterministic
+        std::unordered_map<uint64_t, std::vector<const IesProfile*>> slicesByHash;
+        std::vector<const IesProfile*> sliceProfiles;
+
+        for (const auto& profile : profiles)
+        {
+            if (!profile)
+                continue;
+
+            profile->atlasSlice = -1;
+            if (!ValidateIesData(profile->rawData))
+            {
+                log::warning("IES profile '%s' has malformed data, it is not added to the atlas", profile->name.c_str());
+                continue;
+            }
+
+            if (profile->contentHash == 0)
+                profile->contentHash = HashIesData(profile->rawData);
+
+            auto& candidates = slicesByHash[profile->contentHash];
+            for (const IesProfile* candidate : candidates)
+            {
+                if (candidate->rawData == profile->rawData)
+                {
+                    profile->atlasSlice = candidate->atlasSlice;
+                    break;
+                }
+            }
+
+            if (profile->atlasSlice < 0)
+            {
+                profile->atlasSlice = int(sliceProfiles.size());
+                sliceProfiles.push_back(profile.get());
+                candidates.push_back(profile.get());
+            }
+        }
+
+        const size_t sliceSize = size_t(c_IesProfileTextureSize) * c_IesProfileTextureSize;
+        texels.resize(sliceProfiles.size() * sliceSize);
+
+        auto resampleSlice = [&sliceProfiles, &texels, sliceSize](size_t slice)
+        {
+            ResampleIesProfile(sliceProfiles[slice]->rawData, texels.data() + slice * sliceSize);
+        };
+
+        ParallelFor(executor, sliceProfiles.size(), resampleSlice);
+
+        return uint32_t(sliceProfiles.size());
+    }
+}
+
+std::shared_ptr<IesProfile> IesProfileLoader::LoadIesProfile(donut::vfs::IFileSystem& fs, const std::filesystem::path& path)
+{
+    auto fileBlob = fs.readFile(path);
+
+    if (!fileBlob)
         return nullptr;
 
-    // Stash the normalization factor in data[0], we don't use that anyway
-    numericData[0] = 1.f / maxCandelas;
+    std::shared_ptr<IesProfile> profile = ParseIesProfile(*fileBlob, path.filename().generic_string());
 
-    std::shared_ptr<IesProfile> profile = std::make_shared<IesProfile>();
-    profile->name = path.filename().generic_string();
-    profile->textureIndex = -1;
-    profile->rawData = std::move(numericData);
+    if (!profile)
+        return nullptr;
+
+    auto& loadedProfile = m_LoadedProfiles[profile->contentHash];
+    if (auto existingProfile = loadedProfile.lock())
+    {
+        if (existingProfile->rawData == profile->rawData)
+            return existingProfile;
+    }
+
+    loadedProfile = profile;
 
     return profile;
 }
 
+void IesProfileLoader::ReleaseTextureDescriptor(IesProfile& profile)
+{
+    if (m_DescriptorTableManager && profile.textureIndex >= 0)
+        m_DescriptorTableManager->ReleaseDescriptor(profile.textureIndex);
+    profile.textureIndex = -1;
+}
+
 void IesProfileLoader::BakeIesProfile(IesProfile& profile, nvrhi::ICommandList* commandList)
 {
     if (profile.texture)
         return;
 
+    // the texture was dropped, but the descriptor may still be there
+    ReleaseTextureDescriptor(profile);
+
     nvrhi::BufferDesc bufferDesc;
     bufferDesc.byteSize = sizeof(float) * profile.rawData.size();
     bufferDesc.initialState = nvrhi::ResourceStates::ShaderResource;
@@ -282,3 +490,74 @@ void IesProfileLoader::BakeIesProfile(IesProfile& profile, nvrhi::ICommandList*
         profile.textureIndex = m_DescriptorTableManager->CreateDescriptor(nvrhi::BindingSetItem::Texture_SRV(0, profile.texture));
     }
 }
+
+nvrhi::TextureHandle IesProfileLoader::BakeIesProfileAtlas(const std::vector<std::shared_ptr<IesProfile>>& profiles,
+    nvrhi::ICommandList* commandList, tf::Executor* executor)
+{
+    // detach the profiles from the previous atlas, those that are placed again get the new one below
+    for (const auto& weakProfile : m_AtlasProfiles)
+    {
+        auto profile = weakProfile.lock();
+        if (!profile || profile->texture != m_Atlas)
+            continue;
+
+        profile->texture = nullptr;
+        profile->textureIndex = -1;
+        profile->atlasSlice = -1;
+    }
+    m_AtlasProfiles.clear();
+
+    if (m_DescriptorTableManager && m_AtlasTextureIndex >= 0)
+        m_DescriptorTableManager->ReleaseDescriptor(m_AtlasTextureIndex);
+    m_AtlasTextureIndex = -1;
+    m_Atlas = nullptr;
+
+    std::vector<float> texels;
+    uint32_t sliceCount = BuildIesProfileAtlas(profiles, texels, executor);
+
+    if (sliceCount == 0)
+        return nullptr;
+
+    nvrhi::TextureDesc textureDesc;
+    textureDesc.dimension = nvrhi::TextureDimension::Texture2DArray;
+    textureDesc.width = c_IesProfileTextureSize;
+    textureDesc.height = c_IesProfileTextureSize;
+    textureDesc.arraySize = sliceCount;
+    textureDesc.debugName = "IesProfileAtlas";
+    textureDesc.format = nvrhi::Format::R16_FLOAT;
+    textureDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+    textureDesc.keepInitialState = true;
+    m_Atlas = m_Device->createTexture(textureDesc);
+
+    std::vector<uint16_t> halfTexels(texels.size());
+    for (size_t i = 0; i < texels.size(); i++)
+        halfTexels[i] = dm::floatToHalf(texels[i]);
+
+    const size_t sliceSize = size_t(c_IesProfileTextureSize) * c_IesProfileTextureSize;
+    for (uint32_t slice = 0; slice < sliceCount; slice++)
+    {
+        commandList->writeTexture(m_Atlas, slice, 0, halfTexels.data() + slice * sliceSize,
+            c_IesProfileTextureSize * sizeof(uint16_t));
+    }
+
+    if (m_DescriptorTableManager)
+    {
+        m_AtlasTextureIndex = m_DescriptorTableManager->CreateDescriptor(nvrhi::BindingSetItem::Texture_SRV(0, m_Atlas));
+    }
+
+    for (const auto& profile : profiles)
+    {
+        if (!profile || profile->atlasSlice < 0)
+            continue;
+
+        // a profile that was baked separately before
+        if (profile->texture != m_Atlas)
+            ReleaseTextureDescriptor(*profile);
+
+        profile->texture = m_Atlas;
+        profile->textureIndex = m_AtlasTextureIndex;
+        m_AtlasProfiles.push_back(profile);
+    }
+
+    return m_Atlas;
+}
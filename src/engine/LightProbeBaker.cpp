@@ -0,0 +1,541 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/engine/LightProbeBaker.h>
+#include <donut/engine/DDSFile.h>
+#include <donut/engine/SceneTypes.h>
+#include <donut/engine/TextureCache.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/core/log.h>
+#include <donut/core/parallel.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace donut::math;
+using namespace donut::vfs;
+using namespace donut::engine;
+using namespace donut::core;
+
+namespace
+{
+    constexpr uint32_t c_IrradianceFileMagic = 0x48535044; // 'DPSH'
+    constexpr uint32_t c_CacheVersion = 1;
+
+    struct IrradianceFileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        float coefficients[SphericalHarmonicsL2::CoefficientCount][3];
+    };
+
+    uint64_t HashBytes(const void* data, size_t size, uint64_t hash)
+    {
+        constexpr uint64_t prime = 0x100000001b3ull;
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+        // Words first, then the tail, FNV-1a style
+        size_t offset = 0;
+        for (; offset + sizeof(uint64_t) <= size; offset += sizeof(uint64_t))
+        {
+            uint64_t word;
+            memcpy(&word, bytes + offset, sizeof(word));
+            hash = (hash ^ word) * prime;
+            hash ^= hash >> 29;
+        }
+        for (; offset < size; offset++)
+            hash = (hash ^ bytes[offset]) * prime;
+
+        return hash;
+    }
+
+    // Box filter of each face, used as the source of the filtered importance sampling
+    std::vector<CubemapImage> BuildSourceMipChain(const CubemapImage& radiance)
+    {
+        std::vector<CubemapImage> chain;
+        chain.push_back(radiance);
+
+        while (chain.back().size > 1)
+        {
+            const CubemapImage& source = chain.back();
+            CubemapImage mip;
+            mip.Resize(source.size / 2);
+
+            for (uint32_t face = 0; face < 6; face++)
+            {
+                const float4* src = source.GetFace(face);
+                float4* dst = mip.GetFace(face);
+                for (uint32_t y = 0; y < mip.size; y++)
+                {
+                    for (uint32_t x = 0; x < mip.size; x++)
+                    {
+                        const float4* row0 = src + (y * 2) * source.size + x * 2;
+                        const float4* row1 = row0 + source.size;
+                        dst[y * mip.size + x] = (row0[0] + row0[1] + row1[0] + row1[1]) * 0.25f;
+                    }
+                }
+            }
+
+            chain.push_back(std::move(mip));
+        }
+
+        return chain;
+    }
+
+    float4 SampleLevel(const std::vector<CubemapImage>& chain, const float3& direction, float lod)
+    {
+        lod = clamp(lod, 0.f, float(chain.size() - 1));
+        const uint32_t level = uint32_t(lod);
+        const float fraction = lod - float(level);
+
+        float4 result = chain[level].Sample(direction);
+        if (fraction > 0.f && level + 1 < chain.size())
+            result = lerp(result, chain[level + 1].Sample(direction), fraction);
+        return result;
+    }
+
+    float RadicalInverse(uint32_t i)
+    {
+        i = (i & 0x55555555) << 1 | (i & 0xAAAAAAAA) >> 1;
+        i = (i & 0x33333333) << 2 | (i & 0xCCCCCCCC) >> 2;
+        i = (i & 0x0F0F0F0F) << 4 | (i & 0xF0F0F0F0) >> 4;
+        i = (i & 0x00FF00FF) << 8 | (i & 0xFF00FF00) >> 8;
+        i = (i << 16) | (i >> 16);
+        return float(i) * 2.3283064365386963e-10f;
+    }
+
+    void ConstructONB(const float3& normal, float3& tangent, float3& bitangent)
+    {
+        float sign = (normal.z >= 0) ? 1.f : -1.f;
+        float a = -1.f / (sign + normal.z);
+        float b = normal.x * normal.y * a;
+        tangent = float3(1.f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+        bitangent = float3(b, sign + normal.y * normal.y * a, -normal.y);
+    }
+
+    // The GGX samples only depend on the roughness because N = V = R, so they are computed once per mip level
+    struct SpecularSample
+    {
+        float3 direction;   // L in tangent space
+        float weight;       // N.L
+        float lodOffset;    // source mip level for a 1x1 source, add log2 of the source size
+    };
+
+    std::vector<SpecularSample> GenerateSpecularSamples(float roughness, uint32_t sampleCount)
+    {
+        std::vector<SpecularSample> samples;
+        samples.reserve(sampleCount);
+
+        const float alpha = roughness * roughness;
+        const float alphaSquared = alpha * alpha;
+
+        for (uint32_t i = 0; i < sampleCount; i++)
+        {
+            const float phi = 2.f * PI_f * float(i) / float(sampleCount);
+            const float random = RadicalInverse(i);
+            const float cosTheta = sqrtf((1.f - random) / (1.f + (alphaSquared - 1.f) * random));
+            const float sinTheta = sqrtf(std::max(0.f, 1.f - cosTheta * cosTheta));
+
+            const float3 H = float3(sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta);
+            const float3 L = 2.f * cosTheta * H - float3(0.f, 0.f, 1.f);
+            if (L.z <= 0.f)
+                continue;
+
+            // pdf(L) = D(H) * N.H / (4 * V.H) = D(H) / 4 with N = V
+            const float denominator = cosTheta * cosTheta * (alphaSquared - 1.f) + 1.f;
+            const float pdf = alphaSquared / (PI_f * denominator * denominator) * 0.25f;
+
+            // Filtered importance sampling: pick the mip level whose texels cover the solid angle of the sample
+            // [Colbert and Krivanek, GPU Gems 3, chapter 20]
+            const float sampleSolidAngle = 1.f / (float(sampleCount) * pdf);
+            const float texelSolidAngleTimesSizeSquared = 4.f * PI_f / 6.f;
+            const float lodOffset = 0.5f * std::log2(sampleSolidAngle / texelSolidAngleTimesSizeSquared) + 1.f;
+
+            samples.push_back({ L, L.z, lodOffset });
+        }
+
+        return samples;
+    }
+
+    void FilterSpecularFace(const std::vector<CubemapImage>& sourceChain, const std::vector<SpecularSample>& samples,
+        float roughness, uint32_t face, CubemapImage& output)
+    {
+        const uint32_t size = output.size;
+        const float sourceLod = std::log2(float(sourceChain[0].size));
+        float4* texels = output.GetFace(face);
+
+        for (uint32_t y = 0; y < size; y++)
+        {
+            for (uint32_t x = 0; x < size; x++)
+            {
+                const float3 N = CubemapImage::GetTexelDirection(face, x, y, size);
+
+                if (roughness <= 0.f || samples.empty())
+                {
+                    // Mirror reflection, filtered down to the output resolution
+                    texels[y * size + x] = SampleLevel(sourceChain, N, sourceLod - std::log2(float(size)));
+                    continue;
+                }
+
+                float3 T, B;
+                ConstructONB(N, T, B);
+
+                float4 totalRadiance = 0.f;
+                float totalWeight = 0.f;
+                for (const SpecularSample& sample : samples)
+                {
+                    const float3 L = sample.direction.x * T + sample.direction.y * B + sample.direction.z * N;
+                    totalRadiance += SampleLevel(sourceChain, L, sourceLod + sample.lodOffset) * sample.weight;
+                    totalWeight += sample.weight;
+                }
+
+                texels[y * size + x] = totalRadiance / totalWeight;
+            }
+        }
+    }
+
+    std::vector<uint8_t> EncodeFace(const CubemapImage& image, uint32_t face)
+    {
+        const size_t texelCount = size_t(image.size) * image.size;
+        std::vector<uint8_t> data(texelCount * 4 * sizeof(uint16_t));
+        uint16_t* halves = reinterpret_cast<uint16_t*>(data.data());
+
+        const float4* texels = image.GetFace(face);
+        for (size_t i = 0; i < texelCount; i++)
+        {
+            halves[i * 4 + 0] = floatToHalf(texels[i].x);
+            halves[i * 4 + 1] = floatToHalf(texels[i].y);
+            halves[i * 4 + 2] = floatToHalf(texels[i].z);
+            halves[i * 4 + 3] = floatToHalf(texels[i].w);
+        }
+
+        return data;
+    }
+
+    void DecodeRows(const uint8_t* data, size_t rowPitch, nvrhi::Format format, uint32_t size, float4* texels)
+    {
+        for (uint32_t y = 0; y < size; y++)
+        {
+            const uint8_t* row = data + y * rowPitch;
+            float4* output = texels + y * size;
+
+            if (format == nvrhi::Format::RGBA32_FLOAT)
+            {
+                memcpy(output, row, size * sizeof(float4));
+                continue;
+            }
+
+            for (uint32_t x = 0; x < size; x++)
+            {
+                uint16_t halves[4];
+                memcpy(halves, row + x * sizeof(halves), sizeof(halves));
+                output[x] = float4(halfToFloat(halves[0]), halfToFloat(halves[1]), halfToFloat(halves[2]), halfToFloat(halves[3]));
+            }
+        }
+    }
+}
+
+namespace donut::engine
+{
+    float GetLightProbeMipRoughness(uint32_t mipLevel, uint32_t mipLevels)
+    {
+        if (mipLevels <= 1)
+            return 0.f;
+
+        // Same mapping as the sample application and the specularMipLevel computation in the lighting shaders
+        float level = float(mipLevel) / float(mipLevels - 1);
+        return level * level;
+    }
+
+    BakedLightProbe BakeLightProbe(const CubemapImage& radiance, const LightProbeBakeSettings& settings, tf::Executor* executor)
+    {
+        std::vector<BakedLightProbe> probes = BakeLightProbes({ &radiance }, settings, executor);
+        return std::move(probes[0]);
+    }
+
+    std::vector<BakedLightProbe> BakeLightProbes(const std::vector<const CubemapImage*>& radiance,
+        const LightProbeBakeSettings& settings, tf::Executor* executor)
+    {
+        std::vector<BakedLightProbe> probes(radiance.size());
+        std::vector<std::vector<CubemapImage>> sourceChains(radiance.size());
+
+        const uint32_t mipLevels = std::max(settings.specularMipLevels, 1u);
+
+        ParallelFor(executor, radiance.size(), [&](size_t index)
+        {
+            const CubemapImage& environment = *radiance[index];
+            if (environment.size == 0)
+                return;
+
+            probes[index].diffuseIrradiance = ProjectCubemapToSH(environment).ConvolveWithCosineLobe();
+            sourceChains[index] = BuildSourceMipChain(environment);
+
+            probes[index].specularMips.resize(mipLevels);
+            for (uint32_t mipLevel = 0; mipLevel < mipLevels; mipLevel++)
+                probes[index].specularMips[mipLevel].Resize(std::max(settings.specularSize >> mipLevel, 1u));
+        });
+
+        std::vector<std::vector<SpecularSample>> samples(mipLevels);
+        for (uint32_t mipLevel = 0; mipLevel < mipLevels; mipLevel++)
+            samples[mipLevel] = GenerateSpecularSamples(GetLightProbeMipRoughness(mipLevel, mipLevels), settings.sampleCount);
+
+        // Every face of every mip level of every probe is a separate work item
+        const size_t itemsPerProbe = size_t(mipLevels) * 6;
+        ParallelFor(executor, radiance.size() * itemsPerProbe, [&](size_t item)
+        {
+            const size_t index = item / itemsPerProbe;
+            const uint32_t mipLevel = uint32_t(item % itemsPerProbe) / 6;
+            const uint32_t face = uint32_t(item % 6);
+
+            if (sourceChains[index].empty())
+                return;
+
+            FilterSpecularFace(sourceChains[index], samples[mipLevel], GetLightProbeMipRoughness(mipLevel, mipLevels), face,
+                probes[index].specularMips[mipLevel]);
+        });
+
+        return probes;
+    }
+
+    bool ReadCubemapFromStagingTexture(nvrhi::IDevice* device, nvrhi::IStagingTexture* stagingTexture,
+        uint32_t baseArraySlice, uint32_t mipLevel, CubemapImage& result)
+    {
+        const nvrhi::TextureDesc& desc = stagingTexture->getDesc();
+        if (desc.format != nvrhi::Format::RGBA16_FLOAT && desc.format != nvrhi::Format::RGBA32_FLOAT)
+        {
+            log::error("ReadCubemapFromStagingTexture: unsupported format, RGBA16_FLOAT or RGBA32_FLOAT expected");
+            return false;
+        }
+
+        if (desc.width != desc.height || baseArraySlice + 6 > desc.arraySize || mipLevel >= desc.mipLevels)
+            return false;
+
+        result.Resize(std::max(desc.width >> mipLevel, 1u));
+
+        for (uint32_t face = 0; face < 6; face++)
+        {
+            nvrhi::TextureSlice slice;
+            slice.arraySlice = baseArraySlice + face;
+            slice.mipLevel = mipLevel;
+
+            size_t rowPitch = 0;
+            const uint8_t* data = static_cast<const uint8_t*>(device->mapStagingTexture(stagingTexture, slice, nvrhi::CpuAccessMode::Read, &rowPitch));
+            if (!data)
+                return false;
+
+            DecodeRows(data, rowPitch, desc.format, result.size, result.GetFace(face));
+
+            device->unmapStagingTexture(stagingTexture);
+        }
+
+        return true;
+    }
+
+    bool UploadBakedLightProbe(nvrhi::ICommandList* commandList, const BakedLightProbe& baked, LightProbe& probe)
+    {
+        if (!probe.specularMap || baked.specularMips.empty())
+            return false;
+
+        const nvrhi::TextureDesc& desc = probe.specularMap->getDesc();
+        if (desc.width != baked.specularMips[0].size || desc.mipLevels < baked.specularMips.size()
+            || desc.format != nvrhi::Format::RGBA16_FLOAT || (probe.specularArrayIndex + 1) * 6 > desc.arraySize)
+        {
+            log::error("The baked light probe '%s' doesn't match its specular map (%dx%d, %d mip levels, RGBA16_FLOAT expected)",
+                probe.name.c_str(), baked.specularMips[0].size, baked.specularMips[0].size, int(baked.specularMips.size()));
+            return false;
+        }
+
+        for (uint32_t face = 0; face < 6; face++)
+        {
+            for (uint32_t mipLevel = 0; mipLevel < uint32_t(baked.specularMips.size()); mipLevel++)
+            {
+                const CubemapImage& image = baked.specularMips[mipLevel];
+                std::vector<uint8_t> data = EncodeFace(image, face);
+                commandList->writeTexture(probe.specularMap, probe.specularArrayIndex * 6 + face, mipLevel,
+                    data.data(), size_t(image.size) * 4 * sizeof(uint16_t));
+            }
+        }
+
+        probe.diffuseIrradianceSH = baked.diffuseIrradiance;
+        probe.useDiffuseIrradianceSH = true;
+
+        return true;
+    }
+
+    LightProbeCache::LightProbeCache(std::shared_ptr<vfs::IFileSystem> fs, const std::filesystem::path& directory)
+        : m_FS(std::move(fs))
+        , m_Directory(directory)
+    {
+    }
+
+    uint64_t LightProbeCache::ComputeKey(const void* content, size_t size, const LightProbeBakeSettings& settings)
+    {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        hash = HashBytes(content, size, hash);
+
+        const uint32_t parameters[] = { c_CacheVersion, settings.specularSize, settings.specularMipLevels, settings.sampleCount };
+        hash = HashBytes(parameters, sizeof(parameters), hash);
+
+        return hash;
+    }
+
+    uint64_t LightProbeCache::ComputeKey(const CubemapImage& radiance, const LightProbeBakeSettings& settings)
+    {
+        uint64_t hash = HashBytes(&radiance.size, sizeof(radiance.size), 0xcbf29ce484222325ull);
+        hash = HashBytes(radiance.texels.data(), radiance.texels.size() * sizeof(float4), hash);
+        return ComputeKey(&hash, sizeof(hash), settings);
+    }
+
+    std::filesystem::path LightProbeCache::GetSpecularPath(uint64_t key) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.dds", static_cast<unsigned long long>(key));
+        return m_Directory / name;
+    }
+
+    std::filesystem::path LightProbeCache::GetIrradiancePath(uint64_t key) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.sh", static_cast<unsigned long long>(key));
+        return m_Directory / name;
+    }
+
+    bool LightProbeCache::Load(uint64_t key, BakedLightProbe& result) const
+    {
+        const std::filesystem::path irradiancePath = GetIrradiancePath(key);
+        const std::filesystem::path specularPath = GetSpecularPath(key);
+        if (!m_FS->fileExists(irradiancePath) || !m_FS->fileExists(specularPath))
+            return false;
+
+        std::shared_ptr<IBlob> irradianceBlob = m_FS->readFile(irradiancePath);
+        if (!irradianceBlob || irradianceBlob->size() != sizeof(IrradianceFileHeader))
+        {
+            log::warning("Light probe cache entry '%s' is corrupt", irradiancePath.generic_string().c_str());
+            return false;
+        }
+
+        IrradianceFileHeader header;
+        memcpy(&header, irradianceBlob->data(), sizeof(header));
+        if (header.magic != c_IrradianceFileMagic || header.version != c_CacheVersion)
+            return false;
+
+        TextureData textureData;
+        textureData.data = m_FS->readFile(specularPath);
+        if (!textureData.data || !LoadDDSTextureFromMemory(textureData)
+            || textureData.format != nvrhi::Format::RGBA16_FLOAT
+            || textureData.dimension != nvrhi::TextureDimension::TextureCube
+            || textureData.width != textureData.height)
+        {
+            log::warning("Light probe cache entry '%s' is corrupt", specularPath.generic_string().c_str());
+            return false;
+        }
+
+        for (int i = 0; i < SphericalHarmonicsL2::CoefficientCount; i++)
+            result.diffuseIrradiance.coefficients[i] = float3(header.coefficients[i][0], header.coefficients[i][1], header.coefficients[i][2]);
+
+        const uint8_t* data = static_cast<const uint8_t*>(textureData.data->data());
+        result.specularMips.resize(textureData.mipLevels);
+        for (uint32_t mipLevel = 0; mipLevel < textureData.mipLevels; mipLevel++)
+        {
+            CubemapImage& image = result.specularMips[mipLevel];
+            image.Resize(std::max(textureData.width >> mipLevel, 1u));
+
+            for (uint32_t face = 0; face < 6; face++)
+            {
+                const TextureSubresourceData& layout = textureData.dataLayout[face][mipLevel];
+                DecodeRows(data + layout.dataOffset, layout.rowPitch, textureData.format, image.size, image.GetFace(face));
+            }
+        }
+
+        return true;
+    }
+
+    bool LightProbeCache::Store(uint64_t key, const BakedLightProbe& probe) const
+    {
+        if (probe.specularMips.empty())
+            return false;
+
+        const uint32_t mipLevels = uint32_t(probe.specularMips.size());
+        std::vector<std::vector<uint8_t>> subresources;
+        subresources.reserve(size_t(mipLevels) * 6);
+        for (uint32_t face = 0; face < 6; face++)
+            for (uint32_t mipLevel = 0; mipLevel < mipLevels; mipLevel++)
+                subresources.push_back(EncodeFace(probe.specularMips[mipLevel], face));
+
+        std::shared_ptr<IBlob> dds = CreateDDSCubemapFromMemory(nvrhi::Format::RGBA16_FLOAT, probe.specularMips[0].size, mipLevels, subresources);
+        if (!dds)
+            return false;
+
+        IrradianceFileHeader header;
+        header.magic = c_IrradianceFileMagic;
+        header.version = c_CacheVersion;
+        for (int i = 0; i < SphericalHarmonicsL2::CoefficientCount; i++)
+        {
+            header.coefficients[i][0] = probe.diffuseIrradiance.coefficients[i].x;
+            header.coefficients[i][1] = probe.diffuseIrradiance.coefficients[i].y;
+            header.coefficients[i][2] = probe.diffuseIrradiance.coefficients[i].z;
+        }
+
+        // The specular file goes last, Load() needs both
+        return m_FS->writeFile(GetIrradiancePath(key), &header, sizeof(header))
+            && m_FS->writeFile(GetSpecularPath(key), dds->data(), dds->size());
+    }
+
+    std::vector<BakedLightProbe> LightProbeCache::BakeOrLoad(const std::vector<const CubemapImage*>& radiance,
+        const LightProbeBakeSettings& settings, tf::Executor* executor, size_t* pBakedCount) const
+    {
+        std::vector<BakedLightProbe> probes(radiance.size());
+        std::vector<uint64_t> keys(radiance.size());
+
+        ParallelFor(executor, radiance.size(), [&](size_t index)
+        {
+            keys[index] = ComputeKey(*radiance[index], settings);
+        });
+
+        // The file system is not required to be thread-safe
+        std::vector<const CubemapImage*> missing;
+        std::vector<size_t> missingIndices;
+        for (size_t index = 0; index < radiance.size(); index++)
+        {
+            if (Load(keys[index], probes[index]))
+                continue;
+
+            missing.push_back(radiance[index]);
+            missingIndices.push_back(index);
+        }
+
+        std::vector<BakedLightProbe> baked = BakeLightProbes(missing, settings, executor);
+        for (size_t i = 0; i < baked.size(); i++)
+        {
+            const size_t index = missingIndices[i];
+            if (!Store(keys[index], baked[i]))
+                log::warning("Couldn't store the baked light probe in '%s'", GetSpecularPath(keys[index]).generic_string().c_str());
+
+            probes[index] = std::move(baked[i]);
+        }
+
+        if (pBakedCount)
+            *pBakedCount = missing.size();
+
+        return probes;
+    }
+}
@@ -25,8 +25,16 @@
 using namespace donut::math;
 #include <donut/shaders/material_cb.h>
 
+#include <atomic>
+
 namespace donut::engine
 {
+    uint64_t Material::AllocateUniqueID()
+    {
+        static std::atomic<uint64_t> nextUniqueID = 1;
+        return nextUniqueID.fetch_add(1, std::memory_order_relaxed);
+    }
+
     static int GetBindlessTextureIndex(const std::shared_ptr<LoadedTexture>& texture)
     {
         return texture ? texture->bindlessDescriptor.Get() : -1;
@@ -23,8 +23,14 @@
 #include <donut/engine/MaterialBindingCache.h>
 #include <donut/core/log.h>
 
+#include <algorithm>
+
 using namespace donut::engine;
 
+// Lower bound on the number of slow-path lookups between two snapshot publications,
+// so that a handful of new materials does not copy a large map every time.
+static constexpr size_t c_MinSlowLookupsPerPublish = 16;
+
 MaterialBindingCache::MaterialBindingCache(
     nvrhi::IDevice* device, 
     nvrhi::ShaderType shaderType, 
@@ -39,7 +45,11 @@ MaterialBindingCache::MaterialBindingCache(
     , m_FallbackTexture(fallbackTexture)
     , m_Sampler(sampler)
     , m_TrackLiveness(trackLiveness)
+    , m_Snapshot(nullptr)
 {
+    m_Factory = [this](const Material& material) { return CreateMaterialBindingSet(&material); };
+    PublishSnapshot();
+
     nvrhi::BindingLayoutDesc layoutDesc;
     layoutDesc.visibility = shaderType;
     layoutDesc.registerSpace = registerSpace;
@@ -76,30 +86,153 @@ MaterialBindingCache::MaterialBindingCache(
     m_BindingLayout = m_Device->createBindingLayout(layoutDesc);
 }
 
+MaterialBindingCache::MaterialBindingCache(nvrhi::IBindingLayout* layout, BindingSetFactory factory)
+    : m_BindingLayout(layout)
+    , m_Factory(std::move(factory))
+    , m_Snapshot(nullptr)
+{
+    PublishSnapshot();
+}
+
 nvrhi::IBindingLayout* donut::engine::MaterialBindingCache::GetLayout() const
 {
     return m_BindingLayout;
 }
 
+bool MaterialBindingCache::HasPendingTextures(const Material& material)
+{
+    for (const auto* texture : {
+        &material.baseOrDiffuseTexture,
+        &material.metalRoughOrSpecularTexture,
+        &material.normalTexture,
+        &material.emissiveTexture,
+        &material.occlusionTexture,
+        &material.transmissionTexture })
+    {
+        if (*texture && !(*texture)->texture)
+            return true;
+    }
+
+    return false;
+}
+
+bool MaterialBindingCache::IsEntryCurrent(const Entry& entry, const Material& material)
+{
+    if (entry.version != material.version)
+        return false;
+
+    // The entry was built with fallback textures: rebuild it once the loads complete.
+    if (entry.texturesPending && !HasPendingTextures(material))
+        return false;
+
+    return true;
+}
+
 nvrhi::IBindingSet* donut::engine::MaterialBindingCache::GetMaterialBindingSet(const Material* material)
+{
+    if (!material)
+        return nullptr;
+
+    const Snapshot* snapshot = m_Snapshot.load(std::memory_order_acquire);
+
+    auto it = snapshot->entries.find(material->uniqueID);
+    if (it != snapshot->entries.end() && IsEntryCurrent(*it->second, *material))
+        return it->second->bindingSet;
+
+    return GetMaterialBindingSetSlow(material);
+}
+
+nvrhi::IBindingSet* MaterialBindingCache::GetMaterialBindingSetSlow(const Material* material)
 {
     std::lock_guard<std::mutex> lockGuard(m_Mutex);
 
-    nvrhi::BindingSetHandle& bindingSet = m_BindingSets[material];
+    ++m_SlowLookupsSincePublish;
+
+    // Another thread may have created the entry since the snapshot was published.
+    std::unique_ptr<Entry>& slot = m_Entries[material->uniqueID];
+    if (!slot || !IsEntryCurrent(*slot, *material))
+    {
+        auto entry = std::make_unique<Entry>();
+        entry->version = material->version;
+        entry->texturesPending = HasPendingTextures(*material);
+        entry->owner = material->weak_from_this();
+        entry->ownerTracked = !entry->owner.expired();
+        entry->bindingSet = m_Factory(*material);
+        ++m_BindingSetsCreated;
+
+        // Readers of the current snapshot may still use the old entry.
+        if (slot)
+            m_RetiredEntries.push_back(std::move(slot));
+
+        slot = std::move(entry);
+    }
 
-    if (bindingSet)
-        return bindingSet;
+    nvrhi::IBindingSet* bindingSet = slot->bindingSet;
 
-    bindingSet = CreateMaterialBindingSet(material);
+    if (m_SlowLookupsSincePublish >= std::max(c_MinSlowLookupsPerPublish, m_CurrentSnapshot->entries.size() / 2))
+        PublishSnapshot();
 
     return bindingSet;
 }
 
+void MaterialBindingCache::PublishSnapshot()
+{
+    auto snapshot = std::make_unique<Snapshot>();
+    snapshot->entries.reserve(m_Entries.size());
+    for (const auto& it : m_Entries)
+        snapshot->entries[it.first] = it.second.get();
+
+    m_Snapshot.store(snapshot.get(), std::memory_order_release);
+
+    if (m_CurrentSnapshot)
+        m_RetiredSnapshots.push_back(std::move(m_CurrentSnapshot));
+
+    m_CurrentSnapshot = std::move(snapshot);
+    m_SlowLookupsSincePublish = 0;
+}
+
+void MaterialBindingCache::ReleaseDestroyedMaterials()
+{
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    for (auto it = m_Entries.begin(); it != m_Entries.end(); )
+    {
+        if (it->second->ownerTracked && it->second->owner.expired())
+            it = m_Entries.erase(it);
+        else
+            ++it;
+    }
+
+    PublishSnapshot();
+
+    m_RetiredSnapshots.clear();
+    m_RetiredEntries.clear();
+}
+
 void donut::engine::MaterialBindingCache::Clear()
 {
     std::lock_guard<std::mutex> lockGuard(m_Mutex);
 
-    m_BindingSets.clear();
+    m_Entries.clear();
+
+    PublishSnapshot();
+
+    m_RetiredSnapshots.clear();
+    m_RetiredEntries.clear();
+}
+
+size_t MaterialBindingCache::GetEntryCount() const
+{
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    return m_Entries.size();
+}
+
+size_t MaterialBindingCache::GetBindingSetsCreated() const
+{
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+    return m_BindingSetsCreated;
 }
 
 nvrhi::BindingSetItem MaterialBindingCache::GetTextureBindingSetItem(uint32_t slot, const std::shared_ptr<LoadedTexture>& texture) const
@@ -35,10 +35,13 @@ this software is released into the Public Domain.
 */
 
 #include <donut/engine/Scene.h>
+#include <donut/engine/SceneLoader.h>
 #include <donut/engine/GltfImporter.h>
+#include <donut/engine/GpuProfiler.h>
 #include <donut/core/json.h>
 #include <donut/core/log.h>
 #include <donut/core/string_utils.h>
+#include <donut/core/vfs/VFS.h>
 #include <nvrhi/common/misc.h>
 #include <json/value.h>
 
@@ -71,6 +74,16 @@ struct Scene::Resources
     std::vector<InstanceData> instanceData;
 };
 
+const InstanceData* Scene::GetInstanceData() const
+{
+    return m_Resources->instanceData.data();
+}
+
+size_t Scene::GetInstanceDataCount() const
+{
+    return m_Resources->instanceData.size();
+}
+
 Scene::Scene(
     nvrhi::IDevice* device,
     ShaderFactory& shaderFactory,
@@ -163,18 +176,27 @@ bool Scene::LoadWithExecutor(const std::filesystem::path& sceneFileName, tf::Exe
 
         std::filesystem::path scenePath = sceneFileName.parent_path();
 
+        auto data = m_fs->readFile(sceneFileName);
+        if (!data)
+        {
+            log::error("Couldn't read file %s", sceneFileName.generic_string().c_str());
+            return false;
+        }
+
+        // The graph and animations are streamed into compact records,
+        // everything else is returned as documents.
+        SceneLoader loader(m_SceneGraph, m_SceneTypeFactory, m_fs, scenePath);
         Json::Value documentRoot;
-        if (!json::LoadFromFile(*m_fs, sceneFileName, documentRoot))
+        if (!loader.Parse(data, sceneFileName.generic_string(), documentRoot))
             return false;
 
         if (documentRoot.isObject())
         {
-            if (!LoadCustomData(documentRoot, executor))
+            if (!LoadCustomSections(documentRoot, executor))
                 return false;
 
             LoadModels(documentRoot["models"], scenePath, executor);
-            LoadSceneGraph(documentRoot["graph"], rootNode);
-            LoadAnimations(documentRoot["animations"]);
+            loader.Build(rootNode, m_Models, executor);
             LoadHelpers(documentRoot["helpers"]);
         }
         else
@@ -242,345 +264,16 @@ void Scene::LoadModels(
 #endif
 }
 
-void Scene::LoadSceneGraph(const Json::Value& nodeList, const std::shared_ptr<SceneGraphNode>& parent)
-{
-    for (const auto& src : nodeList)
-    {
-        if (!src.isObject())
-        {
-            log::warning("Non-object node in the scene graph definition.");
-            continue;
-        }
-
-        std::string nodeName;
-        const auto& name = src["name"];
-        if (name.isString())
-        {
-            nodeName = name.asString();
-        }
-
-        std::shared_ptr<SceneGraphNode> customParent = parent;
-        const auto& parentNode = src["parent"];
-        if (parentNode.isString())
-        {
-            customParent = m_SceneGraph->FindNode(parentNode.asString());
-            if (!customParent)
-            {
-                log::warning("Custom parent '%s' specified for node '%s' not found, skipping the node.",
-                    parentNode.asCString(), nodeName.c_str());
-                continue;
-            }
-        }
-        else if (!parentNode.isNull())
-        {
-            log::warning("Custom parent specification for node '%s' is not a string, ignoring.",
-                nodeName.c_str());
-        }
-
-        std::shared_ptr<SceneGraphNode> dst;
-
-        const auto& modelNode = src["model"];
-        if (!modelNode.isNull())
-        {
-            if (!modelNode.isIntegral())
-            {
-                log::warning("Model references in the scene graph must be indices into the model array.");
-                continue;
-            }
-
-            int modelIndex = modelNode.asInt();
-            if (modelIndex < 0 || modelIndex >= int(m_Models.size()))
-            {
-                log::warning("Referenced model %d is not defined in the model array.", modelIndex);
-                continue;
-            }
-
-            const auto& loadedModel = m_Models[modelIndex];
-            if (!loadedModel.rootNode)
-            {
-                continue;
-            }
-
-            dst = loadedModel.rootNode;
-        }
-        else
-        {
-            dst = std::make_shared<SceneGraphNode>();
-        }
-
-        dst = m_SceneGraph->Attach(customParent, dst);
-
-        dst->SetName(nodeName);
-        
-        const auto& translation = src["translation"];
-        if (!translation.isNull())
-        {
-            double3 value = double3::zero();
-            translation >> value;
-            dst->SetTranslation(value);
-        }
-
-        const auto& rotation = src["rotation"];
-        if (!rotation.isNull())
-        {
-            double4 value = double4(0.0, 0.0, 0.0, 1.0);
-            rotation >> value;
-            dst->SetRotation(dm::dquat::fromXYZW(value));
-        }
-        else
-        {
-            const auto& euler = src["euler"];
-            if (!euler.isNull())
-            {
-                double3 value = double3::zero();
-                euler >> value;
-                dst->SetRotation(rotationQuat(value));
-            }
-        }
-
-        const auto& scaling = src["scaling"];
-        if (!scaling.isNull())
-        {
-            double3 value = double3(1.0);
-            scaling >> value;
-            dst->SetScaling(value);
-        }
-
-        const auto& children = src["children"];
-        if (!children.isNull())
-        {
-            LoadSceneGraph(children, dst);
-        }
-
-        const auto& leafTypeNode = src["type"];
-        if (leafTypeNode.isString())
-        {
-            auto leaf = m_SceneTypeFactory->CreateLeaf(leafTypeNode.asString());
-            if (leaf)
-            {
-                dst->SetLeaf(leaf);
-                leaf->Load(src);
-            }
-            else
-            {
-                log::warning("Unknown leaf type '%s' for node '%s', skipping.",
-                    leafTypeNode.asCString(), dst->GetName().c_str());
-            }
-        }
-        else if (!leafTypeNode.isNull())
-        {
-            log::warning("Leaf type specification for node '%s' is not a string, skipping.",
-                dst->GetName().c_str());
-        }
-    }
-
-    parent->ReverseChildren();
-}
-
-static dm::float4 ReadUpToFloat4(const Json::Value& node)
+void Scene::LoadSceneGraph(const Json::Value& nodeList, const std::shared_ptr<SceneGraphNode>& parent, const std::filesystem::path& scenePath)
 {
-    if (node.isNumeric())
-        return dm::float4(node.asFloat());
-
-    if (node.isArray())
-    {
-        float4 result = float4::zero();
-        for (int i = 0; i < std::min(4, int(node.size())); i++)
-        {
-            result[i] = node[i].asFloat();
-        }
-        return result;
-    }
-
-    return float4::zero();
+    SceneLoader loader(m_SceneGraph, m_SceneTypeFactory, m_fs, scenePath);
+    loader.LoadSceneGraph(nodeList, parent, m_Models);
 }
 
 void Scene::LoadAnimations(const Json::Value& nodeList)
 {
-    std::shared_ptr<SceneGraphNode> animationContainer;
-
-    for (const auto& animationNode : nodeList)
-    {
-        const auto& animation = std::make_shared<SceneGraphAnimation>();
-
-        const auto& sceneAnimationNode = std::make_shared<SceneGraphNode>();
-        sceneAnimationNode->SetLeaf(animation);
-
-        const auto& nameNode = animationNode["name"];
-        if (nameNode.isString())
-        {
-            animation->SetName(nameNode.asString());
-        }
-
-        const auto& channelsNode = animationNode["channels"];
-        if (channelsNode.isArray())
-        {
-            int channelIndex = -1;
-            for (const auto& channelSrc : channelsNode)
-            {
-                // Increment the index in the beginning because there are 'continue' statements below
-                ++channelIndex;
-
-                const auto& sampler = std::make_shared<animation::Sampler>();
-
-                const auto& modeNode = channelSrc["mode"];
-                if (modeNode.isString())
-                {
-                    if (modeNode.asString() == "step")
-                        sampler->SetInterpolationMode(animation::InterpolationMode::Step);
-                    else if (modeNode.asString() == "linear")
-                        sampler->SetInterpolationMode(animation::InterpolationMode::Linear);
-                    else if (modeNode.asString() == "slerp")
-                        sampler->SetInterpolationMode(animation::InterpolationMode::Slerp);
-                    else if (modeNode.asString() == "hermite")
-                        sampler->SetInterpolationMode(animation::InterpolationMode::HermiteSpline);
-                    else if (modeNode.asString() == "catmull-rom")
-                        sampler->SetInterpolationMode(animation::InterpolationMode::CatmullRomSpline);
-                    else
-                        log::warning("Unknown interpolation mode '%s' specified for animation '%s' channel %d. "
-                            "Valid interpolation modes are: step, linear, hermite, catmull-rom.",
-                            modeNode.asCString(), animation->GetName().c_str(), channelIndex);
-                }
-                else
-                {
-                    sampler->SetInterpolationMode(animation::InterpolationMode::Step);
-                    log::warning("Interpolation mode is not specified for animation '%s' channel %d, using step.",
-                        animation->GetName().c_str(), channelIndex);
-                }
-
-                const auto& attributeNode = channelSrc["attribute"];
-                AnimationAttribute attribute = AnimationAttribute::Undefined;
-                if (attributeNode.isString() && !attributeNode.asString().empty())
-                {
-                    if (attributeNode.asString() == "translation")
-                        attribute = AnimationAttribute::Translation;
-                    else if (attributeNode.asString() == "rotation")
-                        attribute = AnimationAttribute::Rotation;
-                    else if (attributeNode.asString() == "scaling")
-                        attribute = AnimationAttribute::Scaling;
-                    else
-                        attribute = AnimationAttribute::LeafProperty;
-                }
-                else
-                {
-                    log::warning("Attribute is not specified for animation '%s' channel %d, ignoring.",
-                        animation->GetName().c_str(), channelIndex);
-                    continue;
-                }
-
-                int keyframeIndex = -1;
-                for (const auto& dataPoint : channelSrc["data"])
-                {
-                    ++keyframeIndex;
-
-                    const auto& timeNode = dataPoint["time"];
-                    if (!timeNode.isNumeric())
-                    {
-                        log::warning("Invalid keyframe %d in animation '%s' channel %d: time is not specified or is not numeric.",
-                            keyframeIndex, animation->GetName().c_str(), channelIndex);
-                        continue;
-                    }
-
-                    animation::Keyframe keyframe;
-                    keyframe.time = timeNode.asFloat();
-                    keyframe.value = ReadUpToFloat4(dataPoint["value"]);
-                    keyframe.inTangent = ReadUpToFloat4(dataPoint["inTangent"]);
-                    keyframe.outTangent = ReadUpToFloat4(dataPoint["outTangent"]);
-
-                    sampler->AddKeyframe(keyframe);
-                }
-
-                auto processTargetNode = [this, &animation, &sampler, attribute, &attributeNode, channelIndex](const Json::Value& targetNode)
-                {
-                    if (targetNode.isString())
-                    {
-                        std::string targetName = targetNode.asString();
-                        if (donut::string_utils::starts_with(targetName, "material:"))
-                        {
-                            targetName = targetName.substr(9);
-
-                            std::shared_ptr<Material> material;
-                            for (const auto& it : m_SceneGraph->GetMaterials())
-                            {
-                                if (it->name == targetName)
-                                {
-                                    material = it;
-                                    break;
-                                }
-                            }
-
-                            if (material)
-                            {
-                                const auto& channel = std::make_shared<SceneGraphAnimationChannel>(sampler, material);
-                                channel->SetLeafProperyName(attributeNode.asString());
-                                animation->AddChannel(channel);
-                            }
-                            else
-                            {
-                                log::warning("Target material '%s' specified for animation '%s' channel %d not found, ignoring.",
-                                    std::string(targetName).c_str(), animation->GetName().c_str(), channelIndex);
-                            }
-                        }
-                        else
-                        {
-                            const auto& target = m_SceneGraph->FindNode(targetNode.asString());
-                            if (target)
-                            {
-                                const auto& channel = std::make_shared<SceneGraphAnimationChannel>(sampler, target, attribute);
-                                if (attribute == AnimationAttribute::LeafProperty)
-                                    channel->SetLeafProperyName(attributeNode.asString());
-                                animation->AddChannel(channel);
-                            }
-                            else
-                            {
-                                log::warning("Target node '%s' specified for animation '%s' channel %d not found, ignoring.",
-                                    targetNode.asCString(), animation->GetName().c_str(), channelIndex);
-                            }
-                        }
-                    }
-                    else if (!targetNode.isNull())
-                    {
-                        log::warning("Target node specification for animation '%s' channel %d is not a string, ignoring.",
-                            animation->GetName().c_str(), channelIndex);
-                    }
-                };
-
-                const auto& targetNode = channelSrc["target"];
-                if (!targetNode.isNull())
-                {
-                    processTargetNode(targetNode);
-                }
-                else
-                {
-                    const auto& targetsNode = channelSrc["targets"];
-                    if (targetsNode.isArray())
-                    {
-                        for (const auto& targetArrayItem : targetsNode)
-                        {
-                            processTargetNode(targetArrayItem);
-                        }
-                    }
-                }
-            }
-        }
-
-        if (!animation->GetChannels().empty())
-        {
-            if (!animationContainer)
-            {
-                animationContainer = std::make_shared<SceneGraphNode>();
-                animationContainer->SetName("Animations");
-                m_SceneGraph->Attach(m_SceneGraph->GetRootNode(), animationContainer);
-            }
-            
-            m_SceneGraph->Attach(animationContainer, sceneAnimationNode);
-        }
-        else
-        {
-            log::warning("Animation '%s' processed with no valid channels, ignoring.",
-                animation->GetName().c_str());
-        }
-    }
+    SceneLoader loader(m_SceneGraph, m_SceneTypeFactory, m_fs, std::filesystem::path());
+    loader.LoadAnimations(nodeList);
 }
 
 void Scene::LoadHelpers(const Json::Value& nodeList) const
@@ -604,12 +297,17 @@ void Scene::LoadHelpers(const Json::Value& nodeList) const
     }
 }
 
-bool Scene::LoadCustomData(Json::Value& rootNode, tf::Executor* executor)
+bool Scene::LoadCustomSections(Json::Value& /*sections*/, tf::Executor* /*executor*/)
 {
     // Reserved for derived classes
     return true;
 }
 
+bool Scene::LoadCustomData(Json::Value& rootNode, tf::Executor* executor)
+{
+    return LoadCustomSections(rootNode, executor);
+}
+
 void Scene::FinishedLoading(uint32_t frameIndex, bool allocateSharedAcrossDevicesBufferForMeshes)
 {
     nvrhi::CommandListHandle commandList = m_Device->createCommandList();
@@ -654,9 +352,9 @@ void Scene::RefreshBuffers(nvrhi::ICommandList* commandList, uint32_t frameIndex
         arraysAllocated = true;
     }
 
-    if (m_SceneGraph->GetMeshInstances().size() > m_Resources->instanceData.size())
+    if (m_SceneGraph->GetInstanceDataCount() > m_Resources->instanceData.size())
     {
-        m_Resources->instanceData.resize(nvrhi::align<size_t>(m_SceneGraph->GetMeshInstances().size(), allocationGranularity));
+        m_Resources->instanceData.resize(nvrhi::align<size_t>(m_SceneGraph->GetInstanceDataCount(), allocationGranularity));
         m_InstanceBuffer = CreateInstanceBuffer();
         arraysAllocated = true;
     }
@@ -670,6 +368,7 @@ void Scene::RefreshBuffers(nvrhi::ICommandList* commandList, uint32_t frameIndex
         {
             material->materialConstants = CreateMaterialConstantBuffer(material->name);
             material->dirty = true;
+            ++material->version;
         }
 
         if (material->dirty)
@@ -729,13 +428,13 @@ void Scene::UpdateSkinnedMeshes(nvrhi::ICommandList* commandList, uint32_t frame
 
         if (!skinningMarkerPlaced)
         {
-            commandList->beginMarker("Skinning");
+            BeginMarker(commandList, "Skinning");
             skinningMarkerPlaced = true;
         }
 
         const auto& groupName = skinnedInstance->GetName();
         if (!groupName.empty())
-            commandList->beginMarker(groupName.c_str());
+            BeginMarker(commandList, groupName.c_str());
 
         jointMatrices.resize(skinnedInstance->joints.size());
         dm::daffine3 worldToRoot = inverse(skinnedInstance->GetNode()->GetLocalToWorldTransform());
@@ -787,12 +486,12 @@ void Scene::UpdateSkinnedMeshes(nvrhi::ICommandList* commandList, uint32_t frame
         commandList->dispatch(dm::div_ceil(constants.numVertices, 256));
 
         if (!groupName.empty())
-            commandList->endMarker();
+            EndMarker(commandList);
     }
 
     if (skinningMarkerPlaced)
     {
-        commandList->endMarker();
+        EndMarker(commandList);
     }
 }
 
@@ -1209,6 +908,16 @@ void Scene::UpdateInstance(const std::shared_ptr<MeshInstance>& instance)
     if (!node)
         return;
 
+    if (auto instanceArray = dynamic_cast<MeshInstanceArray*>(instance.get()))
+    {
+        if (instanceArray->GetInstanceCount() > 0)
+        {
+            instanceArray->FillInstanceData(&m_Resources->instanceData[instance->GetInstanceIndex()],
+                node->GetLocalToWorldTransformFloat(), node->GetPrevLocalToWorldTransformFloat());
+        }
+        return;
+    }
+
     InstanceData& idata = m_Resources->instanceData[instance->GetInstanceIndex()];
     affineToColumnMajor(node->GetLocalToWorldTransformFloat(), idata.transform);
     affineToColumnMajor(node->GetPrevLocalToWorldTransformFloat(), idata.prevTransform);
@@ -1216,5 +925,6 @@ void Scene::UpdateInstance(const std::shared_ptr<MeshInstance>& instance)
     const auto& mesh = instance->GetMesh();
     idata.firstGeometryIndex = mesh->geometries[0]->globalGeometryIndex;
     idata.numGeometries = uint32_t(mesh->geometries.size());
+    idata.customData = 0u;
     idata.padding = 0u;
 }
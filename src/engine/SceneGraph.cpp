@@ -23,8 +23,15 @@
 #include <donut/engine/SceneGraph.h>
 #include <donut/core/log.h>
 #include <donut/core/json.h>
+#include <donut/core/vfs/VFS.h>
+#include <algorithm>
+#include <cstring>
+#include <numeric>
 #include <sstream>
 
+using namespace donut::math;
+#include <donut/shaders/bindless.h>
+
 using namespace donut::engine;
 
 const std::string& SceneGraphLeaf::GetName() const
@@ -129,6 +136,327 @@ bool MeshInstance::SetProperty(const std::string& name, const dm::float4& value)
     return SceneGraphLeaf::SetProperty(name, value);
 }
 
+bool MeshInstanceArray::SetMesh(std::shared_ptr<MeshInfo> mesh)
+{
+    if (GetNode())
+    {
+        log::error("Cannot change the mesh of an instance array that is attached to a node.");
+        return false;
+    }
+
+    m_Mesh = std::move(mesh);
+    BuildCells();
+    return true;
+}
+
+void MeshInstanceArray::SetInstances(std::vector<dm::affine3> transforms, std::vector<uint32_t> customData)
+{
+    if (!customData.empty() && customData.size() != transforms.size())
+    {
+        log::warning("Instance array: got %d custom values for %d instances, ignoring the custom data.",
+            int(customData.size()), int(transforms.size()));
+        customData.clear();
+    }
+
+    m_Transforms = std::move(transforms);
+    m_CustomData = std::move(customData);
+
+    BuildCells();
+    InvalidateNode();
+}
+
+void MeshInstanceArray::SetMaxInstancesPerCell(uint32_t count)
+{
+    count = std::max(count, 1u);
+    if (count == m_MaxInstancesPerCell)
+        return;
+
+    m_MaxInstancesPerCell = count;
+
+    BuildCells();
+    InvalidateNode();
+}
+
+void MeshInstanceArray::InvalidateNode() const
+{
+    // The instance count and the bounds affect instance indices and bounding boxes of the whole graph,
+    // which are only recomputed on structure changes.
+    if (SceneGraphNode* node = GetNode())
+        node->PropagateDirtyFlags(SceneGraphNode::DirtyFlags::SubgraphStructure);
+}
+
+void MeshInstanceArray::BuildCells()
+{
+    m_Cells.clear();
+    m_Bounds = box3::empty();
+
+    const uint32_t instanceCount = uint32_t(m_Transforms.size());
+    if (instanceCount == 0)
+        return;
+
+    // Split the instances along the longest axis of their positions until every range fits into a cell.
+    // Left halves are processed first, so the cells come out in order of their first instance.
+
+    std::vector<uint32_t> order(instanceCount);
+    std::iota(order.begin(), order.end(), 0u);
+
+    struct Range
+    {
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    std::vector<Range> stack;
+    stack.push_back({ 0, instanceCount });
+
+    while (!stack.empty())
+    {
+        Range range = stack.back();
+        stack.pop_back();
+
+        if (range.end - range.begin <= m_MaxInstancesPerCell)
+        {
+            InstanceArrayCell cell;
+            cell.firstInstance = range.begin;
+            cell.instanceCount = range.end - range.begin;
+            m_Cells.push_back(cell);
+            continue;
+        }
+
+        box3 centers = box3::empty();
+        for (uint32_t i = range.begin; i < range.end; i++)
+            centers |= m_Transforms[order[i]].m_translation;
+
+        float3 extent = centers.diagonal();
+        int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z) ? 1 : 2;
+
+        uint32_t middle = range.begin + (range.end - range.begin) / 2;
+        std::nth_element(order.begin() + range.begin, order.begin() + middle, order.begin() + range.end,
+            [this, axis](uint32_t a, uint32_t b) { return m_Transforms[a].m_translation[axis] < m_Transforms[b].m_translation[axis]; });
+
+        stack.push_back({ middle, range.end });
+        stack.push_back({ range.begin, middle });
+    }
+
+    std::vector<affine3> transforms(instanceCount);
+    for (uint32_t i = 0; i < instanceCount; i++)
+        transforms[i] = m_Transforms[order[i]];
+    m_Transforms = std::move(transforms);
+
+    if (!m_CustomData.empty())
+    {
+        std::vector<uint32_t> customData(instanceCount);
+        for (uint32_t i = 0; i < instanceCount; i++)
+            customData[i] = m_CustomData[order[i]];
+        m_CustomData = std::move(customData);
+    }
+
+    const box3 meshBounds = m_Mesh ? m_Mesh->objectSpaceBounds : box3(float3(0.f), float3(0.f));
+
+    for (auto& cell : m_Cells)
+    {
+        for (uint32_t i = cell.firstInstance; i < cell.firstInstance + cell.instanceCount; i++)
+            cell.bounds |= meshBounds * m_Transforms[i];
+
+        m_Bounds |= cell.bounds;
+    }
+}
+
+void MeshInstanceArray::GetVisibleCells(const dm::frustum& frustum, const dm::affine3& localToWorld, std::vector<uint32_t>& cellIndices) const
+{
+    for (uint32_t cellIndex = 0; cellIndex < uint32_t(m_Cells.size()); cellIndex++)
+    {
+        if (frustum.intersectsWith(m_Cells[cellIndex].bounds * localToWorld))
+            cellIndices.push_back(cellIndex);
+    }
+}
+
+void MeshInstanceArray::FillInstanceData(InstanceData* dst, const dm::affine3& localToWorld, const dm::affine3& prevLocalToWorld) const
+{
+    const uint32_t firstGeometryIndex = m_Mesh->geometries[0]->globalGeometryIndex;
+    const uint32_t numGeometries = uint32_t(m_Mesh->geometries.size());
+
+    for (size_t i = 0; i < m_Transforms.size(); i++)
+    {
+        InstanceData& idata = dst[i];
+        affineToColumnMajor(m_Transforms[i] * localToWorld, idata.transform);
+        affineToColumnMajor(m_Transforms[i] * prevLocalToWorld, idata.prevTransform);
+        idata.firstGeometryIndex = firstGeometryIndex;
+        idata.numGeometries = numGeometries;
+        idata.customData = m_CustomData.empty() ? 0u : m_CustomData[i];
+        idata.padding = 0u;
+    }
+}
+
+// Binary instance array layout, little-endian:
+//   InstanceArrayFileHeader
+//   instanceCount transforms, 12 floats each: the 3x3 linear part in row-major order followed by the translation
+//   instanceCount uint32 custom values, if c_InstanceArrayHasCustomData is set
+struct InstanceArrayFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t instanceCount;
+    uint32_t flags;
+};
+
+static constexpr uint32_t c_InstanceArrayMagic = 0x41494E44; // "DNIA"
+static constexpr uint32_t c_InstanceArrayVersion = 1;
+static constexpr uint32_t c_InstanceArrayHasCustomData = 0x01;
+
+static_assert(sizeof(affine3) == 12 * sizeof(float), "The binary instance array format stores affine3 as is");
+
+bool MeshInstanceArray::LoadBinary(const donut::vfs::IBlob& blob)
+{
+    InstanceArrayFileHeader header{};
+    if (blob.size() < sizeof(header))
+    {
+        log::error("Instance array data is too small (%d bytes).", int(blob.size()));
+        return false;
+    }
+
+    const uint8_t* data = static_cast<const uint8_t*>(blob.data());
+    memcpy(&header, data, sizeof(header));
+
+    if (header.magic != c_InstanceArrayMagic || header.version != c_InstanceArrayVersion)
+    {
+        log::error("Unrecognized instance array data (magic 0x%08x, version %u).", header.magic, header.version);
+        return false;
+    }
+
+    const bool hasCustomData = (header.flags & c_InstanceArrayHasCustomData) != 0;
+    const size_t transformBytes = size_t(header.instanceCount) * sizeof(affine3);
+    const size_t customDataBytes = hasCustomData ? size_t(header.instanceCount) * sizeof(uint32_t) : 0;
+
+    if (blob.size() < sizeof(header) + transformBytes + customDataBytes)
+    {
+        log::error("Instance array data is truncated: %u instances need %d bytes, got %d.", header.instanceCount,
+            int(sizeof(header) + transformBytes + customDataBytes), int(blob.size()));
+        return false;
+    }
+
+    std::vector<affine3> transforms(header.instanceCount);
+    memcpy(transforms.data(), data + sizeof(header), transformBytes);
+
+    std::vector<uint32_t> customData;
+    if (hasCustomData)
+    {
+        customData.resize(header.instanceCount);
+        memcpy(customData.data(), data + sizeof(header) + transformBytes, customDataBytes);
+    }
+
+    SetInstances(std::move(transforms), std::move(customData));
+    return true;
+}
+
+std::shared_ptr<donut::vfs::IBlob> MeshInstanceArray::SaveBinary() const
+{
+    InstanceArrayFileHeader header{};
+    header.magic = c_InstanceArrayMagic;
+    header.version = c_InstanceArrayVersion;
+    header.instanceCount = uint32_t(m_Transforms.size());
+    header.flags = m_CustomData.empty() ? 0 : c_InstanceArrayHasCustomData;
+
+    const size_t transformBytes = m_Transforms.size() * sizeof(affine3);
+    const size_t customDataBytes = m_CustomData.size() * sizeof(uint32_t);
+    const size_t size = sizeof(header) + transformBytes + customDataBytes;
+
+    uint8_t* data = static_cast<uint8_t*>(malloc(size));
+    if (!data)
+        return nullptr;
+
+    memcpy(data, &header, sizeof(header));
+    memcpy(data + sizeof(header), m_Transforms.data(), transformBytes);
+    memcpy(data + sizeof(header) + transformBytes, m_CustomData.data(), customDataBytes);
+
+    return std::make_shared<donut::vfs::Blob>(data, size);
+}
+
+std::shared_ptr<SceneGraphLeaf> MeshInstanceArray::Clone()
+{
+    auto copy = std::make_shared<MeshInstanceArray>(m_Mesh);
+    copy->m_Transforms = m_Transforms;
+    copy->m_CustomData = m_CustomData;
+    copy->m_Cells = m_Cells;
+    copy->m_Bounds = m_Bounds;
+    copy->m_MaxInstancesPerCell = m_MaxInstancesPerCell;
+    return std::static_pointer_cast<SceneGraphLeaf>(copy);
+}
+
+void MeshInstanceArray::Load(const Json::Value& node)
+{
+    uint32_t maxInstancesPerCell = m_MaxInstancesPerCell;
+    node["maxInstancesPerCell"] >> maxInstancesPerCell;
+    m_MaxInstancesPerCell = std::max(maxInstancesPerCell, 1u);
+
+    const auto& instances = node["instances"];
+    if (!instances.isArray())
+    {
+        BuildCells();
+        InvalidateNode();
+        return;
+    }
+
+    std::vector<affine3> transforms;
+    std::vector<uint32_t> customData;
+    transforms.reserve(instances.size());
+    customData.reserve(instances.size());
+    bool hasCustomData = false;
+
+    for (const auto& instance : instances)
+    {
+        // Either a bare [x, y, z] position or an object with the same fields as a scene graph node
+        float3 translation = 0.f;
+        quat rotation = quat::identity();
+        float3 scale = 1.f;
+        uint32_t custom = 0;
+
+        if (instance.isArray())
+        {
+            instance >> translation;
+        }
+        else
+        {
+            instance["translation"] >> translation;
+            instance["scaling"] >> scale;
+
+            const auto& rotationNode = instance["rotation"];
+            const auto& eulerNode = instance["euler"];
+            if (!rotationNode.isNull())
+            {
+                float4 value = float4(0.f, 0.f, 0.f, 1.f);
+                rotationNode >> value;
+                rotation = quat::fromXYZW(value);
+            }
+            else if (!eulerNode.isNull())
+            {
+                float3 value = 0.f;
+                eulerNode >> value;
+                rotation = rotationQuat(value);
+            }
+
+            const auto& customNode = instance["customData"];
+            if (!customNode.isNull())
+            {
+                customNode >> custom;
+                hasCustomData = true;
+            }
+        }
+
+        affine3 transform = scaling(scale);
+        transform *= rotation.toAffine();
+        transform *= dm::translation(translation);
+
+        transforms.push_back(transform);
+        customData.push_back(custom);
+    }
+
+    if (!hasCustomData)
+        customData.clear();
+
+    SetInstances(std::move(transforms), std::move(customData));
+}
+
 dm::affine3 SceneCamera::GetViewToWorldMatrix() const
 {
     auto node = GetNode();
@@ -326,7 +654,17 @@ void SceneGraphNode::SetLeaf(const std::shared_ptr<SceneGraphLeaf>& leaf)
 
 void SceneGraphNode::SetName(const std::string& name)
 {
+    if (m_Name == name)
+        return;
+
+    // the parent's index refers to the name storage, so drop the entry before changing it
+    if (m_Parent)
+        m_Parent->UnindexChild(this);
+
     m_Name = name;
+
+    if (m_Parent)
+        m_Parent->IndexChild(this);
 }
 
 void SceneGraphNode::ReverseChildren()
@@ -335,10 +673,29 @@ void SceneGraphNode::ReverseChildren()
     std::shared_ptr<SceneGraphNode> current, prev, next;
     current = m_FirstChild;
 
+    // the children are visited in their old order, so prepending each one to its name list
+    // and numbering them downwards leaves both in the new order
+    m_ChildIndex.clear();
+    int64_t order = 0;
+
     while (current)
     {
         next = current->m_NextSibling;
         current->m_NextSibling = prev;
+        current->m_SiblingOrder = order--;
+
+        SceneGraphNode* child = current.get();
+        child->m_PrevSameName = nullptr;
+        child->m_NextSameName = nullptr;
+        auto [it, inserted] = m_ChildIndex.try_emplace(child->m_Name, child);
+        if (!inserted)
+        {
+            child->m_NextSameName = it->second;
+            it->second->m_PrevSameName = child;
+            m_ChildIndex.erase(it);
+            m_ChildIndex.emplace(child->m_Name, child);
+        }
+
         prev = current;
         current = next;
     }
@@ -346,6 +703,92 @@ void SceneGraphNode::ReverseChildren()
     m_FirstChild = prev;
 }
 
+SceneGraphNode* SceneGraphNode::FindChild(std::string_view name) const
+{
+    auto it = m_ChildIndex.find(name);
+    return (it != m_ChildIndex.end()) ? it->second : nullptr;
+}
+
+void SceneGraphNode::LinkChild(const std::shared_ptr<SceneGraphNode>& child)
+{
+    child->m_Parent = this;
+    child->m_SiblingOrder = m_FirstChild ? m_FirstChild->m_SiblingOrder - 1 : 0;
+    child->m_NextSibling = m_FirstChild;
+    m_FirstChild = child;
+
+    // new children are inserted at the front, so they go first in the list of children with their name
+    IndexChild(child.get());
+}
+
+void SceneGraphNode::UnlinkChild(SceneGraphNode* child)
+{
+    std::shared_ptr<SceneGraphNode>* sibling = &m_FirstChild;
+    while (*sibling && sibling->get() != child)
+        sibling = &(*sibling)->m_NextSibling;
+
+    if (!*sibling)
+        return;
+
+    UnindexChild(child);
+    *sibling = child->m_NextSibling;
+}
+
+void SceneGraphNode::IndexChild(SceneGraphNode* child)
+{
+    auto [it, inserted] = m_ChildIndex.try_emplace(child->m_Name, child);
+    if (inserted)
+        return;
+
+    SceneGraphNode* first = it->second;
+    if (child->m_SiblingOrder < first->m_SiblingOrder)
+    {
+        child->m_NextSameName = first;
+        first->m_PrevSameName = child;
+
+        // the key must refer to the name of the child that the entry points to
+        m_ChildIndex.erase(it);
+        m_ChildIndex.emplace(child->m_Name, child);
+        return;
+    }
+
+    // only the children with the same name are visited
+    SceneGraphNode* prev = first;
+    while (prev->m_NextSameName && prev->m_NextSameName->m_SiblingOrder < child->m_SiblingOrder)
+        prev = prev->m_NextSameName;
+
+    child->m_PrevSameName = prev;
+    child->m_NextSameName = prev->m_NextSameName;
+    if (prev->m_NextSameName)
+        prev->m_NextSameName->m_PrevSameName = child;
+    prev->m_NextSameName = child;
+}
+
+void SceneGraphNode::UnindexChild(SceneGraphNode* child)
+{
+    SceneGraphNode* prev = child->m_PrevSameName;
+    SceneGraphNode* next = child->m_NextSameName;
+    child->m_PrevSameName = nullptr;
+    child->m_NextSameName = nullptr;
+
+    if (next)
+        next->m_PrevSameName = prev;
+
+    if (prev)
+    {
+        prev->m_NextSameName = next;
+        return;
+    }
+
+    // the child was the first one with its name, promote the next one if there is any
+    auto it = m_ChildIndex.find(child->m_Name);
+    if (it == m_ChildIndex.end() || it->second != child)
+        return;
+
+    m_ChildIndex.erase(it);
+    if (next)
+        m_ChildIndex.emplace(next->m_Name, next);
+}
+
 int SceneGraphWalker::Next(bool allowChildren)
 {
     if (!m_Current)
@@ -689,9 +1132,7 @@ std::shared_ptr<SceneGraphNode> SceneGraph::Attach(const std::shared_ptr<SceneGr
         // operating on an orphaned subgraph - do not copy or register anything
 
         assert(parent);
-        child->m_NextSibling = parent->m_FirstChild;
-        child->m_Parent = parent.get();
-        parent->m_FirstChild = child;
+        parent->LinkChild(child);
         return child;
     }
 
@@ -733,8 +1174,7 @@ std::shared_ptr<SceneGraphNode> SceneGraph::Attach(const std::shared_ptr<SceneGr
             // attach the copy to the new parent
             if (currentParent)
             {
-                copy->m_NextSibling = currentParent->m_FirstChild;
-                currentParent->m_FirstChild = copy;
+                currentParent->LinkChild(copy);
             }
             else
             {
@@ -823,15 +1263,13 @@ std::shared_ptr<SceneGraphNode> SceneGraph::Attach(const std::shared_ptr<SceneGr
             walker.Next(true);
         }
 
-        child->m_Parent = parent.get();
-
         if (parent)
         {
-            child->m_NextSibling = parent->m_FirstChild;
-            parent->m_FirstChild = child;
+            parent->LinkChild(child);
         }
         else
         {
+            child->m_Parent = nullptr;
             m_Root = child;
         }
 
@@ -878,12 +1316,7 @@ std::shared_ptr<SceneGraphNode> SceneGraph::Detach(const std::shared_ptr<SceneGr
     if (node->m_Parent)
     {
         node->m_Parent->PropagateDirtyFlags(SceneGraphNode::DirtyFlags::SubgraphStructure);
-
-        std::shared_ptr<SceneGraphNode>* sibling = &node->m_Parent->m_FirstChild;
-        while (*sibling && *sibling != node)
-            sibling = &(*sibling)->m_NextSibling;
-        if (*sibling)
-            *sibling = node->m_NextSibling;
+        node->m_Parent->UnlinkChild(node.get());
     }
 
     node->m_Parent = nullptr;
@@ -898,17 +1331,16 @@ std::shared_ptr<SceneGraphNode> SceneGraph::Detach(const std::shared_ptr<SceneGr
     return node;
 }
 
-std::shared_ptr<SceneGraphNode> SceneGraph::FindNode(const std::filesystem::path& path, SceneGraphNode* context) const
+std::shared_ptr<SceneGraphNode> SceneGraph::FindNode(std::string_view path, SceneGraphNode* context) const
 {
-    auto pathComponent = path.begin();
-
-    if (pathComponent == path.end())
+    if (path.empty())
         return nullptr;
 
-    if (*pathComponent == "/")
+    size_t pos = 0;
+    if (path[0] == '/')
     {
         context = m_Root.get();
-        ++pathComponent;
+        pos = std::min(path.find_first_not_of('/'), path.size());
     }
 
     if (!context)
@@ -918,34 +1350,31 @@ std::shared_ptr<SceneGraphNode> SceneGraph::FindNode(const std::filesystem::path
     }
 
     SceneGraphNode* current = context;
-    
-    while (current && pathComponent != path.end())
-    {
-        if (*pathComponent == "..")
-        {
-            current = current->GetParent();
-            ++pathComponent;
-            continue;
-        }
 
-        SceneGraphNode* child;
-        for (child = current->GetFirstChild(); child; child = child->GetNextSibling())
-        {
-            if (child->GetName() == *pathComponent)
-                break;
-        }
+    // A trailing separator produces one empty component, same as std::filesystem::path iteration.
+    bool lastComponent = (pos == path.size());
+    while (current && !lastComponent)
+    {
+        size_t end = path.find('/', pos);
+        std::string_view component = path.substr(pos, end - pos);
 
-        if (child)
-        {
-            current = child;
-            ++pathComponent;
-            continue;
-        }
+        if (end == std::string_view::npos)
+            lastComponent = true;
+        else
+            pos = std::min(path.find_first_not_of('/', end), path.size());
 
-        return nullptr;
+        if (component == "..")
+            current = current->GetParent();
+        else
+            current = current->FindChild(component);
     }
 
-    return current->shared_from_this();
+    return current ? current->shared_from_this() : nullptr;
+}
+
+std::shared_ptr<SceneGraphNode> SceneGraph::FindNode(const std::filesystem::path& path, SceneGraphNode* context) const
+{
+    return FindNode(std::string_view(path.generic_string()), context);
 }
 
 void SceneGraph::Refresh(uint32_t frameIndex)
@@ -957,6 +1386,11 @@ void SceneGraph::Refresh(uint32_t frameIndex)
     };
 
     bool structureDirty = HasPendingStructureChanges();
+    if (structureDirty)
+        ++m_StructureVersion;
+
+    // nodes whose bounding box is recomputed below get a new bounds version
+    const uint32_t boundsVersion = ++m_RefreshCount;
 
     StackItem context;
     std::vector<StackItem> stack;
@@ -997,6 +1431,7 @@ void SceneGraph::Refresh(uint32_t frameIndex)
         if ((current->m_Dirty & (SceneGraphNode::DirtyFlags::SubgraphStructure | SceneGraphNode::DirtyFlags::SubgraphTransforms)) != 0 || context.supergraphTransformUpdated)
         {
             current->m_GlobalBoundingBox = dm::box3::empty();
+            current->m_BoundsVersion = boundsVersion;
             if (current->m_Leaf)
             {
                 dm::box3 localBoundingBox = current->m_Leaf->GetLocalBoundingBox();
@@ -1092,31 +1527,68 @@ void SceneGraph::Refresh(uint32_t frameIndex)
         for (const auto& instance : m_MeshInstances)
         {
             instance->m_InstanceIndex = instanceIndex;
-            ++instanceIndex;
+            instanceIndex += int(instance->GetInstanceCount());
+        }
+        m_InstanceDataCount = size_t(instanceIndex);
+
+        // Number meshes, geometries, buffer groups and materials in the order of their first use by the
+        // mesh instances, so that the indices don't depend on the iteration order of the trackers,
+        // which is based on pointers and changes from run to run.
+
+        for (const auto& mesh : m_Meshes)
+        {
+            mesh->globalMeshIndex = -1;
+            if (mesh->buffers)
+                mesh->buffers->globalBufferGroupIndex = -1;
         }
 
+        for (const auto& material : m_Materials)
+            material->materialID = -1;
+
         int meshIndex = 0;
         int geometryIndex = 0;
-        for (const auto& mesh : m_Meshes)
+        int bufferGroupIndex = 0;
+        int materialIndex = 0;
+
+        auto assignMeshIndices = [&meshIndex, &geometryIndex, &bufferGroupIndex, &materialIndex](MeshInfo* mesh)
         {
+            if (!mesh || mesh->globalMeshIndex >= 0)
+                return;
+
+            mesh->globalMeshIndex = meshIndex;
+            ++meshIndex;
+
             for (const auto& geometry : mesh->geometries)
             {
                 geometry->globalGeometryIndex = geometryIndex;
                 ++geometryIndex;
-            }
 
-            mesh->globalMeshIndex = meshIndex;
-            ++meshIndex;
-        }
+                if (geometry->material && geometry->material->materialID < 0)
+                {
+                    geometry->material->materialID = materialIndex;
+                    ++materialIndex;
+                }
+            }
 
-        assert(m_GeometryCount == geometryIndex);
+            if (mesh->buffers && mesh->buffers->globalBufferGroupIndex < 0)
+            {
+                mesh->buffers->globalBufferGroupIndex = bufferGroupIndex;
+                ++bufferGroupIndex;
+            }
+        };
 
-        int materialIndex = 0;
-        for (const auto& material : m_Materials)
+        for (const auto& instance : m_MeshInstances)
         {
-            material->materialID = materialIndex;
-            ++materialIndex;
+            const auto& mesh = instance->GetMesh();
+            if (!mesh)
+                continue;
+
+            assignMeshIndices(mesh.get());
+            assignMeshIndices(mesh->skinPrototype.get());
         }
+
+        assert(m_GeometryCount == geometryIndex);
+        assert(m_Materials.size() == size_t(materialIndex));
     }
 }
 
@@ -1142,6 +1614,10 @@ std::shared_ptr<SceneGraphLeaf> SceneTypeFactory::CreateLeaf(const std::string&
     {
         return std::make_shared<OrthographicCamera>();
     }
+    if (type == "MeshInstanceArray")
+    {
+        return std::make_shared<MeshInstanceArray>(nullptr);
+    }
 
     return nullptr;
 }
@@ -0,0 +1,1339 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/engine/SceneLoader.h>
+#include <donut/core/json.h>
+#include <donut/core/json_stream.h>
+#include <donut/core/log.h>
+#include <donut/core/string_utils.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/core/parallel.h>
+#include <json/value.h>
+#include <algorithm>
+
+using namespace donut::math;
+using namespace donut::engine;
+using namespace donut::core;
+
+static constexpr uint32_t c_NoNode = ~0u;
+
+// Defaults of the transform members, as in json::Read<double3> and json::Read<double4>
+static constexpr double c_DefaultTranslation[3] = { 0.0, 0.0, 0.0 };
+static constexpr double c_DefaultRotation[4] = { 0.0, 0.0, 0.0, 1.0 };
+static constexpr double c_DefaultScaling[3] = { 1.0, 1.0, 1.0 };
+
+// State of a vector member of a node record, see ReadVector()
+enum class VectorState : uint8_t
+{
+    Absent,     // missing or null: the transform is left alone
+    Value,      // decoded while parsing
+    Document    // needs the Json::Value conversion, kept in NodeRecord::vectors
+};
+
+struct SceneLoader::NodeRecord
+{
+    uint32_t firstChild = c_NoNode;
+    uint32_t nextSibling = c_NoNode;
+
+    bool isObject = false;
+    bool hasChildren = false;
+    VectorState translationState = VectorState::Absent;
+    VectorState rotationState = VectorState::Absent;
+    VectorState eulerState = VectorState::Absent;
+    VectorState scalingState = VectorState::Absent;
+
+    std::string name;
+    Json::Value parent;
+    Json::Value model;
+    Json::Value type;
+
+    double3 translation = double3::zero();
+    double4 rotation = double4(0.0, 0.0, 0.0, 1.0);
+    double3 euler = double3::zero();
+    double3 scaling = double3(1.0);
+
+    std::unique_ptr<Json::Value> vectors;   // object with the members in the Document state
+    std::unique_ptr<Json::Value> members;   // the other members of a node with a leaf type, for SceneGraphLeaf::Load()
+};
+
+struct SceneLoader::KeyframeRecord
+{
+    animation::Keyframe keyframe;
+    bool valid = false;
+};
+
+struct SceneLoader::ChannelTarget
+{
+    std::shared_ptr<SceneGraphNode> node;
+    std::shared_ptr<Material> material;
+    bool resolved = false;
+};
+
+struct SceneLoader::ChannelRecord
+{
+    Json::Value mode;
+    Json::Value attribute;
+    Json::Value target;
+    std::vector<Json::Value> targets;
+    std::vector<KeyframeRecord> keyframes;
+
+    // filled by Build()
+    std::shared_ptr<animation::Sampler> sampler;
+    std::vector<ChannelTarget> resolvedTargets;
+};
+
+struct SceneLoader::AnimationRecord
+{
+    Json::Value name;
+    std::vector<ChannelRecord> channels;
+};
+
+namespace
+{
+    enum NodeKey
+    {
+        Key_Name,
+        Key_Parent,
+        Key_Model,
+        Key_Translation,
+        Key_Rotation,
+        Key_Euler,
+        Key_Scaling,
+        Key_Children,
+        Key_Type
+    };
+
+    const donut::json::KeyTable c_NodeKeys = {
+        "name", "parent", "model", "translation", "rotation", "euler", "scaling", "children", "type"
+    };
+
+    enum AnimationKey
+    {
+        Key_AnimationName,
+        Key_Channels
+    };
+
+    const donut::json::KeyTable c_AnimationKeys = { "name", "channels" };
+
+    enum ChannelKey
+    {
+        Key_Mode,
+        Key_Attribute,
+        Key_Data,
+        Key_Target,
+        Key_Targets
+    };
+
+    const donut::json::KeyTable c_ChannelKeys = { "mode", "attribute", "data", "target", "targets" };
+
+    enum KeyframeKey
+    {
+        Key_Time,
+        Key_Value,
+        Key_InTangent,
+        Key_OutTangent
+    };
+
+    const donut::json::KeyTable c_KeyframeKeys = { "time", "value", "inTangent", "outTangent" };
+
+    enum SectionKey
+    {
+        Key_Graph,
+        Key_Animations
+    };
+
+    const donut::json::KeyTable c_SectionKeys = { "graph", "animations" };
+
+    // Thrown out of the animation parser when the section has to be read as a document,
+    // which only happens for inputs that the document path rejects.
+    struct AnimationFallback { };
+}
+
+static dm::float4 ReadUpToFloat4(const Json::Value& node)
+{
+    if (node.isNumeric())
+        return dm::float4(node.asFloat());
+
+    if (node.isArray())
+    {
+        float4 result = float4::zero();
+        for (int i = 0; i < std::min(4, int(node.size())); i++)
+        {
+            result[i] = node[i].asFloat();
+        }
+        return result;
+    }
+
+    return float4::zero();
+}
+
+static bool IsScalarNumber(donut::json::TokenType type)
+{
+    return type == donut::json::TokenType::Null
+        || type == donut::json::TokenType::Boolean
+        || type == donut::json::TokenType::Number;
+}
+
+// Streaming version of ReadUpToFloat4. Returns false when the value has
+// elements that asFloat() does not convert.
+static bool ReadUpToFloat4(donut::json::StreamReader& reader, float4& result)
+{
+    using donut::json::TokenType;
+
+    result = float4::zero();
+    Json::Value scalar;
+
+    switch (reader.Peek())
+    {
+    case TokenType::Number:
+        if (!reader.ReadScalar(scalar))
+            return true;
+        result = float4(scalar.asFloat());
+        return true;
+
+    case TokenType::Array: {
+        if (!reader.EnterArray())
+            return true;
+        int index = 0;
+        while (reader.NextElement())
+        {
+            if (index < 4)
+            {
+                if (!IsScalarNumber(reader.Peek()))
+                    return false;
+                if (!reader.ReadScalar(scalar))
+                    return true;
+                result[index] = scalar.asFloat();
+            }
+            else
+                reader.Skip();
+            ++index;
+        }
+        return true;
+    }
+
+    default:
+        reader.Skip();
+        return true;
+    }
+}
+
+// Streaming version of json::Read<double3> and json::Read<double4>, which return
+// the default for values other than numbers and arrays of the right size.
+// Returns false when the value has elements that asDouble() does not convert;
+// the reader is then left on the value.
+static bool ReadVector(donut::json::StreamReader& reader, double* result, const double* defaultValue, int count, VectorState& state)
+{
+    using donut::json::TokenType;
+
+    Json::Value scalar;
+    for (int i = 0; i < count; i++)
+        result[i] = defaultValue[i];
+
+    switch (reader.Peek())
+    {
+    case TokenType::Null:
+        state = VectorState::Absent;
+        reader.Skip();
+        return true;
+
+    case TokenType::Number:
+        state = VectorState::Value;
+        if (reader.ReadScalar(scalar))
+        {
+            for (int i = 0; i < count; i++)
+                result[i] = scalar.asDouble();
+        }
+        return true;
+
+    case TokenType::Array: {
+        auto position = reader.Save();
+        if (!reader.EnterArray())
+            return true;
+
+        double elements[4];
+        int size = 0;
+        while (reader.NextElement())
+        {
+            if (!IsScalarNumber(reader.Peek()))
+            {
+                // asDouble() throws on strings and containers, but only if the size matches;
+                // leave that to the document path
+                reader.Restore(position);
+                return false;
+            }
+            if (!reader.ReadScalar(scalar))
+                return true;
+            if (size < count)
+                elements[size] = scalar.asDouble();
+            ++size;
+        }
+
+        state = VectorState::Value;
+        if (size == count)
+        {
+            for (int i = 0; i < count; i++)
+                result[i] = elements[i];
+        }
+        return true;
+    }
+
+    default:
+        state = VectorState::Value;
+        reader.Skip();
+        return true;
+    }
+}
+
+static void ParseInterpolationMode(const Json::Value& modeNode, animation::Sampler& sampler)
+{
+    if (!modeNode.isString())
+    {
+        sampler.SetInterpolationMode(animation::InterpolationMode::Step);
+        return;
+    }
+
+    if (modeNode.asString() == "step")
+        sampler.SetInterpolationMode(animation::InterpolationMode::Step);
+    else if (modeNode.asString() == "linear")
+        sampler.SetInterpolationMode(animation::InterpolationMode::Linear);
+    else if (modeNode.asString() == "slerp")
+        sampler.SetInterpolationMode(animation::InterpolationMode::Slerp);
+    else if (modeNode.asString() == "hermite")
+        sampler.SetInterpolationMode(animation::InterpolationMode::HermiteSpline);
+    else if (modeNode.asString() == "catmull-rom")
+        sampler.SetInterpolationMode(animation::InterpolationMode::CatmullRomSpline);
+}
+
+static bool IsKnownInterpolationMode(const std::string& mode)
+{
+    return mode == "step" || mode == "linear" || mode == "slerp" || mode == "hermite" || mode == "catmull-rom";
+}
+
+static void WarnInterpolationMode(const Json::Value& modeNode, const std::string& animationName, int channelIndex)
+{
+    if (modeNode.isString())
+    {
+        if (!IsKnownInterpolationMode(modeNode.asString()))
+            donut::log::warning("Unknown interpolation mode '%s' specified for animation '%s' channel %d. "
+                "Valid interpolation modes are: step, linear, hermite, catmull-rom.",
+                modeNode.asCString(), animationName.c_str(), channelIndex);
+    }
+    else
+    {
+        donut::log::warning("Interpolation mode is not specified for animation '%s' channel %d, using step.",
+            animationName.c_str(), channelIndex);
+    }
+}
+
+static AnimationAttribute ParseAttribute(const Json::Value& attributeNode)
+{
+    if (!attributeNode.isString() || attributeNode.asString().empty())
+        return AnimationAttribute::Undefined;
+
+    if (attributeNode.asString() == "translation")
+        return AnimationAttribute::Translation;
+    if (attributeNode.asString() == "rotation")
+        return AnimationAttribute::Rotation;
+    if (attributeNode.asString() == "scaling")
+        return AnimationAttribute::Scaling;
+
+    return AnimationAttribute::LeafProperty;
+}
+
+// Node paths that may resolve differently once the animations are attached under
+// the "Animations" container, and relative paths which FindNode reports as errors,
+// are resolved in order while the animations are attached.
+static bool CanResolveEarly(const std::string& path)
+{
+    std::filesystem::path nodePath(path);
+    auto component = nodePath.begin();
+    if (component == nodePath.end() || *component != "/")
+        return false;
+
+    for (++component; component != nodePath.end(); ++component)
+    {
+        if (*component == ".." || *component == "Animations")
+            return false;
+    }
+
+    return true;
+}
+
+SceneLoader::SceneLoader(
+    std::shared_ptr<SceneGraph> sceneGraph,
+    std::shared_ptr<SceneTypeFactory> sceneTypeFactory,
+    std::shared_ptr<vfs::IFileSystem> fs,
+    std::filesystem::path scenePath)
+    : m_SceneGraph(std::move(sceneGraph))
+    , m_SceneTypeFactory(std::move(sceneTypeFactory))
+    , m_fs(std::move(fs))
+    , m_ScenePath(std::move(scenePath))
+    , m_FirstRootNode(c_NoNode)
+{
+}
+
+SceneLoader::~SceneLoader() = default;
+
+void SceneLoader::LoadSceneGraph(const Json::Value& nodeList, const std::shared_ptr<SceneGraphNode>& parent,
+    const std::vector<SceneImportResult>& models)
+{
+    size_t recordCount = m_Nodes.size();
+    uint32_t firstNode = AppendNodeList(nodeList);
+    BuildNodes(firstNode, parent, models);
+    m_Nodes.resize(recordCount);
+}
+
+uint32_t SceneLoader::AppendNodeList(const Json::Value& nodeList)
+{
+    uint32_t firstNode = c_NoNode;
+    uint32_t lastNode = c_NoNode;
+    for (const auto& src : nodeList)
+    {
+        uint32_t index = AppendNode(src);
+
+        if (lastNode == c_NoNode)
+            firstNode = index;
+        else
+            m_Nodes[lastNode].nextSibling = index;
+        lastNode = index;
+    }
+
+    return firstNode;
+}
+
+uint32_t SceneLoader::AppendNode(const Json::Value& src)
+{
+    uint32_t index = uint32_t(m_Nodes.size());
+    m_Nodes.emplace_back();
+
+    if (!src.isObject())
+        return index;
+
+    NodeRecord& node = m_Nodes[index];
+    node.isObject = true;
+
+    auto setVector = [&node](const char* key, const Json::Value& value, VectorState& state)
+    {
+        if (value.isNull())
+            return;
+
+        state = VectorState::Document;
+        if (!node.vectors)
+            node.vectors = std::make_unique<Json::Value>(Json::objectValue);
+        (*node.vectors)[key] = value;
+    };
+
+    for (auto it = src.begin(); it != src.end(); ++it)
+    {
+        switch (c_NodeKeys.Find(it.name()))
+        {
+        case Key_Name:
+            node.name = it->isString() ? it->asString() : std::string();
+            break;
+        case Key_Parent:
+            node.parent = *it;
+            break;
+        case Key_Model:
+            node.model = *it;
+            break;
+        case Key_Type:
+            node.type = *it;
+            break;
+        case Key_Translation:
+            setVector("translation", *it, node.translationState);
+            break;
+        case Key_Rotation:
+            setVector("rotation", *it, node.rotationState);
+            break;
+        case Key_Euler:
+            setVector("euler", *it, node.eulerState);
+            break;
+        case Key_Scaling:
+            setVector("scaling", *it, node.scalingState);
+            break;
+        case Key_Children:
+            node.hasChildren = !it->isNull();
+            break;
+        default:
+            if (!node.members)
+                node.members = std::make_unique<Json::Value>(Json::objectValue);
+            (*node.members)[it.name()] = *it;
+            break;
+        }
+    }
+
+    if (!node.type.isString())
+        node.members.reset();
+
+    if (node.hasChildren)
+    {
+        // the list may reallocate the records
+        uint32_t firstChild = AppendNodeList(src["children"]);
+        m_Nodes[index].firstChild = firstChild;
+    }
+
+    return index;
+}
+
+void SceneLoader::LoadLeaf(const std::shared_ptr<SceneGraphNode>& dst, const Json::Value& src, const Json::Value& leafTypeNode) const
+{
+    if (leafTypeNode.isString())
+    {
+        auto leaf = m_SceneTypeFactory->CreateLeaf(leafTypeNode.asString());
+        if (auto instanceArray = std::dynamic_pointer_cast<MeshInstanceArray>(leaf))
+        {
+            // The mesh must be known before the leaf is attached, so that the graph can track it
+            if (!LoadInstanceArrayMesh(src, *instanceArray, dst->GetName()))
+                leaf = nullptr;
+        }
+
+        if (leaf)
+        {
+            dst->SetLeaf(leaf);
+            leaf->Load(src);
+
+            const auto& fileNode = src["file"];
+            if (fileNode.isString())
+            {
+                if (auto instanceArray = std::dynamic_pointer_cast<MeshInstanceArray>(leaf))
+                {
+                    std::filesystem::path fileName = m_ScenePath / fileNode.asString();
+                    auto blob = m_fs->readFile(fileName);
+                    if (!blob)
+                        log::warning("Couldn't read instance array file '%s'.", fileName.generic_string().c_str());
+                    else if (!instanceArray->LoadBinary(*blob))
+                        log::warning("Failed to load instance array file '%s'.", fileName.generic_string().c_str());
+                }
+            }
+        }
+        else
+        {
+            log::warning("Unknown leaf type '%s' for node '%s', skipping.",
+                leafTypeNode.asCString(), dst->GetName().c_str());
+        }
+    }
+    else if (!leafTypeNode.isNull())
+    {
+        log::warning("Leaf type specification for node '%s' is not a string, skipping.",
+            dst->GetName().c_str());
+    }
+}
+
+bool SceneLoader::LoadInstanceArrayMesh(const Json::Value& src, MeshInstanceArray& instanceArray, const std::string& nodeName) const
+{
+    const auto& meshNode = src["meshNode"];
+    if (!meshNode.isString())
+    {
+        log::warning("Instance array node '%s' has no 'meshNode' reference, skipping.", nodeName.c_str());
+        return false;
+    }
+
+    auto sourceNode = m_SceneGraph->FindNode(meshNode.asString());
+    auto sourceInstance = sourceNode ? std::dynamic_pointer_cast<MeshInstance>(sourceNode->GetLeaf()) : nullptr;
+    if (!sourceInstance || !sourceInstance->GetMesh())
+    {
+        log::warning("Mesh node '%s' referenced by instance array node '%s' not found or has no mesh, skipping.",
+            meshNode.asCString(), nodeName.c_str());
+        return false;
+    }
+
+    return instanceArray.SetMesh(sourceInstance->GetMesh());
+}
+
+SceneLoader::ChannelTarget SceneLoader::ResolveTarget(const Json::Value& targetNode) const
+{
+    ChannelTarget result;
+    if (!targetNode.isString())
+        return result;
+
+    std::string targetName = targetNode.asString();
+    if (donut::string_utils::starts_with(targetName, "material:"))
+    {
+        targetName = targetName.substr(9);
+
+        for (const auto& it : m_SceneGraph->GetMaterials())
+        {
+            if (it->name == targetName)
+            {
+                result.material = it;
+                break;
+            }
+        }
+        result.resolved = true;
+    }
+    else if (CanResolveEarly(targetName))
+    {
+        result.node = m_SceneGraph->FindNode(targetName);
+        result.resolved = true;
+    }
+
+    return result;
+}
+
+void SceneLoader::AddChannel(SceneGraphAnimation& animation, const std::shared_ptr<animation::Sampler>& sampler,
+    AnimationAttribute attribute, const Json::Value& attributeNode, const Json::Value& targetNode,
+    const ChannelTarget& target, int channelIndex) const
+{
+    if (targetNode.isString())
+    {
+        std::string targetName = targetNode.asString();
+        if (donut::string_utils::starts_with(targetName, "material:"))
+        {
+            targetName = targetName.substr(9);
+
+            if (target.material)
+            {
+                const auto& channel = std::make_shared<SceneGraphAnimationChannel>(sampler, target.material);
+                channel->SetLeafProperyName(attributeNode.asString());
+                animation.AddChannel(channel);
+            }
+            else
+            {
+                log::warning("Target material '%s' specified for animation '%s' channel %d not found, ignoring.",
+                    std::string(targetName).c_str(), animation.GetName().c_str(), channelIndex);
+            }
+        }
+        else
+        {
+            const auto& targetNodePtr = target.resolved ? target.node : m_SceneGraph->FindNode(targetName);
+            if (targetNodePtr)
+            {
+                const auto& channel = std::make_shared<SceneGraphAnimationChannel>(sampler, targetNodePtr, attribute);
+                if (attribute == AnimationAttribute::LeafProperty)
+                    channel->SetLeafProperyName(attributeNode.asString());
+                animation.AddChannel(channel);
+            }
+            else
+            {
+                log::warning("Target node '%s' specified for animation '%s' channel %d not found, ignoring.",
+                    targetNode.asCString(), animation.GetName().c_str(), channelIndex);
+            }
+        }
+    }
+    else if (!targetNode.isNull())
+    {
+        log::warning("Target node specification for animation '%s' channel %d is not a string, ignoring.",
+            animation.GetName().c_str(), channelIndex);
+    }
+}
+
+void SceneLoader::AttachAnimation(const std::shared_ptr<SceneGraphAnimation>& animation, const std::shared_ptr<SceneGraphNode>& animationNode,
+    std::shared_ptr<SceneGraphNode>& animationContainer) const
+{
+    if (!animation->GetChannels().empty())
+    {
+        if (!animationContainer)
+        {
+            animationContainer = std::make_shared<SceneGraphNode>();
+            animationContainer->SetName("Animations");
+            m_SceneGraph->Attach(m_SceneGraph->GetRootNode(), animationContainer);
+        }
+        
+        m_SceneGraph->Attach(animationContainer, animationNode);
+    }
+    else
+    {
+        log::warning("Animation '%s' processed with no valid channels, ignoring.",
+            animation->GetName().c_str());
+    }
+}
+
+void SceneLoader::LoadAnimations(const Json::Value& nodeList)
+{
+    std::vector<AnimationRecord> streamedAnimations;
+    std::swap(m_Animations, streamedAnimations);
+
+    AppendAnimations(nodeList);
+    BuildAnimations(nullptr);
+
+    m_Animations = std::move(streamedAnimations);
+}
+
+void SceneLoader::AppendAnimations(const Json::Value& nodeList)
+{
+    // Reads the members in the same order and with the same conversions as the graph
+    // building does, so that malformed values fail in the same way
+    for (const auto& animationNode : nodeList)
+    {
+        AnimationRecord& animation = m_Animations.emplace_back();
+        animation.name = animationNode["name"];
+
+        const auto& channelsNode = animationNode["channels"];
+        if (!channelsNode.isArray())
+            continue;
+
+        for (const auto& channelSrc : channelsNode)
+        {
+            ChannelRecord& channel = animation.channels.emplace_back();
+            channel.mode = channelSrc["mode"];
+            channel.attribute = channelSrc["attribute"];
+            if (ParseAttribute(channel.attribute) == AnimationAttribute::Undefined)
+                continue;
+
+            for (const auto& dataPoint : channelSrc["data"])
+            {
+                KeyframeRecord& keyframe = channel.keyframes.emplace_back();
+
+                const auto& timeNode = dataPoint["time"];
+                keyframe.valid = timeNode.isNumeric();
+                if (!keyframe.valid)
+                    continue;
+
+                keyframe.keyframe.time = timeNode.asFloat();
+                keyframe.keyframe.value = ReadUpToFloat4(dataPoint["value"]);
+                keyframe.keyframe.inTangent = ReadUpToFloat4(dataPoint["inTangent"]);
+                keyframe.keyframe.outTangent = ReadUpToFloat4(dataPoint["outTangent"]);
+            }
+
+            channel.target = channelSrc["target"];
+            if (channel.target.isNull())
+            {
+                const auto& targetsNode = channelSrc["targets"];
+                if (targetsNode.isArray())
+                {
+                    for (const auto& targetArrayItem : targetsNode)
+                        channel.targets.push_back(targetArrayItem);
+                }
+            }
+        }
+    }
+}
+
+bool SceneLoader::Parse(std::shared_ptr<vfs::IBlob const> data, const std::string& fileName, Json::Value& sections)
+{
+    m_Data = std::move(data);
+    m_Nodes.clear();
+    m_Animations.clear();
+    m_FirstRootNode = c_NoNode;
+    m_HasAnimations = false;
+    m_AnimationsDocument.reset();
+
+    const char* begin = static_cast<const char*>(m_Data->data());
+    json::StreamReader reader(begin, begin + m_Data->size());
+
+    bool success;
+    if (reader.Peek() == json::TokenType::Object)
+    {
+        sections = Json::Value(Json::objectValue);
+        reader.EnterObject();
+
+        std::string_view key;
+        while (reader.NextMember(key))
+        {
+            switch (c_SectionKeys.Find(key))
+            {
+            case Key_Graph:
+                m_FirstRootNode = c_NoNode;
+                if (reader.Peek() == json::TokenType::Array)
+                    ParseNodeList(reader, m_FirstRootNode);
+                else
+                {
+                    Json::Value nodeList;
+                    if (reader.ReadValue(nodeList))
+                        m_FirstRootNode = AppendNodeList(nodeList);
+                }
+                break;
+
+            case Key_Animations: {
+                m_HasAnimations = true;
+                m_Animations.clear();
+                m_AnimationsDocument.reset();
+
+                auto position = reader.Save();
+                bool streamed = false;
+                if (reader.Peek() == json::TokenType::Array)
+                {
+                    try
+                    {
+                        reader.EnterArray();
+                        while (reader.NextElement())
+                        {
+                            m_Animations.emplace_back();
+                            ParseAnimation(reader, m_Animations.back());
+                        }
+                        streamed = true;
+                    }
+                    catch (const AnimationFallback&)
+                    {
+                        m_Animations.clear();
+                        reader.Restore(position);
+                    }
+                }
+
+                if (!streamed)
+                {
+                    m_AnimationsDocument = std::make_unique<Json::Value>();
+                    reader.ReadValue(*m_AnimationsDocument);
+                }
+                break;
+            }
+
+            default:
+                reader.ReadValue(sections[std::string(key)]);
+                break;
+            }
+        }
+        success = !reader.HasError();
+    }
+    else
+    {
+        success = reader.ReadValue(sections);
+    }
+
+    if (!success)
+    {
+        log::error("Couldn't parse JSON file %s:\n%s", fileName.c_str(), reader.GetError().c_str());
+        m_Data.reset();
+    }
+
+    return success;
+}
+
+bool SceneLoader::ParseNodeList(json::StreamReader& reader, uint32_t& firstNode)
+{
+    firstNode = c_NoNode;
+    if (!reader.EnterArray())
+        return false;
+
+    uint32_t lastNode = c_NoNode;
+    while (reader.NextElement())
+    {
+        uint32_t index;
+        if (!ParseNode(reader, index))
+            return false;
+
+        if (lastNode == c_NoNode)
+            firstNode = index;
+        else
+            m_Nodes[lastNode].nextSibling = index;
+        lastNode = index;
+    }
+
+    return !reader.HasError();
+}
+
+bool SceneLoader::ParseNode(json::StreamReader& reader, uint32_t& index)
+{
+    index = uint32_t(m_Nodes.size());
+    m_Nodes.emplace_back();
+
+    if (reader.Peek() != json::TokenType::Object)
+        return reader.Skip();
+
+    m_Nodes[index].isObject = true;
+    reader.EnterObject();
+
+    Json::Value scalar;
+    std::string_view key;
+    while (reader.NextMember(key))
+    {
+        NodeRecord* node = &m_Nodes[index];
+        const char* vectorKey = nullptr;
+        bool vectorDecoded = true;
+
+        switch (c_NodeKeys.Find(key))
+        {
+        case Key_Name:
+            reader.ReadScalar(scalar);
+            node->name = scalar.isString() ? scalar.asString() : std::string();
+            break;
+
+        case Key_Parent:
+            reader.ReadScalar(node->parent);
+            break;
+
+        case Key_Model:
+            reader.ReadScalar(node->model);
+            break;
+
+        case Key_Type:
+            reader.ReadScalar(node->type);
+            break;
+
+        case Key_Translation:
+            vectorKey = "translation";
+            vectorDecoded = ReadVector(reader, &node->translation.x, c_DefaultTranslation, 3, node->translationState);
+            if (!vectorDecoded)
+                node->translationState = VectorState::Document;
+            break;
+
+        case Key_Rotation:
+            vectorKey = "rotation";
+            vectorDecoded = ReadVector(reader, &node->rotation.x, c_DefaultRotation, 4, node->rotationState);
+            if (!vectorDecoded)
+                node->rotationState = VectorState::Document;
+            break;
+
+        case Key_Euler:
+            vectorKey = "euler";
+            vectorDecoded = ReadVector(reader, &node->euler.x, c_DefaultTranslation, 3, node->eulerState);
+            if (!vectorDecoded)
+                node->eulerState = VectorState::Document;
+            break;
+
+        case Key_Scaling:
+            vectorKey = "scaling";
+            vectorDecoded = ReadVector(reader, &node->scaling.x, c_DefaultScaling, 3, node->scalingState);
+            if (!vectorDecoded)
+                node->scalingState = VectorState::Document;
+            break;
+
+        case Key_Children: {
+            node->firstChild = c_NoNode;
+            node->hasChildren = reader.Peek() != json::TokenType::Null;
+            uint32_t firstChild = c_NoNode;
+            if (reader.Peek() == json::TokenType::Array)
+            {
+                if (!ParseNodeList(reader, firstChild))
+                    return false;
+            }
+            else if (node->hasChildren)
+            {
+                Json::Value children;
+                if (reader.ReadValue(children))
+                    firstChild = AppendNodeList(children);
+            }
+            else
+                reader.Skip();
+            // the list may have reallocated the records
+            node = &m_Nodes[index];
+            node->firstChild = firstChild;
+            break;
+        }
+
+        default: {
+            // Leaves read arbitrary members. Keep them in this pass, the node type may come later.
+            if (!node->members)
+                node->members = std::make_unique<Json::Value>(Json::objectValue);
+            Json::Value& member = (*node->members)[std::string(key)];
+            reader.ReadValue(member);
+            break;
+        }
+        }
+
+        if (vectorKey && !vectorDecoded)
+        {
+            if (!node->vectors)
+                node->vectors = std::make_unique<Json::Value>(Json::objectValue);
+            reader.ReadValue((*node->vectors)[vectorKey]);
+        }
+
+        if (reader.HasError())
+            return false;
+    }
+
+    if (!m_Nodes[index].type.isString())
+        m_Nodes[index].members.reset();
+
+    return !reader.HasError();
+}
+
+bool SceneLoader::ParseAnimation(json::StreamReader& reader, AnimationRecord& animation)
+{
+    json::TokenType tokenType = reader.Peek();
+    if (tokenType == json::TokenType::Null)
+        return reader.Skip();
+    if (tokenType != json::TokenType::Object)
+        throw AnimationFallback();
+
+    reader.EnterObject();
+
+    int key;
+    while (reader.NextMember(c_AnimationKeys, key))
+    {
+        switch (key)
+        {
+        case Key_AnimationName:
+            reader.ReadScalar(animation.name);
+            break;
+
+        case Key_Channels:
+            animation.channels.clear();
+            if (reader.Peek() == json::TokenType::Array)
+            {
+                reader.EnterArray();
+                while (reader.NextElement())
+                {
+                    animation.channels.emplace_back();
+                    if (!ParseChannel(reader, animation.channels.back()))
+                        return false;
+                }
+            }
+            else
+                reader.Skip();
+            break;
+
+        default:
+            reader.Skip();
+            break;
+        }
+    }
+
+    return !reader.HasError();
+}
+
+bool SceneLoader::ParseChannel(json::StreamReader& reader, ChannelRecord& channel)
+{
+    json::TokenType tokenType = reader.Peek();
+    if (tokenType == json::TokenType::Null)
+        return reader.Skip();
+    if (tokenType != json::TokenType::Object)
+        throw AnimationFallback();
+
+    reader.EnterObject();
+
+    int key;
+    while (reader.NextMember(c_ChannelKeys, key))
+    {
+        switch (key)
+        {
+        case Key_Mode:
+            reader.ReadScalar(channel.mode);
+            break;
+
+        case Key_Attribute:
+            reader.ReadScalar(channel.attribute);
+            break;
+
+        case Key_Target:
+            reader.ReadScalar(channel.target);
+            break;
+
+        case Key_Data:
+            channel.keyframes.clear();
+            if (reader.Peek() == json::TokenType::Array)
+            {
+                reader.EnterArray();
+                while (reader.NextElement())
+                {
+                    channel.keyframes.emplace_back();
+                    if (!ParseKeyframe(reader, channel.keyframes.back()))
+                        return false;
+                }
+            }
+            else if (reader.Peek() == json::TokenType::Object)
+                throw AnimationFallback();
+            else
+                reader.Skip();
+            break;
+
+        case Key_Targets:
+            channel.targets.clear();
+            if (reader.Peek() == json::TokenType::Array)
+            {
+                reader.EnterArray();
+                while (reader.NextElement())
+                {
+                    channel.targets.emplace_back();
+                    reader.ReadScalar(channel.targets.back());
+                }
+            }
+            else
+                reader.Skip();
+            break;
+
+        default:
+            reader.Skip();
+            break;
+        }
+    }
+
+    return !reader.HasError();
+}
+
+bool SceneLoader::ParseKeyframe(json::StreamReader& reader, KeyframeRecord& keyframe)
+{
+    json::TokenType tokenType = reader.Peek();
+    if (tokenType == json::TokenType::Null)
+        return reader.Skip();
+    if (tokenType != json::TokenType::Object)
+        throw AnimationFallback();
+
+    reader.EnterObject();
+
+    Json::Value scalar;
+    int key;
+    while (reader.NextMember(c_KeyframeKeys, key))
+    {
+        switch (key)
+        {
+        case Key_Time:
+            reader.ReadScalar(scalar);
+            keyframe.valid = scalar.isNumeric();
+            keyframe.keyframe.time = keyframe.valid ? scalar.asFloat() : 0.f;
+            break;
+
+        case Key_Value:
+            if (!ReadUpToFloat4(reader, keyframe.keyframe.value))
+                throw AnimationFallback();
+            break;
+
+        case Key_InTangent:
+            if (!ReadUpToFloat4(reader, keyframe.keyframe.inTangent))
+                throw AnimationFallback();
+            break;
+
+        case Key_OutTangent:
+            if (!ReadUpToFloat4(reader, keyframe.keyframe.outTangent))
+                throw AnimationFallback();
+            break;
+
+        default:
+            reader.Skip();
+            break;
+        }
+    }
+
+    return !reader.HasError();
+}
+
+void SceneLoader::Build(const std::shared_ptr<SceneGraphNode>& parent, const std::vector<SceneImportResult>& models,
+    tf::Executor* executor)
+{
+    BuildNodes(m_FirstRootNode, parent, models);
+
+    // the animation records are converted from the document here rather than in Parse(),
+    // where the graph does not exist yet, so that malformed values fail at the same point
+    if (m_AnimationsDocument)
+        AppendAnimations(*m_AnimationsDocument);
+    if (m_HasAnimations)
+        BuildAnimations(executor);
+
+    m_Nodes.clear();
+    m_Animations.clear();
+    m_AnimationsDocument.reset();
+    m_Data.reset();
+}
+
+void SceneLoader::BuildNodes(uint32_t firstNode, const std::shared_ptr<SceneGraphNode>& parent,
+    const std::vector<SceneImportResult>& models)
+{
+    for (uint32_t index = firstNode; index != c_NoNode; index = m_Nodes[index].nextSibling)
+    {
+        NodeRecord& src = m_Nodes[index];
+
+        if (!src.isObject)
+        {
+            log::warning("Non-object node in the scene graph definition.");
+            continue;
+        }
+
+        const std::string& nodeName = src.name;
+
+        std::shared_ptr<SceneGraphNode> customParent = parent;
+        if (src.parent.isString())
+        {
+            customParent = m_SceneGraph->FindNode(src.parent.asString());
+            if (!customParent)
+            {
+                log::warning("Custom parent '%s' specified for node '%s' not found, skipping the node.",
+                    src.parent.asCString(), nodeName.c_str());
+                continue;
+            }
+        }
+        else if (!src.parent.isNull())
+        {
+            log::warning("Custom parent specification for node '%s' is not a string, ignoring.",
+                nodeName.c_str());
+        }
+
+        std::shared_ptr<SceneGraphNode> dst;
+
+        if (!src.model.isNull())
+        {
+            if (!src.model.isIntegral())
+            {
+                log::warning("Model references in the scene graph must be indices into the model array.");
+                continue;
+            }
+
+            int modelIndex = src.model.asInt();
+            if (modelIndex < 0 || modelIndex >= int(models.size()))
+            {
+                log::warning("Referenced model %d is not defined in the model array.", modelIndex);
+                continue;
+            }
+
+            const auto& loadedModel = models[modelIndex];
+            if (!loadedModel.rootNode)
+            {
+                continue;
+            }
+
+            dst = loadedModel.rootNode;
+        }
+        else
+        {
+            dst = std::make_shared<SceneGraphNode>();
+        }
+
+        dst = m_SceneGraph->Attach(customParent, dst);
+
+        dst->SetName(nodeName);
+
+        if (src.translationState == VectorState::Value)
+            dst->SetTranslation(src.translation);
+        else if (src.translationState == VectorState::Document)
+        {
+            double3 value = double3::zero();
+            (*src.vectors)["translation"] >> value;
+            dst->SetTranslation(value);
+        }
+
+        if (src.rotationState == VectorState::Value)
+            dst->SetRotation(dm::dquat::fromXYZW(src.rotation));
+        else if (src.rotationState == VectorState::Document)
+        {
+            double4 value = double4(0.0, 0.0, 0.0, 1.0);
+            (*src.vectors)["rotation"] >> value;
+            dst->SetRotation(dm::dquat::fromXYZW(value));
+        }
+        else if (src.eulerState == VectorState::Value)
+            dst->SetRotation(rotationQuat(src.euler));
+        else if (src.eulerState == VectorState::Document)
+        {
+            double3 value = double3::zero();
+            (*src.vectors)["euler"] >> value;
+            dst->SetRotation(rotationQuat(value));
+        }
+
+        if (src.scalingState == VectorState::Value)
+            dst->SetScaling(src.scaling);
+        else if (src.scalingState == VectorState::Document)
+        {
+            double3 value = double3(1.0);
+            (*src.vectors)["scaling"] >> value;
+            dst->SetScaling(value);
+        }
+
+        if (src.hasChildren)
+            BuildNodes(src.firstChild, dst, models);
+
+        if (src.type.isString())
+        {
+            // The leaf sees the node members other than the children and the transform
+            Json::Value leafNode = src.members ? std::move(*src.members) : Json::Value(Json::objectValue);
+            if (!src.name.empty())
+                leafNode["name"] = src.name;
+            if (!src.parent.isNull())
+                leafNode["parent"] = src.parent;
+            if (!src.model.isNull())
+                leafNode["model"] = src.model;
+            leafNode["type"] = src.type;
+            LoadLeaf(dst, leafNode, src.type);
+        }
+        else if (!src.type.isNull())
+        {
+            LoadLeaf(dst, Json::Value(), src.type);
+        }
+    }
+
+    parent->ReverseChildren();
+}
+
+void SceneLoader::BuildAnimations(tf::Executor* executor)
+{
+    // Samplers and channel targets do not depend on each other, prepare them in parallel
+    ParallelFor(executor, m_Animations.size(), [this](size_t animationIndex)
+    {
+        for (auto& channel : m_Animations[animationIndex].channels)
+        {
+            channel.sampler = std::make_shared<animation::Sampler>();
+            ParseInterpolationMode(channel.mode, *channel.sampler);
+
+            if (ParseAttribute(channel.attribute) == AnimationAttribute::Undefined)
+                continue;
+
+            for (const auto& keyframe : channel.keyframes)
+            {
+                if (keyframe.valid)
+                    channel.sampler->AddKeyframe(keyframe.keyframe);
+            }
+
+            if (!channel.target.isNull())
+                channel.resolvedTargets.push_back(ResolveTarget(channel.target));
+            else
+            {
+                for (const auto& target : channel.targets)
+                    channel.resolvedTargets.push_back(ResolveTarget(target));
+            }
+        }
+    });
+
+    // Warnings, channels and the graph changes happen in document order
+    std::shared_ptr<SceneGraphNode> animationContainer;
+
+    for (const auto& animationSrc : m_Animations)
+    {
+        const auto& animation = std::make_shared<SceneGraphAnimation>();
+
+        const auto& sceneAnimationNode = std::make_shared<SceneGraphNode>();
+        sceneAnimationNode->SetLeaf(animation);
+
+        if (animationSrc.name.isString())
+        {
+            animation->SetName(animationSrc.name.asString());
+        }
+
+        int channelIndex = -1;
+        for (const auto& channel : animationSrc.channels)
+        {
+            ++channelIndex;
+
+            WarnInterpolationMode(channel.mode, animation->GetName(), channelIndex);
+
+            AnimationAttribute attribute = ParseAttribute(channel.attribute);
+            if (attribute == AnimationAttribute::Undefined)
+            {
+                log::warning("Attribute is not specified for animation '%s' channel %d, ignoring.",
+                    animation->GetName().c_str(), channelIndex);
+                continue;
+            }
+
+            for (size_t keyframeIndex = 0; keyframeIndex < channel.keyframes.size(); keyframeIndex++)
+            {
+                if (!channel.keyframes[keyframeIndex].valid)
+                {
+                    log::warning("Invalid keyframe %d in animation '%s' channel %d: time is not specified or is not numeric.",
+                        int(keyframeIndex), animation->GetName().c_str(), channelIndex);
+                }
+            }
+
+            if (!channel.target.isNull())
+            {
+                AddChannel(*animation, channel.sampler, attribute, channel.attribute, channel.target,
+                    channel.resolvedTargets[0], channelIndex);
+            }
+            else
+            {
+                for (size_t targetIndex = 0; targetIndex < channel.targets.size(); targetIndex++)
+                {
+                    AddChannel(*animation, channel.sampler, attribute, channel.attribute, channel.targets[targetIndex],
+                        channel.resolvedTargets[targetIndex], channelIndex);
+                }
+            }
+        }
+
+        AttachAnimation(animation, sceneAnimationNode, animationContainer);
+    }
+}
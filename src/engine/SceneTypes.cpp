@@ -22,6 +22,7 @@
 
 #include <donut/engine/SceneGraph.h>
 #include <donut/engine/ShadowMap.h>
+#include <donut/engine/IesProfile.h>
 #include <donut/core/json.h>
 #include <json/value.h>
 
@@ -31,12 +32,23 @@ using namespace donut::math;
 
 using namespace donut::engine;
 
+static void FillIesProfileConstants(const IesProfile* profile, LightConstants& lightConstants)
+{
+    if (profile && profile->atlasSlice >= 0)
+    {
+        lightConstants.iesProfileSlice = profile->atlasSlice;
+        lightConstants.iesProfileTextureIndex = profile->textureIndex;
+    }
+}
+
 void Light::FillLightConstants(LightConstants& lightConstants) const
 {
     lightConstants.color = color;
     lightConstants.shadowCascades = int4(-1);
     lightConstants.perObjectShadows = int4(-1);
     lightConstants.shadowChannel = int4(shadowChannel, -1, -1, -1);
+    lightConstants.iesProfileSlice = -1;
+    lightConstants.iesProfileTextureIndex = -1;
     if (shadowMap)
         lightConstants.outOfBoundsShadow = shadowMap->IsLitOutOfBounds() ? 1.f : 0.f;
     else
@@ -179,6 +191,7 @@ std::shared_ptr<SceneGraphLeaf> SpotLight::Clone()
     copy->range = range;
     copy->innerAngle = innerAngle;
     copy->outerAngle = outerAngle;
+    copy->iesProfile = iesProfile;
     return std::static_pointer_cast<SceneGraphLeaf>(copy);
 }
 
@@ -195,6 +208,7 @@ void SpotLight::FillLightConstants(LightConstants& lightConstants) const
     lightConstants.color = color;
     lightConstants.innerAngle = dm::radians(innerAngle);
     lightConstants.outerAngle = dm::radians(outerAngle);
+    FillIesProfileConstants(iesProfile.get(), lightConstants);
 }
 
 void SpotLight::Load(const Json::Value& node)
@@ -260,6 +274,7 @@ std::shared_ptr<SceneGraphLeaf> PointLight::Clone()
     copy->intensity = intensity;
     copy->radius = radius;
     copy->range = range;
+    copy->iesProfile = iesProfile;
     return std::static_pointer_cast<SceneGraphLeaf>(copy);
 }
 
@@ -273,6 +288,7 @@ void PointLight::FillLightConstants(LightConstants& lightConstants) const
     lightConstants.angularSizeOrInvRange = (range <= 0.f) ? 0.f : 1.f / range;
     lightConstants.intensity = intensity;
     lightConstants.color = color;
+    FillIesProfileConstants(iesProfile.get(), lightConstants);
 }
 
 void PointLight::Load(const Json::Value& node)
@@ -382,7 +398,7 @@ bool LightProbe::IsActive() const
         return false;
     if (bounds.isempty())
         return false;
-    if ((diffuseScale == 0.f || !diffuseMap) && (specularScale == 0.f || !specularMap))
+    if ((diffuseScale == 0.f || (!diffuseMap && !useDiffuseIrradianceSH)) && (specularScale == 0.f || !specularMap))
         return false;
 
     return true;
@@ -395,6 +411,15 @@ void LightProbe::FillLightProbeConstants(LightProbeConstants& lightProbeConstant
     lightProbeConstants.diffuseScale = diffuseScale;
     lightProbeConstants.specularScale = specularScale;
     lightProbeConstants.mipLevels = specularMap ? static_cast<float>(specularMap->getDesc().mipLevels) : 0.f;
+    lightProbeConstants.diffuseFromSH = useDiffuseIrradianceSH ? 1 : 0;
+
+    // The diffuse cubemaps rendered by LightProbeProcessingPass hold irradiance / pi^2,
+    // scale the SH to match so that both sources are interchangeable
+    const float diffuseSHScale = useDiffuseIrradianceSH ? 1.f / (PI_f * PI_f) : 0.f;
+    for (int i = 0; i < SphericalHarmonicsL2::CoefficientCount; i++)
+    {
+        lightProbeConstants.diffuseSH[i] = float4(diffuseIrradianceSH.coefficients[i] * diffuseSHScale, 0.f);
+    }
 
     for (uint32_t nPlane = 0; nPlane < frustum::PLANES_COUNT; nPlane++)
     {
@@ -24,6 +24,13 @@
 #include <donut/core/vfs/VFS.h>
 #include <donut/core/log.h>
 #include <nvrhi/common/shader-blob.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
 
 using namespace std;
 using namespace donut::vfs;
@@ -40,7 +47,44 @@ ShaderFactory::ShaderFactory(nvrhi::DeviceHandle rendererInterface,
 
 void ShaderFactory::ClearCache()
 {
+    std::lock_guard<std::mutex> lockGuard(m_CacheMutex);
+
 	m_BytecodeCache.clear();
+	m_LoadedFiles.clear();
+}
+
+std::shared_ptr<IBlob> ShaderFactory::FindInCache(const std::string& key)
+{
+    std::lock_guard<std::mutex> lockGuard(m_CacheMutex);
+
+    auto it = m_BytecodeCache.find(key);
+    if (it == m_BytecodeCache.end())
+        return nullptr;
+
+    return it->second;
+}
+
+std::shared_ptr<IBlob> ShaderFactory::LoadIntoCache(const std::string& relativePath)
+{
+    // The file is read and decompressed without holding the lock, so that multiple
+    // threads can load different files at the same time.
+    std::shared_ptr<IBlob> data = m_fs->readFile(m_basePath / relativePath);
+
+    if (!data)
+        return nullptr;
+
+    std::lock_guard<std::mutex> lockGuard(m_CacheMutex);
+
+    // Another thread may have loaded the same file in the meantime - keep the first copy.
+    auto [it, inserted] = m_BytecodeCache.try_emplace(relativePath, data);
+    if (inserted)
+    {
+        m_LoadedFiles.push_back(relativePath);
+        ++m_FilesLoaded;
+        m_BytesLoaded += data->size();
+    }
+
+    return it->second;
 }
 
 std::shared_ptr<IBlob> ShaderFactory::GetBytecode(const char* fileName, const char* entryName)
@@ -58,24 +102,166 @@ std::shared_ptr<IBlob> ShaderFactory::GetBytecode(const char* fileName, const ch
             adjustedName += "_" + string(entryName);
     }
 
-    std::filesystem::path shaderFilePath = m_basePath / (adjustedName + ".bin");
-
-    std::shared_ptr<IBlob>& data = m_BytecodeCache[shaderFilePath.generic_string()];
+    std::string relativePath = std::filesystem::path(adjustedName + ".bin").lexically_normal().generic_string();
 
-    if (data)
+    if (std::shared_ptr<IBlob> data = FindInCache(relativePath))
+    {
+        ++m_CacheHits;
         return data;
+    }
+
+    ++m_CacheMisses;
 
-    data = m_fs->readFile(shaderFilePath);
+    std::shared_ptr<IBlob> data = LoadIntoCache(relativePath);
 
     if (!data)
     {
-        log::error("Couldn't read the binary file for shader %s from %s", fileName, shaderFilePath.generic_string().c_str());
+        log::error("Couldn't read the binary file for shader %s from %s", fileName, (m_basePath / relativePath).generic_string().c_str());
         return nullptr;
     }
 
     return data;
 }
 
+size_t ShaderFactory::PrefetchBytecode(const std::vector<std::string>& files, tf::Executor* executor)
+{
+#ifndef DONUT_WITH_TASKFLOW
+    (void)executor;
+#endif
+
+    std::vector<std::string> missingFiles;
+    {
+        std::lock_guard<std::mutex> lockGuard(m_CacheMutex);
+
+        for (const std::string& file : files)
+        {
+            std::string relativePath = std::filesystem::path(file).lexically_normal().generic_string();
+            if (m_BytecodeCache.find(relativePath) == m_BytecodeCache.end())
+                missingFiles.push_back(std::move(relativePath));
+        }
+    }
+
+    std::atomic<size_t> filesLoaded = 0;
+    auto loadFile = [this, &missingFiles, &filesLoaded](size_t index)
+    {
+        if (LoadIntoCache(missingFiles[index]))
+            ++filesLoaded;
+        else
+            log::warning("Couldn't prefetch the shader binary %s", (m_basePath / missingFiles[index]).generic_string().c_str());
+    };
+
+#ifdef DONUT_WITH_TASKFLOW
+    if (executor && missingFiles.size() > 1)
+    {
+        tf::Taskflow taskflow;
+        taskflow.for_each_index(size_t(0), missingFiles.size(), size_t(1), loadFile);
+        executor->run(taskflow).wait();
+    }
+    else
+#endif
+    {
+        for (size_t index = 0; index < missingFiles.size(); index++)
+            loadFile(index);
+    }
+
+    m_FilesPrefetched += filesLoaded;
+    return filesLoaded;
+}
+
+size_t ShaderFactory::PrefetchFromManifest(const std::filesystem::path& manifestFile, tf::Executor* executor)
+{
+    std::shared_ptr<IBlob> manifest = m_fs->readFile(manifestFile);
+
+    if (!manifest)
+    {
+        log::warning("Couldn't read the shader manifest %s", manifestFile.generic_string().c_str());
+        return 0;
+    }
+
+    std::vector<std::string> files;
+
+    const char* text = static_cast<const char*>(manifest->data());
+    const char* end = text + manifest->size();
+    while (text < end)
+    {
+        const char* lineEnd = std::find(text, end, '\n');
+        std::string line(text, lineEnd);
+        text = lineEnd < end ? lineEnd + 1 : end;
+
+        while (!line.empty() && isspace(uint8_t(line.back())))
+            line.pop_back();
+        size_t first = line.find_first_not_of(" \t");
+
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+
+        files.push_back(line.substr(first));
+    }
+
+    return PrefetchBytecode(files, executor);
+}
+
+static void EnumerateBytecodeFiles(IFileSystem& fs, const std::filesystem::path& basePath, const std::filesystem::path& directory, std::vector<std::string>& files)
+{
+    const std::filesystem::path path = directory.empty() ? basePath : basePath / directory;
+
+    fs.enumerateFiles(path, { ".bin" }, [&directory, &files](std::string_view name)
+    {
+        files.push_back((directory / name).lexically_normal().generic_string());
+    });
+
+    std::vector<std::string> subdirectories;
+    fs.enumerateDirectories(path, enumerate_to_vector(subdirectories));
+
+    for (const std::string& subdirectory : subdirectories)
+        EnumerateBytecodeFiles(fs, basePath, directory / subdirectory, files);
+}
+
+size_t ShaderFactory::PrefetchDirectory(const std::filesystem::path& directory, tf::Executor* executor)
+{
+    std::vector<std::string> files;
+    EnumerateBytecodeFiles(*m_fs, m_basePath, directory, files);
+
+    return PrefetchBytecode(files, executor);
+}
+
+bool ShaderFactory::WriteManifest(const std::filesystem::path& fileName) const
+{
+    std::ofstream file(fileName, std::ios::out | std::ios::trunc);
+    if (!file.is_open())
+    {
+        log::error("Couldn't open file '%s' for writing", fileName.generic_string().c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lockGuard(m_CacheMutex);
+
+    for (const std::string& loadedFile : m_LoadedFiles)
+        file << loadedFile << '\n';
+
+    return file.good();
+}
+
+ShaderFactoryStats ShaderFactory::GetStats() const
+{
+    ShaderFactoryStats stats;
+    stats.cacheHits = m_CacheHits;
+    stats.cacheMisses = m_CacheMisses;
+    stats.filesLoaded = m_FilesLoaded;
+    stats.bytesLoaded = m_BytesLoaded;
+    stats.filesPrefetched = m_FilesPrefetched;
+    return stats;
+}
+
+void ShaderFactory::ResetStats()
+{
+    m_CacheHits = 0;
+    m_CacheMisses = 0;
+    m_FilesLoaded = 0;
+    m_BytesLoaded = 0;
+    m_FilesPrefetched = 0;
+}
+
 
 nvrhi::ShaderHandle ShaderFactory::CreateShader(const char* fileName, const char* entryName, const vector<ShaderMacro>* pDefines, nvrhi::ShaderType shaderType)
 {
@@ -0,0 +1,341 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/engine/SphericalHarmonics.h>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DONUT_SH_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+using namespace donut::math;
+using namespace donut::engine;
+
+namespace
+{
+    // Maps the face coordinates (a, b) in [-1, 1] to an unnormalized direction: dir = a * A + b * B + C,
+    // where 'a' goes right and 'b' goes up on the face. Matches uvToDirection in light_probe.hlsl.
+    struct FaceAxes
+    {
+        float3 A, B, C;
+    };
+
+    const FaceAxes c_FaceAxes[6] = {
+        { float3( 0.f, 0.f, -1.f), float3(0.f, 1.f,  0.f), float3( 1.f,  0.f,  0.f) }, // +X
+        { float3( 0.f, 0.f,  1.f), float3(0.f, 1.f,  0.f), float3(-1.f,  0.f,  0.f) }, // -X
+        { float3( 1.f, 0.f,  0.f), float3(0.f, 0.f, -1.f), float3( 0.f,  1.f,  0.f) }, // +Y
+        { float3( 1.f, 0.f,  0.f), float3(0.f, 0.f,  1.f), float3( 0.f, -1.f,  0.f) }, // -Y
+        { float3( 1.f, 0.f,  0.f), float3(0.f, 1.f,  0.f), float3( 0.f,  0.f,  1.f) }, // +Z
+        { float3(-1.f, 0.f,  0.f), float3(0.f, 1.f,  0.f), float3( 0.f,  0.f, -1.f) }  // -Z
+    };
+
+    constexpr float c_Basis0 = 0.282094792f;  // 1 / (2 sqrt(pi))
+    constexpr float c_Basis1 = 0.488602512f;  // sqrt(3 / (4 pi))
+    constexpr float c_Basis2 = 1.092548431f;  // sqrt(15 / (4 pi))
+    constexpr float c_Basis3 = 0.315391565f;  // sqrt(5 / (16 pi))
+    constexpr float c_Basis4 = 0.546274215f;  // sqrt(15 / (16 pi))
+
+    struct ProjectionSums
+    {
+        double coefficients[SphericalHarmonicsL2::CoefficientCount][3] = {};
+        double weight = 0.0;
+    };
+
+    // The solid angle of a texel is proportional to 1 / (a^2 + b^2 + 1)^(3/2); the common factor
+    // (2 / size)^2 cancels out when the sums are normalized to the area of the sphere.
+    void AccumulateTexel(const FaceAxes& axes, float a, float b, const float4& color, ProjectionSums& sums)
+    {
+        float3 direction = axes.A * a + axes.B * b + axes.C;
+        float invLength = 1.f / sqrtf(a * a + b * b + 1.f);
+        float weight = invLength * invLength * invLength;
+
+        float basis[SphericalHarmonicsL2::CoefficientCount];
+        SphericalHarmonicsL2::EvaluateBasis(direction * invLength, basis);
+
+        for (int i = 0; i < SphericalHarmonicsL2::CoefficientCount; i++)
+        {
+            double weightedBasis = double(basis[i] * weight);
+            sums.coefficients[i][0] += weightedBasis * color.x;
+            sums.coefficients[i][1] += weightedBasis * color.y;
+            sums.coefficients[i][2] += weightedBasis * color.z;
+        }
+        sums.weight += weight;
+    }
+
+#ifdef DONUT_SH_USE_SSE
+    float HorizontalSum(__m128 v)
+    {
+        __m128 shuffled = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+        __m128 sums = _mm_add_ps(v, shuffled);
+        shuffled = _mm_movehl_ps(shuffled, sums);
+        sums = _mm_add_ss(sums, shuffled);
+        return _mm_cvtss_f32(sums);
+    }
+
+    // Processes the texels of a row in groups of 4 and returns the number of texels done.
+    // Each row is summed in single precision and then added to the double precision totals.
+    uint32_t AccumulateRowSSE(const FaceAxes& axes, const float4* row, uint32_t size, float b, ProjectionSums& sums)
+    {
+        const uint32_t count = size & ~3u;
+        if (count == 0)
+            return 0;
+
+        const __m128 one = _mm_set1_ps(1.f);
+        const __m128 texelScale = _mm_set1_ps(2.f / float(size));
+        const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        const __m128 vb = _mm_set1_ps(b);
+        const __m128 bSquaredPlusOne = _mm_set1_ps(b * b + 1.f);
+
+        __m128 accumulators[SphericalHarmonicsL2::CoefficientCount][3];
+        for (auto& coefficient : accumulators)
+            for (auto& channel : coefficient)
+                channel = _mm_setzero_ps();
+        __m128 weightSum = _mm_setzero_ps();
+
+        for (uint32_t x = 0; x < count; x += 4)
+        {
+            __m128 a = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_set1_ps(float(x)), laneOffsets), texelScale), one);
+
+            __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(a, a), bSquaredPlusOne)));
+            __m128 weight = _mm_mul_ps(_mm_mul_ps(invLength, invLength), invLength);
+
+            __m128 dx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_set1_ps(axes.A.x)), _mm_mul_ps(vb, _mm_set1_ps(axes.B.x))), _mm_set1_ps(axes.C.x));
+            __m128 dy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_set1_ps(axes.A.y)), _mm_mul_ps(vb, _mm_set1_ps(axes.B.y))), _mm_set1_ps(axes.C.y));
+            __m128 dz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_set1_ps(axes.A.z)), _mm_mul_ps(vb, _mm_set1_ps(axes.B.z))), _mm_set1_ps(axes.C.z));
+            dx = _mm_mul_ps(dx, invLength);
+            dy = _mm_mul_ps(dy, invLength);
+            dz = _mm_mul_ps(dz, invLength);
+
+            __m128 basis[SphericalHarmonicsL2::CoefficientCount];
+            basis[0] = _mm_set1_ps(c_Basis0);
+            basis[1] = _mm_mul_ps(_mm_set1_ps(c_Basis1), dy);
+            basis[2] = _mm_mul_ps(_mm_set1_ps(c_Basis1), dz);
+            basis[3] = _mm_mul_ps(_mm_set1_ps(c_Basis1), dx);
+            basis[4] = _mm_mul_ps(_mm_set1_ps(c_Basis2), _mm_mul_ps(dx, dy));
+            basis[5] = _mm_mul_ps(_mm_set1_ps(c_Basis2), _mm_mul_ps(dy, dz));
+            basis[6] = _mm_mul_ps(_mm_set1_ps(c_Basis3), _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(3.f), _mm_mul_ps(dz, dz)), one));
+            basis[7] = _mm_mul_ps(_mm_set1_ps(c_Basis2), _mm_mul_ps(dx, dz));
+            basis[8] = _mm_mul_ps(_mm_set1_ps(c_Basis4), _mm_sub_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+
+            // Texels are RGBA, transpose them into one register per channel
+            __m128 red = _mm_loadu_ps(&row[x + 0].x);
+            __m128 green = _mm_loadu_ps(&row[x + 1].x);
+            __m128 blue = _mm_loadu_ps(&row[x + 2].x);
+            __m128 alpha = _mm_loadu_ps(&row[x + 3].x);
+            _MM_TRANSPOSE4_PS(red, green, blue, alpha);
+
+            red = _mm_mul_ps(red, weight);
+            green = _mm_mul_ps(green, weight);
+            blue = _mm_mul_ps(blue, weight);
+
+            for (int i = 0; i < SphericalHarmonicsL2::CoefficientCount; i++)
+            {
+                accumulators[i][0] = _mm_add_ps(accumulators[i][0], _mm_mul_ps(basis[i], red));
+                accumulators[i][1] = _mm_add_ps(accumulators[i][1], _mm_mul_ps(basis[i], green));
+                accumulators[i][2] = _mm_add_ps(accumulators[i][2], _mm_mul_ps(basis[i], blue));
+            }
+            weightSum = _mm_add_ps(weightSum, weight);
+        }
+
+        for (int i = 0; i < SphericalHarmonicsL2::CoefficientCount; i++)
+            for (int channel = 0; channel < 3; channel++)
+                sums.coefficients[i][channel] += double(HorizontalSum(accumulators[i][channel]));
+        sums.weight += double(HorizontalSum(weightSum));
+
+        return count;
+    }
+#endif
+}
+
+void CubemapImage::Resize(uint32_t faceSize)
+{
+    size = faceSize;
+    texels.resize(size_t(6) * faceSize * faceSize);
+}
+
+float3 CubemapImage::GetTexelDirection(uint32_t face, uint32_t x, uint32_t y, uint32_t size)
+{
+    const FaceAxes& axes = c_FaceAxes[face];
+    float a = (float(x) + 0.5f) * 2.f / float(size) - 1.f;
+    float b = 1.f - (float(y) + 0.5f) * 2.f / float(size);
+    return normalize(axes.A * a + axes.B * b + axes.C);
+}
+
+float4 CubemapImage::Sample(const float3& direction) const
+{
+    if (size == 0)
+        return float4(0.f);
+
+    float3 absolute = abs(direction);
+    uint32_t face;
+    float a, b, majorAxis;
+    if (absolute.x >= absolute.y && absolute.x >= absolute.z)
+    {
+        majorAxis = absolute.x;
+        face = direction.x >= 0.f ? 0 : 1;
+        a = direction.x >= 0.f ? -direction.z : direction.z;
+        b = direction.y;
+    }
+    else if (absolute.y >= absolute.z)
+    {
+        majorAxis = absolute.y;
+        face = direction.y >= 0.f ? 2 : 3;
+        a = direction.x;
+        b = direction.y >= 0.f ? -direction.z : direction.z;
+    }
+    else
+    {
+        majorAxis = absolute.z;
+        face = direction.z >= 0.f ? 4 : 5;
+        a = direction.z >= 0.f ? direction.x : -direction.x;
+        b = direction.y;
+    }
+
+    if (majorAxis <= 0.f)
+        return float4(0.f);
+
+    float u = (a / majorAxis + 1.f) * 0.5f;
+    float v = (1.f - b / majorAxis) * 0.5f;
+
+    float fx = clamp(u * float(size) - 0.5f, 0.f, float(size - 1));
+    float fy = clamp(v * float(size) - 0.5f, 0.f, float(size - 1));
+    uint32_t x0 = uint32_t(fx);
+    uint32_t y0 = uint32_t(fy);
+    uint32_t x1 = std::min(x0 + 1, size - 1);
+    uint32_t y1 = std::min(y0 + 1, size - 1);
+    float tx = fx - float(x0);
+    float ty = fy - float(y0);
+
+    const float4* texels = GetFace(face);
+    float4 top = lerp(texels[y0 * size + x0], texels[y0 * size + x1], tx);
+    float4 bottom = lerp(texels[y1 * size + x0], texels[y1 * size + x1], tx);
+    return lerp(top, bottom, ty);
+}
+
+void SphericalHarmonicsL2::EvaluateBasis(const float3& direction, float basis[CoefficientCount])
+{
+    const float x = direction.x;
+    const float y = direction.y;
+    const float z = direction.z;
+
+    basis[0] = c_Basis0;
+    basis[1] = c_Basis1 * y;
+    basis[2] = c_Basis1 * z;
+    basis[3] = c_Basis1 * x;
+    basis[4] = c_Basis2 * x * y;
+    basis[5] = c_Basis2 * y * z;
+    basis[6] = c_Basis3 * (3.f * z * z - 1.f);
+    basis[7] = c_Basis2 * x * z;
+    basis[8] = c_Basis4 * (x * x - y * y);
+}
+
+float3 SphericalHarmonicsL2::Evaluate(const float3& direction) const
+{
+    float basis[CoefficientCount];
+    EvaluateBasis(direction, basis);
+
+    float3 result = 0.f;
+    for (int i = 0; i < CoefficientCount; i++)
+        result += coefficients[i] * basis[i];
+    return result;
+}
+
+SphericalHarmonicsL2 SphericalHarmonicsL2::ConvolveWithCosineLobe() const
+{
+    // Zonal coefficients of the clamped cosine per band, including the sqrt(4 pi / (2l + 1)) factor
+    // [Ramamoorthi and Hanrahan 2001, "An Efficient Representation for Irradiance Environment Maps"]
+    constexpr float band0 = PI_f;
+    constexpr float band1 = 2.f * PI_f / 3.f;
+    constexpr float band2 = PI_f / 4.f;
+
+    SphericalHarmonicsL2 result = *this;
+    result.coefficients[0] *= band0;
+    for (int i = 1; i < 4; i++)
+        result.coefficients[i] *= band1;
+    for (int i = 4; i < CoefficientCount; i++)
+        result.coefficients[i] *= band2;
+    return result;
+}
+
+SphericalHarmonicsL2& SphericalHarmonicsL2::operator+=(const SphericalHarmonicsL2& other)
+{
+    for (int i = 0; i < CoefficientCount; i++)
+        coefficients[i] += other.coefficients[i];
+    return *this;
+}
+
+SphericalHarmonicsL2& SphericalHarmonicsL2::operator*=(float scale)
+{
+    for (int i = 0; i < CoefficientCount; i++)
+        coefficients[i] *= scale;
+    return *this;
+}
+
+namespace donut::engine
+{
+    SphericalHarmonicsL2 ProjectCubemapToSH(const CubemapImage& cubemap)
+    {
+        SphericalHarmonicsL2 result;
+        if (cubemap.size == 0 || cubemap.texels.size() < size_t(6) * cubemap.size * cubemap.size)
+            return result;
+
+        const uint32_t size = cubemap.size;
+        ProjectionSums sums;
+
+        for (uint32_t face = 0; face < 6; face++)
+        {
+            const FaceAxes& axes = c_FaceAxes[face];
+            const float4* texels = cubemap.GetFace(face);
+
+            for (uint32_t y = 0; y < size; y++)
+            {
+                const float4* row = texels + y * size;
+                const float b = 1.f - (float(y) + 0.5f) * 2.f / float(size);
+
+                uint32_t x = 0;
+#ifdef DONUT_SH_USE_SSE
+                x = AccumulateRowSSE(axes, row, size, b, sums);
+#endif
+                for (; x < size; x++)
+                {
+                    const float a = (float(x) + 0.5f) * 2.f / float(size) - 1.f;
+                    AccumulateTexel(axes, a, b, row[x], sums);
+                }
+            }
+        }
+
+        // Normalizing the texel weights to the area of the sphere removes the discretization error
+        // of the solid angle approximation
+        const double normalization = 4.0 * double(PI_f) / sums.weight;
+        for (int i = 0; i < SphericalHarmonicsL2::CoefficientCount; i++)
+        {
+            result.coefficients[i] = float3(
+                float(sums.coefficients[i][0] * normalization),
+                float(sums.coefficients[i][1] * normalization),
+                float(sums.coefficients[i][2] * normalization));
+        }
+
+        return result;
+    }
+}
@@ -342,6 +342,12 @@ uint GetMipLevelsNum(uint width, uint height)
 }
 
 void TextureCache::FinalizeTexture(std::shared_ptr<TextureData> texture, CommonRenderPasses* passes, nvrhi::ICommandList* commandList)
+{
+    if (UploadTexture(texture, passes, commandList))
+        GenerateMipmaps({ texture }, passes, commandList);
+}
+
+bool TextureCache::UploadTexture(const std::shared_ptr<TextureData>& texture, CommonRenderPasses* passes, nvrhi::ICommandList* commandList)
 {
     assert(texture->data);
     assert(commandList);
@@ -451,30 +457,48 @@ void TextureCache::FinalizeTexture(std::shared_ptr<TextureData> texture, CommonR
 
     texture->data.reset();
 
-    uint width = scaledWidth;
-    uint height = scaledHeight;
-    for (uint mipLevel = texture->mipLevels; mipLevel < textureDesc.mipLevels; mipLevel++)
-    {
-        width /= 2;
-        height /= 2;
+    ++m_TexturesFinalized;
 
-        nvrhi::FramebufferHandle framebuffer = m_Device->createFramebuffer(nvrhi::FramebufferDesc()
-            .addColorAttachment(nvrhi::FramebufferAttachment()
-                .setTexture(texture->texture)
-                .setArraySlice(0)
-                .setMipLevel(mipLevel)));
-        
-        BlitParameters blitParams;
-        blitParams.sourceTexture = texture->texture;
-        blitParams.sourceMip = mipLevel - 1;
-        blitParams.targetFramebuffer = framebuffer;
-        passes->BlitTexture(commandList, blitParams);
-    }
+    if (texture->mipLevels < textureDesc.mipLevels)
+        return true;
 
     commandList->setPermanentTextureState(texture->texture, nvrhi::ResourceStates::ShaderResource);
     commandList->commitBarriers();
 
-    ++m_TexturesFinalized;
+    return false;
+}
+
+void TextureCache::GenerateMipmaps(const std::vector<std::shared_ptr<TextureData>>& textures, CommonRenderPasses* passes, nvrhi::ICommandList* commandList)
+{
+    uint32_t maxMipLevels = 0;
+    for (const auto& texture : textures)
+        maxMipLevels = std::max(maxMipLevels, texture->texture->getDesc().mipLevels);
+
+    for (uint mipLevel = 1; mipLevel < maxMipLevels; mipLevel++)
+    {
+        for (const auto& texture : textures)
+        {
+            if (mipLevel < texture->mipLevels || mipLevel >= texture->texture->getDesc().mipLevels)
+                continue;
+
+            nvrhi::FramebufferHandle framebuffer = m_Device->createFramebuffer(nvrhi::FramebufferDesc()
+                .addColorAttachment(nvrhi::FramebufferAttachment()
+                    .setTexture(texture->texture)
+                    .setArraySlice(0)
+                    .setMipLevel(mipLevel)));
+
+            BlitParameters blitParams;
+            blitParams.sourceTexture = texture->texture;
+            blitParams.sourceMip = mipLevel - 1;
+            blitParams.targetFramebuffer = framebuffer;
+            passes->BlitTexture(commandList, blitParams);
+        }
+    }
+
+    for (const auto& texture : textures)
+        commandList->setPermanentTextureState(texture->texture, nvrhi::ResourceStates::ShaderResource);
+
+    commandList->commitBarriers();
 }
 
 void TextureCache::TextureLoaded(std::shared_ptr<TextureData> texture)
@@ -530,9 +554,7 @@ std::shared_ptr<LoadedTexture> TextureCache::LoadTextureFromFileDeferred(const s
         {
             TextureLoaded(texture);
 
-            std::lock_guard<std::mutex> guard(m_TexturesToFinalizeMutex);
-
-            m_TexturesToFinalize.push(texture);
+            m_UploadScheduler.Enqueue(texture);
         }
     }
 
@@ -561,9 +583,7 @@ std::shared_ptr<LoadedTexture> TextureCache::LoadTextureFromFileAsync(const std:
             {
                 TextureLoaded(texture);
 
-                std::lock_guard<std::mutex> guard(m_TexturesToFinalizeMutex);
-
-                m_TexturesToFinalize.push(texture);
+                m_UploadScheduler.Enqueue(texture);
             }
         }
 
@@ -605,9 +625,7 @@ std::shared_ptr<LoadedTexture> TextureCache::LoadTextureFromMemoryDeferred(const
     {
         TextureLoaded(texture);
 
-        std::lock_guard<std::mutex> guard(m_TexturesToFinalizeMutex);
-
-        m_TexturesToFinalize.push(texture);
+        m_UploadScheduler.Enqueue(texture);
     }
     
     ++m_TexturesLoaded;
@@ -629,9 +647,7 @@ std::shared_ptr<LoadedTexture> TextureCache::LoadTextureFromMemoryAsync(const st
             {
                 TextureLoaded(texture);
 
-                std::lock_guard<std::mutex> guard(m_TexturesToFinalizeMutex);
-
-                m_TexturesToFinalize.push(texture);
+                m_UploadScheduler.Enqueue(texture);
             }
 
             ++m_TexturesLoaded;
@@ -647,56 +663,67 @@ std::shared_ptr<TextureData> TextureCache::GetLoadedTexture(std::filesystem::pat
 	return m_LoadedTextures[path.generic_string()];
 }
 
-bool TextureCache::ProcessRenderingThreadCommands(CommonRenderPasses& passes, float timeLimitMilliseconds)
+class TextureCache::Uploader : public ITextureUploader
 {
-    using namespace std::chrono;
+private:
+    TextureCache& m_Cache;
+    CommonRenderPasses& m_Passes;
 
-    time_point<high_resolution_clock> startTime = high_resolution_clock::now();
+public:
+    Uploader(TextureCache& cache, CommonRenderPasses& passes)
+        : m_Cache(cache)
+        , m_Passes(passes)
+    { }
 
-    uint commandsExecuted = 0;
-    while (true)
+    void BeginBatch() override
     {
-        std::shared_ptr<TextureData> pTexture;
-
-        if (timeLimitMilliseconds > 0 && commandsExecuted > 0)
+        if (!m_Cache.m_CommandList)
         {
-            time_point<high_resolution_clock> now = high_resolution_clock::now();
-
-            if (float(duration_cast<microseconds>(now - startTime).count()) > timeLimitMilliseconds * 1e3f)
-                break;
+            m_Cache.m_CommandList = m_Cache.m_Device->createCommandList();
         }
 
-        {
-            std::lock_guard<std::mutex> guard(m_TexturesToFinalizeMutex);
+        m_Cache.m_CommandList->open();
+    }
 
-            if (m_TexturesToFinalize.empty())
-                break;
+    nvrhi::Format UploadTexture(const std::shared_ptr<TextureData>& texture) override
+    {
+        return m_Cache.UploadTexture(texture, &m_Passes, m_Cache.m_CommandList)
+            ? texture->texture->getDesc().format
+            : nvrhi::Format::UNKNOWN;
+    }
 
-            pTexture = m_TexturesToFinalize.front();
-            m_TexturesToFinalize.pop();
-        }
+    void GenerateMipmaps(nvrhi::Format /*format*/, const std::vector<std::shared_ptr<TextureData>>& textures) override
+    {
+        m_Cache.GenerateMipmaps(textures, &m_Passes, m_Cache.m_CommandList);
+    }
 
-        if (pTexture->data)
-        {
-            //LOG("Finalizing texture %s", pTexture->fileName.c_str());
-            commandsExecuted += 1;
+    void EndBatch() override
+    {
+        m_Cache.m_CommandList->close();
+        m_Cache.m_Device->executeCommandList(m_Cache.m_CommandList);
+        m_Cache.m_Device->runGarbageCollection();
+    }
+};
 
-            if (!m_CommandList)
-            {
-                m_CommandList = m_Device->createCommandList();
-            }
+bool TextureCache::ProcessRenderingThreadCommands(CommonRenderPasses& passes, float timeLimitMilliseconds)
+{
+    Uploader uploader(*this, passes);
 
-            m_CommandList->open();
+    if (timeLimitMilliseconds > 0)
+        return m_UploadScheduler.ProcessBatch(uploader, m_UploadBudgetBytes, timeLimitMilliseconds) > 0;
 
-            FinalizeTexture(pTexture, &passes, m_CommandList);
+    uint32_t texturesProcessed = 0;
+    while (uint32_t count = m_UploadScheduler.ProcessBatch(uploader, m_UploadBudgetBytes))
+        texturesProcessed += count;
 
-            m_CommandList->close();
-            m_Device->executeCommandList(m_CommandList);
-            m_Device->runGarbageCollection();
-        }
-    }
+    return texturesProcessed > 0;
+}
 
-    return (commandsExecuted > 0);
+void TextureCache::SetTextureUploadPriority(const std::shared_ptr<LoadedTexture>& _texture, float priority)
+{
+    std::shared_ptr<TextureData> texture = std::static_pointer_cast<TextureData>(_texture);
+    if (texture)
+        m_UploadScheduler.SetPriority(*texture, priority);
 }
 
 void TextureCache::LoadingFinished()
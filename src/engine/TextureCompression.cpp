@@ -0,0 +1,769 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/engine/TextureCompression.h>
+#include <donut/engine/DDSFile.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/core/parallel.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+using namespace donut::engine;
+using namespace donut::core;
+
+namespace
+{
+    struct Block
+    {
+        uint8_t pixels[16][4];
+    };
+
+    // Reads a 4x4 block, replicating the last row and column for partial blocks at the edges
+    void LoadBlock(const uint8_t* rgba, uint32_t width, uint32_t height, size_t rowPitch, uint32_t blockX, uint32_t blockY, Block& block)
+    {
+        for (uint32_t y = 0; y < 4; y++)
+        {
+            const uint8_t* row = rgba + std::min(blockY * 4 + y, height - 1) * rowPitch;
+            for (uint32_t x = 0; x < 4; x++)
+            {
+                uint32_t pixelX = std::min(blockX * 4 + x, width - 1);
+                memcpy(block.pixels[y * 4 + x], row + pixelX * 4, 4);
+            }
+        }
+    }
+
+    // Computes the mean of the values and the direction of their largest variance
+    template<int N>
+    void ComputePrincipalAxis(const float values[16][N], float mean[N], float axis[N])
+    {
+        for (int c = 0; c < N; c++)
+        {
+            mean[c] = 0.f;
+            for (int i = 0; i < 16; i++)
+                mean[c] += values[i][c];
+            mean[c] *= 1.f / 16.f;
+        }
+
+        float covariance[N][N] = {};
+        for (int i = 0; i < 16; i++)
+        {
+            float d[N];
+            for (int c = 0; c < N; c++)
+                d[c] = values[i][c] - mean[c];
+
+            for (int a = 0; a < N; a++)
+                for (int b = 0; b < N; b++)
+                    covariance[a][b] += d[a] * d[b];
+        }
+
+        // power iteration, starting from the row of the channel with the largest variance
+        int start = 0;
+        for (int c = 1; c < N; c++)
+            if (covariance[c][c] > covariance[start][start])
+                start = c;
+
+        for (int c = 0; c < N; c++)
+            axis[c] = covariance[start][c];
+
+        for (int iteration = 0; iteration < 8; iteration++)
+        {
+            float next[N] = {};
+            float largest = 0.f;
+            for (int a = 0; a < N; a++)
+            {
+                for (int b = 0; b < N; b++)
+                    next[a] += covariance[a][b] * axis[b];
+                largest = std::max(largest, std::abs(next[a]));
+            }
+
+            if (largest == 0.f)
+                break;
+
+            for (int c = 0; c < N; c++)
+                axis[c] = next[c] / largest;
+        }
+
+        float length = 0.f;
+        for (int c = 0; c < N; c++)
+            length += axis[c] * axis[c];
+        length = sqrtf(length);
+
+        for (int c = 0; c < N; c++)
+            axis[c] = (length > 0.f) ? axis[c] / length : 0.f;
+    }
+
+    // Initial endpoints: the extremes of the values projected onto the principal axis
+    template<int N>
+    void ComputeAxisEndpoints(const float values[16][N], float endpoint0[N], float endpoint1[N])
+    {
+        float mean[N];
+        float axis[N];
+        ComputePrincipalAxis<N>(values, mean, axis);
+
+        float minT = 0.f;
+        float maxT = 0.f;
+        for (int i = 0; i < 16; i++)
+        {
+            float t = 0.f;
+            for (int c = 0; c < N; c++)
+                t += (values[i][c] - mean[c]) * axis[c];
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+
+        for (int c = 0; c < N; c++)
+        {
+            endpoint0[c] = mean[c] + axis[c] * maxT;
+            endpoint1[c] = mean[c] + axis[c] * minT;
+        }
+    }
+
+    // Least squares endpoints for the given interpolation weights, value = endpoint0 * (1 - w) + endpoint1 * w
+    template<int N>
+    bool FitEndpoints(const float values[16][N], const float weights[16], float endpoint0[N], float endpoint1[N])
+    {
+        float a = 0.f, b = 0.f, c = 0.f;
+        float x0[N] = {};
+        float x1[N] = {};
+        for (int i = 0; i < 16; i++)
+        {
+            float w1 = weights[i];
+            float w0 = 1.f - w1;
+            a += w0 * w0;
+            b += w0 * w1;
+            c += w1 * w1;
+            for (int ch = 0; ch < N; ch++)
+            {
+                x0[ch] += w0 * values[i][ch];
+                x1[ch] += w1 * values[i][ch];
+            }
+        }
+
+        float det = a * c - b * b;
+        if (std::abs(det) < 1e-6f)
+            return false;
+
+        float invDet = 1.f / det;
+        for (int ch = 0; ch < N; ch++)
+        {
+            endpoint0[ch] = std::clamp((c * x0[ch] - b * x1[ch]) * invDet, 0.f, 255.f);
+            endpoint1[ch] = std::clamp((a * x1[ch] - b * x0[ch]) * invDet, 0.f, 255.f);
+        }
+        return true;
+    }
+
+    // BC1 color
+
+    uint16_t PackRGB565(const float color[3])
+    {
+        int r = std::clamp(int(color[0] * (31.f / 255.f) + 0.5f), 0, 31);
+        int g = std::clamp(int(color[1] * (63.f / 255.f) + 0.5f), 0, 63);
+        int b = std::clamp(int(color[2] * (31.f / 255.f) + 0.5f), 0, 31);
+        return uint16_t((r << 11) | (g << 5) | b);
+    }
+
+    void UnpackRGB565(uint16_t packed, int color[3])
+    {
+        int r = (packed >> 11) & 31;
+        int g = (packed >> 5) & 63;
+        int b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    // Selects the nearest 4-color palette entry for each pixel, returns the total squared error
+    float FindColorIndices(const float values[16][3], uint16_t color0, uint16_t color1, uint8_t indices[16])
+    {
+        int palette[4][3];
+        UnpackRGB565(color0, palette[0]);
+        UnpackRGB565(color1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        float totalError = 0.f;
+        for (int i = 0; i < 16; i++)
+        {
+            float bestError = FLT_MAX;
+            for (uint8_t index = 0; index < 4; index++)
+            {
+                float error = 0.f;
+                for (int c = 0; c < 3; c++)
+                {
+                    float d = values[i][c] - float(palette[index][c]);
+                    error += d * d;
+                }
+
+                if (error < bestError)
+                {
+                    bestError = error;
+                    indices[i] = index;
+                }
+            }
+            totalError += bestError;
+        }
+        return totalError;
+    }
+
+    void EncodeColorBlock(const Block& block, uint8_t* output)
+    {
+        float values[16][3];
+        for (int i = 0; i < 16; i++)
+            for (int c = 0; c < 3; c++)
+                values[i][c] = float(block.pixels[i][c]);
+
+        float endpoint0[3], endpoint1[3];
+        ComputeAxisEndpoints<3>(values, endpoint0, endpoint1);
+
+        uint16_t color0 = PackRGB565(endpoint0);
+        uint16_t color1 = PackRGB565(endpoint1);
+        uint8_t indices[16];
+        float error = FindColorIndices(values, color0, color1, indices);
+
+        static const float c_Weights[4] = { 0.f, 1.f, 1.f / 3.f, 2.f / 3.f };
+        float weights[16];
+        for (int i = 0; i < 16; i++)
+            weights[i] = c_Weights[indices[i]];
+
+        if (error > 0.f && FitEndpoints<3>(values, weights, endpoint0, endpoint1))
+        {
+            uint16_t refined0 = PackRGB565(endpoint0);
+            uint16_t refined1 = PackRGB565(endpoint1);
+            uint8_t refinedIndices[16];
+            if (FindColorIndices(values, refined0, refined1, refinedIndices) < error)
+            {
+                color0 = refined0;
+                color1 = refined1;
+                memcpy(indices, refinedIndices, sizeof(indices));
+            }
+        }
+
+        // color0 > color1 selects the 4-color mode
+        if (color0 < color1)
+        {
+            std::swap(color0, color1);
+            for (int i = 0; i < 16; i++)
+                indices[i] ^= 1;
+        }
+        else if (color0 == color1)
+        {
+            memset(indices, 0, sizeof(indices));
+        }
+
+        uint32_t packedIndices = 0;
+        for (int i = 0; i < 16; i++)
+            packedIndices |= uint32_t(indices[i]) << (i * 2);
+
+        output[0] = uint8_t(color0);
+        output[1] = uint8_t(color0 >> 8);
+        output[2] = uint8_t(color1);
+        output[3] = uint8_t(color1 >> 8);
+        memcpy(output + 4, &packedIndices, 4);
+    }
+
+    // BC4 single channel, also used for the alpha of BC3 and both channels of BC5
+
+    void EncodeChannelBlock(const Block& block, int channel, uint8_t* output)
+    {
+        int low = 255, high = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            low = std::min(low, int(block.pixels[i][channel]));
+            high = std::max(high, int(block.pixels[i][channel]));
+        }
+
+        memset(output, 0, 8);
+        output[0] = uint8_t(high);
+        output[1] = uint8_t(low);
+
+        if (low == high)
+            return;
+
+        auto findIndices = [&block, channel](int endpoint0, int endpoint1, uint8_t indices[16]) {
+            // 8-value mode, endpoint0 > endpoint1
+            int palette[8];
+            palette[0] = endpoint0;
+            palette[1] = endpoint1;
+            for (int index = 2; index < 8; index++)
+                palette[index] = ((8 - index) * endpoint0 + (index - 1) * endpoint1 + 3) / 7;
+
+            int totalError = 0;
+            for (int i = 0; i < 16; i++)
+            {
+                int value = block.pixels[i][channel];
+                int bestError = INT32_MAX;
+                for (uint8_t index = 0; index < 8; index++)
+                {
+                    int error = (value - palette[index]) * (value - palette[index]);
+                    if (error < bestError)
+                    {
+                        bestError = error;
+                        indices[i] = index;
+                    }
+                }
+                totalError += bestError;
+            }
+            return totalError;
+        };
+
+        uint8_t indices[16];
+        int error = findIndices(high, low, indices);
+
+        if (error > 0)
+        {
+            float values[16][1];
+            float weights[16];
+            for (int i = 0; i < 16; i++)
+            {
+                values[i][0] = float(block.pixels[i][channel]);
+                weights[i] = (indices[i] == 0) ? 0.f : (indices[i] == 1) ? 1.f : float(indices[i] - 1) / 7.f;
+            }
+
+            float endpoint0[1], endpoint1[1];
+            if (FitEndpoints<1>(values, weights, endpoint0, endpoint1))
+            {
+                int refined0 = int(endpoint0[0] + 0.5f);
+                int refined1 = int(endpoint1[0] + 0.5f);
+                uint8_t refinedIndices[16];
+                if (refined0 > refined1 && findIndices(refined0, refined1, refinedIndices) < error)
+                {
+                    output[0] = uint8_t(refined0);
+                    output[1] = uint8_t(refined1);
+                    memcpy(indices, refinedIndices, sizeof(indices));
+                }
+            }
+        }
+
+        uint64_t packedIndices = 0;
+        for (int i = 0; i < 16; i++)
+            packedIndices |= uint64_t(indices[i]) << (i * 3);
+
+        for (int byte = 0; byte < 6; byte++)
+            output[2 + byte] = uint8_t(packedIndices >> (byte * 8));
+    }
+
+    // BC7 mode 6: RGBA endpoints with 7 bits per channel and a shared LSB per endpoint, 4-bit indices
+
+    const int c_BC7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    struct BC7Endpoint
+    {
+        int quantized[4];
+        int pBit;
+        int expanded[4];
+    };
+
+    void QuantizeBC7Endpoint(const float endpoint[4], BC7Endpoint& result)
+    {
+        float bestError = FLT_MAX;
+        for (int pBit = 0; pBit < 2; pBit++)
+        {
+            BC7Endpoint candidate;
+            candidate.pBit = pBit;
+            float error = 0.f;
+            for (int c = 0; c < 4; c++)
+            {
+                candidate.quantized[c] = std::clamp(int(floorf((endpoint[c] - float(pBit)) * 0.5f + 0.5f)), 0, 127);
+                candidate.expanded[c] = (candidate.quantized[c] << 1) | pBit;
+                float d = float(candidate.expanded[c]) - endpoint[c];
+                error += d * d;
+            }
+
+            if (error < bestError)
+            {
+                bestError = error;
+                result = candidate;
+            }
+        }
+    }
+
+    float FindBC7Indices(const float values[16][4], const BC7Endpoint& endpoint0, const BC7Endpoint& endpoint1, uint8_t indices[16])
+    {
+        int palette[16][4];
+        for (int index = 0; index < 16; index++)
+            for (int c = 0; c < 4; c++)
+                palette[index][c] = ((64 - c_BC7Weights[index]) * endpoint0.expanded[c] + c_BC7Weights[index] * endpoint1.expanded[c] + 32) >> 6;
+
+        float totalError = 0.f;
+        for (int i = 0; i < 16; i++)
+        {
+            float bestError = FLT_MAX;
+            for (uint8_t index = 0; index < 16; index++)
+            {
+                float error = 0.f;
+                for (int c = 0; c < 4; c++)
+                {
+                    float d = values[i][c] - float(palette[index][c]);
+                    error += d * d;
+                }
+
+                if (error < bestError)
+                {
+                    bestError = error;
+                    indices[i] = index;
+                }
+            }
+            totalError += bestError;
+        }
+        return totalError;
+    }
+
+    struct BitWriter
+    {
+        uint8_t* output;
+        uint32_t position = 0;
+
+        void Write(uint32_t value, uint32_t bits)
+        {
+            for (uint32_t bit = 0; bit < bits; bit++, position++)
+            {
+                if ((value >> bit) & 1)
+                    output[position >> 3] |= uint8_t(1 << (position & 7));
+            }
+        }
+    };
+
+    void EncodeBC7Block(const Block& block, uint8_t* output)
+    {
+        float values[16][4];
+        for (int i = 0; i < 16; i++)
+            for (int c = 0; c < 4; c++)
+                values[i][c] = float(block.pixels[i][c]);
+
+        float endpoint0[4], endpoint1[4];
+        ComputeAxisEndpoints<4>(values, endpoint0, endpoint1);
+
+        BC7Endpoint quantized0, quantized1;
+        QuantizeBC7Endpoint(endpoint0, quantized0);
+        QuantizeBC7Endpoint(endpoint1, quantized1);
+        uint8_t indices[16];
+        float error = FindBC7Indices(values, quantized0, quantized1, indices);
+
+        float weights[16];
+        for (int i = 0; i < 16; i++)
+            weights[i] = float(c_BC7Weights[indices[i]]) / 64.f;
+
+        if (error > 0.f && FitEndpoints<4>(values, weights, endpoint0, endpoint1))
+        {
+            BC7Endpoint refined0, refined1;
+            QuantizeBC7Endpoint(endpoint0, refined0);
+            QuantizeBC7Endpoint(endpoint1, refined1);
+            uint8_t refinedIndices[16];
+            if (FindBC7Indices(values, refined0, refined1, refinedIndices) < error)
+            {
+                quantized0 = refined0;
+                quantized1 = refined1;
+                memcpy(indices, refinedIndices, sizeof(indices));
+            }
+        }
+
+        // the MSB of the first index is implicitly 0
+        if (indices[0] & 8)
+        {
+            std::swap(quantized0, quantized1);
+            for (int i = 0; i < 16; i++)
+                indices[i] = uint8_t(15 - indices[i]);
+        }
+
+        memset(output, 0, 16);
+        BitWriter writer{ output };
+        writer.Write(1 << 6, 7); // mode 6
+        for (int c = 0; c < 4; c++)
+        {
+            writer.Write(uint32_t(quantized0.quantized[c]), 7);
+            writer.Write(uint32_t(quantized1.quantized[c]), 7);
+        }
+        writer.Write(uint32_t(quantized0.pBit), 1);
+        writer.Write(uint32_t(quantized1.pBit), 1);
+        writer.Write(indices[0], 3);
+        for (int i = 1; i < 16; i++)
+            writer.Write(indices[i], 4);
+    }
+
+    void EncodeBC1(const Block& block, uint8_t* output)
+    {
+        EncodeColorBlock(block, output);
+    }
+
+    void EncodeBC3(const Block& block, uint8_t* output)
+    {
+        EncodeChannelBlock(block, 3, output);
+        EncodeColorBlock(block, output + 8);
+    }
+
+    void EncodeBC4(const Block& block, uint8_t* output)
+    {
+        EncodeChannelBlock(block, 0, output);
+    }
+
+    void EncodeBC5(const Block& block, uint8_t* output)
+    {
+        EncodeChannelBlock(block, 0, output);
+        EncodeChannelBlock(block, 1, output + 8);
+    }
+
+    typedef void (*BlockEncoder)(const Block& block, uint8_t* output);
+
+    BlockEncoder GetBlockEncoder(nvrhi::Format format)
+    {
+        switch (format)
+        {
+        case nvrhi::Format::BC1_UNORM:
+        case nvrhi::Format::BC1_UNORM_SRGB:
+            return &EncodeBC1;
+        case nvrhi::Format::BC3_UNORM:
+        case nvrhi::Format::BC3_UNORM_SRGB:
+            return &EncodeBC3;
+        case nvrhi::Format::BC4_UNORM:
+            return &EncodeBC4;
+        case nvrhi::Format::BC5_UNORM:
+            return &EncodeBC5;
+        case nvrhi::Format::BC7_UNORM:
+        case nvrhi::Format::BC7_UNORM_SRGB:
+            return &EncodeBC7Block;
+        default:
+            return nullptr;
+        }
+    }
+
+    // Mip generation
+
+    float SrgbToLinear(uint8_t value)
+    {
+        static const std::vector<float> table = []() {
+            std::vector<float> result(256);
+            for (int i = 0; i < 256; i++)
+            {
+                float c = float(i) / 255.f;
+                result[i] = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+            }
+            return result;
+        }();
+        return table[value];
+    }
+
+    uint8_t LinearToSrgb(float value)
+    {
+        float c = (value <= 0.0031308f) ? value * 12.92f : 1.055f * powf(value, 1.f / 2.4f) - 0.055f;
+        return uint8_t(std::clamp(c * 255.f + 0.5f, 0.f, 255.f));
+    }
+
+    // 2x2 box filter; sRGB colors are averaged in linear space and normals are renormalized
+    std::vector<uint8_t> Downsample(const uint8_t* rgba, uint32_t width, uint32_t height, size_t rowPitch, TextureRole role, bool sRGB)
+    {
+        uint32_t outputWidth = std::max(width / 2, 1u);
+        uint32_t outputHeight = std::max(height / 2, 1u);
+        std::vector<uint8_t> result(size_t(outputWidth) * outputHeight * 4);
+
+        const bool linearize = (role == TextureRole::BaseColor) && sRGB;
+
+        for (uint32_t y = 0; y < outputHeight; y++)
+        {
+            const uint8_t* row0 = rgba + std::min(y * 2, height - 1) * rowPitch;
+            const uint8_t* row1 = rgba + std::min(y * 2 + 1, height - 1) * rowPitch;
+
+            for (uint32_t x = 0; x < outputWidth; x++)
+            {
+                const uint8_t* texels[4] = {
+                    row0 + std::min(x * 2, width - 1) * 4,
+                    row0 + std::min(x * 2 + 1, width - 1) * 4,
+                    row1 + std::min(x * 2, width - 1) * 4,
+                    row1 + std::min(x * 2 + 1, width - 1) * 4
+                };
+
+                uint8_t* output = &result[(size_t(y) * outputWidth + x) * 4];
+
+                if (role == TextureRole::Normal)
+                {
+                    float normal[3] = {};
+                    for (const uint8_t* texel : texels)
+                        for (int c = 0; c < 3; c++)
+                            normal[c] += float(texel[c]) / 127.5f - 1.f;
+
+                    float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+                    for (int c = 0; c < 3; c++)
+                    {
+                        float n = (length > 0.f) ? normal[c] / length : 0.f;
+                        output[c] = uint8_t(std::clamp((n + 1.f) * 127.5f + 0.5f, 0.f, 255.f));
+                    }
+                }
+                else
+                {
+                    for (int c = 0; c < 3; c++)
+                    {
+                        if (linearize)
+                        {
+                            float sum = 0.f;
+                            for (const uint8_t* texel : texels)
+                                sum += SrgbToLinear(texel[c]);
+                            output[c] = LinearToSrgb(sum * 0.25f);
+                        }
+                        else
+                        {
+                            output[c] = uint8_t((texels[0][c] + texels[1][c] + texels[2][c] + texels[3][c] + 2) / 4);
+                        }
+                    }
+                }
+
+                output[3] = uint8_t((texels[0][3] + texels[1][3] + texels[2][3] + texels[3][3] + 2) / 4);
+            }
+        }
+
+        return result;
+    }
+}
+
+namespace donut::engine
+{
+    nvrhi::Format ChooseCompressedFormat(const TextureCompressionSettings& settings, bool hasAlpha)
+    {
+        switch (settings.role)
+        {
+        case TextureRole::BaseColor:
+            if (settings.allowBC7)
+                return settings.sRGB ? nvrhi::Format::BC7_UNORM_SRGB : nvrhi::Format::BC7_UNORM;
+            if (hasAlpha)
+                return settings.sRGB ? nvrhi::Format::BC3_UNORM_SRGB : nvrhi::Format::BC3_UNORM;
+            return settings.sRGB ? nvrhi::Format::BC1_UNORM_SRGB : nvrhi::Format::BC1_UNORM;
+
+        case TextureRole::Normal:
+            return nvrhi::Format::BC5_UNORM;
+
+        case TextureRole::OcclusionRoughnessMetallic:
+            return settings.allowBC7 ? nvrhi::Format::BC7_UNORM : nvrhi::Format::BC1_UNORM;
+
+        case TextureRole::SingleChannel:
+            return nvrhi::Format::BC4_UNORM;
+        }
+
+        return nvrhi::Format::UNKNOWN;
+    }
+
+    uint32_t GetCompressedBlockSize(nvrhi::Format format)
+    {
+        switch (format)
+        {
+        case nvrhi::Format::BC1_UNORM:
+        case nvrhi::Format::BC1_UNORM_SRGB:
+        case nvrhi::Format::BC4_UNORM:
+            return 8;
+        case nvrhi::Format::BC3_UNORM:
+        case nvrhi::Format::BC3_UNORM_SRGB:
+        case nvrhi::Format::BC5_UNORM:
+        case nvrhi::Format::BC7_UNORM:
+        case nvrhi::Format::BC7_UNORM_SRGB:
+            return 16;
+        default:
+            return 0;
+        }
+    }
+
+    bool HasTransparentPixels(const uint8_t* rgba, uint32_t width, uint32_t height, size_t rowPitch)
+    {
+        for (uint32_t y = 0; y < height; y++)
+        {
+            const uint8_t* row = rgba + y * rowPitch;
+            for (uint32_t x = 0; x < width; x++)
+            {
+                if (row[x * 4 + 3] != 255)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    bool CompressImage(nvrhi::Format format, const uint8_t* rgba, uint32_t width, uint32_t height, size_t rowPitch,
+        uint8_t* blocks, tf::Executor* executor)
+    {
+        BlockEncoder encoder = GetBlockEncoder(format);
+        if (!encoder || !rgba || !blocks || width == 0 || height == 0)
+            return false;
+
+        const uint32_t blockSize = GetCompressedBlockSize(format);
+        const uint32_t blocksWide = (width + 3) / 4;
+        const uint32_t blocksHigh = (height + 3) / 4;
+
+        ParallelFor(executor, blocksHigh, [=](size_t blockY)
+        {
+            uint8_t* output = blocks + blockY * blocksWide * blockSize;
+            Block block;
+            for (uint32_t blockX = 0; blockX < blocksWide; blockX++)
+            {
+                LoadBlock(rgba, width, height, rowPitch, blockX, uint32_t(blockY), block);
+                encoder(block, output);
+                output += blockSize;
+            }
+        });
+
+        return true;
+    }
+
+    std::shared_ptr<vfs::IBlob> CompressTextureToDDS(const uint8_t* rgba, uint32_t width, uint32_t height, size_t rowPitch,
+        const TextureCompressionSettings& settings, tf::Executor* executor)
+    {
+        if (!rgba || width == 0 || height == 0)
+            return nullptr;
+
+        const bool hasAlpha = settings.role == TextureRole::BaseColor && HasTransparentPixels(rgba, width, height, rowPitch);
+        const nvrhi::Format format = ChooseCompressedFormat(settings, hasAlpha);
+        const uint32_t blockSize = GetCompressedBlockSize(format);
+
+        uint32_t mipLevels = 1;
+        if (settings.generateMips)
+        {
+            while ((std::max(width, height) >> mipLevels) > 0)
+                ++mipLevels;
+        }
+
+        std::vector<std::vector<uint8_t>> mipData(mipLevels);
+        std::vector<uint8_t> downsampled;
+        const uint8_t* source = rgba;
+        size_t sourcePitch = rowPitch;
+        uint32_t mipWidth = width;
+        uint32_t mipHeight = height;
+
+        for (uint32_t mipLevel = 0; mipLevel < mipLevels; mipLevel++)
+        {
+            mipData[mipLevel].resize(size_t((mipWidth + 3) / 4) * ((mipHeight + 3) / 4) * blockSize);
+
+            if (!CompressImage(format, source, mipWidth, mipHeight, sourcePitch, mipData[mipLevel].data(), executor))
+                return nullptr;
+
+            if (mipLevel + 1 < mipLevels)
+            {
+                downsampled = Downsample(source, mipWidth, mipHeight, sourcePitch, settings.role, settings.sRGB);
+                mipWidth = std::max(mipWidth / 2, 1u);
+                mipHeight = std::max(mipHeight / 2, 1u);
+                source = downsampled.data();
+                sourcePitch = size_t(mipWidth) * 4;
+            }
+        }
+
+        return CreateDDSFromMemory(format, width, height, mipData);
+    }
+}
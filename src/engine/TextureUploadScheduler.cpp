@@ -0,0 +1,220 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/engine/TextureUploadScheduler.h>
+#include <donut/engine/TextureCache.h>
+#include <donut/core/vfs/VFS.h>
+
+#include <algorithm>
+#include <chrono>
+
+using namespace donut::engine;
+
+uint64_t donut::engine::GetTextureUploadSize(const TextureData& texture)
+{
+    uint64_t size = 0;
+    for (const auto& arraySlice : texture.dataLayout)
+        for (const TextureSubresourceData& mipLevel : arraySlice)
+            size += mipLevel.dataSize;
+
+    if (size == 0 && texture.data)
+        size = texture.data->size();
+
+    return size;
+}
+
+bool TextureUploadScheduler::IsLessImportant(const Entry& a, const Entry& b)
+{
+    if (a.priority != b.priority)
+        return a.priority < b.priority;
+
+    return a.sequence > b.sequence;
+}
+
+void TextureUploadScheduler::Enqueue(std::shared_ptr<TextureData> texture)
+{
+    Entry entry;
+    entry.bytes = GetTextureUploadSize(*texture);
+    entry.texture = std::move(texture);
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    entry.sequence = m_NextSequence++;
+    m_Progress.texturesQueued++;
+    m_Progress.bytesQueued += entry.bytes;
+    m_Incoming.push_back(std::move(entry));
+}
+
+void TextureUploadScheduler::SetPriority(TextureData& texture, float priority)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if (texture.uploadPriority == priority)
+        return;
+
+    texture.uploadPriority = priority;
+    m_PrioritiesChanged = true;
+}
+
+uint32_t TextureUploadScheduler::ProcessBatch(ITextureUploader& uploader, uint64_t byteBudget, float timeLimitMilliseconds)
+{
+    using namespace std::chrono;
+
+    time_point<high_resolution_clock> startTime = high_resolution_clock::now();
+
+    // Take everything that arrived since the last batch at once
+    bool rebuildHeap = false;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        if (m_PrioritiesChanged)
+        {
+            for (Entry& entry : m_Pending)
+                entry.priority = entry.texture->uploadPriority;
+
+            m_PrioritiesChanged = false;
+            rebuildHeap = true;
+        }
+
+        for (Entry& entry : m_Incoming)
+        {
+            entry.priority = entry.texture->uploadPriority;
+            m_Pending.push_back(std::move(entry));
+        }
+
+        // a large arrival is cheaper to heapify than to insert one by one
+        rebuildHeap = rebuildHeap || m_Incoming.size() > m_Pending.size() / 2;
+
+        if (!rebuildHeap)
+        {
+            for (size_t i = m_Pending.size() - m_Incoming.size(); i < m_Pending.size(); i++)
+                std::push_heap(m_Pending.begin(), m_Pending.begin() + ptrdiff_t(i) + 1, IsLessImportant);
+        }
+
+        m_Incoming.clear();
+    }
+
+    if (rebuildHeap)
+        std::make_heap(m_Pending.begin(), m_Pending.end(), IsLessImportant);
+
+    std::vector<Entry> batch;
+    uint64_t batchBytes = 0;
+    while (!m_Pending.empty())
+    {
+        const Entry& next = m_Pending.front();
+        if (next.texture->data && !batch.empty() && byteBudget > 0 && batchBytes + next.bytes > byteBudget)
+            break;
+
+        std::pop_heap(m_Pending.begin(), m_Pending.end(), IsLessImportant);
+        Entry entry = std::move(m_Pending.back());
+        m_Pending.pop_back();
+
+        if (!entry.texture->data)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Progress.texturesQueued--;
+            m_Progress.bytesQueued -= entry.bytes;
+            continue;
+        }
+
+        batchBytes += entry.bytes;
+        batch.push_back(std::move(entry));
+    }
+
+    if (batch.empty())
+        return 0;
+
+    uploader.BeginBatch();
+
+    // Mip generation is grouped per format, in the order in which the formats first appear in the batch
+    std::vector<std::pair<nvrhi::Format, std::vector<std::shared_ptr<TextureData>>>> mipmapGroups;
+
+    size_t uploadCount = 0;
+    uint64_t uploadedBytes = 0;
+    for (; uploadCount < batch.size(); uploadCount++)
+    {
+        if (timeLimitMilliseconds > 0 && uploadCount > 0)
+        {
+            time_point<high_resolution_clock> now = high_resolution_clock::now();
+
+            if (float(duration_cast<microseconds>(now - startTime).count()) > timeLimitMilliseconds * 1e3f)
+                break;
+        }
+
+        const Entry& entry = batch[uploadCount];
+        nvrhi::Format mipmapFormat = uploader.UploadTexture(entry.texture);
+        uploadedBytes += entry.bytes;
+
+        if (mipmapFormat == nvrhi::Format::UNKNOWN)
+            continue;
+
+        auto group = std::find_if(mipmapGroups.begin(), mipmapGroups.end(),
+            [mipmapFormat](const auto& g) { return g.first == mipmapFormat; });
+
+        if (group == mipmapGroups.end())
+            mipmapGroups.push_back({ mipmapFormat, { entry.texture } });
+        else
+            group->second.push_back(entry.texture);
+    }
+
+    for (const auto& [format, textures] : mipmapGroups)
+        uploader.GenerateMipmaps(format, textures);
+
+    uploader.EndBatch();
+
+    // Whatever the time limit cut off goes back into the queue with its original order
+    for (size_t i = uploadCount; i < batch.size(); i++)
+    {
+        m_Pending.push_back(std::move(batch[i]));
+        std::push_heap(m_Pending.begin(), m_Pending.end(), IsLessImportant);
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Progress.texturesQueued -= uint32_t(uploadCount);
+    m_Progress.texturesFinalized += uint32_t(uploadCount);
+    m_Progress.bytesQueued -= uploadedBytes;
+    m_Progress.bytesUploaded += uploadedBytes;
+    m_Progress.batchesSubmitted++;
+
+    return uint32_t(uploadCount);
+}
+
+bool TextureUploadScheduler::IsEmpty() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Progress.texturesQueued == 0;
+}
+
+TextureUploadProgress TextureUploadScheduler::GetProgress() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Progress;
+}
+
+void TextureUploadScheduler::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Incoming.clear();
+    m_Pending.clear();
+    m_PrioritiesChanged = false;
+    m_Progress = TextureUploadProgress();
+}
@@ -25,6 +25,7 @@
 #include <donut/engine/ShaderFactory.h>
 #include <donut/engine/CommonRenderPasses.h>
 #include <donut/engine/View.h>
+#include <donut/engine/GpuProfiler.h>
 #include <utility>
 
 using namespace donut::math;
@@ -157,7 +158,7 @@ void BloomPass::Render(
 {
     float effectiveSigma = clamp(sigmaInPixels * 0.25f, 1.f, 100.f);
 
-    commandList->beginMarker("Bloom");
+    BeginMarker(commandList, "Bloom");
 
     nvrhi::DrawArguments fullscreenquadargs;
     fullscreenquadargs.instanceCount = 1;
@@ -175,7 +176,7 @@ void BloomPass::Render(
 
         // downscale
         {
-            commandList->beginMarker("Downscale");
+            BeginMarker(commandList, "Downscale");
 
             dm::box2 uvSrcRect = box2(
                 float2(
@@ -201,12 +202,12 @@ void BloomPass::Render(
             blitParams2.sourceTexture = perViewData.textureDownscale1;
             m_CommonPasses->BlitTexture(commandList, blitParams2, &m_BindingCache);
 
-            commandList->endMarker(); // "Downscale"
+            EndMarker(commandList); // "Downscale"
         }
 
         // apply blur
         {
-            commandList->beginMarker("Blur");
+            BeginMarker(commandList, "Blur");
             nvrhi::Viewport viewport;
 
             nvrhi::GraphicsState state;
@@ -241,12 +242,12 @@ void BloomPass::Render(
             commandList->setGraphicsState(state);
             commandList->draw(fullscreenquadargs); // blur to m_TexturePass2Blur
 
-            commandList->endMarker(); // "Blur"
+            EndMarker(commandList); // "Blur"
         }
 
         // composite
         {
-            commandList->beginMarker("Apply");
+            BeginMarker(commandList, "Apply");
 
             BlitParameters blitParams3;
             blitParams3.targetFramebuffer = framebuffer;
@@ -260,9 +261,9 @@ void BloomPass::Render(
             blitParams3.blendConstantColor = nvrhi::Color(blendFactor);
             m_CommonPasses->BlitTexture(commandList, blitParams3, &m_BindingCache);
 
-            commandList->endMarker(); // "Apply"
+            EndMarker(commandList); // "Apply"
         }
     }
 
-    commandList->endMarker(); // "Bloom"
+    EndMarker(commandList); // "Bloom"
 }
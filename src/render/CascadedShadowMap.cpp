@@ -23,7 +23,10 @@
 #include <donut/render/CascadedShadowMap.h>
 #include <donut/render/DepthPass.h>
 #include <donut/render/DrawStrategy.h>
+#include <donut/render/GeometryPasses.h>
 #include <donut/render/PlanarShadowMap.h>
+#include <donut/render/ShadowCache.h>
+#include <donut/engine/FramebufferFactory.h>
 
 using namespace donut::math;
 using namespace donut::engine;
@@ -183,6 +186,13 @@ bool CascadedShadowMap::SetupForPlanarViewStable(const DirectionalLight& light,
     
     bool viewModified = false;
 
+    affine3 worldToLight = affine3::identity();
+    if (m_CacheTracker)
+    {
+        daffine3 lightToWorld = dm::scaling(dm::double3(1.0, 1.0, -1.0)) * light.GetNode()->GetLocalToWorldTransform();
+        worldToLight = affine3(inverse(lightToWorld));
+    }
+
     for (int cascade = m_NumberOfCascades - 1; cascade >= 0; cascade--)
     {
         if (cascade == 0)
@@ -215,6 +225,9 @@ bool CascadedShadowMap::SetupForPlanarViewStable(const DirectionalLight& light,
         cascadeCenter += dm::float3(light.GetDirection()) * (zDown - zUp) * 0.5f;
         halfShadowBoxSize.z = (zDown + zUp) * 0.5f;
 
+        if (m_CacheTracker)
+            m_CacheTracker->SnapCascade(uint32_t(cascade), worldToLight, cascadeCenter, halfShadowBoxSize);
+
         if (m_Cascades[cascade]->SetupDynamicDirectionalLightView(light, cascadeCenter, halfShadowBoxSize, preViewTranslation, fadeRange))
             viewModified = true;
 
@@ -409,3 +422,63 @@ void CascadedShadowMap::Clear(nvrhi::ICommandList* commandList)
 
     commandList->clearDepthStencilTexture(m_ShadowMapTexture, nvrhi::AllSubresources, true, 1.f, depthFormatInfo.hasStencil, 0);
 }
+
+void CascadedShadowMap::EnableStaticCache(nvrhi::IDevice* device)
+{
+    if (m_CacheTracker)
+        return;
+
+    nvrhi::TextureDesc desc = m_ShadowMapTexture->getDesc();
+    desc.debugName = "StaticShadowCache";
+    desc.initialState = nvrhi::ResourceStates::CopySource;
+    m_StaticCacheTexture = device->createTexture(desc);
+
+    m_StaticCacheFramebuffer = std::make_shared<FramebufferFactory>(device);
+    m_StaticCacheFramebuffer->DepthTarget = m_StaticCacheTexture;
+
+    m_CacheTracker = std::make_shared<ShadowCacheTracker>(uint32_t(m_Cascades.size()));
+}
+
+void CascadedShadowMap::RenderCached(
+    nvrhi::ICommandList* commandList,
+    FramebufferFactory& framebufferFactory,
+    const std::shared_ptr<SceneGraphNode>& rootNode,
+    IDrawStrategy& drawStrategy,
+    IGeometryPass& pass,
+    GeometryPassContext& passContext,
+    bool materialEvents)
+{
+    assert(m_CacheTracker);
+
+    if (auto graph = rootNode->GetGraph())
+        m_CacheTracker->UpdateCasters(*graph);
+
+    const nvrhi::FormatInfo& depthFormatInfo = nvrhi::getFormatInfo(m_ShadowMapTexture->getDesc().format);
+
+    ShadowCasterDrawStrategy staticCasters(drawStrategy, *m_CacheTracker, true);
+    ShadowCasterDrawStrategy dynamicCasters(drawStrategy, *m_CacheTracker, false);
+
+    for (int cascade = 0; cascade < m_NumberOfCascades; cascade++)
+    {
+        if (!m_CacheTracker->IsCascadeDirty(uint32_t(cascade)))
+            continue;
+
+        std::shared_ptr<PlanarView> view = m_Cascades[cascade]->GetPlanarView();
+
+        commandList->clearDepthStencilTexture(m_StaticCacheTexture, view->GetSubresources(), true, 1.f, depthFormatInfo.hasStencil, 0);
+
+        staticCasters.PrepareForView(rootNode, *view);
+        RenderView(commandList, view.get(), nullptr, m_StaticCacheFramebuffer->GetFramebuffer(*view), staticCasters, pass, passContext, materialEvents);
+
+        m_CacheTracker->MarkCascadeRendered(uint32_t(cascade));
+    }
+
+    for (int cascade = 0; cascade < m_NumberOfCascades; cascade++)
+    {
+        nvrhi::TextureSlice slice;
+        slice.arraySlice = m_Cascades[cascade]->GetPlanarView()->GetSubresources().baseArraySlice;
+        commandList->copyTexture(m_ShadowMapTexture, slice, m_StaticCacheTexture, slice);
+    }
+
+    RenderCompositeView(commandList, &m_CompositeView, nullptr, framebufferFactory, rootNode, dynamicCasters, pass, passContext, nullptr, materialEvents);
+}
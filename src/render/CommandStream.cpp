@@ -0,0 +1,588 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/render/CommandStream.h>
+#include <donut/render/DrawStrategy.h>
+#include <donut/engine/FramebufferFactory.h>
+#include <donut/engine/GpuProfiler.h>
+#include <donut/engine/SceneGraph.h>
+#include <cassert>
+#include <cstring>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
+using namespace donut::engine;
+using namespace donut::render;
+
+namespace
+{
+    struct CommandHeader
+    {
+        StreamCommand command;
+        uint8_t count0;
+        uint8_t count1;
+        uint8_t padding;
+    };
+
+    struct VertexBufferRecord
+    {
+        nvrhi::IBuffer* buffer;
+        uint64_t offset;
+        uint32_t slot;
+        uint32_t padding;
+    };
+
+    struct IndexBufferRecord
+    {
+        nvrhi::IBuffer* buffer;
+        uint32_t offset;
+        uint32_t format;
+    };
+
+    static_assert(sizeof(CommandHeader) == 4);
+
+    class StreamReader
+    {
+    private:
+        const uint8_t* m_Data;
+        const uint8_t* m_End;
+
+    public:
+        explicit StreamReader(const std::vector<uint8_t>& data)
+            : m_Data(data.data())
+            , m_End(data.data() + data.size())
+        { }
+
+        [[nodiscard]] bool AtEnd() const { return m_Data >= m_End; }
+
+        template<typename T> T Read()
+        {
+            assert(m_Data + sizeof(T) <= m_End);
+            T value;
+            memcpy(&value, m_Data, sizeof(T));
+            m_Data += sizeof(T);
+            return value;
+        }
+    };
+
+    bool SameView(const nvrhi::GraphicsState& a, const nvrhi::GraphicsState& b)
+    {
+        if (a.framebuffer != b.framebuffer || a.shadingRateState != b.shadingRateState)
+            return false;
+
+        if (a.viewport.viewports.size() != b.viewport.viewports.size() || a.viewport.scissorRects.size() != b.viewport.scissorRects.size())
+            return false;
+
+        for (size_t i = 0; i < a.viewport.viewports.size(); i++)
+            if (a.viewport.viewports[i] != b.viewport.viewports[i])
+                return false;
+
+        for (size_t i = 0; i < a.viewport.scissorRects.size(); i++)
+            if (a.viewport.scissorRects[i] != b.viewport.scissorRects[i])
+                return false;
+
+        return true;
+    }
+
+    bool SameBindings(const nvrhi::GraphicsState& a, const nvrhi::GraphicsState& b)
+    {
+        if (a.bindings.size() != b.bindings.size())
+            return false;
+
+        for (size_t i = 0; i < a.bindings.size(); i++)
+            if (a.bindings[i] != b.bindings[i])
+                return false;
+
+        return true;
+    }
+
+    bool SameVertexBuffers(const nvrhi::GraphicsState& a, const nvrhi::GraphicsState& b)
+    {
+        if (a.vertexBuffers.size() != b.vertexBuffers.size())
+            return false;
+
+        for (size_t i = 0; i < a.vertexBuffers.size(); i++)
+        {
+            if (a.vertexBuffers[i].buffer != b.vertexBuffers[i].buffer ||
+                a.vertexBuffers[i].slot != b.vertexBuffers[i].slot ||
+                a.vertexBuffers[i].offset != b.vertexBuffers[i].offset)
+                return false;
+        }
+
+        return true;
+    }
+
+    bool SameIndexBuffer(const nvrhi::GraphicsState& a, const nvrhi::GraphicsState& b)
+    {
+        return a.indexBuffer.buffer == b.indexBuffer.buffer
+            && a.indexBuffer.format == b.indexBuffer.format
+            && a.indexBuffer.offset == b.indexBuffer.offset;
+    }
+}
+
+template<typename T> void CommandStream::Write(const T& value)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    size_t offset = m_Data.size();
+    m_Data.resize(offset + sizeof(T));
+    memcpy(m_Data.data() + offset, &value, sizeof(T));
+}
+
+void CommandStream::WriteHeader(StreamCommand command, uint8_t count0, uint8_t count1)
+{
+    Write(CommandHeader{ command, count0, count1, 0 });
+}
+
+void CommandStream::Reset()
+{
+    m_Data.clear();
+    m_RecordedState = nvrhi::GraphicsState();
+    m_HasRecordedState = false;
+    m_Statistics = Statistics();
+}
+
+void CommandStream::SetGraphicsState(const nvrhi::GraphicsState& state)
+{
+    const uint32_t stateCommandCount = m_Statistics.stateCommandCount;
+
+    if (!m_HasRecordedState || !SameView(state, m_RecordedState))
+    {
+        assert(state.viewport.viewports.size() <= 255 && state.viewport.scissorRects.size() <= 255);
+
+        WriteHeader(StreamCommand::SetView, uint8_t(state.viewport.viewports.size()), uint8_t(state.viewport.scissorRects.size()));
+        Write(state.framebuffer);
+        Write(state.shadingRateState);
+        for (const auto& viewport : state.viewport.viewports)
+            Write(viewport);
+        for (const auto& rect : state.viewport.scissorRects)
+            Write(rect);
+        ++m_Statistics.stateCommandCount;
+    }
+
+    if (!m_HasRecordedState || state.pipeline != m_RecordedState.pipeline)
+    {
+        WriteHeader(StreamCommand::SetPipeline);
+        Write(state.pipeline);
+        ++m_Statistics.stateCommandCount;
+    }
+
+    if (!m_HasRecordedState || !SameBindings(state, m_RecordedState))
+    {
+        WriteHeader(StreamCommand::SetBindings, uint8_t(state.bindings.size()));
+        for (nvrhi::IBindingSet* bindingSet : state.bindings)
+            Write(bindingSet);
+        ++m_Statistics.stateCommandCount;
+    }
+
+    if (!m_HasRecordedState || !SameVertexBuffers(state, m_RecordedState))
+    {
+        WriteHeader(StreamCommand::SetVertexBuffers, uint8_t(state.vertexBuffers.size()));
+        for (const auto& binding : state.vertexBuffers)
+            Write(VertexBufferRecord{ binding.buffer, binding.offset, binding.slot, 0 });
+        ++m_Statistics.stateCommandCount;
+    }
+
+    if (!m_HasRecordedState || !SameIndexBuffer(state, m_RecordedState))
+    {
+        WriteHeader(StreamCommand::SetIndexBuffer);
+        Write(IndexBufferRecord{ state.indexBuffer.buffer, state.indexBuffer.offset, uint32_t(state.indexBuffer.format) });
+        ++m_Statistics.stateCommandCount;
+    }
+
+    if (m_Statistics.stateCommandCount == stateCommandCount)
+    {
+        ++m_Statistics.redundantStateCount;
+        return;
+    }
+
+    m_RecordedState = state;
+    m_HasRecordedState = true;
+}
+
+void CommandStream::DrawIndexed(const nvrhi::DrawArguments& args)
+{
+    WriteHeader(StreamCommand::DrawIndexed);
+    Write(args);
+    ++m_Statistics.drawCount;
+}
+
+void CommandStream::BeginMarker(const char* name)
+{
+    WriteHeader(StreamCommand::BeginMarker);
+    Write(name);
+}
+
+void CommandStream::EndMarker()
+{
+    WriteHeader(StreamCommand::EndMarker);
+}
+
+void donut::render::ReplayCommandStreams(
+    const CommandStream* streams,
+    size_t streamCount,
+    ICommandSink& sink,
+    IGeometryPass* pass,
+    GeometryPassContext* passContext)
+{
+    nvrhi::GraphicsState state;
+    nvrhi::GraphicsState submittedState;
+    bool hasSubmittedState = false;
+
+    for (size_t streamIndex = 0; streamIndex < streamCount; streamIndex++)
+    {
+        StreamReader reader(streams[streamIndex].GetData());
+
+        while (!reader.AtEnd())
+        {
+            CommandHeader header = reader.Read<CommandHeader>();
+
+            switch (header.command)
+            {
+            case StreamCommand::SetView:
+                state.framebuffer = reader.Read<nvrhi::IFramebuffer*>();
+                state.shadingRateState = reader.Read<nvrhi::VariableRateShadingState>();
+                state.viewport = nvrhi::ViewportState();
+                for (uint8_t i = 0; i < header.count0; i++)
+                    state.viewport.addViewport(reader.Read<nvrhi::Viewport>());
+                for (uint8_t i = 0; i < header.count1; i++)
+                    state.viewport.addScissorRect(reader.Read<nvrhi::Rect>());
+                break;
+
+            case StreamCommand::SetPipeline:
+                state.pipeline = reader.Read<nvrhi::IGraphicsPipeline*>();
+                break;
+
+            case StreamCommand::SetBindings:
+                state.bindings.clear();
+                for (uint8_t i = 0; i < header.count0; i++)
+                    state.bindings.push_back(reader.Read<nvrhi::IBindingSet*>());
+                break;
+
+            case StreamCommand::SetVertexBuffers:
+                state.vertexBuffers.clear();
+                for (uint8_t i = 0; i < header.count0; i++)
+                {
+                    VertexBufferRecord record = reader.Read<VertexBufferRecord>();
+                    nvrhi::VertexBufferBinding binding;
+                    binding.buffer = record.buffer;
+                    binding.slot = record.slot;
+                    binding.offset = record.offset;
+                    state.vertexBuffers.push_back(binding);
+                }
+                break;
+
+            case StreamCommand::SetIndexBuffer: {
+                IndexBufferRecord record = reader.Read<IndexBufferRecord>();
+                state.indexBuffer.buffer = record.buffer;
+                state.indexBuffer.offset = record.offset;
+                state.indexBuffer.format = nvrhi::Format(record.format);
+                break;
+            }
+
+            case StreamCommand::DrawIndexed: {
+                nvrhi::DrawArguments args = reader.Read<nvrhi::DrawArguments>();
+
+                // streams record their first state in full, so only compare when a stream changed something
+                if (!hasSubmittedState || !SameView(state, submittedState) || state.pipeline != submittedState.pipeline ||
+                    !SameBindings(state, submittedState) || !SameVertexBuffers(state, submittedState) || !SameIndexBuffer(state, submittedState))
+                {
+                    sink.SetGraphicsState(state);
+                    submittedState = state;
+                    hasSubmittedState = true;
+                }
+
+                if (pass)
+                    pass->SetPushConstants(*passContext, sink.GetCommandList(), state, args);
+
+                sink.DrawIndexed(args);
+                break;
+            }
+
+            case StreamCommand::BeginMarker:
+                sink.BeginMarker(reader.Read<const char*>());
+                break;
+
+            case StreamCommand::EndMarker:
+                sink.EndMarker();
+                break;
+
+            default:
+                assert(!"Unknown stream command");
+                return;
+            }
+        }
+    }
+}
+
+void donut::render::RecordDrawItems(
+    CommandStream& stream,
+    const DrawItem* items,
+    size_t itemCount,
+    const IView* view,
+    nvrhi::IFramebuffer* framebuffer,
+    IGeometryPass& pass,
+    GeometryPassContext& passContext,
+    bool materialEvents)
+{
+    // The same logic as RenderView, recording into the stream
+    const Material* lastMaterial = nullptr;
+    const BufferGroup* lastBuffers = nullptr;
+    nvrhi::RasterCullMode lastCullMode = nvrhi::RasterCullMode::Back;
+
+    bool drawMaterial = true;
+    bool stateValid = false;
+
+    const Material* eventMaterial = nullptr;
+
+    nvrhi::GraphicsState graphicsState;
+    graphicsState.framebuffer = framebuffer;
+    graphicsState.viewport = view->GetViewportState();
+    graphicsState.shadingRateState = view->GetVariableRateShadingState();
+
+    nvrhi::DrawArguments currentDraw;
+    currentDraw.instanceCount = 0;
+
+    auto flushDraw = [&stream, materialEvents, &currentDraw, &eventMaterial](const Material* material)
+    {
+        if (currentDraw.instanceCount == 0)
+            return;
+
+        if (materialEvents && material != eventMaterial)
+        {
+            if (eventMaterial)
+                stream.EndMarker();
+
+            if (material->name.empty())
+            {
+                eventMaterial = nullptr;
+            }
+            else
+            {
+                stream.BeginMarker(material->name.c_str());
+                eventMaterial = material;
+            }
+        }
+
+        stream.DrawIndexed(currentDraw);
+        currentDraw.instanceCount = 0;
+    };
+
+    for (size_t itemIndex = 0; itemIndex < itemCount; itemIndex++)
+    {
+        const DrawItem* item = &items[itemIndex];
+
+        if (item->material == nullptr)
+            continue;
+
+        bool newBuffers = item->buffers != lastBuffers;
+        bool newMaterial = item->material != lastMaterial || item->cullMode != lastCullMode;
+
+        if (newBuffers || newMaterial)
+        {
+            flushDraw(lastMaterial);
+        }
+
+        if (newBuffers)
+        {
+            pass.SetupInputBuffers(passContext, item->buffers, graphicsState);
+
+            lastBuffers = item->buffers;
+            stateValid = false;
+        }
+
+        if (newMaterial)
+        {
+            drawMaterial = pass.SetupMaterial(passContext, item->material, item->cullMode, graphicsState);
+
+            lastMaterial = item->material;
+            lastCullMode = item->cullMode;
+            stateValid = false;
+        }
+
+        if (drawMaterial)
+        {
+            if (!stateValid)
+            {
+                stream.SetGraphicsState(graphicsState);
+                stateValid = true;
+            }
+
+            nvrhi::DrawArguments args;
+            args.vertexCount = item->geometry->numIndices;
+            args.instanceCount = item->instanceCount;
+            args.startVertexLocation = item->mesh->vertexOffset + item->geometry->vertexOffsetInMesh;
+            args.startIndexLocation = item->mesh->indexOffset + item->geometry->indexOffsetInMesh;
+            args.startInstanceLocation = item->instance->GetInstanceIndex() + item->instanceOffset;
+
+            if (args.instanceCount == 0)
+                continue;
+
+            if (currentDraw.instanceCount > 0 &&
+                currentDraw.startIndexLocation == args.startIndexLocation &&
+                currentDraw.startInstanceLocation + currentDraw.instanceCount == args.startInstanceLocation)
+            {
+                currentDraw.instanceCount += args.instanceCount;
+            }
+            else
+            {
+                flushDraw(item->material);
+
+                currentDraw = args;
+            }
+        }
+    }
+
+    flushDraw(lastMaterial);
+
+    if (materialEvents && eventMaterial)
+        stream.EndMarker();
+}
+
+void donut::render::RecordDrawItemsParallel(
+    tf::Executor* executor,
+    std::vector<CommandStream>& streams,
+    const DrawItem* items,
+    size_t itemCount,
+    const IView* view,
+    nvrhi::IFramebuffer* framebuffer,
+    IGeometryPass& pass,
+    GeometryPassContext& passContext,
+    size_t minItemsPerStream,
+    bool materialEvents)
+{
+    size_t maxStreams = 1;
+#ifdef DONUT_WITH_TASKFLOW
+    // a few ranges per worker, so that the uneven cost of the ranges evens out
+    if (executor)
+        maxStreams = executor->num_workers() * 4;
+#endif
+
+    minItemsPerStream = std::max<size_t>(minItemsPerStream, 1);
+    const size_t streamCount = std::max<size_t>(std::min(maxStreams, itemCount / minItemsPerStream), 1);
+    streams.resize(streamCount);
+
+    auto recordStream = [&](size_t streamIndex)
+    {
+        size_t first = itemCount * streamIndex / streamCount;
+        size_t last = itemCount * (streamIndex + 1) / streamCount;
+
+        CommandStream& stream = streams[streamIndex];
+        stream.Reset();
+        RecordDrawItems(stream, items + first, last - first, view, framebuffer, pass, passContext, materialEvents);
+    };
+
+#ifdef DONUT_WITH_TASKFLOW
+    if (executor && streamCount > 1)
+    {
+        tf::Taskflow taskflow;
+        taskflow.for_each_index(size_t(0), streamCount, size_t(1), recordStream);
+        executor->run(taskflow).wait();
+        return;
+    }
+#endif
+
+    for (size_t streamIndex = 0; streamIndex < streamCount; streamIndex++)
+        recordStream(streamIndex);
+}
+
+void ParallelViewRenderer::RenderView(
+    nvrhi::ICommandList* commandList,
+    const IView* view,
+    const IView* viewPrev,
+    nvrhi::IFramebuffer* framebuffer,
+    IDrawStrategy& drawStrategy,
+    IGeometryPass& pass,
+    GeometryPassContext& passContext,
+    bool materialEvents)
+{
+    pass.SetupView(passContext, commandList, view, viewPrev);
+
+    // The strategy can only be traversed serially, and producing the items is cheap compared to recording them
+    m_Items.clear();
+    while (const DrawItem* item = drawStrategy.GetNextItem())
+        m_Items.push_back(*item);
+
+    RecordDrawItemsParallel(m_Executor, m_Streams, m_Items.data(), m_Items.size(), view, framebuffer,
+        pass, passContext, m_MinItemsPerStream, materialEvents);
+
+    CommandListSink sink(commandList);
+    ReplayCommandStreams(m_Streams.data(), m_Streams.size(), sink, &pass, &passContext);
+}
+
+void ParallelViewRenderer::RenderCompositeView(
+    nvrhi::ICommandList* commandList,
+    const ICompositeView* compositeView,
+    const ICompositeView* compositeViewPrev,
+    FramebufferFactory& framebufferFactory,
+    const std::shared_ptr<SceneGraphNode>& rootNode,
+    IDrawStrategy& drawStrategy,
+    IGeometryPass& pass,
+    GeometryPassContext& passContext,
+    const char* passEvent,
+    bool materialEvents)
+{
+    if (passEvent)
+        BeginMarker(commandList, passEvent);
+
+    ViewType::Enum supportedViewTypes = pass.GetSupportedViewTypes();
+
+    if (compositeViewPrev)
+    {
+        // the views must have the same topology
+        assert(compositeView->GetNumChildViews(supportedViewTypes) == compositeViewPrev->GetNumChildViews(supportedViewTypes));
+    }
+
+    uint32_t numChildViews = compositeView->GetNumChildViews(supportedViewTypes);
+
+    // cull all child views in one scene traversal if the strategy supports it
+    bool multiView = false;
+    if (numChildViews > 1)
+    {
+        std::vector<const IView*> childViews(numChildViews);
+        for (uint32_t viewIndex = 0; viewIndex < numChildViews; viewIndex++)
+            childViews[viewIndex] = compositeView->GetChildView(supportedViewTypes, viewIndex);
+
+        multiView = drawStrategy.PrepareForViews(rootNode, childViews.data(), numChildViews);
+    }
+
+    for (uint32_t viewIndex = 0; viewIndex < numChildViews; viewIndex++)
+    {
+        const IView* view = compositeView->GetChildView(supportedViewTypes, viewIndex);
+        const IView* viewPrev = compositeViewPrev ? compositeViewPrev->GetChildView(supportedViewTypes, viewIndex) : nullptr;
+
+        assert(view != nullptr);
+
+        if (multiView)
+            drawStrategy.SelectView(viewIndex);
+        else
+            drawStrategy.PrepareForView(rootNode, *view);
+
+        nvrhi::IFramebuffer* framebuffer = framebufferFactory.GetFramebuffer(*view);
+
+        RenderView(commandList, view, viewPrev, framebuffer, drawStrategy, pass, passContext, materialEvents);
+    }
+
+    if (passEvent)
+        EndMarker(commandList);
+}
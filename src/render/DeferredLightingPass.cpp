@@ -29,6 +29,7 @@
 #include <donut/engine/SceneTypes.h>
 #include <donut/engine/CommonRenderPasses.h>
 #include <donut/engine/View.h>
+#include <donut/engine/GpuProfiler.h>
 #include <donut/core/log.h>
 #include <utility>
 
@@ -128,7 +129,7 @@ void DeferredLightingPass::Render(
     assert(inputs.gbufferEmissive);
     assert(inputs.output);
 
-    commandList->beginMarker("DeferredLighting");
+    BeginMarker(commandList, "DeferredLighting");
 
     DeferredLightingConstants deferredConstants = {};
     deferredConstants.randomOffset = randomOffset;
@@ -292,7 +293,7 @@ void DeferredLightingPass::Render(
             dm::div_ceil(viewExtent.height(), 16));
     }
 
-    commandList->endMarker();
+    EndMarker(commandList);
 }
 
 void DeferredLightingPass::ResetBindingCache()
@@ -71,6 +71,11 @@ void DepthPass::ResetBindingCache() const
     m_MaterialBindings->Clear();
 }
 
+void DepthPass::ReleaseDestroyedMaterials() const
+{
+    m_MaterialBindings->ReleaseDestroyedMaterials();
+}
+
 nvrhi::ShaderHandle DepthPass::CreateVertexShader(ShaderFactory& shaderFactory, const CreateParameters& params)
 {
     return shaderFactory.CreateShader("donut/passes/depth_vs.hlsl", "main", nullptr, nvrhi::ShaderType::Vertex);
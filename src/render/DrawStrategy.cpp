@@ -22,12 +22,17 @@
 
 #include <donut/render/DrawStrategy.h>
 #include <donut/render/GeometryPasses.h>
+#include <donut/render/OcclusionCulling.h>
 #include <donut/engine/SceneGraph.h>
 #include <donut/engine/View.h>
+#include <donut/core/parallel.h>
+#include <algorithm>
+#include <cmath>
 
 using namespace donut::math;
 using namespace donut::engine;
 using namespace donut::render;
+using namespace donut::core;
 
 const DrawItem* PassthroughDrawStrategy::GetNextItem()
 {
@@ -58,77 +63,136 @@ static int CompareDrawItemsOpaque(const DrawItem* a, const DrawItem* b)
     if (a->mesh != b->mesh)
         return a->mesh < b->mesh;
 
-    return a->instance < b->instance;
+    if (a->instance != b->instance)
+        return a->instance < b->instance;
+
+    return a->instanceOffset < b->instanceOffset;
 }
 
-void InstancedOpaqueDrawStrategy::FillChunk()
+void InstancedOpaqueDrawStrategy::AppendMeshInstanceItems(const MeshInstance* meshInstance, const affine3& localToWorld,
+    const frustum& frustum, bool geometriesVisible, std::vector<DrawItem>& items)
 {
-    m_InstanceChunk.resize(m_ChunkSize);
+    if (!meshInstance->Visibility())
+        return;
 
-    DrawItem* writePtr = m_InstanceChunk.data();
-    size_t itemCount = 0;
+    const engine::MeshInfo* mesh = meshInstance->GetMesh().get();
 
-    while (m_Walker && itemCount < m_ChunkSize)
+    // instance arrays produce one draw per visible cell and geometry
+    auto instanceArray = dynamic_cast<const MeshInstanceArray*>(meshInstance);
+    size_t drawsPerGeometry = 1;
+    if (instanceArray)
     {
-        auto relevantContentFlags = SceneContentFlags::OpaqueMeshes | SceneContentFlags::AlphaTestedMeshes;
-        bool subgraphContentRelevant = (m_Walker->GetSubgraphContentFlags() & relevantContentFlags) != 0;
-        bool nodeContentsRelevant = (m_Walker->GetLeafContentFlags() & relevantContentFlags) != 0;
+        m_VisibleCells.clear();
+        instanceArray->GetVisibleCells(frustum, localToWorld, m_VisibleCells);
+        drawsPerGeometry = m_VisibleCells.size();
+    }
 
-        bool nodeVisible = false;
-        if (subgraphContentRelevant)
+    for (const auto& geometry : mesh->geometries)
+    {
+        auto domain = geometry->material->domain;
+        if (domain != MaterialDomain::Opaque && domain != MaterialDomain::AlphaTested)
+            continue;
+
+        if (mesh->geometries.size() > 1 && !mesh->skinPrototype && !instanceArray && !geometriesVisible)
         {
-            nodeVisible = m_ViewFrustum.intersectsWith(m_Walker->GetGlobalBoundingBox());
+            dm::box3 geometryGlobalBoundingBox = geometry->objectSpaceBounds * localToWorld;
+            if (!frustum.intersectsWith(geometryGlobalBoundingBox))
+                continue;
+        }
 
-            if (nodeVisible && nodeContentsRelevant)
+        for (size_t draw = 0; draw < drawsPerGeometry; draw++)
+        {
+            DrawItem& item = items.emplace_back();
+            item.instance = meshInstance;
+            item.mesh = mesh;
+            item.geometry = geometry.get();
+            item.material = geometry->material.get();
+            item.buffers = item.mesh->buffers.get();
+            item.cullMode = (item.material->doubleSided) ? nvrhi::RasterCullMode::None : nvrhi::RasterCullMode::Back;
+            item.distanceToCamera = 0; // don't care
+            item.instanceOffset = 0;
+            item.instanceCount = 1;
+
+            if (instanceArray)
             {
-                auto meshInstance = dynamic_cast<MeshInstance*>(m_Walker->GetLeaf().get());
-                if (meshInstance)
-                {
-                    if (meshInstance->Visibility()) {
+                const InstanceArrayCell& cell = instanceArray->GetCells()[m_VisibleCells[draw]];
+                item.instanceOffset = cell.firstInstance;
+                item.instanceCount = cell.instanceCount;
+            }
+        }
+    }
+}
 
-                        const engine::MeshInfo* mesh = meshInstance->GetMesh().get();
+// The walkers of the graph and of the visibility cache visit the same nodes, the cache only replaces the frustum tests
+static bool IntersectsFrustum(const SceneGraphWalker& walker, const frustum& viewFrustum)
+{
+    return viewFrustum.intersectsWith(walker->GetGlobalBoundingBox());
+}
 
-                        size_t requiredChunkSize = itemCount + mesh->geometries.size();
-                        if (m_InstanceChunk.size() < requiredChunkSize)
-                        {
-                            m_InstanceChunk.resize(requiredChunkSize);
-                            writePtr = m_InstanceChunk.data() + itemCount;
-                        }
+static bool IntersectsFrustum(const VisibilityCacheWalker& walker, const frustum&)
+{
+    return walker.IsVisible();
+}
 
-                        for (const auto& geometry : mesh->geometries)
-                        {
-                            auto domain = geometry->material->domain;
-                            if (domain != MaterialDomain::Opaque && domain != MaterialDomain::AlphaTested)
-                                continue;
+static MeshInstance* GetMeshInstance(const SceneGraphWalker& walker)
+{
+    return dynamic_cast<MeshInstance*>(walker->GetLeaf().get());
+}
 
-                            if (mesh->geometries.size() > 1 && !mesh->skinPrototype)
-                            {
-                                dm::box3 geometryGlobalBoundingBox = geometry->objectSpaceBounds * m_Walker->GetLocalToWorldTransformFloat();
-                                if (!m_ViewFrustum.intersectsWith(geometryGlobalBoundingBox))
-                                    continue;
-                            }
+static MeshInstance* GetMeshInstance(const VisibilityCacheWalker& walker)
+{
+    return walker.GetMeshInstance();
+}
 
-                            DrawItem& item = *writePtr;
-                            item.instance = meshInstance;
-                            item.mesh = mesh;
-                            item.geometry = geometry.get();
-                            item.material = geometry->material.get();
-                            item.buffers = item.mesh->buffers.get();
-                            item.cullMode = (item.material->doubleSided) ? nvrhi::RasterCullMode::None : nvrhi::RasterCullMode::Back;
-                            item.distanceToCamera = 0; // don't care
+static bool AreGeometriesVisible(const SceneGraphWalker&)
+{
+    return false;
+}
 
-                            ++writePtr;
-                            ++itemCount;
-                        }
-                    }
-                }
+static bool AreGeometriesVisible(const VisibilityCacheWalker& walker)
+{
+    return walker.AreGeometriesVisible();
+}
+
+template<typename Walker> void InstancedOpaqueDrawStrategy::FillChunk(Walker& walker)
+{
+    while (walker && m_InstanceChunk.size() < m_ChunkSize)
+    {
+        auto relevantContentFlags = SceneContentFlags::OpaqueMeshes | SceneContentFlags::AlphaTestedMeshes;
+        bool subgraphContentRelevant = (walker->GetSubgraphContentFlags() & relevantContentFlags) != 0;
+        bool nodeContentsRelevant = (walker->GetLeafContentFlags() & relevantContentFlags) != 0;
+
+        bool nodeVisible = false;
+        if (subgraphContentRelevant)
+        {
+            nodeVisible = IntersectsFrustum(walker, m_ViewFrustum);
+
+            if (nodeVisible && m_OcclusionFilter)
+                nodeVisible = m_OcclusionFilter->IsBoxVisible(walker->GetGlobalBoundingBox());
+
+            if (nodeVisible && nodeContentsRelevant)
+            {
+                auto meshInstance = GetMeshInstance(walker);
+                if (meshInstance)
+                    AppendMeshInstanceItems(meshInstance, walker->GetLocalToWorldTransformFloat(), m_ViewFrustum, AreGeometriesVisible(walker), m_InstanceChunk);
             }
         }
 
-        m_Walker.Next(nodeVisible);
+        walker.Next(nodeVisible);
     }
+}
+
+void InstancedOpaqueDrawStrategy::FillChunk()
+{
+    m_InstanceChunk.clear();
+    m_InstanceChunk.reserve(m_ChunkSize);
+
+    if (m_CachedWalker)
+        FillChunk(m_CachedWalker);
+    else
+        FillChunk(m_Walker);
 
-    m_InstanceChunk.resize(itemCount);
+    size_t itemCount = m_InstanceChunk.size();
     m_InstancePtrChunk.resize(itemCount);
 
     for (size_t i = 0; i < itemCount; i++)
@@ -146,16 +210,113 @@ void InstancedOpaqueDrawStrategy::FillChunk()
 
 void donut::render::InstancedOpaqueDrawStrategy::PrepareForView(const std::shared_ptr<engine::SceneGraphNode>& rootNode, const engine::IView& view)
 {
-    m_Walker = SceneGraphWalker(rootNode.get());
+    m_CachedWalker = m_VisibilityCache ? m_VisibilityCache->BeginView(rootNode, view) : VisibilityCacheWalker();
+    m_Walker = SceneGraphWalker(m_CachedWalker ? nullptr : rootNode.get());
     m_ViewFrustum = view.GetViewFrustum();
     m_InstanceChunk.clear();
+    m_InstancePtrChunk.clear();
+    m_ReadPtr = 0;
+    m_MultiView = false;
+}
+
+bool InstancedOpaqueDrawStrategy::PrepareForViews(const std::shared_ptr<engine::SceneGraphNode>& rootNode, const engine::IView* const* views, uint32_t viewCount)
+{
+    if (viewCount == 0 || viewCount > MaxMultiViews)
+        return false;
+
+    m_ViewFrustums.resize(viewCount);
+    for (uint32_t viewIndex = 0; viewIndex < viewCount; viewIndex++)
+        m_ViewFrustums[viewIndex] = views[viewIndex]->GetViewFrustum();
+
+    m_ViewItems.resize(viewCount);
+    for (auto& items : m_ViewItems)
+        items.clear();
+
+    const uint32_t allViews = (viewCount == 32) ? ~0u : ((1u << viewCount) - 1);
+    const auto relevantContentFlags = SceneContentFlags::OpaqueMeshes | SceneContentFlags::AlphaTestedMeshes;
+
+    // m_ViewMaskStack[d] holds the views that see the current node's ancestor at depth d
+    m_ViewMaskStack.clear();
+    m_ViewMaskStack.push_back(allViews);
+
+    SceneGraphWalker walker(rootNode.get());
+    while (walker)
+    {
+        uint32_t parentMask = m_ViewMaskStack.back();
+        uint32_t nodeMask = 0;
+
+        if ((walker->GetSubgraphContentFlags() & relevantContentFlags) != 0)
+        {
+            const box3& bounds = walker->GetGlobalBoundingBox();
+            for (uint32_t viewIndex = 0; viewIndex < viewCount; viewIndex++)
+            {
+                uint32_t viewBit = 1u << viewIndex;
+                if ((parentMask & viewBit) && m_ViewFrustums[viewIndex].intersectsWith(bounds))
+                    nodeMask |= viewBit;
+            }
+
+            if (nodeMask != 0 && (walker->GetLeafContentFlags() & relevantContentFlags) != 0)
+            {
+                auto meshInstance = dynamic_cast<MeshInstance*>(walker->GetLeaf().get());
+                if (meshInstance)
+                {
+                    const affine3& localToWorld = walker->GetLocalToWorldTransformFloat();
+                    for (uint32_t viewIndex = 0; viewIndex < viewCount; viewIndex++)
+                    {
+                        if (nodeMask & (1u << viewIndex))
+                            AppendMeshInstanceItems(meshInstance, localToWorld, m_ViewFrustums[viewIndex], false, m_ViewItems[viewIndex]);
+                    }
+                }
+            }
+        }
+
+        // Next returns the depth of the new node relative to this one: +1 for a child, 0 for a sibling,
+        // negative when going up. The stack keeps the masks of the ancestors of the next node.
+        int depthChange = walker.Next(nodeMask != 0);
+        if (depthChange > 0)
+            m_ViewMaskStack.push_back(nodeMask);
+        else
+            m_ViewMaskStack.resize(std::max<ptrdiff_t>(1, ptrdiff_t(m_ViewMaskStack.size()) + depthChange));
+    }
+
+    m_InstanceChunk.clear();
+    m_InstancePtrChunk.clear();
+    m_ReadPtr = 0;
+    m_MultiView = true;
+
+    return true;
+}
+
+void InstancedOpaqueDrawStrategy::SelectView(uint32_t viewIndex)
+{
+    m_InstancePtrChunk.clear();
     m_ReadPtr = 0;
+
+    if (!m_MultiView || viewIndex >= m_ViewItems.size())
+        return;
+
+    const std::vector<DrawItem>& items = m_ViewItems[viewIndex];
+    m_InstancePtrChunk.resize(items.size());
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        m_InstancePtrChunk[i] = &items[i];
+    }
+
+    if (items.size() > 1)
+    {
+        std::sort(m_InstancePtrChunk.begin(), m_InstancePtrChunk.end(), CompareDrawItemsOpaque);
+    }
 }
 
 const DrawItem* InstancedOpaqueDrawStrategy::GetNextItem()
 {
     if (m_ReadPtr >= m_InstancePtrChunk.size())
+    {
+        if (m_MultiView)
+            return nullptr;
+
         FillChunk();
+    }
 
     if (m_InstancePtrChunk.empty())
         return nullptr;
@@ -166,23 +327,14 @@ const DrawItem* InstancedOpaqueDrawStrategy::GetNextItem()
 
 static int CompareDrawItemsTransparent(const DrawItem* a, const DrawItem* b)
 {
-    if (a->instance == b->instance)
+    if (a->instance == b->instance && a->instanceOffset == b->instanceOffset)
         return a->cullMode > b->cullMode;
 
     return a->distanceToCamera > b->distanceToCamera;
 }
 
-void TransparentDrawStrategy::PrepareForView(const std::shared_ptr<engine::SceneGraphNode>& rootNode, const IView& view)
+template<typename Walker> void TransparentDrawStrategy::CollectItems(Walker& walker, const frustum& viewFrustum, const float3& viewOrigin)
 {
-    m_ReadPtr = 0;
-
-    m_InstancesToDraw.clear();
-    m_InstancePtrsToDraw.clear();
-
-    float3 viewOrigin = view.GetViewOrigin();
-    auto viewFrustum = view.GetViewFrustum();
-
-    SceneGraphWalker walker(rootNode.get());
     while (walker)
     {
         auto relevantContentFlags = SceneContentFlags::BlendedMeshes;
@@ -192,59 +344,84 @@ void TransparentDrawStrategy::PrepareForView(const std::shared_ptr<engine::Scene
         bool nodeVisible = false;
         if (subgraphContentRelevant)
         {
-            nodeVisible = viewFrustum.intersectsWith(walker->GetGlobalBoundingBox());
+            nodeVisible = IntersectsFrustum(walker, viewFrustum);
+
+            if (nodeVisible && m_OcclusionFilter)
+                nodeVisible = m_OcclusionFilter->IsBoxVisible(walker->GetGlobalBoundingBox());
 
             if (nodeVisible && nodeContentsRelevant)
             {
-                auto meshInstance = dynamic_cast<MeshInstance*>(walker->GetLeaf().get());
+                auto meshInstance = GetMeshInstance(walker);
                 if (meshInstance)
                 {
                     const engine::MeshInfo* mesh = meshInstance->GetMesh().get();
+
+                    // instance arrays produce one draw per visible cell and geometry, sorted by the cell distance
+                    auto instanceArray = dynamic_cast<const MeshInstanceArray*>(meshInstance);
+                    size_t drawsPerGeometry = 1;
+                    if (instanceArray)
+                    {
+                        m_VisibleCells.clear();
+                        instanceArray->GetVisibleCells(viewFrustum, walker->GetLocalToWorldTransformFloat(), m_VisibleCells);
+                        drawsPerGeometry = m_VisibleCells.size();
+                    }
+
                     for (const auto& geometry : mesh->geometries)
                     {
                         const auto& material = geometry->material;
                         if (material->domain == MaterialDomain::Opaque || material->domain == MaterialDomain::AlphaTested)
                             continue;
 
-                        dm::box3 geometryGlobalBoundingBox;
-                        if (mesh->geometries.size() > 1 && !mesh->skinPrototype)
+                        for (size_t draw = 0; draw < drawsPerGeometry; draw++)
                         {
-                            geometryGlobalBoundingBox = geometry->objectSpaceBounds * walker->GetLocalToWorldTransformFloat();
-                            if (!viewFrustum.intersectsWith(geometryGlobalBoundingBox))
-                                continue;
-                        }
-                        else
-                        {
-                            geometryGlobalBoundingBox = walker->GetGlobalBoundingBox();
-                        }
+                            DrawItem item{};
 
-                        DrawItem item{};
-                        item.instance = meshInstance;
-                        item.mesh = mesh;
-                        item.geometry = geometry.get();
-                        item.material = geometry->material.get();
-                        item.buffers = mesh->buffers.get();
-                        item.distanceToCamera = length(geometryGlobalBoundingBox.center() - viewOrigin);
-                        if (material->doubleSided)
-                        {
-                            if (DrawDoubleSidedMaterialsSeparately)
+                            dm::box3 geometryGlobalBoundingBox;
+                            if (instanceArray)
                             {
-                                item.cullMode = nvrhi::RasterCullMode::Front;
-                                m_InstancesToDraw.push_back(item);
-                                item.cullMode = nvrhi::RasterCullMode::Back;
-                                m_InstancesToDraw.push_back(item);
+                                const InstanceArrayCell& cell = instanceArray->GetCells()[m_VisibleCells[draw]];
+                                geometryGlobalBoundingBox = cell.bounds * walker->GetLocalToWorldTransformFloat();
+                                item.instanceOffset = cell.firstInstance;
+                                item.instanceCount = cell.instanceCount;
+                            }
+                            else if (mesh->geometries.size() > 1 && !mesh->skinPrototype)
+                            {
+                                geometryGlobalBoundingBox = geometry->objectSpaceBounds * walker->GetLocalToWorldTransformFloat();
+                                if (!viewFrustum.intersectsWith(geometryGlobalBoundingBox))
+                                    continue;
                             }
                             else
                             {
-                                item.cullMode = nvrhi::RasterCullMode::None;
+                                geometryGlobalBoundingBox = walker->GetGlobalBoundingBox();
+                            }
+
+                            item.instance = meshInstance;
+                            item.mesh = mesh;
+                            item.geometry = geometry.get();
+                            item.material = geometry->material.get();
+                            item.buffers = mesh->buffers.get();
+                            item.distanceToCamera = length(geometryGlobalBoundingBox.center() - viewOrigin);
+                            if (material->doubleSided)
+                            {
+                                if (DrawDoubleSidedMaterialsSeparately)
+                                {
+                                    item.cullMode = nvrhi::RasterCullMode::Front;
+                                    m_InstancesToDraw.push_back(item);
+                                    item.cullMode = nvrhi::RasterCullMode::Back;
+                                    m_InstancesToDraw.push_back(item);
+                                }
+                                else
+                                {
+                                    item.cullMode = nvrhi::RasterCullMode::None;
+                                    m_InstancesToDraw.push_back(item);
+                                }
+                            }
+                            else
+                            {
+                                item.cullMode = nvrhi::RasterCullMode::Back;
                                 m_InstancesToDraw.push_back(item);
                             }
                         }
-                        else
-                        {
-                            item.cullMode = nvrhi::RasterCullMode::Back;
-                            m_InstancesToDraw.push_back(item);
-                        }
                     }
                 }
             }
@@ -252,6 +429,28 @@ void TransparentDrawStrategy::PrepareForView(const std::shared_ptr<engine::Scene
 
         walker.Next(nodeVisible);
     }
+}
+
+void TransparentDrawStrategy::PrepareForView(const std::shared_ptr<engine::SceneGraphNode>& rootNode, const IView& view)
+{
+    m_ReadPtr = 0;
+
+    m_InstancesToDraw.clear();
+    m_InstancePtrsToDraw.clear();
+
+    float3 viewOrigin = view.GetViewOrigin();
+    auto viewFrustum = view.GetViewFrustum();
+
+    VisibilityCacheWalker cachedWalker = m_VisibilityCache ? m_VisibilityCache->BeginView(rootNode, view) : VisibilityCacheWalker();
+    if (cachedWalker)
+    {
+        CollectItems(cachedWalker, viewFrustum, viewOrigin);
+    }
+    else
+    {
+        SceneGraphWalker walker(rootNode.get());
+        CollectItems(walker, viewFrustum, viewOrigin);
+    }
 
     if (m_InstancesToDraw.empty())
         return;
@@ -280,3 +479,265 @@ const DrawItem* TransparentDrawStrategy::GetNextItem()
 
     return m_InstancePtrsToDraw[m_ReadPtr++];
 }
+
+
+void donut::render::RadixSortDrawPackets(std::vector<DrawPacket>& packets, std::vector<DrawPacket>& scratch, tf::Executor* executor)
+{
+    constexpr uint32_t radixBits = 8;
+    constexpr uint32_t radixSize = 1 << radixBits;
+    constexpr size_t minPacketsPerBlock = 16384;
+    constexpr size_t maxBlocks = 64;
+
+    const size_t count = packets.size();
+    if (count < 2)
+        return;
+
+    size_t blockCount = executor ? std::min(maxBlocks, (count + minPacketsPerBlock - 1) / minPacketsPerBlock) : 1;
+    size_t blockSize = (count + blockCount - 1) / blockCount;
+
+    scratch.resize(count);
+    std::vector<size_t> histograms(blockCount * radixSize);
+
+    for (uint32_t shift = 0; shift < 64; shift += radixBits)
+    {
+        std::fill(histograms.begin(), histograms.end(), 0);
+
+        ParallelFor(executor, blockCount, [&](size_t block)
+        {
+            size_t* histogram = histograms.data() + block * radixSize;
+            size_t end = std::min(count, (block + 1) * blockSize);
+            for (size_t i = block * blockSize; i < end; i++)
+                ++histogram[(packets[i].key >> shift) & (radixSize - 1)];
+        });
+
+        // skip the digit if all keys share it
+        bool trivial = false;
+        for (uint32_t digit = 0; digit < radixSize && !trivial; digit++)
+        {
+            size_t digitCount = 0;
+            for (size_t block = 0; block < blockCount; block++)
+                digitCount += histograms[block * radixSize + digit];
+            trivial = digitCount == count;
+        }
+        if (trivial)
+            continue;
+
+        // turn the histograms into output offsets, digit-major and block-minor to keep the sort stable
+        size_t offset = 0;
+        for (uint32_t digit = 0; digit < radixSize; digit++)
+        {
+            for (size_t block = 0; block < blockCount; block++)
+            {
+                size_t& bucket = histograms[block * radixSize + digit];
+                size_t bucketCount = bucket;
+                bucket = offset;
+                offset += bucketCount;
+            }
+        }
+
+        ParallelFor(executor, blockCount, [&](size_t block)
+        {
+            size_t* offsets = histograms.data() + block * radixSize;
+            size_t end = std::min(count, (block + 1) * blockSize);
+            for (size_t i = block * blockSize; i < end; i++)
+                scratch[offsets[(packets[i].key >> shift) & (radixSize - 1)]++] = packets[i];
+        });
+
+        packets.swap(scratch);
+    }
+}
+
+uint64_t CompiledOpaqueDrawStrategy::MakeSortKey(const DrawItem& item, uint32_t depthBucket)
+{
+    const uint64_t pass = (item.material->domain == MaterialDomain::AlphaTested) ? 1 : 0;
+    const uint64_t material = uint64_t(item.material->materialID) & 0xffff;
+    const uint64_t buffers = uint64_t(item.buffers ? item.buffers->globalBufferGroupIndex : 0) & 0xfff;
+    const uint64_t depth = uint64_t(depthBucket) & 0xff;
+    const uint64_t geometry = uint64_t(item.geometry->globalGeometryIndex) & 0x3ffffff;
+
+    return (pass << 62) | (material << 46) | (buffers << 34) | (depth << 26) | geometry;
+}
+
+uint32_t CompiledOpaqueDrawStrategy::GetDepthBucket(float distance)
+{
+    // 16 buckets per octave, which covers distances up to 2^16
+    float bucket = std::log2(1.f + std::max(distance, 0.f)) * 16.f;
+    return uint32_t(std::min(bucket, 255.f));
+}
+
+void CompiledOpaqueDrawStrategy::CullInstance(const MeshInstance* meshInstance, CullRange& range) const
+{
+    const SceneGraphNode* node = meshInstance->GetNode();
+    if (!node || !meshInstance->Visibility())
+        return;
+
+    auto relevantContentFlags = SceneContentFlags::OpaqueMeshes | SceneContentFlags::AlphaTestedMeshes;
+    if ((node->GetLeafContentFlags() & relevantContentFlags) == 0)
+        return;
+
+    if (!m_ViewFrustum.intersectsWith(node->GetGlobalBoundingBox()))
+        return;
+
+    if (m_OcclusionFilter && !m_OcclusionFilter->IsBoxVisible(node->GetGlobalBoundingBox()))
+        return;
+
+    const engine::MeshInfo* mesh = meshInstance->GetMesh().get();
+    const dm::affine3& localToWorld = node->GetLocalToWorldTransformFloat();
+
+    auto instanceArray = dynamic_cast<const MeshInstanceArray*>(meshInstance);
+    size_t drawsPerGeometry = 1;
+    if (instanceArray)
+    {
+        range.visibleCells.clear();
+        instanceArray->GetVisibleCells(m_ViewFrustum, localToWorld, range.visibleCells);
+        drawsPerGeometry = range.visibleCells.size();
+    }
+
+    for (const auto& geometry : mesh->geometries)
+    {
+        auto domain = geometry->material->domain;
+        if (domain != MaterialDomain::Opaque && domain != MaterialDomain::AlphaTested)
+            continue;
+
+        dm::box3 geometryGlobalBoundingBox = node->GetGlobalBoundingBox();
+        if (mesh->geometries.size() > 1 && !mesh->skinPrototype && !instanceArray)
+        {
+            geometryGlobalBoundingBox = geometry->objectSpaceBounds * localToWorld;
+            if (!m_ViewFrustum.intersectsWith(geometryGlobalBoundingBox))
+                continue;
+        }
+
+        for (size_t draw = 0; draw < drawsPerGeometry; draw++)
+        {
+            DrawItem item{};
+            item.instance = meshInstance;
+            item.mesh = mesh;
+            item.geometry = geometry.get();
+            item.material = geometry->material.get();
+            item.buffers = mesh->buffers.get();
+            item.cullMode = (item.material->doubleSided) ? nvrhi::RasterCullMode::None : nvrhi::RasterCullMode::Back;
+
+            if (instanceArray)
+            {
+                const InstanceArrayCell& cell = instanceArray->GetCells()[range.visibleCells[draw]];
+                item.instanceOffset = cell.firstInstance;
+                item.instanceCount = cell.instanceCount;
+                geometryGlobalBoundingBox = cell.bounds * localToWorld;
+            }
+
+            item.distanceToCamera = length(geometryGlobalBoundingBox.center() - m_ViewOrigin);
+
+            range.items.push_back(item);
+            range.keys.push_back(MakeSortKey(item, SortByDepth ? GetDepthBucket(item.distanceToCamera) : 0));
+        }
+    }
+}
+
+void CompiledOpaqueDrawStrategy::MergeSortedItems()
+{
+    m_MergedItems.clear();
+
+    for (const DrawPacket& packet : m_Packets)
+    {
+        const DrawItem& item = m_Items[packet.itemIndex];
+
+        if (!m_MergedItems.empty())
+        {
+            DrawItem& last = m_MergedItems.back();
+            if (last.geometry == item.geometry &&
+                last.material == item.material &&
+                last.buffers == item.buffers &&
+                last.cullMode == item.cullMode &&
+                last.instance->GetInstanceIndex() + last.instanceOffset + last.instanceCount == item.instance->GetInstanceIndex() + item.instanceOffset)
+            {
+                last.instanceCount += item.instanceCount;
+                continue;
+            }
+        }
+
+        m_MergedItems.push_back(item);
+    }
+}
+
+void CompiledOpaqueDrawStrategy::PrepareForView(const std::shared_ptr<engine::SceneGraphNode>& rootNode, const engine::IView& view)
+{
+    m_ViewFrustum = view.GetViewFrustum();
+    m_ViewOrigin = view.GetViewOrigin();
+    m_ReadPtr = 0;
+
+    // Use the flat instance list of the graph when drawing all of it, otherwise collect the instances of the subgraph
+    const std::vector<std::shared_ptr<MeshInstance>>* graphInstances = nullptr;
+    auto graph = rootNode ? rootNode->GetGraph() : nullptr;
+    if (graph && graph->GetRootNode() == rootNode)
+        graphInstances = &graph->GetMeshInstances();
+
+    m_CollectedInstances.clear();
+    if (!graphInstances && rootNode)
+    {
+        auto relevantContentFlags = SceneContentFlags::OpaqueMeshes | SceneContentFlags::AlphaTestedMeshes;
+        SceneGraphWalker walker(rootNode.get());
+        while (walker)
+        {
+            bool subgraphContentRelevant = (walker->GetSubgraphContentFlags() & relevantContentFlags) != 0;
+            if (subgraphContentRelevant)
+            {
+                if (auto meshInstance = dynamic_cast<const MeshInstance*>(walker->GetLeaf().get()))
+                    m_CollectedInstances.push_back(meshInstance);
+            }
+            walker.Next(subgraphContentRelevant);
+        }
+    }
+
+    const size_t instanceCount = graphInstances ? graphInstances->size() : m_CollectedInstances.size();
+    const size_t rangeCount = (instanceCount + m_InstancesPerRange - 1) / m_InstancesPerRange;
+    if (m_Ranges.size() < rangeCount)
+        m_Ranges.resize(rangeCount);
+
+    // cull and pack
+    ParallelFor(m_Executor, rangeCount, [this, graphInstances, instanceCount](size_t rangeIndex)
+    {
+        CullRange& range = m_Ranges[rangeIndex];
+        range.items.clear();
+        range.keys.clear();
+
+        size_t end = std::min(instanceCount, (rangeIndex + 1) * m_InstancesPerRange);
+        for (size_t index = rangeIndex * m_InstancesPerRange; index < end; index++)
+        {
+            const MeshInstance* meshInstance = graphInstances ? (*graphInstances)[index].get() : m_CollectedInstances[index];
+            CullInstance(meshInstance, range);
+        }
+    });
+
+    // concatenate the ranges in order
+    size_t itemCount = 0;
+    for (size_t rangeIndex = 0; rangeIndex < rangeCount; rangeIndex++)
+        itemCount += m_Ranges[rangeIndex].items.size();
+
+    m_Items.resize(itemCount);
+    m_Packets.resize(itemCount);
+
+    size_t itemOffset = 0;
+    for (size_t rangeIndex = 0; rangeIndex < rangeCount; rangeIndex++)
+    {
+        const CullRange& range = m_Ranges[rangeIndex];
+        std::copy(range.items.begin(), range.items.end(), m_Items.begin() + itemOffset);
+        for (size_t i = 0; i < range.keys.size(); i++)
+        {
+            m_Packets[itemOffset + i].key = range.keys[i];
+            m_Packets[itemOffset + i].itemIndex = uint32_t(itemOffset + i);
+        }
+        itemOffset += range.items.size();
+    }
+
+    RadixSortDrawPackets(m_Packets, m_SortScratch, m_Executor);
+
+    MergeSortedItems();
+}
+
+const DrawItem* CompiledOpaqueDrawStrategy::GetNextItem()
+{
+    if (m_ReadPtr >= m_MergedItems.size())
+        return nullptr;
+
+    return &m_MergedItems[m_ReadPtr++];
+}
@@ -0,0 +1,171 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/render/DynamicResolution.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace donut::math;
+using namespace donut::render;
+
+DynamicResolutionController::DynamicResolutionController()
+{
+    Reset();
+}
+
+void DynamicResolutionController::Reset()
+{
+    m_FrameTimes.clear();
+    m_Scale = Quantize(MaxScale);
+    m_Integral = 0.f;
+    m_PreviousError = 0.f;
+    m_FilteredFrameTimeMs = 0.f;
+    m_FramesSinceChange = 0;
+}
+
+void DynamicResolutionController::SetScale(float scale)
+{
+    m_Scale = Quantize(scale);
+    m_FrameTimes.clear();
+    m_Integral = 0.f;
+    m_PreviousError = 0.f;
+    m_FramesSinceChange = 0;
+}
+
+float DynamicResolutionController::Quantize(float scale) const
+{
+    if (ScaleStep > 0.f)
+        scale = std::round(scale / ScaleStep) * ScaleStep;
+
+    return clamp(scale, MinScale, MaxScale);
+}
+
+float DynamicResolutionController::GetMedianFrameTime() const
+{
+    const size_t count = std::min<size_t>(m_FrameTimes.size(), std::max(FilterFrames, 1u));
+
+    float values[c_HistoryLength];
+    for (size_t i = 0; i < count; i++)
+        values[i] = m_FrameTimes[m_FrameTimes.size() - count + i];
+
+    std::nth_element(values, values + count / 2, values + count);
+    return values[count / 2];
+}
+
+float DynamicResolutionController::Update(float frameTimeMs)
+{
+    if (!std::isfinite(frameTimeMs) || frameTimeMs <= 0.f)
+        return m_Scale;
+
+    m_FrameTimes.push_back(frameTimeMs);
+    if (m_FramesSinceChange < UINT32_MAX)
+        ++m_FramesSinceChange;
+
+    // Wait until the filter only contains frames rendered at the current scale,
+    // otherwise the response to a change would be counted twice
+    if (m_FrameTimes.size() < std::min<size_t>(std::max(FilterFrames, 1u), c_HistoryLength))
+        return m_Scale;
+
+    m_FilteredFrameTimeMs = GetMedianFrameTime();
+
+    const float budget = std::max(TargetFrameTimeMs, 1e-3f);
+    const float lowerBound = budget * (1.f - Hysteresis);
+
+    if (m_FilteredFrameTimeMs <= budget && m_FilteredFrameTimeMs >= lowerBound)
+    {
+        // On target
+        m_Integral = 0.f;
+        m_PreviousError = 0.f;
+        return m_Scale;
+    }
+
+    // Relative change of the pixel count that would bring the frame time to the middle of the band
+    const float target = 0.5f * (budget + lowerBound);
+    const float error = target / m_FilteredFrameTimeMs - 1.f;
+
+    m_Integral = clamp(m_Integral + error, -4.f, 4.f);
+    const float derivative = error - m_PreviousError;
+    m_PreviousError = error;
+
+    float areaChange = ProportionalGain * error + IntegralGain * m_Integral + DerivativeGain * derivative;
+    areaChange = clamp(areaChange, -MaxAreaChange, MaxAreaChange);
+
+    const float area = m_Scale * m_Scale * (1.f + areaChange);
+    const float newScale = Quantize(std::sqrt(std::max(area, 0.f)));
+
+    if (newScale == m_Scale)
+        return m_Scale;
+
+    if (newScale > m_Scale)
+    {
+        if (m_FramesSinceChange < CooldownFrames)
+            return m_Scale;
+
+        // Don't go up if the frame is expected to exceed the budget at the new scale, which would
+        // just bring us back down after a few frames. The prediction uses the mean of the whole history,
+        // which is steadier than the median of the last few frames.
+        float meanFrameTimeMs = 0.f;
+        for (float frameTime : m_FrameTimes)
+            meanFrameTimeMs += frameTime;
+        meanFrameTimeMs /= float(m_FrameTimes.size());
+
+        const float ratio = newScale / m_Scale;
+        if (std::max(meanFrameTimeMs, m_FilteredFrameTimeMs) * ratio * ratio > budget)
+            return m_Scale;
+    }
+
+    m_Scale = newScale;
+    m_FrameTimes.clear();
+    m_Integral = 0.f;
+    m_PreviousError = 0.f;
+    m_FramesSinceChange = 0;
+
+    return m_Scale;
+}
+
+uint2 donut::render::GetDynamicRenderSize(uint2 maxSize, float scale)
+{
+    scale = clamp(scale, 0.f, 1.f);
+
+    uint2 size;
+    for (int axis = 0; axis < 2; axis++)
+    {
+        uint32_t value = uint32_t(std::lround(float(maxSize[axis]) * scale * 0.5f)) * 2;
+        size[axis] = clamp(value, std::min(maxSize[axis], 2u), maxSize[axis]);
+    }
+
+    return size;
+}
+
+nvrhi::Viewport donut::render::GetDynamicRenderViewport(uint2 maxSize, float scale)
+{
+    uint2 size = GetDynamicRenderSize(maxSize, scale);
+    return nvrhi::Viewport(float(size.x), float(size.y));
+}
+
+float2 donut::render::GetDynamicRenderUVScale(uint2 maxSize, uint2 renderSize)
+{
+    if (maxSize.x == 0 || maxSize.y == 0)
+        return float2(1.f);
+
+    return float2(renderSize) / float2(maxSize);
+}
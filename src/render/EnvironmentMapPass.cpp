@@ -25,6 +25,7 @@
 #include <donut/engine/ShaderFactory.h>
 #include <donut/engine/CommonRenderPasses.h>
 #include <donut/engine/View.h>
+#include <donut/engine/GpuProfiler.h>
 #include <donut/core/math/math.h>
 
 using namespace donut::math;
@@ -105,7 +106,7 @@ void EnvironmentMapPass::Render(
     nvrhi::ICommandList* commandList,
     const ICompositeView& compositeView)
 {
-    commandList->beginMarker("Environment Map");
+    BeginMarker(commandList, "Environment Map");
 
     for (uint viewIndex = 0; viewIndex < compositeView.GetNumChildViews(ViewType::PLANAR); viewIndex++)
     {
@@ -129,5 +130,5 @@ void EnvironmentMapPass::Render(
         commandList->draw(args);
     }
 
-    commandList->endMarker();
+    EndMarker(commandList);
 }
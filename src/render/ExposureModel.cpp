@@ -0,0 +1,383 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/render/ExposureModel.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DONUT_EXPOSURE_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+using namespace donut::render;
+
+static constexpr float c_FixedPointMultiplier = float(1 << c_ExposureHistogramFracBits);
+
+ExposureModel::ExposureModel(const ExposureHistogramRange& range)
+    : m_Range(range)
+{
+}
+
+void ExposureModel::GetClampedPercentiles(const ToneMappingParameters& params, float& lowPercentile, float& highPercentile)
+{
+    lowPercentile = std::min(0.99f, std::max(0.f, params.histogramLowPercentile));
+    highPercentile = std::min(1.f, std::max(lowPercentile, params.histogramHighPercentile));
+}
+
+float ExposureModel::ComputeTargetLuminance(const uint32_t* histogram, const ExposureHistogramRange& range,
+    const ToneMappingParameters& params)
+{
+    // Same operations as exposure_cs.hlsl
+
+    float lowPercentile, highPercentile;
+    GetClampedPercentiles(params, lowPercentile, highPercentile);
+
+    const float logLuminanceScale = range.maxLogLuminance - range.minLogLuminance;
+    const float logLuminanceBias = range.minLogLuminance;
+
+    float cdf = 0.f;
+    for (uint32_t i = 0; i < range.bins; ++i)
+        cdf += float(histogram[i]) / c_FixedPointMultiplier;
+
+    const float lowCdf = cdf * lowPercentile;
+    const float highCdf = cdf * highPercentile;
+
+    float weightSum = 0.f;
+    float binSum = 0.f;
+    cdf = 0.f;
+
+    for (uint32_t i = 0; i < range.bins; ++i)
+    {
+        const float binValue = float(histogram[i]) / c_FixedPointMultiplier;
+
+        if (lowCdf <= cdf + binValue && cdf <= highCdf)
+        {
+            // Note: the bins are centered at i / (bins - 1) when the histogram is built
+            const float histogramBinLuminance = exp2f((float(i) / float(range.bins)) * logLuminanceScale + logLuminanceBias);
+
+            weightSum += histogramBinLuminance * binValue;
+            binSum += binValue;
+        }
+
+        cdf += binValue;
+    }
+
+    float targetLuminance = (binSum > 0.f) ? (weightSum / binSum) : 0.f;
+
+    return std::min(std::max(targetLuminance, params.minAdaptedLuminance), params.maxAdaptedLuminance);
+}
+
+float ExposureModel::Adapt(float adaptedLuminance, float targetLuminance, const ToneMappingParameters& params, float frameTime)
+{
+    const float diff = adaptedLuminance - targetLuminance;
+
+    const float adaptationSpeed = (diff < 0.f)
+        ? params.eyeAdaptationSpeedUp
+        : params.eyeAdaptationSpeedDown;
+
+    if (adaptationSpeed > 0.f)
+        targetLuminance += diff * exp2f(-frameTime * adaptationSpeed);
+
+    return targetLuminance;
+}
+
+float ExposureModel::AdvanceFrame(const uint32_t* histogram, const ToneMappingParameters& params, float frameTime)
+{
+    const float targetLuminance = ComputeTargetLuminance(histogram, m_Range, params);
+    m_AdaptedLuminance = Adapt(m_AdaptedLuminance, targetLuminance, params, frameTime);
+    return m_AdaptedLuminance;
+}
+
+namespace
+{
+    // The GPU computes log2(luminance) and saturates the bin position, so anything outside of the range,
+    // including zero, negative and NaN luminance, lands in the first or the last bin. Clamping the luminance
+    // to the range first gives the same bins and keeps the log2 approximation below in its domain.
+    struct HistogramMapping
+    {
+        float minLuminance;
+        float maxLuminance;
+        float logLuminanceScale;
+        float logLuminanceBias;
+        float maxBin;
+        uint32_t bins;
+
+        explicit HistogramMapping(const ExposureHistogramRange& range)
+        {
+            minLuminance = exp2f(range.minLogLuminance);
+            maxLuminance = exp2f(range.maxLogLuminance);
+            logLuminanceScale = 1.f / (range.maxLogLuminance - range.minLogLuminance);
+            logLuminanceBias = -range.minLogLuminance * logLuminanceScale;
+            maxBin = float(range.bins - 1);
+            bins = range.bins;
+        }
+    };
+
+    // log2 for positive normal numbers: the exponent plus an odd series of atanh for the mantissa
+    // in [sqrt(1/2), sqrt(2)). Absolute error is below 1e-6. The SSE version performs the same operations.
+    constexpr float c_Sqrt2 = 1.41421356f;
+    constexpr float c_Log2C1 = 2.88539008f;  // 2 / ln(2)
+    constexpr float c_Log2C3 = 0.961796694f; // 2 / (3 ln(2))
+    constexpr float c_Log2C5 = 0.577078016f; // 2 / (5 ln(2))
+    constexpr float c_Log2C7 = 0.412198583f; // 2 / (7 ln(2))
+    constexpr float c_Log2C9 = 0.320598898f; // 2 / (9 ln(2))
+
+    float Log2Positive(float x)
+    {
+        uint32_t bits;
+        memcpy(&bits, &x, sizeof(bits));
+
+        int32_t exponent = int32_t(bits >> 23) - 127;
+        bits = (bits & 0x007fffff) | 0x3f800000;
+        float mantissa;
+        memcpy(&mantissa, &bits, sizeof(mantissa));
+
+        if (mantissa > c_Sqrt2)
+        {
+            mantissa = mantissa * 0.5f;
+            exponent += 1;
+        }
+
+        const float t = (mantissa - 1.f) / (mantissa + 1.f);
+        const float t2 = t * t;
+        const float series = t * (c_Log2C1 + t2 * (c_Log2C3 + t2 * (c_Log2C5 + t2 * (c_Log2C7 + t2 * c_Log2C9))));
+        return float(exponent) + series;
+    }
+
+    void AddWeights(uint32_t* histogram, uint32_t bins, uint32_t leftBin, uint32_t rightWeight)
+    {
+        const uint32_t fixedPointOne = 1u << c_ExposureHistogramFracBits;
+        const uint32_t leftWeight = fixedPointOne - rightWeight;
+        const uint32_t rightBin = leftBin + 1;
+
+        if (leftWeight != 0 && leftBin < bins)
+            histogram[leftBin] += leftWeight;
+        if (rightWeight != 0 && rightBin < bins)
+            histogram[rightBin] += rightWeight;
+    }
+
+    void AddPixel(const HistogramMapping& mapping, float r, float g, float b, uint32_t* histogram)
+    {
+        float luminance = 0.2126f * r + 0.7152f * g + 0.0722f * b;
+        luminance = (luminance > mapping.minLuminance) ? luminance : mapping.minLuminance;
+        luminance = (luminance < mapping.maxLuminance) ? luminance : mapping.maxLuminance;
+
+        float biasedLogLuminance = Log2Positive(luminance) * mapping.logLuminanceScale + mapping.logLuminanceBias;
+        biasedLogLuminance = (biasedLogLuminance > 0.f) ? biasedLogLuminance : 0.f;
+        biasedLogLuminance = (biasedLogLuminance < 1.f) ? biasedLogLuminance : 1.f;
+
+        const float histogramBin = biasedLogLuminance * mapping.maxBin;
+        const uint32_t leftBin = uint32_t(int32_t(histogramBin));
+        const float fraction = histogramBin - float(int32_t(leftBin));
+        const uint32_t rightWeight = uint32_t(int32_t(fraction * c_FixedPointMultiplier));
+
+        AddWeights(histogram, mapping.bins, leftBin, rightWeight);
+    }
+
+#ifdef DONUT_EXPOSURE_USE_SSE
+    __m128 Log2PositiveSSE(__m128 x)
+    {
+        const __m128i bits = _mm_castps_si128(x);
+        __m128i exponent = _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127));
+        __m128 mantissa = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f800000)));
+
+        const __m128 large = _mm_cmpgt_ps(mantissa, _mm_set1_ps(c_Sqrt2));
+        mantissa = _mm_or_ps(_mm_and_ps(large, _mm_mul_ps(mantissa, _mm_set1_ps(0.5f))), _mm_andnot_ps(large, mantissa));
+        exponent = _mm_sub_epi32(exponent, _mm_castps_si128(large)); // mask is -1 where large
+
+        const __m128 one = _mm_set1_ps(1.f);
+        const __m128 t = _mm_div_ps(_mm_sub_ps(mantissa, one), _mm_add_ps(mantissa, one));
+        const __m128 t2 = _mm_mul_ps(t, t);
+        __m128 series = _mm_add_ps(_mm_set1_ps(c_Log2C7), _mm_mul_ps(t2, _mm_set1_ps(c_Log2C9)));
+        series = _mm_add_ps(_mm_set1_ps(c_Log2C5), _mm_mul_ps(t2, series));
+        series = _mm_add_ps(_mm_set1_ps(c_Log2C3), _mm_mul_ps(t2, series));
+        series = _mm_add_ps(_mm_set1_ps(c_Log2C1), _mm_mul_ps(t2, series));
+        series = _mm_mul_ps(t, series);
+
+        return _mm_add_ps(_mm_cvtepi32_ps(exponent), series);
+    }
+
+    void AddPixelsSSE(const HistogramMapping& mapping, __m128 r, __m128 g, __m128 b, uint32_t* histogram)
+    {
+        __m128 luminance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.2126f), r), _mm_mul_ps(_mm_set1_ps(0.7152f), g)),
+            _mm_mul_ps(_mm_set1_ps(0.0722f), b));
+        // max/min return the second operand for NaN, like the scalar comparisons
+        luminance = _mm_max_ps(luminance, _mm_set1_ps(mapping.minLuminance));
+        luminance = _mm_min_ps(luminance, _mm_set1_ps(mapping.maxLuminance));
+
+        __m128 biasedLogLuminance = _mm_add_ps(_mm_mul_ps(Log2PositiveSSE(luminance), _mm_set1_ps(mapping.logLuminanceScale)),
+            _mm_set1_ps(mapping.logLuminanceBias));
+        biasedLogLuminance = _mm_max_ps(biasedLogLuminance, _mm_setzero_ps());
+        biasedLogLuminance = _mm_min_ps(biasedLogLuminance, _mm_set1_ps(1.f));
+
+        const __m128 histogramBin = _mm_mul_ps(biasedLogLuminance, _mm_set1_ps(mapping.maxBin));
+        const __m128i leftBin = _mm_cvttps_epi32(histogramBin);
+        const __m128 fraction = _mm_sub_ps(histogramBin, _mm_cvtepi32_ps(leftBin));
+        const __m128i rightWeight = _mm_cvttps_epi32(_mm_mul_ps(fraction, _mm_set1_ps(c_FixedPointMultiplier)));
+
+        alignas(16) uint32_t leftBins[4];
+        alignas(16) uint32_t rightWeights[4];
+        _mm_store_si128((__m128i*)leftBins, leftBin);
+        _mm_store_si128((__m128i*)rightWeights, rightWeight);
+
+        for (int lane = 0; lane < 4; lane++)
+            AddWeights(histogram, mapping.bins, leftBins[lane], rightWeights[lane]);
+    }
+#endif
+}
+
+void donut::render::AddImageToLuminanceHistogram(const float* pixels, uint32_t width, uint32_t height, size_t rowPitch,
+    uint32_t channels, const ExposureHistogramRange& range, uint32_t* histogram)
+{
+    if (!pixels || !histogram || range.bins == 0 || channels < 3)
+        return;
+
+    const HistogramMapping mapping(range);
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+        const float* row = (const float*)((const uint8_t*)pixels + rowPitch * y);
+        uint32_t x = 0;
+
+#ifdef DONUT_EXPOSURE_USE_SSE
+        for (; x + 4 <= width; x += 4)
+        {
+            const float* p = row + x * channels;
+            __m128 r, g, b;
+            if (channels == 4)
+            {
+                __m128 p0 = _mm_loadu_ps(p);
+                __m128 p1 = _mm_loadu_ps(p + 4);
+                __m128 p2 = _mm_loadu_ps(p + 8);
+                __m128 p3 = _mm_loadu_ps(p + 12);
+                _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+                r = p0;
+                g = p1;
+                b = p2;
+            }
+            else
+            {
+                r = _mm_setr_ps(p[0], p[channels], p[channels * 2], p[channels * 3]);
+                g = _mm_setr_ps(p[1], p[channels + 1], p[channels * 2 + 1], p[channels * 3 + 1]);
+                b = _mm_setr_ps(p[2], p[channels + 2], p[channels * 2 + 2], p[channels * 3 + 2]);
+            }
+
+            AddPixelsSSE(mapping, r, g, b, histogram);
+        }
+#endif
+
+        for (; x < width; x++)
+        {
+            const float* p = row + x * channels;
+            AddPixel(mapping, p[0], p[1], p[2], histogram);
+        }
+    }
+}
+
+void ExposureRecording::AddFrame(const uint32_t* histogram, float frameTime)
+{
+    Frame frame;
+    frame.frameTime = frameTime;
+    frame.histogram.assign(histogram, histogram + range.bins);
+    frames.push_back(std::move(frame));
+}
+
+void ExposureRecording::Write(std::ostream& stream) const
+{
+    char buf[128];
+    snprintf(buf, sizeof(buf), "exposure_recording %u %.9g %.9g\n", range.bins, range.minLogLuminance, range.maxLogLuminance);
+    stream << buf;
+
+    for (const Frame& frame : frames)
+    {
+        snprintf(buf, sizeof(buf), "%.9g", frame.frameTime);
+        stream << buf;
+        for (uint32_t value : frame.histogram)
+            stream << ' ' << value;
+        stream << '\n';
+    }
+}
+
+bool ExposureRecording::Read(std::istream& stream)
+{
+    frames.clear();
+
+    std::string line;
+    if (!std::getline(stream, line))
+        return false;
+
+    std::istringstream header(line);
+    std::string magic;
+    ExposureHistogramRange newRange;
+    if (!(header >> magic >> newRange.bins >> newRange.minLogLuminance >> newRange.maxLogLuminance)
+        || magic != "exposure_recording" || newRange.bins == 0)
+        return false;
+
+    range = newRange;
+
+    while (std::getline(stream, line))
+    {
+        if (line.empty())
+            continue;
+
+        std::istringstream values(line);
+        Frame frame;
+        frame.histogram.resize(range.bins);
+        if (!(values >> frame.frameTime))
+            return false;
+        for (uint32_t& value : frame.histogram)
+        {
+            if (!(values >> value))
+                return false;
+        }
+
+        frames.push_back(std::move(frame));
+    }
+
+    return true;
+}
+
+std::vector<float> donut::render::ReplayExposure(const ExposureRecording& recording, const ToneMappingParameters& params,
+    float initialAdaptedLuminance)
+{
+    ExposureModel model(recording.range);
+    model.Reset(initialAdaptedLuminance);
+
+    std::vector<float> adaptedLuminance;
+    adaptedLuminance.reserve(recording.frames.size());
+
+    for (const auto& frame : recording.frames)
+    {
+        if (frame.histogram.size() < recording.range.bins)
+            break;
+
+        adaptedLuminance.push_back(model.AdvanceFrame(frame.histogram.data(), params, frame.frameTime));
+    }
+
+    return adaptedLuminance;
+}
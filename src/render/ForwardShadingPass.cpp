@@ -83,6 +83,11 @@ void ForwardShadingPass::ResetBindingCache()
     m_LightBindingSets.clear();
 }
 
+void ForwardShadingPass::ReleaseDestroyedMaterials() const
+{
+    m_MaterialBindings->ReleaseDestroyedMaterials();
+}
+
 nvrhi::ShaderHandle ForwardShadingPass::CreateVertexShader(ShaderFactory& shaderFactory, const CreateParameters& params)
 {
     return shaderFactory.CreateShader("donut/passes/forward_vs.hlsl", "main", nullptr, nvrhi::ShaderType::Vertex);
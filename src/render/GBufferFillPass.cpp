@@ -75,6 +75,11 @@ void GBufferFillPass::ResetBindingCache() const
     m_MaterialBindings->Clear();
 }
 
+void GBufferFillPass::ReleaseDestroyedMaterials() const
+{
+    m_MaterialBindings->ReleaseDestroyedMaterials();
+}
+
 nvrhi::ShaderHandle GBufferFillPass::CreateVertexShader(ShaderFactory& shaderFactory, const CreateParameters& params)
 {
     std::vector<ShaderMacro> VertexShaderMacros;
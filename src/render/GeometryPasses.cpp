@@ -23,6 +23,7 @@
 #include <donut/render/GeometryPasses.h>
 #include <donut/engine/SceneGraph.h>
 #include <donut/engine/FramebufferFactory.h>
+#include <donut/engine/GpuProfiler.h>
 #include <donut/render/DrawStrategy.h>
 
 using namespace donut::math;
@@ -126,16 +127,19 @@ void donut::render::RenderView(
 
             nvrhi::DrawArguments args;
             args.vertexCount = item->geometry->numIndices;
-            args.instanceCount = 1;
+            args.instanceCount = item->instanceCount;
             args.startVertexLocation = item->mesh->vertexOffset + item->geometry->vertexOffsetInMesh;
             args.startIndexLocation = item->mesh->indexOffset + item->geometry->indexOffsetInMesh;
-            args.startInstanceLocation = item->instance->GetInstanceIndex();
+            args.startInstanceLocation = item->instance->GetInstanceIndex() + item->instanceOffset;
+
+            if (args.instanceCount == 0)
+                continue;
 
             if (currentDraw.instanceCount > 0 && 
                 currentDraw.startIndexLocation == args.startIndexLocation && 
                 currentDraw.startInstanceLocation + currentDraw.instanceCount == args.startInstanceLocation)
             {
-                currentDraw.instanceCount += 1;
+                currentDraw.instanceCount += args.instanceCount;
             }
             else
             {
@@ -165,7 +169,7 @@ void donut::render::RenderCompositeView(
     bool materialEvents)
 {
     if (passEvent)
-        commandList->beginMarker(passEvent);
+        BeginMarker(commandList, passEvent);
 
     ViewType::Enum supportedViewTypes = pass.GetSupportedViewTypes();
 
@@ -175,14 +179,30 @@ void donut::render::RenderCompositeView(
         assert(compositeView->GetNumChildViews(supportedViewTypes) == compositeViewPrev->GetNumChildViews(supportedViewTypes));
     }
     
-    for (uint viewIndex = 0; viewIndex < compositeView->GetNumChildViews(supportedViewTypes); viewIndex++)
+    uint32_t numChildViews = compositeView->GetNumChildViews(supportedViewTypes);
+
+    // cull all child views in one scene traversal if the strategy supports it
+    bool multiView = false;
+    if (numChildViews > 1)
+    {
+        std::vector<const IView*> childViews(numChildViews);
+        for (uint viewIndex = 0; viewIndex < numChildViews; viewIndex++)
+            childViews[viewIndex] = compositeView->GetChildView(supportedViewTypes, viewIndex);
+
+        multiView = drawStrategy.PrepareForViews(rootNode, childViews.data(), numChildViews);
+    }
+    
+    for (uint viewIndex = 0; viewIndex < numChildViews; viewIndex++)
     {
         const IView* view = compositeView->GetChildView(supportedViewTypes, viewIndex);
         const IView* viewPrev = compositeViewPrev ? compositeViewPrev->GetChildView(supportedViewTypes, viewIndex) : nullptr;
 
         assert(view != nullptr);
 
-        drawStrategy.PrepareForView(rootNode, *view);
+        if (multiView)
+            drawStrategy.SelectView(viewIndex);
+        else
+            drawStrategy.PrepareForView(rootNode, *view);
 
         nvrhi::IFramebuffer* framebuffer = framebufferFactory.GetFramebuffer(*view);
 
@@ -190,5 +210,5 @@ void donut::render::RenderCompositeView(
     }
 
     if (passEvent)
-        commandList->endMarker();
+        EndMarker(commandList);
 }
@@ -0,0 +1,661 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/render/GpuCulling.h>
+#include <donut/render/GeometryPasses.h>
+#include <donut/engine/CommonRenderPasses.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/ShaderFactory.h>
+#include <donut/engine/View.h>
+#include <cassert>
+#include <cmath>
+#include <tuple>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
+using namespace donut::math;
+#include <donut/shaders/bindless.h>
+#include <donut/shaders/gpu_culling_cb.h>
+
+using namespace donut::engine;
+using namespace donut::render;
+
+static_assert(sizeof(InstanceData) == 112, "gpu_culling_cs.hlsl reads InstanceData with a stride of 112 bytes");
+static_assert(sizeof(nvrhi::DrawIndexedIndirectArguments) == 5 * sizeof(uint32_t), "gpu_culling_cs.hlsl writes 5 uints per draw");
+
+// The functions below mirror gpu_culling_cs.hlsl. Each floating point expression is evaluated in the same order as
+// in the shader, where 'precise' prevents fusing; this file is compiled without FP contraction for the same reason.
+
+static void TransformBounds(const float3x4& transform, const float3& boundsMin, const float3& boundsMax, float3& worldMin, float3& worldMax)
+{
+    float3 center = (boundsMin + boundsMax) * 0.5f;
+    float3 extent = (boundsMax - boundsMin) * 0.5f;
+
+    float3 worldCenter;
+    float3 worldExtent;
+
+    for (int row = 0; row < 3; row++)
+    {
+        const float4& m = transform[row];
+        worldCenter[row] = m.x * center.x + m.y * center.y + m.z * center.z + m.w;
+        worldExtent[row] = std::abs(m.x) * extent.x + std::abs(m.y) * extent.y + std::abs(m.z) * extent.z;
+    }
+
+    worldMin = worldCenter - worldExtent;
+    worldMax = worldCenter + worldExtent;
+}
+
+static bool IsOutsideFrustum(const GpuCullingConstants& constants, const float3& worldMin, const float3& worldMax)
+{
+    for (int i = 0; i < 6; i++)
+    {
+        const float4& plane = constants.frustumPlanes[i];
+        float3 p = float3(
+            plane.x > 0 ? worldMin.x : worldMax.x,
+            plane.y > 0 ? worldMin.y : worldMax.y,
+            plane.z > 0 ? worldMin.z : worldMax.z);
+
+        float distance = plane.x * p.x + plane.y * p.y + plane.z * p.z - plane.w;
+        if (distance > 0)
+            return true;
+    }
+
+    return false;
+}
+
+static uint32_t GetTexelIndex(float x, float w, uint32_t size, float texelSize)
+{
+    float estimate = std::floor((x / w + 1.f) / texelSize);
+    if (!(estimate >= 0.f))
+        estimate = 0.f;
+    int i = int(std::min(estimate, float(size - 1)));
+
+    float edge = (float(i) * texelSize - 1.f) * w;
+    while (i > 0 && edge > x)
+    {
+        --i;
+        edge = (float(i) * texelSize - 1.f) * w;
+    }
+
+    float nextEdge = (float(i + 1) * texelSize - 1.f) * w;
+    while (uint32_t(i + 1) < size && nextEdge <= x)
+    {
+        ++i;
+        nextEdge = (float(i + 1) * texelSize - 1.f) * w;
+    }
+
+    return uint32_t(i);
+}
+
+static bool IsOccluded(const GpuCullingConstants& constants, const DepthPyramid& pyramid, const float3& worldMin, const float3& worldMax)
+{
+    bool reverseDepth = (constants.flags & GPU_CULLING_FLAG_REVERSE_DEPTH) != 0;
+    const float4x4& m = constants.matWorldToClipOcclusion;
+
+    float4 clip[8];
+    uint2 rectMin = uint2(~0u, ~0u);
+    uint2 rectMax = uint2(0u, 0u);
+
+    for (uint32_t corner = 0; corner < 8; corner++)
+    {
+        float3 p = float3(
+            (corner & 1) ? worldMax.x : worldMin.x,
+            (corner & 2) ? worldMax.y : worldMin.y,
+            (corner & 4) ? worldMax.z : worldMin.z);
+
+        clip[corner] = p.x * m[0] + p.y * m[1] + p.z * m[2] + m[3];
+
+        if (!(clip[corner].w > 0))
+            return false;
+
+        uint2 texel = uint2(
+            GetTexelIndex(clip[corner].x, clip[corner].w, constants.pyramidWidth, constants.pyramidTexelSizeX),
+            GetTexelIndex(-clip[corner].y, clip[corner].w, constants.pyramidHeight, constants.pyramidTexelSizeY));
+
+        rectMin = min(rectMin, texel);
+        rectMax = max(rectMax, texel);
+    }
+
+    uint32_t level = 0;
+    while (level + 1 < constants.pyramidLevels && (
+        (rectMax.x >> level) - (rectMin.x >> level) > 1 ||
+        (rectMax.y >> level) - (rectMin.y >> level) > 1))
+    {
+        ++level;
+    }
+
+    uint2 levelSize = uint2(
+        std::max(constants.pyramidWidth >> level, 1u),
+        std::max(constants.pyramidHeight >> level, 1u));
+    uint2 first = min(uint2(rectMin.x >> level, rectMin.y >> level), levelSize - 1u);
+    uint2 last = min(uint2(rectMax.x >> level, rectMax.y >> level), levelSize - 1u);
+
+    float farthest = pyramid.Load(first.x, first.y, level);
+    for (uint32_t y = first.y; y <= last.y; y++)
+    {
+        for (uint32_t x = first.x; x <= last.x; x++)
+        {
+            float depth = pyramid.Load(x, y, level);
+            farthest = reverseDepth ? std::min(farthest, depth) : std::max(farthest, depth);
+        }
+    }
+
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        float occluderDepth = farthest * clip[i].w;
+        bool behind = reverseDepth ? (clip[i].z < occluderDepth) : (clip[i].z > occluderDepth);
+        if (!behind)
+            return false;
+    }
+
+    return true;
+}
+
+bool donut::render::IsDrawRecordVisible(
+    const GpuCullingConstants& constants,
+    const InstanceData* instances,
+    const GpuCullingDrawRecord& record,
+    const DepthPyramid* pyramid)
+{
+    if (record.flags & GPU_CULLING_RECORD_NO_CULLING)
+        return true;
+
+    if (record.instanceIndex >= constants.instanceCount)
+        return false;
+
+    const InstanceData& instance = instances[record.instanceIndex];
+
+    float3 worldMin, worldMax;
+    TransformBounds(instance.transform, record.boundsMin, record.boundsMax, worldMin, worldMax);
+
+    if (IsOutsideFrustum(constants, worldMin, worldMax))
+        return false;
+
+    if ((constants.flags & GPU_CULLING_FLAG_OCCLUSION) != 0 && pyramid && IsOccluded(constants, *pyramid, worldMin, worldMax))
+        return false;
+
+    return true;
+}
+
+void donut::render::CullDrawRecords(
+    const GpuCullingConstants& constants,
+    const InstanceData* instances,
+    const GpuCullingDrawRecord* records,
+    const GpuCullingBucket* buckets,
+    const DepthPyramid* pyramid,
+    nvrhi::DrawIndexedIndirectArguments* drawArguments,
+    uint32_t* drawCounts,
+    tf::Executor* executor)
+{
+    // the buckets are independent, which is also how the shader processes them
+    auto cullBucket = [&](size_t bucketIndex)
+    {
+        const GpuCullingBucket& bucket = buckets[bucketIndex];
+        uint32_t visibleCount = 0;
+
+        for (uint32_t recordOffset = 0; recordOffset < bucket.recordCount; recordOffset++)
+        {
+            const GpuCullingDrawRecord& record = records[bucket.firstRecord + recordOffset];
+            if (!IsDrawRecordVisible(constants, instances, record, pyramid))
+                continue;
+
+            nvrhi::DrawIndexedIndirectArguments& args = drawArguments[bucket.firstRecord + visibleCount];
+            args.indexCount = record.indexCount;
+            args.instanceCount = 1;
+            args.startIndexLocation = record.startIndexLocation;
+            args.baseVertexLocation = record.baseVertexLocation;
+            args.startInstanceLocation = record.instanceIndex;
+            ++visibleCount;
+        }
+
+        for (uint32_t slot = visibleCount; slot < bucket.recordCount; slot++)
+        {
+            nvrhi::DrawIndexedIndirectArguments& args = drawArguments[bucket.firstRecord + slot];
+            args.indexCount = 0;
+            args.instanceCount = 0;
+            args.startIndexLocation = 0;
+            args.baseVertexLocation = 0;
+            args.startInstanceLocation = 0;
+        }
+
+        drawCounts[bucketIndex] = visibleCount;
+    };
+
+#ifdef DONUT_WITH_TASKFLOW
+    if (executor && constants.bucketCount > 1)
+    {
+        tf::Taskflow taskflow;
+        taskflow.for_each_index(size_t(0), size_t(constants.bucketCount), size_t(1), cullBucket);
+        executor->run(taskflow).wait();
+        return;
+    }
+#endif
+
+    for (size_t bucketIndex = 0; bucketIndex < constants.bucketCount; bucketIndex++)
+        cullBucket(bucketIndex);
+}
+
+void donut::render::BuildDepthPyramid(const float* depth, uint32_t width, uint32_t height, bool reverseDepth, DepthPyramid& pyramid)
+{
+    pyramid.width = width;
+    pyramid.height = height;
+    pyramid.reverseDepth = reverseDepth;
+    pyramid.levels.clear();
+
+    if (width == 0 || height == 0)
+        return;
+
+    pyramid.levels.emplace_back(depth, depth + size_t(width) * height);
+
+    for (uint32_t level = 1; pyramid.GetLevelWidth(level - 1) > 1 || pyramid.GetLevelHeight(level - 1) > 1; level++)
+    {
+        const std::vector<float>& source = pyramid.levels[level - 1];
+        const uint32_t sourceWidth = pyramid.GetLevelWidth(level - 1);
+        const uint32_t sourceHeight = pyramid.GetLevelHeight(level - 1);
+        const uint32_t levelWidth = pyramid.GetLevelWidth(level);
+        const uint32_t levelHeight = pyramid.GetLevelHeight(level);
+
+        std::vector<float> destination(size_t(levelWidth) * levelHeight);
+
+        for (uint32_t y = 0; y < levelHeight; y++)
+        {
+            // the last texel of a level also covers the odd row or column of the source, if there is one
+            uint32_t y0 = y * 2;
+            uint32_t y1 = (y + 1 == levelHeight) ? sourceHeight : std::min(y0 + 2, sourceHeight);
+
+            for (uint32_t x = 0; x < levelWidth; x++)
+            {
+                uint32_t x0 = x * 2;
+                uint32_t x1 = (x + 1 == levelWidth) ? sourceWidth : std::min(x0 + 2, sourceWidth);
+
+                float farthest = source[size_t(y0) * sourceWidth + x0];
+                for (uint32_t sy = y0; sy < y1; sy++)
+                {
+                    for (uint32_t sx = x0; sx < x1; sx++)
+                    {
+                        float value = source[size_t(sy) * sourceWidth + sx];
+                        farthest = reverseDepth ? std::min(farthest, value) : std::max(farthest, value);
+                    }
+                }
+
+                destination[size_t(y) * levelWidth + x] = farthest;
+            }
+        }
+
+        pyramid.levels.push_back(std::move(destination));
+    }
+}
+
+GpuDrawList::GpuDrawList() = default;
+GpuDrawList::~GpuDrawList() = default;
+
+uint32_t GpuDrawList::GetRecordCount() const
+{
+    return uint32_t(m_Records.size());
+}
+
+void GpuDrawList::Build(const SceneGraph& sceneGraph)
+{
+    struct Entry
+    {
+        uint32_t pass;
+        int materialID;
+        int bufferGroupIndex;
+        nvrhi::RasterCullMode cullMode;
+        uint32_t instanceIndex;
+        int geometryIndex;
+        const Material* material;
+        const BufferGroup* buffers;
+        GpuCullingDrawRecord record;
+
+        [[nodiscard]] auto GetBucketKey() const { return std::make_tuple(pass, materialID, bufferGroupIndex, int(cullMode)); }
+        [[nodiscard]] auto GetSortKey() const { return std::make_tuple(pass, materialID, bufferGroupIndex, int(cullMode), instanceIndex, geometryIndex); }
+    };
+
+    std::vector<Entry> entries;
+    m_InstanceCount = uint32_t(sceneGraph.GetInstanceDataCount());
+
+    for (const auto& meshInstance : sceneGraph.GetMeshInstances())
+    {
+        const SceneGraphNode* node = meshInstance->GetNode();
+        if (!node || !meshInstance->Visibility())
+            continue;
+
+        const MeshInfo* mesh = meshInstance->GetMesh().get();
+        const uint32_t instanceCount = meshInstance->GetInstanceCount();
+
+        for (const auto& geometry : mesh->geometries)
+        {
+            const Material* material = geometry->material.get();
+            if (!material)
+                continue;
+
+            if (material->domain != MaterialDomain::Opaque && material->domain != MaterialDomain::AlphaTested)
+                continue;
+
+            for (uint32_t element = 0; element < instanceCount; element++)
+            {
+                Entry entry{};
+                entry.pass = (material->domain == MaterialDomain::AlphaTested) ? 1 : 0;
+                entry.materialID = material->materialID;
+                entry.bufferGroupIndex = mesh->buffers ? mesh->buffers->globalBufferGroupIndex : -1;
+                entry.cullMode = material->doubleSided ? nvrhi::RasterCullMode::None : nvrhi::RasterCullMode::Back;
+                entry.instanceIndex = uint32_t(meshInstance->GetInstanceIndex()) + element;
+                entry.geometryIndex = geometry->globalGeometryIndex;
+                entry.material = material;
+                entry.buffers = mesh->buffers.get();
+
+                GpuCullingDrawRecord& record = entry.record;
+                record.boundsMin = geometry->objectSpaceBounds.m_mins;
+                record.boundsMax = geometry->objectSpaceBounds.m_maxs;
+                record.instanceIndex = entry.instanceIndex;
+                record.flags = (mesh->skinPrototype || geometry->objectSpaceBounds.isempty()) ? GPU_CULLING_RECORD_NO_CULLING : 0;
+                record.indexCount = geometry->numIndices;
+                record.startIndexLocation = mesh->indexOffset + geometry->indexOffsetInMesh;
+                record.baseVertexLocation = int(mesh->vertexOffset + geometry->vertexOffsetInMesh);
+                record.padding = 0;
+
+                entries.push_back(entry);
+            }
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.GetSortKey() < b.GetSortKey(); });
+
+    m_Records.clear();
+    m_GpuBuckets.clear();
+    m_Buckets.clear();
+    m_Records.reserve(entries.size());
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const Entry& entry = entries[i];
+
+        if (i == 0 || entry.GetBucketKey() != entries[i - 1].GetBucketKey())
+        {
+            GpuDrawBucket bucket;
+            bucket.material = entry.material;
+            bucket.buffers = entry.buffers;
+            bucket.cullMode = entry.cullMode;
+            bucket.firstRecord = uint32_t(m_Records.size());
+            m_Buckets.push_back(bucket);
+        }
+
+        m_Records.push_back(entry.record);
+        ++m_Buckets.back().recordCount;
+    }
+
+    m_GpuBuckets.reserve(m_Buckets.size());
+    for (const GpuDrawBucket& bucket : m_Buckets)
+    {
+        GpuCullingBucket gpuBucket{};
+        gpuBucket.firstRecord = bucket.firstRecord;
+        gpuBucket.recordCount = bucket.recordCount;
+        m_GpuBuckets.push_back(gpuBucket);
+    }
+}
+
+void donut::render::FillGpuCullingConstants(GpuCullingConstants& constants, const IView& view, uint32_t bucketCount,
+    uint32_t instanceCount, const OcclusionCullingParameters* occlusion)
+{
+    constants = {};
+
+    dm::frustum frustum = view.GetViewFrustum();
+    for (int i = 0; i < 6; i++)
+        constants.frustumPlanes[i] = float4(frustum.planes[i].normal, frustum.planes[i].distance);
+
+    constants.bucketCount = bucketCount;
+    constants.instanceCount = instanceCount;
+
+    if (occlusion && occlusion->view && occlusion->pyramidWidth > 0 && occlusion->pyramidHeight > 0 && occlusion->pyramidLevels > 0)
+    {
+        constants.flags |= GPU_CULLING_FLAG_OCCLUSION;
+        if (occlusion->view->IsReverseDepth())
+            constants.flags |= GPU_CULLING_FLAG_REVERSE_DEPTH;
+
+        constants.matWorldToClipOcclusion = occlusion->view->GetViewProjectionMatrix();
+        constants.pyramidWidth = occlusion->pyramidWidth;
+        constants.pyramidHeight = occlusion->pyramidHeight;
+        constants.pyramidLevels = occlusion->pyramidLevels;
+        constants.pyramidTexelSizeX = 2.f / float(occlusion->pyramidWidth);
+        constants.pyramidTexelSizeY = 2.f / float(occlusion->pyramidHeight);
+    }
+}
+
+GpuCullingPass::GpuCullingPass(
+    nvrhi::IDevice* device,
+    std::shared_ptr<ShaderFactory> shaderFactory,
+    std::shared_ptr<CommonRenderPasses> commonPasses,
+    const CreateParameters& params)
+    : m_Device(device)
+    , m_CommonPasses(std::move(commonPasses))
+{
+    m_ComputeShader = shaderFactory->CreateShader("donut/passes/gpu_culling_cs.hlsl", "main", nullptr, nvrhi::ShaderType::Compute);
+
+    nvrhi::BufferDesc constantBufferDesc;
+    constantBufferDesc.byteSize = sizeof(GpuCullingConstants);
+    constantBufferDesc.debugName = "GpuCullingConstants";
+    constantBufferDesc.isConstantBuffer = true;
+    constantBufferDesc.isVolatile = true;
+    constantBufferDesc.maxVersions = params.numConstantBufferVersions;
+    m_CullingCB = device->createBuffer(constantBufferDesc);
+
+    nvrhi::BindingLayoutDesc layoutDesc;
+    layoutDesc.visibility = nvrhi::ShaderType::Compute;
+    layoutDesc.bindings = {
+        nvrhi::BindingLayoutItem::VolatileConstantBuffer(0),
+        nvrhi::BindingLayoutItem::RawBuffer_SRV(0),
+        nvrhi::BindingLayoutItem::StructuredBuffer_SRV(1),
+        nvrhi::BindingLayoutItem::StructuredBuffer_SRV(2),
+        nvrhi::BindingLayoutItem::Texture_SRV(3),
+        nvrhi::BindingLayoutItem::TypedBuffer_UAV(0),
+        nvrhi::BindingLayoutItem::TypedBuffer_UAV(1)
+    };
+    m_BindingLayout = device->createBindingLayout(layoutDesc);
+
+    nvrhi::ComputePipelineDesc computePipelineDesc;
+    computePipelineDesc.CS = m_ComputeShader;
+    computePipelineDesc.bindingLayouts = { m_BindingLayout };
+    m_Pso = device->createComputePipeline(computePipelineDesc);
+}
+
+void GpuCullingPass::CreateBuffers(uint32_t recordCount, uint32_t bucketCount)
+{
+    nvrhi::BufferDesc bufferDesc;
+    bufferDesc.byteSize = sizeof(GpuCullingDrawRecord) * std::max(recordCount, 1u);
+    bufferDesc.structStride = sizeof(GpuCullingDrawRecord);
+    bufferDesc.debugName = "GpuCullingRecords";
+    bufferDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+    bufferDesc.keepInitialState = true;
+    m_RecordBuffer = m_Device->createBuffer(bufferDesc);
+
+    bufferDesc.byteSize = sizeof(GpuCullingBucket) * std::max(bucketCount, 1u);
+    bufferDesc.structStride = sizeof(GpuCullingBucket);
+    bufferDesc.debugName = "GpuCullingBuckets";
+    m_BucketBuffer = m_Device->createBuffer(bufferDesc);
+
+    bufferDesc = nvrhi::BufferDesc();
+    bufferDesc.byteSize = sizeof(nvrhi::DrawIndexedIndirectArguments) * std::max(recordCount, 1u);
+    bufferDesc.format = nvrhi::Format::R32_UINT;
+    bufferDesc.canHaveTypedViews = true;
+    bufferDesc.canHaveUAVs = true;
+    bufferDesc.isDrawIndirectArgs = true;
+    bufferDesc.debugName = "GpuCullingDrawArguments";
+    bufferDesc.initialState = nvrhi::ResourceStates::IndirectArgument;
+    bufferDesc.keepInitialState = true;
+    m_DrawArgumentBuffer = m_Device->createBuffer(bufferDesc);
+
+    bufferDesc.byteSize = sizeof(uint32_t) * std::max(bucketCount, 1u);
+    bufferDesc.isDrawIndirectArgs = false;
+    bufferDesc.debugName = "GpuCullingDrawCounts";
+    bufferDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
+    m_DrawCountBuffer = m_Device->createBuffer(bufferDesc);
+
+    m_BindingSet = nullptr;
+}
+
+void GpuCullingPass::SetDrawList(nvrhi::ICommandList* commandList, const GpuDrawList& drawList)
+{
+    const uint32_t recordCount = drawList.GetRecordCount();
+    const uint32_t bucketCount = uint32_t(drawList.GetBuckets().size());
+
+    if (!m_RecordBuffer
+        || m_RecordBuffer->getDesc().byteSize < sizeof(GpuCullingDrawRecord) * recordCount
+        || m_BucketBuffer->getDesc().byteSize < sizeof(GpuCullingBucket) * bucketCount)
+    {
+        CreateBuffers(recordCount, bucketCount);
+    }
+
+    if (recordCount > 0)
+        commandList->writeBuffer(m_RecordBuffer, drawList.GetRecords().data(), sizeof(GpuCullingDrawRecord) * recordCount);
+
+    if (bucketCount > 0)
+        commandList->writeBuffer(m_BucketBuffer, drawList.GetGpuBuckets().data(), sizeof(GpuCullingBucket) * bucketCount);
+
+    m_DrawList = &drawList;
+}
+
+void GpuCullingPass::Cull(
+    nvrhi::ICommandList* commandList,
+    const IView& view,
+    nvrhi::IBuffer* instanceBuffer,
+    const OcclusionCullingParameters* occlusion,
+    nvrhi::ITexture* depthPyramid)
+{
+    assert(m_DrawList);
+
+    const uint32_t bucketCount = uint32_t(m_DrawList->GetBuckets().size());
+    if (bucketCount == 0 || !instanceBuffer)
+        return;
+
+    if (!depthPyramid)
+    {
+        depthPyramid = m_CommonPasses->m_BlackTexture;
+        occlusion = nullptr;
+    }
+
+    if (!m_BindingSet || instanceBuffer != m_BoundInstanceBuffer || depthPyramid != m_BoundDepthPyramid)
+    {
+        nvrhi::BindingSetDesc bindingSetDesc;
+        bindingSetDesc.bindings = {
+            nvrhi::BindingSetItem::ConstantBuffer(0, m_CullingCB),
+            nvrhi::BindingSetItem::RawBuffer_SRV(0, instanceBuffer),
+            nvrhi::BindingSetItem::StructuredBuffer_SRV(1, m_RecordBuffer),
+            nvrhi::BindingSetItem::StructuredBuffer_SRV(2, m_BucketBuffer),
+            nvrhi::BindingSetItem::Texture_SRV(3, depthPyramid),
+            nvrhi::BindingSetItem::TypedBuffer_UAV(0, m_DrawArgumentBuffer),
+            nvrhi::BindingSetItem::TypedBuffer_UAV(1, m_DrawCountBuffer)
+        };
+        m_BindingSet = m_Device->createBindingSet(bindingSetDesc, m_BindingLayout);
+        m_BoundInstanceBuffer = instanceBuffer;
+        m_BoundDepthPyramid = depthPyramid;
+    }
+
+    // the instance buffer is only as large as the scene was when it was last refreshed
+    const uint32_t instanceCount = std::min(m_DrawList->GetInstanceCount(), uint32_t(instanceBuffer->getDesc().byteSize / sizeof(InstanceData)));
+
+    GpuCullingConstants constants;
+    FillGpuCullingConstants(constants, view, bucketCount, instanceCount, occlusion);
+    commandList->writeBuffer(m_CullingCB, &constants, sizeof(constants));
+
+    nvrhi::ComputeState state;
+    state.pipeline = m_Pso;
+    state.bindings = { m_BindingSet };
+    commandList->setComputeState(state);
+    // the last row of groups is partial, the shader skips the groups past bucketCount
+    const uint32_t dispatchWidth = std::min(bucketCount, uint32_t(GPU_CULLING_DISPATCH_WIDTH));
+    const uint32_t dispatchHeight = (bucketCount + GPU_CULLING_DISPATCH_WIDTH - 1) / GPU_CULLING_DISPATCH_WIDTH;
+    commandList->dispatch(dispatchWidth, dispatchHeight);
+}
+
+void GpuCullingPass::CullOnCpu(
+    nvrhi::ICommandList* commandList,
+    const IView& view,
+    const InstanceData* instances,
+    const OcclusionCullingParameters* occlusion,
+    const DepthPyramid* depthPyramid,
+    tf::Executor* executor)
+{
+    assert(m_DrawList);
+
+    const uint32_t recordCount = m_DrawList->GetRecordCount();
+    const uint32_t bucketCount = uint32_t(m_DrawList->GetBuckets().size());
+    if (bucketCount == 0 || !instances)
+        return;
+
+    if (!depthPyramid)
+        occlusion = nullptr;
+
+    GpuCullingConstants constants;
+    FillGpuCullingConstants(constants, view, bucketCount, m_DrawList->GetInstanceCount(), occlusion);
+
+    m_CpuDrawArguments.resize(recordCount);
+    m_CpuDrawCounts.resize(bucketCount);
+
+    CullDrawRecords(constants, instances, m_DrawList->GetRecords().data(), m_DrawList->GetGpuBuckets().data(), depthPyramid,
+        m_CpuDrawArguments.data(), m_CpuDrawCounts.data(), executor);
+
+    commandList->writeBuffer(m_DrawArgumentBuffer, m_CpuDrawArguments.data(), sizeof(nvrhi::DrawIndexedIndirectArguments) * recordCount);
+    commandList->writeBuffer(m_DrawCountBuffer, m_CpuDrawCounts.data(), sizeof(uint32_t) * bucketCount);
+}
+
+void GpuCullingPass::Render(
+    nvrhi::ICommandList* commandList,
+    const IView* view,
+    const IView* viewPrev,
+    nvrhi::IFramebuffer* framebuffer,
+    IGeometryPass& pass,
+    GeometryPassContext& passContext)
+{
+    assert(m_DrawList);
+
+    pass.SetupView(passContext, commandList, view, viewPrev);
+
+    nvrhi::GraphicsState graphicsState;
+    graphicsState.framebuffer = framebuffer;
+    graphicsState.viewport = view->GetViewportState();
+    graphicsState.shadingRateState = view->GetVariableRateShadingState();
+    graphicsState.indirectParams = m_DrawArgumentBuffer;
+
+    const BufferGroup* lastBuffers = nullptr;
+
+    for (const GpuDrawBucket& bucket : m_DrawList->GetBuckets())
+    {
+        if (bucket.recordCount == 0)
+            continue;
+
+        if (bucket.buffers != lastBuffers)
+        {
+            pass.SetupInputBuffers(passContext, bucket.buffers, graphicsState);
+            lastBuffers = bucket.buffers;
+        }
+
+        // every bucket has a different material or cull mode
+        if (!pass.SetupMaterial(passContext, bucket.material, bucket.cullMode, graphicsState))
+            continue;
+
+        commandList->setGraphicsState(graphicsState);
+        commandList->drawIndexedIndirect(bucket.firstRecord * uint32_t(sizeof(nvrhi::DrawIndexedIndirectArguments)), bucket.recordCount);
+    }
+}
@@ -23,6 +23,7 @@
 #include <donut/render/JointsRenderPass.h>
 #include <donut/engine/Scene.h>
 #include <donut/engine/ShaderFactory.h>
+#include <donut/engine/GpuProfiler.h>
 #include <donut/core/math/math.h>
 #include <nvrhi/utils.h>
 
@@ -162,7 +163,7 @@ namespace donut::render
                 return;
         }
         
-        commandList->beginMarker("JointsRenderPass");
+        BeginMarker(commandList, "JointsRenderPass");
 
         PlanarViewConstants constants;
         view->FillPlanarViewConstants(constants);   
@@ -215,7 +216,7 @@ namespace donut::render
 
         commandList->draw(args);
 
-        commandList->endMarker();
+        EndMarker(commandList);
     }
 
 } // end namespace donut::render
@@ -25,6 +25,7 @@
 #include <donut/engine/ShaderFactory.h>
 #include <donut/engine/CommonRenderPasses.h>
 #include <donut/engine/View.h>
+#include <donut/engine/GpuProfiler.h>
 
 using namespace donut::math;
 #include <donut/shaders/light_probe_cb.h>
@@ -193,7 +194,7 @@ void LightProbeProcessingPass::GenerateCubemapMips(
     uint32_t sourceMipLevel, 
     uint32_t levelsToGenerate)
 {
-    commandList->beginMarker("Cubemap Mips");
+    BeginMarker(commandList, "Cubemap Mips");
 
     for (uint32_t index = 0; index < levelsToGenerate; index++)
     {
@@ -201,7 +202,7 @@ void LightProbeProcessingPass::GenerateCubemapMips(
         BlitCubemap(commandList, cubeMap, baseArraySlice, mipLevel, cubeMap, baseArraySlice, mipLevel + 1);
     }
 
-    commandList->endMarker();
+    EndMarker(commandList);
 }
 
 void LightProbeProcessingPass::RenderDiffuseMap(
@@ -223,7 +224,7 @@ void LightProbeProcessingPass::RenderDiffuseMap(
     uint32_t intermediateMipLevel = static_cast<uint32_t>(std::max(0.f, dm::log2f(float(m_IntermediateTextureSize) / outputSize) - 2.f));
     float intermediateSize = ceilf(float(m_IntermediateTextureSize) * powf(0.5f, float(intermediateMipLevel)));
 
-    commandList->beginMarker("Diffuse Light Probe");
+    BeginMarker(commandList, "Diffuse Light Probe");
 
     nvrhi::FramebufferHandle framebuffer = GetCachedFramebuffer(m_IntermediateTexture, nvrhi::TextureSubresourceSet(intermediateMipLevel, 1, 0, 6));
 
@@ -266,7 +267,7 @@ void LightProbeProcessingPass::RenderDiffuseMap(
     BlitCubemap(commandList, m_IntermediateTexture, 0, intermediateMipLevel, m_IntermediateTexture, 0, intermediateMipLevel + 1);
     BlitCubemap(commandList, m_IntermediateTexture, 0, intermediateMipLevel + 1, outDiffuseMap, outBaseArraySlice, outMipLevel);
     
-    commandList->endMarker();
+    EndMarker(commandList);
 }
 
 void LightProbeProcessingPass::RenderSpecularMap(nvrhi::ICommandList* commandList, float roughness, nvrhi::ITexture* inEnvironmentMap, nvrhi::TextureSubresourceSet inSubresources, nvrhi::ITexture* outDiffuseMap, uint32_t outBaseArraySlice, uint32_t outMipLevel)
@@ -282,7 +283,7 @@ void LightProbeProcessingPass::RenderSpecularMap(nvrhi::ICommandList* commandLis
     uint32_t intermediateMipLevel = static_cast<uint32_t>(std::max(0.f, dm::log2f(float(m_IntermediateTextureSize) / outputSize) - 2.f));
     float intermediateSize = ceilf(float(m_IntermediateTextureSize) * powf(0.5f, float(intermediateMipLevel)));
 
-    commandList->beginMarker("Specular Light Probe");
+    BeginMarker(commandList, "Specular Light Probe");
 
     nvrhi::FramebufferHandle framebuffer = GetCachedFramebuffer(m_IntermediateTexture, nvrhi::TextureSubresourceSet(intermediateMipLevel, 1, 0, 6));
 
@@ -327,12 +328,12 @@ void LightProbeProcessingPass::RenderSpecularMap(nvrhi::ICommandList* commandLis
     BlitCubemap(commandList, m_IntermediateTexture, 0, intermediateMipLevel, m_IntermediateTexture, 0, intermediateMipLevel + 1);
     BlitCubemap(commandList, m_IntermediateTexture, 0, intermediateMipLevel + 1, outDiffuseMap, outBaseArraySlice, outMipLevel);
 
-    commandList->endMarker();
+    EndMarker(commandList);
 }
 
 void LightProbeProcessingPass::RenderEnvironmentBrdfTexture(nvrhi::ICommandList* commandList)
 {
-    commandList->beginMarker("Environment BRDF");
+    BeginMarker(commandList, "Environment BRDF");
 
     nvrhi::FramebufferHandle framebuffer = m_Device->createFramebuffer(nvrhi::FramebufferDesc().addColorAttachment(m_EnvironmentBrdfTexture));
 
@@ -357,7 +358,7 @@ void LightProbeProcessingPass::RenderEnvironmentBrdfTexture(nvrhi::ICommandList*
     args.vertexCount = 4;
     commandList->draw(args);
 
-    commandList->endMarker();
+    EndMarker(commandList);
 }
 
 nvrhi::ITexture* LightProbeProcessingPass::GetEnvironmentBrdfTexture()
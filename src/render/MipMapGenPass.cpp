@@ -23,6 +23,7 @@
 #include <donut/render/MipMapGenPass.h>
 #include <donut/engine/ShaderFactory.h>
 #include <donut/engine/CommonRenderPasses.h>
+#include <donut/engine/GpuProfiler.h>
 
 using namespace donut::math;
 #include <donut/shaders/mipmapgen_cb.h>
@@ -159,7 +160,7 @@ void MipMapGenPass::Dispatch(nvrhi::ICommandList* commandList, int maxLOD)
 {
     assert(m_Texture);
 
-    commandList->beginMarker("MipMapGen::Dispatch");
+    BeginMarker(commandList, "MipMapGen::Dispatch");
 
     uint nmipLevels = m_Texture->getDesc().mipLevels;
     if (maxLOD > 0 && maxLOD < (int)nmipLevels)
@@ -190,7 +191,7 @@ void MipMapGenPass::Dispatch(nvrhi::ICommandList* commandList, int maxLOD)
         commandList->dispatch(width, height);
     }
 
-    commandList->endMarker(); // "MipMapGen::Dispatch"
+    EndMarker(commandList); // "MipMapGen::Dispatch"
 }
 
 
@@ -198,7 +199,7 @@ void MipMapGenPass::Display(std::shared_ptr<donut::engine::CommonRenderPasses> c
 {
     assert(m_Texture);
     
-    commandList->beginMarker("MipMapGen::Display");
+    BeginMarker(commandList, "MipMapGen::Display");
     
     nvrhi::Viewport viewport = nvrhi::Viewport((float)target->getFramebufferInfo().width, (float)target->getFramebufferInfo().height);
 
@@ -230,5 +231,5 @@ void MipMapGenPass::Display(std::shared_ptr<donut::engine::CommonRenderPasses> c
         }
         size = { size.x / 2.f, size.y / 2.f };
     }
-    commandList->endMarker(); // "MipMapGen::Display"
+    EndMarker(commandList); // "MipMapGen::Display"
 }
\ No newline at end of file
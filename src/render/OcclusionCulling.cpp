@@ -0,0 +1,520 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/render/OcclusionCulling.h>
+#include <donut/render/GeometryPasses.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/View.h>
+#include <donut/core/parallel.h>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DONUT_OCCLUSION_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+using namespace donut::math;
+using namespace donut::engine;
+using namespace donut::render;
+using namespace donut::core;
+
+// Pixel coordinates have the origin in the top left corner of the buffer, pixel centers are at +0.5.
+struct SoftwareOcclusionCuller::RasterTriangle
+{
+    // edge functions a * x + b * y + c, non-negative inside the triangle
+    float edgeA[3];
+    float edgeB[3];
+    float edgeC[3];
+
+    // depth plane a * x + b * y + c
+    float depthA;
+    float depthB;
+    float depthC;
+    float depthSlope; // depth change from the center of a pixel to its farthest corner
+    float depthLimit; // farthest vertex depth
+
+    // inclusive pixel bounds
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+};
+
+namespace
+{
+    float4 TransformToClip(const float3& p, const float4x4& m)
+    {
+        return p.x * m[0] + p.y * m[1] + p.z * m[2] + m[3];
+    }
+
+    // Non-negative on the visible side of the near plane
+    float NearPlaneDistance(const float4& clip, bool reverseDepth)
+    {
+        return reverseDepth ? clip.w - clip.z : clip.z;
+    }
+
+    // Writes the farthest depth of the plane over each pixel whose center is inside the triangle, clamped to the
+    // farthest vertex, where it is nearer than the stored depth. 'firstX' is a multiple of 4, the row is padded.
+    template<bool ReverseDepth> void RasterizeSpan(float* row, int firstX, int lastX, const float* edgeA, const float* rowEdge,
+        float depthA, float rowDepth, float depthSlope, float depthLimit)
+    {
+#ifdef DONUT_OCCLUSION_USE_SSE
+        const __m128 laneCenters = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        const __m128 a0 = _mm_set1_ps(edgeA[0]);
+        const __m128 a1 = _mm_set1_ps(edgeA[1]);
+        const __m128 a2 = _mm_set1_ps(edgeA[2]);
+        const __m128 e0 = _mm_set1_ps(rowEdge[0]);
+        const __m128 e1 = _mm_set1_ps(rowEdge[1]);
+        const __m128 e2 = _mm_set1_ps(rowEdge[2]);
+        const __m128 za = _mm_set1_ps(depthA);
+        const __m128 z0 = _mm_set1_ps(rowDepth);
+        const __m128 slope = _mm_set1_ps(depthSlope);
+        const __m128 limit = _mm_set1_ps(depthLimit);
+        const __m128 zero = _mm_setzero_ps();
+
+        for (int x = firstX; x <= lastX; x += 4)
+        {
+            const __m128 px = _mm_add_ps(_mm_set1_ps(float(x)), laneCenters);
+
+            __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), e0), zero);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), e1), zero));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), e2), zero));
+
+            if (_mm_movemask_ps(inside) == 0)
+                continue;
+
+            const __m128 depth = _mm_add_ps(_mm_mul_ps(za, px), z0);
+            const __m128 stored = _mm_loadu_ps(row + x);
+            const __m128 nearer = ReverseDepth
+                ? _mm_max_ps(stored, _mm_max_ps(_mm_sub_ps(depth, slope), limit))
+                : _mm_min_ps(stored, _mm_min_ps(_mm_add_ps(depth, slope), limit));
+
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, stored)));
+        }
+#else
+        for (int x = firstX; x <= lastX; x++)
+        {
+            const float px = float(x) + 0.5f;
+
+            if (edgeA[0] * px + rowEdge[0] >= 0.f && edgeA[1] * px + rowEdge[1] >= 0.f && edgeA[2] * px + rowEdge[2] >= 0.f)
+            {
+                const float depth = depthA * px + rowDepth;
+                row[x] = ReverseDepth
+                    ? std::max(row[x], std::max(depth - depthSlope, depthLimit))
+                    : std::min(row[x], std::min(depth + depthSlope, depthLimit));
+            }
+        }
+#endif
+    }
+}
+
+SoftwareOcclusionCuller::SoftwareOcclusionCuller(uint32_t width, uint32_t height, tf::Executor* executor)
+    : m_Executor(executor)
+    , m_Width(std::max((width + 3u) & ~3u, 4u))
+    , m_Height(std::max(height, 1u))
+{
+}
+
+SoftwareOcclusionCuller::~SoftwareOcclusionCuller() = default;
+
+void SoftwareOcclusionCuller::SetOccluder(const MeshInfo* mesh, std::shared_ptr<OccluderMesh> proxy)
+{
+    m_Designated[mesh].proxy = std::move(proxy);
+}
+
+void SoftwareOcclusionCuller::RemoveOccluder(const MeshInfo* mesh)
+{
+    m_Designated.erase(mesh);
+}
+
+void SoftwareOcclusionCuller::ClearOccluders()
+{
+    m_Designated.clear();
+}
+
+void SoftwareOcclusionCuller::BeginView(const IView& view)
+{
+    // no jitter: the buffer is much coarser than the offsets, and IsBoxVisible grows the boxes by a texel
+    m_WorldToClip = view.GetViewProjectionMatrix(false);
+    m_ViewFrustum = view.GetViewFrustum();
+    m_ReverseDepth = view.IsReverseDepth();
+    m_MirroredView = view.IsMirrored();
+    m_HasDepth = false;
+
+    m_Queue.clear();
+    m_Depth.assign(size_t(m_Width) * m_Height, m_ReverseDepth ? 0.f : 1.f);
+    m_Statistics = Statistics();
+}
+
+void SoftwareOcclusionCuller::AddSceneOccluders(const std::shared_ptr<SceneGraphNode>& rootNode)
+{
+    if (m_Designated.empty() || !rootNode)
+        return;
+
+    SceneGraphWalker walker(rootNode.get());
+    while (walker)
+    {
+        bool subgraphContentRelevant = (walker->GetSubgraphContentFlags() & SceneContentFlags::OpaqueMeshes) != 0;
+        bool nodeContentsRelevant = (walker->GetLeafContentFlags() & SceneContentFlags::OpaqueMeshes) != 0;
+
+        bool nodeVisible = false;
+        if (subgraphContentRelevant)
+        {
+            nodeVisible = m_ViewFrustum.intersectsWith(walker->GetGlobalBoundingBox());
+
+            if (nodeVisible && nodeContentsRelevant)
+            {
+                auto meshInstance = dynamic_cast<MeshInstance*>(walker->GetLeaf().get());
+                if (meshInstance && meshInstance->Visibility() && !dynamic_cast<MeshInstanceArray*>(meshInstance))
+                {
+                    const MeshInfo* mesh = meshInstance->GetMesh().get();
+                    auto designated = m_Designated.find(mesh);
+
+                    if (designated != m_Designated.end() && !mesh->skinPrototype)
+                    {
+                        const affine3& localToWorld = walker->GetLocalToWorldTransformFloat();
+
+                        if (designated->second.proxy)
+                        {
+                            AddOccluder(*designated->second.proxy, localToWorld);
+                        }
+                        else if (mesh->buffers)
+                        {
+                            const BufferGroup& buffers = *mesh->buffers;
+
+                            for (const auto& geometry : mesh->geometries)
+                            {
+                                if (geometry->material->domain != MaterialDomain::Opaque)
+                                    continue;
+
+                                size_t firstVertex = size_t(mesh->vertexOffset) + geometry->vertexOffsetInMesh;
+                                size_t firstIndex = size_t(mesh->indexOffset) + geometry->indexOffsetInMesh;
+                                if (firstVertex + geometry->numVertices > buffers.positionData.size() ||
+                                    firstIndex + geometry->numIndices > buffers.indexData.size())
+                                    continue;
+
+                                AddOccluder(buffers.positionData.data() + firstVertex, geometry->numVertices,
+                                    buffers.indexData.data() + firstIndex, geometry->numIndices,
+                                    localToWorld, geometry->material->doubleSided);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        walker.Next(nodeVisible);
+    }
+}
+
+void SoftwareOcclusionCuller::AddOccluder(const float3* positions, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount,
+    const affine3& localToWorld, bool doubleSided)
+{
+    if (indexCount < 3)
+        return;
+
+    m_Queue.push_back({ positions, indices, vertexCount, indexCount, localToWorld, doubleSided });
+}
+
+void SoftwareOcclusionCuller::AddOccluder(const OccluderMesh& mesh, const affine3& localToWorld)
+{
+    AddOccluder(mesh.positions.data(), uint32_t(mesh.positions.size()), mesh.indices.data(), uint32_t(mesh.indices.size()),
+        localToWorld, mesh.doubleSided);
+}
+
+void SoftwareOcclusionCuller::SetupTriangles(const QueuedOccluder& occluder, std::vector<RasterTriangle>& triangles) const
+{
+    const float4x4 localToClip = affineToHomogeneous(occluder.localToWorld) * m_WorldToClip;
+
+    // Front faces are clockwise on screen, or counter-clockwise in mirrored views, like in the passes.
+    // Instance transforms with a negative determinant flip the faces on screen, and so they do here.
+    const bool mirrored = m_MirroredView;
+
+    const float width = float(m_Width);
+    const float height = float(m_Height);
+
+    for (uint32_t index = 0; index + 2 < occluder.indexCount; index += 3)
+    {
+        const uint32_t i0 = occluder.indices[index];
+        const uint32_t i1 = occluder.indices[index + 1];
+        const uint32_t i2 = occluder.indices[index + 2];
+        if (i0 >= occluder.vertexCount || i1 >= occluder.vertexCount || i2 >= occluder.vertexCount)
+            continue;
+
+        const float4 clip[3] = {
+            TransformToClip(occluder.positions[i0], localToClip),
+            TransformToClip(occluder.positions[i1], localToClip),
+            TransformToClip(occluder.positions[i2], localToClip)
+        };
+
+        // clip against the near plane, which leaves a triangle or a quad
+        float4 polygon[4];
+        uint32_t polygonSize = 0;
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            const float4& current = clip[i];
+            const float4& next = clip[(i + 1) % 3];
+            const float currentDistance = NearPlaneDistance(current, m_ReverseDepth);
+            const float nextDistance = NearPlaneDistance(next, m_ReverseDepth);
+
+            if (currentDistance >= 0.f)
+                polygon[polygonSize++] = current;
+
+            if ((currentDistance >= 0.f) != (nextDistance >= 0.f))
+            {
+                float t = currentDistance / (currentDistance - nextDistance);
+                polygon[polygonSize++] = current + (next - current) * t;
+            }
+        }
+
+        if (polygonSize < 3)
+            continue;
+
+        float3 screen[4];
+        for (uint32_t i = 0; i < polygonSize; i++)
+        {
+            const float4& p = polygon[i];
+            if (!(p.w > 0.f))
+            {
+                polygonSize = 0;
+                break;
+            }
+
+            screen[i] = float3(
+                (p.x / p.w * 0.5f + 0.5f) * width,
+                (0.5f - p.y / p.w * 0.5f) * height,
+                p.z / p.w);
+        }
+
+        for (uint32_t fan = 2; fan < polygonSize; fan++)
+        {
+            const float3 v[3] = { screen[0], screen[fan - 1], screen[fan] };
+
+            float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+            if (area == 0.f || !std::isfinite(area))
+                continue;
+
+            if (!occluder.doubleSided && ((area > 0.f) == mirrored))
+                continue;
+
+            float minX = std::min(std::min(v[0].x, v[1].x), v[2].x);
+            float maxX = std::max(std::max(v[0].x, v[1].x), v[2].x);
+            float minY = std::min(std::min(v[0].y, v[1].y), v[2].y);
+            float maxY = std::max(std::max(v[0].y, v[1].y), v[2].y);
+
+            // pixels whose centers are inside the bounds, clamped before the conversion to int
+            RasterTriangle triangle;
+            triangle.minX = int(std::ceil(std::max(minX - 0.5f, 0.f)));
+            triangle.maxX = int(std::floor(std::min(maxX - 0.5f, width - 1.f)));
+            triangle.minY = int(std::ceil(std::max(minY - 0.5f, 0.f)));
+            triangle.maxY = int(std::floor(std::min(maxY - 0.5f, height - 1.f)));
+            if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+                continue;
+
+            const float sign = (area > 0.f) ? 1.f : -1.f;
+            const float absArea = std::abs(area);
+
+            triangle.depthA = 0.f;
+            triangle.depthB = 0.f;
+            triangle.depthC = 0.f;
+
+            for (int edge = 0; edge < 3; edge++)
+            {
+                const float3& a = v[edge];
+                const float3& b = v[(edge + 1) % 3];
+                const float3& opposite = v[(edge + 2) % 3];
+
+                triangle.edgeA[edge] = sign * (a.y - b.y);
+                triangle.edgeB[edge] = sign * (b.x - a.x);
+                triangle.edgeC[edge] = sign * ((b.y - a.y) * a.x - (b.x - a.x) * a.y);
+
+                // the edge function divided by the area is the barycentric coordinate of the opposite vertex
+                triangle.depthA += triangle.edgeA[edge] * opposite.z;
+                triangle.depthB += triangle.edgeB[edge] * opposite.z;
+                triangle.depthC += triangle.edgeC[edge] * opposite.z;
+            }
+
+            triangle.depthA /= absArea;
+            triangle.depthB /= absArea;
+            triangle.depthC /= absArea;
+            triangle.depthSlope = 0.5f * (std::abs(triangle.depthA) + std::abs(triangle.depthB));
+            triangle.depthLimit = m_ReverseDepth
+                ? std::min(std::min(v[0].z, v[1].z), v[2].z)
+                : std::max(std::max(v[0].z, v[1].z), v[2].z);
+
+            triangles.push_back(triangle);
+        }
+    }
+}
+
+void SoftwareOcclusionCuller::RasterizeBand(uint32_t bandIndex)
+{
+    const int bandFirstY = int(bandIndex * m_RowsPerBand);
+    const int bandLastY = std::min(int((bandIndex + 1) * m_RowsPerBand), int(m_Height)) - 1;
+
+    for (const RasterTriangle* triangle : m_Bands[bandIndex])
+    {
+        const int firstY = std::max(triangle->minY, bandFirstY);
+        const int lastY = std::min(triangle->maxY, bandLastY);
+        const int firstX = triangle->minX & ~3;
+
+        for (int y = firstY; y <= lastY; y++)
+        {
+            const float py = float(y) + 0.5f;
+            const float rowEdge[3] = {
+                triangle->edgeB[0] * py + triangle->edgeC[0],
+                triangle->edgeB[1] * py + triangle->edgeC[1],
+                triangle->edgeB[2] * py + triangle->edgeC[2]
+            };
+            const float rowDepth = triangle->depthB * py + triangle->depthC;
+            float* row = m_Depth.data() + size_t(y) * m_Width;
+
+            if (m_ReverseDepth)
+                RasterizeSpan<true>(row, firstX, triangle->maxX, triangle->edgeA, rowEdge, triangle->depthA, rowDepth, triangle->depthSlope, triangle->depthLimit);
+            else
+                RasterizeSpan<false>(row, firstX, triangle->maxX, triangle->edgeA, rowEdge, triangle->depthA, rowDepth, triangle->depthSlope, triangle->depthLimit);
+        }
+    }
+}
+
+void SoftwareOcclusionCuller::Rasterize()
+{
+    const size_t occluderCount = m_Queue.size();
+    m_OccluderTriangles.resize(occluderCount);
+
+    ParallelFor(m_Executor, occluderCount, [this](size_t occluderIndex)
+    {
+        m_OccluderTriangles[occluderIndex].clear();
+        SetupTriangles(m_Queue[occluderIndex], m_OccluderTriangles[occluderIndex]);
+    });
+
+    // bin the triangles into bands of rows, in occluder order
+    const uint32_t bandCount = (m_Height + m_RowsPerBand - 1) / m_RowsPerBand;
+    m_Bands.resize(bandCount);
+    for (auto& band : m_Bands)
+        band.clear();
+
+    uint32_t triangleCount = 0;
+    for (const auto& triangles : m_OccluderTriangles)
+    {
+        for (const RasterTriangle& triangle : triangles)
+        {
+            for (uint32_t band = uint32_t(triangle.minY) / m_RowsPerBand; band <= uint32_t(triangle.maxY) / m_RowsPerBand; band++)
+                m_Bands[band].push_back(&triangle);
+        }
+        triangleCount += uint32_t(triangles.size());
+    }
+
+    ParallelFor(m_Executor, bandCount, [this](size_t bandIndex)
+    {
+        RasterizeBand(uint32_t(bandIndex));
+    });
+
+    BuildDepthPyramid(m_Depth.data(), m_Width, m_Height, m_ReverseDepth, m_Pyramid);
+    m_HasDepth = true;
+
+    m_Statistics.occluderCount = uint32_t(occluderCount);
+    m_Statistics.triangleCount = triangleCount;
+
+    m_Queue.clear();
+}
+
+void SoftwareOcclusionCuller::RenderOccluders(const std::shared_ptr<SceneGraphNode>& rootNode, const IView& view)
+{
+    BeginView(view);
+    AddSceneOccluders(rootNode);
+    Rasterize();
+}
+
+bool SoftwareOcclusionCuller::IsBoxVisible(const box3& worldBounds) const
+{
+    if (!m_HasDepth || worldBounds.isempty())
+        return true;
+
+    const float width = float(m_Width);
+    const float height = float(m_Height);
+
+    int rectMinX = int(m_Width);
+    int rectMinY = int(m_Height);
+    int rectMaxX = -1;
+    int rectMaxY = -1;
+    float nearest = m_ReverseDepth ? -INFINITY : INFINITY;
+
+    for (uint32_t corner = 0; corner < 8; corner++)
+    {
+        const float4 clip = TransformToClip(worldBounds.getCorner(corner), m_WorldToClip);
+
+        if (!(clip.w > 0.f))
+            return true;
+
+        const float depth = clip.z / clip.w;
+        nearest = m_ReverseDepth ? std::max(nearest, depth) : std::min(nearest, depth);
+
+        // clamped to one pixel outside of the buffer before the conversion to int
+        const float x = std::min(std::max((clip.x / clip.w * 0.5f + 0.5f) * width, -1.f), width);
+        const float y = std::min(std::max((0.5f - clip.y / clip.w * 0.5f) * height, -1.f), height);
+        if (!(x == x) || !(y == y))
+            return true;
+
+        rectMinX = std::min(rectMinX, int(std::floor(x)));
+        rectMinY = std::min(rectMinY, int(std::floor(y)));
+        rectMaxX = std::max(rectMaxX, int(std::floor(x)));
+        rectMaxY = std::max(rectMaxY, int(std::floor(y)));
+    }
+
+    // a pixel is written when its center is covered, so the occluder may not cover all of it: include the
+    // neighbors, which narrows the gaps at occluder silhouettes that are thinner than a pixel
+    rectMinX = std::max(rectMinX - 1, 0);
+    rectMinY = std::max(rectMinY - 1, 0);
+    rectMaxX = std::min(rectMaxX + 1, int(m_Width) - 1);
+    rectMaxY = std::min(rectMaxY + 1, int(m_Height) - 1);
+
+    const uint32_t levelCount = uint32_t(m_Pyramid.levels.size());
+    uint32_t level = 0;
+    while (level + 1 < levelCount && (
+        (uint32_t(rectMaxX) >> level) - (uint32_t(rectMinX) >> level) > 1 ||
+        (uint32_t(rectMaxY) >> level) - (uint32_t(rectMinY) >> level) > 1))
+    {
+        ++level;
+    }
+
+    const uint32_t levelWidth = m_Pyramid.GetLevelWidth(level);
+    const uint32_t levelHeight = m_Pyramid.GetLevelHeight(level);
+    const uint32_t firstX = std::min(uint32_t(rectMinX) >> level, levelWidth - 1);
+    const uint32_t firstY = std::min(uint32_t(rectMinY) >> level, levelHeight - 1);
+    const uint32_t lastX = std::min(uint32_t(rectMaxX) >> level, levelWidth - 1);
+    const uint32_t lastY = std::min(uint32_t(rectMaxY) >> level, levelHeight - 1);
+
+    float farthest = m_Pyramid.Load(firstX, firstY, level);
+    for (uint32_t y = firstY; y <= lastY; y++)
+    {
+        for (uint32_t x = firstX; x <= lastX; x++)
+        {
+            const float depth = m_Pyramid.Load(x, y, level);
+            farthest = m_ReverseDepth ? std::min(farthest, depth) : std::max(farthest, depth);
+        }
+    }
+
+    const bool behind = m_ReverseDepth ? (nearest < farthest) : (nearest > farthest);
+    return !behind;
+}
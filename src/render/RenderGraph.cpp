@@ -0,0 +1,606 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/render/RenderGraph.h>
+#include <donut/core/log.h>
+#include <nvrhi/common/misc.h>
+#include <algorithm>
+
+using namespace donut::render;
+
+static constexpr uint64_t c_PlacementAlignment = 64 * 1024;
+static constexpr uint64_t c_MultisamplePlacementAlignment = 4 * 1024 * 1024;
+
+RenderGraphMemoryRequirements donut::render::EstimateTextureMemoryRequirements(const nvrhi::TextureDesc& desc)
+{
+    const nvrhi::FormatInfo& formatInfo = nvrhi::getFormatInfo(desc.format);
+    const uint64_t blockSize = std::max<uint64_t>(formatInfo.blockSize, 1);
+    const bool is3D = desc.dimension == nvrhi::TextureDimension::Texture3D;
+
+    uint64_t size = 0;
+    for (uint32_t mipLevel = 0; mipLevel < std::max(desc.mipLevels, 1u); mipLevel++)
+    {
+        const uint64_t width = std::max(desc.width >> mipLevel, 1u);
+        const uint64_t height = std::max(desc.height >> mipLevel, 1u);
+        const uint64_t depth = is3D ? std::max(desc.depth >> mipLevel, 1u) : 1;
+        const uint64_t blocks = ((width + blockSize - 1) / blockSize) * ((height + blockSize - 1) / blockSize);
+
+        size += blocks * formatInfo.bytesPerBlock * depth;
+    }
+
+    size *= std::max(desc.arraySize, 1u) * std::max(desc.sampleCount, 1u);
+
+    RenderGraphMemoryRequirements requirements;
+    requirements.alignment = desc.sampleCount > 1 ? c_MultisamplePlacementAlignment : c_PlacementAlignment;
+    requirements.size = nvrhi::align(size, requirements.alignment);
+    return requirements;
+}
+
+nvrhi::ITexture* RenderGraphResources::GetTexture(RenderGraphTextureHandle handle) const
+{
+    if (handle.index >= m_Textures.size())
+        return nullptr;
+
+    return m_Textures[handle.index];
+}
+
+RenderGraphTextureHandle RenderGraphPassBuilder::CreateTexture(const nvrhi::TextureDesc& desc)
+{
+    return m_Graph.CreateTexture(desc);
+}
+
+void RenderGraphPassBuilder::Read(RenderGraphTextureHandle texture, nvrhi::ResourceStates state)
+{
+    m_Graph.AddAccess(m_PassIndex, texture, state, false);
+}
+
+void RenderGraphPassBuilder::Write(RenderGraphTextureHandle texture, nvrhi::ResourceStates state)
+{
+    m_Graph.AddAccess(m_PassIndex, texture, state, true);
+}
+
+void RenderGraphPassBuilder::SetSideEffects()
+{
+    m_Graph.m_Passes[m_PassIndex].sideEffects = true;
+}
+
+RenderGraphTextureHandle RenderGraph::CreateTexture(const nvrhi::TextureDesc& desc)
+{
+    TextureNode node;
+    node.desc = desc;
+    m_Textures.push_back(std::move(node));
+
+    return RenderGraphTextureHandle{ uint32_t(m_Textures.size() - 1) };
+}
+
+RenderGraphTextureHandle RenderGraph::ImportTexture(nvrhi::ITexture* texture, nvrhi::ResourceStates currentState, nvrhi::ResourceStates finalState)
+{
+    TextureNode node;
+    if (texture)
+        node.desc = texture->getDesc();
+    node.importedTexture = texture;
+    node.initialState = currentState;
+    node.finalState = finalState;
+    node.imported = true;
+    m_Textures.push_back(std::move(node));
+
+    return RenderGraphTextureHandle{ uint32_t(m_Textures.size() - 1) };
+}
+
+uint32_t RenderGraph::AddPass(const std::string& name, const std::function<void(RenderGraphPassBuilder& builder)>& setup,
+    RenderGraphExecuteFunc execute)
+{
+    const uint32_t passIndex = uint32_t(m_Passes.size());
+
+    PassNode node;
+    node.name = name;
+    node.execute = std::move(execute);
+    m_Passes.push_back(std::move(node));
+
+    RenderGraphPassBuilder builder(*this, passIndex);
+    if (setup)
+        setup(builder);
+
+    return passIndex;
+}
+
+void RenderGraph::AddAccess(uint32_t passIndex, RenderGraphTextureHandle texture, nvrhi::ResourceStates state, bool write)
+{
+    if (texture.index >= m_Textures.size())
+    {
+        log::error("RenderGraph: pass '%s' accesses an invalid texture handle", m_Passes[passIndex].name.c_str());
+        return;
+    }
+
+    m_Passes[passIndex].accesses.push_back(TextureAccess{ texture.index, state, write });
+}
+
+void RenderGraph::Reset()
+{
+    m_Passes.clear();
+    m_Textures.clear();
+}
+
+bool RenderGraph::Compile(const RenderGraphCompileOptions& options, RenderGraphPlan& plan) const
+{
+    plan = RenderGraphPlan();
+    plan.passCulled.resize(m_Passes.size(), true);
+    plan.textures.resize(m_Textures.size());
+
+    // Culling: walk the passes backwards and keep the ones that write something needed later.
+    // Imported textures are needed after the graph; a kept pass needs everything it reads.
+    // A write does not end the need for a texture because passes may write only part of it.
+
+    std::vector<bool> needed(m_Textures.size(), false);
+    for (size_t textureIndex = 0; textureIndex < m_Textures.size(); textureIndex++)
+        needed[textureIndex] = m_Textures[textureIndex].imported;
+
+    for (size_t passIndex = m_Passes.size(); passIndex-- > 0; )
+    {
+        const PassNode& pass = m_Passes[passIndex];
+
+        bool keep = pass.sideEffects || !options.cullPasses;
+        for (const TextureAccess& access : pass.accesses)
+        {
+            if (access.write && needed[access.texture])
+                keep = true;
+        }
+
+        if (!keep)
+            continue;
+
+        plan.passCulled[passIndex] = false;
+        for (const TextureAccess& access : pass.accesses)
+        {
+            if (!access.write)
+                needed[access.texture] = true;
+        }
+    }
+
+    for (uint32_t passIndex = 0; passIndex < uint32_t(m_Passes.size()); passIndex++)
+    {
+        if (!plan.passCulled[passIndex])
+            plan.passes.push_back(RenderGraphPlannedPass{ passIndex, {} });
+    }
+
+    // Lifetimes
+
+    std::vector<bool> written(m_Textures.size(), false);
+
+    for (uint32_t plannedIndex = 0; plannedIndex < uint32_t(plan.passes.size()); plannedIndex++)
+    {
+        const PassNode& pass = m_Passes[plan.passes[plannedIndex].passIndex];
+
+        for (const TextureAccess& access : pass.accesses)
+        {
+            const TextureNode& texture = m_Textures[access.texture];
+            RenderGraphTexturePlacement& placement = plan.textures[access.texture];
+
+            if (texture.imported)
+                continue;
+
+            if (!access.write && !written[access.texture])
+            {
+                log::warning("RenderGraph: pass '%s' reads transient texture '%s' before any pass writes it",
+                    pass.name.c_str(), texture.desc.debugName.c_str());
+            }
+            written[access.texture] = written[access.texture] || access.write;
+
+            if (!placement.allocated)
+            {
+                placement.allocated = true;
+                placement.firstPass = plannedIndex;
+            }
+            placement.lastPass = plannedIndex;
+        }
+    }
+
+    // Placement
+
+    const RenderGraphMemoryRequirementsFunc& getMemoryRequirements = options.getMemoryRequirements
+        ? options.getMemoryRequirements
+        : RenderGraphMemoryRequirementsFunc(EstimateTextureMemoryRequirements);
+
+    std::vector<uint32_t> placementOrder;
+    std::vector<uint64_t> alignments(m_Textures.size(), 1);
+    for (uint32_t textureIndex = 0; textureIndex < uint32_t(m_Textures.size()); textureIndex++)
+    {
+        RenderGraphTexturePlacement& placement = plan.textures[textureIndex];
+        if (!placement.allocated)
+            continue;
+
+        RenderGraphMemoryRequirements requirements = getMemoryRequirements(m_Textures[textureIndex].desc);
+        placement.size = requirements.size;
+        alignments[textureIndex] = std::max<uint64_t>(requirements.alignment, 1);
+        placementOrder.push_back(textureIndex);
+    }
+
+    if (options.enableAliasing)
+    {
+        // Largest first, then in order of first use; ties are broken by index to keep the result stable.
+        std::sort(placementOrder.begin(), placementOrder.end(), [&plan](uint32_t a, uint32_t b)
+        {
+            const RenderGraphTexturePlacement& pa = plan.textures[a];
+            const RenderGraphTexturePlacement& pb = plan.textures[b];
+            if (pa.size != pb.size)
+                return pa.size > pb.size;
+            if (pa.firstPass != pb.firstPass)
+                return pa.firstPass < pb.firstPass;
+            return a < b;
+        });
+    }
+
+    std::vector<uint32_t> placed;
+    std::vector<std::pair<uint64_t, uint64_t>> occupied;
+
+    for (uint32_t textureIndex : placementOrder)
+    {
+        RenderGraphTexturePlacement& placement = plan.textures[textureIndex];
+        const uint64_t alignment = alignments[textureIndex];
+
+        uint64_t offset = 0;
+        if (options.enableAliasing)
+        {
+            occupied.clear();
+            for (uint32_t otherIndex : placed)
+            {
+                const RenderGraphTexturePlacement& other = plan.textures[otherIndex];
+                if (other.firstPass <= placement.lastPass && placement.firstPass <= other.lastPass)
+                    occupied.push_back({ other.offset, other.offset + other.size });
+            }
+
+            std::sort(occupied.begin(), occupied.end());
+
+            for (const auto& range : occupied)
+            {
+                if (offset + placement.size <= range.first)
+                    break;
+
+                offset = std::max(offset, nvrhi::align(range.second, alignment));
+            }
+        }
+        else
+        {
+            offset = nvrhi::align(plan.heapSize, alignment);
+        }
+
+        placement.offset = offset;
+        placed.push_back(textureIndex);
+
+        plan.heapSize = std::max(plan.heapSize, offset + placement.size);
+        plan.unaliasedSize = nvrhi::align(plan.unaliasedSize, alignment) + placement.size;
+    }
+
+    if (!plan.passes.empty())
+    {
+        std::vector<int64_t> liveDelta(plan.passes.size() + 1, 0);
+        for (const RenderGraphTexturePlacement& placement : plan.textures)
+        {
+            if (!placement.allocated)
+                continue;
+
+            liveDelta[placement.firstPass] += int64_t(placement.size);
+            liveDelta[placement.lastPass + 1] -= int64_t(placement.size);
+        }
+
+        int64_t live = 0;
+        for (size_t plannedIndex = 0; plannedIndex < plan.passes.size(); plannedIndex++)
+        {
+            live += liveDelta[plannedIndex];
+            plan.peakLiveSize = std::max(plan.peakLiveSize, uint64_t(live));
+        }
+    }
+
+    // Transitions
+
+    std::vector<nvrhi::ResourceStates> currentStates(m_Textures.size());
+    std::vector<bool> acquired(m_Textures.size(), false);
+    for (size_t textureIndex = 0; textureIndex < m_Textures.size(); textureIndex++)
+    {
+        currentStates[textureIndex] = m_Textures[textureIndex].initialState;
+        acquired[textureIndex] = m_Textures[textureIndex].imported;
+    }
+
+    std::vector<uint32_t> passTextures;
+    std::vector<nvrhi::ResourceStates> passStates(m_Textures.size(), nvrhi::ResourceStates::Unknown);
+    std::vector<uint8_t> passWrites(m_Textures.size(), 0);
+
+    for (RenderGraphPlannedPass& plannedPass : plan.passes)
+    {
+        const PassNode& pass = m_Passes[plannedPass.passIndex];
+
+        // Combine the accesses of the pass per texture: reads may use several read-only states
+        // at once, but a written texture must be used in one state only.
+        passTextures.clear();
+        for (const TextureAccess& access : pass.accesses)
+        {
+            if (passStates[access.texture] == nvrhi::ResourceStates::Unknown)
+                passTextures.push_back(access.texture);
+            else if ((access.write || passWrites[access.texture]) && passStates[access.texture] != access.state)
+            {
+                log::error("RenderGraph: pass '%s' writes texture %u and uses it in another state",
+                    pass.name.c_str(), access.texture);
+                return false;
+            }
+
+            passStates[access.texture] = passStates[access.texture] | access.state;
+            passWrites[access.texture] |= access.write ? 1 : 0;
+        }
+
+        for (uint32_t textureIndex : passTextures)
+        {
+            const nvrhi::ResourceStates state = passStates[textureIndex];
+
+            if (!acquired[textureIndex])
+            {
+                RenderGraphBarrier barrier;
+                barrier.texture.index = textureIndex;
+                barrier.before = nvrhi::ResourceStates::Common;
+                barrier.after = state;
+                barrier.discard = true;
+                plannedPass.barriers.push_back(barrier);
+                acquired[textureIndex] = true;
+            }
+            else if (currentStates[textureIndex] != state)
+            {
+                RenderGraphBarrier barrier;
+                barrier.texture.index = textureIndex;
+                barrier.before = currentStates[textureIndex];
+                barrier.after = state;
+                plannedPass.barriers.push_back(barrier);
+            }
+
+            currentStates[textureIndex] = state;
+            passStates[textureIndex] = nvrhi::ResourceStates::Unknown;
+            passWrites[textureIndex] = 0;
+        }
+
+        plan.barrierCount += uint32_t(plannedPass.barriers.size());
+    }
+
+    for (uint32_t textureIndex = 0; textureIndex < uint32_t(m_Textures.size()); textureIndex++)
+    {
+        const TextureNode& texture = m_Textures[textureIndex];
+        if (!texture.imported || texture.finalState == nvrhi::ResourceStates::Unknown)
+            continue;
+
+        if (currentStates[textureIndex] != texture.finalState)
+        {
+            RenderGraphBarrier barrier;
+            barrier.texture.index = textureIndex;
+            barrier.before = currentStates[textureIndex];
+            barrier.after = texture.finalState;
+            plan.finalBarriers.push_back(barrier);
+        }
+    }
+
+    plan.barrierCount += uint32_t(plan.finalBarriers.size());
+
+    return true;
+}
+
+bool RenderGraphExecutor::TextureKey::operator==(const TextureKey& other) const
+{
+    return offset == other.offset
+        && desc.width == other.desc.width
+        && desc.height == other.desc.height
+        && desc.depth == other.desc.depth
+        && desc.arraySize == other.desc.arraySize
+        && desc.mipLevels == other.desc.mipLevels
+        && desc.sampleCount == other.desc.sampleCount
+        && desc.sampleQuality == other.desc.sampleQuality
+        && desc.format == other.desc.format
+        && desc.dimension == other.desc.dimension
+        && desc.isRenderTarget == other.desc.isRenderTarget
+        && desc.isUAV == other.desc.isUAV
+        && desc.isTypeless == other.desc.isTypeless
+        && desc.useClearValue == other.desc.useClearValue
+        && desc.clearValue == other.desc.clearValue;
+}
+
+size_t RenderGraphExecutor::TextureKeyHash::operator()(const TextureKey& key) const
+{
+    size_t hash = 0;
+    nvrhi::hash_combine(hash, key.offset);
+    nvrhi::hash_combine(hash, key.desc.width);
+    nvrhi::hash_combine(hash, key.desc.height);
+    nvrhi::hash_combine(hash, key.desc.depth);
+    nvrhi::hash_combine(hash, key.desc.arraySize);
+    nvrhi::hash_combine(hash, key.desc.mipLevels);
+    nvrhi::hash_combine(hash, key.desc.sampleCount);
+    nvrhi::hash_combine(hash, key.desc.format);
+    nvrhi::hash_combine(hash, key.desc.dimension);
+    return hash;
+}
+
+RenderGraphExecutor::RenderGraphExecutor(nvrhi::IDevice* device)
+    : m_Device(device)
+{
+}
+
+nvrhi::TextureDesc RenderGraphExecutor::GetPlacedTextureDesc(const nvrhi::TextureDesc& desc)
+{
+    nvrhi::TextureDesc placedDesc = desc;
+    placedDesc.isVirtual = true;
+    placedDesc.initialState = nvrhi::ResourceStates::Common;
+    placedDesc.keepInitialState = false;
+    return placedDesc;
+}
+
+RenderGraphMemoryRequirements RenderGraphExecutor::GetMemoryRequirements(const nvrhi::TextureDesc& desc)
+{
+    TextureKey key;
+    key.desc = desc;
+
+    auto it = m_MemoryRequirements.find(key);
+    if (it != m_MemoryRequirements.end())
+        return it->second;
+
+    nvrhi::TextureHandle texture = m_Device->createTexture(GetPlacedTextureDesc(desc));
+
+    RenderGraphMemoryRequirements requirements;
+    if (texture)
+    {
+        nvrhi::MemoryRequirements memReq = m_Device->getTextureMemoryRequirements(texture);
+        requirements.size = memReq.size;
+        requirements.alignment = memReq.alignment;
+    }
+    else
+    {
+        log::error("RenderGraphExecutor: cannot create texture '%s'", desc.debugName.c_str());
+    }
+
+    m_MemoryRequirements[key] = requirements;
+    return requirements;
+}
+
+nvrhi::ITexture* RenderGraphExecutor::GetPlacedTexture(const nvrhi::TextureDesc& desc, uint64_t offset)
+{
+    TextureKey key;
+    key.desc = desc;
+    key.offset = offset;
+
+    PlacedTexture& placed = m_PlacedTextures[key];
+    placed.lastUsedFrame = m_FrameIndex;
+
+    if (!placed.texture)
+    {
+        placed.texture = m_Device->createTexture(GetPlacedTextureDesc(desc));
+        if (placed.texture)
+            m_Device->bindTextureMemory(placed.texture, m_Heap, offset);
+    }
+
+    return placed.texture;
+}
+
+bool RenderGraphExecutor::Execute(const RenderGraph& graph, nvrhi::ICommandList* commandList, RenderGraphPlan* outPlan)
+{
+    RenderGraphCompileOptions options;
+    options.getMemoryRequirements = [this](const nvrhi::TextureDesc& desc) { return GetMemoryRequirements(desc); };
+
+    RenderGraphPlan localPlan;
+    RenderGraphPlan& plan = outPlan ? *outPlan : localPlan;
+
+    if (!graph.Compile(options, plan))
+        return false;
+
+    Execute(graph, plan, commandList);
+    return true;
+}
+
+void RenderGraphExecutor::Execute(const RenderGraph& graph, const RenderGraphPlan& plan, nvrhi::ICommandList* commandList)
+{
+    ++m_FrameIndex;
+
+    if (plan.heapSize > m_HeapCapacity)
+    {
+        // Placed textures cannot move to another heap, so they are all recreated.
+        m_PlacedTextures.clear();
+
+        nvrhi::HeapDesc heapDesc;
+        heapDesc.type = nvrhi::HeapType::DeviceLocal;
+        heapDesc.capacity = plan.heapSize;
+        heapDesc.debugName = "RenderGraphHeap";
+
+        m_Heap = m_Device->createHeap(heapDesc);
+        m_HeapCapacity = m_Heap ? plan.heapSize : 0;
+    }
+
+    RenderGraphResources resources;
+    resources.m_Textures.resize(graph.m_Textures.size(), nullptr);
+
+    for (size_t textureIndex = 0; textureIndex < graph.m_Textures.size(); textureIndex++)
+    {
+        const RenderGraph::TextureNode& texture = graph.m_Textures[textureIndex];
+        const RenderGraphTexturePlacement& placement = plan.textures[textureIndex];
+
+        if (texture.imported)
+            resources.m_Textures[textureIndex] = texture.importedTexture;
+        else if (placement.allocated && m_Heap)
+            resources.m_Textures[textureIndex] = GetPlacedTexture(texture.desc, placement.offset);
+    }
+
+    for (const RenderGraphPlannedPass& plannedPass : plan.passes)
+    {
+        const RenderGraph::PassNode& pass = graph.m_Passes[plannedPass.passIndex];
+
+        for (const RenderGraphBarrier& barrier : plannedPass.barriers)
+        {
+            nvrhi::ITexture* texture = resources.m_Textures[barrier.texture.index];
+            if (!texture || !barrier.discard)
+                continue;
+
+            commandList->beginTrackingTextureState(texture, nvrhi::AllSubresources, nvrhi::ResourceStates::Common);
+
+            // The memory may hold another texture's data. Render targets and depth buffers must be
+            // initialized after aliasing, so they are cleared even without a clear value, to zero.
+            const nvrhi::TextureDesc& desc = texture->getDesc();
+            if (desc.useClearValue || desc.isRenderTarget)
+            {
+                const nvrhi::Color clearValue = desc.useClearValue ? desc.clearValue : nvrhi::Color(0.f);
+                const nvrhi::FormatInfo& formatInfo = nvrhi::getFormatInfo(desc.format);
+                if (formatInfo.hasDepth || formatInfo.hasStencil)
+                    commandList->clearDepthStencilTexture(texture, nvrhi::AllSubresources, true, clearValue.r, formatInfo.hasStencil, 0);
+                else
+                    commandList->clearTextureFloat(texture, nvrhi::AllSubresources, clearValue);
+            }
+        }
+
+        for (const RenderGraphBarrier& barrier : plannedPass.barriers)
+        {
+            nvrhi::ITexture* texture = resources.m_Textures[barrier.texture.index];
+            if (texture)
+                commandList->setTextureState(texture, nvrhi::AllSubresources, barrier.after);
+        }
+        commandList->commitBarriers();
+
+        if (pass.execute)
+        {
+            commandList->beginMarker(pass.name.c_str());
+            pass.execute(commandList, resources);
+            commandList->endMarker();
+        }
+    }
+
+    for (const RenderGraphBarrier& barrier : plan.finalBarriers)
+    {
+        nvrhi::ITexture* texture = resources.m_Textures[barrier.texture.index];
+        if (texture)
+            commandList->setTextureState(texture, nvrhi::AllSubresources, barrier.after);
+    }
+    commandList->commitBarriers();
+
+    for (auto it = m_PlacedTextures.begin(); it != m_PlacedTextures.end(); )
+    {
+        if (m_FrameIndex - it->second.lastUsedFrame > MaxUnusedFrames)
+            it = m_PlacedTextures.erase(it);
+        else
+            ++it;
+    }
+}
+
+void RenderGraphExecutor::ReleaseMemory()
+{
+    m_PlacedTextures.clear();
+    m_Heap = nullptr;
+    m_HeapCapacity = 0;
+}
@@ -0,0 +1,300 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/render/ShadowCache.h>
+#include <donut/render/GeometryPasses.h>
+#include <donut/engine/SceneGraph.h>
+#include <cmath>
+
+using namespace donut::math;
+using namespace donut::engine;
+using namespace donut::render;
+
+ShadowCacheTracker::ShadowCacheTracker(uint32_t numCascades)
+{
+    SetNumberOfCascades(numCascades);
+}
+
+void ShadowCacheTracker::SetNumberOfCascades(uint32_t count)
+{
+    m_Cascades.resize(count);
+}
+
+void ShadowCacheTracker::Invalidate()
+{
+    for (auto& cascade : m_Cascades)
+        cascade = CascadeState();
+}
+
+box3 ShadowCacheTracker::GetCascadeBox(const CascadeState& cascade)
+{
+    return box3(cascade.centerLight - cascade.halfSize, cascade.centerLight + cascade.halfSize);
+}
+
+void ShadowCacheTracker::AddDirtyRegion(const box3& bounds)
+{
+    if (bounds.isempty())
+        return;
+
+    m_DirtyRegions.push_back(bounds);
+
+    for (auto& cascade : m_Cascades)
+    {
+        if (!cascade.valid || cascade.dirty)
+            continue;
+
+        affine3 worldToLight = affine3::identity();
+        worldToLight.m_linear = cascade.worldToLight;
+
+        if ((bounds * worldToLight).intersects(GetCascadeBox(cascade)))
+            cascade.dirty = true;
+    }
+}
+
+void ShadowCacheTracker::RemoveCaster(const CasterState& state)
+{
+    if (state.visible && !state.isDynamic)
+        AddDirtyRegion(state.bounds);
+}
+
+void ShadowCacheTracker::UpdateCaster(const std::shared_ptr<MeshInstance>& meshInstance, const SceneGraphNode& node)
+{
+    box3 bounds = meshInstance->GetLocalBoundingBox() * node.GetLocalToWorldTransformFloat();
+
+    auto [it, inserted] = m_Casters.try_emplace(meshInstance.get());
+    CasterState& state = it->second;
+
+    // a new instance at the address of a destroyed one
+    if (!inserted && state.instance.expired())
+    {
+        RemoveCaster(state);
+        state = CasterState();
+        inserted = true;
+    }
+
+    state.lastSeenUpdate = m_UpdateIndex;
+
+    if (inserted)
+    {
+        state.instance = meshInstance;
+        state.bounds = bounds;
+        state.lastMovedUpdate = m_UpdateIndex;
+        state.alwaysDynamic = dynamic_cast<const SkinnedMeshInstance*>(meshInstance.get()) != nullptr;
+        state.isDynamic = state.alwaysDynamic;
+        state.visible = meshInstance->Visibility();
+        if (!state.isDynamic && state.visible)
+            AddDirtyRegion(bounds);
+        return;
+    }
+
+    if (bounds != state.bounds)
+    {
+        // a static caster that starts moving has to be removed from the cached maps
+        if (!state.isDynamic)
+        {
+            if (state.visible)
+                AddDirtyRegion(state.bounds);
+            state.isDynamic = true;
+        }
+
+        state.bounds = bounds;
+        state.lastMovedUpdate = m_UpdateIndex;
+    }
+}
+
+void ShadowCacheTracker::UpdateCasters(const SceneGraph& graph)
+{
+    ++m_UpdateIndex;
+    m_DirtyRegions.clear();
+
+    SceneGraphNode* root = graph.GetRootNode().get();
+    bool fullScan = m_Graph != &graph || graph.GetStructureVersion() != m_StructureVersion || graph.HasPendingStructureChanges();
+
+    if (fullScan)
+    {
+        for (const auto& meshInstance : graph.GetMeshInstances())
+        {
+            if (const SceneGraphNode* node = meshInstance->GetNode())
+                UpdateCaster(meshInstance, *node);
+        }
+    }
+    else if (root && root->GetBoundsVersion() > m_BoundsVersion)
+    {
+        // only visit the subgraphs whose bounds were recomputed since the last update
+        SceneGraphWalker walker(root);
+        while (walker)
+        {
+            bool changed = walker->GetBoundsVersion() > m_BoundsVersion;
+            if (changed)
+            {
+                if (auto meshInstance = std::dynamic_pointer_cast<MeshInstance>(walker->GetLeaf()))
+                    UpdateCaster(meshInstance, *walker.Get());
+            }
+
+            walker.Next(changed);
+        }
+    }
+
+    m_Graph = &graph;
+    m_StructureVersion = graph.GetStructureVersion();
+    m_BoundsVersion = root ? root->GetBoundsVersion() : 0;
+
+    m_StaticCasterCount = 0;
+    m_DynamicCasterCount = 0;
+
+    for (auto it = m_Casters.begin(); it != m_Casters.end(); )
+    {
+        CasterState& state = it->second;
+
+        // instances that were destroyed, or removed from the graph since the last full scan
+        if (state.instance.expired() || (fullScan && state.lastSeenUpdate != m_UpdateIndex))
+        {
+            RemoveCaster(state);
+            it = m_Casters.erase(it);
+            continue;
+        }
+
+        // the graph doesn't track visibility, so compare the flags of all casters;
+        // hidden instances don't cast shadows, treat them like removed ones
+        bool visible = it->first->Visibility();
+        if (visible != state.visible)
+        {
+            state.visible = visible;
+            if (!state.isDynamic)
+                AddDirtyRegion(state.bounds);
+        }
+
+        if (state.isDynamic && !state.alwaysDynamic && m_UpdateIndex - state.lastMovedUpdate >= DynamicFrames)
+        {
+            // still for long enough, bake it into the cached maps
+            if (state.visible)
+                AddDirtyRegion(state.bounds);
+            state.isDynamic = false;
+        }
+
+        if (state.visible)
+        {
+            if (state.isDynamic)
+                ++m_DynamicCasterCount;
+            else
+                ++m_StaticCasterCount;
+        }
+
+        ++it;
+    }
+}
+
+bool ShadowCacheTracker::SnapCascade(uint32_t cascadeIndex, const affine3& worldToLight, float3& center, float3& halfSize)
+{
+    if (cascadeIndex >= m_Cascades.size())
+        return true;
+
+    CascadeState& cascade = m_Cascades[cascadeIndex];
+
+    // Tolerate float noise in the inputs so that the cached projection stays bit-exact
+    constexpr float relativeTolerance = 1e-4f;
+    float3x3 rotation = worldToLight.m_linear;
+    bool sameRotation = cascade.valid && all(abs(rotation.row0 - cascade.worldToLight.row0) <= relativeTolerance)
+        && all(abs(rotation.row1 - cascade.worldToLight.row1) <= relativeTolerance)
+        && all(abs(rotation.row2 - cascade.worldToLight.row2) <= relativeTolerance);
+    if (sameRotation)
+        rotation = cascade.worldToLight;
+
+    float3 grid = max(halfSize * (2.f * SnapFraction), float3(1e-6f));
+    float3 snappedHalfSize = halfSize + grid * 0.5f;
+    bool sameSize = cascade.valid && all(abs(snappedHalfSize - cascade.halfSize) <= cascade.halfSize * relativeTolerance);
+    if (sameSize)
+    {
+        snappedHalfSize = cascade.halfSize;
+        grid = cascade.grid;
+    }
+
+    float3 centerLight = center * rotation;
+    float3 snappedCenter = float3(round(centerLight / grid)) * grid;
+
+    if (!sameRotation || !sameSize || any(snappedCenter != cascade.centerLight))
+    {
+        cascade.worldToLight = rotation;
+        cascade.centerLight = snappedCenter;
+        cascade.halfSize = snappedHalfSize;
+        cascade.grid = grid;
+        cascade.valid = true;
+        cascade.dirty = true;
+    }
+
+    // the rotation is orthogonal, so its inverse is the transpose
+    center = cascade.centerLight * transpose(cascade.worldToLight);
+    halfSize = cascade.halfSize;
+
+    return cascade.dirty;
+}
+
+bool ShadowCacheTracker::IsCascadeDirty(uint32_t cascade) const
+{
+    if (cascade >= m_Cascades.size())
+        return true;
+
+    return m_Cascades[cascade].dirty || !m_Cascades[cascade].valid;
+}
+
+void ShadowCacheTracker::MarkCascadeRendered(uint32_t cascade)
+{
+    if (cascade < m_Cascades.size() && m_Cascades[cascade].valid)
+        m_Cascades[cascade].dirty = false;
+}
+
+bool ShadowCacheTracker::IsStaticCaster(const MeshInstance* instance) const
+{
+    auto it = m_Casters.find(instance);
+    if (it == m_Casters.end())
+        return false;
+
+    const CasterState& state = it->second;
+    return state.visible && !state.isDynamic && !state.instance.expired();
+}
+
+
+void ShadowCasterDrawStrategy::PrepareForView(const std::shared_ptr<SceneGraphNode>& rootNode, const IView& view)
+{
+    m_Inner.PrepareForView(rootNode, view);
+}
+
+const DrawItem* ShadowCasterDrawStrategy::GetNextItem()
+{
+    while (const DrawItem* item = m_Inner.GetNextItem())
+    {
+        if (m_Tracker.IsStaticCaster(item->instance) == m_StaticCasters)
+            return item;
+    }
+
+    return nullptr;
+}
+
+bool ShadowCasterDrawStrategy::PrepareForViews(const std::shared_ptr<SceneGraphNode>& rootNode, const IView* const* views, uint32_t viewCount)
+{
+    return m_Inner.PrepareForViews(rootNode, views, viewCount);
+}
+
+void ShadowCasterDrawStrategy::SelectView(uint32_t viewIndex)
+{
+    m_Inner.SelectView(viewIndex);
+}
@@ -27,6 +27,7 @@
 #include <donut/engine/ShadowMap.h>
 #include <donut/engine/CommonRenderPasses.h>
 #include <donut/engine/View.h>
+#include <donut/engine/GpuProfiler.h>
 
 using namespace donut::math;
 #include <donut/shaders/sky_cb.h>
@@ -94,7 +95,7 @@ void SkyPass::Render(
     const DirectionalLight& light,
     const SkyParameters& params) const
 {
-    commandList->beginMarker("Sky");
+    BeginMarker(commandList, "Sky");
 
     for (uint viewIndex = 0; viewIndex < compositeView.GetNumChildViews(ViewType::PLANAR); viewIndex++)
     {
@@ -123,7 +124,7 @@ void SkyPass::Render(
         commandList->draw(args);
     }
 
-    commandList->endMarker();
+    EndMarker(commandList);
 }
 
 void SkyPass::FillShaderParameters(const engine::DirectionalLight& light, const SkyParameters& input, ProceduralSkyShaderParameters& output)
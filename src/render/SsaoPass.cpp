@@ -27,6 +27,7 @@
 #include <donut/engine/ShadowMap.h>
 #include <donut/engine/CommonRenderPasses.h>
 #include <donut/engine/View.h>
+#include <donut/engine/GpuProfiler.h>
 #include <nvrhi/utils.h>
 
 using namespace donut::math;
@@ -210,7 +211,7 @@ void SsaoPass::Render(
     assert(m_Compute.BindingSets[bindingSetIndex]);
     assert(m_Blur.BindingSets[bindingSetIndex]);
 
-    commandList->beginMarker("SSAO");
+    BeginMarker(commandList, "SSAO");
 
     for (uint viewIndex = 0; viewIndex < compositeView.GetNumChildViews(ViewType::PLANAR); viewIndex++)
     {
@@ -264,5 +265,5 @@ void SsaoPass::Render(
         commandList->dispatch(dispatchWidth, dispatchHeight, 1);
     }
 
-    commandList->endMarker();
+    EndMarker(commandList);
 }
\ No newline at end of file
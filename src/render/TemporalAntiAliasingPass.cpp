@@ -25,6 +25,7 @@
 #include <donut/engine/ShaderFactory.h>
 #include <donut/engine/CommonRenderPasses.h>
 #include <donut/engine/View.h>
+#include <donut/engine/GpuProfiler.h>
 
 using namespace donut::math;
 #include <donut/shaders/taa_cb.h>
@@ -32,6 +33,7 @@ using namespace donut::math;
 #include <nvrhi/utils.h>
 
 #include <assert.h>
+#include <cmath>
 #include <random>
 
 using namespace donut::engine;
@@ -46,8 +48,8 @@ TemporalAntiAliasingPass::TemporalAntiAliasingPass(
     : m_CommonPasses(commonPasses)
     , m_FrameIndex(0)
     , m_StencilMask(params.motionVectorStencilMask)
-    , m_R2Jitter(0.0f, 0.0f)
     , m_Jitter(TemporalAntiAliasingJitter::MSAA)
+    , m_JitterPhaseCount(16)
 {
     const IView* sampleView = compositeView.GetChildView(ViewType::PLANAR, 0);
 
@@ -183,7 +185,7 @@ void TemporalAntiAliasingPass::RenderMotionVectors(
     assert(compositeView.GetNumChildViews(ViewType::PLANAR) == compositeViewPrevious.GetNumChildViews(ViewType::PLANAR));
     assert(m_MotionVectorsPso);
 
-    commandList->beginMarker("MotionVectors");
+    BeginMarker(commandList, "MotionVectors");
 
     for (uint viewIndex = 0; viewIndex < compositeView.GetNumChildViews(ViewType::PLANAR); viewIndex++)
     {
@@ -218,7 +220,7 @@ void TemporalAntiAliasingPass::RenderMotionVectors(
         commandList->draw(args);
     }
 
-    commandList->endMarker();
+    EndMarker(commandList);
 }
 
 void TemporalAntiAliasingPass::TemporalResolve(
@@ -230,7 +232,7 @@ void TemporalAntiAliasingPass::TemporalResolve(
 {
     assert(compositeViewInput.GetNumChildViews(ViewType::PLANAR) == compositeViewOutput.GetNumChildViews(ViewType::PLANAR));
     
-    commandList->beginMarker("TemporalAA");
+    BeginMarker(commandList, "TemporalAA");
 
     for (uint viewIndex = 0; viewIndex < compositeViewInput.GetNumChildViews(ViewType::PLANAR); viewIndex++)
     {
@@ -267,7 +269,7 @@ void TemporalAntiAliasingPass::TemporalResolve(
         commandList->dispatch(gridSize.x, gridSize.y, 1);
     }
 
-    commandList->endMarker();
+    EndMarker(commandList);
 }
 
 void TemporalAntiAliasingPass::AdvanceFrame()
@@ -275,18 +277,6 @@ void TemporalAntiAliasingPass::AdvanceFrame()
     m_FrameIndex++;
 
     std::swap(m_ResolveBindingSet, m_ResolveBindingSetPrevious);
-
-    if (m_Jitter == TemporalAntiAliasingJitter::R2)
-    {
-        // Advance R2 jitter sequence
-        // http://extremelearning.com.au/unreasonable-effectiveness-of-quasirandom-sequences/
-
-        static const float g = 1.32471795724474602596f;
-        static const float a1 = 1.0f / g;
-        static const float a2 = 1.0f / (g * g);
-        m_R2Jitter[0] = fmodf(m_R2Jitter[0] + a1, 1.0f);
-        m_R2Jitter[1] = fmodf(m_R2Jitter[1] + a2, 1.0f);
-    }
 }
 
 static float VanDerCorput(size_t base, size_t index)
@@ -303,9 +293,17 @@ static float VanDerCorput(size_t base, size_t index)
     return ret;
 }
 
-dm::float2 TemporalAntiAliasingPass::GetCurrentPixelOffset()
+uint32_t donut::render::GetTemporalAntiAliasingJitterPhaseCount(float upscalingRatio)
+{
+    // Every output pixel should receive a few samples per cycle: scale the native phase count by the
+    // number of output pixels per input pixel.
+    float ratio = std::max(upscalingRatio, 1.f);
+    return uint32_t(dm::clamp(std::ceil(16.f * ratio * ratio), 16.f, 256.f));
+}
+
+dm::float2 donut::render::GetTemporalAntiAliasingJitterOffset(TemporalAntiAliasingJitter jitter, uint32_t frameIndex, uint32_t phaseCount)
 {
-    switch (m_Jitter)
+    switch (jitter)
     {
         default:
         case TemporalAntiAliasingJitter::MSAA:
@@ -315,27 +313,45 @@ dm::float2 TemporalAntiAliasingPass::GetCurrentPixelOffset()
                 float2(-0.3125f, 0.3125f), float2(-0.4375f, 0.0625f), float2(0.1875f, 0.4375f), float2(0.4375f, -0.4375f)
             };
 
-            return offsets[m_FrameIndex % 8];
+            return offsets[frameIndex % 8];
         }
         case TemporalAntiAliasingJitter::Halton:
         {
-            uint32_t index = (m_FrameIndex % 16) + 1;
+            uint32_t index = (frameIndex % std::max(phaseCount, 1u)) + 1;
             return float2{ VanDerCorput(2, index), VanDerCorput(3, index) } - 0.5f;
         }
         case TemporalAntiAliasingJitter::R2:
         {
-            return m_R2Jitter - 0.5f;
+            // R2 sequence
+            // http://extremelearning.com.au/unreasonable-effectiveness-of-quasirandom-sequences/
+
+            static const double g = 1.32471795724474602596;
+            static const double a1 = 1.0 / g;
+            static const double a2 = 1.0 / (g * g);
+            double x = double(frameIndex) * a1;
+            double y = double(frameIndex) * a2;
+            return float2{ float(x - std::floor(x)), float(y - std::floor(y)) } - 0.5f;
         }
         case TemporalAntiAliasingJitter::WhiteNoise:
         {
-            std::mt19937 rng(m_FrameIndex);
+            std::mt19937 rng(frameIndex);
             std::uniform_real_distribution<float> dist(-0.5f, 0.5f);
             return float2{ dist(rng), dist(rng) };
         }
     }
 }
 
+dm::float2 TemporalAntiAliasingPass::GetCurrentPixelOffset()
+{
+    return GetTemporalAntiAliasingJitterOffset(m_Jitter, m_FrameIndex, m_JitterPhaseCount);
+}
+
 void donut::render::TemporalAntiAliasingPass::SetJitter(TemporalAntiAliasingJitter jitter)
 {
     m_Jitter = jitter;
 }
+
+void TemporalAntiAliasingPass::SetUpscalingRatio(float upscalingRatio)
+{
+    m_JitterPhaseCount = GetTemporalAntiAliasingJitterPhaseCount(upscalingRatio);
+}
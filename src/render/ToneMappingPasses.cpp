@@ -27,6 +27,7 @@
 #include <sstream>
 #include <assert.h>
 #include <donut/engine/FramebufferFactory.h>
+#include <donut/engine/GpuProfiler.h>
 #include <donut/core/log.h>
 
 using namespace donut::math;
@@ -44,11 +45,14 @@ ToneMappingPass::ToneMappingPass(
     const CreateParameters& params)
     : m_Device(device)
     , m_CommonPasses(commonPasses)
-    , m_HistogramBins(params.histogramBins)
     , m_FramebufferFactory(framebufferFactory)
 {
     assert(params.histogramBins <= 256);
 
+    m_HistogramRange.bins = params.histogramBins;
+    m_HistogramRange.minLogLuminance = params.histogramMinLogLuminance;
+    m_HistogramRange.maxLogLuminance = params.histogramMaxLogLuminance;
+
     const IView* sampleView = compositeView.GetChildView(ViewType::PLANAR, 0);
     nvrhi::IFramebuffer* sampleFramebuffer = m_FramebufferFactory->GetFramebuffer(*sampleView);
 
@@ -74,7 +78,7 @@ ToneMappingPass::ToneMappingPass(
     m_ToneMappingCB = device->createBuffer(constantBufferDesc);
 
     nvrhi::BufferDesc storageBufferDesc;
-    storageBufferDesc.byteSize = sizeof(uint) * m_HistogramBins;
+    storageBufferDesc.byteSize = sizeof(uint) * m_HistogramRange.bins;
     storageBufferDesc.format = nvrhi::Format::R32_UINT;
     storageBufferDesc.canHaveUAVs = true;
     storageBufferDesc.debugName = "HistogramBuffer";
@@ -236,12 +240,12 @@ void ToneMappingPass::SimpleRender(
     const ICompositeView& compositeView, nvrhi
     ::ITexture* sourceTexture)
 {
-    commandList->beginMarker("ToneMapping");
+    BeginMarker(commandList, "ToneMapping");
     ResetHistogram(commandList);
     AddFrameToHistogram(commandList, compositeView, sourceTexture);
     ComputeExposure(commandList, params);
     Render(commandList, params, compositeView, sourceTexture);
-    commandList->endMarker();
+    EndMarker(commandList);
 }
 
 nvrhi::BufferHandle ToneMappingPass::GetExposureBuffer()
@@ -249,6 +253,11 @@ nvrhi::BufferHandle ToneMappingPass::GetExposureBuffer()
     return m_ExposureBuffer;
 }
 
+nvrhi::BufferHandle ToneMappingPass::GetHistogramBuffer()
+{
+    return m_HistogramBuffer;
+}
+
 void ToneMappingPass::AdvanceFrame(float frameTime)
 {
     m_FrameTime = frameTime;
@@ -265,9 +274,6 @@ void ToneMappingPass::ResetHistogram(nvrhi::ICommandList* commandList)
     commandList->clearBufferUInt(m_HistogramBuffer, 0);
 }
 
-static const float g_minLogLuminance = -10; // TODO: figure out how to set these properly
-static const float g_maxLogLuminamce = 4;
-
 void ToneMappingPass::AddFrameToHistogram(nvrhi::ICommandList* commandList, const ICompositeView& compositeView, nvrhi::ITexture* sourceTexture)
 {
     nvrhi::BindingSetHandle& bindingSet = m_HistogramBindingSets[sourceTexture];
@@ -292,8 +298,8 @@ void ToneMappingPass::AddFrameToHistogram(nvrhi::ICommandList* commandList, cons
         for (uint viewportIndex = 0; viewportIndex < viewportState.scissorRects.size(); viewportIndex++)
         {
             ToneMappingConstants toneMappingConstants = {};
-            toneMappingConstants.logLuminanceScale = 1.0f / (g_maxLogLuminamce - g_minLogLuminance);
-            toneMappingConstants.logLuminanceBias = -g_minLogLuminance * toneMappingConstants.logLuminanceScale;
+            toneMappingConstants.logLuminanceScale = 1.0f / (m_HistogramRange.maxLogLuminance - m_HistogramRange.minLogLuminance);
+            toneMappingConstants.logLuminanceBias = -m_HistogramRange.minLogLuminance * toneMappingConstants.logLuminanceScale;
 
             nvrhi::Rect& scissor = viewportState.scissorRects[viewportIndex];
             toneMappingConstants.viewOrigin = uint2(scissor.minX, scissor.minY);
@@ -316,10 +322,9 @@ void ToneMappingPass::AddFrameToHistogram(nvrhi::ICommandList* commandList, cons
 void ToneMappingPass::ComputeExposure(nvrhi::ICommandList* commandList, const ToneMappingParameters& params)
 {
     ToneMappingConstants toneMappingConstants = {};
-    toneMappingConstants.logLuminanceScale = g_maxLogLuminamce - g_minLogLuminance;
-    toneMappingConstants.logLuminanceBias = g_minLogLuminance;
-    toneMappingConstants.histogramLowPercentile = std::min(0.99f, std::max(0.f, params.histogramLowPercentile));
-    toneMappingConstants.histogramHighPercentile = std::min(1.f, std::max(toneMappingConstants.histogramLowPercentile, params.histogramHighPercentile));
+    toneMappingConstants.logLuminanceScale = m_HistogramRange.maxLogLuminance - m_HistogramRange.minLogLuminance;
+    toneMappingConstants.logLuminanceBias = m_HistogramRange.minLogLuminance;
+    ExposureModel::GetClampedPercentiles(params, toneMappingConstants.histogramLowPercentile, toneMappingConstants.histogramHighPercentile);
     toneMappingConstants.eyeAdaptationSpeedUp = params.eyeAdaptationSpeedUp;
     toneMappingConstants.eyeAdaptationSpeedDown = params.eyeAdaptationSpeedDown;
     toneMappingConstants.minAdaptedLuminance = params.minAdaptedLuminance;
@@ -0,0 +1,372 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/render/VisibilityCache.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/View.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace donut::math;
+using namespace donut::engine;
+using namespace donut::render;
+
+// Relative tolerance for the rounding of the plane distances in frustum::intersectsWith
+static constexpr double c_PlaneDistanceTolerance = 1e-5;
+
+struct VisibilityCacheWalker::ViewState
+{
+    struct Node
+    {
+        SceneGraphNode* node = nullptr;
+        MeshInstance* meshInstance = nullptr;
+        uint32_t subgraphEnd = 0;     // index of the node that follows the subgraph
+        uint32_t boundsVersion = 0;
+        uint32_t epoch = 0;           // the result is only valid in the epoch where it was computed
+        bool visible = false;
+        float extent = 0.f;           // largest magnitude of the box coordinates
+        double margin = 0.0;          // plane distance that the result can absorb, less the rounding tolerance
+        double geometryMargin = 0.0;  // the same for all geometry boxes of a mesh being visible, see AreGeometriesVisible
+        float geometryExtent = 0.f;
+        double normalDrift = 0.0;     // drift of the view when the node was tested
+        double distanceDrift = 0.0;
+    };
+
+    std::vector<Node> nodes;
+    std::weak_ptr<SceneGraph> graph;
+    std::weak_ptr<SceneGraphNode> rootNode;
+    uint32_t structureVersion = 0;
+
+    frustum viewFrustum;
+    bool hasFrustum = false;
+    bool cacheable = false;
+    uint32_t epoch = 1;
+
+    // accumulated motion of the planes since the last cut
+    double normalDrift = 0.0;
+    double distanceDrift = 0.0;
+
+    // scales of the plane equations for the rounding tolerance
+    double normalScale = 0.0;
+    double distanceScale = 0.0;
+
+    VisibilityCache::Statistics statistics;
+
+    void BuildNodes(SceneGraphNode* root);
+    void UpdateFrustum(const frustum& newFrustum, float cameraCutThreshold);
+    [[nodiscard]] double GetTolerance(float extent) const;
+    [[nodiscard]] bool IsValid(const Node& node, double margin, float extent) const;
+    bool TestNode(Node& node);
+    void TestGeometries(Node& node);
+};
+
+static bool IsBoxIndependent(const plane& p)
+{
+    return p.normal.x == 0.f && p.normal.y == 0.f && p.normal.z == 0.f;
+}
+
+static float GetExtent(const box3& bounds)
+{
+    return std::max(
+        std::max(std::max(std::abs(bounds.m_mins.x), std::abs(bounds.m_maxs.x)), std::max(std::abs(bounds.m_mins.y), std::abs(bounds.m_maxs.y))),
+        std::max(std::abs(bounds.m_mins.z), std::abs(bounds.m_maxs.z)));
+}
+
+// The distance of the nearest corner of the box to each plane, as in frustum::intersectsWith: a visible box keeps
+// its result while all distances stay below zero, a culled box while one of them stays above zero.
+static double GetMargin(const frustum& viewFrustum, const box3& bounds, bool visible)
+{
+    double margin = visible ? INFINITY : -INFINITY;
+    for (int i = 0; i < frustum::PLANES_COUNT; i++)
+    {
+        const plane& p = viewFrustum.planes[i];
+
+        if (IsBoxIndependent(p))
+        {
+            if (!visible && p.distance < 0.f)
+                margin = INFINITY;
+            continue;
+        }
+
+        const double x = p.normal.x > 0 ? bounds.m_mins.x : bounds.m_maxs.x;
+        const double y = p.normal.y > 0 ? bounds.m_mins.y : bounds.m_maxs.y;
+        const double z = p.normal.z > 0 ? bounds.m_mins.z : bounds.m_maxs.z;
+        const double distance = double(p.normal.x) * x + double(p.normal.y) * y + double(p.normal.z) * z - double(p.distance);
+
+        if (visible)
+            margin = std::min(margin, -distance);
+        else
+            margin = std::max(margin, distance);
+    }
+    return margin;
+}
+
+void VisibilityCacheWalker::ViewState::BuildNodes(SceneGraphNode* root)
+{
+    nodes.clear();
+
+    // indices of the nodes whose subgraph is still being visited
+    std::vector<uint32_t> open;
+
+    SceneGraphWalker walker(root);
+    while (walker)
+    {
+        Node& node = nodes.emplace_back();
+        node.node = walker.Get();
+        node.meshInstance = dynamic_cast<MeshInstance*>(walker->GetLeaf().get());
+        open.push_back(uint32_t(nodes.size() - 1));
+
+        // a sibling closes the current node, going up also closes its ancestors
+        int depthChange = walker.Next(true);
+        for (int closed = 0; closed < 1 - depthChange && !open.empty(); closed++)
+        {
+            nodes[open.back()].subgraphEnd = uint32_t(nodes.size());
+            open.pop_back();
+        }
+    }
+
+    for (uint32_t index : open)
+        nodes[index].subgraphEnd = uint32_t(nodes.size());
+
+    // the new nodes carry no results
+    ++epoch;
+}
+
+void VisibilityCacheWalker::ViewState::UpdateFrustum(const frustum& newFrustum, float cameraCutThreshold)
+{
+    bool cut = !hasFrustum;
+    double normalDelta = 0.0;
+    double distanceDelta = 0.0;
+
+    cacheable = true;
+    normalScale = 0.0;
+    distanceScale = 0.0;
+
+    for (int i = 0; i < frustum::PLANES_COUNT; i++)
+    {
+        const plane& current = newFrustum.planes[i];
+        const plane& previous = viewFrustum.planes[i];
+
+        if (!std::isfinite(current.normal.x) || !std::isfinite(current.normal.y) || !std::isfinite(current.normal.z) ||
+            !std::isfinite(current.distance))
+        {
+            cacheable = false;
+            continue;
+        }
+
+        // planes with a zero normal accept or reject all boxes, they may only change with a cut
+        if (IsBoxIndependent(current) || IsBoxIndependent(previous))
+        {
+            if (!IsBoxIndependent(current) || !IsBoxIndependent(previous) || current.distance != previous.distance)
+                cut = true;
+            continue;
+        }
+
+        normalDelta = std::max(normalDelta,
+            std::abs(double(current.normal.x) - double(previous.normal.x)) +
+            std::abs(double(current.normal.y) - double(previous.normal.y)) +
+            std::abs(double(current.normal.z) - double(previous.normal.z)));
+        distanceDelta = std::max(distanceDelta, std::abs(double(current.distance) - double(previous.distance)));
+
+        normalScale = std::max(normalScale,
+            double(std::abs(current.normal.x)) + double(std::abs(current.normal.y)) + double(std::abs(current.normal.z)));
+        distanceScale = std::max(distanceScale, double(std::abs(current.distance)));
+    }
+
+    if (!std::isfinite(distanceDelta) || normalDelta > double(cameraCutThreshold))
+        cut = true;
+
+    if (cut)
+    {
+        ++epoch;
+        normalDrift = 0.0;
+        distanceDrift = 0.0;
+    }
+    else
+    {
+        normalDrift += normalDelta;
+        distanceDrift += distanceDelta;
+    }
+
+    viewFrustum = newFrustum;
+    hasFrustum = true;
+}
+
+double VisibilityCacheWalker::ViewState::GetTolerance(float extent) const
+{
+    return c_PlaneDistanceTolerance * (normalScale * double(extent) + distanceScale);
+}
+
+bool VisibilityCacheWalker::ViewState::IsValid(const Node& node, double margin, float extent) const
+{
+    const double drift = (normalDrift - node.normalDrift) * double(extent) + (distanceDrift - node.distanceDrift);
+    return margin - drift - GetTolerance(extent) > 0.0;
+}
+
+bool VisibilityCacheWalker::ViewState::TestNode(Node& node)
+{
+    if (cacheable && node.epoch == epoch && node.boundsVersion == node.node->GetBoundsVersion() && IsValid(node, node.margin, node.extent))
+    {
+        ++statistics.cachedNodes;
+        return node.visible;
+    }
+
+    ++statistics.testedNodes;
+
+    // the result always comes from the same test that the draw strategies use without the cache
+    const box3& bounds = node.node->GetGlobalBoundingBox();
+    node.visible = viewFrustum.intersectsWith(bounds);
+    node.boundsVersion = node.node->GetBoundsVersion();
+    node.epoch = epoch;
+    node.normalDrift = normalDrift;
+    node.distanceDrift = distanceDrift;
+    node.extent = GetExtent(bounds);
+    node.margin = -INFINITY;
+    node.geometryMargin = -INFINITY;
+
+    if (!cacheable || !std::isfinite(node.extent))
+        return node.visible;
+
+    node.margin = GetMargin(viewFrustum, bounds, node.visible) - GetTolerance(node.extent);
+
+    if (node.visible)
+        TestGeometries(node);
+
+    return node.visible;
+}
+
+// Meshes with several geometries are culled per geometry by the draw strategies. When all of them are visible
+// with a margin, that result is cached as well.
+void VisibilityCacheWalker::ViewState::TestGeometries(Node& node)
+{
+    const MeshInstance* meshInstance = node.meshInstance;
+    if (!meshInstance || dynamic_cast<const MeshInstanceArray*>(meshInstance))
+        return;
+
+    const MeshInfo* mesh = meshInstance->GetMesh().get();
+    if (!mesh || mesh->geometries.size() < 2 || mesh->skinPrototype)
+        return;
+
+    const affine3& localToWorld = node.node->GetLocalToWorldTransformFloat();
+    double margin = INFINITY;
+    float extent = 0.f;
+    for (const auto& geometry : mesh->geometries)
+    {
+        const box3 geometryBounds = geometry->objectSpaceBounds * localToWorld;
+        const float geometryExtent = GetExtent(geometryBounds);
+        if (!std::isfinite(geometryExtent) || !viewFrustum.intersectsWith(geometryBounds))
+            return;
+
+        margin = std::min(margin, GetMargin(viewFrustum, geometryBounds, true));
+        extent = std::max(extent, geometryExtent);
+    }
+
+    node.geometryMargin = margin - GetTolerance(extent);
+    node.geometryExtent = extent;
+}
+
+VisibilityCacheWalker::operator bool() const
+{
+    return m_View && m_Index < m_View->nodes.size();
+}
+
+SceneGraphNode* VisibilityCacheWalker::Get() const
+{
+    return *this ? m_View->nodes[m_Index].node : nullptr;
+}
+
+void VisibilityCacheWalker::Next(bool allowChildren)
+{
+    m_Index = allowChildren ? m_Index + 1 : m_View->nodes[m_Index].subgraphEnd;
+}
+
+bool VisibilityCacheWalker::IsVisible() const
+{
+    return m_View->TestNode(m_View->nodes[m_Index]);
+}
+
+MeshInstance* VisibilityCacheWalker::GetMeshInstance() const
+{
+    return m_View->nodes[m_Index].meshInstance;
+}
+
+bool VisibilityCacheWalker::AreGeometriesVisible() const
+{
+    // only called after IsVisible, which validated the node
+    const ViewState::Node& node = m_View->nodes[m_Index];
+    return m_View->IsValid(node, node.geometryMargin, node.geometryExtent);
+}
+
+VisibilityCache::VisibilityCache() = default;
+VisibilityCache::~VisibilityCache() = default;
+
+VisibilityCacheWalker VisibilityCache::BeginView(const std::shared_ptr<SceneGraphNode>& rootNode, const IView& view)
+{
+    VisibilityCacheWalker walker;
+
+    std::shared_ptr<SceneGraph> graph = rootNode ? rootNode->GetGraph() : nullptr;
+    if (!graph)
+        return walker;
+
+    std::unique_ptr<VisibilityCacheWalker::ViewState>& state = m_Views[&view];
+    if (!state)
+        state = std::make_unique<VisibilityCacheWalker::ViewState>();
+
+    if (state->graph.lock() != graph || state->rootNode.lock() != rootNode || state->structureVersion != graph->GetStructureVersion())
+    {
+        state->BuildNodes(rootNode.get());
+        state->graph = graph;
+        state->rootNode = rootNode;
+        state->structureVersion = graph->GetStructureVersion();
+    }
+
+    state->UpdateFrustum(view.GetViewFrustum(), m_CameraCutThreshold);
+    state->statistics = Statistics();
+
+    walker.m_View = state.get();
+    walker.m_Index = 0;
+    return walker;
+}
+
+void VisibilityCache::ResetView(const IView& view)
+{
+    auto it = m_Views.find(&view);
+    if (it != m_Views.end())
+        it->second->hasFrustum = false;
+}
+
+void VisibilityCache::RemoveView(const IView& view)
+{
+    m_Views.erase(&view);
+}
+
+void VisibilityCache::Clear()
+{
+    m_Views.clear();
+}
+
+VisibilityCache::Statistics VisibilityCache::GetStatistics(const IView& view) const
+{
+    auto it = m_Views.find(&view);
+    return (it != m_Views.end()) ? it->second->statistics : Statistics();
+}
@@ -0,0 +1,173 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/View.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Procedural scenes shared by the render tests. Everything is built from a seeded LCG,
+// so the same arguments produce the same scene on every platform.
+
+namespace donut::tests
+{
+	struct Random
+	{
+		uint32_t state = 1;
+		uint32_t operator()() { state = state * 1664525u + 1013904223u; return state >> 8; }
+		float uniform(float low, float high) { return low + (high - low) * float((*this)() & 0xffff) / 65535.f; }
+	};
+
+	struct TestScene
+	{
+		std::shared_ptr<engine::SceneGraph> graph;
+		std::shared_ptr<engine::SceneGraphNode> root;
+		std::vector<std::shared_ptr<engine::SceneGraphNode>> groups;
+		std::vector<std::shared_ptr<engine::SceneGraphNode>> leaves;
+		std::vector<std::shared_ptr<engine::Material>> materials;
+		std::vector<std::shared_ptr<engine::MeshInfo>> meshes;
+	};
+
+	// Named materials with materialID = index: a mix of opaque, alpha tested and, optionally,
+	// alpha blended ones, a third of them double sided
+	inline std::vector<std::shared_ptr<engine::Material>> createMaterials(int count, bool alphaBlended = true)
+	{
+		std::vector<std::shared_ptr<engine::Material>> materials;
+		for (int i = 0; i < count; i++)
+		{
+			auto material = std::make_shared<engine::Material>();
+			material->name = "material" + std::to_string(i);
+			material->materialID = i;
+			material->domain = (alphaBlended && i % 5 == 4) ? engine::MaterialDomain::AlphaBlended
+				: (i % 4 == 3) ? engine::MaterialDomain::AlphaTested : engine::MaterialDomain::Opaque;
+			material->doubleSided = (i % 3 == 0);
+			materials.push_back(material);
+		}
+		return materials;
+	}
+
+	// Meshes over 4 buffer groups, mesh i has (i % 3) + 1 geometries of 300 indices with random materials.
+	// Geometry g covers the unit box that starts at (g - 1, g - 1, g - 1).
+	inline std::vector<std::shared_ptr<engine::MeshInfo>> createMeshes(int count, const std::vector<std::shared_ptr<engine::Material>>& materials, Random& random)
+	{
+		std::vector<std::shared_ptr<engine::BufferGroup>> buffers;
+		for (int i = 0; i < 4; i++)
+			buffers.push_back(std::make_shared<engine::BufferGroup>());
+
+		std::vector<std::shared_ptr<engine::MeshInfo>> meshes;
+		for (int i = 0; i < count; i++)
+		{
+			auto mesh = std::make_shared<engine::MeshInfo>();
+			mesh->buffers = buffers[i % buffers.size()];
+			mesh->indexOffset = uint32_t(i * 1000);
+			mesh->vertexOffset = uint32_t(i * 500);
+			mesh->objectSpaceBounds = dm::box3::empty();
+			for (int g = 0; g <= i % 3; g++)
+			{
+				auto geometry = std::make_shared<engine::MeshGeometry>();
+				geometry->material = materials[random() % materials.size()];
+				geometry->indexOffsetInMesh = uint32_t(g * 300);
+				geometry->vertexOffsetInMesh = uint32_t(g * 100);
+				geometry->numIndices = 300;
+				geometry->objectSpaceBounds = dm::box3(dm::float3(-1.f + float(g)), dm::float3(float(g)));
+				mesh->objectSpaceBounds |= geometry->objectSpaceBounds;
+				mesh->geometries.push_back(geometry);
+			}
+			meshes.push_back(mesh);
+		}
+		return meshes;
+	}
+
+	// A scene graph with only a root node, and the materials and meshes to populate it with
+	inline TestScene createEmptyScene(int materialCount, int meshCount, Random& random, bool alphaBlended = true)
+	{
+		TestScene scene;
+		scene.materials = createMaterials(materialCount, alphaBlended);
+		scene.meshes = createMeshes(meshCount, scene.materials, random);
+		scene.graph = std::make_shared<engine::SceneGraph>();
+		scene.root = std::make_shared<engine::SceneGraphNode>();
+		scene.graph->SetRootNode(scene.root);
+		return scene;
+	}
+
+	// A gridSize x gridSize grid of instances of random meshes, 4 units apart in the XZ plane, starting at
+	// z = 0 and centered on x = 0. The instances are spread over 'groupCount' groups, or one group per row.
+	inline void addInstanceGrid(TestScene& scene, int gridSize, Random& random, int groupCount = 0)
+	{
+		const size_t firstGroup = scene.groups.size();
+		for (int i = 0; i < groupCount; i++)
+		{
+			auto group = std::make_shared<engine::SceneGraphNode>();
+			scene.graph->Attach(scene.root, group);
+			scene.groups.push_back(group);
+		}
+
+		for (int z = 0; z < gridSize; z++)
+		{
+			if (groupCount == 0)
+			{
+				auto row = std::make_shared<engine::SceneGraphNode>();
+				scene.graph->Attach(scene.root, row);
+				scene.groups.push_back(row);
+			}
+
+			for (int x = 0; x < gridSize; x++)
+			{
+				auto& group = groupCount ? scene.groups[firstGroup + (x + z) % groupCount] : scene.groups.back();
+				auto instance = std::make_shared<engine::MeshInstance>(scene.meshes[random() % scene.meshes.size()]);
+				auto node = scene.graph->AttachLeafNode(group, instance);
+				node->SetTranslation(dm::double3(double(x - gridSize / 2) * 4.0, 0.0, double(z) * 4.0));
+				scene.leaves.push_back(node);
+			}
+		}
+	}
+
+	// An instance array of the first mesh with 'count' instances scattered over [-100, 100) x [0, 200) at y = 2
+	inline std::shared_ptr<engine::MeshInstanceArray> addInstanceArray(TestScene& scene, const std::shared_ptr<engine::SceneGraphNode>& parent,
+		int count, uint32_t maxInstancesPerCell, Random& random)
+	{
+		std::vector<dm::affine3> transforms;
+		for (int i = 0; i < count; i++)
+			transforms.push_back(dm::translation(dm::float3(float(random() % 200) - 100.f, 2.f, float(random() % 200))));
+
+		auto instanceArray = std::make_shared<engine::MeshInstanceArray>(scene.meshes[0]);
+		instanceArray->SetMaxInstancesPerCell(maxInstancesPerCell);
+		instanceArray->SetInstances(std::move(transforms));
+		scene.graph->AttachLeafNode(parent, instanceArray);
+		return instanceArray;
+	}
+
+	// 1280x720 perspective view above the start of the grid, looking along +Z
+	inline engine::PlanarView createView(float zFar = 150.f)
+	{
+		engine::PlanarView view;
+		view.SetViewport(nvrhi::Viewport(1280.f, 720.f));
+		view.SetMatrices(dm::translation(dm::float3(0.f, -5.f, 20.f)), dm::perspProjD3DStyle(dm::radians(60.f), 16.f / 9.f, 0.1f, zFar));
+		view.UpdateCache();
+		return view;
+	}
+}
@@ -0,0 +1,138 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+// Fuzz harness for the chunk file loader.
+//
+// With DONUT_LIBFUZZER defined (DONUT_WITH_FUZZERS), this is a libFuzzer
+// target ; otherwise it builds a standalone driver that replays the files
+// given on the command line, e.g. a corpus or a crash reproducer.
+
+#include <donut/core/chunk/chunk.h>
+#include <donut/core/chunk/chunkFile.h>
+#include <donut/core/log.h>
+#include <donut/core/vfs/VFS.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+using namespace donut;
+
+// reads every byte the loader exposes, so that address sanitizer catches
+// any pointer that escapes the blob
+static uint32_t touch(void const * data, size_t size)
+{
+    uint32_t sum = 0;
+    for (size_t i = 0; i < size; ++i)
+        sum += reinterpret_cast<uint8_t const *>(data)[i];
+    return sum;
+}
+
+static uint32_t touchString(char const * str)
+{
+    return str ? touch(str, strlen(str)) : 0;
+}
+
+static uint32_t touchMeshSet(chunk::MeshSetBase const & mset)
+{
+    uint32_t sum = touchString(mset.name);
+
+    sum += touch(mset.streams.position, mset.streams.position ? mset.nverts * sizeof(math::float3) : 0);
+    sum += touch(mset.streams.texcoord0, mset.streams.texcoord0 ? mset.nverts * sizeof(math::float2) : 0);
+    sum += touch(mset.streams.texcoord1, mset.streams.texcoord1 ? mset.nverts * sizeof(math::float2) : 0);
+    sum += touch(mset.streams.normal, mset.streams.normal ? mset.nverts * sizeof(uint32_t) : 0);
+    sum += touch(mset.streams.tangent, mset.streams.tangent ? mset.nverts * sizeof(uint32_t) : 0);
+    sum += touch(mset.streams.bitangent, mset.streams.bitangent ? mset.nverts * sizeof(uint32_t) : 0);
+
+    for (uint32_t i = 0; i < mset.ninstances; ++i)
+        sum += touchString(mset.instances[i].name) + mset.instances[i].minfoId;
+
+    for (uint32_t i = 0; i < mset.nnodes; ++i)
+        sum += touchString(mset.nodes[i].name) + mset.nodes[i].parentId;
+
+    if (mset.type == chunk::MeshSetBase::MESH)
+    {
+        auto const & set = static_cast<chunk::MeshSet const &>(mset);
+        sum += touch(set.indices, set.nindices * sizeof(uint32_t));
+        for (uint32_t i = 0; i < set.nmeshInfos; ++i)
+            sum += touchString(set.meshInfos[i].name) + touchString(set.meshInfos[i].materialName);
+    }
+    else if (mset.type == chunk::MeshSetBase::MESHLET)
+    {
+        auto const & set = static_cast<chunk::MeshletSet const &>(mset);
+        sum += touch(set.indices32, set.nindices32 * sizeof(uint32_t));
+        sum += touch(set.indices8, set.nindices8);
+        sum += touch(set.meshlets, size_t(set.nmeshlets) * set.meshletSize * sizeof(uint32_t));
+        for (uint32_t i = 0; i < set.nmeshInfos; ++i)
+            sum += touchString(set.meshInfos[i].name) + touchString(set.meshInfos[i].materialName);
+    }
+    return sum;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const * data, size_t size)
+{
+    static bool const init = []() { log::SetMinSeverity(log::Severity::Fatal); return true; }();
+    (void)init;
+
+    void * copy = malloc(size ? size : 1);
+    if (size)
+        memcpy(copy, data, size);
+    auto blob = std::make_shared<vfs::Blob const>(copy, size);
+
+    volatile uint32_t sum = 0;
+
+    if (auto cfile = chunk::ChunkFile::deserialize(blob, "fuzz"))
+    {
+        for (auto const & c : cfile->getChunks())
+            sum += touch(c->data, c->size);
+    }
+
+    if (auto mset = chunk::deserialize(blob, "fuzz"))
+        sum += touchMeshSet(*mset);
+
+    return 0;
+}
+
+#ifndef DONUT_LIBFUZZER
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::ifstream file(argv[i], std::ios::binary);
+        if (!file)
+        {
+            fprintf(stderr, "cannot open '%s'\n", argv[i]);
+            return 1;
+        }
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        LLVMFuzzerTestOneInput(data.data(), data.size());
+        printf("%s : ok\n", argv[i]);
+    }
+    return 0;
+}
+
+#endif
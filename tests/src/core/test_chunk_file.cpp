@@ -0,0 +1,544 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/core/chunk/chunk.h>
+#include <donut/core/chunk/chunkFile.h>
+#include <donut/core/log.h>
+#include <donut/core/vfs/VFS.h>
+
+#include <donut/tests/utils.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace donut;
+using namespace donut::math;
+
+// test geometry : a quad split into 2 mesh infos, 2 instances & 3 nodes
+struct TestGeometry
+{
+	std::vector<float3> positions = { {0,0,0}, {1,0,0}, {1,1,0}, {0,1,0} };
+	std::vector<float2> texcoords = { {0,0}, {1,0}, {1,1}, {0,1} };
+	std::vector<uint32_t> normals = { 1, 2, 3, 4 };
+	std::vector<uint32_t> indices = { 0, 1, 2, 0, 2, 3 };
+
+	std::vector<chunk::MeshInfo> meshInfos;
+	std::vector<chunk::MeshletInfo> meshletInfos;
+	std::vector<chunk::MeshInstance> instances;
+	std::vector<chunk::MeshNode> nodes;
+
+	std::vector<uint8_t> indices8 = { 0, 1, 2, 0, 2, 3 };
+	std::vector<uint32_t> meshlets = { 0, 4, 0, 2, 0, 0, 0, 0 };
+
+	TestGeometry()
+	{
+		meshInfos.resize(2);
+		memset(meshInfos.data(), 0, meshInfos.size() * sizeof(chunk::MeshInfo));
+		meshInfos[0].name = "first";
+		meshInfos[0].materialName = "red";
+		meshInfos[0].numVertices = 4;
+		meshInfos[0].numIndices = 3;
+		meshInfos[1].name = "second";
+		meshInfos[1].materialName = "red";
+		meshInfos[1].numVertices = 4;
+		meshInfos[1].firstIndex = 3;
+		meshInfos[1].numIndices = 3;
+
+		meshletInfos.resize(1);
+		memset(meshletInfos.data(), 0, meshletInfos.size() * sizeof(chunk::MeshletInfo));
+		meshletInfos[0].name = "meshlets";
+		meshletInfos[0].numMeshlets = 2;
+
+		instances.resize(2);
+		memset(instances.data(), 0, instances.size() * sizeof(chunk::MeshInstance));
+		instances[0].name = "instance0";
+		instances[0].minfoId = 0;
+		instances[0].nodeId = 1;
+		instances[1].name = nullptr;
+		instances[1].minfoId = 1;
+		instances[1].nodeId = 2;
+		instances[1].transform = affine3::identity();
+
+		nodes.resize(3);
+		memset(nodes.data(), 0, nodes.size() * sizeof(chunk::MeshNode));
+		nodes[0] = { "root", ~0u, ~0u, ~0u };
+		nodes[1] = { "child0", 0, 2, 0 };
+		nodes[2] = { "child1", 0, ~0u, 1 };
+	}
+
+	void fill(chunk::MeshSetBase & set)
+	{
+		set.name = "quad";
+		set.streams.position = positions.data();
+		set.streams.texcoord0 = texcoords.data();
+		set.streams.normal = normals.data();
+		set.nverts = uint32_t(positions.size());
+		set.instances = instances.data();
+		set.ninstances = uint32_t(instances.size());
+		set.nodes = nodes.data();
+		set.nnodes = uint32_t(nodes.size());
+		set.rootId = 0;
+		set.bbox = box3(float3(0.f), float3(1.f, 1.f, 0.f));
+	}
+
+	chunk::MeshSet makeMeshSet()
+	{
+		chunk::MeshSet set;
+		set.type = chunk::MeshSetBase::MESH;
+		fill(set);
+		set.indices = indices.data();
+		set.nindices = uint32_t(indices.size());
+		set.meshInfos = meshInfos.data();
+		set.nmeshInfos = uint32_t(meshInfos.size());
+		return set;
+	}
+
+	chunk::MeshletSet makeMeshletSet()
+	{
+		chunk::MeshletSet set;
+		set.type = chunk::MeshSetBase::MESHLET;
+		fill(set);
+		for (auto & instance : instances)
+			instance.minfoId = 0;
+		set.maxVerts = 64;
+		set.maxPrims = 126;
+		set.indices32 = indices.data();
+		set.nindices32 = uint32_t(indices.size());
+		set.indices8 = indices8.data();
+		set.nindices8 = uint32_t(indices8.size());
+		set.meshlets = meshlets.data();
+		set.nmeshlets = 2;
+		set.meshletSize = 4;
+		set.meshInfos = meshletInfos.data();
+		set.nmeshInfos = uint32_t(meshletInfos.size());
+		return set;
+	}
+};
+
+static bool sameString(char const * a, char const * b)
+{
+	if (!a || !b)
+		return a == b;
+	return strcmp(a, b) == 0;
+}
+
+static void checkCommon(chunk::MeshSetBase const & a, chunk::MeshSetBase const & b)
+{
+	CHECK(a.type == b.type);
+	CHECK(sameString(a.name, b.name));
+	CHECK(a.nverts == b.nverts);
+	CHECK(memcmp(a.streams.position, b.streams.position, a.nverts * sizeof(float3)) == 0);
+	CHECK(memcmp(a.streams.texcoord0, b.streams.texcoord0, a.nverts * sizeof(float2)) == 0);
+	CHECK(memcmp(a.streams.normal, b.streams.normal, a.nverts * sizeof(uint32_t)) == 0);
+	CHECK(b.streams.texcoord1 == nullptr && b.streams.tangent == nullptr);
+	CHECK(all(a.bbox.m_mins == b.bbox.m_mins) && all(a.bbox.m_maxs == b.bbox.m_maxs));
+
+	CHECK(a.ninstances == b.ninstances);
+	for (uint32_t i = 0; i < a.ninstances; ++i)
+	{
+		CHECK(sameString(a.instances[i].name, b.instances[i].name));
+		CHECK(a.instances[i].minfoId == b.instances[i].minfoId);
+		CHECK(a.instances[i].nodeId == b.instances[i].nodeId);
+		CHECK(all(a.instances[i].transform.m_translation == b.instances[i].transform.m_translation));
+	}
+
+	CHECK(a.nnodes == b.nnodes && a.rootId == b.rootId);
+	for (uint32_t i = 0; i < a.nnodes; ++i)
+	{
+		CHECK(sameString(a.nodes[i].name, b.nodes[i].name));
+		CHECK(a.nodes[i].parentId == b.nodes[i].parentId);
+		CHECK(a.nodes[i].siblingId == b.nodes[i].siblingId);
+		CHECK(a.nodes[i].instanceId == b.nodes[i].instanceId);
+	}
+}
+
+static std::shared_ptr<vfs::IBlob const> copyBlob(std::vector<uint8_t> const & data)
+{
+	void * copy = malloc(data.empty() ? 1 : data.size());
+	if (!data.empty())
+		memcpy(copy, data.data(), data.size());
+	return std::make_shared<vfs::Blob const>(copy, data.size());
+}
+
+static std::vector<uint8_t> toBytes(vfs::IBlob const & blob)
+{
+	auto data = reinterpret_cast<uint8_t const *>(blob.data());
+	return std::vector<uint8_t>(data, data + blob.size());
+}
+
+// re-packs a chunk file in the legacy 0x100 layout : no checksums, native
+// size_t offsets & chunks packed back to back (so misaligned)
+static std::vector<uint8_t> makeLegacyBlob(chunk::ChunkFile const & cfile)
+{
+	struct Entry { uint32_t chunkId, chunkType, chunkVersion; size_t offset, size; };
+
+	auto const & chunks = cfile.getChunks();
+
+	uint32_t header[3] = { 0x100, uint32_t(chunks.size()), 20 };
+
+	std::vector<uint8_t> result(20 + chunks.size() * sizeof(Entry));
+	memcpy(result.data(), "NVDACHNK", 8);
+	memcpy(result.data() + 8, header, sizeof(header));
+
+	for (size_t i = 0; i < chunks.size(); ++i)
+	{
+		chunk::Chunk const & c = *chunks[i];
+		Entry e = { uint32_t(i + 1), c.chunkType, c.chunkVersion, result.size(), c.size };
+		memcpy(&e.chunkId, &c.chunkId, sizeof(uint32_t));
+		memcpy(result.data() + 20 + i * sizeof(Entry), &e, sizeof(Entry));
+
+		auto data = reinterpret_cast<uint8_t const *>(c.data);
+		result.insert(result.end(), data, data + c.size);
+	}
+	return result;
+}
+
+void test_mesh_roundtrip()
+{
+	TestGeometry geo;
+	chunk::MeshSet source = geo.makeMeshSet();
+
+	for (bool compress : { false, true })
+	{
+		auto blob = chunk::serialize(source, compress);
+		CHECK(blob);
+
+		// deserialization must not depend on the writer's blob staying alive
+		auto mset = chunk::deserialize(copyBlob(toBytes(*blob)), "roundtrip");
+		CHECK(mset && mset->type == chunk::MeshSetBase::MESH);
+		checkCommon(source, *mset);
+
+		auto const & set = static_cast<chunk::MeshSet const &>(*mset);
+		CHECK(set.nindices == source.nindices);
+		CHECK(memcmp(set.indices, source.indices, source.nindices * sizeof(uint32_t)) == 0);
+		CHECK(set.nmeshInfos == source.nmeshInfos);
+		for (uint32_t i = 0; i < set.nmeshInfos; ++i)
+		{
+			CHECK(sameString(set.meshInfos[i].name, source.meshInfos[i].name));
+			CHECK(sameString(set.meshInfos[i].materialName, source.meshInfos[i].materialName));
+			CHECK(set.meshInfos[i].firstIndex == source.meshInfos[i].firstIndex);
+			CHECK(set.meshInfos[i].numIndices == source.meshInfos[i].numIndices);
+		}
+	}
+
+	// serialization is deterministic
+	auto a = chunk::serialize(source);
+	auto b = chunk::serialize(source);
+	CHECK(a->size() == b->size() && memcmp(a->data(), b->data(), a->size()) == 0);
+}
+
+void test_meshlet_roundtrip()
+{
+	TestGeometry geo;
+	chunk::MeshletSet source = geo.makeMeshletSet();
+
+	auto blob = chunk::serialize(source);
+	CHECK(blob);
+
+	auto mset = chunk::deserialize(blob, "roundtrip");
+	CHECK(mset && mset->type == chunk::MeshSetBase::MESHLET);
+	checkCommon(source, *mset);
+
+	auto const & set = static_cast<chunk::MeshletSet const &>(*mset);
+	CHECK(set.maxVerts == 64 && set.maxPrims == 126);
+	CHECK(set.nindices32 == source.nindices32 && set.nindices8 == source.nindices8);
+	CHECK(memcmp(set.indices8, source.indices8, source.nindices8) == 0);
+	CHECK(set.nmeshlets == 2 && set.meshletSize == 4);
+	CHECK(memcmp(set.meshlets, source.meshlets, 2 * 4 * sizeof(uint32_t)) == 0);
+	CHECK(set.nmeshInfos == 1 && set.meshInfos[0].numMeshlets == 2);
+	CHECK(sameString(set.meshInfos[0].name, "meshlets"));
+}
+
+struct LargeDesc { static constexpr uint32_t chunktype = 0x1000, version = 1; };
+struct SmallDesc { static constexpr uint32_t chunktype = 0x1001, version = 1; };
+
+void test_chunk_alignment_and_compression()
+{
+	// large compressible chunk + small chunk
+	std::vector<uint32_t> large(64 * 1024);
+	for (size_t i = 0; i < large.size(); ++i)
+		large[i] = uint32_t(i / 16);
+	std::vector<uint8_t> small = { 1, 2, 3 };
+
+	chunk::ChunkFile writer;
+	auto largeId = writer.addChunk<LargeDesc>(large.data(), large.size() * sizeof(uint32_t));
+	auto smallId = writer.addChunk<SmallDesc>(small.data(), small.size());
+
+	for (bool compress : { false, true })
+	{
+		auto blob = writer.serialize(compress);
+		CHECK(blob);
+
+#ifdef DONUT_WITH_LZ4
+		if (compress)
+			CHECK(blob->size() < large.size() * sizeof(uint32_t) / 2);
+#endif
+
+		auto cfile = chunk::ChunkFile::deserialize(blob, "aligned");
+		CHECK(cfile && cfile->getChunks().size() == 2);
+
+		auto largeChunk = cfile->getChunk<LargeDesc>(largeId);
+		auto smallChunk = cfile->getChunk<SmallDesc>(smallId);
+		CHECK(largeChunk && smallChunk);
+		CHECK(largeChunk->size == large.size() * sizeof(uint32_t));
+		CHECK(memcmp(largeChunk->data, large.data(), largeChunk->size) == 0);
+		CHECK(smallChunk->size == 3 && memcmp(smallChunk->data, small.data(), 3) == 0);
+
+		for (auto const & c : cfile->getChunks())
+			CHECK((reinterpret_cast<uintptr_t>(c->data) % 16) == 0);
+
+		// uncompressed chunks are served in place from the blob
+		if (!compress)
+		{
+			auto base = reinterpret_cast<uint8_t const *>(blob->data());
+			CHECK(largeChunk->data == base + largeChunk->offset);
+		}
+	}
+}
+
+void test_legacy_format()
+{
+	TestGeometry geo;
+	chunk::MeshSet source = geo.makeMeshSet();
+
+	auto blob = chunk::serialize(source, false);
+	auto cfile = chunk::ChunkFile::deserialize(blob, "legacy");
+	CHECK(cfile);
+
+	auto legacy = makeLegacyBlob(*cfile);
+
+	// chunks in the legacy layout are misaligned : they must be copied
+	auto legacyFile = chunk::ChunkFile::deserialize(copyBlob(legacy), "legacy");
+	CHECK(legacyFile && legacyFile->getChunks().size() == cfile->getChunks().size());
+	for (auto const & c : legacyFile->getChunks())
+		CHECK((reinterpret_cast<uintptr_t>(c->data) % 16) == 0);
+
+	auto mset = chunk::deserialize(copyBlob(legacy), "legacy");
+	CHECK(mset);
+	checkCommon(source, *mset);
+
+	// the legacy loader used to accept an invalid signature
+	legacy[0] = 'X';
+	CHECK(!chunk::ChunkFile::deserialize(copyBlob(legacy), "legacy"));
+	legacy[0] = 'N';
+
+	// ... and to overflow on offset + size
+	size_t hugeSize = ~size_t(0) - 8;
+	memcpy(legacy.data() + 20 + 24, &hugeSize, sizeof(size_t));
+	CHECK(!chunk::ChunkFile::deserialize(copyBlob(legacy), "legacy"));
+}
+
+void test_corruption()
+{
+	TestGeometry geo;
+	chunk::MeshSet source = geo.makeMeshSet();
+
+	auto bytes = toBytes(*chunk::serialize(source));
+	CHECK(chunk::deserialize(copyBlob(bytes), "corrupt"));
+
+	auto corrupt = [&](size_t offset)
+	{
+		auto copy = bytes;
+		copy[offset] ^= 0x40;
+		return chunk::ChunkFile::deserialize(copyBlob(copy), "corrupt") == nullptr;
+	};
+
+	CHECK(corrupt(0));                 // signature
+	CHECK(corrupt(8));                 // version
+	CHECK(corrupt(20));                // table checksum
+	CHECK(corrupt(32));                // table
+
+	// Chunk::size is the decompressed size : the stored size of LZ4 chunks is read
+	// from the chunk table (48-byte entries, offset and stored size at 16 and 24)
+	uint32_t chunkCount = 0, tableOffset = 0;
+	memcpy(&chunkCount, bytes.data() + 12, sizeof(uint32_t));
+	memcpy(&tableOffset, bytes.data() + 16, sizeof(uint32_t));
+	CHECK(chunkCount > 0 && tableOffset + chunkCount * 48 <= bytes.size());
+
+	size_t lastChunkEnd = 0;
+	for (uint32_t i = 0; i < chunkCount; ++i)
+	{
+		uint64_t offset = 0, storedSize = 0;
+		memcpy(&offset, bytes.data() + tableOffset + i * 48 + 16, sizeof(uint64_t));
+		memcpy(&storedSize, bytes.data() + tableOffset + i * 48 + 24, sizeof(uint64_t));
+		CHECK(storedSize > 0 && offset + storedSize <= bytes.size());
+
+		CHECK(corrupt(size_t(offset + storedSize - 1))); // chunk data
+		lastChunkEnd = std::max(lastChunkEnd, size_t(offset + storedSize));
+	}
+
+	// the blob ends with padding : cut into the last chunk
+
+	for (size_t size : { size_t(0), size_t(19), size_t(31), bytes.size() / 2, lastChunkEnd - 1 })
+	{
+		std::vector<uint8_t> truncated(bytes.begin(), bytes.begin() + size);
+		CHECK(!chunk::ChunkFile::deserialize(copyBlob(truncated), "truncated"));
+	}
+}
+
+static uint32_t touchMeshSet(chunk::MeshSetBase const & mset)
+{
+	uint32_t sum = 0;
+	auto touch = [&](void const * data, size_t size) {
+		for (size_t i = 0; i < size; ++i)
+			sum += reinterpret_cast<uint8_t const *>(data)[i];
+	};
+	auto touchString = [&](char const * str) { if (str) touch(str, strlen(str)); };
+
+	touchString(mset.name);
+	touch(mset.streams.position, mset.nverts * sizeof(float3));
+	if (mset.streams.texcoord0)
+		touch(mset.streams.texcoord0, mset.nverts * sizeof(float2));
+	for (uint32_t i = 0; i < mset.ninstances; ++i)
+		touchString(mset.instances[i].name);
+	for (uint32_t i = 0; i < mset.nnodes; ++i)
+		touchString(mset.nodes[i].name);
+
+	if (mset.type == chunk::MeshSetBase::MESH)
+	{
+		auto const & set = static_cast<chunk::MeshSet const &>(mset);
+		for (uint32_t i = 0; i < set.nindices; ++i)
+			touch(&mset.streams.position[set.indices[i]], sizeof(float3));
+		for (uint32_t i = 0; i < set.nmeshInfos; ++i)
+		{
+			touchString(set.meshInfos[i].name);
+			touch(set.indices + set.meshInfos[i].firstIndex, set.meshInfos[i].numIndices * sizeof(uint32_t));
+		}
+	}
+	return sum;
+}
+
+// standalone version of the fuzz harness (see fuzz_chunk_file.cpp) :
+// random mutations of valid files must be rejected or load consistently
+void test_fuzz_mutations()
+{
+	TestGeometry geo;
+	chunk::MeshSet source = geo.makeMeshSet();
+
+	auto current = toBytes(*chunk::serialize(source));
+
+	auto cfile = chunk::ChunkFile::deserialize(copyBlob(current), "fuzz");
+	auto legacy = makeLegacyBlob(*cfile);
+
+	log::SetMinSeverity(log::Severity::Fatal);
+
+	std::mt19937 rng(0x5eed);
+
+	int loaded = 0;
+	for (int iteration = 0; iteration < 4000; ++iteration)
+	{
+		// legacy files have no checksums, so mutations reach the mesh set reader
+		auto data = (iteration & 1) ? legacy : current;
+
+		int mutations = 1 + int(rng() % 4);
+		for (int m = 0; m < mutations; ++m)
+		{
+			size_t offset = rng() % data.size();
+			switch (rng() % 5)
+			{
+				case 0: data[offset] ^= uint8_t(1u << (rng() % 8)); break;
+				case 1: data[offset] = uint8_t(rng()); break;
+				case 2: {
+					uint32_t value = (rng() & 1) ? ~0u : rng() % 64;
+					if (offset + sizeof(value) <= data.size())
+						memcpy(data.data() + offset, &value, sizeof(value));
+				} break;
+				case 3: data.resize(offset); break;
+				case 4: data.insert(data.begin() + offset, uint8_t(rng())); break;
+			}
+			if (data.empty())
+				break;
+		}
+
+		if (auto mset = chunk::deserialize(copyBlob(data), "fuzz"))
+		{
+			touchMeshSet(*mset);
+			++loaded;
+		}
+	}
+
+	log::SetMinSeverity(log::Severity::Info);
+
+	// some mutations hit padding or payload bytes of legacy files
+	CHECK(loaded > 0);
+}
+
+void benchmark_chunk_file()
+{
+	// ~16 MB of vertex-like data in 64 chunks
+	constexpr size_t chunkCount = 64;
+	constexpr size_t chunkSize = 256 * 1024;
+
+	std::vector<std::vector<float>> chunks(chunkCount);
+	std::mt19937 rng(1);
+	for (auto & c : chunks)
+	{
+		c.resize(chunkSize / sizeof(float));
+		for (size_t i = 0; i < c.size(); ++i)
+			c[i] = float(int(i / 3) % 1024) * 0.25f + float(rng() % 4);
+	}
+
+	chunk::ChunkFile writer;
+	for (auto const & c : chunks)
+		writer.addChunk<LargeDesc>(c.data(), chunkSize);
+
+	for (bool compress : { false, true })
+	{
+		auto t0 = std::chrono::high_resolution_clock::now();
+		auto blob = writer.serialize(compress);
+		auto t1 = std::chrono::high_resolution_clock::now();
+		auto cfile = chunk::ChunkFile::deserialize(blob, "bench");
+		auto t2 = std::chrono::high_resolution_clock::now();
+
+		CHECK(cfile && cfile->getChunks().size() == chunkCount);
+
+		printf("chunk file (%s) : %.1f MB -> %.1f MB, write %.2f ms, read %.2f ms\n",
+			compress ? "lz4" : "raw",
+			double(chunkCount * chunkSize) / (1024.0 * 1024.0),
+			double(blob->size()) / (1024.0 * 1024.0),
+			std::chrono::duration<double, std::milli>(t1 - t0).count(),
+			std::chrono::duration<double, std::milli>(t2 - t1).count());
+	}
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_mesh_roundtrip();
+		test_meshlet_roundtrip();
+		test_chunk_alignment_and_compression();
+		test_legacy_format();
+		test_corruption();
+		test_fuzz_mutations();
+		benchmark_chunk_file();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
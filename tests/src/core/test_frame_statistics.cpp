@@ -0,0 +1,132 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/core/frame_statistics.h>
+
+#include <donut/tests/utils.h>
+
+#include <cmath>
+#include <sstream>
+
+using namespace donut;
+
+static bool nearlyEqual(double a, double b)
+{
+	return std::abs(a - b) < 1e-6;
+}
+
+void test_percentiles()
+{
+	std::vector<double> values;
+	for (int i = 1; i <= 101; ++i)
+		values.push_back(double(i));
+
+	CHECK(nearlyEqual(profiler::FrameStatistics::Percentile(values, 0.0), 1.0));
+	CHECK(nearlyEqual(profiler::FrameStatistics::Percentile(values, 50.0), 51.0));
+	CHECK(nearlyEqual(profiler::FrameStatistics::Percentile(values, 95.0), 96.0));
+	CHECK(nearlyEqual(profiler::FrameStatistics::Percentile(values, 100.0), 101.0));
+
+	// interpolation between samples
+	std::vector<double> pair = { 10.0, 20.0 };
+	CHECK(nearlyEqual(profiler::FrameStatistics::Percentile(pair, 50.0), 15.0));
+	CHECK(nearlyEqual(profiler::FrameStatistics::Percentile(pair, 99.0), 19.9));
+
+	CHECK(profiler::FrameStatistics::Percentile({}, 50.0) == 0.0);
+
+	// unsorted input to Summarize
+	profiler::FrameTimeSummary summary = profiler::FrameStatistics::Summarize({ 4.0, 1.0, 3.0, 2.0 });
+	CHECK(summary.count == 4);
+	CHECK(nearlyEqual(summary.mean, 2.5));
+	CHECK(nearlyEqual(summary.min, 1.0) && nearlyEqual(summary.max, 4.0));
+	CHECK(nearlyEqual(summary.p50, 2.5));
+}
+
+void test_warmup_and_gpu_times()
+{
+	profiler::FrameStatistics stats(3);
+
+	for (uint64_t frame = 0; frame < 3; ++frame)
+	{
+		CHECK(stats.IsWarmingUp());
+		CHECK(!stats.AddFrame(frame, 100.0, 100.0));
+	}
+	CHECK(!stats.IsWarmingUp());
+
+	for (uint64_t frame = 3; frame < 13; ++frame)
+		CHECK(stats.AddFrame(frame, 10.0, 4.0));
+
+	// only some frames get GPU times, and they arrive out of order
+	stats.SetGpuTime(7, 6.0);
+	stats.SetGpuTime(5, 8.0);
+	stats.SetGpuTime(1, 50.0); // warm-up frame, ignored
+	stats.SetGpuTime(99, 50.0); // unknown frame, ignored
+
+	CHECK(stats.GetSamples().size() == 10);
+	CHECK(stats.GetFrameTimeSummary().count == 10);
+	CHECK(nearlyEqual(stats.GetFrameTimeSummary().mean, 10.0));
+	CHECK(nearlyEqual(stats.GetCpuSummary().max, 4.0));
+
+	profiler::FrameTimeSummary gpu = stats.GetGpuSummary();
+	CHECK(gpu.count == 2);
+	CHECK(nearlyEqual(gpu.mean, 7.0));
+	CHECK(nearlyEqual(gpu.min, 6.0) && nearlyEqual(gpu.max, 8.0));
+
+	stats.Reset();
+	CHECK(stats.IsWarmingUp());
+	CHECK(stats.GetSamples().empty());
+}
+
+void test_output_formats()
+{
+	profiler::FrameStatistics stats;
+	stats.AddFrame(0, 16.5, 5.25);
+	stats.AddFrame(1, 17.0, 6.0);
+	stats.SetGpuTime(0, 12.0);
+
+	std::stringstream csv;
+	stats.WriteCsv(csv);
+	CHECK(csv.str() == "frame,frame_ms,cpu_ms,gpu_ms\n0,16.5000,5.2500,12.0000\n1,17.0000,6.0000,\n");
+
+	std::stringstream json;
+	stats.WriteJson(json);
+	std::string text = json.str();
+	CHECK(text.find("\"frame\": { \"count\": 2") != std::string::npos);
+	CHECK(text.find("\"gpu\": { \"count\": 1") != std::string::npos);
+	CHECK(text.find("\"gpu_ms\": 12.0000") != std::string::npos);
+	CHECK(text.find("\"gpu_ms\": null") != std::string::npos);
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_percentiles();
+		test_warmup_and_gpu_times();
+		test_output_formats();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,342 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/core/json_stream.h>
+#include <donut/tests/utils.h>
+
+#include <json/value.h>
+
+#include <random>
+#include <string>
+
+using namespace donut;
+
+static bool streamValue(const std::string& text, Json::Value& value, std::string* error = nullptr)
+{
+	json::StreamReader reader(text.data(), text.data() + text.size());
+	bool success = reader.ReadValue(value);
+	if (error)
+		*error = reader.GetError();
+	return success && !reader.HasError();
+}
+
+// Builds the tree with the navigation functions only, without the jsoncpp fallback of ReadValue.
+static bool readTree(json::StreamReader& reader, Json::Value& value)
+{
+	switch (reader.Peek())
+	{
+	case json::TokenType::Object: {
+		value = Json::Value(Json::objectValue);
+		if (!reader.EnterObject())
+			return false;
+		std::string_view key;
+		while (reader.NextMember(key))
+		{
+			if (!readTree(reader, value[std::string(key)]))
+				return false;
+		}
+		return !reader.HasError();
+	}
+
+	case json::TokenType::Array: {
+		value = Json::Value(Json::arrayValue);
+		if (!reader.EnterArray())
+			return false;
+		while (reader.NextElement())
+		{
+			if (!readTree(reader, value.append(Json::Value())))
+				return false;
+		}
+		return !reader.HasError();
+	}
+
+	default:
+		return reader.ReadScalar(value);
+	}
+}
+
+static bool streamTree(const std::string& text, Json::Value& value)
+{
+	json::StreamReader reader(text.data(), text.data() + text.size());
+	return readTree(reader, value) && !reader.HasError();
+}
+
+static bool domValue(const std::string& text, Json::Value& value)
+{
+	return json::Parse(text.data(), text.data() + text.size(), value);
+}
+
+// Scalars are decoded by the streaming reader itself and must match jsoncpp, type included.
+void test_scalars()
+{
+	const char* documents[] = {
+		"0", "-0", "12", "-12", "2147483647", "2147483648", "-2147483649",
+		"9223372036854775807", "9223372036854775808", "-9223372036854775808", "-9223372036854775809",
+		"18446744073709551615", "18446744073709551616", "1.5", "-0.25", "1e3", "-2.5E-3", "1.0", "1e-400", "-", "1.", "-.5", "1.e2", "007",
+		"true", "false", "null",
+		"\"\"", "\"plain\"", "\"a\\nb\\tc\\\\d\\/e\\\"f\"", "\"\\u00e9\\u4e2d\"", "\"\\ud83d\\ude00\"",
+		" \t\r\n 42 ", "// comment\n7", "/* block */ \"x\"", "\xEF\xBB\xBF" "3"
+	};
+
+	for (const char* document : documents)
+	{
+		Json::Value expected, actual;
+		CHECK(domValue(document, expected));
+		CHECK(streamValue(document, actual));
+		CHECK(expected.type() == actual.type());
+		CHECK(expected == actual);
+	}
+}
+
+void test_documents()
+{
+	const char* documents[] = {
+		"{}", "[]", "[[], {}, [[]]]",
+		"{ \"a\": 1, \"b\": [true, false, null], \"c\": { \"d\": \"e\" } }",
+		"{ \"a\": 1, \"a\": 2 }",
+		"[1, 2, 3,]",
+		"{ \"a\": [1, 2,], \"b\": {\"c\": 1,}, }",
+		"// leading\n{ /* inside */ \"a\" : // after colon\n 1 /* after value */, \"b\": 2 }",
+		"{ \"k\\u00e9y\": \"v\\u00e0lue\", \"\": 0 }"
+	};
+
+	for (const char* document : documents)
+	{
+		Json::Value expected, actual, tree;
+		CHECK(domValue(document, expected));
+		CHECK(streamValue(document, actual));
+		CHECK(streamTree(document, tree));
+		CHECK(expected == actual);
+		CHECK(expected == tree);
+	}
+}
+
+void test_navigation()
+{
+	std::string text = "{ \"name\": \"x\", \"list\": [1, [2], {\"a\": 3}], \"unknown\": { \"deep\": [[[]]] }, \"count\": 4 }";
+	json::StreamReader reader(text.data(), text.data() + text.size());
+
+	enum { Name, List, Count };
+	json::KeyTable keys = { "name", "list", "count" };
+	CHECK(keys.Find("list") == List);
+	CHECK(keys.Find("lis") == json::KeyTable::Unknown);
+
+	CHECK(reader.Peek() == json::TokenType::Object);
+	CHECK(reader.EnterObject());
+
+	int seen = 0;
+	int key;
+	while (reader.NextMember(keys, key))
+	{
+		Json::Value value;
+		switch (key)
+		{
+		case Name:
+			CHECK(reader.ReadScalar(value));
+			CHECK(value.asString() == "x");
+			seen |= 1;
+			break;
+
+		case List: {
+			CHECK(reader.Peek() == json::TokenType::Array);
+			auto position = reader.Save();
+
+			// containers read as scalars are skipped and reported by type
+			CHECK(reader.EnterArray());
+			int index = 0;
+			while (reader.NextElement())
+			{
+				CHECK(reader.ReadScalar(value));
+				if (index == 0) CHECK(value.asInt() == 1);
+				if (index == 1) CHECK(value.isArray() && value.empty());
+				if (index == 2) CHECK(value.isObject() && value.empty());
+				++index;
+			}
+			CHECK(index == 3);
+
+			// the same value again, as a document
+			reader.Restore(position);
+			CHECK(reader.ReadValue(value));
+			CHECK(value.size() == 3 && value[2]["a"].asInt() == 3);
+			seen |= 2;
+			break;
+		}
+
+		case Count:
+			CHECK(reader.ReadScalar(value));
+			CHECK(value.isInt() && value.asInt() == 4);
+			seen |= 4;
+			break;
+
+		default: {
+			const char* begin;
+			const char* end;
+			CHECK(reader.SkipSpan(begin, end));
+			CHECK(std::string(begin, end) == "{ \"deep\": [[[]]] }");
+			seen |= 8;
+			break;
+		}
+		}
+	}
+
+	CHECK(!reader.HasError());
+	CHECK(seen == 15);
+	CHECK(reader.Peek() == json::TokenType::Invalid);
+}
+
+void test_errors()
+{
+	const char* documents[] = {
+		"", "{", "[1 2]", "{\"a\" 1}", "{\"a\": }", "{a: 1}", "[1,,2]", "{\"a\" /* comment */ : 1}", "\"unterminated", "/* open",
+		"tru", "nul", "1e", "-e5", "-.", "1e+", "1e400", "[-1e400]", "{\"a\": 1e999}", "[1, 2", "{\"a\": 1", "\"bad \\x escape\"", "\"\\u12\""
+	};
+
+	for (const char* document : documents)
+	{
+		Json::Value expected, actual;
+		std::string error;
+		CHECK(!domValue(document, expected));
+		CHECK(!streamValue(document, actual, &error));
+		CHECK(!streamTree(document, actual));
+		CHECK(error.compare(0, 5, "Line ") == 0);
+	}
+
+	// position of the error
+	std::string error;
+	Json::Value value;
+	CHECK(!streamValue("{\n  \"a\": 1,\n  \"b\" 2\n}", value, &error));
+	CHECK(error.compare(0, 7, "Line 3,") == 0);
+
+	// depth limit
+	std::string deep(1001, '[');
+	deep += std::string(1001, ']');
+	CHECK(!streamValue(deep, value, &error));
+	std::string shallow(999, '[');
+	shallow += std::string(999, ']');
+	CHECK(streamValue(shallow, value));
+}
+
+static void writeRandomValue(std::mt19937& rng, std::string& out, int depth)
+{
+	auto pad = [&]()
+	{
+		switch (rng() % 8)
+		{
+		case 0: out += " "; break;
+		case 1: out += "\n\t"; break;
+		case 2: out += "/* c */"; break;
+		case 3: out += "// line\n"; break;
+		default: break;
+		}
+	};
+
+	pad();
+	int kind = depth > 4 ? int(rng() % 5) : int(rng() % 7);
+	switch (kind)
+	{
+	case 0: out += (rng() & 1) ? "true" : "false"; break;
+	case 1: out += "null"; break;
+	case 2: {
+		static const char* numbers[] = { "0", "-1", "17", "3.25", "-1e-5", "4294967296", "1.5E+2", "-9223372036854775808" };
+		out += numbers[rng() % 8];
+		break;
+	}
+	case 3:
+	case 4: {
+		static const char* strings[] = { "\"\"", "\"abc\"", "\"a\\\"b\"", "\"\\u0041\\u00df\"", "\"tab\\t\"" };
+		out += strings[rng() % 5];
+		break;
+	}
+	case 5: {
+		out += "[";
+		int count = int(rng() % 5);
+		for (int i = 0; i < count; i++)
+		{
+			if (i) out += ",";
+			writeRandomValue(rng, out, depth + 1);
+		}
+		if (count && (rng() % 4) == 0) out += ",";
+		out += "]";
+		break;
+	}
+	default: {
+		out += "{";
+		int count = int(rng() % 5);
+		for (int i = 0; i < count; i++)
+		{
+			if (i) out += ",";
+			pad();
+			out += "\"k" + std::to_string(rng() % 6) + "\"";
+			pad();
+			out += ":";
+			writeRandomValue(rng, out, depth + 1);
+		}
+		if (count && (rng() % 4) == 0) out += ",";
+		out += "}";
+		break;
+	}
+	}
+	pad();
+}
+
+void test_random_documents()
+{
+	std::mt19937 rng(1234);
+	for (int iteration = 0; iteration < 2000; iteration++)
+	{
+		std::string text;
+		writeRandomValue(rng, text, 0);
+
+		Json::Value expected, actual;
+		bool domSuccess = domValue(text, expected);
+		bool streamSuccess = streamTree(text, actual);
+		CHECK(domSuccess == streamSuccess);
+		if (domSuccess)
+			CHECK(expected == actual);
+
+		// truncated documents fail or succeed in both readers
+		std::string truncated = text.substr(0, rng() % (text.size() + 1));
+		domSuccess = domValue(truncated, expected);
+		streamSuccess = streamTree(truncated, actual);
+		CHECK(domSuccess == streamSuccess);
+		if (domSuccess)
+			CHECK(expected == actual);
+	}
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_scalars();
+		test_documents();
+		test_navigation();
+		test_errors();
+		test_random_documents();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
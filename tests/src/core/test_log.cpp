@@ -0,0 +1,489 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/core/log.h>
+#include <donut/core/log_sinks.h>
+
+#include <donut/tests/utils.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+using namespace donut;
+
+// Lets the test hold up the logging thread inside a sink.
+class GateSink : public log::ISink
+{
+public:
+	std::mutex mutex;
+	std::condition_variable cv;
+	bool open = true;
+	std::vector<log::Record> records;
+
+	void Write(const log::Record& record) override
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		cv.wait(lock, [this]() { return open; });
+		records.push_back(record);
+	}
+
+	void SetOpen(bool value)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			open = value;
+		}
+		cv.notify_all();
+	}
+};
+
+static log::AsyncDesc makeDesc(std::shared_ptr<log::ISink> sink)
+{
+	log::AsyncDesc desc;
+	desc.sinks.push_back(sink);
+	desc.rateLimitWindowMs = 0;
+	return desc;
+}
+
+void test_sync_callback()
+{
+	std::vector<std::string> messages;
+	auto saved = log::GetCallback();
+	log::SetCallback([&messages](log::Severity, const char* text) { messages.push_back(text); });
+
+	CHECK(!log::IsAsync());
+	log::info("hello %d", 42);
+	log::debug("filtered out");
+	CHECK(messages.size() == 1 && messages[0] == "hello 42");
+
+	log::SetCallback(saved);
+}
+
+void test_async_multithreaded()
+{
+	constexpr int numThreads = 8;
+	constexpr int messagesPerThread = 500;
+
+	auto sink = std::make_shared<log::MemorySink>(numThreads * messagesPerThread + 1);
+	log::AsyncDesc desc = makeDesc(sink);
+	desc.overflowPolicy = log::OverflowPolicy::Block;
+	desc.threadRingCapacity = 64;
+	log::StartAsync(desc);
+	CHECK(log::IsAsync());
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < numThreads; ++t)
+	{
+		threads.emplace_back([t]() {
+			for (int i = 0; i < messagesPerThread; ++i)
+				log::warning("thread %d message %d", t, i);
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+
+	// longer than the inline storage of a ring slot
+	std::string longMessage(1000, 'x');
+	log::warning("%s", longMessage.c_str());
+
+	log::Flush();
+
+	uint64_t count = 0;
+	auto records = sink->GetRecords(count);
+	CHECK(count == numThreads * messagesPerThread + 1);
+	CHECK(records.size() == count);
+	CHECK(records.back().text == longMessage);
+
+	// per-thread order is preserved, every thread has its own id
+	std::vector<int> nextIndex(numThreads, 0);
+	std::vector<uint32_t> threadIds(numThreads, 0);
+	std::vector<uint64_t> lastTimestamps(numThreads, 0);
+	for (size_t i = 0; i + 1 < records.size(); ++i)
+	{
+		const auto& record = records[i];
+		int t = -1, index = -1;
+		sscanf(record.text.c_str(), "thread %d message %d", &t, &index);
+		CHECK(t >= 0 && t < numThreads);
+		CHECK(index == nextIndex[t]);
+		nextIndex[t]++;
+		if (threadIds[t] == 0)
+			threadIds[t] = record.threadId;
+		CHECK(threadIds[t] == record.threadId);
+		CHECK(record.severity == log::Severity::Warning);
+		CHECK(record.timestampUs >= lastTimestamps[t]);
+		lastTimestamps[t] = record.timestampUs;
+	}
+	std::sort(threadIds.begin(), threadIds.end());
+	CHECK(std::unique(threadIds.begin(), threadIds.end()) == threadIds.end());
+
+	char line[256];
+	size_t length = log::FormatRecord(records[0], line, sizeof(line));
+	CHECK(length == strlen(line));
+	CHECK(strstr(line, "WARNING: thread ") != nullptr);
+
+	log::StopAsync();
+	CHECK(!log::IsAsync());
+}
+
+void test_async_drop_policy()
+{
+	auto sink = std::make_shared<GateSink>();
+	log::AsyncDesc desc = makeDesc(sink);
+	desc.threadRingCapacity = 16;
+	log::StartAsync(desc);
+
+	uint64_t droppedBefore = log::GetDroppedMessageCount();
+	sink->SetOpen(false);
+
+	constexpr int total = 200;
+	for (int i = 0; i < total; ++i)
+		log::warning("message %d", i);
+
+	sink->SetOpen(true);
+	log::Flush();
+
+	uint64_t dropped = log::GetDroppedMessageCount() - droppedBefore;
+	CHECK(dropped > 0);
+	CHECK(sink->records.size() + dropped == total);
+	CHECK(sink->records.front().text == "message 0");
+
+	log::StopAsync();
+}
+
+void test_async_block_policy()
+{
+	auto sink = std::make_shared<GateSink>();
+	log::AsyncDesc desc = makeDesc(sink);
+	desc.threadRingCapacity = 4;
+	desc.overflowPolicy = log::OverflowPolicy::Block;
+	log::StartAsync(desc);
+
+	uint64_t droppedBefore = log::GetDroppedMessageCount();
+	sink->SetOpen(false);
+
+	constexpr int total = 100;
+	std::atomic<int> logged = 0;
+	std::thread producer([&logged]() {
+		for (int i = 0; i < total; ++i)
+		{
+			log::warning("message %d", i);
+			logged++;
+		}
+	});
+
+	// the producer has to stall on the full ring while the sink is closed
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	CHECK(logged < total);
+
+	sink->SetOpen(true);
+	producer.join();
+	log::Flush();
+
+	CHECK(log::GetDroppedMessageCount() == droppedBefore);
+	CHECK(sink->records.size() == total);
+	for (int i = 0; i < total; ++i)
+	{
+		CHECK(sink->records[i].text == "message " + std::to_string(i));
+	}
+
+	log::StopAsync();
+}
+
+void test_async_rate_limit()
+{
+	auto sink = std::make_shared<log::MemorySink>();
+	log::AsyncDesc desc = makeDesc(sink);
+	desc.rateLimitWindowMs = 200;
+	desc.rateLimitMaxRepeats = 3;
+	log::StartAsync(desc);
+
+	for (int i = 0; i < 10; ++i)
+		log::warning("spam");
+	log::warning("different");
+	log::Flush();
+
+	uint64_t count = 0;
+	auto records = sink->GetRecords(count);
+	CHECK(records.size() == 4);
+	CHECK(records[3].text == "different");
+
+	// the next repeat after the window reports how many were suppressed
+	std::this_thread::sleep_for(std::chrono::milliseconds(250));
+	log::warning("spam");
+	log::Flush();
+
+	records = sink->GetRecords(count);
+	CHECK(records.size() == 1);
+	CHECK(records[0].text == "spam" && records[0].suppressedRepeats == 7);
+
+	char line[256];
+	log::FormatRecord(records[0], line, sizeof(line));
+	CHECK(strstr(line, "7 identical messages suppressed") != nullptr);
+
+	log::StopAsync();
+}
+
+void test_async_callback()
+{
+	std::mutex mutex;
+	std::vector<std::string> messages;
+	auto saved = log::GetCallback();
+	log::SetCallback([&](log::Severity, const char* text) {
+		std::lock_guard<std::mutex> lock(mutex);
+		messages.push_back(text);
+	});
+
+	log::AsyncDesc desc;
+	log::StartAsync(desc);
+	log::info("async %d", 1);
+	log::error("async %d", 2);
+	log::Flush();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		CHECK(messages.size() == 2 && messages[0] == "async 1" && messages[1] == "async 2");
+	}
+
+	log::StopAsync();
+	log::SetCallback(saved);
+}
+
+void test_async_fatal_not_dropped()
+{
+	// a custom callback, so that the fatal message doesn't abort the test
+	auto saved = log::GetCallback();
+	log::SetCallback([](log::Severity, const char*) { });
+
+	auto sink = std::make_shared<GateSink>();
+	log::AsyncDesc desc = makeDesc(sink);
+	desc.threadRingCapacity = 4;
+	log::StartAsync(desc);
+
+	uint64_t droppedBefore = log::GetDroppedMessageCount();
+	sink->SetOpen(false);
+
+	for (int i = 0; i < 20; ++i)
+		log::warning("message %d", i);
+	CHECK(log::GetDroppedMessageCount() > droppedBefore);
+
+	// the ring is full, the fatal message has to wait for room instead of being dropped
+	std::thread opener([&sink]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		sink->SetOpen(true);
+	});
+	uint64_t droppedBeforeFatal = log::GetDroppedMessageCount();
+	log::fatal("fatal %d", 1);
+	opener.join();
+
+	// and it has been written out by the time log::fatal returns
+	CHECK(log::GetDroppedMessageCount() == droppedBeforeFatal);
+	CHECK(!sink->records.empty() && sink->records.back().text == "fatal 1");
+	CHECK(sink->records.back().severity == log::Severity::Fatal);
+
+	log::StopAsync();
+	log::SetCallback(saved);
+}
+
+void test_async_default_callback()
+{
+#ifndef _WIN32
+	// without sinks, the messages still reach the console through the default callback
+	auto path = std::filesystem::temp_directory_path() / "donut_test_log_stderr.txt";
+	fflush(stderr);
+	int savedStderr = dup(fileno(stderr));
+	FILE* file = fopen(path.generic_string().c_str(), "w");
+	CHECK(file);
+	dup2(fileno(file), fileno(stderr));
+
+	log::AsyncDesc desc;
+	log::StartAsync(desc);
+	log::warning("async without sinks %d", 3);
+	log::StopAsync();
+
+	fflush(stderr);
+	dup2(savedStderr, fileno(stderr));
+	close(savedStderr);
+	fclose(file);
+
+	file = fopen(path.generic_string().c_str(), "r");
+	CHECK(file);
+	char line[256];
+	bool found = false;
+	while (fgets(line, sizeof(line), file))
+		found |= strstr(line, "WARNING: async without sinks 3") != nullptr;
+	fclose(file);
+	std::filesystem::remove(path);
+	CHECK(found);
+#endif
+}
+
+void test_rotating_file_sink()
+{
+	auto dir = std::filesystem::temp_directory_path() / "donut_test_log";
+	std::filesystem::remove_all(dir);
+	std::filesystem::create_directories(dir);
+	auto path = dir / "test.log";
+
+	{
+		auto sink = std::make_shared<log::RotatingFileSink>(path, 1024, 3);
+		CHECK(sink->IsOpen());
+
+		log::AsyncDesc desc = makeDesc(sink);
+		log::StartAsync(desc);
+		for (int i = 0; i < 100; ++i)
+			log::warning("line %03d of the rotating file sink test", i);
+		log::StopAsync();
+	}
+
+	CHECK(std::filesystem::exists(path));
+	CHECK(std::filesystem::exists(dir / "test.log.1"));
+	CHECK(std::filesystem::exists(dir / "test.log.2"));
+	CHECK(!std::filesystem::exists(dir / "test.log.3"));
+	CHECK(std::filesystem::file_size(path) <= 1024);
+
+	// the newest message is in the current file
+	FILE* file = fopen(path.generic_string().c_str(), "r");
+	CHECK(file);
+	char line[256];
+	bool found = false;
+	while (fgets(line, sizeof(line), file))
+		found |= strstr(line, "line 099") != nullptr;
+	fclose(file);
+	CHECK(found);
+
+	std::filesystem::remove_all(dir);
+}
+
+class NullSink : public log::ISink
+{
+public:
+	void Write(const log::Record& record) override
+	{
+		char line[4096];
+		size_t length = log::FormatRecord(record, line, sizeof(line));
+		fwrite(line, 1, length, m_File);
+	}
+
+	NullSink() { m_File = fopen("/dev/null", "w"); }
+	~NullSink() override { fclose(m_File); }
+
+private:
+	FILE* m_File;
+};
+
+// Logging latency seen by the calling threads: synchronous callback writing to a file vs. the async backend.
+void benchmark_log()
+{
+#ifndef _WIN32
+	constexpr int numThreads = 8;
+	constexpr int messagesPerThread = 5000;
+
+	auto run = [](const char* name) {
+		std::vector<std::vector<uint32_t>> latencies(numThreads);
+		auto start = std::chrono::steady_clock::now();
+
+		std::vector<std::thread> threads;
+		for (int t = 0; t < numThreads; ++t)
+		{
+			threads.emplace_back([t, &latencies]() {
+				latencies[t].reserve(messagesPerThread);
+				for (int i = 0; i < messagesPerThread; ++i)
+				{
+					auto t0 = std::chrono::steady_clock::now();
+					log::warning("benchmark thread %d message %d value %f", t, i, i * 0.5);
+					auto t1 = std::chrono::steady_clock::now();
+					latencies[t].push_back(uint32_t(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()));
+				}
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+
+		auto end = std::chrono::steady_clock::now();
+
+		std::vector<uint32_t> all;
+		for (const auto& l : latencies)
+			all.insert(all.end(), l.begin(), l.end());
+		std::sort(all.begin(), all.end());
+
+		double seconds = std::chrono::duration<double>(end - start).count();
+		printf("log (%s): %.0f messages/s, latency p50 %.2f us, p99 %.2f us\n", name,
+			double(all.size()) / seconds, all[all.size() / 2] * 1e-3, all[all.size() * 99 / 100] * 1e-3);
+	};
+
+	auto saved = log::GetCallback();
+	{
+		auto sink = std::make_shared<NullSink>();
+		std::mutex mutex;
+		log::SetCallback([&](log::Severity severity, const char* text) {
+			std::lock_guard<std::mutex> lock(mutex);
+			log::Record record;
+			record.severity = severity;
+			record.text = text;
+			sink->Write(record);
+		});
+		run("sync");
+		log::SetCallback(saved);
+	}
+
+	{
+		log::AsyncDesc desc = makeDesc(std::make_shared<NullSink>());
+		desc.overflowPolicy = log::OverflowPolicy::Block;
+		desc.threadRingCapacity = 4096;
+		log::StartAsync(desc);
+		run("async");
+		log::StopAsync();
+	}
+#endif
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_sync_callback();
+		test_async_multithreaded();
+		test_async_drop_policy();
+		test_async_block_policy();
+		test_async_rate_limit();
+		test_async_callback();
+		test_async_fatal_not_dropped();
+		test_async_default_callback();
+		test_rotating_file_sink();
+		benchmark_log();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,231 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/core/profiler.h>
+
+#include <donut/tests/utils.h>
+
+#include <cstring>
+#include <sstream>
+#include <thread>
+
+using namespace donut;
+
+#ifdef DONUT_WITH_PROFILER
+
+static const profiler::ScopeStats* findStats(std::vector<profiler::ScopeStats> const& stats, char const* name, profiler::Track track)
+{
+	for (auto const& s : stats)
+		if (s.name == name && s.track == track)
+			return &s;
+	return nullptr;
+}
+
+static size_t countOccurrences(std::string const& str, std::string const& pattern)
+{
+	size_t count = 0;
+	for (size_t pos = str.find(pattern); pos != std::string::npos; pos = str.find(pattern, pos + 1))
+		++count;
+	return count;
+}
+
+void test_nested_scopes()
+{
+	auto& prof = profiler::Profiler::Get();
+	prof.ResetScopeStats();
+
+	prof.BeginFrame();
+	{
+		DONUT_PROFILE_SCOPE("outer");
+		for (int i = 0; i < 3; ++i)
+		{
+			DONUT_PROFILE_SCOPE("inner");
+		}
+	}
+	prof.EndFrame();
+
+	auto stats = prof.GetScopeStats();
+	auto outer = findStats(stats, "outer", profiler::Track::Cpu);
+	auto inner = findStats(stats, "inner", profiler::Track::Cpu);
+	CHECK(outer && inner);
+	CHECK(outer->depth == 0 && inner->depth == 1);
+	CHECK(outer->callCount == 1 && inner->callCount == 3);
+	CHECK(outer->history.size() == 1 && inner->history.size() == 1);
+	CHECK(outer->lastMs >= inner->lastMs);
+
+	// unbalanced EndScope must be harmless
+	profiler::EndScope();
+
+	prof.BeginFrame();
+	prof.EndFrame();
+
+	stats = prof.GetScopeStats();
+	outer = findStats(stats, "outer", profiler::Track::Cpu);
+	CHECK(outer && outer->history.size() == 1);
+}
+
+void test_multithreaded_scopes()
+{
+	auto& prof = profiler::Profiler::Get();
+	prof.ResetScopeStats();
+
+	constexpr int numThreads = 8;
+	constexpr int scopesPerThread = 1000;
+
+	prof.BeginFrame();
+	{
+		std::vector<std::thread> threads;
+		for (int t = 0; t < numThreads; ++t)
+		{
+			threads.emplace_back([]() {
+				profiler::SetThreadName("worker");
+				for (int i = 0; i < scopesPerThread; ++i)
+				{
+					DONUT_PROFILE_SCOPE("work");
+				}
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+	}
+	prof.EndFrame();
+
+	auto stats = prof.GetScopeStats();
+	auto work = findStats(stats, "work", profiler::Track::Cpu);
+	CHECK(work && work->callCount == numThreads * scopesPerThread);
+	CHECK(prof.GetDroppedEventCount() == 0);
+}
+
+void test_ring_overflow()
+{
+	auto& prof = profiler::Profiler::Get();
+	prof.ResetScopeStats();
+
+	uint64_t droppedBefore = prof.GetDroppedEventCount();
+
+	prof.BeginFrame();
+	std::thread([]() {
+		for (size_t i = 0; i < profiler::c_ThreadRingCapacity + 10; ++i)
+		{
+			DONUT_PROFILE_SCOPE("flood");
+		}
+	}).join();
+	prof.EndFrame();
+
+	auto stats = prof.GetScopeStats();
+	auto flood = findStats(stats, "flood", profiler::Track::Cpu);
+	CHECK(flood && flood->callCount == profiler::c_ThreadRingCapacity);
+	CHECK(prof.GetDroppedEventCount() - droppedBefore == 10);
+}
+
+void test_chrome_trace_export()
+{
+	auto& prof = profiler::Profiler::Get();
+	prof.BeginCapture(2);
+
+	for (int frame = 0; frame < 3; ++frame)
+	{
+		prof.BeginFrame();
+		uint64_t frameIndex = prof.GetFrameIndex();
+		{
+			DONUT_PROFILE_SCOPE("scope \"quoted\"");
+		}
+		prof.EndFrame();
+
+		profiler::Event gpuEvent = {};
+		strcpy(gpuEvent.name, "gpu pass");
+		gpuEvent.beginNs = 0;
+		gpuEvent.endNs = 1000;
+		prof.AddGpuEvents(frameIndex, &gpuEvent, 1);
+	}
+
+	CHECK(!prof.IsCapturing());
+	CHECK(prof.GetCapturedFrameCount() == 2);
+
+	auto stats = prof.GetScopeStats();
+	auto gpu = findStats(stats, "gpu pass", profiler::Track::Gpu);
+	CHECK(gpu && gpu->lastMs > 0.0009 && gpu->lastMs < 0.0011);
+
+	std::stringstream ss;
+	prof.ExportChromeTrace(ss);
+	std::string trace = ss.str();
+
+	CHECK(trace.find("{\"traceEvents\":[") == 0);
+	CHECK(countOccurrences(trace, "\"ph\":\"X\"") == 2 * 3); // frame + cpu + gpu, per captured frame
+	CHECK(countOccurrences(trace, "scope \\\"quoted\\\"") == 2);
+	CHECK(countOccurrences(trace, "\"cat\":\"gpu\"") == 2);
+	CHECK(countOccurrences(trace, "\"worker\"") >= 1);
+
+	prof.ClearCapture();
+	CHECK(prof.GetCapturedFrameCount() == 0);
+}
+
+void benchmark_scope_overhead()
+{
+	auto& prof = profiler::Profiler::Get();
+
+	constexpr int iterations = 1000;
+	constexpr int frames = 100;
+
+	uint64_t recordNs = 0;
+	uint64_t collectNs = 0;
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		prof.BeginFrame();
+		uint64_t t0 = profiler::GetTimestampNs();
+		for (int i = 0; i < iterations; ++i)
+		{
+			DONUT_PROFILE_SCOPE("bench");
+		}
+		uint64_t t1 = profiler::GetTimestampNs();
+		prof.EndFrame();
+		uint64_t t2 = profiler::GetTimestampNs();
+
+		recordNs += t1 - t0;
+		collectNs += t2 - t1;
+	}
+
+	printf("profiler: %.1f ns to record a scope, %.1f ns per scope to collect it\n",
+		double(recordNs) / double(iterations * frames), double(collectNs) / double(iterations * frames));
+}
+
+#endif
+
+int main(int, char** argv)
+{
+	try
+	{
+#ifdef DONUT_WITH_PROFILER
+		test_nested_scopes();
+		test_multithreaded_scopes();
+		test_ring_overflow();
+		test_chrome_trace_export();
+		benchmark_scope_overhead();
+#endif
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,381 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/core/vfs/VFS.h>
+
+#include <donut/tests/utils.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <thread>
+
+using namespace donut;
+
+// Files in memory, with every request recorded
+class MemoryFileSystem : public vfs::IFileSystem
+{
+public:
+	std::map<std::string, std::string> files;
+	std::string lastPath;
+
+	bool folderExists(const std::filesystem::path& name) override
+	{
+		lastPath = name.generic_string();
+		std::string prefix = lastPath.empty() ? "" : lastPath + "/";
+		return std::any_of(files.begin(), files.end(), [&prefix](auto const& file) { return file.first.find(prefix) == 0; });
+	}
+
+	bool fileExists(const std::filesystem::path& name) override
+	{
+		lastPath = name.generic_string();
+		return files.find(lastPath) != files.end();
+	}
+
+	std::shared_ptr<vfs::IBlob> readFile(const std::filesystem::path& name) override
+	{
+		lastPath = name.generic_string();
+		auto it = files.find(lastPath);
+		if (it == files.end())
+			return nullptr;
+
+		void* data = malloc(it->second.size());
+		memcpy(data, it->second.data(), it->second.size());
+		return std::make_shared<vfs::Blob>(data, it->second.size());
+	}
+
+	bool writeFile(const std::filesystem::path& name, const void* data, size_t size) override
+	{
+		lastPath = name.generic_string();
+		files[lastPath] = std::string(static_cast<const char*>(data), size);
+		return true;
+	}
+
+	int enumerateFiles(const std::filesystem::path& path, const std::vector<std::string>& extensions, vfs::enumerate_callback_t callback, bool allowDuplicates) override
+	{
+		lastPath = path.generic_string();
+		std::string prefix = lastPath.empty() ? "" : lastPath + "/";
+		int count = 0;
+		for (auto const& file : files)
+		{
+			if (file.first.find(prefix) == 0 && file.first.find('/', prefix.size()) == std::string::npos)
+			{
+				callback(file.first.substr(prefix.size()));
+				++count;
+			}
+		}
+		return count;
+	}
+
+	int enumerateDirectories(const std::filesystem::path& path, vfs::enumerate_callback_t callback, bool allowDuplicates) override
+	{
+		return vfs::status::NotImplemented;
+	}
+
+	void add(const std::string& name, const std::string& contents)
+	{
+		files[name] = contents;
+	}
+};
+
+// Every file exists, nothing is recorded, safe to use from several threads
+class NullFileSystem : public MemoryFileSystem
+{
+public:
+	bool fileExists(const std::filesystem::path&) override { return true; }
+};
+
+static std::string readString(vfs::IFileSystem& fs, const std::filesystem::path& name)
+{
+	auto blob = fs.readFile(name);
+	if (!blob)
+		return std::string();
+	return std::string(static_cast<const char*>(blob->data()), blob->size());
+}
+
+void test_normalize_path()
+{
+	std::string result;
+	auto normalize = [&result](const char* path) { vfs::normalizePath(path, result); return result; };
+
+	CHECK(normalize("/a/b/c") == "/a/b/c");
+	CHECK(normalize("/a//b/./c/") == "/a/b/c");
+	CHECK(normalize("/a/b/../c") == "/a/c");
+	CHECK(normalize("/a/../../b") == "/b");
+	CHECK(normalize("/..") == "/");
+	CHECK(normalize("/") == "/");
+	CHECK(normalize("") == "");
+	CHECK(normalize("a/./b") == "a/b");
+	CHECK(normalize("../a") == "../a");
+	CHECK(normalize("a/../../b") == "../b");
+	CHECK(normalize("./") == "");
+}
+
+void test_virtual_path()
+{
+	CHECK(vfs::VirtualPath("/a//b/./c/").str() == "/a/b/c");
+	CHECK(vfs::VirtualPath(std::filesystem::path("/a/b/../c")) == vfs::VirtualPath("/a/c"));
+	CHECK(vfs::VirtualPath("./").empty());
+
+	vfs::RootFileSystem rootFS;
+	auto memoryFS = std::make_shared<MemoryFileSystem>();
+	memoryFS->files["a.txt"] = "a";
+	rootFS.mount("/data", memoryFS);
+	rootFS.mount("/datafiles", std::make_shared<MemoryFileSystem>());
+
+	vfs::VirtualPath path("/data/./sub/../a.txt");
+	CHECK(path.str() == "/data/a.txt");
+	CHECK(rootFS.fileExists(path));
+	CHECK(readString(rootFS, path.path()) == "a");
+	CHECK(rootFS.readFile(path) != nullptr);
+	CHECK(!rootFS.fileExists(vfs::VirtualPath("/datafiles/a.txt")));
+	CHECK(!rootFS.fileExists(vfs::VirtualPath("data/a.txt")));
+
+	CHECK(rootFS.writeFile(vfs::VirtualPath("/data/b.txt"), "b", 1));
+	CHECK(memoryFS->files["b.txt"] == "b");
+}
+
+void test_mount_prefixes()
+{
+	vfs::RootFileSystem rootFS;
+
+	auto media = std::make_shared<MemoryFileSystem>();
+	media->add("a.txt", "media a");
+	media->add("sub/b.txt", "media b");
+
+	auto mediaSub = std::make_shared<MemoryFileSystem>();
+	mediaSub->add("c.txt", "nested c");
+
+	auto mediaExtra = std::make_shared<MemoryFileSystem>();
+	mediaExtra->add("a.txt", "extra a");
+
+	rootFS.mount("/media", media);
+	rootFS.mount("/media_extra", mediaExtra);
+
+	// "/media_extra" must not resolve into "/media"
+	CHECK(readString(rootFS, "/media/a.txt") == "media a");
+	CHECK(readString(rootFS, "/media_extra/a.txt") == "extra a");
+	CHECK(readString(rootFS, "/medi/a.txt").empty());
+	CHECK(!rootFS.fileExists("/mediax/a.txt"));
+
+	// normalization of the request
+	CHECK(readString(rootFS, "/media/sub/../a.txt") == "media a");
+	CHECK(readString(rootFS, "//media/./sub//b.txt") == "media b");
+	CHECK(readString(rootFS, "/other/../media/a.txt") == "media a");
+	CHECK(!rootFS.fileExists("/media/../a.txt"));
+
+	// relative path of the mount point itself
+	CHECK(rootFS.folderExists("/media"));
+	CHECK(media->lastPath.empty());
+	CHECK(rootFS.folderExists("/media/"));
+
+	// a mount inside another mount is rejected, a parent of a mount point is fine
+	rootFS.mount("/media/sub", mediaSub);
+	CHECK(readString(rootFS, "/media/sub/b.txt") == "media b");
+	CHECK(!rootFS.unmount("/media/sub"));
+
+	auto rootLevel = std::make_shared<MemoryFileSystem>();
+	rootLevel->add("top.txt", "top");
+	rootFS.mount("/", rootLevel);
+	CHECK(readString(rootFS, "/top.txt") == "top");
+	CHECK(readString(rootFS, "/media/a.txt") == "media a"); // the longest prefix wins
+	CHECK(!rootFS.fileExists("top.txt")); // the root mount covers absolute paths only
+
+	// the same mount point can't be mounted twice without an overlay
+	rootFS.mount("/media", mediaSub);
+	CHECK(readString(rootFS, "/media/a.txt") == "media a");
+
+	CHECK(rootFS.unmount("/media/"));
+	CHECK(!rootFS.fileExists("/media/a.txt"));
+	CHECK(readString(rootFS, "/media_extra/a.txt") == "extra a");
+	CHECK(!rootFS.unmount("/media"));
+
+	// mounts nested under the root mount point are fine
+	rootFS.mount("/deep/mount/point", media);
+	CHECK(readString(rootFS, "/deep/mount/point/a.txt") == "media a");
+	CHECK(rootFS.unmount("/deep/mount/point"));
+	CHECK(rootFS.unmount("/"));
+	CHECK(!rootFS.fileExists("/top.txt"));
+
+	// the tree is deeper than the mount path
+	rootFS.mount("/deep/mount/point", media);
+	CHECK(readString(rootFS, "/deep/mount/point/sub/b.txt") == "media b");
+	CHECK(!rootFS.fileExists("/deep/mount/b.txt"));
+	CHECK(rootFS.unmount("/deep/mount/point"));
+}
+
+void test_overlay_mounts()
+{
+	vfs::RootFileSystem rootFS;
+
+	auto base = std::make_shared<MemoryFileSystem>();
+	base->add("a.txt", "base a");
+	base->add("b.txt", "base b");
+
+	auto patch = std::make_shared<MemoryFileSystem>();
+	patch->add("b.txt", "patch b");
+	patch->add("c.txt", "patch c");
+
+	auto mod = std::make_shared<MemoryFileSystem>();
+	mod->add("c.txt", "mod c");
+
+	rootFS.mount("/data", base);
+	CHECK(rootFS.mountOverlay("/data", patch, 10));
+	CHECK(rootFS.mountOverlay("/data", mod, 5));
+
+	CHECK(readString(rootFS, "/data/a.txt") == "base a");
+	CHECK(readString(rootFS, "/data/b.txt") == "patch b");
+	CHECK(readString(rootFS, "/data/c.txt") == "patch c");
+	CHECK(!rootFS.fileExists("/data/d.txt"));
+
+	// writes go to the top layer
+	CHECK(rootFS.writeFile("/data/d.txt", "new", 3));
+	CHECK(patch->files.count("d.txt") == 1);
+
+	// enumeration merges the layers
+	std::vector<std::string> names;
+	int count = rootFS.enumerateFiles("/data", {}, vfs::enumerate_to_vector(names));
+	std::sort(names.begin(), names.end());
+	CHECK(count == 4);
+	CHECK(names == std::vector<std::string>({ "a.txt", "b.txt", "c.txt", "d.txt" }));
+
+	names.clear();
+	count = rootFS.enumerateFiles("/data", {}, vfs::enumerate_to_vector(names), true);
+	CHECK(count == 6 && names.size() == 6);
+
+	CHECK(rootFS.enumerateDirectories("/data", [](std::string_view) { }) == vfs::status::NotImplemented);
+
+	// equal priority: the layer mounted last wins
+	auto hotfix = std::make_shared<MemoryFileSystem>();
+	hotfix->add("c.txt", "hotfix c");
+	CHECK(rootFS.mountOverlay("/data", hotfix, 10));
+	CHECK(readString(rootFS, "/data/c.txt") == "hotfix c");
+
+	// removing layers one by one
+	CHECK(rootFS.unmount("/data", hotfix));
+	CHECK(!rootFS.unmount("/data", hotfix));
+	CHECK(rootFS.unmount("/data", patch));
+	CHECK(readString(rootFS, "/data/b.txt") == "base b");
+	CHECK(readString(rootFS, "/data/c.txt") == "mod c");
+	CHECK(rootFS.unmount("/data"));
+	CHECK(!rootFS.fileExists("/data/a.txt"));
+}
+
+void test_concurrent_lookups()
+{
+	vfs::RootFileSystem rootFS;
+
+	rootFS.mount("/stable", std::make_shared<NullFileSystem>());
+
+	std::atomic<bool> stop = false;
+	std::atomic<int> failures = 0;
+	std::vector<std::thread> readers;
+	for (int t = 0; t < 4; t++)
+	{
+		readers.emplace_back([&]() {
+			while (!stop)
+			{
+				if (!rootFS.fileExists("/stable/file.txt") && !stop)
+					++failures;
+			}
+		});
+	}
+
+	for (int i = 0; i < 200; i++)
+	{
+		auto temporary = std::make_shared<NullFileSystem>();
+		rootFS.mount("/temp" + std::to_string(i), temporary);
+		rootFS.mountOverlay("/stable", temporary, -1);
+		rootFS.unmount("/stable", temporary);
+		rootFS.unmount("/temp" + std::to_string(i));
+	}
+
+	stop = true;
+	for (auto& reader : readers)
+		reader.join();
+
+	CHECK(failures == 0);
+}
+
+// Lookup cost with a realistic number of mount points
+void benchmark_mount_lookup()
+{
+	vfs::RootFileSystem rootFS;
+
+	for (int i = 0; i < 32; i++)
+		rootFS.mount("/mount" + std::to_string(i) + "/assets", std::make_shared<NullFileSystem>());
+
+	std::vector<std::filesystem::path> paths;
+	for (int i = 0; i < 1000; i++)
+		paths.push_back("/mount" + std::to_string(i % 32) + "/assets/textures/material_" + std::to_string(i) + "/base_color.png");
+
+	constexpr int iterations = 200;
+	auto start = std::chrono::high_resolution_clock::now();
+	int found = 0;
+	for (int iteration = 0; iteration < iterations; iteration++)
+		for (const auto& path : paths)
+			found += rootFS.fileExists(path) ? 1 : 0;
+	auto end = std::chrono::high_resolution_clock::now();
+
+	CHECK(found == iterations * int(paths.size()));
+
+	double ns = std::chrono::duration<double, std::nano>(end - start).count() / double(found);
+	printf("RootFileSystem: %.0f ns per lookup with 32 mount points\n", ns);
+
+	// the same paths, normalized once
+	std::vector<vfs::VirtualPath> virtualPaths;
+	for (const auto& path : paths)
+		virtualPaths.emplace_back(path);
+
+	start = std::chrono::high_resolution_clock::now();
+	found = 0;
+	for (int iteration = 0; iteration < iterations; iteration++)
+		for (const auto& path : virtualPaths)
+			found += rootFS.fileExists(path) ? 1 : 0;
+	end = std::chrono::high_resolution_clock::now();
+
+	CHECK(found == iterations * int(paths.size()));
+
+	ns = std::chrono::duration<double, std::nano>(end - start).count() / double(found);
+	printf("RootFileSystem: %.0f ns per lookup of a VirtualPath\n", ns);
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_normalize_path();
+		test_virtual_path();
+		test_mount_prefixes();
+		test_overlay_mounts();
+		test_concurrent_lookups();
+		benchmark_mount_lookup();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,211 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/core/vfs/ZipFile.h>
+
+#include <donut/tests/utils.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+#ifdef DONUT_WITH_MINIZ
+#include <miniz.h>
+#include <miniz_zip.h>
+#endif
+
+using namespace donut;
+
+#ifdef DONUT_WITH_MINIZ
+
+// Compressible pseudo-random contents that depend only on the file index
+static std::vector<uint8_t> makeFileContents(uint32_t index)
+{
+	uint32_t state = index * 2654435761u + 1;
+	size_t size = 16384 + (index * 7919) % 131072;
+
+	std::vector<uint8_t> data(size);
+	for (size_t i = 0; i < size; i++)
+	{
+		state = state * 1664525u + 1013904223u;
+		data[i] = uint8_t('a' + (state >> 28)); // 16 distinct letters
+	}
+	return data;
+}
+
+static std::string makeFileName(uint32_t index)
+{
+	return "dir" + std::to_string(index % 4) + "/file" + std::to_string(index) + ".bin";
+}
+
+static std::filesystem::path createTestArchive(uint32_t fileCount)
+{
+	std::filesystem::path path = std::filesystem::temp_directory_path() / "donut_test_zip_file.zip";
+
+	mz_zip_archive zip;
+	memset(&zip, 0, sizeof(zip));
+	CHECK(mz_zip_writer_init_file(&zip, path.generic_string().c_str(), 0));
+
+	for (uint32_t dir = 0; dir < 4; dir++)
+	{
+		std::string dirName = "dir" + std::to_string(dir) + "/";
+		CHECK(mz_zip_writer_add_mem(&zip, dirName.c_str(), nullptr, 0, 0));
+	}
+
+	for (uint32_t index = 0; index < fileCount; index++)
+	{
+		std::vector<uint8_t> data = makeFileContents(index);
+		mz_uint level = (index % 8 == 0) ? 0 : MZ_BEST_SPEED; // some files are stored without compression
+		CHECK(mz_zip_writer_add_mem(&zip, makeFileName(index).c_str(), data.data(), data.size(), level));
+	}
+
+	CHECK(mz_zip_writer_finalize_archive(&zip));
+	CHECK(mz_zip_writer_end(&zip));
+
+	return path;
+}
+
+static bool checkFile(vfs::ZipFile& zipFile, uint32_t index)
+{
+	auto blob = zipFile.readFile(makeFileName(index));
+	if (!blob)
+		return false;
+
+	std::vector<uint8_t> expected = makeFileContents(index);
+	return blob->size() == expected.size() && memcmp(blob->data(), expected.data(), expected.size()) == 0;
+}
+
+void test_zip_file_reads(const std::filesystem::path& archivePath, uint32_t fileCount)
+{
+	vfs::ZipFile zipFile(archivePath);
+	CHECK(zipFile.isOpen());
+
+	CHECK(zipFile.folderExists("dir1"));
+	CHECK(!zipFile.folderExists("dir9"));
+	CHECK(zipFile.fileExists("dir3/file3.bin"));
+	CHECK(zipFile.fileExists("/dir3/./file3.bin"));
+	CHECK(!zipFile.fileExists("dir3/file4.bin"));
+	CHECK(!zipFile.readFile("missing.bin"));
+
+	for (uint32_t index = 0; index < fileCount; index++)
+		CHECK(checkFile(zipFile, index));
+
+	vfs::ZipFile missing(archivePath.parent_path() / "donut_missing_archive.zip");
+	CHECK(!missing.isOpen());
+	CHECK(!missing.readFile("dir0/file0.bin"));
+}
+
+void test_zip_file_concurrent_reads(const std::filesystem::path& archivePath, uint32_t fileCount)
+{
+	vfs::ZipFile zipFile(archivePath);
+
+	constexpr int numThreads = 8;
+	std::atomic<int> failures = 0;
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < numThreads; t++)
+	{
+		threads.emplace_back([&, t]() {
+			// every thread walks the archive in a different order, so the same files are read concurrently
+			for (uint32_t i = 0; i < fileCount * 2; i++)
+			{
+				uint32_t index = (i * 7 + uint32_t(t) * 13) % fileCount;
+				if (!checkFile(zipFile, index) || !zipFile.fileExists(makeFileName(index)))
+					++failures;
+			}
+		});
+	}
+
+	for (auto& thread : threads)
+		thread.join();
+
+	CHECK(failures == 0);
+}
+
+void benchmark_zip_file(const std::filesystem::path& archivePath, uint32_t fileCount)
+{
+	vfs::ZipFile zipFile(archivePath);
+	const int numThreads = std::max(2, int(std::thread::hardware_concurrency()));
+
+	// reads every file once from numThreads threads, optionally serialized the way the
+	// archive used to be accessed, with one lock around each read
+	auto readAll = [&](bool serialize)
+	{
+		std::mutex mutex;
+		std::atomic<uint32_t> next = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+
+		std::vector<std::thread> threads;
+		for (int t = 0; t < numThreads; t++)
+		{
+			threads.emplace_back([&]() {
+				for (uint32_t index = next++; index < fileCount; index = next++)
+				{
+					std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+					if (serialize)
+						lock.lock();
+					zipFile.readFile(makeFileName(index));
+				}
+			});
+		}
+
+		for (auto& thread : threads)
+			thread.join();
+
+		auto end = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration<double, std::milli>(end - start).count();
+	};
+
+	double serializedMs = readAll(true);
+	double concurrentMs = readAll(false);
+
+	printf("zip file: %d files on %d threads, %.1f ms serialized, %.1f ms concurrent\n",
+		int(fileCount), numThreads, serializedMs, concurrentMs);
+}
+
+#endif
+
+int main(int, char** argv)
+{
+	try
+	{
+#ifdef DONUT_WITH_MINIZ
+		const uint32_t fileCount = 512;
+		std::filesystem::path archivePath = createTestArchive(fileCount);
+
+		test_zip_file_reads(archivePath, fileCount);
+		test_zip_file_concurrent_reads(archivePath, fileCount);
+		benchmark_zip_file(archivePath, fileCount);
+
+		std::filesystem::remove(archivePath);
+#endif
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,113 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/engine/CameraPath.h>
+#include <donut/tests/utils.h>
+
+#include <json/reader.h>
+#include <json/value.h>
+
+using namespace donut;
+using namespace donut::math;
+using namespace donut::engine;
+
+static bool nearlyEqual(const float3& a, const float3& b)
+{
+	return length(a - b) < 1e-4f;
+}
+
+void test_keyframe_evaluation()
+{
+	CameraPath path;
+	CHECK(path.IsEmpty());
+
+	path.SetInterpolationMode(animation::InterpolationMode::Linear);
+	path.AddKeyframe(0.f, float3(0.f, 0.f, 0.f), float3(0.f, 0.f, 1.f));
+	path.AddKeyframe(2.f, float3(4.f, 0.f, 0.f), float3(4.f, 0.f, 1.f), float3(0.f, 2.f, 0.f), 30.f);
+
+	CHECK(!path.IsEmpty());
+	CHECK(path.GetDuration() == 2.f);
+
+	CameraPathPose pose = path.Evaluate(1.f);
+	CHECK(nearlyEqual(pose.position, float3(2.f, 0.f, 0.f)));
+	CHECK(nearlyEqual(pose.target, float3(2.f, 0.f, 1.f)));
+	CHECK(nearlyEqual(pose.up, float3(0.f, 1.f, 0.f)));
+	CHECK(pose.verticalFov.has_value() && *pose.verticalFov == 30.f);
+
+	// clamped outside of the path
+	CHECK(nearlyEqual(path.Evaluate(-1.f).position, float3(0.f, 0.f, 0.f)));
+	CHECK(nearlyEqual(path.Evaluate(10.f).position, float3(4.f, 0.f, 0.f)));
+
+	// evaluation is deterministic
+	CHECK(nearlyEqual(path.Evaluate(0.75f).position, path.Evaluate(0.75f).position));
+
+	CameraPath empty;
+	CHECK(nearlyEqual(empty.Evaluate(1.f).up, float3(0.f, 1.f, 0.f)));
+}
+
+void test_json_load()
+{
+	const char* text = R"({
+		"mode": "step",
+		"keyframes": [
+			{ "time": 0, "position": [0, 1, 0], "target": [0, 1, 1] },
+			{ "time": 1, "position": [1, 1, 0], "target": [1, 1, 1], "vfov": 45 },
+			{ "time": 0.5, "position": [9, 9, 9], "target": [9, 9, 9] },
+			{ "time": 3, "position": [2, 1, 0] },
+			{ "time": 4, "position": [3, 1, 0], "target": [3, 1, 1], "up": [0, 0, 1] }
+		]
+	})";
+
+	Json::Value root;
+	Json::Reader reader;
+	CHECK(reader.parse(text, root));
+
+	CameraPath path;
+	CHECK(path.Load(root));
+
+	// the out-of-order and incomplete keyframes are skipped
+	CHECK(path.GetDuration() == 4.f);
+	CHECK(nearlyEqual(path.Evaluate(0.9f).position, float3(0.f, 1.f, 0.f)));
+	CHECK(nearlyEqual(path.Evaluate(2.f).position, float3(1.f, 1.f, 0.f)));
+	CHECK(nearlyEqual(path.Evaluate(4.f).up, float3(0.f, 0.f, 1.f)));
+	CHECK(path.Evaluate(2.f).verticalFov.has_value());
+
+	Json::Value invalid;
+	CHECK(reader.parse(R"({ "keyframes": 5 })", invalid));
+	CameraPath invalidPath;
+	CHECK(!invalidPath.Load(invalid));
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_keyframe_evaluation();
+		test_json_load();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,395 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/engine/IesProfile.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/tests/utils.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
+using namespace donut;
+using namespace donut::engine;
+
+constexpr size_t c_SliceSize = size_t(c_IesProfileTextureSize) * c_IesProfileTextureSize;
+
+// Writes an LM-63-2002 file with the given angles and candela values (horizontal-major)
+static std::string makeIesText(const std::vector<float>& verticalAngles, const std::vector<float>& horizontalAngles,
+	const std::vector<float>& candelas)
+{
+	std::stringstream ss;
+	ss << "IESNA:LM-63-2002\r\n";
+	ss << "[TEST] synthetic\r\n";
+	ss << "TILT=NONE\r\n";
+	ss << "1 1000 1 " << verticalAngles.size() << " " << horizontalAngles.size() << " 1 2 0 0 0\r\n";
+	ss << "1 1 100\r\n";
+	for (float angle : verticalAngles)
+		ss << angle << " ";
+	ss << "\r\n";
+	for (float angle : horizontalAngles)
+		ss << angle << " ";
+	ss << "\r\n";
+	for (float value : candelas)
+		ss << value << " ";
+	ss << "\r\n";
+	return ss.str();
+}
+
+static std::shared_ptr<IesProfile> parseText(const std::string& text, const std::string& name)
+{
+	void* data = malloc(text.size());
+	memcpy(data, text.data(), text.size());
+	vfs::Blob blob(data, text.size());
+	return ParseIesProfile(blob, name);
+}
+
+// Direct evaluation of the profile at the given angles, written independently of ResampleIesProfile:
+// linear search and bilinear interpolation on the candela grid.
+static float evaluateReference(const std::vector<float>& verticalAngles, const std::vector<float>& horizontalAngles,
+	const std::vector<float>& candelas, float maxCandelas, float vertical, float horizontal)
+{
+	auto locate = [](const std::vector<float>& angles, float angle, int& i0, int& i1, float& t)
+	{
+		i0 = i1 = 0;
+		t = 0.f;
+		if (angles.size() == 1 || angle <= angles.front())
+			return;
+		if (angle >= angles.back())
+		{
+			i0 = i1 = int(angles.size()) - 1;
+			return;
+		}
+		for (size_t i = 1; i < angles.size(); i++)
+		{
+			if (angle <= angles[i])
+			{
+				i0 = int(i) - 1;
+				i1 = int(i);
+				t = (angle - angles[i0]) / (angles[i1] - angles[i0]);
+				return;
+			}
+		}
+	};
+
+	if (vertical > verticalAngles.back())
+		return 0.f;
+
+	float lastHorizontal = horizontalAngles.back();
+	if (lastHorizontal <= 180.f)
+	{
+		horizontal = fabsf(horizontal);
+		if (lastHorizontal == 90.f && horizontal > 90.f)
+			horizontal = 180.f - horizontal;
+	}
+	else if (horizontal < 0.f)
+		horizontal += 360.f;
+
+	int v0, v1, h0, h1;
+	float vt, ht;
+	locate(verticalAngles, vertical, v0, v1, vt);
+	locate(horizontalAngles, horizontal, h0, h1, ht);
+
+	size_t numVertical = verticalAngles.size();
+	float a = candelas[h0 * numVertical + v0];
+	float b = candelas[h0 * numVertical + v1];
+	float c = candelas[h1 * numVertical + v0];
+	float d = candelas[h1 * numVertical + v1];
+	float top = a + (b - a) * vt;
+	float bottom = c + (d - c) * vt;
+	return (top + (bottom - top) * ht) / maxCandelas;
+}
+
+static float texelVerticalAngle(uint32_t x) { return float(x) * 180.f / float(c_IesProfileTextureSize); }
+static float texelHorizontalAngle(uint32_t y) { return float(y) * 360.f / float(c_IesProfileTextureSize) - 180.f; }
+
+void test_parse()
+{
+	std::vector<float> vertical = { 0.f, 45.f, 90.f };
+	std::vector<float> horizontal = { 0.f };
+	std::vector<float> candelas = { 200.f, 100.f, 50.f };
+
+	auto profile = parseText(makeIesText(vertical, horizontal, candelas), "test.ies");
+	CHECK(profile);
+	CHECK(profile->name == "test.ies");
+	CHECK(profile->rawData.size() == 13 + 3 + 1 + 3);
+	CHECK(profile->rawData[0] == 1.f / 200.f); // normalization
+	CHECK(profile->rawData[3] == 3.f && profile->rawData[4] == 1.f);
+	CHECK(profile->contentHash != 0);
+	CHECK(profile->atlasSlice == -1);
+	CHECK(profile->textureIndex == -1);
+
+	// the hash depends on the contents only
+	auto sameContents = parseText(makeIesText(vertical, horizontal, candelas), "copy.ies");
+	CHECK(sameContents && sameContents->contentHash == profile->contentHash);
+
+	auto otherContents = parseText(makeIesText(vertical, horizontal, { 200.f, 100.f, 60.f }), "other.ies");
+	CHECK(otherContents && otherContents->contentHash != profile->contentHash);
+
+	// unsupported header and wrong data size
+	CHECK(!parseText("NOT AN IES FILE\r\nTILT=NONE\r\n1 2 3\r\n", "bad.ies"));
+	std::string truncated = makeIesText(vertical, horizontal, candelas);
+	truncated.resize(truncated.rfind("50"));
+	CHECK(!parseText(truncated, "truncated.ies"));
+}
+
+void test_resample_isotropic()
+{
+	// linear falloff from 1 at the pole to 0 at the horizon; isotropic with a single horizontal angle
+	std::vector<float> vertical = { 0.f, 90.f, 180.f };
+	std::vector<float> horizontal = { 0.f };
+	std::vector<float> candelas = { 1000.f, 500.f, 0.f };
+
+	auto profile = parseText(makeIesText(vertical, horizontal, candelas), "linear.ies");
+	CHECK(profile);
+
+	std::vector<float> texels(c_SliceSize);
+	CHECK(ResampleIesProfile(profile->rawData, texels.data()));
+
+	for (uint32_t y = 0; y < c_IesProfileTextureSize; y++)
+	{
+		for (uint32_t x = 0; x < c_IesProfileTextureSize; x++)
+		{
+			float expected = 1.f - texelVerticalAngle(x) / 180.f;
+			CHECK(fabsf(texels[y * c_IesProfileTextureSize + x] - expected) < 1e-5f);
+		}
+	}
+}
+
+void test_resample_symmetry()
+{
+	std::vector<float> vertical = { 0.f, 30.f, 60.f, 90.f };
+
+	struct Case
+	{
+		std::vector<float> horizontal;
+	};
+
+	// quadrant symmetry, bilateral symmetry, and full 360 degree data
+	const Case cases[] = {
+		{ { 0.f, 45.f, 90.f } },
+		{ { 0.f, 60.f, 120.f, 180.f } },
+		{ { 0.f, 90.f, 180.f, 270.f, 360.f } },
+	};
+
+	for (const Case& c : cases)
+	{
+		std::vector<float> candelas;
+		float maxCandelas = 0.f;
+		for (size_t h = 0; h < c.horizontal.size(); h++)
+		{
+			for (size_t v = 0; v < vertical.size(); v++)
+			{
+				float value = 100.f + 37.f * float(h) + 11.f * float(v) + float((h * 7 + v * 3) % 5);
+				candelas.push_back(value);
+				maxCandelas = std::max(maxCandelas, value);
+			}
+		}
+
+		auto profile = parseText(makeIesText(vertical, c.horizontal, candelas), "symmetry.ies");
+		CHECK(profile);
+
+		std::vector<float> texels(c_SliceSize);
+		CHECK(ResampleIesProfile(profile->rawData, texels.data()));
+
+		for (uint32_t y = 0; y < c_IesProfileTextureSize; y++)
+		{
+			for (uint32_t x = 0; x < c_IesProfileTextureSize; x++)
+			{
+				float expected = evaluateReference(vertical, c.horizontal, candelas, maxCandelas,
+					texelVerticalAngle(x), texelHorizontalAngle(y));
+				float actual = texels[y * c_IesProfileTextureSize + x];
+				CHECK(fabsf(actual - expected) < 1e-5f);
+
+				// nothing below the horizon for this profile
+				if (texelVerticalAngle(x) > 90.f)
+				{
+					CHECK(actual == 0.f);
+				}
+			}
+		}
+	}
+}
+
+void test_resample_malformed()
+{
+	std::vector<float> texels(c_SliceSize);
+	CHECK(!ResampleIesProfile({}, texels.data()));
+
+	std::vector<float> rawData(13 + 2 + 1 + 2, 1.f);
+	rawData[3] = 2.f;
+	rawData[4] = 1.f;
+	CHECK(ResampleIesProfile(rawData, texels.data()));
+
+	rawData[4] = 2.f; // claims more data than present
+	CHECK(!ResampleIesProfile(rawData, texels.data()));
+
+	rawData[3] = 0.f;
+	CHECK(!ResampleIesProfile(rawData, texels.data()));
+}
+
+static std::vector<std::shared_ptr<IesProfile>> makeProfileSet(size_t distinctCount, size_t copies)
+{
+	std::vector<float> vertical;
+	for (int v = 0; v <= 18; v++)
+		vertical.push_back(float(v) * 10.f);
+	std::vector<float> horizontal;
+	for (int h = 0; h <= 8; h++)
+		horizontal.push_back(float(h) * 45.f);
+
+	std::vector<std::shared_ptr<IesProfile>> profiles;
+	for (size_t copy = 0; copy < copies; copy++)
+	{
+		for (size_t index = 0; index < distinctCount; index++)
+		{
+			std::vector<float> candelas;
+			for (size_t h = 0; h < horizontal.size(); h++)
+				for (size_t v = 0; v < vertical.size(); v++)
+					candelas.push_back(float((index * 131 + h * 17 + v * 29) % 97) + 1.f);
+
+			std::string name = "profile" + std::to_string(index) + "_" + std::to_string(copy) + ".ies";
+			profiles.push_back(parseText(makeIesText(vertical, horizontal, candelas), name));
+		}
+	}
+	return profiles;
+}
+
+void test_atlas()
+{
+	auto profiles = makeProfileSet(3, 2);
+	CHECK(profiles.size() == 6);
+
+	// a malformed profile and a null entry are skipped
+	auto malformed = std::make_shared<IesProfile>();
+	malformed->name = "malformed.ies";
+	malformed->rawData = { 1.f, 2.f, 3.f };
+	profiles.insert(profiles.begin() + 1, malformed);
+	profiles.push_back(nullptr);
+
+	std::vector<float> texels;
+	uint32_t sliceCount = BuildIesProfileAtlas(profiles, texels);
+	CHECK(sliceCount == 3);
+	CHECK(texels.size() == sliceCount * c_SliceSize);
+	CHECK(malformed->atlasSlice == -1);
+
+	// slices are assigned in order of first appearance, copies share the slice
+	CHECK(profiles[0]->atlasSlice == 0);
+	CHECK(profiles[2]->atlasSlice == 1);
+	CHECK(profiles[3]->atlasSlice == 2);
+	CHECK(profiles[4]->atlasSlice == 0);
+	CHECK(profiles[5]->atlasSlice == 1);
+	CHECK(profiles[6]->atlasSlice == 2);
+
+	for (size_t index : { 0, 2, 3 })
+	{
+		std::vector<float> reference(c_SliceSize);
+		CHECK(ResampleIesProfile(profiles[index]->rawData, reference.data()));
+		CHECK(memcmp(reference.data(), texels.data() + profiles[index]->atlasSlice * c_SliceSize, c_SliceSize * sizeof(float)) == 0);
+	}
+
+	// a hash collision must not merge different profiles
+	profiles[3]->contentHash = profiles[0]->contentHash;
+	profiles[6]->contentHash = profiles[0]->contentHash;
+	sliceCount = BuildIesProfileAtlas(profiles, texels);
+	CHECK(sliceCount == 3);
+	CHECK(profiles[3]->atlasSlice == 2);
+	CHECK(profiles[4]->atlasSlice == 0);
+	CHECK(profiles[6]->atlasSlice == 2);
+
+	// empty input
+	sliceCount = BuildIesProfileAtlas({}, texels);
+	CHECK(sliceCount == 0 && texels.empty());
+}
+
+#ifdef DONUT_WITH_TASKFLOW
+
+void test_atlas_parallel()
+{
+	auto profiles = makeProfileSet(16, 2);
+
+	std::vector<float> serialTexels;
+	uint32_t serialSlices = BuildIesProfileAtlas(profiles, serialTexels);
+	std::vector<int> serialAssignment;
+	for (const auto& profile : profiles)
+		serialAssignment.push_back(profile->atlasSlice);
+
+	tf::Executor executor(4);
+	std::vector<float> parallelTexels;
+	uint32_t parallelSlices = BuildIesProfileAtlas(profiles, parallelTexels, &executor);
+
+	CHECK(serialSlices == 16 && parallelSlices == serialSlices);
+	CHECK(serialTexels.size() == parallelTexels.size());
+	CHECK(memcmp(serialTexels.data(), parallelTexels.data(), serialTexels.size() * sizeof(float)) == 0);
+	for (size_t i = 0; i < profiles.size(); i++)
+	{
+		CHECK(profiles[i]->atlasSlice == serialAssignment[i]);
+	}
+}
+
+void benchmark_atlas()
+{
+	auto profiles = makeProfileSet(64, 1);
+	std::vector<float> texels;
+
+	auto t0 = std::chrono::high_resolution_clock::now();
+	BuildIesProfileAtlas(profiles, texels);
+	auto t1 = std::chrono::high_resolution_clock::now();
+
+	tf::Executor executor;
+	BuildIesProfileAtlas(profiles, texels, &executor);
+	auto t2 = std::chrono::high_resolution_clock::now();
+
+	double serialMs = std::chrono::duration<double, std::milli>(t1 - t0).count();
+	double parallelMs = std::chrono::duration<double, std::milli>(t2 - t1).count();
+	printf("ies atlas: %zu profiles, %.2f ms serial, %.2f ms on %zu workers\n",
+		profiles.size(), serialMs, parallelMs, executor.num_workers());
+}
+
+#endif
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_parse();
+		test_resample_isotropic();
+		test_resample_symmetry();
+		test_resample_malformed();
+		test_atlas();
+#ifdef DONUT_WITH_TASKFLOW
+		test_atlas_parallel();
+		benchmark_atlas();
+#endif
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,399 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/engine/LightProbeBaker.h>
+#include <donut/engine/SphericalHarmonics.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/tests/utils.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
+using namespace donut;
+using namespace donut::math;
+using namespace donut::engine;
+
+static CubemapImage createCubemap(uint32_t size, const std::function<float3(const float3&)>& radiance)
+{
+	CubemapImage cubemap;
+	cubemap.Resize(size);
+	for (uint32_t face = 0; face < 6; face++)
+	{
+		float4* texels = cubemap.GetFace(face);
+		for (uint32_t y = 0; y < size; y++)
+			for (uint32_t x = 0; x < size; x++)
+				texels[y * size + x] = float4(radiance(CubemapImage::GetTexelDirection(face, x, y, size)), 1.f);
+	}
+	return cubemap;
+}
+
+// Evenly spread directions for testing, including the axes and the cube corners
+static std::vector<float3> testDirections()
+{
+	std::vector<float3> directions = {
+		float3(1.f, 0.f, 0.f), float3(-1.f, 0.f, 0.f), float3(0.f, 1.f, 0.f),
+		float3(0.f, -1.f, 0.f), float3(0.f, 0.f, 1.f), float3(0.f, 0.f, -1.f),
+		normalize(float3(1.f, 1.f, 1.f)), normalize(float3(-1.f, 1.f, -1.f))
+	};
+
+	const int count = 64;
+	for (int i = 0; i < count; i++)
+	{
+		float z = 1.f - (float(i) + 0.5f) * 2.f / float(count);
+		float r = sqrtf(1.f - z * z);
+		float phi = float(i) * 2.399963f; // golden angle
+		directions.push_back(float3(r * cosf(phi), r * sinf(phi), z));
+	}
+	return directions;
+}
+
+static bool nearlyEqual(const float3& a, const float3& b, float relativeTolerance)
+{
+	return length(a - b) <= relativeTolerance * std::max(length(b), 1e-3f);
+}
+
+void test_cubemap_directions()
+{
+	// the texel mapping and Sample() must be inverse to each other
+	const uint32_t size = 8;
+	CubemapImage cubemap;
+	cubemap.Resize(size);
+	for (size_t i = 0; i < cubemap.texels.size(); i++)
+		cubemap.texels[i] = float4(float(i), 0.f, 0.f, 0.f);
+
+	for (uint32_t face = 0; face < 6; face++)
+	{
+		for (uint32_t y = 0; y < size; y++)
+		{
+			for (uint32_t x = 0; x < size; x++)
+			{
+				float3 direction = CubemapImage::GetTexelDirection(face, x, y, size);
+				CHECK(fabsf(cubemap.Sample(direction).x - float((face * size + y) * size + x)) < 1e-3f);
+			}
+		}
+	}
+
+	// D3D face orientation: +X face, top left texel points to +Y and +Z
+	float3 corner = CubemapImage::GetTexelDirection(0, 0, 0, size);
+	CHECK(corner.x > 0.f && corner.y > 0.f && corner.z > 0.f);
+	// +Y face, top left texel points to -X and -Z
+	corner = CubemapImage::GetTexelDirection(2, 0, 0, size);
+	CHECK(corner.y > 0.f && corner.x < 0.f && corner.z < 0.f);
+}
+
+void test_sh_projection()
+{
+	// constant radiance: E(n) = pi * L
+	{
+		const float3 color = float3(1.f, 2.f, 3.f);
+		for (uint32_t size : { 1u, 6u, 32u })
+		{
+			auto cubemap = createCubemap(size, [color](const float3&) { return color; });
+			SphericalHarmonicsL2 radiance = ProjectCubemapToSH(cubemap);
+			SphericalHarmonicsL2 irradiance = radiance.ConvolveWithCosineLobe();
+
+			for (const float3& n : testDirections())
+			{
+				CHECK(nearlyEqual(radiance.Evaluate(n), color, 1e-4f));
+				CHECK(nearlyEqual(irradiance.Evaluate(n), color * PI_f, 1e-4f));
+			}
+		}
+	}
+
+	// linear radiance, band 0 and 1: E(n) = pi * a + 2pi/3 * b * dot(n, d)
+	{
+		const float3 d = normalize(float3(0.3f, -0.5f, 0.8f));
+		const float a = 1.f, b = 0.5f;
+		for (uint32_t size : { 6u, 32u })
+		{
+			auto cubemap = createCubemap(size, [=](const float3& w) { return float3(a + b * dot(w, d)); });
+			SphericalHarmonicsL2 irradiance = ProjectCubemapToSH(cubemap).ConvolveWithCosineLobe();
+
+			const float tolerance = size < 8 ? 1e-2f : 1e-3f;
+			for (const float3& n : testDirections())
+				CHECK(nearlyEqual(irradiance.Evaluate(n), float3(PI_f * a + 2.f * PI_f / 3.f * b * dot(n, d)), tolerance));
+		}
+	}
+
+	// radiance z^2, band 0 and 2: E(n) = pi / 3 + pi * (3 n_z^2 - 1) / 12, which gives pi / 2 at n = +Z
+	{
+		auto cubemap = createCubemap(64, [](const float3& w) { return float3(w.z * w.z); });
+		SphericalHarmonicsL2 irradiance = ProjectCubemapToSH(cubemap).ConvolveWithCosineLobe();
+
+		for (const float3& n : testDirections())
+			CHECK(nearlyEqual(irradiance.Evaluate(n), float3(PI_f / 3.f + PI_f * (3.f * n.z * n.z - 1.f) / 12.f), 2e-3f));
+		CHECK(nearlyEqual(irradiance.Evaluate(float3(0.f, 0.f, 1.f)), float3(PI_f * 0.5f), 2e-3f));
+	}
+
+	// a smooth sky: compare against brute force integration of the irradiance
+	{
+		const uint32_t size = 32;
+		auto sky = [](const float3& w) { return float3(0.2f, 0.3f, 0.5f) + float3(1.f, 0.9f, 0.6f) * std::max(w.y, 0.f) * std::max(w.y, 0.f); };
+		auto cubemap = createCubemap(size, sky);
+		SphericalHarmonicsL2 irradiance = ProjectCubemapToSH(cubemap).ConvolveWithCosineLobe();
+
+		float maxError = 0.f;
+		for (const float3& n : testDirections())
+		{
+			float3 reference = 0.f;
+			float totalSolidAngle = 0.f;
+			for (uint32_t face = 0; face < 6; face++)
+			{
+				for (uint32_t y = 0; y < size; y++)
+				{
+					for (uint32_t x = 0; x < size; x++)
+					{
+						float a = (float(x) + 0.5f) * 2.f / float(size) - 1.f;
+						float b = (float(y) + 0.5f) * 2.f / float(size) - 1.f;
+						float solidAngle = powf(a * a + b * b + 1.f, -1.5f);
+						float3 w = CubemapImage::GetTexelDirection(face, x, y, size);
+						reference += sky(w) * std::max(dot(n, w), 0.f) * solidAngle;
+						totalSolidAngle += solidAngle;
+					}
+				}
+			}
+			reference *= 4.f * PI_f / totalSolidAngle;
+
+			float3 value = irradiance.Evaluate(n);
+			maxError = std::max(maxError, length(value - reference) / length(reference));
+		}
+		CHECK(maxError < 0.03f);
+	}
+}
+
+void test_bake_constant_environment()
+{
+	const float3 color = float3(0.5f, 1.f, 2.f);
+	auto environment = createCubemap(32, [color](const float3&) { return color; });
+
+	LightProbeBakeSettings settings;
+	settings.specularSize = 16;
+	settings.specularMipLevels = 5;
+	settings.sampleCount = 32;
+
+	BakedLightProbe probe = BakeLightProbe(environment, settings);
+
+	CHECK(nearlyEqual(probe.diffuseIrradiance.Evaluate(float3(0.f, 1.f, 0.f)), color * PI_f, 1e-4f));
+	CHECK(probe.specularMips.size() == 5);
+	for (uint32_t mipLevel = 0; mipLevel < 5; mipLevel++)
+	{
+		const CubemapImage& mip = probe.specularMips[mipLevel];
+		CHECK(mip.size == (16u >> mipLevel));
+		for (const float4& texel : mip.texels)
+			CHECK(nearlyEqual(texel.xyz(), color, 1e-4f));
+	}
+
+	CHECK(GetLightProbeMipRoughness(0, 5) == 0.f);
+	CHECK(GetLightProbeMipRoughness(4, 5) == 1.f);
+}
+
+void test_bake_sky()
+{
+	// bright upper hemisphere, black below
+	auto environment = createCubemap(64, [](const float3& w) { return float3(w.y > 0.f ? 1.f : 0.f); });
+
+	LightProbeBakeSettings settings;
+	settings.specularSize = 16;
+	settings.specularMipLevels = 5;
+	settings.sampleCount = 64;
+
+	BakedLightProbe probe = BakeLightProbe(environment, settings);
+
+	// E(up) = pi, E(down) = 0, E(horizon) = pi / 2; L2 is only an approximation of a step
+	const SphericalHarmonicsL2& sh = probe.diffuseIrradiance;
+	CHECK(fabsf(sh.Evaluate(float3(0.f, 1.f, 0.f)).x - PI_f) < 0.1f * PI_f);
+	CHECK(fabsf(sh.Evaluate(float3(0.f, -1.f, 0.f)).x) < 0.1f * PI_f);
+	CHECK(fabsf(sh.Evaluate(float3(1.f, 0.f, 0.f)).x - PI_f * 0.5f) < 0.02f * PI_f);
+
+	auto center = [](const CubemapImage& mip, uint32_t face) { return mip.GetFace(face)[(mip.size / 2) * mip.size + mip.size / 2].x; };
+
+	// the mirror level keeps the sharp edge, the roughest level blurs it but stays brighter on the top
+	const CubemapImage& mirror = probe.specularMips.front();
+	const CubemapImage& rough = probe.specularMips.back();
+	CHECK(center(mirror, 2) > 0.99f && center(mirror, 3) < 0.01f);
+	CHECK(center(rough, 2) > 0.6f && center(rough, 2) < 1.f);
+	CHECK(center(rough, 3) > 0.f && center(rough, 3) < 0.4f);
+	CHECK(center(rough, 0) > center(rough, 3) && center(rough, 0) < center(rough, 2));
+}
+
+void test_light_probe_cache()
+{
+	std::filesystem::path directory = std::filesystem::temp_directory_path() / "donut_test_light_probe_cache";
+	std::filesystem::remove_all(directory);
+	std::filesystem::create_directories(directory);
+
+	auto fs = std::make_shared<vfs::NativeFileSystem>();
+	LightProbeCache cache(fs, directory);
+
+	LightProbeBakeSettings settings;
+	settings.specularSize = 8;
+	settings.specularMipLevels = 4;
+	settings.sampleCount = 16;
+
+	auto red = createCubemap(16, [](const float3& w) { return float3(1.f + w.x, 0.f, 0.f); });
+	auto green = createCubemap(16, [](const float3& w) { return float3(0.f, 1.f + w.y, 0.f); });
+
+	const uint64_t redKey = LightProbeCache::ComputeKey(red, settings);
+	CHECK(redKey != LightProbeCache::ComputeKey(green, settings));
+	CHECK(redKey == LightProbeCache::ComputeKey(red, settings));
+	LightProbeBakeSettings otherSettings = settings;
+	otherSettings.sampleCount = 32;
+	CHECK(redKey != LightProbeCache::ComputeKey(red, otherSettings));
+
+	BakedLightProbe loaded;
+	CHECK(!cache.Load(redKey, loaded));
+
+	size_t bakedCount = 0;
+	auto first = cache.BakeOrLoad({ &red, &green }, settings, nullptr, &bakedCount);
+	CHECK(bakedCount == 2);
+	CHECK(std::filesystem::exists(cache.GetSpecularPath(redKey)));
+	CHECK(std::filesystem::exists(cache.GetIrradiancePath(redKey)));
+
+	auto second = cache.BakeOrLoad({ &red, &green }, settings, nullptr, &bakedCount);
+	CHECK(bakedCount == 0);
+	CHECK(second.size() == 2);
+
+	for (size_t probe = 0; probe < 2; probe++)
+	{
+		for (int i = 0; i < SphericalHarmonicsL2::CoefficientCount; i++)
+			CHECK(all(first[probe].diffuseIrradiance.coefficients[i] == second[probe].diffuseIrradiance.coefficients[i]));
+
+		CHECK(first[probe].specularMips.size() == second[probe].specularMips.size());
+		for (size_t mipLevel = 0; mipLevel < first[probe].specularMips.size(); mipLevel++)
+		{
+			const CubemapImage& a = first[probe].specularMips[mipLevel];
+			const CubemapImage& b = second[probe].specularMips[mipLevel];
+			CHECK(a.size == b.size && a.texels.size() == b.texels.size());
+			for (size_t i = 0; i < a.texels.size(); i++)
+				CHECK(length(a.texels[i] - b.texels[i]) <= 1e-3f * std::max(length(a.texels[i]), 1.f)); // half precision
+		}
+	}
+
+	// a corrupt entry is a miss
+	{
+		const char garbage[] = "not a light probe";
+		fs->writeFile(cache.GetIrradiancePath(redKey), garbage, sizeof(garbage));
+		CHECK(!cache.Load(redKey, loaded));
+	}
+
+	std::filesystem::remove_all(directory);
+}
+
+#ifdef DONUT_WITH_TASKFLOW
+void test_parallel_baking()
+{
+	LightProbeBakeSettings settings;
+	settings.specularSize = 16;
+	settings.specularMipLevels = 5;
+	settings.sampleCount = 16;
+
+	std::vector<CubemapImage> environments;
+	for (int i = 0; i < 3; i++)
+		environments.push_back(createCubemap(32, [i](const float3& w) { return float3(1.f + w.x * float(i), 1.f + w.y, 1.f - w.z * 0.5f); }));
+
+	std::vector<const CubemapImage*> radiance;
+	for (const auto& environment : environments)
+		radiance.push_back(&environment);
+
+	tf::Executor executor(4);
+	auto serial = BakeLightProbes(radiance, settings);
+	auto parallel = BakeLightProbes(radiance, settings, &executor);
+
+	for (size_t probe = 0; probe < radiance.size(); probe++)
+	{
+		for (size_t mipLevel = 0; mipLevel < serial[probe].specularMips.size(); mipLevel++)
+		{
+			const auto& a = serial[probe].specularMips[mipLevel].texels;
+			const auto& b = parallel[probe].specularMips[mipLevel].texels;
+			CHECK(a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(float4)) == 0);
+		}
+	}
+}
+#endif
+
+void benchmark_light_probe_baking()
+{
+	auto environment = createCubemap(256, [](const float3& w) { return float3(0.5f + 0.5f * w.y, 0.5f + 0.25f * w.x, 0.25f); });
+
+	const int iterations = 10;
+	auto t0 = std::chrono::high_resolution_clock::now();
+	SphericalHarmonicsL2 sh;
+	for (int i = 0; i < iterations; i++)
+		sh += ProjectCubemapToSH(environment);
+	auto t1 = std::chrono::high_resolution_clock::now();
+	double projectionMs = std::chrono::duration<double, std::milli>(t1 - t0).count() / iterations;
+
+	LightProbeBakeSettings settings;
+	settings.specularSize = 64;
+	settings.specularMipLevels = 5;
+	settings.sampleCount = 32;
+
+	std::vector<const CubemapImage*> radiance(4, &environment);
+
+	t0 = std::chrono::high_resolution_clock::now();
+	auto serial = BakeLightProbes(radiance, settings);
+	t1 = std::chrono::high_resolution_clock::now();
+	double serialMs = std::chrono::duration<double, std::milli>(t1 - t0).count();
+
+	printf("SH projection: %.2f ms for a 256x256 cubemap, %.0f Mtexels/s\n", projectionMs, 6.0 * 256 * 256 / projectionMs * 1e-3);
+
+#ifdef DONUT_WITH_TASKFLOW
+	tf::Executor executor;
+	t0 = std::chrono::high_resolution_clock::now();
+	auto parallel = BakeLightProbes(radiance, settings, &executor);
+	t1 = std::chrono::high_resolution_clock::now();
+	double parallelMs = std::chrono::duration<double, std::milli>(t1 - t0).count();
+
+	printf("Light probe baking: %.1f ms per probe serial, %.1f ms per probe on %zu threads\n",
+		serialMs / radiance.size(), parallelMs / radiance.size(), executor.num_workers());
+#else
+	printf("Light probe baking: %.1f ms per probe\n", serialMs / radiance.size());
+#endif
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_cubemap_directions();
+		test_sh_projection();
+		test_bake_constant_environment();
+		test_bake_sky();
+		test_light_probe_cache();
+#ifdef DONUT_WITH_TASKFLOW
+		test_parallel_baking();
+#endif
+		benchmark_light_probe_baking();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,303 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/engine/MaterialBindingCache.h>
+#include <donut/tests/utils.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace donut;
+using namespace donut::engine;
+
+class FakeBindingSet : public nvrhi::RefCounter<nvrhi::IBindingSet>
+{
+public:
+	const Material* material;
+	uint32_t version;
+	bool withTextures;
+
+	FakeBindingSet(const Material& material)
+		: material(&material)
+		, version(material.version)
+		, withTextures(material.baseOrDiffuseTexture && material.baseOrDiffuseTexture->texture)
+	{ }
+
+	const nvrhi::BindingSetDesc* getDesc() const override { return nullptr; }
+	nvrhi::IBindingLayout* getLayout() const override { return nullptr; }
+};
+
+class FakeTexture : public nvrhi::RefCounter<nvrhi::ITexture>
+{
+public:
+	nvrhi::TextureDesc desc;
+
+	const nvrhi::TextureDesc& getDesc() const override { return desc; }
+	nvrhi::Object getNativeView(nvrhi::ObjectType, nvrhi::Format, nvrhi::TextureSubresourceSet, nvrhi::TextureDimension, bool) override { return nullptr; }
+};
+
+struct FakeFactory
+{
+	std::atomic<int> calls = 0;
+
+	MaterialBindingCache::BindingSetFactory get()
+	{
+		return [this](const Material& material) {
+			++calls;
+			return nvrhi::BindingSetHandle::Create(new FakeBindingSet(material));
+		};
+	}
+};
+
+static const FakeBindingSet* fake(nvrhi::IBindingSet* bindingSet)
+{
+	return static_cast<const FakeBindingSet*>(bindingSet);
+}
+
+void test_lookup_and_versioning()
+{
+	FakeFactory factory;
+	MaterialBindingCache cache(nullptr, factory.get());
+
+	auto a = std::make_shared<Material>();
+	auto b = std::make_shared<Material>();
+	CHECK(a->uniqueID != b->uniqueID);
+
+	nvrhi::IBindingSet* setA = cache.GetMaterialBindingSet(a.get());
+	nvrhi::IBindingSet* setB = cache.GetMaterialBindingSet(b.get());
+	CHECK(setA && setB && setA != setB);
+	CHECK(fake(setA)->material == a.get());
+	CHECK(factory.calls == 2);
+
+	// repeated lookups are served from the cache, including after the snapshot is published
+	for (int i = 0; i < 100; ++i)
+	{
+		CHECK(cache.GetMaterialBindingSet(a.get()) == setA);
+		CHECK(cache.GetMaterialBindingSet(b.get()) == setB);
+	}
+	CHECK(factory.calls == 2);
+	CHECK(cache.GetEntryCount() == 2);
+
+	// a version bump rebuilds only the affected material
+	++a->version;
+	nvrhi::IBindingSet* setA2 = cache.GetMaterialBindingSet(a.get());
+	CHECK(setA2 != setA);
+	CHECK(fake(setA2)->version == a->version);
+	CHECK(cache.GetMaterialBindingSet(b.get()) == setB);
+	CHECK(factory.calls == 3);
+	CHECK(cache.GetEntryCount() == 2);
+
+	// the superseded binding set stays valid until the next release point
+	CHECK(fake(setA)->material == a.get());
+	cache.ReleaseDestroyedMaterials();
+	CHECK(cache.GetMaterialBindingSet(a.get()) == setA2);
+	CHECK(factory.calls == 3);
+
+	CHECK(cache.GetMaterialBindingSet(nullptr) == nullptr);
+
+	// a copy with the same version is a different material to the cache
+	auto copy = std::make_shared<Material>(*a);
+	CHECK(copy->uniqueID != a->uniqueID && copy->version == a->version);
+	nvrhi::IBindingSet* setCopy = cache.GetMaterialBindingSet(copy.get());
+	CHECK(setCopy != setA2 && fake(setCopy)->material == copy.get());
+	*copy = *b;
+	CHECK(copy->uniqueID != b->uniqueID);
+	CHECK(cache.GetMaterialBindingSet(copy.get()) != setB);
+	CHECK(factory.calls == 5);
+	copy.reset();
+	cache.ReleaseDestroyedMaterials();
+
+	cache.Clear();
+	CHECK(cache.GetEntryCount() == 0);
+	CHECK(cache.GetMaterialBindingSet(a.get()) != nullptr);
+	CHECK(factory.calls == 6);
+}
+
+void test_pending_textures()
+{
+	FakeFactory factory;
+	MaterialBindingCache cache(nullptr, factory.get());
+
+	auto material = std::make_shared<Material>();
+	material->baseOrDiffuseTexture = std::make_shared<LoadedTexture>();
+
+	nvrhi::IBindingSet* fallbackSet = cache.GetMaterialBindingSet(material.get());
+	CHECK(!fake(fallbackSet)->withTextures);
+	CHECK(cache.GetMaterialBindingSet(material.get()) == fallbackSet);
+	CHECK(factory.calls == 1);
+
+	// the texture finishes loading: the entry is rebuilt without a version bump
+	material->baseOrDiffuseTexture->texture = nvrhi::TextureHandle::Create(new FakeTexture());
+
+	nvrhi::IBindingSet* loadedSet = cache.GetMaterialBindingSet(material.get());
+	CHECK(loadedSet != fallbackSet);
+	CHECK(fake(loadedSet)->withTextures);
+	CHECK(cache.GetMaterialBindingSet(material.get()) == loadedSet);
+	CHECK(factory.calls == 2);
+
+	// a texture that never loads does not cause rebuilds
+	auto broken = std::make_shared<Material>();
+	broken->normalTexture = std::make_shared<LoadedTexture>();
+	for (int i = 0; i < 10; ++i)
+		cache.GetMaterialBindingSet(broken.get());
+	CHECK(factory.calls == 3);
+}
+
+void test_destroyed_materials()
+{
+	FakeFactory factory;
+	MaterialBindingCache cache(nullptr, factory.get());
+
+	std::vector<std::shared_ptr<Material>> materials;
+	for (int i = 0; i < 100; ++i)
+	{
+		materials.push_back(std::make_shared<Material>());
+		cache.GetMaterialBindingSet(materials.back().get());
+	}
+
+	// not owned by a shared_ptr: never considered destroyed
+	Material local;
+	cache.GetMaterialBindingSet(&local);
+	CHECK(cache.GetEntryCount() == 101);
+
+	materials.erase(materials.begin() + 50, materials.end());
+	cache.ReleaseDestroyedMaterials();
+	CHECK(cache.GetEntryCount() == 51);
+
+	// a new material reusing the address of a destroyed one gets its own binding set
+	int callsBefore = factory.calls;
+	for (int i = 0; i < 50; ++i)
+		materials.push_back(std::make_shared<Material>());
+	for (const auto& material : materials)
+		CHECK(fake(cache.GetMaterialBindingSet(material.get()))->material == material.get());
+	CHECK(factory.calls == callsBefore + 50);
+	CHECK(cache.GetEntryCount() == 101);
+}
+
+void test_concurrent_lookups()
+{
+	FakeFactory factory;
+	MaterialBindingCache cache(nullptr, factory.get());
+
+	constexpr int numMaterials = 2000;
+	constexpr int numThreads = 8;
+
+	std::vector<std::shared_ptr<Material>> materials;
+	for (int i = 0; i < numMaterials; ++i)
+		materials.push_back(std::make_shared<Material>());
+
+	std::atomic<int> mismatches = 0;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < numThreads; ++t)
+	{
+		threads.emplace_back([&, t]() {
+			for (int pass = 0; pass < 4; ++pass)
+			{
+				for (int i = 0; i < numMaterials; ++i)
+				{
+					const Material* material = materials[(i * 7 + t * 131) % numMaterials].get();
+					if (fake(cache.GetMaterialBindingSet(material))->material != material)
+						++mismatches;
+				}
+			}
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+
+	CHECK(mismatches == 0);
+	CHECK(factory.calls == numMaterials);
+	CHECK(cache.GetBindingSetsCreated() == numMaterials);
+	CHECK(cache.GetEntryCount() == numMaterials);
+}
+
+static std::atomic<size_t> g_Sink;
+
+void benchmark_concurrent_lookups()
+{
+	FakeFactory factory;
+	MaterialBindingCache cache(nullptr, factory.get());
+
+	constexpr int numMaterials = 5000;
+	constexpr int lookupsPerThread = 1000000;
+	const int numThreads = std::max(2, int(std::thread::hardware_concurrency()));
+
+	std::vector<std::shared_ptr<Material>> materials;
+	for (int i = 0; i < numMaterials; ++i)
+	{
+		materials.push_back(std::make_shared<Material>());
+		cache.GetMaterialBindingSet(materials.back().get());
+	}
+
+	auto runThreads = [&](auto&& lookup) {
+		std::vector<std::thread> threads;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int t = 0; t < numThreads; ++t)
+		{
+			threads.emplace_back([&, t]() {
+				size_t sink = 0;
+				for (int i = 0; i < lookupsPerThread; ++i)
+					sink += size_t(lookup(materials[(i + t * 977) % numMaterials].get()));
+				g_Sink += sink;
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+		auto end = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration<double, std::nano>(end - start).count() / double(lookupsPerThread);
+	};
+
+	double cacheNs = runThreads([&](const Material* material) { return cache.GetMaterialBindingSet(material); });
+
+	// the previous design: one map keyed by pointer, behind a global mutex
+	std::unordered_map<const Material*, nvrhi::IBindingSet*> lockedMap;
+	std::mutex mutex;
+	for (const auto& material : materials)
+		lockedMap[material.get()] = cache.GetMaterialBindingSet(material.get());
+
+	double lockedNs = runThreads([&](const Material* material) {
+		std::lock_guard<std::mutex> lockGuard(mutex);
+		return lockedMap[material];
+	});
+
+	printf("MaterialBindingCache: %d threads, %.1f ns per lookup round (snapshot), %.1f ns (global mutex)\n",
+		numThreads, cacheNs, lockedNs);
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_lookup_and_versioning();
+		test_pending_textures();
+		test_destroyed_materials();
+		test_concurrent_lookups();
+		benchmark_concurrent_lookups();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,296 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/engine/SceneGraph.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/tests/utils.h>
+
+#include <json/reader.h>
+#include <json/value.h>
+
+using namespace donut;
+using namespace donut::math;
+using namespace donut::engine;
+
+#include <donut/shaders/bindless.h>
+
+static std::shared_ptr<MeshInfo> createMesh()
+{
+	auto material = std::make_shared<Material>();
+	material->domain = MaterialDomain::Opaque;
+
+	auto geometry = std::make_shared<MeshGeometry>();
+	geometry->material = material;
+	geometry->objectSpaceBounds = box3(float3(-0.5f), float3(0.5f));
+
+	auto mesh = std::make_shared<MeshInfo>();
+	mesh->geometries.push_back(geometry);
+	mesh->objectSpaceBounds = geometry->objectSpaceBounds;
+	return mesh;
+}
+
+// 'size' x 'size' instances on the XZ plane, 10 units apart, custom data = original index + 1
+static std::shared_ptr<MeshInstanceArray> createGrid(const std::shared_ptr<MeshInfo>& mesh, int size, uint32_t maxInstancesPerCell)
+{
+	std::vector<affine3> transforms;
+	std::vector<uint32_t> customData;
+	for (int z = 0; z < size; z++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			transforms.push_back(translation(float3(float(x) * 10.f, 0.f, float(z) * 10.f)));
+			customData.push_back(uint32_t(z * size + x + 1));
+		}
+	}
+
+	auto instanceArray = std::make_shared<MeshInstanceArray>(mesh);
+	instanceArray->SetMaxInstancesPerCell(maxInstancesPerCell);
+	instanceArray->SetInstances(std::move(transforms), std::move(customData));
+	return instanceArray;
+}
+
+static float3 originalPosition(int size, uint32_t custom)
+{
+	int index = int(custom) - 1;
+	return float3(float(index % size) * 10.f, 0.f, float(index / size) * 10.f);
+}
+
+void test_cells()
+{
+	const int size = 40;
+	auto instanceArray = createGrid(createMesh(), size, 64);
+
+	CHECK(instanceArray->GetInstanceCount() == size * size);
+	CHECK(instanceArray->GetCustomData().size() == size * size);
+
+	// the cells partition the array into contiguous ranges
+	uint32_t nextInstance = 0;
+	for (const auto& cell : instanceArray->GetCells())
+	{
+		CHECK(cell.firstInstance == nextInstance);
+		CHECK(cell.instanceCount > 0 && cell.instanceCount <= 64);
+		nextInstance += cell.instanceCount;
+
+		for (uint32_t i = cell.firstInstance; i < cell.firstInstance + cell.instanceCount; i++)
+			CHECK(cell.bounds.contains(instanceArray->GetInstanceTransforms()[i].m_translation));
+	}
+	CHECK(nextInstance == size * size);
+
+	// custom data is reordered together with the transforms
+	for (uint32_t i = 0; i < instanceArray->GetInstanceCount(); i++)
+	{
+		float3 position = instanceArray->GetInstanceTransforms()[i].m_translation;
+		CHECK(all(position == originalPosition(size, instanceArray->GetCustomData()[i])));
+	}
+
+	box3 bounds = instanceArray->GetLocalBoundingBox();
+	CHECK(all(bounds.m_mins == float3(-0.5f, -0.5f, -0.5f)));
+	CHECK(all(bounds.m_maxs == float3(390.5f, 0.5f, 390.5f)));
+
+	// mismatched custom data is dropped
+	instanceArray->SetInstances({ affine3::identity(), affine3::identity() }, { 1u });
+	CHECK(instanceArray->GetInstanceCount() == 2);
+	CHECK(instanceArray->GetCustomData().empty());
+	CHECK(instanceArray->GetCells().size() == 1);
+}
+
+void test_culling()
+{
+	const int size = 40;
+	auto instanceArray = createGrid(createMesh(), size, 16);
+
+	std::vector<uint32_t> visibleCells;
+	instanceArray->GetVisibleCells(frustum::infinite(), affine3::identity(), visibleCells);
+	CHECK(visibleCells.size() == instanceArray->GetCells().size());
+
+	// a small box around one corner of the grid
+	box3 region(float3(-5.f, -1.f, -5.f), float3(25.f, 1.f, 25.f));
+	visibleCells.clear();
+	instanceArray->GetVisibleCells(frustum::fromBox(region), affine3::identity(), visibleCells);
+	CHECK(!visibleCells.empty());
+	CHECK(visibleCells.size() < instanceArray->GetCells().size() / 4);
+
+	// every instance inside the region belongs to a visible cell
+	uint32_t visibleInstances = 0;
+	for (uint32_t cellIndex : visibleCells)
+	{
+		const auto& cell = instanceArray->GetCells()[cellIndex];
+		CHECK(region.intersects(cell.bounds));
+
+		for (uint32_t i = cell.firstInstance; i < cell.firstInstance + cell.instanceCount; i++)
+		{
+			if (region.contains(instanceArray->GetInstanceTransforms()[i].m_translation))
+				++visibleInstances;
+		}
+	}
+	CHECK(visibleInstances == 9);
+
+	// the node transform moves the cells
+	visibleCells.clear();
+	instanceArray->GetVisibleCells(frustum::fromBox(region), translation(float3(1000.f, 0.f, 0.f)), visibleCells);
+	CHECK(visibleCells.empty());
+}
+
+void test_scene_graph_integration()
+{
+	auto mesh = createMesh();
+
+	auto graph = std::make_shared<SceneGraph>();
+	auto root = std::make_shared<SceneGraphNode>();
+	graph->SetRootNode(root);
+
+	auto single = graph->AttachLeafNode(root, std::make_shared<MeshInstance>(mesh));
+	auto instanceArray = createGrid(mesh, 10, 32);
+	auto arrayNode = graph->AttachLeafNode(root, instanceArray);
+	arrayNode->SetTranslation(double3(0.0, 100.0, 0.0));
+	auto last = std::make_shared<MeshInstance>(mesh);
+	graph->AttachLeafNode(root, last);
+
+	graph->Refresh(0);
+
+	CHECK(graph->GetMeshes().size() == 1);
+	CHECK(graph->GetMeshInstances().size() == 3);
+	CHECK(graph->GetInstanceDataCount() == 102);
+
+	// instances are numbered in registration order, the array takes one entry per element
+	CHECK(std::dynamic_pointer_cast<MeshInstance>(single->GetLeaf())->GetInstanceIndex() == 0);
+	CHECK(instanceArray->GetInstanceIndex() == 1);
+	CHECK(last->GetInstanceIndex() == 101);
+
+	CHECK((arrayNode->GetLeafContentFlags() & SceneContentFlags::OpaqueMeshes) != 0);
+	CHECK(arrayNode->GetGlobalBoundingBox().m_mins.y == 99.5f);
+	CHECK(root->GetGlobalBoundingBox().m_maxs.x == 90.5f);
+
+	// changing the instance count is a structure change
+	instanceArray->SetInstances({ affine3::identity() });
+	CHECK(graph->HasPendingStructureChanges());
+	graph->Refresh(1);
+	CHECK(graph->GetInstanceDataCount() == 3);
+	CHECK(root->GetGlobalBoundingBox().m_maxs.x == 0.5f);
+
+	// instance data
+	instanceArray = createGrid(mesh, 2, 32);
+	arrayNode->SetLeaf(instanceArray);
+	graph->Refresh(2);
+	CHECK(graph->GetInstanceDataCount() == 6);
+
+	std::vector<InstanceData> instanceData(instanceArray->GetInstanceCount());
+	instanceArray->FillInstanceData(instanceData.data(), arrayNode->GetLocalToWorldTransformFloat(), affine3::identity());
+	for (size_t i = 0; i < instanceData.size(); i++)
+	{
+		const InstanceData& idata = instanceData[i];
+		float3 position = originalPosition(2, idata.customData);
+		CHECK(all(idata.transform.col(3) == position + float3(0.f, 100.f, 0.f)));
+		CHECK(all(idata.prevTransform.col(3) == position));
+		CHECK(idata.numGeometries == 1);
+	}
+}
+
+void test_loading()
+{
+	auto mesh = createMesh();
+	auto source = createGrid(mesh, 8, 16);
+
+	auto blob = source->SaveBinary();
+	CHECK(blob);
+
+	MeshInstanceArray loaded(mesh);
+	CHECK(loaded.LoadBinary(*blob));
+	CHECK(loaded.GetInstanceCount() == source->GetInstanceCount());
+	CHECK(loaded.GetCustomData() == source->GetCustomData());
+	for (uint32_t i = 0; i < loaded.GetInstanceCount(); i++)
+		CHECK(all(loaded.GetInstanceTransforms()[i].m_translation == originalPosition(8, loaded.GetCustomData()[i])));
+
+	vfs::Blob truncated(malloc(blob->size() - 4), blob->size() - 4);
+	memcpy(const_cast<void*>(truncated.data()), blob->data(), truncated.size());
+	MeshInstanceArray invalid(mesh);
+	CHECK(!invalid.LoadBinary(truncated));
+	CHECK(invalid.GetInstanceCount() == 0);
+
+	Json::Value node;
+	Json::Reader reader;
+	CHECK(reader.parse(R"({
+		"type": "MeshInstanceArray",
+		"maxInstancesPerCell": 2,
+		"instances": [
+			[ 1, 2, 3 ],
+			{ "translation": [ 10, 0, 0 ], "scaling": 2, "customData": 7 },
+			{ "translation": [ 20, 0, 0 ], "euler": [ 0, 1.5707964, 0 ] }
+		]
+	})", node));
+
+	auto fromJson = std::dynamic_pointer_cast<MeshInstanceArray>(SceneTypeFactory().CreateLeaf("MeshInstanceArray"));
+	CHECK(fromJson);
+	CHECK(fromJson->SetMesh(mesh));
+	fromJson->Load(node);
+
+	CHECK(fromJson->GetInstanceCount() == 3);
+	CHECK(fromJson->GetMaxInstancesPerCell() == 2);
+	CHECK(fromJson->GetCells().size() == 2);
+	CHECK(fromJson->GetCustomData().size() == 3);
+
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		const affine3& transform = fromJson->GetInstanceTransforms()[i];
+		switch (fromJson->GetCustomData()[i])
+		{
+		case 7:
+			CHECK(all(transform.m_translation == float3(10.f, 0.f, 0.f)));
+			CHECK(transform.m_linear[0][0] == 2.f);
+			break;
+		default:
+			if (transform.m_translation.x == 1.f)
+			{
+				CHECK(all(transform.m_translation == float3(1.f, 2.f, 3.f)));
+			}
+			else
+			{
+				CHECK(fabsf(transform.transformVector(float3(1.f, 0.f, 0.f)).z) > 0.99f);
+			}
+			break;
+		}
+	}
+
+	// the mesh cannot be changed once the leaf is in a graph
+	auto graph = std::make_shared<SceneGraph>();
+	auto root = std::make_shared<SceneGraphNode>();
+	graph->SetRootNode(root);
+	graph->AttachLeafNode(root, fromJson);
+	CHECK(!fromJson->SetMesh(nullptr));
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_cells();
+		test_culling();
+		test_scene_graph_integration();
+		test_loading();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
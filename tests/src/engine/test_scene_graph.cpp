@@ -0,0 +1,367 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/engine/SceneGraph.h>
+#include <donut/core/log.h>
+#include <donut/tests/utils.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <random>
+
+using namespace donut;
+using namespace donut::engine;
+
+// Reference path resolution: splits the path into components and scans the child lists.
+static SceneGraphNode* findNodeLinear(const SceneGraph& graph, const std::string& path, SceneGraphNode* context)
+{
+	if (path.empty())
+		return nullptr;
+
+	size_t pos = 0;
+	if (path[0] == '/')
+	{
+		context = graph.GetRootNode().get();
+		while (pos < path.size() && path[pos] == '/')
+			++pos;
+		if (pos == path.size())
+			return context;
+	}
+
+	std::vector<std::string> components;
+	while (true)
+	{
+		size_t end = path.find('/', pos);
+		components.push_back(path.substr(pos, end == std::string::npos ? std::string::npos : end - pos));
+		if (end == std::string::npos)
+			break;
+		pos = end;
+		while (pos < path.size() && path[pos] == '/')
+			++pos;
+	}
+
+	SceneGraphNode* current = context;
+	for (const std::string& component : components)
+	{
+		if (!current)
+			return nullptr;
+
+		if (component == "..")
+		{
+			current = current->GetParent();
+			continue;
+		}
+
+		SceneGraphNode* child = current->GetFirstChild();
+		while (child && child->GetName() != component)
+			child = child->GetNextSibling();
+		current = child;
+	}
+
+	return current;
+}
+
+static void collectNodes(SceneGraphNode* root, std::vector<std::shared_ptr<SceneGraphNode>>& nodes)
+{
+	nodes.clear();
+	SceneGraphWalker walker(root);
+	while (walker)
+	{
+		nodes.push_back(walker->shared_from_this());
+		walker.Next(true);
+	}
+}
+
+static void verifyChildIndex(SceneGraphNode* root)
+{
+	SceneGraphWalker walker(root);
+	while (walker)
+	{
+		for (SceneGraphNode* child = walker->GetFirstChild(); child; child = child->GetNextSibling())
+		{
+			SceneGraphNode* first = walker->GetFirstChild();
+			while (first->GetName() != child->GetName())
+				first = first->GetNextSibling();
+
+			CHECK(walker->FindChild(child->GetName()) == first);
+			CHECK(child->GetParent() == walker.Get());
+		}
+		walker.Next(true);
+	}
+}
+
+static std::string randomPath(std::mt19937& rng, const std::vector<std::string>& names)
+{
+	std::string path;
+	if (rng() % 4 != 0)
+		path = "/";
+	int components = int(rng() % 5);
+	for (int i = 0; i < components; ++i)
+	{
+		if (i > 0 || (rng() % 8) == 0)
+			path += "/";
+		path += (rng() % 6 == 0) ? ".." : names[rng() % names.size()];
+	}
+	if (rng() % 8 == 0)
+		path += "/";
+	return path;
+}
+
+void test_child_index_under_mutation()
+{
+	const std::vector<std::string> names = { "a", "b", "c", "node", "" };
+
+	std::mt19937 rng(17);
+	auto graph = std::make_shared<SceneGraph>();
+	graph->SetRootNode(std::make_shared<SceneGraphNode>());
+
+	std::vector<std::shared_ptr<SceneGraphNode>> nodes;
+	std::vector<std::shared_ptr<SceneGraphNode>> detached;
+
+	for (int step = 0; step < 4000; ++step)
+	{
+		collectNodes(graph->GetRootNode().get(), nodes);
+		auto& node = nodes[rng() % nodes.size()];
+		auto& other = nodes[rng() % nodes.size()];
+
+		switch (rng() % 8)
+		{
+		case 0:
+		case 1: {
+			auto child = std::make_shared<SceneGraphNode>();
+			child->SetName(names[rng() % names.size()]);
+			graph->Attach(node, child);
+			break;
+		}
+		case 2:
+			node->SetName(names[rng() % names.size()]);
+			break;
+		case 3:
+			node->ReverseChildren();
+			break;
+		case 4:
+			if (node != graph->GetRootNode() && nodes.size() > 16)
+				detached.push_back(graph->Detach(node));
+			break;
+		case 5:
+			if (!detached.empty())
+			{
+				// re-attach a detached subgraph, possibly renamed while outside of the graph
+				auto subgraph = detached.back();
+				detached.pop_back();
+				if (rng() % 2)
+					subgraph->SetName(names[rng() % names.size()]);
+				graph->Attach(node, subgraph);
+			}
+			break;
+		case 6:
+			// attaching a node that is already in the graph makes a copy
+			if (nodes.size() < 200)
+			{
+				bool isAncestor = false;
+				for (SceneGraphNode* p = other.get(); p; p = p->GetParent())
+					isAncestor |= (p == node.get());
+				if (!isAncestor)
+					graph->Attach(other, node);
+			}
+			break;
+		case 7:
+			if (!detached.empty())
+			{
+				// grow a detached subgraph
+				auto child = std::make_shared<SceneGraphNode>();
+				child->SetName(names[rng() % names.size()]);
+				graph->Attach(detached.back(), child);
+			}
+			break;
+		}
+
+		verifyChildIndex(graph->GetRootNode().get());
+		for (const auto& subgraph : detached)
+			verifyChildIndex(subgraph.get());
+
+		collectNodes(graph->GetRootNode().get(), nodes);
+		for (int query = 0; query < 16; ++query)
+		{
+			std::string path = randomPath(rng, names);
+			SceneGraphNode* context = nodes[rng() % nodes.size()].get();
+			SceneGraphNode* expected = findNodeLinear(*graph, path, context);
+			CHECK(graph->FindNode(std::string_view(path), context).get() == expected);
+			CHECK(graph->FindNode(std::filesystem::path(path), context).get() == expected);
+		}
+	}
+}
+
+void test_path_syntax()
+{
+	auto graph = std::make_shared<SceneGraph>();
+	auto root = std::make_shared<SceneGraphNode>();
+	graph->SetRootNode(root);
+
+	auto makeNode = [](const char* name) {
+		auto node = std::make_shared<SceneGraphNode>();
+		node->SetName(name);
+		return node;
+	};
+
+	auto a = graph->Attach(root, makeNode("a"));
+	auto b = graph->Attach(a, makeNode("b"));
+	auto unnamed = graph->Attach(a, makeNode(""));
+	auto dot = graph->Attach(a, makeNode("."));
+
+	CHECK(graph->FindNode("/") == root);
+	CHECK(graph->FindNode("///") == root);
+	CHECK(graph->FindNode("/a") == a);
+	CHECK(graph->FindNode("//a//b") == b);
+	CHECK(graph->FindNode("/a/b/../b") == b);
+	CHECK(graph->FindNode("/a/.") == dot);
+	CHECK(graph->FindNode("/a/") == unnamed);
+	CHECK(graph->FindNode("/b") == nullptr);
+	CHECK(graph->FindNode("/..") == nullptr);
+	CHECK(graph->FindNode("/a/b/c") == nullptr);
+	CHECK(graph->FindNode("") == nullptr);
+	CHECK(graph->FindNode("b", a.get()) == b);
+	CHECK(graph->FindNode("../a/b", a.get()) == b);
+	CHECK(graph->FindNode(std::string("/a/b")) == b);
+	CHECK(graph->FindNode(b->GetPath()) == b);
+
+	std::vector<std::string> messages;
+	log::SetCallback([&messages](log::Severity, const char* message) { messages.push_back(message); });
+	CHECK(graph->FindNode("a") == nullptr);
+	log::ResetCallback();
+	CHECK(messages.size() == 1);
+
+	// duplicates: the first child in sibling order wins, and the next one takes over when it goes away
+	auto b2 = graph->Attach(a, makeNode("b"));
+	CHECK(graph->FindNode("/a/b") == b2);
+	a->ReverseChildren();
+	CHECK(graph->FindNode("/a/b") == b);
+	b->SetName("x");
+	CHECK(graph->FindNode("/a/b") == b2);
+	CHECK(graph->FindNode("/a/x") == b);
+	b->SetName("b");
+	CHECK(graph->FindNode("/a/b") == b);
+	graph->Detach(b);
+	CHECK(graph->FindNode("/a/b") == b2);
+	graph->Detach(b2);
+	CHECK(graph->FindNode("/a/b") == nullptr);
+}
+
+static double timeQueries(const std::vector<std::string>& paths, int repeats, const std::function<bool(const std::string&)>& query)
+{
+	size_t found = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int repeat = 0; repeat < repeats; ++repeat)
+		for (const std::string& path : paths)
+			found += query(path) ? 1 : 0;
+	auto end = std::chrono::high_resolution_clock::now();
+
+	CHECK(found == paths.size() * repeats);
+	return std::chrono::duration<double, std::nano>(end - start).count() / double(paths.size() * repeats);
+}
+
+void benchmark_find_node()
+{
+	auto runBenchmark = [](const char* label, const std::shared_ptr<SceneGraph>& graph, int repeats)
+	{
+		std::vector<std::shared_ptr<SceneGraphNode>> nodes;
+		collectNodes(graph->GetRootNode().get(), nodes);
+
+		// the linear scan is quadratic in the sibling count, so query a sample of the nodes
+		size_t stride = std::max<size_t>(nodes.size() / 1024, 1);
+		std::vector<std::string> paths;
+		for (size_t i = 0; i < nodes.size(); i += stride)
+			paths.push_back(nodes[i]->GetPath().generic_string());
+
+		double linear = timeQueries(paths, repeats, [&graph](const std::string& path) { return findNodeLinear(*graph, path, nullptr) != nullptr; });
+		double indexed = timeQueries(paths, repeats, [&graph](const std::string& path) { return graph->FindNode(std::string_view(path)) != nullptr; });
+		double fsPath = timeQueries(paths, repeats, [&graph](const std::string& path) { return graph->FindNode(std::filesystem::path(path)) != nullptr; });
+
+		printf("FindNode, %s (%zu nodes): linear scan %.0f ns, string_view %.0f ns, filesystem::path %.0f ns per query\n",
+			label, nodes.size(), linear, indexed, fsPath);
+	};
+
+	{
+		// 64 chains of 64 levels, every level has a few siblings
+		auto graph = std::make_shared<SceneGraph>();
+		auto root = std::make_shared<SceneGraphNode>();
+		graph->SetRootNode(root);
+		for (int chain = 0; chain < 64; ++chain)
+		{
+			auto parent = root;
+			for (int depth = 0; depth < 64; ++depth)
+			{
+				auto node = std::make_shared<SceneGraphNode>();
+				node->SetName("chain" + std::to_string(chain) + "_level" + std::to_string(depth));
+				parent = graph->Attach(parent, node);
+			}
+		}
+		runBenchmark("deep", graph, 2);
+	}
+
+	{
+		// 65536 siblings, attached first and named afterwards, every 16th one shares its name with the next one
+		const int siblingCount = 65536;
+		auto graph = std::make_shared<SceneGraph>();
+		auto root = std::make_shared<SceneGraphNode>();
+		graph->SetRootNode(root);
+		auto groupNode = std::make_shared<SceneGraphNode>();
+		groupNode->SetName("group");
+		groupNode = graph->Attach(root, groupNode);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		std::vector<std::shared_ptr<SceneGraphNode>> siblings;
+		for (int i = 0; i < siblingCount; ++i)
+			siblings.push_back(graph->Attach(groupNode, std::make_shared<SceneGraphNode>()));
+		for (int i = 0; i < siblingCount; ++i)
+			siblings[i]->SetName("instance" + std::to_string(i % 16 == 0 ? i + 1 : i));
+		auto end = std::chrono::high_resolution_clock::now();
+
+		// siblings are attached at the front, so the one with the higher index comes first
+		CHECK(groupNode->FindChild("instance1") == siblings[1].get());
+		graph->Detach(siblings[1]);
+		CHECK(groupNode->FindChild("instance1") == siblings[0].get());
+		CHECK(groupNode->FindChild("instance2") == siblings[2].get());
+
+		printf("Attach + SetName, %d siblings: %.2f ms\n", siblingCount,
+			std::chrono::duration<double, std::milli>(end - start).count());
+
+		runBenchmark("wide", graph, 1);
+	}
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_path_syntax();
+		test_child_index_under_mutation();
+		benchmark_find_node();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,757 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/engine/SceneLoader.h>
+#include <donut/core/json_stream.h>
+#include <donut/core/log.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/tests/utils.h>
+
+#include <json/value.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <sstream>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
+using namespace donut;
+using namespace donut::math;
+using namespace donut::engine;
+
+#include <donut/shaders/bindless.h>
+
+// Allocation tracking for the benchmark: every block carries its size in a header.
+
+static std::atomic<size_t> g_AllocatedBytes{ 0 };
+static std::atomic<size_t> g_PeakAllocatedBytes{ 0 };
+
+static constexpr size_t c_AllocationHeader = 16;
+
+void* operator new(size_t size)
+{
+	void* block = malloc(size + c_AllocationHeader);
+	if (!block)
+		throw std::bad_alloc();
+	*static_cast<size_t*>(block) = size;
+
+	size_t current = g_AllocatedBytes.fetch_add(size) + size;
+	size_t peak = g_PeakAllocatedBytes.load();
+	while (current > peak && !g_PeakAllocatedBytes.compare_exchange_weak(peak, current))
+		;
+
+	return static_cast<char*>(block) + c_AllocationHeader;
+}
+
+void operator delete(void* ptr) noexcept
+{
+	if (!ptr)
+		return;
+	void* block = static_cast<char*>(ptr) - c_AllocationHeader;
+	g_AllocatedBytes.fetch_sub(*static_cast<size_t*>(block));
+	free(block);
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete[](void* ptr) noexcept { operator delete(ptr); }
+void operator delete(void* ptr, size_t) noexcept { operator delete(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { operator delete(ptr); }
+
+// Random scene descriptions. The members of every object are shuffled, and all
+// the kinds of invalid entries that the loader warns about are represented.
+
+class SceneGenerator
+{
+public:
+	explicit SceneGenerator(uint32_t seed, int nodeCount, int animationCount)
+		: m_Rng(seed)
+		, m_NodesLeft(nodeCount)
+		, m_AnimationCount(animationCount)
+	{ }
+
+	std::string Generate()
+	{
+		std::string graph = "[";
+		bool first = true;
+		while (m_NodesLeft > 0)
+		{
+			if (!first)
+				graph += ",";
+			first = false;
+			graph += Pad() + Node("", 0);
+		}
+		graph += "]";
+
+		std::string animations = "[";
+		for (int i = 0; i < m_AnimationCount; i++)
+		{
+			if (i)
+				animations += ",";
+			animations += Pad() + Animation(i);
+		}
+		animations += "]";
+
+		return Object({
+			{ "models", "[\"a.gltf\", \"b.gltf\", \"c.gltf\", \"d.gltf\"]" },
+			{ "graph", graph },
+			{ "animations", animations },
+			{ "helpers", "[[0, 1, 0]]" },
+			{ "custom", "{ \"value\": 1 }" }
+		});
+	}
+
+private:
+	using Members = std::vector<std::pair<std::string, std::string>>;
+
+	std::mt19937 m_Rng;
+	int m_NodesLeft;
+	int m_AnimationCount;
+	int m_NextName = 0;
+	std::vector<std::string> m_Paths;
+
+	int Random(int count) { return int(m_Rng() % uint32_t(count)); }
+	bool Chance(int percent) { return Random(100) < percent; }
+
+	std::string Number()
+	{
+		static const char* numbers[] = { "0", "1", "-2", "0.5", "-1.25", "3e-1", "10", "1E1" };
+		return numbers[Random(8)];
+	}
+
+	std::string Pad()
+	{
+		switch (Random(10))
+		{
+		case 0: return " ";
+		case 1: return "\n  ";
+		case 2: return "/* comment */";
+		case 3: return "// comment\n";
+		default: return "";
+		}
+	}
+
+	std::string Object(Members members)
+	{
+		std::shuffle(members.begin(), members.end(), m_Rng);
+		std::string result = "{";
+		for (size_t i = 0; i < members.size(); i++)
+		{
+			if (i)
+				result += ",";
+			result += Pad() + "\"" + members[i].first + "\":" + Pad() + members[i].second;
+		}
+		if (!members.empty() && Chance(10))
+			result += ",";
+		return result + Pad() + "}";
+	}
+
+	std::string Vector(int size)
+	{
+		switch (Random(12))
+		{
+		case 0: return Number();                                // broadcast
+		case 1: return "[1, 2]";                                // wrong size, default
+		case 2: return "\"text\"";                              // default
+		case 3: return "null";                                  // ignored
+		case 4: return "{}";                                    // default
+		case 5: return "[1, \"a\"]";                            // wrong size, read as a document
+		case 6: return size == 3 ? "[true, null, 2]" : "[true, null, 2, false]";
+		default: {
+			std::string result = "[";
+			for (int i = 0; i < size; i++)
+				result += (i ? ", " : "") + Number();
+			return result + "]";
+		}
+		}
+	}
+
+	std::string Path()
+	{
+		if (m_Paths.empty() || Chance(10))
+			return "\"/missing\"";
+		if (Chance(5))
+			return "\"relative\"";
+		return "\"" + m_Paths[Random(int(m_Paths.size()))] + "\"";
+	}
+
+	std::string Leaf(Members& members)
+	{
+		switch (Random(8))
+		{
+		case 0:
+			members.push_back({ "irradiance", Number() });
+			members.push_back({ "angularSize", Number() });
+			members.push_back({ "color", "[1, 0.5, 0.25]" });
+			return "\"DirectionalLight\"";
+		case 1:
+			members.push_back({ "intensity", Number() });
+			members.push_back({ "radius", Number() });
+			members.push_back({ "range", Number() });
+			return "\"PointLight\"";
+		case 2:
+			members.push_back({ "intensity", Number() });
+			members.push_back({ "innerAngle", "20" });
+			members.push_back({ "outerAngle", "40" });
+			return "\"SpotLight\"";
+		case 3:
+			members.push_back({ "verticalFov", Number() });
+			members.push_back({ "zNear", "0.1" });
+			if (Chance(50))
+				members.push_back({ "zFar", "100" });
+			return "\"PerspectiveCamera\"";
+		case 4:
+			members.push_back({ "xMag", Number() });
+			members.push_back({ "yMag", Number() });
+			return "\"OrthographicCamera\"";
+		case 5:
+			return "\"NoSuchType\"";
+		case 6:
+			return "5";
+		default:
+			return "null";
+		}
+	}
+
+	std::string Node(const std::string& parentPath, int depth)
+	{
+		--m_NodesLeft;
+
+		if (Chance(2))
+			return Chance(50) ? "42" : "\"not a node\"";
+
+		Members members;
+
+		int nameIndex = m_NextName++;
+		std::string name;
+		if (Chance(90))
+		{
+			bool escaped = Chance(10);
+			name = (escaped ? "n\xc3\xa9_" : "node_") + std::to_string(nameIndex);
+			members.push_back({ "name", escaped ? "\"n\\u00e9_" + std::to_string(nameIndex) + "\"" : "\"" + name + "\"" });
+			m_Paths.push_back(parentPath + "/" + name);
+		}
+		else if (Chance(50))
+			members.push_back({ "name", "7" });
+
+		if (Chance(8))
+			members.push_back({ "parent", Chance(85) ? Path() : "3" });
+
+		// Referencing a model copies its current subgraph, keep model nodes as leaves
+		// so that the copies don't grow with the graph
+		bool hasModel = depth == 0 && Chance(8);
+		if (hasModel)
+		{
+			static const char* models[] = { "0", "1", "2", "3", "0", "1", "-1", "4", "\"0\"", "1.0", "[]" };
+			members.push_back({ "model", models[Random(11)] });
+		}
+
+		if (Chance(60))
+			members.push_back({ "translation", Vector(3) });
+		if (Chance(30))
+			members.push_back({ "rotation", Vector(4) });
+		if (Chance(20))
+			members.push_back({ "euler", Vector(3) });
+		if (Chance(30))
+			members.push_back({ "scaling", Vector(3) });
+		if (Chance(5))
+			members.push_back({ "translation", Vector(3) });   // duplicate, the last one wins
+
+		if (Chance(50))
+			members.push_back({ "type", Leaf(members) });
+
+		if (Chance(5))
+			members.push_back({ "unknown", "{ \"nested\": [1, { \"a\": null }] }" });
+
+		if (!hasModel && depth < 5 && m_NodesLeft > 0 && Chance(40))
+		{
+			std::string path = parentPath + "/" + name;
+			int childCount = 1 + Random(4);
+			std::string children;
+			if (Chance(5))
+			{
+				// an object of nodes instead of an array
+				children = "{ \"first\": " + Node(path, depth + 1) + " }";
+			}
+			else
+			{
+				children = "[";
+				for (int i = 0; i < childCount && m_NodesLeft > 0; i++)
+				{
+					if (i)
+						children += ",";
+					children += Pad() + Node(path, depth + 1);
+				}
+				children += "]";
+			}
+			members.push_back({ "children", children });
+		}
+		else if (!hasModel && Chance(5))
+			members.push_back({ "children", Chance(50) ? "[]" : "null" });
+
+		return Object(std::move(members));
+	}
+
+	std::string Keyframe()
+	{
+		Members members;
+		if (Chance(95))
+			members.push_back({ "time", Chance(95) ? Number() : "\"soon\"" });
+		if (Chance(90))
+			members.push_back({ "value", Chance(50) ? Number() : "[" + Number() + ", " + Number() + ", " + Number() + ", 1, \"ignored\"]" });
+		if (Chance(20))
+			members.push_back({ "inTangent", "[0, 1]" });
+		if (Chance(20))
+			members.push_back({ "outTangent", "\"none\"" });
+		return Object(std::move(members));
+	}
+
+	std::string Channel()
+	{
+		if (Chance(3))
+			return "null";
+
+		Members members;
+
+		static const char* modes[] = { "\"step\"", "\"linear\"", "\"slerp\"", "\"hermite\"", "\"catmull-rom\"", "\"cubic\"", "1" };
+		if (Chance(90))
+			members.push_back({ "mode", modes[Random(7)] });
+
+		static const char* attributes[] = { "\"translation\"", "\"rotation\"", "\"scaling\"", "\"intensity\"", "\"\"", "true" };
+		if (Chance(95))
+			members.push_back({ "attribute", attributes[Random(6)] });
+
+		std::string data = "[";
+		int keyframeCount = Random(5);
+		for (int i = 0; i < keyframeCount; i++)
+			data += (i ? "," : "") + Keyframe();
+		members.push_back({ "data", data + "]" });
+
+		if (Chance(60))
+			members.push_back({ "target", Chance(10) ? "\"material:mat_1\"" : Chance(5) ? "\"material:none\"" : Chance(5) ? "[]" : Path() });
+		if (Chance(40))
+			members.push_back({ "targets", "[" + Path() + ", " + Path() + ", null, 2]" });
+
+		return Object(std::move(members));
+	}
+
+	std::string Animation(int index)
+	{
+		if (Chance(2))
+			return "null";
+
+		Members members;
+		if (Chance(90))
+			members.push_back({ "name", "\"animation_" + std::to_string(index) + "\"" });
+
+		std::string channels = "[";
+		int channelCount = Random(4);
+		for (int i = 0; i < channelCount; i++)
+			channels += (i ? "," : "") + Channel();
+		members.push_back({ "channels", channels + "]" });
+
+		return Object(std::move(members));
+	}
+};
+
+// Stand-ins for the imported glTF models. Every graph gets its own copies, since the
+// first reference to a model moves it into the graph.
+static std::vector<SceneImportResult> createModels()
+{
+	std::vector<SceneImportResult> models(4);
+	for (int index = 0; index < 3; index++)
+	{
+		auto material = std::make_shared<Material>();
+		material->name = "mat_" + std::to_string(index);
+
+		auto geometry = std::make_shared<MeshGeometry>();
+		geometry->material = material;
+
+		auto mesh = std::make_shared<MeshInfo>();
+		mesh->name = "mesh_" + std::to_string(index);
+		mesh->geometries.push_back(geometry);
+
+		// like the glTF importer, build the model in a temporary graph
+		auto modelGraph = std::make_shared<SceneGraph>();
+		auto root = std::make_shared<SceneGraphNode>();
+		modelGraph->SetRootNode(root);
+		auto meshNode = modelGraph->AttachLeafNode(root, std::make_shared<MeshInstance>(mesh));
+		meshNode->SetName("mesh");
+		meshNode->SetTranslation(double3(double(index), 0.0, 0.0));
+
+		models[index].rootNode = root;
+	}
+	// models[3] failed to load
+	return models;
+}
+
+struct LoadResult
+{
+	std::shared_ptr<SceneGraph> graph;
+	std::vector<std::string> messages;
+	Json::Value sections;
+};
+
+static std::shared_ptr<SceneGraph> createGraph()
+{
+	auto graph = std::make_shared<SceneGraph>();
+	auto root = std::make_shared<SceneGraphNode>();
+	root->SetName("SceneRoot");
+	graph->SetRootNode(root);
+	return graph;
+}
+
+static std::vector<std::string>* g_Messages = nullptr;
+
+static void captureMessages(std::vector<std::string>* messages)
+{
+	g_Messages = messages;
+	if (messages)
+		log::SetCallback([](log::Severity, const char* message) { g_Messages->push_back(message); });
+	else
+		log::ResetCallback();
+}
+
+static LoadResult loadDocument(const std::string& text)
+{
+	LoadResult result;
+	result.graph = createGraph();
+
+	Json::Value document;
+	CHECK(json::Parse(text.data(), text.data() + text.size(), document));
+
+	auto models = createModels();
+	captureMessages(&result.messages);
+	SceneLoader loader(result.graph, std::make_shared<SceneTypeFactory>(), nullptr, "");
+	loader.LoadSceneGraph(document["graph"], result.graph->GetRootNode(), models);
+	loader.LoadAnimations(document["animations"]);
+	captureMessages(nullptr);
+
+	return result;
+}
+
+static LoadResult loadStreaming(const std::string& text, tf::Executor* executor)
+{
+	LoadResult result;
+	result.graph = createGraph();
+
+	void* data = malloc(text.size());
+	memcpy(data, text.data(), text.size());
+	auto blob = std::make_shared<vfs::Blob>(data, text.size());
+
+	auto models = createModels();
+	captureMessages(&result.messages);
+	SceneLoader loader(result.graph, std::make_shared<SceneTypeFactory>(), nullptr, "");
+	CHECK(loader.Parse(blob, "scene.json", result.sections));
+	loader.Build(result.graph->GetRootNode(), models, executor);
+	captureMessages(nullptr);
+
+	return result;
+}
+
+static void compareLeaves(const std::shared_ptr<SceneGraphLeaf>& a, const std::shared_ptr<SceneGraphLeaf>& b)
+{
+	CHECK(!a == !b);
+	if (!a)
+		return;
+
+	CHECK(typeid(*a) == typeid(*b));
+
+	if (auto lightA = std::dynamic_pointer_cast<Light>(a))
+	{
+		Json::Value storeA, storeB;
+		lightA->Store(storeA);
+		std::static_pointer_cast<Light>(b)->Store(storeB);
+		CHECK(storeA == storeB);
+		CHECK(all(lightA->color == std::static_pointer_cast<Light>(b)->color));
+	}
+	else if (auto cameraA = std::dynamic_pointer_cast<PerspectiveCamera>(a))
+	{
+		auto cameraB = std::static_pointer_cast<PerspectiveCamera>(b);
+		CHECK(cameraA->verticalFov == cameraB->verticalFov && cameraA->zNear == cameraB->zNear);
+		CHECK(cameraA->zFar == cameraB->zFar && cameraA->aspectRatio == cameraB->aspectRatio);
+	}
+	else if (auto orthoA = std::dynamic_pointer_cast<OrthographicCamera>(a))
+	{
+		auto orthoB = std::static_pointer_cast<OrthographicCamera>(b);
+		CHECK(orthoA->xMag == orthoB->xMag && orthoA->yMag == orthoB->yMag);
+		CHECK(orthoA->zNear == orthoB->zNear && orthoA->zFar == orthoB->zFar);
+	}
+	else if (auto meshA = std::dynamic_pointer_cast<MeshInstance>(a))
+	{
+		CHECK(meshA->GetMesh()->name == std::static_pointer_cast<MeshInstance>(b)->GetMesh()->name);
+	}
+	else if (auto animationA = std::dynamic_pointer_cast<SceneGraphAnimation>(a))
+	{
+		auto animationB = std::static_pointer_cast<SceneGraphAnimation>(b);
+		CHECK(animationA->GetName() == animationB->GetName());
+		CHECK(animationA->GetChannels().size() == animationB->GetChannels().size());
+		for (size_t i = 0; i < animationA->GetChannels().size(); i++)
+		{
+			const auto& channelA = *animationA->GetChannels()[i];
+			const auto& channelB = *animationB->GetChannels()[i];
+			CHECK(channelA.GetAttribute() == channelB.GetAttribute());
+			CHECK(channelA.GetLeafPropertyName() == channelB.GetLeafPropertyName());
+
+			auto targetA = channelA.GetTargetNode();
+			auto targetB = channelB.GetTargetNode();
+			CHECK(!targetA == !targetB);
+			if (targetA)
+				CHECK(targetA->GetName() == targetB->GetName() && all(targetA->GetTranslation() == targetB->GetTranslation()));
+
+			auto& samplerA = *channelA.GetSampler();
+			auto& samplerB = *channelB.GetSampler();
+			CHECK(samplerA.GetMode() == samplerB.GetMode());
+			CHECK(samplerA.GetKeyframes().size() == samplerB.GetKeyframes().size());
+			for (size_t k = 0; k < samplerA.GetKeyframes().size(); k++)
+			{
+				const auto& keyA = samplerA.GetKeyframes()[k];
+				const auto& keyB = samplerB.GetKeyframes()[k];
+				CHECK(keyA.time == keyB.time && all(keyA.value == keyB.value));
+				CHECK(all(keyA.inTangent == keyB.inTangent) && all(keyA.outTangent == keyB.outTangent));
+			}
+		}
+	}
+}
+
+static size_t compareGraphs(const LoadResult& a, const LoadResult& b)
+{
+	SceneGraphWalker walkerA(a.graph->GetRootNode().get());
+	SceneGraphWalker walkerB(b.graph->GetRootNode().get());
+
+	size_t nodeCount = 0;
+	while (walkerA && walkerB)
+	{
+		CHECK(walkerA->GetName() == walkerB->GetName());
+		CHECK(all(walkerA->GetTranslation() == walkerB->GetTranslation()));
+		CHECK(all(walkerA->GetScaling() == walkerB->GetScaling()));
+		CHECK(all(walkerA->GetRotation() == walkerB->GetRotation()));
+		compareLeaves(walkerA->GetLeaf(), walkerB->GetLeaf());
+
+		int depthA = walkerA.Next(true);
+		int depthB = walkerB.Next(true);
+		CHECK(depthA == depthB);
+		++nodeCount;
+	}
+	CHECK(!walkerA && !walkerB);
+
+	CHECK(a.graph->GetLights().size() == b.graph->GetLights().size());
+	CHECK(a.graph->GetCameras().size() == b.graph->GetCameras().size());
+	CHECK(a.graph->GetAnimations().size() == b.graph->GetAnimations().size());
+	CHECK(a.graph->GetMeshInstances().size() == b.graph->GetMeshInstances().size());
+
+	// the same warnings, in the same order
+	CHECK(a.messages == b.messages);
+
+	return nodeCount;
+}
+
+void test_generated_scenes()
+{
+#ifdef DONUT_WITH_TASKFLOW
+	tf::Executor executor(4);
+	tf::Executor* executorPtr = &executor;
+#else
+	tf::Executor* executorPtr = nullptr;
+#endif
+
+	for (uint32_t seed = 1; seed <= 40; seed++)
+	{
+		SceneGenerator generator(seed, 20 + int(seed) * 5, int(seed % 8) * 3);
+		std::string text = generator.Generate();
+
+		LoadResult reference = loadDocument(text);
+		LoadResult streamed = loadStreaming(text, executorPtr);
+		LoadResult serial = loadStreaming(text, nullptr);
+
+		size_t nodeCount = compareGraphs(reference, streamed);
+		CHECK(nodeCount > 1);
+		compareGraphs(reference, serial);
+
+		// the other sections are passed through
+		CHECK(streamed.sections.isMember("models") && streamed.sections["models"].size() == 4);
+		CHECK(streamed.sections["custom"]["value"].asInt() == 1);
+		CHECK(streamed.sections.isMember("helpers"));
+		CHECK(!streamed.sections.isMember("graph") && !streamed.sections.isMember("animations"));
+	}
+}
+
+void test_special_cases()
+{
+	const char* scenes[] = {
+		// no graph or animations
+		"{ \"models\": [] }",
+		// sections that are not arrays
+		"{ \"graph\": { \"a\": { \"name\": \"x\" } }, \"animations\": null }",
+		"{ \"graph\": 5, \"animations\": {} }",
+		// duplicate sections and members, the last one wins
+		"{ \"graph\": [{ \"name\": \"a\" }], \"graph\": [{ \"name\": \"b\", \"name\": \"c\", \"children\": [{}], \"children\": null }] }",
+		// a value that the document path never converts makes the animations fall back to the document
+		"{ \"graph\": [{ \"name\": \"a\" }], \"animations\": [{ \"name\": \"anim\", \"channels\": [{ \"attribute\": \"translation\", \"target\": \"/a\", "
+			"\"data\": [{ \"time\": \"late\", \"value\": [\"x\"] }, { \"time\": 1, \"value\": 2 }] }] }] }",
+		"{ \"graph\": [{ \"name\": \"a\" }], \"animations\": [{ \"channels\": [{ \"attribute\": \"scaling\", \"target\": \"/a\", "
+			"\"data\": { \"key\": { \"time\": 0, \"value\": 1 } } }] }] }",
+		// targets that depend on the animations attached before them
+		"{ \"graph\": [{ \"name\": \"Animations\", \"children\": [{ \"name\": \"x\" }] }], \"animations\": ["
+			"{ \"name\": \"first\", \"channels\": [{ \"attribute\": \"translation\", \"target\": \"/Animations/x\", \"data\": [{ \"time\": 0 }] }] },"
+			"{ \"name\": \"second\", \"channels\": [{ \"attribute\": \"translation\", \"target\": \"/Animations/x\", \"data\": [{ \"time\": 0 }] }] },"
+			"{ \"name\": \"third\", \"channels\": [{ \"attribute\": \"translation\", \"targets\": [\"/Animations\", \"x\"], \"data\": [] }] }] }"
+	};
+
+	for (const char* scene : scenes)
+	{
+		LoadResult reference = loadDocument(scene);
+		LoadResult streamed = loadStreaming(scene, nullptr);
+		compareGraphs(reference, streamed);
+	}
+
+	// parse errors are reported with the file name
+	std::vector<std::string> messages;
+	captureMessages(&messages);
+	{
+		std::string text = "{ \"graph\": [{ \"name\": \"a\" } }";
+		void* data = malloc(text.size());
+		memcpy(data, text.data(), text.size());
+		SceneLoader loader(createGraph(), std::make_shared<SceneTypeFactory>(), nullptr, "");
+		Json::Value sections;
+		CHECK(!loader.Parse(std::make_shared<vfs::Blob>(data, text.size()), "broken.json", sections));
+	}
+	captureMessages(nullptr);
+	CHECK(messages.size() == 1 && messages[0].find("broken.json") != std::string::npos);
+}
+
+void test_leaf_members()
+{
+	// the leaf members may come before the type and around the children
+	const char* scene = "{ \"graph\": [{ \"name\": \"lamp\", \"color\": [1, 0.5, 0.25], \"translation\": [1, 2, 3], "
+		"\"children\": [{ \"name\": \"child\", \"radius\": 7 }], \"radius\": 2, \"type\": \"PointLight\" }] }";
+
+	LoadResult reference = loadDocument(scene);
+	LoadResult streamed = loadStreaming(scene, nullptr);
+	compareGraphs(reference, streamed);
+
+	auto node = streamed.graph->FindNode("/lamp");
+	CHECK(node && all(node->GetTranslation() == double3(1.0, 2.0, 3.0)));
+	auto light = std::dynamic_pointer_cast<PointLight>(node->GetLeaf());
+	CHECK(light);
+	CHECK(all(light->color == float3(1.f, 0.5f, 0.25f)));
+	CHECK(light->radius == 2.f);
+
+	auto child = streamed.graph->FindNode("/lamp/child");
+	CHECK(child && !child->GetLeaf());
+}
+
+void benchmark_scene_loading()
+{
+	SceneGenerator generator(7, 30000, 300);
+	std::string text = generator.Generate();
+
+	log::SetCallback([](log::Severity, const char*) { });
+
+	using Clock = std::chrono::high_resolution_clock;
+	auto milliseconds = [](Clock::time_point begin, Clock::time_point end)
+	{
+		return std::chrono::duration<double, std::milli>(end - begin).count();
+	};
+
+	// Parse time, build time and peak allocation of a load; the scene description
+	// itself is allocated outside of the measurement.
+	auto measure = [&](const char* name, auto&& parse, auto&& build)
+	{
+		size_t baseline = g_AllocatedBytes.load();
+		g_PeakAllocatedBytes.store(baseline);
+
+		auto graph = createGraph();
+		auto models = createModels();
+
+		auto start = Clock::now();
+		parse(graph);
+		auto parsed = Clock::now();
+		build(graph, models);
+		auto end = Clock::now();
+
+		size_t peak = g_PeakAllocatedBytes.load() - baseline;
+		size_t retained = g_AllocatedBytes.load() - baseline;
+
+		printf("scene loader, %s: parse %.2f ms, build %.2f ms, peak %.1f KB (graph %.1f KB)\n", name,
+			milliseconds(start, parsed), milliseconds(parsed, end), double(peak) / 1024.0, double(retained) / 1024.0);
+	};
+
+	printf("scene loader: %.1f KB scene description\n", double(text.size()) / 1024.0);
+
+	{
+		Json::Value document;
+		measure("document",
+			[&](const std::shared_ptr<SceneGraph>&) { json::Parse(text.data(), text.data() + text.size(), document); },
+			[&](const std::shared_ptr<SceneGraph>& graph, const std::vector<SceneImportResult>& models)
+			{
+				SceneLoader loader(graph, std::make_shared<SceneTypeFactory>(), nullptr, "");
+				loader.LoadSceneGraph(document["graph"], graph->GetRootNode(), models);
+				loader.LoadAnimations(document["animations"]);
+				document = Json::Value();
+			});
+	}
+
+	{
+		void* data = malloc(text.size());
+		memcpy(data, text.data(), text.size());
+		auto blob = std::make_shared<vfs::Blob>(data, text.size());
+
+		std::unique_ptr<SceneLoader> loader;
+		Json::Value sections;
+		measure("streaming",
+			[&](const std::shared_ptr<SceneGraph>& graph)
+			{
+				loader = std::make_unique<SceneLoader>(graph, std::make_shared<SceneTypeFactory>(), nullptr, "");
+				loader->Parse(blob, "scene.json", sections);
+			},
+			[&](const std::shared_ptr<SceneGraph>& graph, const std::vector<SceneImportResult>& models)
+			{
+				loader->Build(graph->GetRootNode(), models, nullptr);
+				loader.reset();
+			});
+	}
+
+	log::ResetCallback();
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_generated_scenes();
+		test_special_cases();
+		test_leaf_members();
+		benchmark_scene_loading();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
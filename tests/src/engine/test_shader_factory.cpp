@@ -0,0 +1,246 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/engine/ShaderFactory.h>
+#include <donut/core/vfs/Compression.h>
+#include <donut/core/vfs/TarFile.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/tests/utils.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
+using namespace donut;
+using namespace donut::engine;
+
+// Shader binaries used by the tests: path relative to the shader directory and contents.
+static const std::vector<std::pair<std::string, std::string>> g_Shaders = {
+	{ "passes/bloom_ps.bin", "bloom bytecode" },
+	{ "passes/sky_ps.bin", "sky bytecode" },
+	{ "passes/ssao_compute_cs.bin", std::string(100000, 's') },
+	{ "fullscreen_vs.bin", "fullscreen bytecode" },
+	{ "deep/nested/path/shader_main_cs.bin", "nested bytecode" },
+};
+
+static std::filesystem::path getTestDirectory()
+{
+	std::filesystem::path path = std::filesystem::temp_directory_path() / "donut_test_shader_factory";
+	std::filesystem::remove_all(path);
+	std::filesystem::create_directories(path);
+	return path;
+}
+
+// Writes the shaders into a native directory, with every other file compressed.
+static void writeNativeShaders(const std::filesystem::path& shaderDir)
+{
+	auto nativeFS = std::make_shared<vfs::NativeFileSystem>();
+	vfs::CompressionLayer compressionLayer(nativeFS);
+
+	for (size_t i = 0; i < g_Shaders.size(); i++)
+	{
+		std::filesystem::path path = shaderDir / g_Shaders[i].first;
+		std::filesystem::create_directories(path.parent_path());
+		if (i & 1)
+			path += ".lz4";
+		CHECK(compressionLayer.writeFile(path, g_Shaders[i].second.data(), g_Shaders[i].second.size()));
+	}
+}
+
+// Minimal ustar writer - only what TarFile needs to enumerate and read the files.
+static void writeTarEntry(std::ofstream& tar, const std::string& name, const std::string& data)
+{
+	char header[512] = {};
+	strncpy(header, name.c_str(), 100);
+	snprintf(header + 124, 12, "%011o", unsigned(data.size()));
+	header[156] = '0';
+	memcpy(header + 257, "ustar", 5);
+	tar.write(header, sizeof(header));
+	tar.write(data.data(), data.size());
+
+	char padding[512] = {};
+	tar.write(padding, (512 - data.size() % 512) % 512);
+}
+
+static void writeTarShaders(const std::filesystem::path& tarFile)
+{
+	std::ofstream tar(tarFile, std::ios::binary);
+	for (const auto& [name, data] : g_Shaders)
+		writeTarEntry(tar, "shaders/" + name, data);
+	char end[1024] = {};
+	tar.write(end, sizeof(end));
+}
+
+static void checkBytecode(ShaderFactory& factory, const char* fileName, const char* entryName, const std::string& expected)
+{
+	std::shared_ptr<vfs::IBlob> blob = factory.GetBytecode(fileName, entryName);
+	CHECK(blob && blob->size() == expected.size());
+	CHECK(memcmp(blob->data(), expected.data(), expected.size()) == 0);
+}
+
+void test_bytecode_cache(const std::shared_ptr<vfs::IFileSystem>& fs, const std::filesystem::path& basePath)
+{
+	ShaderFactory factory(nullptr, fs, basePath);
+
+	checkBytecode(factory, "passes/bloom_ps.hlsl", "main", g_Shaders[0].second);
+	checkBytecode(factory, "passes/bloom_ps.hlsl", nullptr, g_Shaders[0].second);
+	checkBytecode(factory, "passes/ssao_compute_cs.hlsl", nullptr, g_Shaders[2].second);
+	checkBytecode(factory, "deep/nested/path/shader.hlsl", "main_cs", g_Shaders[4].second);
+	CHECK(factory.GetBytecode("missing.hlsl", nullptr) == nullptr);
+
+	ShaderFactoryStats stats = factory.GetStats();
+	CHECK(stats.cacheHits == 1);
+	CHECK(stats.cacheMisses == 4);
+	CHECK(stats.filesLoaded == 3);
+	CHECK(stats.bytesLoaded == g_Shaders[0].second.size() + g_Shaders[2].second.size() + g_Shaders[4].second.size());
+
+	factory.ResetStats();
+	CHECK(factory.GetStats().cacheMisses == 0);
+}
+
+void test_concurrent_access(const std::shared_ptr<vfs::IFileSystem>& fs, const std::filesystem::path& basePath)
+{
+	ShaderFactory factory(nullptr, fs, basePath);
+
+	std::vector<std::thread> threads;
+	std::atomic<int> failures = 0;
+	for (int t = 0; t < 8; ++t)
+	{
+		threads.emplace_back([&factory, &failures]()
+		{
+			for (int i = 0; i < 100; ++i)
+			{
+				const auto& [name, data] = g_Shaders[i % g_Shaders.size()];
+				std::string shaderName = name.substr(0, name.size() - 4) + ".hlsl";
+				std::shared_ptr<vfs::IBlob> blob = factory.GetBytecode(shaderName.c_str(), nullptr);
+				if (!blob || blob->size() != data.size())
+					++failures;
+			}
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+
+	CHECK(failures == 0);
+
+	ShaderFactoryStats stats = factory.GetStats();
+	CHECK(stats.cacheHits + stats.cacheMisses == 800);
+	CHECK(stats.filesLoaded == g_Shaders.size());
+}
+
+void test_prefetch(const std::shared_ptr<vfs::IFileSystem>& fs, const std::filesystem::path& basePath, const std::filesystem::path& tempDir, tf::Executor* executor)
+{
+	// directory prefetch finds all files, including nested and compressed ones
+	{
+		ShaderFactory factory(nullptr, fs, basePath);
+		CHECK(factory.PrefetchDirectory("", executor) == g_Shaders.size());
+		CHECK(factory.PrefetchDirectory("passes", executor) == 0);
+
+		checkBytecode(factory, "passes/sky_ps.hlsl", nullptr, g_Shaders[1].second);
+		checkBytecode(factory, "deep/nested/path/shader.hlsl", "main_cs", g_Shaders[4].second);
+
+		ShaderFactoryStats stats = factory.GetStats();
+		CHECK(stats.filesPrefetched == g_Shaders.size());
+		CHECK(stats.cacheMisses == 0 && stats.cacheHits == 2);
+
+		// round trip through a manifest
+		CHECK(factory.WriteManifest(tempDir / "manifest.txt"));
+
+		ShaderFactory factory2(nullptr, fs, basePath);
+		CHECK(factory2.PrefetchFromManifest("/temp/manifest.txt", executor) == g_Shaders.size());
+		checkBytecode(factory2, "fullscreen_vs.hlsl", nullptr, g_Shaders[3].second);
+		CHECK(factory2.GetStats().cacheMisses == 0);
+
+		// after a reload, the manifest lists each file once
+		factory.ClearCache();
+		checkBytecode(factory, "passes/sky_ps.hlsl", nullptr, g_Shaders[1].second);
+		checkBytecode(factory, "passes/sky_ps.hlsl", nullptr, g_Shaders[1].second);
+		CHECK(factory.WriteManifest(tempDir / "manifest3.txt"));
+
+		std::ifstream manifest(tempDir / "manifest3.txt");
+		std::vector<std::string> lines;
+		for (std::string line; std::getline(manifest, line); )
+			lines.push_back(line);
+		CHECK(lines.size() == 1);
+	}
+
+	// manifest with comments, blank lines, CRLF line endings and missing files
+	{
+		std::ofstream(tempDir / "manifest2.txt", std::ios::binary)
+			<< "# shaders\r\n\r\n  passes/bloom_ps.bin\r\nmissing.bin\r\n./fullscreen_vs.bin";
+
+		ShaderFactory factory(nullptr, fs, basePath);
+		CHECK(factory.PrefetchFromManifest("/temp/manifest2.txt", executor) == 2);
+		CHECK(factory.GetStats().filesLoaded == 2);
+		checkBytecode(factory, "fullscreen_vs.hlsl", nullptr, g_Shaders[3].second);
+		CHECK(factory.GetStats().cacheHits == 1);
+
+		CHECK(factory.PrefetchFromManifest("/temp/missing.txt", executor) == 0);
+	}
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		std::filesystem::path tempDir = getTestDirectory();
+
+		// /native/shaders - loose files, some of them compressed
+		// /pack/shaders   - files in a tar archive
+		// /temp           - manifests
+		writeNativeShaders(tempDir / "native" / "shaders");
+		writeTarShaders(tempDir / "shaders.tar");
+
+		auto tarFS = std::make_shared<vfs::TarFile>(tempDir / "shaders.tar");
+		CHECK(tarFS->isOpen());
+
+		auto rootFS = std::make_shared<vfs::RootFileSystem>();
+		rootFS->mount("/native", std::make_shared<vfs::CompressionLayer>(
+			std::make_shared<vfs::RelativeFileSystem>(std::make_shared<vfs::NativeFileSystem>(), tempDir / "native")));
+		rootFS->mount("/pack", tarFS);
+		rootFS->mount("/temp", tempDir);
+
+		for (const char* basePath : { "/native/shaders", "/pack/shaders" })
+		{
+			test_bytecode_cache(rootFS, basePath);
+			test_concurrent_access(rootFS, basePath);
+			test_prefetch(rootFS, basePath, tempDir, nullptr);
+#ifdef DONUT_WITH_TASKFLOW
+			tf::Executor executor;
+			test_prefetch(rootFS, basePath, tempDir, &executor);
+#endif
+		}
+
+		std::filesystem::remove_all(tempDir);
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
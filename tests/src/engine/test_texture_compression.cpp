@@ -0,0 +1,437 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/engine/TextureCompression.h>
+#include <donut/engine/DDSFile.h>
+#include <donut/engine/TextureCache.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/tests/utils.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
+using namespace donut;
+using namespace donut::engine;
+
+// Reference decoders for the formats produced by the encoder
+
+static void decodeColorBlock(const uint8_t* block, uint8_t pixels[16][4], bool forceFourColors)
+{
+	uint16_t c0 = uint16_t(block[0] | (block[1] << 8));
+	uint16_t c1 = uint16_t(block[2] | (block[3] << 8));
+
+	int palette[4][4];
+	for (int e = 0; e < 2; e++)
+	{
+		uint16_t c = e ? c1 : c0;
+		int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+		palette[e][0] = (r << 3) | (r >> 2);
+		palette[e][1] = (g << 2) | (g >> 4);
+		palette[e][2] = (b << 3) | (b >> 2);
+		palette[e][3] = 255;
+	}
+	for (int ch = 0; ch < 4; ch++)
+	{
+		if (c0 > c1 || forceFourColors)
+		{
+			palette[2][ch] = (2 * palette[0][ch] + palette[1][ch]) / 3;
+			palette[3][ch] = (palette[0][ch] + 2 * palette[1][ch]) / 3;
+		}
+		else
+		{
+			palette[2][ch] = (palette[0][ch] + palette[1][ch]) / 2;
+			palette[3][ch] = 0;
+		}
+	}
+
+	uint32_t indices;
+	memcpy(&indices, block + 4, 4);
+	for (int i = 0; i < 16; i++)
+		for (int ch = 0; ch < 4; ch++)
+			pixels[i][ch] = uint8_t(palette[(indices >> (i * 2)) & 3][ch]);
+}
+
+static void decodeChannelBlock(const uint8_t* block, uint8_t pixels[16][4], int channel)
+{
+	int palette[8];
+	palette[0] = block[0];
+	palette[1] = block[1];
+	if (palette[0] > palette[1])
+	{
+		for (int i = 2; i < 8; i++)
+			palette[i] = ((8 - i) * palette[0] + (i - 1) * palette[1]) / 7;
+	}
+	else
+	{
+		for (int i = 2; i < 6; i++)
+			palette[i] = ((6 - i) * palette[0] + (i - 1) * palette[1]) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	uint64_t indices = 0;
+	for (int b = 0; b < 6; b++)
+		indices |= uint64_t(block[2 + b]) << (b * 8);
+	for (int i = 0; i < 16; i++)
+		pixels[i][channel] = uint8_t(palette[(indices >> (i * 3)) & 7]);
+}
+
+static uint32_t readBits(const uint8_t* block, uint32_t& position, uint32_t count)
+{
+	uint32_t value = 0;
+	for (uint32_t bit = 0; bit < count; bit++, position++)
+		value |= uint32_t((block[position >> 3] >> (position & 7)) & 1) << bit;
+	return value;
+}
+
+// Mode 6 only
+static bool decodeBC7Block(const uint8_t* block, uint8_t pixels[16][4])
+{
+	static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	uint32_t position = 0;
+	if (readBits(block, position, 7) != 0x40)
+		return false;
+
+	int endpoints[2][4];
+	for (int ch = 0; ch < 4; ch++)
+	{
+		endpoints[0][ch] = int(readBits(block, position, 7));
+		endpoints[1][ch] = int(readBits(block, position, 7));
+	}
+	int p0 = int(readBits(block, position, 1));
+	int p1 = int(readBits(block, position, 1));
+	for (int ch = 0; ch < 4; ch++)
+	{
+		endpoints[0][ch] = (endpoints[0][ch] << 1) | p0;
+		endpoints[1][ch] = (endpoints[1][ch] << 1) | p1;
+	}
+
+	for (int i = 0; i < 16; i++)
+	{
+		int index = int(readBits(block, position, i == 0 ? 3 : 4));
+		for (int ch = 0; ch < 4; ch++)
+			pixels[i][ch] = uint8_t(((64 - weights[index]) * endpoints[0][ch] + weights[index] * endpoints[1][ch] + 32) >> 6);
+	}
+	return true;
+}
+
+static std::vector<uint8_t> decodeImage(nvrhi::Format format, const uint8_t* blocks, uint32_t width, uint32_t height)
+{
+	std::vector<uint8_t> image(size_t(width) * height * 4, 0);
+	const uint32_t blockSize = GetCompressedBlockSize(format);
+	const uint32_t blocksWide = (width + 3) / 4;
+
+	for (uint32_t by = 0; by < (height + 3) / 4; by++)
+	{
+		for (uint32_t bx = 0; bx < blocksWide; bx++)
+		{
+			const uint8_t* block = blocks + (by * blocksWide + bx) * blockSize;
+			uint8_t pixels[16][4] = {};
+			switch (format)
+			{
+			case nvrhi::Format::BC1_UNORM:
+			case nvrhi::Format::BC1_UNORM_SRGB:
+				decodeColorBlock(block, pixels, false);
+				break;
+			case nvrhi::Format::BC3_UNORM:
+			case nvrhi::Format::BC3_UNORM_SRGB:
+				decodeColorBlock(block + 8, pixels, true);
+				decodeChannelBlock(block, pixels, 3);
+				break;
+			case nvrhi::Format::BC4_UNORM:
+				decodeChannelBlock(block, pixels, 0);
+				break;
+			case nvrhi::Format::BC5_UNORM:
+				decodeChannelBlock(block, pixels, 0);
+				decodeChannelBlock(block + 8, pixels, 1);
+				break;
+			case nvrhi::Format::BC7_UNORM:
+			case nvrhi::Format::BC7_UNORM_SRGB:
+				CHECK(decodeBC7Block(block, pixels));
+				break;
+			default:
+				CHECK(false);
+			}
+
+			for (uint32_t y = 0; y < 4 && by * 4 + y < height; y++)
+				for (uint32_t x = 0; x < 4 && bx * 4 + x < width; x++)
+					memcpy(&image[((by * 4 + y) * width + bx * 4 + x) * 4], pixels[y * 4 + x], 4);
+		}
+	}
+	return image;
+}
+
+static double computePSNR(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b, int firstChannel, int numChannels)
+{
+	double sum = 0.0;
+	size_t count = 0;
+	for (size_t i = 0; i < a.size(); i += 4)
+	{
+		for (int ch = firstChannel; ch < firstChannel + numChannels; ch++)
+		{
+			double d = double(a[i + ch]) - double(b[i + ch]);
+			sum += d * d;
+			++count;
+		}
+	}
+	double mse = sum / double(count);
+	return mse == 0.0 ? 100.0 : 10.0 * log10(255.0 * 255.0 / mse);
+}
+
+// Smooth gradients with some detail and noise, roughly like a photographic texture
+static std::vector<uint8_t> createTestImage(uint32_t width, uint32_t height)
+{
+	std::vector<uint8_t> image(size_t(width) * height * 4);
+	uint32_t seed = 12345;
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			float noise = float((seed >> 24) & 15) - 7.5f;
+			float u = float(x) / float(width);
+			float v = float(y) / float(height);
+			uint8_t* pixel = &image[(size_t(y) * width + x) * 4];
+			pixel[0] = uint8_t(std::clamp(255.f * u + noise, 0.f, 255.f));
+			pixel[1] = uint8_t(std::clamp(128.f + 100.f * sinf(v * 12.f + u * 3.f) + noise, 0.f, 255.f));
+			pixel[2] = uint8_t(std::clamp(255.f * (1.f - v) * 0.5f + 60.f * cosf(u * 20.f) + 60.f + noise, 0.f, 255.f));
+			pixel[3] = uint8_t(std::clamp(255.f * (0.5f + 0.5f * sinf(u * 7.f + v * 5.f)) + noise, 0.f, 255.f));
+		}
+	}
+	return image;
+}
+
+static double compressAndMeasure(nvrhi::Format format, const std::vector<uint8_t>& image, uint32_t width, uint32_t height, int firstChannel, int numChannels)
+{
+	uint32_t blockSize = GetCompressedBlockSize(format);
+	std::vector<uint8_t> blocks(size_t((width + 3) / 4) * ((height + 3) / 4) * blockSize);
+	CHECK(CompressImage(format, image.data(), width, height, width * 4, blocks.data()));
+
+	auto decoded = decodeImage(format, blocks.data(), width, height);
+	return computePSNR(image, decoded, firstChannel, numChannels);
+}
+
+void test_compression_quality()
+{
+	const uint32_t width = 256;
+	const uint32_t height = 128;
+	auto image = createTestImage(width, height);
+
+	double bc1 = compressAndMeasure(nvrhi::Format::BC1_UNORM, image, width, height, 0, 3);
+	double bc3Color = compressAndMeasure(nvrhi::Format::BC3_UNORM, image, width, height, 0, 3);
+	double bc3Alpha = compressAndMeasure(nvrhi::Format::BC3_UNORM, image, width, height, 3, 1);
+	double bc4 = compressAndMeasure(nvrhi::Format::BC4_UNORM, image, width, height, 0, 1);
+	double bc5 = compressAndMeasure(nvrhi::Format::BC5_UNORM, image, width, height, 0, 2);
+	double bc7 = compressAndMeasure(nvrhi::Format::BC7_UNORM, image, width, height, 0, 4);
+
+	printf("texture compression PSNR: BC1 %.2f dB, BC3 %.2f / %.2f dB, BC4 %.2f dB, BC5 %.2f dB, BC7 %.2f dB\n",
+		bc1, bc3Color, bc3Alpha, bc4, bc5, bc7);
+
+	CHECK(bc1 > 33.0);
+	CHECK(bc3Color > 33.0);
+	CHECK(bc3Alpha > 40.0);
+	CHECK(bc4 > 40.0);
+	CHECK(bc5 > 40.0);
+	CHECK(bc7 > 36.0);
+
+	// flat blocks are exact in BC4/BC5; BC7 mode 6 shares the LSB between the channels of an endpoint
+	std::vector<uint8_t> flat(64 * 4);
+	for (size_t i = 0; i < flat.size(); i += 4)
+	{
+		flat[i + 0] = 77;
+		flat[i + 1] = 200;
+		flat[i + 2] = 13;
+		flat[i + 3] = 129;
+	}
+	CHECK(compressAndMeasure(nvrhi::Format::BC4_UNORM, flat, 8, 8, 0, 1) == 100.0);
+	CHECK(compressAndMeasure(nvrhi::Format::BC5_UNORM, flat, 8, 8, 0, 2) == 100.0);
+	CHECK(compressAndMeasure(nvrhi::Format::BC7_UNORM, flat, 8, 8, 0, 4) > 48.0);
+	CHECK(compressAndMeasure(nvrhi::Format::BC1_UNORM, flat, 8, 8, 0, 3) > 40.0);
+
+	// partial blocks at the right and bottom edges
+	std::vector<uint8_t> small(13 * 7 * 4);
+	for (uint32_t y = 0; y < 7; y++)
+		memcpy(&small[y * 13 * 4], &image[(y * width + 100) * 4], 13 * 4);
+	CHECK(compressAndMeasure(nvrhi::Format::BC7_UNORM, small, 13, 7, 0, 4) > 36.0);
+	CHECK(compressAndMeasure(nvrhi::Format::BC1_UNORM, small, 13, 7, 0, 3) > 33.0);
+}
+
+void test_format_selection()
+{
+	TextureCompressionSettings settings;
+	CHECK(ChooseCompressedFormat(settings, false) == nvrhi::Format::BC1_UNORM_SRGB);
+	CHECK(ChooseCompressedFormat(settings, true) == nvrhi::Format::BC3_UNORM_SRGB);
+	settings.allowBC7 = true;
+	CHECK(ChooseCompressedFormat(settings, true) == nvrhi::Format::BC7_UNORM_SRGB);
+
+	settings.role = TextureRole::Normal;
+	CHECK(ChooseCompressedFormat(settings, false) == nvrhi::Format::BC5_UNORM);
+	settings.role = TextureRole::OcclusionRoughnessMetallic;
+	CHECK(ChooseCompressedFormat(settings, false) == nvrhi::Format::BC7_UNORM);
+	settings.allowBC7 = false;
+	CHECK(ChooseCompressedFormat(settings, false) == nvrhi::Format::BC1_UNORM);
+	settings.role = TextureRole::SingleChannel;
+	CHECK(ChooseCompressedFormat(settings, false) == nvrhi::Format::BC4_UNORM);
+
+	CHECK(GetCompressedBlockSize(nvrhi::Format::RGBA8_UNORM) == 0);
+	uint8_t pixel[4] = {};
+	uint8_t block[16];
+	CHECK(!CompressImage(nvrhi::Format::RGBA8_UNORM, pixel, 1, 1, 4, block));
+}
+
+void test_dds_round_trip()
+{
+	const uint32_t width = 64;
+	const uint32_t height = 32;
+	auto image = createTestImage(width, height);
+
+	TextureCompressionSettings settings;
+	settings.role = TextureRole::BaseColor;
+	auto dds = CompressTextureToDDS(image.data(), width, height, width * 4, settings);
+	CHECK(dds);
+
+	TextureData texture;
+	texture.data = dds;
+	CHECK(LoadDDSTextureFromMemory(texture));
+	CHECK(texture.format == nvrhi::Format::BC3_UNORM_SRGB); // the test image has alpha
+	CHECK(texture.width == width && texture.height == height);
+	CHECK(texture.mipLevels == 7);
+	CHECK(texture.dimension == nvrhi::TextureDimension::Texture2D);
+	CHECK(texture.dataLayout.size() == 1 && texture.dataLayout[0].size() == 7);
+	CHECK(texture.dataLayout[0][6].dataSize == 16);
+
+	// the top level matches a direct compression of the image
+	std::vector<uint8_t> blocks(size_t(width / 4) * (height / 4) * 16);
+	CHECK(CompressImage(nvrhi::Format::BC3_UNORM_SRGB, image.data(), width, height, width * 4, blocks.data()));
+	const auto& top = texture.dataLayout[0][0];
+	CHECK(top.dataSize == blocks.size());
+	CHECK(memcmp(static_cast<const uint8_t*>(dds->data()) + top.dataOffset, blocks.data(), blocks.size()) == 0);
+
+	// the smallest mip level of a gradient is close to the average color
+	const auto& last = texture.dataLayout[0][6];
+	auto decoded = decodeImage(texture.format, static_cast<const uint8_t*>(dds->data()) + last.dataOffset, 1, 1);
+	CHECK(decoded[0] > 96 && decoded[0] < 160);
+
+	// opaque normal map: BC5, no mips
+	for (size_t i = 0; i < image.size(); i += 4)
+		image[i + 3] = 255;
+	settings.role = TextureRole::Normal;
+	settings.generateMips = false;
+	dds = CompressTextureToDDS(image.data(), width, height, width * 4, settings);
+	texture = TextureData();
+	texture.data = dds;
+	CHECK(LoadDDSTextureFromMemory(texture));
+	CHECK(texture.format == nvrhi::Format::BC5_UNORM && texture.mipLevels == 1);
+
+	// odd sizes
+	dds = CompressTextureToDDS(image.data(), 13, 7, width * 4, TextureCompressionSettings());
+	texture = TextureData();
+	texture.data = dds;
+	CHECK(LoadDDSTextureFromMemory(texture));
+	CHECK(texture.format == nvrhi::Format::BC1_UNORM_SRGB && texture.mipLevels == 4);
+}
+
+#ifdef DONUT_WITH_TASKFLOW
+void test_parallel_compression()
+{
+	const uint32_t width = 256;
+	const uint32_t height = 256;
+	auto image = createTestImage(width, height);
+
+	tf::Executor executor(4);
+	for (nvrhi::Format format : { nvrhi::Format::BC1_UNORM, nvrhi::Format::BC3_UNORM, nvrhi::Format::BC5_UNORM, nvrhi::Format::BC7_UNORM })
+	{
+		size_t size = size_t(width / 4) * (height / 4) * GetCompressedBlockSize(format);
+		std::vector<uint8_t> serial(size), parallel(size);
+		CHECK(CompressImage(format, image.data(), width, height, width * 4, serial.data()));
+		CHECK(CompressImage(format, image.data(), width, height, width * 4, parallel.data(), &executor));
+		CHECK(serial == parallel);
+	}
+}
+#endif
+
+void benchmark_texture_compression()
+{
+	const uint32_t width = 1024;
+	const uint32_t height = 1024;
+	auto image = createTestImage(width, height);
+
+#ifdef DONUT_WITH_TASKFLOW
+	tf::Executor executor;
+#endif
+
+	const std::pair<nvrhi::Format, const char*> formats[] = {
+		{ nvrhi::Format::BC1_UNORM, "BC1" },
+		{ nvrhi::Format::BC3_UNORM, "BC3" },
+		{ nvrhi::Format::BC4_UNORM, "BC4" },
+		{ nvrhi::Format::BC5_UNORM, "BC5" },
+		{ nvrhi::Format::BC7_UNORM, "BC7" }
+	};
+
+	for (const auto& [format, name] : formats)
+	{
+		std::vector<uint8_t> blocks(size_t(width / 4) * (height / 4) * GetCompressedBlockSize(format));
+
+		auto t0 = std::chrono::high_resolution_clock::now();
+		CompressImage(format, image.data(), width, height, width * 4, blocks.data());
+		auto t1 = std::chrono::high_resolution_clock::now();
+		double serialMs = std::chrono::duration<double, std::milli>(t1 - t0).count();
+
+#ifdef DONUT_WITH_TASKFLOW
+		t0 = std::chrono::high_resolution_clock::now();
+		CompressImage(format, image.data(), width, height, width * 4, blocks.data(), &executor);
+		t1 = std::chrono::high_resolution_clock::now();
+		double parallelMs = std::chrono::duration<double, std::milli>(t1 - t0).count();
+
+		printf("%s: %.1f Mpix/s serial, %.1f Mpix/s on %zu threads\n", name,
+			double(width * height) / serialMs * 1e-3, double(width * height) / parallelMs * 1e-3, executor.num_workers());
+#else
+		printf("%s: %.1f Mpix/s\n", name, double(width * height) / serialMs * 1e-3);
+#endif
+	}
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_compression_quality();
+		test_format_selection();
+		test_dds_round_trip();
+#ifdef DONUT_WITH_TASKFLOW
+		test_parallel_compression();
+#endif
+		benchmark_texture_compression();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,338 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/engine/TextureUploadScheduler.h>
+#include <donut/engine/TextureCache.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/tests/utils.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+using namespace donut;
+using namespace donut::engine;
+
+// Records the calls instead of creating textures. Like the real uploader, it releases the CPU data
+// of uploaded textures, and textures marked as render targets need mip generation.
+class FakeUploader : public ITextureUploader
+{
+public:
+	std::vector<std::string> calls;
+	std::vector<std::string> uploadOrder;
+	bool inBatch = false;
+
+	void BeginBatch() override
+	{
+		CHECK(!inBatch);
+		inBatch = true;
+		calls.push_back("begin");
+	}
+
+	nvrhi::Format UploadTexture(const std::shared_ptr<TextureData>& texture) override
+	{
+		CHECK(inBatch);
+		CHECK(texture->data);
+		texture->data.reset();
+		calls.push_back("upload " + texture->path);
+		uploadOrder.push_back(texture->path);
+		return texture->isRenderTarget ? texture->format : nvrhi::Format::UNKNOWN;
+	}
+
+	void GenerateMipmaps(nvrhi::Format format, const std::vector<std::shared_ptr<TextureData>>& textures) override
+	{
+		CHECK(inBatch);
+		std::string call = "mips " + std::to_string(int(format));
+		for (const auto& texture : textures)
+		{
+			CHECK(texture->format == format);
+			call += " " + texture->path;
+		}
+		calls.push_back(call);
+	}
+
+	void EndBatch() override
+	{
+		CHECK(inBatch);
+		inBatch = false;
+		calls.push_back("end");
+	}
+};
+
+static std::shared_ptr<TextureData> createTexture(const std::string& name, size_t size,
+	nvrhi::Format format = nvrhi::Format::RGBA8_UNORM, bool generateMips = false)
+{
+	auto texture = std::make_shared<TextureData>();
+	texture->path = name;
+	texture->format = format;
+	texture->isRenderTarget = generateMips;
+	texture->data = std::make_shared<vfs::Blob>(malloc(size), size);
+	return texture;
+}
+
+static const uint64_t MB = 1024 * 1024;
+
+void test_budget_batching()
+{
+	TextureUploadScheduler scheduler;
+	FakeUploader uploader;
+
+	for (int i = 0; i < 10; i++)
+		scheduler.Enqueue(createTexture("t" + std::to_string(i), MB));
+
+	CHECK(!scheduler.IsEmpty());
+	CHECK(scheduler.GetProgress().texturesQueued == 10);
+	CHECK(scheduler.GetProgress().bytesQueued == 10 * MB);
+	CHECK(scheduler.GetProgress().GetFraction() == 0.f);
+
+	// 3.5 MB per batch: 3 + 3 + 3 + 1 textures
+	std::vector<uint32_t> batchSizes;
+	while (uint32_t count = scheduler.ProcessBatch(uploader, 3 * MB + MB / 2))
+		batchSizes.push_back(count);
+
+	CHECK(batchSizes == std::vector<uint32_t>({ 3, 3, 3, 1 }));
+	CHECK(scheduler.IsEmpty());
+
+	TextureUploadProgress progress = scheduler.GetProgress();
+	CHECK(progress.texturesQueued == 0);
+	CHECK(progress.texturesFinalized == 10);
+	CHECK(progress.bytesUploaded == 10 * MB);
+	CHECK(progress.batchesSubmitted == 4);
+	CHECK(progress.GetFraction() == 1.f);
+
+	std::vector<std::string> expected = { "begin", "upload t0", "upload t1", "upload t2", "end" };
+	CHECK(std::equal(expected.begin(), expected.end(), uploader.calls.begin()));
+
+	// a texture larger than the budget is processed alone, and so are the textures after it
+	scheduler.Enqueue(createTexture("large", 10 * MB));
+	scheduler.Enqueue(createTexture("small", MB / 2));
+	CHECK(scheduler.ProcessBatch(uploader, MB) == 1);
+	CHECK(uploader.uploadOrder.back() == "large");
+	CHECK(scheduler.ProcessBatch(uploader, MB) == 1);
+	CHECK(uploader.uploadOrder.back() == "small");
+
+	// no budget: everything in one batch
+	for (int i = 0; i < 100; i++)
+		scheduler.Enqueue(createTexture("u" + std::to_string(i), MB));
+	CHECK(scheduler.ProcessBatch(uploader, 0) == 100);
+	CHECK(scheduler.ProcessBatch(uploader, 0) == 0);
+}
+
+void test_priorities()
+{
+	TextureUploadScheduler scheduler;
+	FakeUploader uploader;
+
+	auto a = createTexture("a", 100);
+	auto b = createTexture("b", 100);
+	auto c = createTexture("c", 100);
+	auto d = createTexture("d", 100);
+	auto e = createTexture("e", 100);
+
+	// a priority can be requested before the texture has finished loading
+	scheduler.SetPriority(*d, 5.f);
+
+	scheduler.Enqueue(a);
+	scheduler.Enqueue(b);
+	scheduler.Enqueue(c);
+	scheduler.Enqueue(d);
+
+	// the first batch only takes d, which is the most important one
+	CHECK(scheduler.ProcessBatch(uploader, 100) == 1);
+	CHECK(uploader.uploadOrder == std::vector<std::string>({ "d" }));
+
+	// ... or while it is waiting
+	scheduler.SetPriority(*c, 2.f);
+	scheduler.Enqueue(e);
+	scheduler.SetPriority(*e, 1.f);
+
+	// equal priorities keep the arrival order
+	CHECK(scheduler.ProcessBatch(uploader, 0) == 4);
+	CHECK(uploader.uploadOrder == std::vector<std::string>({ "d", "c", "e", "a", "b" }));
+
+	// a larger arrival in the middle of the queue, with a lowered priority for some of it
+	std::vector<std::shared_ptr<TextureData>> textures;
+	for (int i = 0; i < 200; i++)
+	{
+		textures.push_back(createTexture(std::to_string(i), 100));
+		scheduler.SetPriority(*textures.back(), float(i % 7));
+		scheduler.Enqueue(textures.back());
+	}
+	for (int i = 0; i < 200; i += 3)
+		scheduler.SetPriority(*textures[i], -1.f);
+
+	uploader.uploadOrder.clear();
+	while (scheduler.ProcessBatch(uploader, 1000))
+	{ }
+
+	CHECK(uploader.uploadOrder.size() == textures.size());
+	for (size_t i = 1; i < uploader.uploadOrder.size(); i++)
+	{
+		const TextureData& prev = *textures[std::stoi(uploader.uploadOrder[i - 1])];
+		const TextureData& next = *textures[std::stoi(uploader.uploadOrder[i])];
+		CHECK(prev.uploadPriority > next.uploadPriority || (prev.uploadPriority == next.uploadPriority && std::stoi(prev.path) < std::stoi(next.path)));
+	}
+}
+
+void test_mipmap_grouping()
+{
+	TextureUploadScheduler scheduler;
+	FakeUploader uploader;
+
+	scheduler.Enqueue(createTexture("a", 100, nvrhi::Format::SRGBA8_UNORM, true));
+	scheduler.Enqueue(createTexture("b", 100, nvrhi::Format::RGBA8_UNORM, true));
+	scheduler.Enqueue(createTexture("c", 100, nvrhi::Format::BC1_UNORM, false));
+	scheduler.Enqueue(createTexture("d", 100, nvrhi::Format::SRGBA8_UNORM, true));
+	scheduler.Enqueue(createTexture("e", 100, nvrhi::Format::RGBA8_UNORM, true));
+
+	CHECK(scheduler.ProcessBatch(uploader, 0) == 5);
+
+	// all uploads first, then one mip generation call per format, in the order the formats appeared
+	std::vector<std::string> expected = {
+		"begin",
+		"upload a", "upload b", "upload c", "upload d", "upload e",
+		"mips " + std::to_string(int(nvrhi::Format::SRGBA8_UNORM)) + " a d",
+		"mips " + std::to_string(int(nvrhi::Format::RGBA8_UNORM)) + " b e",
+		"end"
+	};
+	CHECK(uploader.calls == expected);
+}
+
+void test_dropped_textures()
+{
+	TextureUploadScheduler scheduler;
+	FakeUploader uploader;
+
+	auto finalized = createTexture("finalized", MB);
+	finalized->data.reset();
+	CHECK(GetTextureUploadSize(*finalized) == 0);
+
+	auto layout = createTexture("layout", MB);
+	layout->dataLayout = { { TextureSubresourceData{ 0, 0, 0, 1000 }, TextureSubresourceData{ 0, 0, 1000, 250 } } };
+	CHECK(GetTextureUploadSize(*layout) == 1250);
+
+	scheduler.Enqueue(finalized);
+	scheduler.Enqueue(layout);
+	CHECK(scheduler.GetProgress().texturesQueued == 2);
+
+	CHECK(scheduler.ProcessBatch(uploader, 0) == 1);
+	CHECK(uploader.uploadOrder == std::vector<std::string>({ "layout" }));
+	CHECK(scheduler.IsEmpty());
+	CHECK(scheduler.GetProgress().bytesUploaded == 1250);
+	CHECK(scheduler.GetProgress().bytesQueued == 0);
+
+	// a batch of textures that are all gone does not submit anything
+	finalized = createTexture("finalized", MB);
+	scheduler.Enqueue(finalized);
+	finalized->data.reset();
+	size_t calls = uploader.calls.size();
+	CHECK(scheduler.ProcessBatch(uploader, 0) == 0);
+	CHECK(uploader.calls.size() == calls);
+	CHECK(scheduler.IsEmpty());
+
+	scheduler.Enqueue(createTexture("x", 100));
+	scheduler.Clear();
+	CHECK(scheduler.IsEmpty());
+	CHECK(scheduler.ProcessBatch(uploader, 0) == 0);
+}
+
+void test_concurrent_enqueue()
+{
+	TextureUploadScheduler scheduler;
+	FakeUploader uploader;
+
+	constexpr int numThreads = 4;
+	constexpr int texturesPerThread = 500;
+
+	std::atomic<int> running = numThreads;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < numThreads; t++)
+	{
+		threads.emplace_back([&scheduler, &running, t]()
+		{
+			for (int i = 0; i < texturesPerThread; i++)
+			{
+				auto texture = createTexture(std::to_string(t) + "/" + std::to_string(i), 1000);
+				scheduler.SetPriority(*texture, float(i % 3));
+				scheduler.Enqueue(texture);
+			}
+			--running;
+		});
+	}
+
+	uint32_t finalized = 0;
+	while (running > 0 || !scheduler.IsEmpty())
+		finalized += scheduler.ProcessBatch(uploader, 64 * 1000);
+
+	for (auto& thread : threads)
+		thread.join();
+
+	CHECK(finalized == numThreads * texturesPerThread);
+	CHECK(uploader.uploadOrder.size() == numThreads * texturesPerThread);
+	CHECK(scheduler.GetProgress().texturesFinalized == numThreads * texturesPerThread);
+}
+
+void benchmark_scheduling()
+{
+	TextureUploadScheduler scheduler;
+	FakeUploader uploader;
+
+	// a level with 2000 textures of 64 KB to 4 MB
+	uint64_t totalBytes = 0;
+	for (int i = 0; i < 2000; i++)
+	{
+		size_t size = size_t(64 * 1024) << (i % 7);
+		totalBytes += size;
+		auto texture = createTexture(std::to_string(i), size);
+		scheduler.SetPriority(*texture, float(i % 13));
+		scheduler.Enqueue(texture);
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	while (scheduler.ProcessBatch(uploader, 64 * MB))
+	{ }
+	auto end = std::chrono::high_resolution_clock::now();
+
+	printf("texture upload scheduler: 2000 textures, %.0f MB in %u command lists, %.2f ms of scheduling\n",
+		double(totalBytes) / double(MB), scheduler.GetProgress().batchesSubmitted,
+		std::chrono::duration<double, std::milli>(end - start).count());
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_budget_batching();
+		test_priorities();
+		test_mipmap_grouping();
+		test_dropped_textures();
+		test_concurrent_enqueue();
+		benchmark_scheduling();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
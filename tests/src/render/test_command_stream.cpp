@@ -0,0 +1,535 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/render/CommandStream.h>
+#include <donut/render/DrawStrategy.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/View.h>
+#include <donut/tests/scene_fixture.h>
+#include <donut/tests/utils.h>
+
+#include <chrono>
+#include <tuple>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
+using namespace donut;
+using namespace donut::math;
+using namespace donut::engine;
+using namespace donut::render;
+
+// The objects are never dereferenced, only compared
+template<typename T> static T* fakeObject(uintptr_t id)
+{
+	return reinterpret_cast<T*>(0x10000 + id * 64);
+}
+
+using namespace donut::tests;
+
+// A grid of mesh instances with 12 opaque and alpha tested materials over 4 buffer groups, one group per row
+static TestScene createScene(int gridSize)
+{
+	Random random;
+	TestScene scene = createEmptyScene(12, 12, random, false);
+	addInstanceGrid(scene, gridSize, random);
+	scene.graph->Refresh(0);
+	return scene;
+}
+
+// Maps the 12 materials to 6 combinations of pipeline and binding set, so that different materials
+// often produce the same state. Materials with materialID % 11 == 10 are not drawn.
+class FakePass : public IGeometryPass
+{
+public:
+	uint32_t pushConstantCount = 0;
+
+	[[nodiscard]] ViewType::Enum GetSupportedViewTypes() const override { return ViewType::PLANAR; }
+
+	void SetupView(GeometryPassContext& context, nvrhi::ICommandList* commandList, const IView* view, const IView* viewPrev) override { }
+
+	bool SetupMaterial(GeometryPassContext& context, const Material* material, nvrhi::RasterCullMode cullMode, nvrhi::GraphicsState& state) override
+	{
+		if (material->materialID % 11 == 10)
+			return false;
+
+		state.pipeline = fakeObject<nvrhi::IGraphicsPipeline>(material->materialID % 3 + (cullMode == nvrhi::RasterCullMode::None ? 3 : 0));
+		state.bindings.clear();
+		state.bindings.push_back(fakeObject<nvrhi::IBindingSet>(100));
+		state.bindings.push_back(fakeObject<nvrhi::IBindingSet>(101 + material->materialID % 2));
+		return true;
+	}
+
+	// Like a scene that keeps all meshes in one pair of buffers, so that switching buffer groups does not change the state
+	void SetupInputBuffers(GeometryPassContext& context, const BufferGroup* buffers, nvrhi::GraphicsState& state) override
+	{
+		nvrhi::VertexBufferBinding binding;
+		binding.buffer = fakeObject<nvrhi::IBuffer>(200);
+		binding.slot = 0;
+		binding.offset = 0;
+		state.vertexBuffers.clear();
+		state.vertexBuffers.push_back(binding);
+		binding.slot = 1;
+		binding.offset = 256;
+		state.vertexBuffers.push_back(binding);
+
+		state.indexBuffer.buffer = fakeObject<nvrhi::IBuffer>(201);
+		state.indexBuffer.format = nvrhi::Format::R32_UINT;
+		state.indexBuffer.offset = 0;
+	}
+
+	void SetPushConstants(GeometryPassContext& context, nvrhi::ICommandList* commandList, nvrhi::GraphicsState& state, nvrhi::DrawArguments& args) override
+	{
+		++pushConstantCount;
+	}
+};
+
+// The parts of the state that a draw depends on
+struct DrawState
+{
+	nvrhi::IFramebuffer* framebuffer = nullptr;
+	nvrhi::IGraphicsPipeline* pipeline = nullptr;
+	nvrhi::IBindingSet* materialBindings = nullptr;
+	nvrhi::IBuffer* vertexBuffer = nullptr;
+	uint64_t vertexBufferOffset = 0;
+	nvrhi::IBuffer* indexBuffer = nullptr;
+	size_t viewportCount = 0;
+
+	bool operator==(const DrawState& other) const
+	{
+		return std::tie(framebuffer, pipeline, materialBindings, vertexBuffer, vertexBufferOffset, indexBuffer, viewportCount)
+			== std::tie(other.framebuffer, other.pipeline, other.materialBindings, other.vertexBuffer, other.vertexBufferOffset, other.indexBuffer, other.viewportCount);
+	}
+};
+
+static DrawState describeState(const nvrhi::GraphicsState& state)
+{
+	DrawState result;
+	result.framebuffer = state.framebuffer;
+	result.pipeline = state.pipeline;
+	result.materialBindings = state.bindings.size() > 1 ? state.bindings[1] : nullptr;
+	result.vertexBuffer = state.vertexBuffers.size() > 1 ? state.vertexBuffers[1].buffer : nullptr;
+	result.vertexBufferOffset = state.vertexBuffers.size() > 1 ? state.vertexBuffers[1].offset : 0;
+	result.indexBuffer = state.indexBuffer.buffer;
+	result.viewportCount = state.viewport.viewports.size();
+	return result;
+}
+
+struct RecordedDraw
+{
+	DrawState state;
+	uint32_t vertexCount;
+	uint32_t instanceCount;
+	uint32_t startIndexLocation;
+	uint32_t startVertexLocation;
+	uint32_t startInstanceLocation;
+
+	bool operator==(const RecordedDraw& other) const
+	{
+		return state == other.state && vertexCount == other.vertexCount && instanceCount == other.instanceCount
+			&& startIndexLocation == other.startIndexLocation && startVertexLocation == other.startVertexLocation
+			&& startInstanceLocation == other.startInstanceLocation;
+	}
+};
+
+class RecordingSink : public ICommandSink
+{
+public:
+	enum class Call { SetGraphicsState, DrawIndexed, BeginMarker, EndMarker };
+
+	std::vector<Call> calls;
+	std::vector<RecordedDraw> draws;
+	std::vector<std::string> markers;
+	bool hasState = false;
+	nvrhi::GraphicsState currentState;
+	uint32_t redundantStateCalls = 0;
+	int markerDepth = 0;
+	int maxMarkerDepth = 0;
+	bool unbalancedMarkers = false;
+
+	void SetGraphicsState(const nvrhi::GraphicsState& state) override
+	{
+		if (hasState && describeState(state) == describeState(currentState))
+			++redundantStateCalls;
+
+		calls.push_back(Call::SetGraphicsState);
+		currentState = state;
+		hasState = true;
+	}
+
+	void DrawIndexed(const nvrhi::DrawArguments& args) override
+	{
+		calls.push_back(Call::DrawIndexed);
+		draws.push_back({ hasState ? describeState(currentState) : DrawState(), args.vertexCount, args.instanceCount,
+			args.startIndexLocation, args.startVertexLocation, args.startInstanceLocation });
+	}
+
+	void BeginMarker(const char* name) override
+	{
+		calls.push_back(Call::BeginMarker);
+		markers.push_back(name);
+		maxMarkerDepth = std::max(maxMarkerDepth, ++markerDepth);
+	}
+
+	void EndMarker() override
+	{
+		calls.push_back(Call::EndMarker);
+		if (--markerDepth < 0)
+			unbalancedMarkers = true;
+	}
+
+	[[nodiscard]] nvrhi::ICommandList* GetCommandList() override { return nullptr; }
+};
+
+// What RenderView draws for the items, computed without any state tracking
+static std::vector<RecordedDraw> referenceDraws(const std::vector<DrawItem>& items, const IView& view, nvrhi::IFramebuffer* framebuffer)
+{
+	FakePass pass;
+	GeometryPassContext context;
+	std::vector<RecordedDraw> result;
+	const DrawItem* previous = nullptr;
+
+	for (const DrawItem& item : items)
+	{
+		if (!item.material)
+			continue;
+
+		nvrhi::GraphicsState state;
+		state.framebuffer = framebuffer;
+		state.viewport = view.GetViewportState();
+		pass.SetupInputBuffers(context, item.buffers, state);
+		if (!pass.SetupMaterial(context, item.material, item.cullMode, state) || item.instanceCount == 0)
+			continue;
+
+		RecordedDraw draw = { describeState(state), item.geometry->numIndices, item.instanceCount,
+			item.mesh->indexOffset + item.geometry->indexOffsetInMesh,
+			item.mesh->vertexOffset + item.geometry->vertexOffsetInMesh,
+			uint32_t(item.instance->GetInstanceIndex()) + item.instanceOffset };
+
+		bool sameState = previous && previous->material == item.material && previous->buffers == item.buffers && previous->cullMode == item.cullMode;
+		previous = &item;
+
+		if (sameState && !result.empty() && result.back().startIndexLocation == draw.startIndexLocation &&
+			result.back().startInstanceLocation + result.back().instanceCount == draw.startInstanceLocation)
+		{
+			result.back().instanceCount += draw.instanceCount;
+			continue;
+		}
+
+		result.push_back(draw);
+	}
+
+	return result;
+}
+
+// Splits merged draws back into one draw per instance, which does not depend on where the streams were split
+static std::vector<RecordedDraw> expandDraws(const std::vector<RecordedDraw>& draws)
+{
+	std::vector<RecordedDraw> result;
+	for (const RecordedDraw& draw : draws)
+	{
+		for (uint32_t i = 0; i < draw.instanceCount; i++)
+		{
+			RecordedDraw single = draw;
+			single.instanceCount = 1;
+			single.startInstanceLocation = draw.startInstanceLocation + i;
+			result.push_back(single);
+		}
+	}
+	return result;
+}
+
+static std::vector<DrawItem> collectItems(const TestScene& scene, const IView& view)
+{
+	InstancedOpaqueDrawStrategy strategy;
+	strategy.PrepareForView(scene.root, view);
+
+	std::vector<DrawItem> items;
+	while (const DrawItem* item = strategy.GetNextItem())
+		items.push_back(*item);
+
+	// an item without a material is skipped, like in RenderView
+	if (!items.empty())
+	{
+		DrawItem empty = items[0];
+		empty.material = nullptr;
+		items.insert(items.begin() + items.size() / 2, empty);
+	}
+
+	return items;
+}
+
+void test_stream_format()
+{
+	nvrhi::GraphicsState state;
+	state.framebuffer = fakeObject<nvrhi::IFramebuffer>(1);
+	state.viewport.addViewportAndScissorRect(nvrhi::Viewport(640.f, 480.f));
+	state.pipeline = fakeObject<nvrhi::IGraphicsPipeline>(2);
+	state.bindings.push_back(fakeObject<nvrhi::IBindingSet>(3));
+	state.bindings.push_back(fakeObject<nvrhi::IBindingSet>(4));
+	nvrhi::VertexBufferBinding vertexBuffer;
+	vertexBuffer.buffer = fakeObject<nvrhi::IBuffer>(5);
+	vertexBuffer.slot = 2;
+	vertexBuffer.offset = 1024;
+	state.vertexBuffers.push_back(vertexBuffer);
+	state.indexBuffer.buffer = fakeObject<nvrhi::IBuffer>(6);
+	state.indexBuffer.format = nvrhi::Format::R16_UINT;
+	state.indexBuffer.offset = 64;
+
+	CommandStream stream;
+	CHECK(stream.IsEmpty());
+
+	stream.SetGraphicsState(state);
+	const size_t setViewSize = 4 + sizeof(void*) + sizeof(nvrhi::VariableRateShadingState) + sizeof(nvrhi::Viewport) + sizeof(nvrhi::Rect);
+	const size_t fullStateSize = setViewSize + (4 + sizeof(void*)) + (4 + 2 * sizeof(void*)) + (4 + sizeof(void*) + 16) + (4 + sizeof(void*) + 8);
+	CHECK(stream.GetData().size() == fullStateSize);
+	CHECK(stream.GetData()[0] == uint8_t(StreamCommand::SetView));
+	CHECK(stream.GetData()[1] == 1 && stream.GetData()[2] == 1);
+	CHECK(stream.GetData()[setViewSize] == uint8_t(StreamCommand::SetPipeline));
+	CHECK(stream.GetStatistics().stateCommandCount == 5);
+
+	// identical state records nothing
+	stream.SetGraphicsState(state);
+	CHECK(stream.GetData().size() == fullStateSize);
+	CHECK(stream.GetStatistics().redundantStateCount == 1);
+
+	// only the pipeline changes
+	state.pipeline = fakeObject<nvrhi::IGraphicsPipeline>(7);
+	stream.SetGraphicsState(state);
+	CHECK(stream.GetData().size() == fullStateSize + 4 + sizeof(void*));
+	CHECK(stream.GetData()[fullStateSize] == uint8_t(StreamCommand::SetPipeline));
+
+	nvrhi::DrawArguments args;
+	args.vertexCount = 36;
+	args.instanceCount = 4;
+	args.startIndexLocation = 100;
+	args.startVertexLocation = 200;
+	args.startInstanceLocation = 300;
+	stream.BeginMarker("marker");
+	stream.DrawIndexed(args);
+	stream.EndMarker();
+	CHECK(stream.GetData().size() == fullStateSize + (4 + sizeof(void*)) + (4 + sizeof(void*)) + (4 + sizeof(nvrhi::DrawArguments)) + 4);
+	CHECK(stream.GetStatistics().drawCount == 1);
+
+	FakePass pass;
+	GeometryPassContext context;
+	RecordingSink sink;
+	ReplayCommandStreams(&stream, 1, sink, &pass, &context);
+
+	CHECK(sink.calls.size() == 4);
+	CHECK(sink.calls[0] == RecordingSink::Call::BeginMarker);
+	CHECK(sink.calls[1] == RecordingSink::Call::SetGraphicsState);
+	CHECK(sink.calls[2] == RecordingSink::Call::DrawIndexed);
+	CHECK(sink.calls[3] == RecordingSink::Call::EndMarker);
+	CHECK(sink.markers.size() == 1 && sink.markers[0] == "marker");
+	CHECK(pass.pushConstantCount == 1);
+
+	// the replayed state round-trips through the stream
+	const nvrhi::GraphicsState& replayed = sink.currentState;
+	CHECK(replayed.framebuffer == state.framebuffer);
+	CHECK(replayed.pipeline == state.pipeline);
+	CHECK(replayed.viewport.viewports.size() == 1 && replayed.viewport.viewports[0] == state.viewport.viewports[0]);
+	CHECK(replayed.viewport.scissorRects.size() == 1 && replayed.viewport.scissorRects[0] == state.viewport.scissorRects[0]);
+	CHECK(replayed.bindings.size() == 2 && replayed.bindings[0] == state.bindings[0] && replayed.bindings[1] == state.bindings[1]);
+	CHECK(replayed.vertexBuffers.size() == 1);
+	CHECK(replayed.vertexBuffers[0].buffer == vertexBuffer.buffer && replayed.vertexBuffers[0].slot == 2 && replayed.vertexBuffers[0].offset == 1024);
+	CHECK(replayed.indexBuffer.buffer == state.indexBuffer.buffer && replayed.indexBuffer.format == nvrhi::Format::R16_UINT && replayed.indexBuffer.offset == 64);
+	CHECK(sink.draws[0].vertexCount == 36 && sink.draws[0].instanceCount == 4 && sink.draws[0].startIndexLocation == 100);
+	CHECK(sink.draws[0].startVertexLocation == 200 && sink.draws[0].startInstanceLocation == 300);
+
+	stream.Reset();
+	CHECK(stream.IsEmpty());
+	CHECK(stream.GetStatistics().drawCount == 0 && stream.GetStatistics().stateCommandCount == 0);
+
+	// after a reset, the full state is recorded again
+	stream.SetGraphicsState(state);
+	CHECK(stream.GetData().size() == fullStateSize);
+}
+
+void test_record_and_replay()
+{
+	TestScene scene = createScene(40);
+	PlanarView view = createView(1000.f);
+	std::vector<DrawItem> items = collectItems(scene, view);
+	CHECK(items.size() > 100);
+
+	nvrhi::IFramebuffer* framebuffer = fakeObject<nvrhi::IFramebuffer>(1000);
+	std::vector<RecordedDraw> reference = referenceDraws(items, view, framebuffer);
+	CHECK(!reference.empty());
+
+	FakePass pass;
+	GeometryPassContext context;
+	CommandStream stream;
+	RecordDrawItems(stream, items.data(), items.size(), &view, framebuffer, pass, context);
+
+	CHECK(pass.pushConstantCount == 0);
+	CHECK(stream.GetStatistics().drawCount == reference.size());
+	// several materials map to the same state, so some state changes are filtered at record time
+	CHECK(stream.GetStatistics().redundantStateCount > 0);
+
+	RecordingSink sink;
+	ReplayCommandStreams(&stream, 1, sink, &pass, &context);
+
+	CHECK(sink.draws == reference);
+	CHECK(sink.redundantStateCalls == 0);
+	CHECK(pass.pushConstantCount == reference.size());
+	CHECK(!sink.calls.empty() && sink.calls[0] == RecordingSink::Call::SetGraphicsState);
+	CHECK(sink.markers.empty());
+}
+
+void test_parallel_recording()
+{
+	TestScene scene = createScene(40);
+	PlanarView view = createView(1000.f);
+	std::vector<DrawItem> items = collectItems(scene, view);
+
+	nvrhi::IFramebuffer* framebuffer = fakeObject<nvrhi::IFramebuffer>(1000);
+	std::vector<RecordedDraw> reference = expandDraws(referenceDraws(items, view, framebuffer));
+
+	tf::Executor* executor = nullptr;
+#ifdef DONUT_WITH_TASKFLOW
+	tf::Executor taskflowExecutor(4);
+	executor = &taskflowExecutor;
+#endif
+
+	FakePass pass;
+	GeometryPassContext context;
+	std::vector<CommandStream> streams;
+	RecordDrawItemsParallel(executor, streams, items.data(), items.size(), &view, framebuffer, pass, context, 50, true);
+
+	CHECK(!streams.empty());
+	CHECK(streams.size() <= items.size() / 50);
+#ifdef DONUT_WITH_TASKFLOW
+	CHECK(streams.size() > 1);
+#endif
+
+	RecordingSink sink;
+	ReplayCommandStreams(streams.data(), streams.size(), sink, &pass, &context);
+
+	CHECK(expandDraws(sink.draws) == reference);
+	CHECK(sink.redundantStateCalls == 0);
+	CHECK(!sink.unbalancedMarkers && sink.markerDepth == 0 && sink.maxMarkerDepth == 1);
+
+	// every draw is inside a material marker, and no marker is empty
+	{
+		bool insideMarker = false;
+		bool markerHasDraws = false;
+		for (RecordingSink::Call call : sink.calls)
+		{
+			if (call == RecordingSink::Call::BeginMarker)
+			{
+				insideMarker = true;
+				markerHasDraws = false;
+			}
+			else if (call == RecordingSink::Call::EndMarker)
+			{
+				CHECK(markerHasDraws);
+				insideMarker = false;
+			}
+			else if (call == RecordingSink::Call::DrawIndexed)
+			{
+				CHECK(insideMarker);
+				markerHasDraws = true;
+			}
+		}
+	}
+
+	// replaying consecutive ranges of streams into two sinks produces the same draws, in order
+	if (streams.size() > 1)
+	{
+		size_t split = streams.size() / 2;
+		RecordingSink first, second;
+		ReplayCommandStreams(streams.data(), split, first, &pass, &context);
+		ReplayCommandStreams(streams.data() + split, streams.size() - split, second, &pass, &context);
+
+		std::vector<RecordedDraw> combined = first.draws;
+		combined.insert(combined.end(), second.draws.begin(), second.draws.end());
+		CHECK(combined == sink.draws);
+
+		// each sink starts without state, so the state is set before the first draw
+		auto firstDraw = std::find(second.calls.begin(), second.calls.end(), RecordingSink::Call::DrawIndexed);
+		auto firstState = std::find(second.calls.begin(), second.calls.end(), RecordingSink::Call::SetGraphicsState);
+		CHECK(firstState < firstDraw);
+		CHECK(first.markerDepth == 0 && second.markerDepth == 0);
+	}
+}
+
+void benchmark_recording()
+{
+	TestScene scene = createScene(300);
+	PlanarView view = createView(1000.f);
+	std::vector<DrawItem> items = collectItems(scene, view);
+
+	nvrhi::IFramebuffer* framebuffer = fakeObject<nvrhi::IFramebuffer>(1000);
+	FakePass pass;
+	GeometryPassContext context;
+	std::vector<CommandStream> streams;
+
+	auto measure = [&](tf::Executor* executor)
+	{
+		constexpr int iterations = 10;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < iterations; i++)
+			RecordDrawItemsParallel(executor, streams, items.data(), items.size(), &view, framebuffer, pass, context);
+		auto end = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+	};
+
+	double serialMs = measure(nullptr);
+	size_t bytes = streams[0].GetData().size();
+
+#ifdef DONUT_WITH_TASKFLOW
+	tf::Executor executor;
+	double parallelMs = measure(&executor);
+#endif
+
+	RecordingSink sink;
+	auto start = std::chrono::high_resolution_clock::now();
+	ReplayCommandStreams(streams.data(), streams.size(), sink, &pass, &context);
+	auto end = std::chrono::high_resolution_clock::now();
+	double replayMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+	printf("command stream: %zu items, %zu draws, %zu bytes\n", items.size(), sink.draws.size(), bytes);
+	printf("command stream: recording %.2f ms serial", serialMs);
+#ifdef DONUT_WITH_TASKFLOW
+	printf(", %.2f ms on %zu workers in %zu streams", parallelMs, executor.num_workers(), streams.size());
+#endif
+	printf(", replay %.2f ms\n", replayMs);
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_stream_format();
+		test_record_and_replay();
+		test_parallel_recording();
+		benchmark_recording();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,393 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/render/DrawStrategy.h>
+#include <donut/render/GeometryPasses.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/View.h>
+#include <donut/tests/scene_fixture.h>
+#include <donut/tests/utils.h>
+
+#include <algorithm>
+#include <chrono>
+#include <tuple>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
+using namespace donut;
+using namespace donut::math;
+using namespace donut::engine;
+using namespace donut::render;
+
+using namespace donut::tests;
+
+// A grid of mesh instances in 8 groups with a mix of materials, buffer groups and multi-geometry meshes,
+// plus one instance array. The same arguments always produce the same scene.
+static TestScene createScene(int gridSize)
+{
+	Random random;
+	TestScene scene = createEmptyScene(16, 12, random);
+	addInstanceGrid(scene, gridSize, random, 8);
+	addInstanceArray(scene, scene.groups[0], 500, 32, random);
+	scene.graph->Refresh(0);
+	return scene;
+}
+
+// Four orthographic "cascades" of growing size plus the six faces of a cube map
+struct MultiViewSetup
+{
+	PlanarView cascades[4];
+	CubemapView cubemap;
+	std::vector<const IView*> views;
+
+	MultiViewSetup()
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			float size = 10.f * float(1 << i);
+			cascades[i].SetViewport(nvrhi::Viewport(1024.f, 1024.f));
+			cascades[i].SetMatrices(translation(float3(0.f, -5.f, 10.f)), orthoProjD3DStyle(-size, size, -size, size, 0.f, 2.f * size));
+			cascades[i].UpdateCache();
+			views.push_back(&cascades[i]);
+		}
+
+		cubemap.SetTransform(translation(float3(-20.f, -2.f, -60.f)), 0.1f, 30.f);
+		cubemap.SetArrayViewports(256, 0);
+		cubemap.UpdateCache();
+		for (uint32_t face = 0; face < cubemap.GetNumChildViews(ViewType::PLANAR); face++)
+			views.push_back(cubemap.GetChildView(ViewType::PLANAR, face));
+	}
+};
+
+// (instance buffer index, geometry index) for every instance drawn by the strategy, sorted
+static std::vector<std::pair<int, int>> expandItems(IDrawStrategy& strategy)
+{
+	std::vector<std::pair<int, int>> result;
+	while (const DrawItem* item = strategy.GetNextItem())
+	{
+		for (uint32_t i = 0; i < item->instanceCount; i++)
+			result.push_back({ item->instance->GetInstanceIndex() + int(item->instanceOffset + i), item->geometry->globalGeometryIndex });
+	}
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+// Everything that identifies a draw without depending on memory addresses
+static std::vector<std::tuple<int, int, int, uint32_t, int>> describeItems(const std::vector<DrawItem>& items)
+{
+	std::vector<std::tuple<int, int, int, uint32_t, int>> result;
+	for (const auto& item : items)
+	{
+		result.push_back({ item.material->materialID, item.geometry->globalGeometryIndex,
+			item.instance->GetInstanceIndex() + int(item.instanceOffset), item.instanceCount, int(item.cullMode) });
+	}
+	return result;
+}
+
+void test_radix_sort()
+{
+	Random random;
+
+	for (size_t count : { size_t(0), size_t(1), size_t(1000), size_t(200000) })
+	{
+		std::vector<DrawPacket> packets(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			// few distinct keys to make stability matter, spread over the whole 64-bit range
+			uint64_t key = uint64_t(random() % 97) * 0x9E3779B97F4A7C15ull;
+			packets[i] = { key, uint32_t(i) };
+		}
+
+		std::vector<DrawPacket> expected = packets;
+		std::stable_sort(expected.begin(), expected.end(), [](const DrawPacket& a, const DrawPacket& b) { return a.key < b.key; });
+
+		std::vector<DrawPacket> sorted = packets;
+		std::vector<DrawPacket> scratch;
+		RadixSortDrawPackets(sorted, scratch);
+		for (size_t i = 0; i < count; i++)
+			CHECK(sorted[i].key == expected[i].key && sorted[i].itemIndex == expected[i].itemIndex);
+
+#ifdef DONUT_WITH_TASKFLOW
+		tf::Executor executor(4);
+		sorted = packets;
+		RadixSortDrawPackets(sorted, scratch, &executor);
+		for (size_t i = 0; i < count; i++)
+			CHECK(sorted[i].key == expected[i].key && sorted[i].itemIndex == expected[i].itemIndex);
+#endif
+	}
+
+	// keys with a single distinct value are left in place
+	std::vector<DrawPacket> same = { { 5, 2 }, { 5, 0 }, { 5, 1 } };
+	std::vector<DrawPacket> scratch;
+	RadixSortDrawPackets(same, scratch);
+	CHECK(same[0].itemIndex == 2 && same[1].itemIndex == 0 && same[2].itemIndex == 1);
+}
+
+void test_sort_key()
+{
+	Material opaque, alphaTested;
+	opaque.materialID = 3;
+	alphaTested.domain = MaterialDomain::AlphaTested;
+	alphaTested.materialID = 1;
+
+	BufferGroup buffers;
+	buffers.globalBufferGroupIndex = 2;
+
+	MeshGeometry geometry;
+	geometry.globalGeometryIndex = 7;
+
+	DrawItem item{};
+	item.material = &opaque;
+	item.buffers = &buffers;
+	item.geometry = &geometry;
+
+	uint64_t nearKey = CompiledOpaqueDrawStrategy::MakeSortKey(item, CompiledOpaqueDrawStrategy::GetDepthBucket(1.f));
+	uint64_t farKey = CompiledOpaqueDrawStrategy::MakeSortKey(item, CompiledOpaqueDrawStrategy::GetDepthBucket(100.f));
+	CHECK(nearKey < farKey);
+	CHECK((nearKey & 0x3ffffff) == 7);
+
+	item.material = &alphaTested;
+	CHECK(CompiledOpaqueDrawStrategy::MakeSortKey(item, 0) > farKey); // alpha tested after all opaque
+
+	CHECK(CompiledOpaqueDrawStrategy::GetDepthBucket(0.f) == 0);
+	CHECK(CompiledOpaqueDrawStrategy::GetDepthBucket(1e30f) == 255);
+}
+
+void test_matches_instanced_strategy()
+{
+	TestScene scene = createScene(40);
+	PlanarView view = createView();
+
+	InstancedOpaqueDrawStrategy reference;
+	reference.PrepareForView(scene.root, view);
+	auto expected = expandItems(reference);
+	CHECK(!expected.empty());
+
+	CompiledOpaqueDrawStrategy compiled;
+	compiled.SetInstancesPerRange(64);
+	compiled.PrepareForView(scene.root, view);
+	CHECK(compiled.GetVisibleItemCount() > compiled.GetDrawItems().size()); // some items were merged
+	CHECK(expandItems(compiled) == expected);
+
+	// ranges are consumed once
+	CHECK(compiled.GetNextItem() == nullptr);
+
+	// subgraph drawing only sees the instances of the subgraph
+	reference.PrepareForView(scene.groups[1], view);
+	compiled.PrepareForView(scene.groups[1], view);
+	auto expectedGroup = expandItems(reference);
+	CHECK(!expectedGroup.empty() && expectedGroup.size() < expected.size());
+	CHECK(expandItems(compiled) == expectedGroup);
+
+	// merged items must be sorted by pass first: no opaque item after an alpha-tested one
+	compiled.PrepareForView(scene.root, view);
+	bool seenAlphaTested = false;
+	for (const auto& item : compiled.GetDrawItems())
+	{
+		bool alphaTested = item.material->domain == MaterialDomain::AlphaTested;
+		CHECK(!seenAlphaTested || alphaTested);
+		seenAlphaTested |= alphaTested;
+	}
+}
+
+void test_determinism()
+{
+	PlanarView view = createView();
+
+	// two independently allocated copies of the same scene produce the same draws
+	TestScene sceneA = createScene(30);
+	TestScene sceneB = createScene(30);
+
+	CompiledOpaqueDrawStrategy strategyA, strategyB;
+	strategyA.PrepareForView(sceneA.root, view);
+	strategyB.PrepareForView(sceneB.root, view);
+	CHECK(describeItems(strategyA.GetDrawItems()) == describeItems(strategyB.GetDrawItems()));
+
+#ifdef DONUT_WITH_TASKFLOW
+	tf::Executor executor(4);
+	CompiledOpaqueDrawStrategy parallel(&executor);
+	parallel.SetInstancesPerRange(16);
+	parallel.PrepareForView(sceneA.root, view);
+	CHECK(describeItems(parallel.GetDrawItems()) == describeItems(strategyA.GetDrawItems()));
+#endif
+}
+
+void test_multi_view_culling()
+{
+	TestScene scene = createScene(60);
+	MultiViewSetup setup;
+	const uint32_t viewCount = uint32_t(setup.views.size());
+
+	InstancedOpaqueDrawStrategy reference;
+	InstancedOpaqueDrawStrategy multiView;
+	CHECK(multiView.PrepareForViews(scene.root, setup.views.data(), viewCount));
+
+	size_t nonEmptyViews = 0;
+	for (uint32_t viewIndex = 0; viewIndex < viewCount; viewIndex++)
+	{
+		reference.PrepareForView(scene.root, *setup.views[viewIndex]);
+		auto expected = expandItems(reference);
+
+		multiView.SelectView(viewIndex);
+		CHECK(expandItems(multiView) == expected);
+
+		// selecting a view again replays its items
+		multiView.SelectView(viewIndex);
+		CHECK(expandItems(multiView) == expected);
+
+		if (!expected.empty())
+			++nonEmptyViews;
+	}
+	CHECK(nonEmptyViews > viewCount / 2);
+
+	// subgraph root
+	CHECK(multiView.PrepareForViews(scene.groups[2], setup.views.data(), viewCount));
+	reference.PrepareForView(scene.groups[2], *setup.views[3]);
+	multiView.SelectView(3);
+	CHECK(expandItems(multiView) == expandItems(reference));
+
+	// too many views, and back to the single-view path
+	std::vector<const IView*> tooMany(InstancedOpaqueDrawStrategy::MaxMultiViews + 1, setup.views[0]);
+	CHECK(!multiView.PrepareForViews(scene.root, tooMany.data(), uint32_t(tooMany.size())));
+	multiView.PrepareForView(scene.root, *setup.views[0]);
+	reference.PrepareForView(scene.root, *setup.views[0]);
+	CHECK(expandItems(multiView) == expandItems(reference));
+
+	// strategies without multi-view support decline
+	TransparentDrawStrategy transparent;
+	CHECK(!transparent.PrepareForViews(scene.root, setup.views.data(), viewCount));
+}
+
+template<typename Func>
+static double measureMs(int iterations, Func&& func)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < iterations; i++)
+		func();
+	auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count() / double(iterations);
+}
+
+// Counts the draw calls that RenderView would issue for the strategy.
+// Item pointers are only valid until the next GetNextItem call, so the state is copied.
+static size_t countDrawCalls(IDrawStrategy& strategy)
+{
+	size_t drawCalls = 0;
+	DrawItem last{};
+	int lastEnd = -1;
+	while (const DrawItem* item = strategy.GetNextItem())
+	{
+		int start = item->instance->GetInstanceIndex() + int(item->instanceOffset);
+		bool merged = last.material == item->material && last.buffers == item->buffers &&
+			last.cullMode == item->cullMode && last.geometry == item->geometry && lastEnd == start;
+		if (!merged)
+			++drawCalls;
+		last = *item;
+		lastEnd = start + int(item->instanceCount);
+	}
+	return drawCalls;
+}
+
+void benchmark_draw_strategies()
+{
+	TestScene scene = createScene(250);
+	PlanarView view = createView();
+	const int iterations = 10;
+
+	InstancedOpaqueDrawStrategy reference;
+	size_t referenceDraws = 0;
+	double referenceMs = measureMs(iterations, [&]() { reference.PrepareForView(scene.root, view); referenceDraws = countDrawCalls(reference); });
+
+	CompiledOpaqueDrawStrategy compiled;
+	size_t compiledDraws = 0;
+	double compiledMs = measureMs(iterations, [&]() { compiled.PrepareForView(scene.root, view); compiledDraws = countDrawCalls(compiled); });
+
+	printf("draw strategy: instanced %.2f ms / %d draws, compiled %.2f ms / %d draws",
+		referenceMs, int(referenceDraws), compiledMs, int(compiledDraws));
+
+#ifdef DONUT_WITH_TASKFLOW
+	tf::Executor executor;
+	compiled.SetExecutor(&executor);
+	double parallelMs = measureMs(iterations, [&]() { compiled.PrepareForView(scene.root, view); countDrawCalls(compiled); });
+	printf(", compiled on %d threads %.2f ms", int(executor.num_workers()), parallelMs);
+#endif
+
+	printf("\n");
+}
+
+void benchmark_multi_view_culling()
+{
+	TestScene scene = createScene(316); // ~100k mesh instances
+	MultiViewSetup setup;
+	const uint32_t viewCount = uint32_t(setup.views.size());
+	const int iterations = 3;
+
+	InstancedOpaqueDrawStrategy strategy;
+	size_t perViewItems = 0;
+	double perViewMs = measureMs(iterations, [&]() {
+		perViewItems = 0;
+		for (const IView* view : setup.views)
+		{
+			strategy.PrepareForView(scene.root, *view);
+			while (strategy.GetNextItem())
+				++perViewItems;
+		}
+	});
+
+	size_t multiViewItems = 0;
+	double multiViewMs = measureMs(iterations, [&]() {
+		multiViewItems = 0;
+		strategy.PrepareForViews(scene.root, setup.views.data(), viewCount);
+		for (uint32_t viewIndex = 0; viewIndex < viewCount; viewIndex++)
+		{
+			strategy.SelectView(viewIndex);
+			while (strategy.GetNextItem())
+				++multiViewItems;
+		}
+	});
+
+	printf("multi-view culling, %d views: per view %.2f ms, single traversal %.2f ms (%d items)\n",
+		int(viewCount), perViewMs, multiViewMs, int(multiViewItems));
+	CHECK(perViewItems == multiViewItems);
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_radix_sort();
+		test_sort_key();
+		test_matches_instanced_strategy();
+		test_determinism();
+		test_multi_view_culling();
+		benchmark_draw_strategies();
+		benchmark_multi_view_culling();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,310 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/render/DynamicResolution.h>
+#include <donut/render/TemporalAntiAliasingPass.h>
+#include <donut/tests/utils.h>
+
+#include <cmath>
+#include <functional>
+#include <random>
+#include <set>
+
+using namespace donut;
+using namespace donut::math;
+using namespace donut::render;
+
+// Synthetic GPU: a fixed cost plus a cost proportional to the rendered pixel count
+struct LoadModel
+{
+	float fixedMs = 2.f;
+	float fullResolutionMs = 10.f;
+
+	[[nodiscard]] float FrameTime(float scale) const { return fixedMs + fullResolutionMs * scale * scale; }
+};
+
+struct SimulationResult
+{
+	std::vector<float> scales;      // scale used to render each frame
+	std::vector<float> frameTimes;
+	uint32_t changes = 0;
+
+	[[nodiscard]] uint32_t CountChanges(size_t first, size_t last) const
+	{
+		uint32_t count = 0;
+		for (size_t i = std::max<size_t>(first, 1); i < last && i < scales.size(); i++)
+			if (scales[i] != scales[i - 1])
+				++count;
+		return count;
+	}
+};
+
+// Runs the controller against a load trace; 'load' returns the model for a frame, 'noise' the relative noise amplitude
+static SimulationResult simulate(DynamicResolutionController& controller, uint32_t frames,
+	const std::function<LoadModel(uint32_t)>& load, float noise = 0.f, uint32_t seed = 1)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> dist(-1.f, 1.f);
+
+	SimulationResult result;
+	float scale = controller.GetScale();
+	for (uint32_t frame = 0; frame < frames; frame++)
+	{
+		float frameTime = load(frame).FrameTime(scale) * (1.f + noise * dist(rng));
+		result.scales.push_back(scale);
+		result.frameTimes.push_back(frameTime);
+
+		float newScale = controller.Update(frameTime);
+		if (newScale != scale)
+			++result.changes;
+		scale = newScale;
+	}
+	return result;
+}
+
+void test_render_size()
+{
+	CHECK(all(GetDynamicRenderSize(uint2(1920, 1080), 1.f) == uint2(1920, 1080)));
+	CHECK(all(GetDynamicRenderSize(uint2(1920, 1080), 0.5f) == uint2(960, 540)));
+	CHECK(all(GetDynamicRenderSize(uint2(1920, 1080), 0.7f) == uint2(1344, 756)));
+
+	// even sizes, but never larger than the render targets
+	uint2 size = GetDynamicRenderSize(uint2(1921, 1081), 1.f);
+	CHECK(all(size == uint2(1921, 1081)));
+	size = GetDynamicRenderSize(uint2(1921, 1081), 0.77f);
+	CHECK(size.x % 2 == 0 && size.y % 2 == 0);
+	CHECK(std::abs(int(size.x) - int(1921 * 0.77f)) <= 1 && std::abs(int(size.y) - int(1081 * 0.77f)) <= 1);
+
+	// out of range scales and tiny targets
+	CHECK(all(GetDynamicRenderSize(uint2(640, 480), 2.f) == uint2(640, 480)));
+	CHECK(all(GetDynamicRenderSize(uint2(640, 480), 0.f) == uint2(2, 2)));
+	CHECK(all(GetDynamicRenderSize(uint2(1, 1), 0.1f) == uint2(1, 1)));
+
+	nvrhi::Viewport viewport = GetDynamicRenderViewport(uint2(1920, 1080), 0.5f);
+	CHECK(viewport.minX == 0.f && viewport.minY == 0.f);
+	CHECK(viewport.maxX == 960.f && viewport.maxY == 540.f);
+
+	float2 uvScale = GetDynamicRenderUVScale(uint2(1920, 1080), uint2(960, 540));
+	CHECK(uvScale.x == 0.5f && uvScale.y == 0.5f);
+	CHECK(all(GetDynamicRenderUVScale(uint2(0, 0), uint2(0, 0)) == float2(1.f)));
+}
+
+void test_jitter()
+{
+	CHECK(GetTemporalAntiAliasingJitterPhaseCount(1.f) == 16);
+	CHECK(GetTemporalAntiAliasingJitterPhaseCount(0.5f) == 16);
+	CHECK(GetTemporalAntiAliasingJitterPhaseCount(1.5f) == 36);
+	CHECK(GetTemporalAntiAliasingJitterPhaseCount(2.f) == 64);
+	CHECK(GetTemporalAntiAliasingJitterPhaseCount(10.f) == 256);
+
+	const TemporalAntiAliasingJitter jitters[] = {
+		TemporalAntiAliasingJitter::MSAA, TemporalAntiAliasingJitter::Halton,
+		TemporalAntiAliasingJitter::R2, TemporalAntiAliasingJitter::WhiteNoise };
+
+	for (TemporalAntiAliasingJitter jitter : jitters)
+	{
+		for (uint32_t frame = 0; frame < 1000; frame++)
+		{
+			float2 offset = GetTemporalAntiAliasingJitterOffset(jitter, frame, 64);
+			CHECK(offset.x >= -0.5f && offset.x < 0.5f && offset.y >= -0.5f && offset.y < 0.5f);
+		}
+	}
+
+	// the Halton sequence repeats after the phase count
+	for (uint32_t phaseCount : { 16u, 36u, 64u })
+	{
+		for (uint32_t frame = 0; frame < phaseCount; frame++)
+		{
+			float2 a = GetTemporalAntiAliasingJitterOffset(TemporalAntiAliasingJitter::Halton, frame, phaseCount);
+			float2 b = GetTemporalAntiAliasingJitterOffset(TemporalAntiAliasingJitter::Halton, frame + phaseCount, phaseCount);
+			CHECK(all(a == b));
+		}
+	}
+
+	// when upscaling, one cycle of offsets must land in every output pixel covered by an input pixel
+	for (float ratio : { 1.f, 1.5f, 2.f, 3.f })
+	{
+		uint32_t phaseCount = GetTemporalAntiAliasingJitterPhaseCount(ratio);
+		int cells = int(std::ceil(ratio));
+
+		std::set<std::pair<int, int>> covered;
+		for (uint32_t frame = 0; frame < phaseCount; frame++)
+		{
+			float2 offset = GetTemporalAntiAliasingJitterOffset(TemporalAntiAliasingJitter::Halton, frame, phaseCount);
+			int x = std::min(int((offset.x + 0.5f) * ratio), cells - 1);
+			int y = std::min(int((offset.y + 0.5f) * ratio), cells - 1);
+			covered.insert(std::make_pair(x, y));
+		}
+		CHECK(covered.size() == size_t(cells * cells));
+	}
+
+	// R2 matches the incremental form of the sequence
+	float2 r2 = float2(0.f);
+	const float g = 1.32471795724474602596f;
+	for (uint32_t frame = 0; frame < 1000; frame++)
+	{
+		float2 offset = GetTemporalAntiAliasingJitterOffset(TemporalAntiAliasingJitter::R2, frame);
+		CHECK(std::abs(offset.x - (r2.x - 0.5f)) < 1e-3f && std::abs(offset.y - (r2.y - 0.5f)) < 1e-3f);
+		r2.x = fmodf(r2.x + 1.f / g, 1.f);
+		r2.y = fmodf(r2.y + 1.f / (g * g), 1.f);
+	}
+}
+
+void test_controller_light_load()
+{
+	DynamicResolutionController controller;
+	CHECK(controller.GetScale() == 1.f);
+
+	LoadModel model;
+	model.fullResolutionMs = 8.f;
+	auto result = simulate(controller, 1000, [&](uint32_t) { return model; }, 0.05f);
+	CHECK(result.changes == 0);
+	CHECK(controller.GetScale() == 1.f);
+}
+
+void test_controller_converges()
+{
+	DynamicResolutionController controller;
+	const float budget = controller.TargetFrameTimeMs;
+	const float lowerBound = budget * (1.f - controller.Hysteresis);
+
+	// needs about 0.7 to fit
+	LoadModel model;
+	model.fullResolutionMs = 30.f;
+	auto result = simulate(controller, 1000, [&](uint32_t) { return model; });
+
+	// reaches the band quickly, then stays put
+	size_t settled = 0;
+	while (settled < result.frameTimes.size() && result.frameTimes[settled] > budget)
+		++settled;
+	CHECK(settled < 60);
+
+	CHECK(result.CountChanges(200, 1000) == 0);
+	CHECK(result.frameTimes.back() <= budget);
+
+	// the final scale is the largest step that fits
+	float scale = controller.GetScale();
+	CHECK(model.FrameTime(scale) <= budget);
+	CHECK(model.FrameTime(scale + controller.ScaleStep) > budget || model.FrameTime(scale) >= lowerBound);
+}
+
+void test_controller_spike()
+{
+	DynamicResolutionController controller;
+	const float budget = controller.TargetFrameTimeMs;
+
+	LoadModel normal;
+	normal.fullResolutionMs = 11.f;
+	LoadModel spike;
+	spike.fullResolutionMs = 28.f;
+
+	const uint32_t spikeBegin = 200;
+	const uint32_t spikeEnd = 400;
+	auto result = simulate(controller, 1000,
+		[&](uint32_t frame) { return (frame >= spikeBegin && frame < spikeEnd) ? spike : normal; }, 0.03f);
+
+	CHECK(result.scales[spikeBegin - 1] == 1.f);
+
+	// reacts within a few frames
+	size_t reaction = spikeBegin;
+	while (reaction < spikeEnd && result.scales[reaction] == 1.f)
+		++reaction;
+	CHECK(reaction - spikeBegin <= 5);
+
+	// within budget for the rest of the spike
+	for (size_t frame = spikeBegin + 60; frame < spikeEnd; frame++)
+	{
+		CHECK(result.frameTimes[frame] <= budget * 1.05f);
+	}
+
+	// and back to full resolution after it
+	size_t recovery = spikeEnd;
+	while (recovery < result.scales.size() && result.scales[recovery] < 1.f)
+		++recovery;
+	CHECK(recovery - spikeEnd < 300);
+	CHECK(result.scales.back() == 1.f);
+}
+
+void test_controller_hysteresis()
+{
+	// a load that puts the frame time near the edge of the band, with noise
+	LoadModel model;
+	model.fullResolutionMs = 27.f;
+
+	DynamicResolutionController controller;
+	auto result = simulate(controller, 2000, [&](uint32_t) { return model; }, 0.1f, 7);
+	CHECK(result.CountChanges(200, 2000) <= 4);
+
+	// without hysteresis, quantization and cooldown the same trace flickers
+	DynamicResolutionController twitchy;
+	twitchy.Hysteresis = 0.f;
+	twitchy.ScaleStep = 0.f;
+	twitchy.CooldownFrames = 0;
+	twitchy.FilterFrames = 1;
+	auto twitchyResult = simulate(twitchy, 2000, [&](uint32_t) { return model; }, 0.1f, 7);
+	CHECK(twitchyResult.CountChanges(200, 2000) > 100);
+}
+
+void test_controller_limits()
+{
+	DynamicResolutionController controller;
+	controller.MinScale = 0.5f;
+
+	LoadModel model;
+	model.fullResolutionMs = 200.f;
+	simulate(controller, 300, [&](uint32_t) { return model; });
+	CHECK(controller.GetScale() == 0.5f);
+
+	// invalid samples are ignored
+	CHECK(controller.Update(0.f) == 0.5f);
+	CHECK(controller.Update(NAN) == 0.5f);
+	CHECK(controller.Update(-1.f) == 0.5f);
+
+	controller.SetScale(0.73f);
+	CHECK(std::abs(controller.GetScale() - 0.75f) < 1e-6f);
+	controller.SetScale(0.1f);
+	CHECK(controller.GetScale() == 0.5f);
+
+	controller.Reset();
+	CHECK(controller.GetScale() == 1.f);
+	CHECK(controller.GetFilteredFrameTimeMs() == 0.f);
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_render_size();
+		test_jitter();
+		test_controller_light_load();
+		test_controller_converges();
+		test_controller_spike();
+		test_controller_hysteresis();
+		test_controller_limits();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
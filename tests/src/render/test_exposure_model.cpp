@@ -0,0 +1,420 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/render/ExposureModel.h>
+#include <donut/tests/utils.h>
+
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <sstream>
+
+using namespace donut;
+using namespace donut::render;
+
+// histogram_cs.hlsl, written out with the standard library
+static void referenceHistogram(const std::vector<float>& rgba, const ExposureHistogramRange& range, std::vector<uint32_t>& histogram)
+{
+	const float logLuminanceScale = 1.f / (range.maxLogLuminance - range.minLogLuminance);
+	const float logLuminanceBias = -range.minLogLuminance * logLuminanceScale;
+
+	for (size_t i = 0; i + 3 < rgba.size(); i += 4)
+	{
+		float luminance = 0.2126f * rgba[i] + 0.7152f * rgba[i + 1] + 0.0722f * rgba[i + 2];
+		float biasedLogLuminance = std::log2(luminance) * logLuminanceScale + logLuminanceBias;
+		float saturated = (biasedLogLuminance > 0.f) ? std::min(biasedLogLuminance, 1.f) : 0.f; // saturate(NaN) = 0
+		float histogramBin = saturated * float(range.bins - 1);
+
+		uint32_t leftBin = uint32_t(std::floor(histogramBin));
+		uint32_t rightBin = leftBin + 1;
+		uint32_t rightWeight = uint32_t((histogramBin - std::floor(histogramBin)) * 64.f);
+		uint32_t leftWeight = 64 - rightWeight;
+
+		if (leftWeight != 0 && leftBin < range.bins)
+			histogram[leftBin] += leftWeight;
+		if (rightWeight != 0 && rightBin < range.bins)
+			histogram[rightBin] += rightWeight;
+	}
+}
+
+// exposure_cs.hlsl in double precision
+static double referenceTargetLuminance(const std::vector<uint32_t>& histogram, const ExposureHistogramRange& range,
+	const ToneMappingParameters& params)
+{
+	double low = std::min(0.99, std::max(0.0, double(params.histogramLowPercentile)));
+	double high = std::min(1.0, std::max(low, double(params.histogramHighPercentile)));
+
+	double total = 0.0;
+	for (uint32_t value : histogram)
+		total += value / 64.0;
+
+	double cdf = 0.0, weightSum = 0.0, binSum = 0.0;
+	for (uint32_t i = 0; i < range.bins; i++)
+	{
+		double binValue = histogram[i] / 64.0;
+		if (total * low <= cdf + binValue && cdf <= total * high)
+		{
+			double luminance = std::exp2(double(i) / range.bins * (range.maxLogLuminance - range.minLogLuminance) + range.minLogLuminance);
+			weightSum += luminance * binValue;
+			binSum += binValue;
+		}
+		cdf += binValue;
+	}
+
+	double target = binSum > 0.0 ? weightSum / binSum : 0.0;
+	return std::min(std::max(target, double(params.minAdaptedLuminance)), double(params.maxAdaptedLuminance));
+}
+
+// Log-uniform luminance between 2^minLog and 2^maxLog, with some color
+static std::vector<float> randomImage(uint32_t pixelCount, float minLog, float maxLog, uint32_t seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> logDist(minLog, maxLog);
+	std::uniform_real_distribution<float> tint(0.5f, 1.5f);
+
+	std::vector<float> rgba(pixelCount * 4);
+	for (uint32_t i = 0; i < pixelCount; i++)
+	{
+		float value = std::exp2(logDist(rng));
+		rgba[i * 4 + 0] = value * tint(rng);
+		rgba[i * 4 + 1] = value;
+		rgba[i * 4 + 2] = value * tint(rng);
+		rgba[i * 4 + 3] = 1.f;
+	}
+	return rgba;
+}
+
+static uint64_t totalWeight(const std::vector<uint32_t>& histogram)
+{
+	uint64_t total = 0;
+	for (uint32_t value : histogram)
+		total += value;
+	return total;
+}
+
+void test_histogram()
+{
+	ExposureHistogramRange range;
+	const uint32_t width = 317;
+	const uint32_t height = 29;
+
+	// covers the range and a few stops outside of it on both sides
+	std::vector<float> rgba = randomImage(width * height, range.minLogLuminance - 3.f, range.maxLogLuminance + 3.f, 1);
+
+	std::vector<uint32_t> histogram(range.bins, 0);
+	AddImageToLuminanceHistogram(rgba.data(), width, height, width * 4 * sizeof(float), 4, range, histogram.data());
+
+	std::vector<uint32_t> reference(range.bins, 0);
+	referenceHistogram(rgba, range, reference);
+
+	// every pixel adds a full unit of weight
+	CHECK(totalWeight(histogram) == uint64_t(width) * height * 64);
+	CHECK(totalWeight(reference) == totalWeight(histogram));
+
+	// the log2 approximation moves a fixed point unit between neighbours at most, and rarely
+	uint64_t difference = 0;
+	for (uint32_t i = 0; i < range.bins; i++)
+		difference += uint64_t(std::abs(int64_t(histogram[i]) - int64_t(reference[i])));
+	CHECK(difference <= uint64_t(width) * height / 50);
+
+	// clamped pixels land exactly at the ends
+	CHECK(histogram[0] == reference[0]);
+	CHECK(histogram[range.bins - 1] == reference[range.bins - 1]);
+}
+
+void test_histogram_special_values()
+{
+	ExposureHistogramRange range;
+	const float inf = std::numeric_limits<float>::infinity();
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+
+	// zero, negative, NaN and tiny values go to the first bin, infinity and huge values to the last,
+	// exact powers of two to exact bin positions
+	std::vector<float> values = { 0.f, -1.f, nan, 1e-30f, inf, 1e30f, 1.f, 0.5f, 2.f, 1.f / 1024.f, 16.f };
+	std::vector<float> rgba;
+	for (float value : values)
+	{
+		rgba.insert(rgba.end(), { value, value, value, 1.f });
+	}
+
+	std::vector<uint32_t> histogram(range.bins, 0);
+	AddImageToLuminanceHistogram(rgba.data(), uint32_t(values.size()), 1, rgba.size() * sizeof(float), 4, range, histogram.data());
+
+	std::vector<uint32_t> reference(range.bins, 0);
+	referenceHistogram(rgba, range, reference);
+
+	CHECK(histogram == reference);
+	CHECK(histogram[0] == 5 * 64);                // 0, -1, NaN, 1e-30 and 2^-10
+	CHECK(histogram[range.bins - 1] == 3 * 64);    // inf, 1e30 and 2^4
+}
+
+void test_histogram_simd_matches_scalar()
+{
+	ExposureHistogramRange range;
+	range.bins = 64;
+	range.minLogLuminance = -8.f;
+	range.maxLogLuminance = 8.f;
+
+	const uint32_t width = 103;
+	const uint32_t height = 7;
+	std::vector<float> rgba = randomImage(width * height, -10.f, 10.f, 2);
+
+	std::vector<uint32_t> batched(range.bins, 0);
+	AddImageToLuminanceHistogram(rgba.data(), width, height, width * 4 * sizeof(float), 4, range, batched.data());
+
+	// one pixel at a time never takes the SIMD path
+	std::vector<uint32_t> single(range.bins, 0);
+	for (uint32_t i = 0; i < width * height; i++)
+		AddImageToLuminanceHistogram(rgba.data() + i * 4, 1, 1, 4 * sizeof(float), 4, range, single.data());
+
+	CHECK(batched == single);
+
+	// RGB input, with padded rows
+	const uint32_t rowPitch = (width * 3 + 5) * sizeof(float);
+	std::vector<float> rgb(rowPitch / sizeof(float) * height, -1.f);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			for (uint32_t c = 0; c < 3; c++)
+				rgb[y * rowPitch / sizeof(float) + x * 3 + c] = rgba[(y * width + x) * 4 + c];
+		}
+	}
+
+	std::vector<uint32_t> fromRgb(range.bins, 0);
+	AddImageToLuminanceHistogram(rgb.data(), width, height, rowPitch, 3, range, fromRgb.data());
+	CHECK(fromRgb == batched);
+}
+
+void test_target_luminance()
+{
+	ExposureHistogramRange range;
+	ToneMappingParameters params;
+	params.minAdaptedLuminance = 1e-4f;
+	params.maxAdaptedLuminance = 100.f;
+
+	// all weight in one bin
+	for (uint32_t bin : { 10u, 128u, 200u })
+	{
+		std::vector<uint32_t> histogram(range.bins, 0);
+		histogram[bin] = 1000 * 64;
+
+		float target = ExposureModel::ComputeTargetLuminance(histogram.data(), range, params);
+		float expected = std::exp2(float(bin) / float(range.bins) * 14.f - 10.f);
+		CHECK(std::abs(target - expected) <= expected * 1e-5f);
+	}
+
+	// clamping to the adapted range
+	{
+		std::vector<uint32_t> histogram(range.bins, 0);
+		histogram[0] = 64;
+		params.minAdaptedLuminance = 0.02f;
+		CHECK(ExposureModel::ComputeTargetLuminance(histogram.data(), range, params) == 0.02f);
+
+		std::fill(histogram.begin(), histogram.end(), 0);
+		CHECK(ExposureModel::ComputeTargetLuminance(histogram.data(), range, params) == 0.02f);
+	}
+
+	// agreement with the GPU math on real histograms, for several percentile settings
+	const float percentiles[][2] = { { 0.8f, 0.95f }, { 0.f, 1.f }, { 0.5f, 0.5f }, { 1.5f, 0.2f }, { -1.f, 0.1f } };
+	for (uint32_t seed = 0; seed < 8; seed++)
+	{
+		std::vector<float> rgba = randomImage(4096, -6.f + float(seed), -2.f + float(seed), seed + 10);
+		std::vector<uint32_t> histogram(range.bins, 0);
+		AddImageToLuminanceHistogram(rgba.data(), 64, 64, 64 * 4 * sizeof(float), 4, range, histogram.data());
+
+		for (const auto& percentile : percentiles)
+		{
+			params.histogramLowPercentile = percentile[0];
+			params.histogramHighPercentile = percentile[1];
+
+			float target = ExposureModel::ComputeTargetLuminance(histogram.data(), range, params);
+			double expected = referenceTargetLuminance(histogram, range, params);
+			CHECK(std::abs(target - expected) <= expected * 1e-4);
+		}
+	}
+
+	float low, high;
+	params.histogramLowPercentile = 1.5f;
+	params.histogramHighPercentile = 0.2f;
+	ExposureModel::GetClampedPercentiles(params, low, high);
+	CHECK(low == 0.99f && high == 0.99f);
+}
+
+static float runConstant(ExposureModel& model, const std::vector<uint32_t>& histogram, const ToneMappingParameters& params,
+	float seconds, float frameTime)
+{
+	int frames = int(std::lround(seconds / frameTime));
+	float luminance = model.GetAdaptedLuminance();
+	for (int i = 0; i < frames; i++)
+		luminance = model.AdvanceFrame(histogram.data(), params, frameTime);
+	return luminance;
+}
+
+void test_adaptation()
+{
+	ExposureHistogramRange range;
+	ToneMappingParameters params;
+	params.eyeAdaptationSpeedUp = 2.f;
+	params.eyeAdaptationSpeedDown = 0.5f;
+
+	std::vector<uint32_t> bright(range.bins, 0);
+	bright[200] = 64 * 100;
+	std::vector<uint32_t> dark(range.bins, 0);
+	dark[120] = 64 * 100;
+
+	const float brightTarget = ExposureModel::ComputeTargetLuminance(bright.data(), range, params);
+	const float darkTarget = ExposureModel::ComputeTargetLuminance(dark.data(), range, params);
+	CHECK(brightTarget == params.maxAdaptedLuminance);
+	CHECK(darkTarget > params.minAdaptedLuminance && darkTarget < brightTarget);
+
+	// going up: the distance halves every 1 / speedUp seconds, independent of the frame rate
+	for (float frameTime : { 1.f / 30.f, 1.f / 60.f, 1.f / 144.f })
+	{
+		ExposureModel model(range);
+		model.Reset(darkTarget);
+		float luminance = runConstant(model, bright, params, 1.f, frameTime);
+		float expected = brightTarget + (darkTarget - brightTarget) * std::exp2(-params.eyeAdaptationSpeedUp * 1.f);
+		CHECK(std::abs(luminance - expected) < 1e-4f);
+	}
+
+	// going down is slower
+	{
+		ExposureModel model(range);
+		model.Reset(brightTarget);
+		float luminance = runConstant(model, dark, params, 2.f, 1.f / 60.f);
+		float expected = darkTarget + (brightTarget - darkTarget) * std::exp2(-params.eyeAdaptationSpeedDown * 2.f);
+		CHECK(std::abs(luminance - expected) < 1e-4f);
+	}
+
+	// monotonic convergence without overshoot, from the reset state
+	{
+		ExposureModel model(range);
+		CHECK(model.GetAdaptedLuminance() == 0.f);
+		float previous = 0.f;
+		for (int frame = 0; frame < 600; frame++)
+		{
+			float luminance = model.AdvanceFrame(dark.data(), params, 1.f / 60.f);
+			CHECK(luminance >= previous && luminance <= darkTarget);
+			previous = luminance;
+		}
+		CHECK(std::abs(previous - darkTarget) < darkTarget * 1e-3f);
+	}
+
+	// zero speed snaps to the target
+	params.eyeAdaptationSpeedDown = 0.f;
+	CHECK(ExposureModel::Adapt(brightTarget, darkTarget, params, 1.f / 60.f) == darkTarget);
+}
+
+void test_replay()
+{
+	ExposureHistogramRange range;
+	ToneMappingParameters params;
+
+	// a camera moving from a dark room into daylight and back, at an uneven frame rate
+	ExposureRecording recording;
+	recording.range = range;
+
+	ExposureModel live(range);
+	std::vector<float> liveResults;
+
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> frameTimeDist(1.f / 90.f, 1.f / 30.f);
+	for (int frame = 0; frame < 300; frame++)
+	{
+		float brightness = (frame < 100) ? -6.f : (frame < 200) ? 1.f : -4.f;
+		std::vector<float> rgba = randomImage(32 * 32, brightness - 2.f, brightness + 2.f, frame);
+
+		std::vector<uint32_t> histogram(range.bins, 0);
+		AddImageToLuminanceHistogram(rgba.data(), 32, 32, 32 * 4 * sizeof(float), 4, range, histogram.data());
+
+		float frameTime = frameTimeDist(rng);
+		recording.AddFrame(histogram.data(), frameTime);
+		liveResults.push_back(live.AdvanceFrame(histogram.data(), params, frameTime));
+	}
+
+	// the replay reproduces the live results exactly
+	std::vector<float> replayed = ReplayExposure(recording, params);
+	CHECK(replayed == liveResults);
+
+	// also after a round trip through the text format
+	std::stringstream ss;
+	recording.Write(ss);
+
+	ExposureRecording loaded;
+	CHECK(loaded.Read(ss));
+	CHECK(loaded.frames.size() == recording.frames.size());
+	CHECK(loaded.range.bins == range.bins && loaded.range.minLogLuminance == range.minLogLuminance);
+	CHECK(ReplayExposure(loaded, params) == liveResults);
+
+	// the adapted luminance followed the scene
+	CHECK(liveResults[99] < liveResults[199]);
+	CHECK(liveResults[299] < liveResults[199]);
+
+	// malformed input
+	std::stringstream bad("exposure_recording 4 -10 4\n0.016 1 2 3\n");
+	CHECK(!loaded.Read(bad));
+	std::stringstream wrongHeader("something else\n");
+	CHECK(!loaded.Read(wrongHeader));
+}
+
+void benchmark_histogram()
+{
+	ExposureHistogramRange range;
+	const uint32_t width = 1920;
+	const uint32_t height = 1080;
+	std::vector<float> rgba = randomImage(width * height, -12.f, 6.f, 3);
+	std::vector<uint32_t> histogram(range.bins, 0);
+
+	auto t0 = std::chrono::high_resolution_clock::now();
+	AddImageToLuminanceHistogram(rgba.data(), width, height, width * 4 * sizeof(float), 4, range, histogram.data());
+	auto t1 = std::chrono::high_resolution_clock::now();
+	std::vector<uint32_t> reference(range.bins, 0);
+	referenceHistogram(rgba, range, reference);
+	auto t2 = std::chrono::high_resolution_clock::now();
+
+	double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+	double referenceMs = std::chrono::duration<double, std::milli>(t2 - t1).count();
+	printf("luminance histogram: %ux%u in %.2f ms (%.0f Mpix/s), std::log2 reference %.2f ms\n",
+		width, height, ms, double(width) * height / (ms * 1000.0), referenceMs);
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_histogram();
+		test_histogram_special_values();
+		test_histogram_simd_matches_scalar();
+		test_target_luminance();
+		test_adaptation();
+		test_replay();
+		benchmark_histogram();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
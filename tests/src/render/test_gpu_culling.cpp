@@ -0,0 +1,506 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/render/GpuCulling.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/View.h>
+#include <donut/tests/scene_fixture.h>
+#include <donut/tests/utils.h>
+
+#include <chrono>
+#include <tuple>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
+using namespace donut;
+using namespace donut::math;
+using namespace donut::engine;
+using namespace donut::render;
+
+#include <donut/shaders/bindless.h>
+#include <donut/shaders/gpu_culling_cb.h>
+
+using namespace donut::tests;
+
+struct CullingScene : TestScene
+{
+	explicit CullingScene(TestScene&& scene) : TestScene(std::move(scene)) { }
+
+	std::vector<InstanceData> instanceData;
+	std::vector<affine3> instanceTransforms;
+};
+
+// What Scene::UpdateInstance writes into the instance buffer, and the transforms it was made from
+static void fillInstanceData(CullingScene& scene)
+{
+	scene.instanceData.assign(scene.graph->GetInstanceDataCount(), InstanceData{});
+	scene.instanceTransforms.assign(scene.graph->GetInstanceDataCount(), affine3::identity());
+
+	for (const auto& instance : scene.graph->GetMeshInstances())
+	{
+		SceneGraphNode* node = instance->GetNode();
+		affine3 localToWorld = node->GetLocalToWorldTransformFloat();
+
+		if (auto instanceArray = dynamic_cast<MeshInstanceArray*>(instance.get()))
+		{
+			instanceArray->FillInstanceData(&scene.instanceData[instance->GetInstanceIndex()], localToWorld, localToWorld);
+			for (uint32_t i = 0; i < instanceArray->GetInstanceCount(); i++)
+				scene.instanceTransforms[instance->GetInstanceIndex() + i] = instanceArray->GetInstanceTransforms()[i] * localToWorld;
+			continue;
+		}
+
+		affineToColumnMajor(localToWorld, scene.instanceData[instance->GetInstanceIndex()].transform);
+		scene.instanceTransforms[instance->GetInstanceIndex()] = localToWorld;
+	}
+}
+
+// A grid of mesh instances, some of them rotated and scaled, with a mix of materials and buffer groups,
+// a hidden instance, a skinned-like mesh that must never be culled, and one instance array.
+static CullingScene createScene(int gridSize)
+{
+	Random random;
+	CullingScene scene(createEmptyScene(16, 12, random));
+
+	for (int z = 0; z < gridSize; z++)
+	{
+		// one group per row keeps the sibling lists short
+		auto row = std::make_shared<SceneGraphNode>();
+		scene.graph->Attach(scene.root, row);
+
+		for (int x = 0; x < gridSize; x++)
+		{
+			auto instance = std::make_shared<MeshInstance>(scene.meshes[random() % scene.meshes.size()]);
+			auto node = scene.graph->AttachLeafNode(row, instance);
+			node->SetTranslation(double3(double(x - gridSize / 2) * 4.0, double(random() % 5) - 2.0, double(z) * 4.0));
+			if (random() % 3 == 0)
+			{
+				node->SetRotation(rotationQuat(double3(0.3, radians(double(random() % 360)), 0.0)));
+				node->SetScaling(double3(0.5 + double(random() % 4)));
+			}
+			if (x == 1 && z == 1)
+				instance->Visibility() = false;
+		}
+	}
+
+	auto skinnedMesh = std::make_shared<MeshInfo>(*scene.meshes[0]);
+	skinnedMesh->skinPrototype = scene.meshes[0];
+	skinnedMesh->geometries = { std::make_shared<MeshGeometry>(*scene.meshes[0]->geometries[0]) };
+	skinnedMesh->geometries[0]->material = scene.materials[0];
+	auto skinnedNode = scene.graph->AttachLeafNode(scene.root, std::make_shared<MeshInstance>(skinnedMesh));
+	skinnedNode->SetTranslation(double3(0.0, 0.0, -1000.0));
+
+	addInstanceArray(scene, scene.root, 500, 32, random);
+
+	scene.graph->Refresh(0);
+	fillInstanceData(scene);
+	return scene;
+}
+
+struct CullingResult
+{
+	std::vector<nvrhi::DrawIndexedIndirectArguments> drawArguments;
+	std::vector<uint32_t> drawCounts;
+};
+
+static CullingResult cull(const CullingScene& scene, const GpuDrawList& drawList, const GpuCullingConstants& constants,
+	const DepthPyramid* pyramid, tf::Executor* executor = nullptr)
+{
+	CullingResult result;
+	result.drawArguments.resize(drawList.GetRecordCount());
+	result.drawCounts.resize(drawList.GetBuckets().size());
+	CullDrawRecords(constants, scene.instanceData.data(), drawList.GetRecords().data(), drawList.GetGpuBuckets().data(),
+		pyramid, result.drawArguments.data(), result.drawCounts.data(), executor);
+	return result;
+}
+
+static bool sameArguments(const nvrhi::DrawIndexedIndirectArguments& a, const nvrhi::DrawIndexedIndirectArguments& b)
+{
+	return a.indexCount == b.indexCount && a.instanceCount == b.instanceCount && a.startIndexLocation == b.startIndexLocation
+		&& a.baseVertexLocation == b.baseVertexLocation && a.startInstanceLocation == b.startInstanceLocation;
+}
+
+void test_draw_list()
+{
+	CullingScene scene = createScene(20);
+
+	GpuDrawList drawList;
+	drawList.Build(*scene.graph);
+
+	CHECK(drawList.GetInstanceCount() == scene.graph->GetInstanceDataCount());
+	CHECK(drawList.GetBuckets().size() == drawList.GetGpuBuckets().size());
+
+	// one record per visible instance buffer entry and opaque or alpha-tested geometry
+	uint32_t expectedRecords = 0;
+	for (const auto& instance : scene.graph->GetMeshInstances())
+	{
+		if (!instance->Visibility())
+			continue;
+		for (const auto& geometry : instance->GetMesh()->geometries)
+		{
+			if (geometry->material->domain == MaterialDomain::Opaque || geometry->material->domain == MaterialDomain::AlphaTested)
+				expectedRecords += instance->GetInstanceCount();
+		}
+	}
+	CHECK(drawList.GetRecordCount() == expectedRecords);
+
+	uint32_t nextRecord = 0;
+	bool alphaTested = false;
+	for (size_t b = 0; b < drawList.GetBuckets().size(); b++)
+	{
+		const GpuDrawBucket& bucket = drawList.GetBuckets()[b];
+		CHECK(bucket.firstRecord == nextRecord);
+		CHECK(bucket.recordCount > 0);
+		CHECK(drawList.GetGpuBuckets()[b].firstRecord == bucket.firstRecord);
+		CHECK(drawList.GetGpuBuckets()[b].recordCount == bucket.recordCount);
+		nextRecord += bucket.recordCount;
+
+		// opaque buckets come first
+		bool bucketAlphaTested = bucket.material->domain == MaterialDomain::AlphaTested;
+		CHECK(!alphaTested || bucketAlphaTested);
+		alphaTested = bucketAlphaTested;
+
+		CHECK(bucket.cullMode == (bucket.material->doubleSided ? nvrhi::RasterCullMode::None : nvrhi::RasterCullMode::Back));
+
+		for (uint32_t r = 1; r < bucket.recordCount; r++)
+			CHECK(drawList.GetRecords()[bucket.firstRecord + r - 1].instanceIndex <= drawList.GetRecords()[bucket.firstRecord + r].instanceIndex);
+
+		if (b > 0)
+		{
+			const GpuDrawBucket& prev = drawList.GetBuckets()[b - 1];
+			CHECK(std::make_tuple(prev.material->materialID, prev.buffers->globalBufferGroupIndex, int(prev.cullMode))
+				!= std::make_tuple(bucket.material->materialID, bucket.buffers->globalBufferGroupIndex, int(bucket.cullMode)));
+		}
+	}
+	CHECK(nextRecord == drawList.GetRecordCount());
+
+	uint32_t noCullingRecords = 0;
+	for (const auto& record : drawList.GetRecords())
+	{
+		CHECK(record.instanceIndex < drawList.GetInstanceCount());
+		CHECK(record.indexCount == 300);
+		if (record.flags & GPU_CULLING_RECORD_NO_CULLING)
+			++noCullingRecords;
+	}
+	CHECK(noCullingRecords > 0);
+}
+
+void test_frustum_culling()
+{
+	CullingScene scene = createScene(40);
+	PlanarView view = createView();
+	frustum viewFrustum = view.GetViewFrustum();
+
+	GpuDrawList drawList;
+	drawList.Build(*scene.graph);
+
+	GpuCullingConstants constants;
+	FillGpuCullingConstants(constants, view, uint32_t(drawList.GetBuckets().size()), drawList.GetInstanceCount());
+	CHECK((constants.flags & GPU_CULLING_FLAG_OCCLUSION) == 0);
+
+	CullingResult result = cull(scene, drawList, constants, nullptr);
+
+	uint32_t totalVisible = 0;
+	for (size_t b = 0; b < drawList.GetBuckets().size(); b++)
+	{
+		const GpuCullingBucket& bucket = drawList.GetGpuBuckets()[b];
+
+		// the visible records in record order, then empty draws
+		uint32_t slot = 0;
+		for (uint32_t r = 0; r < bucket.recordCount; r++)
+		{
+			const GpuCullingDrawRecord& record = drawList.GetRecords()[bucket.firstRecord + r];
+			const box3 bounds(record.boundsMin, record.boundsMax);
+			const affine3& transform = scene.instanceTransforms[record.instanceIndex];
+
+			// an independent test with dm::frustum, which may only disagree on boxes that touch a plane
+			bool visible = IsDrawRecordVisible(constants, scene.instanceData.data(), record, nullptr);
+			bool expected = viewFrustum.intersectsWith(bounds * transform) || (record.flags & GPU_CULLING_RECORD_NO_CULLING);
+			if (visible != expected)
+			{
+				const box3 inner(bounds.m_mins + 1e-3f, bounds.m_maxs - 1e-3f);
+				const box3 outer(bounds.m_mins - 1e-3f, bounds.m_maxs + 1e-3f);
+				CHECK(visible ? viewFrustum.intersectsWith(outer * transform) : !viewFrustum.intersectsWith(inner * transform));
+			}
+
+			if (!visible)
+				continue;
+
+			const nvrhi::DrawIndexedIndirectArguments& args = result.drawArguments[bucket.firstRecord + slot];
+			CHECK(args.indexCount == record.indexCount);
+			CHECK(args.instanceCount == 1);
+			CHECK(args.startIndexLocation == record.startIndexLocation);
+			CHECK(args.baseVertexLocation == record.baseVertexLocation);
+			CHECK(args.startInstanceLocation == record.instanceIndex);
+			++slot;
+		}
+
+		CHECK(result.drawCounts[b] == slot);
+		for (; slot < bucket.recordCount; slot++)
+			CHECK(sameArguments(result.drawArguments[bucket.firstRecord + slot], nvrhi::DrawIndexedIndirectArguments{ 0, 0, 0, 0, 0 }));
+
+		totalVisible += result.drawCounts[b];
+	}
+
+	CHECK(totalVisible > 0 && totalVisible < drawList.GetRecordCount());
+
+	// instance buffer entries past the count that the constants were made with are never drawn
+	GpuCullingConstants truncated = constants;
+	truncated.instanceCount = 0;
+	for (const auto& record : drawList.GetRecords())
+		CHECK(IsDrawRecordVisible(truncated, scene.instanceData.data(), record, nullptr) == ((record.flags & GPU_CULLING_RECORD_NO_CULLING) != 0));
+}
+
+// A pyramid with the same depth everywhere, or the far plane depth on the left half of the screen
+static DepthPyramid createPyramid(uint32_t width, uint32_t height, float depth, bool farLeftHalf)
+{
+	std::vector<float> buffer(size_t(width) * height, depth);
+	if (farLeftHalf)
+	{
+		for (uint32_t y = 0; y < height; y++)
+			for (uint32_t x = 0; x < width / 2; x++)
+				buffer[size_t(y) * width + x] = 1.f;
+	}
+
+	DepthPyramid pyramid;
+	BuildDepthPyramid(buffer.data(), width, height, false, pyramid);
+	return pyramid;
+}
+
+void test_occlusion_culling()
+{
+	CullingScene scene = createScene(40);
+	PlanarView view = createView();
+	const float4x4 viewProjection = view.GetViewProjectionMatrix();
+
+	GpuDrawList drawList;
+	drawList.Build(*scene.graph);
+
+	// the depth of an occluder plane 30 units in front of the camera
+	const float4 occluderClip = float4(0.f, 0.f, 30.f, 1.f) * view.GetProjectionMatrix();
+	const float occluderDepth = occluderClip.z / occluderClip.w;
+
+	const uint32_t pyramidWidth = 256;
+	const uint32_t pyramidHeight = 128;
+
+	for (bool farLeftHalf : { false, true })
+	{
+		DepthPyramid pyramid = createPyramid(pyramidWidth, pyramidHeight, occluderDepth, farLeftHalf);
+
+		OcclusionCullingParameters occlusion;
+		occlusion.view = &view;
+		occlusion.pyramidWidth = pyramidWidth;
+		occlusion.pyramidHeight = pyramidHeight;
+		occlusion.pyramidLevels = uint32_t(pyramid.levels.size());
+
+		GpuCullingConstants constants;
+		FillGpuCullingConstants(constants, view, uint32_t(drawList.GetBuckets().size()), drawList.GetInstanceCount(), &occlusion);
+		CHECK((constants.flags & GPU_CULLING_FLAG_OCCLUSION) != 0);
+		CHECK((constants.flags & GPU_CULLING_FLAG_REVERSE_DEPTH) == 0);
+
+		uint32_t occludedCount = 0;
+		for (const auto& record : drawList.GetRecords())
+		{
+			if (!IsDrawRecordVisible(constants, scene.instanceData.data(), record, nullptr))
+				continue;
+
+			bool visible = IsDrawRecordVisible(constants, scene.instanceData.data(), record, &pyramid);
+			if (record.flags & GPU_CULLING_RECORD_NO_CULLING)
+			{
+				CHECK(visible);
+				continue;
+			}
+
+			// project the world space box and compare against the occluder, leaving a margin for rounding
+			const box3 worldBounds = box3(record.boundsMin, record.boundsMax) * scene.instanceTransforms[record.instanceIndex];
+			bool allBehind = true;
+			bool anyInFront = false;
+			bool anyOnLeft = false;
+			for (int corner = 0; corner < 8; corner++)
+			{
+				float4 clip = float4(worldBounds.getCorner(corner), 1.f) * viewProjection;
+				if (clip.w <= 0.f)
+				{
+					allBehind = false;
+					anyInFront = true;
+					break;
+				}
+				float depth = clip.z / clip.w;
+				allBehind = allBehind && depth > occluderDepth + 1e-4f;
+				anyInFront = anyInFront || depth < occluderDepth - 1e-4f;
+				anyOnLeft = anyOnLeft || clip.x / clip.w < 0.f;
+			}
+
+			if (anyInFront || (farLeftHalf && anyOnLeft))
+			{
+				CHECK(visible);
+			}
+			else if (allBehind && !farLeftHalf)
+			{
+				CHECK(!visible);
+			}
+
+			if (!visible)
+				++occludedCount;
+		}
+
+		CHECK(occludedCount > 0);
+
+		// the pyramid only ever removes draws
+		CullingResult frustumOnly = cull(scene, drawList, constants, nullptr);
+		CullingResult occluded = cull(scene, drawList, constants, &pyramid);
+		for (size_t b = 0; b < drawList.GetBuckets().size(); b++)
+			CHECK(occluded.drawCounts[b] <= frustumOnly.drawCounts[b]);
+	}
+
+	// with the far plane everywhere, nothing is occluded
+	DepthPyramid farPyramid = createPyramid(pyramidWidth, pyramidHeight, 1.f, false);
+	OcclusionCullingParameters occlusion{ &view, pyramidWidth, pyramidHeight, uint32_t(farPyramid.levels.size()) };
+	GpuCullingConstants constants;
+	FillGpuCullingConstants(constants, view, uint32_t(drawList.GetBuckets().size()), drawList.GetInstanceCount(), &occlusion);
+	CullingResult frustumOnly = cull(scene, drawList, constants, nullptr);
+	CullingResult occluded = cull(scene, drawList, constants, &farPyramid);
+	CHECK(frustumOnly.drawCounts == occluded.drawCounts);
+}
+
+void test_depth_pyramid()
+{
+	Random random;
+
+	for (auto [width, height] : { std::make_pair(1u, 1u), std::make_pair(16u, 8u), std::make_pair(37u, 5u), std::make_pair(3u, 29u) })
+	{
+		for (bool reverseDepth : { false, true })
+		{
+			std::vector<float> depth(size_t(width) * height);
+			for (float& d : depth)
+				d = float(random() % 1000) / 1000.f;
+
+			DepthPyramid pyramid;
+			BuildDepthPyramid(depth.data(), width, height, reverseDepth, pyramid);
+
+			CHECK(pyramid.GetLevelWidth(uint32_t(pyramid.levels.size()) - 1) == 1);
+			CHECK(pyramid.GetLevelHeight(uint32_t(pyramid.levels.size()) - 1) == 1);
+
+			for (uint32_t level = 0; level < pyramid.levels.size(); level++)
+			{
+				const uint32_t levelWidth = pyramid.GetLevelWidth(level);
+				const uint32_t levelHeight = pyramid.GetLevelHeight(level);
+				CHECK(pyramid.levels[level].size() == size_t(levelWidth) * levelHeight);
+
+				// every texel is the farthest depth of the base texels it covers, the last ones cover the remainder
+				for (uint32_t y = 0; y < levelHeight; y++)
+				{
+					for (uint32_t x = 0; x < levelWidth; x++)
+					{
+						uint32_t x1 = (x + 1 == levelWidth) ? width : (x + 1) << level;
+						uint32_t y1 = (y + 1 == levelHeight) ? height : (y + 1) << level;
+
+						float expected = depth[size_t(y << level) * width + (x << level)];
+						for (uint32_t sy = y << level; sy < y1; sy++)
+							for (uint32_t sx = x << level; sx < x1; sx++)
+								expected = reverseDepth ? std::min(expected, depth[size_t(sy) * width + sx]) : std::max(expected, depth[size_t(sy) * width + sx]);
+
+						CHECK(pyramid.Load(x, y, level) == expected);
+					}
+				}
+			}
+		}
+	}
+}
+
+void test_parallel_culling()
+{
+#ifdef DONUT_WITH_TASKFLOW
+	CullingScene scene = createScene(60);
+	PlanarView view = createView();
+
+	GpuDrawList drawList;
+	drawList.Build(*scene.graph);
+
+	DepthPyramid pyramid = createPyramid(128, 64, 0.99f, true);
+	OcclusionCullingParameters occlusion{ &view, 128, 64, uint32_t(pyramid.levels.size()) };
+
+	GpuCullingConstants constants;
+	FillGpuCullingConstants(constants, view, uint32_t(drawList.GetBuckets().size()), drawList.GetInstanceCount(), &occlusion);
+
+	tf::Executor executor(4);
+	CullingResult serial = cull(scene, drawList, constants, &pyramid);
+	CullingResult parallel = cull(scene, drawList, constants, &pyramid, &executor);
+
+	CHECK(serial.drawCounts == parallel.drawCounts);
+	for (size_t i = 0; i < serial.drawArguments.size(); i++)
+		CHECK(sameArguments(serial.drawArguments[i], parallel.drawArguments[i]));
+#endif
+}
+
+void benchmark_culling()
+{
+	CullingScene scene = createScene(300);
+	PlanarView view = createView();
+
+	auto start = std::chrono::high_resolution_clock::now();
+	GpuDrawList drawList;
+	drawList.Build(*scene.graph);
+	auto built = std::chrono::high_resolution_clock::now();
+
+	DepthPyramid pyramid = createPyramid(1280, 720, 0.99f, true);
+	OcclusionCullingParameters occlusion{ &view, 1280, 720, uint32_t(pyramid.levels.size()) };
+
+	GpuCullingConstants constants;
+	FillGpuCullingConstants(constants, view, uint32_t(drawList.GetBuckets().size()), drawList.GetInstanceCount(), &occlusion);
+
+	const int iterations = 10;
+	CullingResult result;
+	auto cullStart = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < iterations; i++)
+		result = cull(scene, drawList, constants, &pyramid);
+	auto cullEnd = std::chrono::high_resolution_clock::now();
+
+	uint32_t visible = 0;
+	for (uint32_t count : result.drawCounts)
+		visible += count;
+
+	printf("gpu culling: %u records in %zu buckets, list built in %.2f ms, culled on the CPU in %.2f ms, %u visible\n",
+		drawList.GetRecordCount(), drawList.GetBuckets().size(),
+		std::chrono::duration<double, std::milli>(built - start).count(),
+		std::chrono::duration<double, std::milli>(cullEnd - cullStart).count() / iterations, visible);
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_draw_list();
+		test_frustum_culling();
+		test_occlusion_culling();
+		test_depth_pyramid();
+		test_parallel_culling();
+		benchmark_culling();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,603 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/render/OcclusionCulling.h>
+#include <donut/render/DrawStrategy.h>
+#include <donut/render/GeometryPasses.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/View.h>
+#include <donut/tests/scene_fixture.h>
+#include <donut/tests/utils.h>
+
+#include <algorithm>
+#include <chrono>
+#include <set>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
+using namespace donut;
+using namespace donut::math;
+using namespace donut::engine;
+using namespace donut::render;
+
+using donut::tests::Random;
+
+// A closed unit cube centered at the origin, with front faces wound clockwise when seen from outside
+static OccluderMesh createCube(bool doubleSided = false)
+{
+	OccluderMesh mesh;
+	mesh.doubleSided = doubleSided;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		for (float side : { -1.f, 1.f })
+		{
+			float3 normal = 0.f;
+			float3 u = 0.f;
+			float3 v = 0.f;
+			normal[axis] = side * 0.5f;
+			u[(axis + 1) % 3] = 0.5f;
+			v[(axis + 2) % 3] = 0.5f;
+
+			uint32_t base = uint32_t(mesh.positions.size());
+			mesh.positions.push_back(normal - u - v);
+			mesh.positions.push_back(normal + u - v);
+			mesh.positions.push_back(normal + u + v);
+			mesh.positions.push_back(normal - u + v);
+
+			// cross(u, v) points along +axis, so the negative faces are wound the other way
+			if (side > 0.f)
+				mesh.indices.insert(mesh.indices.end(), { base, base + 1, base + 2, base, base + 2, base + 3 });
+			else
+				mesh.indices.insert(mesh.indices.end(), { base, base + 2, base + 1, base, base + 3, base + 2 });
+		}
+	}
+
+	return mesh;
+}
+
+// A unit square in the XY plane, facing -Z (towards a camera that looks along +Z)
+static OccluderMesh createQuad(bool doubleSided)
+{
+	OccluderMesh mesh;
+	mesh.doubleSided = doubleSided;
+	mesh.positions = { float3(-0.5f, -0.5f, 0.f), float3(-0.5f, 0.5f, 0.f), float3(0.5f, 0.5f, 0.f), float3(0.5f, -0.5f, 0.f) };
+	mesh.indices = { 0, 1, 2, 0, 2, 3 };
+	return mesh;
+}
+
+static affine3 boxTransform(const float3& center, const float3& size, float yaw = 0.f)
+{
+	return scaling(size) * rotation(float3(0.f, 1.f, 0.f), yaw) * translation(center);
+}
+
+static box3 centeredBox(const float3& center, const float3& size)
+{
+	return box3(center - size * 0.5f, center + size * 0.5f);
+}
+
+// Camera at 'position' looking along +Z
+static PlanarView createView(const float3& position, bool reverseDepth, uint32_t width = 1280, uint32_t height = 720)
+{
+	PlanarView view;
+	view.SetViewport(nvrhi::Viewport(float(width), float(height)));
+	float aspect = float(width) / float(height);
+	view.SetMatrices(translation(-position), reverseDepth
+		? perspProjD3DStyleReverse(radians(60.f), aspect, 0.1f)
+		: perspProjD3DStyle(radians(60.f), aspect, 0.1f, 500.f));
+	view.UpdateCache();
+	return view;
+}
+
+void test_wall()
+{
+	for (bool reverseDepth : { false, true })
+	{
+		PlanarView view = createView(0.f, reverseDepth);
+		OccluderMesh cube = createCube();
+
+		SoftwareOcclusionCuller culler(128, 64);
+
+		// nothing is culled before the first Rasterize
+		CHECK(culler.IsBoxVisible(centeredBox(float3(0.f, 0.f, 40.f), 2.f)));
+
+		culler.BeginView(view);
+		culler.AddOccluder(cube, boxTransform(float3(0.f, 0.f, 20.f), float3(20.f, 20.f, 1.f)));
+		culler.Rasterize();
+
+		CHECK(culler.GetStatistics().occluderCount == 1);
+		CHECK(culler.GetStatistics().triangleCount == 2); // only the face towards the camera is front facing
+		for (float depth : culler.GetDepthBuffer())
+		{
+			CHECK(depth >= 0.f && depth <= 1.f);
+		}
+
+		CHECK(!culler.IsBoxVisible(centeredBox(float3(0.f, 0.f, 40.f), 2.f)));    // behind the wall
+		CHECK(!culler.IsBoxVisible(centeredBox(float3(5.f, -3.f, 22.f), 2.f)));   // right behind the wall
+		CHECK(culler.IsBoxVisible(centeredBox(float3(0.f, 0.f, 10.f), 2.f)));     // in front of it
+		CHECK(culler.IsBoxVisible(centeredBox(float3(0.f, 0.f, 20.f), 4.f)));     // intersecting it
+		CHECK(culler.IsBoxVisible(centeredBox(float3(21.f, 0.f, 40.f), 4.f)));    // sticking out on the side
+		CHECK(culler.IsBoxVisible(centeredBox(float3(30.f, 0.f, 40.f), 2.f)));    // next to it
+		CHECK(culler.IsBoxVisible(centeredBox(float3(0.f, 0.f, 0.f), 2.f)));      // around the camera
+		CHECK(culler.IsBoxVisible(box3::empty()));
+
+		// a box just behind the front face is culled, a box that touches it is not
+		CHECK(!culler.IsBoxVisible(box3(float3(-1.f, -1.f, 19.6f), float3(1.f, 1.f, 21.f))));
+		CHECK(culler.IsBoxVisible(box3(float3(-1.f, -1.f, 19.5f), float3(1.f, 1.f, 21.f))));
+
+		// single-sided geometry only occludes with its front faces
+		for (bool doubleSided : { false, true })
+		{
+			OccluderMesh quad = createQuad(doubleSided);
+
+			culler.BeginView(view);
+			culler.AddOccluder(quad, boxTransform(float3(0.f, 0.f, 20.f), float3(20.f, 20.f, 1.f)));
+			culler.Rasterize();
+			CHECK(!culler.IsBoxVisible(centeredBox(float3(0.f, 0.f, 40.f), 2.f)));
+
+			// turned around
+			culler.BeginView(view);
+			culler.AddOccluder(quad, boxTransform(float3(0.f, 0.f, 20.f), float3(20.f, 20.f, 1.f), radians(180.f)));
+			culler.Rasterize();
+			CHECK(culler.IsBoxVisible(centeredBox(float3(0.f, 0.f, 40.f), 2.f)) == !doubleSided);
+
+			// mirrored by the instance transform, which turns the front face away like the GPU does
+			culler.BeginView(view);
+			culler.AddOccluder(quad, boxTransform(float3(0.f, 0.f, 20.f), float3(-20.f, 20.f, 1.f)));
+			culler.Rasterize();
+			CHECK(culler.IsBoxVisible(centeredBox(float3(0.f, 0.f, 40.f), 2.f)) == !doubleSided);
+		}
+
+		// a floor that crosses the near plane is clipped and still occludes what is below it
+		{
+			OccluderMesh quad = createQuad(true);
+			culler.BeginView(view);
+			culler.AddOccluder(quad, scaling(float3(200.f, 200.f, 1.f)) * rotation(float3(1.f, 0.f, 0.f), radians(90.f)) * translation(float3(0.f, -2.f, 0.f)));
+			culler.Rasterize();
+
+			for (float depth : culler.GetDepthBuffer())
+			{
+				CHECK(depth >= 0.f && depth <= 1.f);
+			}
+			CHECK(!culler.IsBoxVisible(centeredBox(float3(0.f, -20.f, 30.f), 2.f)));
+			CHECK(culler.IsBoxVisible(centeredBox(float3(0.f, 0.f, 30.f), 2.f)));
+			CHECK(culler.IsBoxVisible(centeredBox(float3(0.f, -2.f, 30.f), 2.f)));
+		}
+	}
+}
+
+struct WorldTriangle
+{
+	float3 v[3];
+	bool doubleSided;
+};
+
+static void appendTriangles(const OccluderMesh& mesh, const affine3& transform, std::vector<WorldTriangle>& triangles)
+{
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		WorldTriangle triangle;
+		for (int j = 0; j < 3; j++)
+			triangle.v[j] = transform.transformPoint(mesh.positions[mesh.indices[i + j]]);
+		triangle.doubleSided = mesh.doubleSided;
+		triangles.push_back(triangle);
+	}
+}
+
+// Calls 'sample(x, y, depth)' for every sample whose center is covered by the triangle.
+// Only valid for triangles in front of the near plane.
+template<typename Func> static void rasterizeReference(const WorldTriangle& triangle, const float4x4& worldToClip,
+	int width, int height, bool frontFacesOnly, Func sample)
+{
+	double3 s[3];
+	for (int i = 0; i < 3; i++)
+	{
+		const float3& p = triangle.v[i];
+		float4 clip = p.x * worldToClip[0] + p.y * worldToClip[1] + p.z * worldToClip[2] + worldToClip[3];
+		s[i] = double3((double(clip.x) / clip.w * 0.5 + 0.5) * width, (0.5 - double(clip.y) / clip.w * 0.5) * height, double(clip.z) / clip.w);
+	}
+
+	double area = (s[1].x - s[0].x) * (s[2].y - s[0].y) - (s[1].y - s[0].y) * (s[2].x - s[0].x);
+	if (area == 0.0 || (frontFacesOnly && !triangle.doubleSided && area < 0.0))
+		return;
+
+	int minX = std::max(0, int(std::floor(std::min({ s[0].x, s[1].x, s[2].x }))));
+	int maxX = std::min(width - 1, int(std::ceil(std::max({ s[0].x, s[1].x, s[2].x }))));
+	int minY = std::max(0, int(std::floor(std::min({ s[0].y, s[1].y, s[2].y }))));
+	int maxY = std::min(height - 1, int(std::ceil(std::max({ s[0].y, s[1].y, s[2].y }))));
+
+	auto edge = [](const double3& a, const double3& b, double x, double y) { return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x); };
+
+	for (int y = minY; y <= maxY; y++)
+	{
+		for (int x = minX; x <= maxX; x++)
+		{
+			double px = x + 0.5;
+			double py = y + 0.5;
+			double w0 = edge(s[1], s[2], px, py) / area;
+			double w1 = edge(s[2], s[0], px, py) / area;
+			double w2 = edge(s[0], s[1], px, py) / area;
+			if (w0 >= 0.0 && w1 >= 0.0 && w2 >= 0.0)
+				sample(x, y, w0 * s[0].z + w1 * s[1].z + w2 * s[2].z);
+		}
+	}
+}
+
+// Random box occluders, some of them rotated, and random boxes behind and between them, all in front of the camera.
+// Every box that the culler rejects must be hidden at each pixel center of a reference rasterization
+// at the resolution of the culler.
+void test_conservative()
+{
+	uint32_t culledTotal = 0;
+	uint32_t testedTotal = 0;
+
+	for (uint32_t seed = 1; seed <= 4; seed++)
+	{
+		const bool reverseDepth = (seed % 2) == 0;
+		PlanarView view = createView(0.f, reverseDepth);
+		const float4x4 worldToClip = view.GetViewProjectionMatrix(false);
+
+		Random random;
+		random.state = seed;
+
+		SoftwareOcclusionCuller culler(128, 64);
+		culler.BeginView(view);
+
+		std::vector<OccluderMesh> meshes = { createCube(), createCube(true) };
+		std::vector<WorldTriangle> occluderTriangles;
+		for (int i = 0; i < 40; i++)
+		{
+			const OccluderMesh& mesh = meshes[i % 2];
+			affine3 transform = boxTransform(
+				float3(random.uniform(-30.f, 30.f), random.uniform(-10.f, 10.f), random.uniform(15.f, 60.f)),
+				float3(random.uniform(2.f, 12.f), random.uniform(2.f, 12.f), random.uniform(1.f, 6.f)),
+				(i % 3 == 0) ? random.uniform(-1.f, 1.f) : 0.f);
+
+			culler.AddOccluder(mesh, transform);
+			appendTriangles(mesh, transform, occluderTriangles);
+		}
+		culler.Rasterize();
+
+		const int width = int(culler.GetWidth());
+		const int height = int(culler.GetHeight());
+		std::vector<float> reference(size_t(width) * height, reverseDepth ? 0.f : 1.f);
+		for (const WorldTriangle& triangle : occluderTriangles)
+		{
+			rasterizeReference(triangle, worldToClip, width, height, true, [&](int x, int y, double depth)
+			{
+				float& stored = reference[size_t(y) * width + x];
+				stored = reverseDepth ? std::max(stored, float(depth)) : std::min(stored, float(depth));
+			});
+		}
+
+		OccluderMesh box = createCube(true);
+		for (int i = 0; i < 2000; i++)
+		{
+			float3 center = float3(random.uniform(-40.f, 40.f), random.uniform(-15.f, 15.f), random.uniform(20.f, 100.f));
+			float3 size = float3(random.uniform(0.2f, 4.f), random.uniform(0.2f, 4.f), random.uniform(0.2f, 4.f));
+
+			if (culler.IsBoxVisible(centeredBox(center, size)))
+				continue;
+
+			std::vector<WorldTriangle> boxTriangles;
+			appendTriangles(box, boxTransform(center, size), boxTriangles);
+
+			bool visible = false;
+			for (const WorldTriangle& triangle : boxTriangles)
+			{
+				rasterizeReference(triangle, worldToClip, width, height, false, [&](int x, int y, double depth)
+				{
+					float stored = reference[size_t(y) * width + x];
+					if (reverseDepth ? float(depth) > stored : float(depth) < stored)
+						visible = true;
+				});
+			}
+
+			CHECK(!visible);
+			++culledTotal;
+		}
+		testedTotal += 2000;
+	}
+
+	// the scenes are dense enough that a good part of the boxes is hidden
+	CHECK(culledTotal > testedTotal / 10);
+}
+
+// The depth buffer does not depend on the band size or the number of threads
+void test_determinism()
+{
+	PlanarView view = createView(float3(0.f, 2.f, 0.f), false);
+	OccluderMesh cube = createCube();
+
+	Random random;
+	std::vector<affine3> transforms;
+	for (int i = 0; i < 200; i++)
+	{
+		transforms.push_back(boxTransform(
+			float3(random.uniform(-50.f, 50.f), random.uniform(-5.f, 5.f), random.uniform(5.f, 100.f)),
+			float3(random.uniform(1.f, 10.f), random.uniform(1.f, 10.f), random.uniform(1.f, 10.f)),
+			random.uniform(-3.f, 3.f)));
+	}
+
+	auto render = [&](SoftwareOcclusionCuller& culler)
+	{
+		culler.BeginView(view);
+		for (const affine3& transform : transforms)
+			culler.AddOccluder(cube, transform);
+		culler.Rasterize();
+		return culler.GetDepthBuffer();
+	};
+
+	SoftwareOcclusionCuller serial(250, 100);
+	CHECK(serial.GetWidth() == 252);
+	std::vector<float> expected = render(serial);
+
+	SoftwareOcclusionCuller singleRows(250, 100);
+	singleRows.SetRowsPerBand(1);
+	CHECK(render(singleRows) == expected);
+
+#ifdef DONUT_WITH_TASKFLOW
+	tf::Executor executor(4);
+	SoftwareOcclusionCuller parallel(250, 100, &executor);
+	parallel.SetRowsPerBand(8);
+	CHECK(render(parallel) == expected);
+	CHECK(parallel.GetStatistics().triangleCount == serial.GetStatistics().triangleCount);
+#endif
+}
+
+struct TestScene
+{
+	std::shared_ptr<SceneGraph> graph;
+	std::shared_ptr<SceneGraphNode> root;
+	std::shared_ptr<MeshInfo> wallMesh;
+	std::shared_ptr<MeshInfo> pillarMesh;
+	std::shared_ptr<MeshInfo> propMesh;
+	std::shared_ptr<MeshInfo> glassMesh;
+};
+
+static std::shared_ptr<MeshInfo> createMesh(const OccluderMesh& shape, const std::shared_ptr<Material>& material)
+{
+	auto buffers = std::make_shared<BufferGroup>();
+	buffers->positionData = shape.positions;
+	buffers->indexData = shape.indices;
+
+	auto geometry = std::make_shared<MeshGeometry>();
+	geometry->material = material;
+	geometry->numVertices = uint32_t(shape.positions.size());
+	geometry->numIndices = uint32_t(shape.indices.size());
+	geometry->objectSpaceBounds = box3(float3(-0.5f), float3(0.5f));
+
+	auto mesh = std::make_shared<MeshInfo>();
+	mesh->buffers = buffers;
+	mesh->geometries.push_back(geometry);
+	mesh->objectSpaceBounds = geometry->objectSpaceBounds;
+	mesh->totalIndices = geometry->numIndices;
+	mesh->totalVertices = geometry->numVertices;
+	return mesh;
+}
+
+// A wall and a row of pillars, with rows of small props and glass panes in front of and behind them
+static TestScene createScene(int rows)
+{
+	auto opaque = std::make_shared<Material>();
+	auto glass = std::make_shared<Material>();
+	glass->domain = MaterialDomain::AlphaBlended;
+
+	TestScene scene;
+	scene.wallMesh = createMesh(createCube(), opaque);
+	scene.pillarMesh = createMesh(createCube(), opaque);
+	scene.propMesh = createMesh(createCube(), opaque);
+	scene.glassMesh = createMesh(createQuad(true), glass);
+
+	scene.graph = std::make_shared<SceneGraph>();
+	scene.root = std::make_shared<SceneGraphNode>();
+	scene.graph->SetRootNode(scene.root);
+
+	auto wall = scene.graph->AttachLeafNode(scene.root, std::make_shared<MeshInstance>(scene.wallMesh));
+	wall->SetScaling(double3(60.0, 20.0, 1.0));
+	wall->SetTranslation(double3(0.0, 0.0, 30.0));
+
+	for (int i = 0; i < 4; i++)
+	{
+		auto pillar = scene.graph->AttachLeafNode(scene.root, std::make_shared<MeshInstance>(scene.pillarMesh));
+		pillar->SetScaling(double3(4.0, 20.0, 4.0));
+		pillar->SetTranslation(double3(-60.0 + i * 40.0, 0.0, 20.0));
+	}
+
+	for (int z = 0; z < rows; z++)
+	{
+		auto group = std::make_shared<SceneGraphNode>();
+		scene.graph->Attach(scene.root, group);
+
+		for (int x = 0; x < 40; x++)
+		{
+			auto prop = scene.graph->AttachLeafNode(group, std::make_shared<MeshInstance>(x % 5 == 0 ? scene.glassMesh : scene.propMesh));
+			prop->SetTranslation(double3(double(x) * 3.0 - 60.0, -2.0, 10.0 + double(z) * 2.0));
+		}
+	}
+
+	scene.graph->Refresh(0);
+	return scene;
+}
+
+// Items that draw consecutive instances of the graph are expanded, so that merging strategies can be compared
+static std::set<std::pair<const MeshInstance*, const MeshGeometry*>> collectItems(IDrawStrategy& strategy, const SceneGraph& graph)
+{
+	std::set<std::pair<const MeshInstance*, const MeshGeometry*>> result;
+	while (const DrawItem* item = strategy.GetNextItem())
+	{
+		for (uint32_t i = 0; i < item->instanceCount; i++)
+			result.insert({ graph.GetMeshInstances()[item->instance->GetInstanceIndex() + i].get(), item->geometry });
+	}
+	return result;
+}
+
+void test_draw_strategies()
+{
+	TestScene scene = createScene(20);
+	PlanarView view = createView(float3(0.f, 0.f, -10.f), true);
+
+	SoftwareOcclusionCuller culler(128, 64);
+	culler.SetOccluder(scene.wallMesh.get());
+	auto pillarProxy = std::make_shared<OccluderMesh>(createCube());
+	culler.SetOccluder(scene.pillarMesh.get(), pillarProxy);
+	CHECK(culler.IsOccluder(scene.wallMesh.get()) && !culler.IsOccluder(scene.propMesh.get()));
+
+	// the wall and the two inner pillars, the outer pillars are outside of the frustum
+	culler.RenderOccluders(scene.root, view);
+	CHECK(culler.GetStatistics().occluderCount == 3);
+
+	InstancedOpaqueDrawStrategy instanced;
+	instanced.PrepareForView(scene.root, view);
+	auto allOpaque = collectItems(instanced, *scene.graph);
+
+	instanced.SetOcclusionFilter(&culler);
+	instanced.PrepareForView(scene.root, view);
+	auto visibleOpaque = collectItems(instanced, *scene.graph);
+
+	CHECK(!visibleOpaque.empty());
+	CHECK(visibleOpaque.size() < allOpaque.size());
+	CHECK(std::includes(allOpaque.begin(), allOpaque.end(), visibleOpaque.begin(), visibleOpaque.end()));
+
+	// only props behind the pillars or the wall are culled, the occluders themselves are visible
+	for (const auto& item : allOpaque)
+	{
+		bool culled = visibleOpaque.find(item) == visibleOpaque.end();
+		const SceneGraphNode* node = item.first->GetNode();
+		if (culled)
+		{
+			CHECK(item.first->GetMesh() == scene.propMesh);
+			CHECK(node->GetGlobalBoundingBox().m_mins.z > 18.f);
+		}
+		if (node->GetGlobalBoundingBox().m_maxs.z < 18.f)
+		{
+			CHECK(!culled);
+		}
+	}
+
+	CompiledOpaqueDrawStrategy compiled;
+	compiled.SetOcclusionFilter(&culler);
+	compiled.PrepareForView(scene.root, view);
+	CHECK(collectItems(compiled, *scene.graph) == visibleOpaque);
+
+	TransparentDrawStrategy transparent;
+	transparent.PrepareForView(scene.root, view);
+	auto allGlass = collectItems(transparent, *scene.graph);
+	transparent.SetOcclusionFilter(&culler);
+	transparent.PrepareForView(scene.root, view);
+	auto visibleGlass = collectItems(transparent, *scene.graph);
+	CHECK(!visibleGlass.empty() && visibleGlass.size() < allGlass.size());
+
+	// without designated occluders, nothing is culled
+	culler.RemoveOccluder(scene.wallMesh.get());
+	culler.ClearOccluders();
+	culler.RenderOccluders(scene.root, view);
+	CHECK(culler.GetStatistics().occluderCount == 0);
+	instanced.PrepareForView(scene.root, view);
+	CHECK(collectItems(instanced, *scene.graph) == allOpaque);
+}
+
+// City blocks: a grid of buildings along streets, with small props everywhere, seen from street level
+void benchmark_city()
+{
+	OccluderMesh cube = createCube();
+	Random random;
+
+	std::vector<affine3> buildings;
+	for (int z = 0; z < 20; z++)
+	{
+		for (int x = -10; x < 10; x++)
+		{
+			float height = random.uniform(10.f, 60.f);
+			buildings.push_back(boxTransform(float3(float(x) * 30.f + 15.f, height * 0.5f, float(z) * 30.f + 15.f), float3(22.f, height, 22.f)));
+		}
+	}
+
+	std::vector<box3> props;
+	for (int i = 0; i < 100000; i++)
+	{
+		float3 center = float3(random.uniform(-300.f, 300.f), random.uniform(0.f, 4.f), random.uniform(0.f, 600.f));
+		props.push_back(centeredBox(center, float3(random.uniform(0.5f, 3.f))));
+	}
+
+	PlanarView view = createView(float3(0.f, 2.f, -5.f), true);
+
+	auto measure = [&](tf::Executor* executor)
+	{
+		SoftwareOcclusionCuller culler(256, 128, executor);
+		constexpr int iterations = 20;
+
+		double rasterMs = 0.0;
+		double testMs = 0.0;
+		size_t visibleCount = 0;
+		for (int i = 0; i < iterations; i++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			culler.BeginView(view);
+			for (const affine3& building : buildings)
+				culler.AddOccluder(cube, building);
+			culler.Rasterize();
+			auto middle = std::chrono::high_resolution_clock::now();
+
+			visibleCount = 0;
+			for (const box3& prop : props)
+				visibleCount += culler.IsBoxVisible(prop) ? 1 : 0;
+			auto end = std::chrono::high_resolution_clock::now();
+
+			rasterMs += std::chrono::duration<double, std::milli>(middle - start).count();
+			testMs += std::chrono::duration<double, std::milli>(end - middle).count();
+		}
+
+		printf("occlusion culling: %zu occluders, %u triangles rasterized in %.3f ms; %zu boxes tested in %.3f ms, %.1f%% visible",
+			buildings.size(), culler.GetStatistics().triangleCount, rasterMs / iterations, props.size(), testMs / iterations,
+			100.0 * double(visibleCount) / double(props.size()));
+	};
+
+	measure(nullptr);
+	printf(" (serial)\n");
+
+#ifdef DONUT_WITH_TASKFLOW
+	tf::Executor executor;
+	measure(&executor);
+	printf(" (%zu workers)\n", executor.num_workers());
+#endif
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_wall();
+		test_conservative();
+		test_determinism();
+		test_draw_strategies();
+		benchmark_city();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,422 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/render/RenderGraph.h>
+#include <donut/tests/utils.h>
+
+#include <chrono>
+#include <random>
+
+using namespace donut;
+using namespace donut::render;
+
+constexpr uint64_t c_MB = 1024 * 1024;
+
+static nvrhi::TextureDesc makeDesc(uint32_t width, uint32_t height, nvrhi::Format format, const char* name)
+{
+	nvrhi::TextureDesc desc;
+	desc.width = width;
+	desc.height = height;
+	desc.format = format;
+	desc.isRenderTarget = true;
+	desc.debugName = name;
+	return desc;
+}
+
+// Every texture takes exactly 'size' bytes
+static RenderGraphCompileOptions fixedSizeOptions(uint64_t size)
+{
+	RenderGraphCompileOptions options;
+	options.getMemoryRequirements = [size](const nvrhi::TextureDesc& desc) {
+		return RenderGraphMemoryRequirements{ size * std::max(desc.arraySize, 1u), 64 * 1024 };
+	};
+	return options;
+}
+
+static bool placementsAreValid(const RenderGraphPlan& plan)
+{
+	for (size_t a = 0; a < plan.textures.size(); a++)
+	{
+		const auto& pa = plan.textures[a];
+		if (!pa.allocated)
+			continue;
+		if (pa.offset % (64 * 1024) != 0 || pa.offset + pa.size > plan.heapSize)
+			return false;
+
+		for (size_t b = a + 1; b < plan.textures.size(); b++)
+		{
+			const auto& pb = plan.textures[b];
+			if (!pb.allocated)
+				continue;
+
+			bool livesOverlap = pa.firstPass <= pb.lastPass && pb.firstPass <= pa.lastPass;
+			bool memoryOverlaps = pa.offset < pb.offset + pb.size && pb.offset < pa.offset + pa.size;
+			if (livesOverlap && memoryOverlaps)
+				return false;
+		}
+	}
+	return plan.heapSize >= plan.peakLiveSize && plan.heapSize <= plan.unaliasedSize;
+}
+
+void test_memory_estimate()
+{
+	auto rgba8 = EstimateTextureMemoryRequirements(makeDesc(1024, 1024, nvrhi::Format::RGBA8_UNORM, ""));
+	CHECK(rgba8.size == 4 * c_MB);
+	CHECK(rgba8.alignment == 64 * 1024);
+
+	// BC1: 8 bytes per 4x4 block, 1024x1024 with a full mip chain
+	nvrhi::TextureDesc bc1 = makeDesc(1024, 1024, nvrhi::Format::BC1_UNORM, "");
+	bc1.mipLevels = 11;
+	auto bc1Size = EstimateTextureMemoryRequirements(bc1);
+	CHECK(bc1Size.size == 704 * 1024); // 512 KB + 128 KB + 32 KB + ... + 8 bytes for each of the 1x1-block mips, aligned up
+
+	nvrhi::TextureDesc msaa = makeDesc(100, 100, nvrhi::Format::R8_UNORM, "");
+	msaa.sampleCount = 4;
+	auto msaaSize = EstimateTextureMemoryRequirements(msaa);
+	CHECK(msaaSize.alignment == 4 * c_MB && msaaSize.size == 4 * c_MB);
+}
+
+void test_culling()
+{
+	RenderGraph graph;
+	auto output = graph.ImportTexture(nullptr, nvrhi::ResourceStates::Common, nvrhi::ResourceStates::Present);
+	const auto desc = makeDesc(64, 64, nvrhi::Format::RGBA8_UNORM, "");
+
+	RenderGraphTextureHandle gbuffer, lit, debug, debugBlur;
+
+	uint32_t gbufferPass = graph.AddPass("gbuffer", [&](RenderGraphPassBuilder& builder) {
+		gbuffer = builder.CreateTexture(desc);
+		builder.Write(gbuffer);
+	}, nullptr);
+	uint32_t debugPass = graph.AddPass("debug", [&](RenderGraphPassBuilder& builder) {
+		builder.Read(gbuffer);
+		debug = builder.CreateTexture(desc);
+		builder.Write(debug);
+	}, nullptr);
+	uint32_t debugBlurPass = graph.AddPass("debug blur", [&](RenderGraphPassBuilder& builder) {
+		builder.Read(debug);
+		debugBlur = builder.CreateTexture(desc);
+		builder.Write(debugBlur, nvrhi::ResourceStates::UnorderedAccess);
+	}, nullptr);
+	uint32_t lightingPass = graph.AddPass("lighting", [&](RenderGraphPassBuilder& builder) {
+		builder.Read(gbuffer);
+		lit = builder.CreateTexture(desc);
+		builder.Write(lit);
+	}, nullptr);
+	uint32_t readbackPass = graph.AddPass("readback", [&](RenderGraphPassBuilder& builder) {
+		builder.Read(lit, nvrhi::ResourceStates::CopySource);
+		builder.SetSideEffects();
+	}, nullptr);
+	uint32_t presentPass = graph.AddPass("tonemap", [&](RenderGraphPassBuilder& builder) {
+		builder.Read(lit);
+		builder.Write(output);
+	}, nullptr);
+
+	RenderGraphPlan plan;
+	CHECK(graph.Compile(RenderGraphCompileOptions(), plan));
+
+	CHECK(!plan.passCulled[gbufferPass]);
+	CHECK(plan.passCulled[debugPass]);
+	CHECK(plan.passCulled[debugBlurPass]);
+	CHECK(!plan.passCulled[lightingPass]);
+	CHECK(!plan.passCulled[readbackPass]);
+	CHECK(!plan.passCulled[presentPass]);
+	CHECK(plan.passes.size() == 4);
+	CHECK(plan.passes[0].passIndex == gbufferPass && plan.passes[3].passIndex == presentPass);
+
+	CHECK(plan.textures[gbuffer.index].allocated);
+	CHECK(!plan.textures[debug.index].allocated && !plan.textures[debugBlur.index].allocated);
+	CHECK(!plan.textures[output.index].allocated);
+	CHECK(plan.textures[lit.index].firstPass == 1 && plan.textures[lit.index].lastPass == 3);
+
+	RenderGraphCompileOptions noCulling;
+	noCulling.cullPasses = false;
+	CHECK(graph.Compile(noCulling, plan));
+	CHECK(plan.passes.size() == 6);
+	CHECK(plan.textures[debugBlur.index].allocated);
+}
+
+void test_aliasing_chain()
+{
+	// A chain of full-screen passes, each reading the previous result: two textures are live at a time.
+	constexpr int numPasses = 10;
+	const uint64_t size = 8 * c_MB;
+
+	RenderGraph graph;
+	auto output = graph.ImportTexture(nullptr, nvrhi::ResourceStates::RenderTarget);
+	const auto desc = makeDesc(1920, 1080, nvrhi::Format::RGBA16_FLOAT, "");
+
+	RenderGraphTextureHandle previous;
+	for (int i = 0; i < numPasses; ++i)
+	{
+		graph.AddPass("step", [&](RenderGraphPassBuilder& builder) {
+			if (previous.IsValid())
+				builder.Read(previous);
+			auto next = builder.CreateTexture(desc);
+			builder.Write(next);
+			previous = next;
+		}, nullptr);
+	}
+	graph.AddPass("output", [&](RenderGraphPassBuilder& builder) {
+		builder.Read(previous);
+		builder.Write(output);
+	}, nullptr);
+
+	RenderGraphPlan plan;
+	CHECK(graph.Compile(fixedSizeOptions(size), plan));
+	CHECK(plan.passes.size() == numPasses + 1);
+	CHECK(plan.peakLiveSize == 2 * size);
+	CHECK(plan.heapSize == 2 * size);
+	CHECK(plan.unaliasedSize == numPasses * size);
+	CHECK(placementsAreValid(plan));
+
+	RenderGraphCompileOptions noAliasing = fixedSizeOptions(size);
+	noAliasing.enableAliasing = false;
+	CHECK(graph.Compile(noAliasing, plan));
+	CHECK(plan.heapSize == numPasses * size);
+	CHECK(placementsAreValid(plan));
+}
+
+void test_aliasing_mixed_sizes()
+{
+	// big0 [0,1], small [1,2], big1 [2,3]: the two big textures share memory
+	RenderGraph graph;
+	auto output = graph.ImportTexture(nullptr, nvrhi::ResourceStates::RenderTarget);
+	auto big = makeDesc(1024, 1024, nvrhi::Format::RGBA8_UNORM, "big");     // 4 MB
+	auto small = makeDesc(512, 512, nvrhi::Format::RGBA8_UNORM, "small");   // 1 MB
+
+	RenderGraphTextureHandle big0, big1, smallTexture;
+	graph.AddPass("p0", [&](RenderGraphPassBuilder& builder) {
+		big0 = builder.CreateTexture(big);
+		builder.Write(big0);
+	}, nullptr);
+	graph.AddPass("p1", [&](RenderGraphPassBuilder& builder) {
+		builder.Read(big0);
+		smallTexture = builder.CreateTexture(small);
+		builder.Write(smallTexture);
+	}, nullptr);
+	graph.AddPass("p2", [&](RenderGraphPassBuilder& builder) {
+		builder.Read(smallTexture);
+		big1 = builder.CreateTexture(big);
+		builder.Write(big1);
+	}, nullptr);
+	graph.AddPass("p3", [&](RenderGraphPassBuilder& builder) {
+		builder.Read(big1);
+		builder.Write(output);
+	}, nullptr);
+
+	RenderGraphPlan plan;
+	CHECK(graph.Compile(RenderGraphCompileOptions(), plan));
+	CHECK(plan.peakLiveSize == 5 * c_MB);
+	CHECK(plan.heapSize == 5 * c_MB);
+	CHECK(plan.unaliasedSize == 9 * c_MB);
+	CHECK(plan.textures[big0.index].offset == plan.textures[big1.index].offset);
+	CHECK(placementsAreValid(plan));
+}
+
+static bool hasBarrier(const std::vector<RenderGraphBarrier>& barriers, RenderGraphTextureHandle texture,
+	nvrhi::ResourceStates before, nvrhi::ResourceStates after, bool discard = false)
+{
+	for (const auto& barrier : barriers)
+	{
+		if (barrier.texture == texture)
+			return barrier.before == before && barrier.after == after && barrier.discard == discard;
+	}
+	return false;
+}
+
+void test_barriers()
+{
+	using nvrhi::ResourceStates;
+
+	RenderGraph graph;
+	auto history = graph.ImportTexture(nullptr, ResourceStates::ShaderResource, ResourceStates::ShaderResource);
+	auto output = graph.ImportTexture(nullptr, ResourceStates::Common, ResourceStates::Present);
+	const auto desc = makeDesc(64, 64, nvrhi::Format::RGBA8_UNORM, "");
+	RenderGraphTextureHandle color, depth;
+
+	graph.AddPass("draw", [&](RenderGraphPassBuilder& builder) {
+		color = builder.CreateTexture(desc);
+		depth = builder.CreateTexture(makeDesc(64, 64, nvrhi::Format::D32, ""));
+		builder.Write(color);
+		builder.Write(depth, ResourceStates::DepthWrite);
+	}, nullptr);
+	graph.AddPass("ssao", [&](RenderGraphPassBuilder& builder) {
+		builder.Read(depth, ResourceStates::ShaderResource);
+		builder.Read(color);
+		builder.SetSideEffects();
+	}, nullptr);
+	graph.AddPass("taa", [&](RenderGraphPassBuilder& builder) {
+		builder.Read(color);
+		builder.Read(depth, ResourceStates::DepthRead);
+		builder.Read(depth, ResourceStates::ShaderResource);
+		builder.Write(history, ResourceStates::UnorderedAccess);
+	}, nullptr);
+	graph.AddPass("tonemap", [&](RenderGraphPassBuilder& builder) {
+		builder.Read(history);
+		builder.Write(output);
+	}, nullptr);
+
+	RenderGraphPlan plan;
+	CHECK(graph.Compile(RenderGraphCompileOptions(), plan));
+	CHECK(plan.passes.size() == 4);
+
+	const auto& draw = plan.passes[0].barriers;
+	CHECK(draw.size() == 2);
+	CHECK(hasBarrier(draw, color, ResourceStates::Common, ResourceStates::RenderTarget, true));
+	CHECK(hasBarrier(draw, depth, ResourceStates::Common, ResourceStates::DepthWrite, true));
+
+	const auto& ssao = plan.passes[1].barriers;
+	CHECK(ssao.size() == 2);
+	CHECK(hasBarrier(ssao, color, ResourceStates::RenderTarget, ResourceStates::ShaderResource));
+	CHECK(hasBarrier(ssao, depth, ResourceStates::DepthWrite, ResourceStates::ShaderResource));
+
+	// color stays in ShaderResource; the depth reads are combined into one state
+	const auto& taa = plan.passes[2].barriers;
+	CHECK(taa.size() == 2);
+	CHECK(hasBarrier(taa, depth, ResourceStates::ShaderResource, ResourceStates::DepthRead | ResourceStates::ShaderResource));
+	CHECK(hasBarrier(taa, history, ResourceStates::ShaderResource, ResourceStates::UnorderedAccess));
+
+	const auto& tonemap = plan.passes[3].barriers;
+	CHECK(tonemap.size() == 2);
+	CHECK(hasBarrier(tonemap, history, ResourceStates::UnorderedAccess, ResourceStates::ShaderResource));
+	CHECK(hasBarrier(tonemap, output, ResourceStates::Common, ResourceStates::RenderTarget));
+
+	// history is already in its final state
+	CHECK(plan.finalBarriers.size() == 1);
+	CHECK(hasBarrier(plan.finalBarriers, output, ResourceStates::RenderTarget, ResourceStates::Present));
+	CHECK(plan.barrierCount == 9);
+
+	// a texture that is written must not be used in another state by the same pass
+	graph.AddPass("invalid", [&](RenderGraphPassBuilder& builder) {
+		builder.Read(history);
+		builder.Write(history, ResourceStates::UnorderedAccess);
+	}, nullptr);
+	CHECK(!graph.Compile(RenderGraphCompileOptions(), plan));
+}
+
+// Random graphs shaped like a frame: each pass reads a few recent textures and writes new ones
+static void buildRandomGraph(RenderGraph& graph, std::mt19937& rng, int numPasses)
+{
+	graph.Reset();
+	auto output = graph.ImportTexture(nullptr, nvrhi::ResourceStates::Common, nvrhi::ResourceStates::Present);
+
+	const nvrhi::Format formats[] = { nvrhi::Format::R8_UNORM, nvrhi::Format::RGBA8_UNORM, nvrhi::Format::RGBA16_FLOAT, nvrhi::Format::RGBA32_FLOAT };
+	const uint32_t sizes[] = { 256, 512, 1024, 2048 };
+
+	std::vector<RenderGraphTextureHandle> textures;
+	for (int passIndex = 0; passIndex < numPasses; ++passIndex)
+	{
+		graph.AddPass("pass", [&](RenderGraphPassBuilder& builder) {
+			int reads = textures.empty() ? 0 : int(rng() % 3) + 1;
+			for (int i = 0; i < reads; ++i)
+			{
+				size_t window = std::min<size_t>(textures.size(), 16);
+				builder.Read(textures[textures.size() - 1 - rng() % window]);
+			}
+
+			int writes = int(rng() % 2) + 1;
+			for (int i = 0; i < writes; ++i)
+			{
+				uint32_t size = sizes[rng() % 4];
+				auto texture = builder.CreateTexture(makeDesc(size, size, formats[rng() % 4], ""));
+				builder.Write(texture);
+				textures.push_back(texture);
+			}
+
+			if (passIndex == numPasses - 1 || rng() % 50 == 0)
+				builder.Write(output);
+		}, nullptr);
+	}
+}
+
+void test_random_graphs()
+{
+	std::mt19937 rng(7);
+	RenderGraph graph;
+	RenderGraphPlan plan;
+
+	for (int iteration = 0; iteration < 50; ++iteration)
+	{
+		buildRandomGraph(graph, rng, 20 + iteration * 4);
+		CHECK(graph.Compile(RenderGraphCompileOptions(), plan));
+		CHECK(placementsAreValid(plan));
+		CHECK(plan.heapSize < plan.unaliasedSize);
+
+		// every read of a surviving pass sees a texture that lives across it
+		for (uint32_t plannedIndex = 0; plannedIndex < plan.passes.size(); plannedIndex++)
+		{
+			for (const auto& barrier : plan.passes[plannedIndex].barriers)
+			{
+				if (graph.IsImported(barrier.texture))
+					continue;
+				const auto& placement = plan.textures[barrier.texture.index];
+				CHECK(placement.allocated);
+				CHECK(placement.firstPass <= plannedIndex && plannedIndex <= placement.lastPass);
+				CHECK(barrier.discard == (placement.firstPass == plannedIndex));
+			}
+		}
+	}
+}
+
+void benchmark_compile()
+{
+	std::mt19937 rng(11);
+	RenderGraph graph;
+	RenderGraphPlan plan;
+
+	for (int numPasses : { 100, 1000, 5000 })
+	{
+		buildRandomGraph(graph, rng, numPasses);
+
+		constexpr int iterations = 5;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < iterations; ++i)
+			graph.Compile(RenderGraphCompileOptions(), plan);
+		auto end = std::chrono::high_resolution_clock::now();
+
+		double ms = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+		printf("RenderGraph: %d passes, %zu textures: %.3f ms to compile, heap %.1f MB, peak live %.1f MB, unaliased %.1f MB\n",
+			numPasses, graph.GetTextureCount(), ms, double(plan.heapSize) / c_MB, double(plan.peakLiveSize) / c_MB,
+			double(plan.unaliasedSize) / c_MB);
+	}
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_memory_estimate();
+		test_culling();
+		test_aliasing_chain();
+		test_aliasing_mixed_sizes();
+		test_barriers();
+		test_random_graphs();
+		benchmark_compile();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,277 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/render/ShadowCache.h>
+#include <donut/render/GeometryPasses.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/tests/utils.h>
+
+using namespace donut;
+using namespace donut::math;
+using namespace donut::engine;
+using namespace donut::render;
+
+struct CasterScene
+{
+	std::shared_ptr<SceneGraph> graph;
+	std::shared_ptr<SceneGraphNode> root;
+	std::vector<std::shared_ptr<SceneGraphNode>> nodes;
+	std::vector<std::shared_ptr<MeshInstance>> instances;
+};
+
+// Unit boxes in a row along X, 10 units apart
+static CasterScene createCasterScene(int count)
+{
+	auto mesh = std::make_shared<MeshInfo>();
+	mesh->objectSpaceBounds = box3(float3(-0.5f), float3(0.5f));
+
+	CasterScene scene;
+	scene.graph = std::make_shared<SceneGraph>();
+	scene.root = std::make_shared<SceneGraphNode>();
+	scene.graph->SetRootNode(scene.root);
+
+	for (int i = 0; i < count; i++)
+	{
+		auto instance = std::make_shared<MeshInstance>(mesh);
+		auto node = scene.graph->AttachLeafNode(scene.root, instance);
+		node->SetTranslation(double3(double(i) * 10.0, 0.0, 0.0));
+		scene.nodes.push_back(node);
+		scene.instances.push_back(instance);
+	}
+
+	scene.graph->Refresh(0);
+	return scene;
+}
+
+// Light looking straight down: light space X = world X, light space Y = world Z
+static affine3 getWorldToLight()
+{
+	affine3 worldToLight = affine3::identity();
+	worldToLight.m_linear = float3x3(
+		1.f, 0.f, 0.f,
+		0.f, 0.f, 1.f,
+		0.f, 1.f, 0.f);
+	return worldToLight;
+}
+
+void test_cascade_snapping()
+{
+	ShadowCacheTracker tracker(2);
+	affine3 worldToLight = getWorldToLight();
+	const float3 originalHalfSize = float3(16.f, 16.f, 50.f);
+
+	float3 center = float3(3.f, 0.f, 1.f);
+	float3 halfSize = originalHalfSize;
+	CHECK(tracker.SnapCascade(0, worldToLight, center, halfSize));
+	CHECK(all(halfSize > originalHalfSize));
+
+	// the snapped box covers the requested one
+	box3 requested = box3(float3(3.f, 0.f, 1.f) - originalHalfSize, float3(3.f, 0.f, 1.f) + originalHalfSize) * worldToLight;
+	box3 snapped = box3(center - halfSize, center + halfSize) * worldToLight;
+	CHECK(snapped.contains(requested));
+
+	float3 firstCenter = center;
+	tracker.MarkCascadeRendered(0);
+	CHECK(!tracker.IsCascadeDirty(0));
+	CHECK(tracker.IsCascadeDirty(1)); // never set up
+
+	// small camera movement: same projection
+	center = float3(3.5f, 0.f, 1.2f);
+	halfSize = originalHalfSize;
+	CHECK(!tracker.SnapCascade(0, worldToLight, center, halfSize));
+	CHECK(all(center == firstCenter));
+
+	// float noise in the size doesn't change the projection either
+	center = float3(3.f, 0.f, 1.f);
+	halfSize = originalHalfSize * 1.000001f;
+	CHECK(!tracker.SnapCascade(0, worldToLight, center, halfSize));
+
+	// crossing a grid line does
+	center = float3(3.f + originalHalfSize.x, 0.f, 1.f);
+	halfSize = originalHalfSize;
+	CHECK(tracker.SnapCascade(0, worldToLight, center, halfSize));
+	tracker.MarkCascadeRendered(0);
+
+	// and so does a different cascade size
+	halfSize = originalHalfSize * 2.f;
+	CHECK(tracker.SnapCascade(0, worldToLight, center, halfSize));
+	tracker.MarkCascadeRendered(0);
+
+	// or a different light direction
+	affine3 rotatedLight = rotation(float3(0.f, 1.f, 0.f), 0.1f) * worldToLight;
+	halfSize = originalHalfSize * 2.f;
+	CHECK(tracker.SnapCascade(0, rotatedLight, center, halfSize));
+	tracker.MarkCascadeRendered(0);
+
+	tracker.Invalidate();
+	CHECK(tracker.IsCascadeDirty(0));
+}
+
+void test_caster_tracking()
+{
+	CasterScene scene = createCasterScene(8);
+	ShadowCacheTracker tracker(2);
+	tracker.DynamicFrames = 3;
+	affine3 worldToLight = getWorldToLight();
+
+	// cascade 0 around the first box, cascade 1 around the last one
+	auto setupCascades = [&]()
+	{
+		float3 center = float3(0.f), halfSize = float3(4.f, 4.f, 20.f);
+		tracker.SnapCascade(0, worldToLight, center, halfSize);
+		center = float3(70.f, 0.f, 0.f);
+		tracker.SnapCascade(1, worldToLight, center, halfSize);
+	};
+	auto renderCascades = [&]()
+	{
+		tracker.MarkCascadeRendered(0);
+		tracker.MarkCascadeRendered(1);
+	};
+
+	tracker.UpdateCasters(*scene.graph);
+	setupCascades();
+	renderCascades();
+	CHECK(tracker.GetStaticCasterCount() == 8 && tracker.GetDynamicCasterCount() == 0);
+	CHECK(tracker.GetDirtyRegions().size() == 8);
+
+	// nothing changes
+	tracker.UpdateCasters(*scene.graph);
+	setupCascades();
+	CHECK(!tracker.IsCascadeDirty(0) && !tracker.IsCascadeDirty(1));
+	CHECK(tracker.GetDirtyRegions().empty());
+
+	// the first box starts moving: it leaves the static set and only cascade 0 needs an update
+	scene.nodes[0]->SetTranslation(double3(0.0, 1.0, 0.0));
+	scene.graph->Refresh(1);
+	tracker.UpdateCasters(*scene.graph);
+	setupCascades();
+	CHECK(!tracker.IsStaticCaster(scene.instances[0].get()));
+	CHECK(tracker.IsStaticCaster(scene.instances[1].get()));
+	CHECK(tracker.GetDynamicCasterCount() == 1);
+	CHECK(tracker.IsCascadeDirty(0) && !tracker.IsCascadeDirty(1));
+	renderCascades();
+
+	// while it keeps moving, the cache stays valid
+	for (int frame = 0; frame < 4; frame++)
+	{
+		scene.nodes[0]->SetTranslation(double3(0.0, 2.0 + frame, 0.0));
+		scene.graph->Refresh(2 + frame);
+		tracker.UpdateCasters(*scene.graph);
+		setupCascades();
+		CHECK(!tracker.IsCascadeDirty(0) && !tracker.IsCascadeDirty(1));
+		CHECK(!tracker.IsStaticCaster(scene.instances[0].get()));
+	}
+
+	// after DynamicFrames still updates it is baked back into the cache
+	for (uint32_t frame = 0; frame < tracker.DynamicFrames; frame++)
+	{
+		CHECK(!tracker.IsStaticCaster(scene.instances[0].get()));
+		tracker.UpdateCasters(*scene.graph);
+	}
+	CHECK(tracker.IsStaticCaster(scene.instances[0].get()));
+	CHECK(tracker.GetDynamicCasterCount() == 0);
+	CHECK(tracker.IsCascadeDirty(0) && !tracker.IsCascadeDirty(1));
+	renderCascades();
+
+	// removing the last box invalidates cascade 1 only
+	scene.graph->Detach(scene.nodes[7]);
+	scene.graph->Refresh(10);
+	tracker.UpdateCasters(*scene.graph);
+	CHECK(tracker.GetStaticCasterCount() == 7);
+	CHECK(!tracker.IsCascadeDirty(0) && tracker.IsCascadeDirty(1));
+	renderCascades();
+
+	// hiding a box behaves like removing it, showing it again like adding it
+	scene.instances[3]->Visibility() = false;
+	tracker.UpdateCasters(*scene.graph);
+	CHECK(tracker.GetStaticCasterCount() == 6);
+	CHECK(tracker.GetDirtyRegions().size() == 1);
+	scene.instances[3]->Visibility() = true;
+	tracker.UpdateCasters(*scene.graph);
+	CHECK(tracker.GetStaticCasterCount() == 7);
+	CHECK(!tracker.IsCascadeDirty(0) && !tracker.IsCascadeDirty(1)); // outside of both cascades
+
+	// replacing the first box with a new instance at the same place, which the allocator may
+	// put at the address of the old one, still needs the cascade to be re-rendered
+	auto mesh = scene.instances[0]->GetMesh();
+	scene.graph->Detach(scene.nodes[0]);
+	scene.nodes[0].reset();
+	scene.instances[0].reset();
+	scene.instances[0] = std::make_shared<MeshInstance>(mesh);
+	scene.nodes[0] = scene.graph->AttachLeafNode(scene.root, scene.instances[0]);
+	scene.nodes[0]->SetTranslation(double3(0.0, 5.0, 0.0));
+	scene.graph->Refresh(11);
+	tracker.UpdateCasters(*scene.graph);
+	CHECK(tracker.IsStaticCaster(scene.instances[0].get()));
+	CHECK(tracker.GetStaticCasterCount() == 7);
+	CHECK(tracker.GetDirtyRegions().size() == 2);
+	CHECK(tracker.IsCascadeDirty(0) && !tracker.IsCascadeDirty(1));
+}
+
+void test_caster_draw_strategy()
+{
+	CasterScene scene = createCasterScene(4);
+	ShadowCacheTracker tracker;
+	tracker.UpdateCasters(*scene.graph);
+
+	scene.nodes[2]->SetTranslation(double3(20.0, 5.0, 0.0));
+	scene.graph->Refresh(1);
+	tracker.UpdateCasters(*scene.graph);
+
+	std::vector<DrawItem> items(scene.instances.size());
+	for (size_t i = 0; i < items.size(); i++)
+		items[i].instance = scene.instances[i].get();
+
+	PassthroughDrawStrategy passthrough;
+
+	passthrough.SetData(items.data(), items.size());
+	ShadowCasterDrawStrategy staticCasters(passthrough, tracker, true);
+	int staticCount = 0;
+	while (const DrawItem* item = staticCasters.GetNextItem())
+	{
+		CHECK(item->instance != scene.instances[2].get());
+		++staticCount;
+	}
+	CHECK(staticCount == 3);
+
+	passthrough.SetData(items.data(), items.size());
+	ShadowCasterDrawStrategy dynamicCasters(passthrough, tracker, false);
+	const DrawItem* item = dynamicCasters.GetNextItem();
+	CHECK(item && item->instance == scene.instances[2].get());
+	CHECK(dynamicCasters.GetNextItem() == nullptr);
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_cascade_snapping();
+		test_caster_tracking();
+		test_caster_draw_strategy();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,386 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/render/VisibilityCache.h>
+#include <donut/render/DrawStrategy.h>
+#include <donut/render/GeometryPasses.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/View.h>
+#include <donut/tests/scene_fixture.h>
+#include <donut/tests/utils.h>
+
+#include <chrono>
+#include <tuple>
+
+using namespace donut;
+using namespace donut::math;
+using namespace donut::engine;
+using namespace donut::render;
+
+using namespace donut::tests;
+
+// Groups of mesh instances spread over a square, with the materials and meshes of the shared fixture
+// and an instance array. The groups have their own transforms.
+static TestScene createScene(int groupCount, int instancesPerGroup, uint32_t seed)
+{
+	Random random;
+	random.state = seed;
+
+	TestScene scene = createEmptyScene(8, 6, random);
+
+	const int side = int(std::ceil(std::sqrt(float(groupCount))));
+	for (int i = 0; i < groupCount; i++)
+	{
+		auto group = std::make_shared<SceneGraphNode>();
+		scene.graph->Attach(scene.root, group);
+		group->SetTranslation(double3(double(i % side - side / 2) * 40.0, 0.0, double(i / side - side / 2) * 40.0));
+		scene.groups.push_back(group);
+
+		for (int j = 0; j < instancesPerGroup; j++)
+		{
+			auto instance = std::make_shared<MeshInstance>(scene.meshes[random() % scene.meshes.size()]);
+			auto node = scene.graph->AttachLeafNode(group, instance);
+			node->SetTranslation(double3(random.uniform(-18.f, 18.f), random.uniform(-4.f, 4.f), random.uniform(-18.f, 18.f)));
+			scene.leaves.push_back(node);
+		}
+	}
+
+	addInstanceArray(scene, scene.root, 200, 16, random);
+
+	scene.graph->Refresh(0);
+	return scene;
+}
+
+struct Camera
+{
+	float3 position = float3(0.f, 3.f, 0.f);
+	float yaw = 0.f;
+	float pitch = 0.f;
+};
+
+static void updateView(PlanarView& view, const Camera& camera, bool reverseDepth)
+{
+	affine3 cameraToWorld = yawPitchRoll(camera.yaw, camera.pitch, 0.f) * translation(camera.position);
+	view.SetViewport(nvrhi::Viewport(1280.f, 720.f));
+	view.SetMatrices(inverse(cameraToWorld), reverseDepth
+		? perspProjD3DStyleReverse(radians(60.f), 16.f / 9.f, 0.1f)
+		: perspProjD3DStyle(radians(60.f), 16.f / 9.f, 0.1f, 120.f));
+	view.UpdateCache();
+}
+
+typedef std::tuple<const MeshInstance*, const MeshGeometry*, uint32_t, uint32_t, nvrhi::RasterCullMode, float> ItemKey;
+
+// The items in the order of the strategy, which includes the chunking of the opaque strategy
+static std::vector<ItemKey> drainItems(IDrawStrategy& strategy)
+{
+	std::vector<ItemKey> result;
+	while (const DrawItem* item = strategy.GetNextItem())
+		result.emplace_back(item->instance, item->geometry, item->instanceOffset, item->instanceCount, item->cullMode, item->distanceToCamera);
+	return result;
+}
+
+void test_versions()
+{
+	TestScene scene = createScene(2, 4, 1);
+	SceneGraphNode* group = scene.groups[0].get();
+	SceneGraphNode* moved = scene.leaves[0].get();
+	SceneGraphNode* sibling = scene.leaves[1].get();
+	SceneGraphNode* otherGroup = scene.groups[1].get();
+
+	const uint32_t structureVersion = scene.graph->GetStructureVersion();
+	const uint32_t siblingVersion = sibling->GetBoundsVersion();
+	const uint32_t otherVersion = otherGroup->GetBoundsVersion();
+
+	// nothing changed
+	uint32_t movedVersion = moved->GetBoundsVersion();
+	scene.graph->Refresh(1);
+	CHECK(moved->GetBoundsVersion() == movedVersion);
+	CHECK(scene.graph->GetStructureVersion() == structureVersion);
+
+	// a transform changes the versions of the node and its ancestors
+	uint32_t groupVersion = group->GetBoundsVersion();
+	uint32_t rootVersion = scene.root->GetBoundsVersion();
+	moved->SetTranslation(double3(1.0, 2.0, 3.0));
+	scene.graph->Refresh(2);
+	CHECK(moved->GetBoundsVersion() != movedVersion);
+	CHECK(group->GetBoundsVersion() != groupVersion);
+	CHECK(scene.root->GetBoundsVersion() != rootVersion);
+	CHECK(sibling->GetBoundsVersion() == siblingVersion);
+	CHECK(otherGroup->GetBoundsVersion() == otherVersion);
+	CHECK(scene.graph->GetStructureVersion() == structureVersion);
+
+	// and so does a transform of an ancestor, for the whole subgraph
+	group->SetTranslation(double3(0.0, 1.0, 0.0));
+	scene.graph->Refresh(3);
+	CHECK(sibling->GetBoundsVersion() != siblingVersion);
+	CHECK(otherGroup->GetBoundsVersion() == otherVersion);
+
+	// structure changes
+	scene.graph->AttachLeafNode(otherGroup->shared_from_this(), std::make_shared<MeshInstance>(scene.meshes[0]));
+	CHECK(scene.graph->GetStructureVersion() == structureVersion);
+	scene.graph->Refresh(4);
+	CHECK(scene.graph->GetStructureVersion() == structureVersion + 1);
+	CHECK(otherGroup->GetBoundsVersion() != otherVersion);
+}
+
+// A camera that moves smoothly with occasional cuts, objects and groups that move, and nodes that are
+// attached and detached. The cached strategies must produce exactly the items of the uncached ones.
+void test_matches_full_culling()
+{
+	uint64_t testedTotal = 0;
+	uint64_t cachedTotal = 0;
+
+	for (uint32_t seed = 1; seed <= 4; seed++)
+	{
+		const bool reverseDepth = (seed % 2) == 0;
+		TestScene scene = createScene(36, 40, seed);
+
+		Random random;
+		random.state = seed * 7919u;
+
+		VisibilityCache cache;
+		PlanarView view;
+		Camera camera;
+
+		InstancedOpaqueDrawStrategy opaque;
+		opaque.SetChunkSize(32);
+		InstancedOpaqueDrawStrategy cachedOpaque;
+		cachedOpaque.SetChunkSize(32);
+		cachedOpaque.SetVisibilityCache(&cache);
+		TransparentDrawStrategy transparent;
+		TransparentDrawStrategy cachedTransparent;
+		cachedTransparent.SetVisibilityCache(&cache);
+
+		for (uint32_t frame = 1; frame <= 200; frame++)
+		{
+			uint32_t event = random() % 100;
+			if (event < 3)
+			{
+				// cut
+				camera.position = float3(random.uniform(-100.f, 100.f), random.uniform(1.f, 20.f), random.uniform(-100.f, 100.f));
+				camera.yaw = random.uniform(-3.14f, 3.14f);
+				camera.pitch = random.uniform(-0.5f, 0.5f);
+			}
+			else if (event < 40)
+			{
+				camera.position += float3(random.uniform(-0.5f, 0.5f), random.uniform(-0.1f, 0.1f), random.uniform(-0.5f, 0.5f));
+				camera.yaw += random.uniform(-0.03f, 0.03f);
+				camera.pitch = clamp(camera.pitch + random.uniform(-0.01f, 0.01f), -0.5f, 0.5f);
+			}
+			// otherwise the camera stays
+
+			for (int i = 0; i < 20; i++)
+			{
+				auto& leaf = scene.leaves[random() % scene.leaves.size()];
+				leaf->SetTranslation(leaf->GetTranslation() + double3(random.uniform(-1.f, 1.f), 0.f, random.uniform(-1.f, 1.f)));
+			}
+
+			if (random() % 10 == 0)
+			{
+				auto& group = scene.groups[random() % scene.groups.size()];
+				group->SetTranslation(group->GetTranslation() + double3(random.uniform(-2.f, 2.f), random.uniform(-0.5f, 0.5f), random.uniform(-2.f, 2.f)));
+			}
+
+			if (random() % 20 == 0)
+			{
+				size_t index = random() % scene.leaves.size();
+				scene.graph->Detach(scene.leaves[index]);
+				scene.leaves.erase(scene.leaves.begin() + index);
+			}
+
+			if (random() % 20 == 0)
+			{
+				auto& group = scene.groups[random() % scene.groups.size()];
+				auto node = scene.graph->AttachLeafNode(group, std::make_shared<MeshInstance>(scene.meshes[random() % scene.meshes.size()]));
+				node->SetTranslation(double3(random.uniform(-18.f, 18.f), 0.f, random.uniform(-18.f, 18.f)));
+				scene.leaves.push_back(node);
+			}
+
+			scene.graph->Refresh(frame);
+			updateView(view, camera, reverseDepth);
+
+			opaque.PrepareForView(scene.root, view);
+			cachedOpaque.PrepareForView(scene.root, view);
+			CHECK(drainItems(cachedOpaque) == drainItems(opaque));
+
+			transparent.PrepareForView(scene.root, view);
+			cachedTransparent.PrepareForView(scene.root, view);
+			CHECK(drainItems(cachedTransparent) == drainItems(transparent));
+
+			VisibilityCache::Statistics statistics = cache.GetStatistics(view);
+			testedTotal += statistics.testedNodes;
+			cachedTotal += statistics.cachedNodes;
+		}
+	}
+
+	// most of the results are reused
+	CHECK(cachedTotal > testedTotal);
+}
+
+void test_camera_cuts()
+{
+	TestScene scene = createScene(16, 20, 3);
+	VisibilityCache cache;
+	PlanarView view;
+	Camera camera;
+
+	InstancedOpaqueDrawStrategy strategy;
+	strategy.SetVisibilityCache(&cache);
+
+	auto renderFrame = [&]()
+	{
+		updateView(view, camera, false);
+		strategy.PrepareForView(scene.root, view);
+		drainItems(strategy);
+		return cache.GetStatistics(view);
+	};
+
+	VisibilityCache::Statistics statistics = renderFrame();
+	CHECK(statistics.testedNodes > 0 && statistics.cachedNodes == 0);
+
+	// a static frame only tests the nodes that touch the frustum planes
+	statistics = renderFrame();
+	CHECK(statistics.cachedNodes > 10 * statistics.testedNodes);
+
+	// small motion
+	camera.position.x += 0.1f;
+	camera.yaw += 0.01f;
+	statistics = renderFrame();
+	CHECK(statistics.cachedNodes > statistics.testedNodes);
+
+	// a large rotation is a cut
+	camera.yaw += 1.5f;
+	statistics = renderFrame();
+	CHECK(statistics.cachedNodes == 0);
+
+	renderFrame();
+	cache.ResetView(view);
+	statistics = renderFrame();
+	CHECK(statistics.cachedNodes == 0);
+
+	// structure changes rebuild the node list
+	renderFrame();
+	scene.graph->Detach(scene.leaves[0]);
+	scene.graph->Refresh(1);
+	statistics = renderFrame();
+	CHECK(statistics.cachedNodes == 0);
+
+	// other views have their own results
+	PlanarView otherView;
+	updateView(otherView, Camera(), false);
+	strategy.PrepareForView(scene.root, otherView);
+	drainItems(strategy);
+	CHECK(cache.GetStatistics(otherView).cachedNodes == 0);
+	statistics = renderFrame();
+	CHECK(statistics.cachedNodes > 10 * statistics.testedNodes);
+
+	// subgraphs that do not belong to a graph are culled without the cache
+	auto detached = std::make_shared<SceneGraphNode>();
+	strategy.PrepareForView(detached, view);
+	CHECK(drainItems(strategy).empty());
+}
+
+template <typename Func>
+static double measureMs(int iterations, Func&& func)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < iterations; i++)
+		func();
+	auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count() / double(iterations);
+}
+
+// Culling of a scene with 50k instances, with a static camera and scene, and with a slowly moving
+// camera and 1% of the instances moving every frame. Both paths replay the same frames on their own scene.
+void benchmark_visibility_cache()
+{
+	const int frames = 30;
+
+	for (bool mostlyStatic : { false, true })
+	{
+		double frameMs[2] = {};
+		size_t items = 0;
+		uint64_t tested = 0;
+		uint64_t cached = 0;
+
+		for (bool useCache : { false, true })
+		{
+			TestScene scene = createScene(400, 125, 5);
+			VisibilityCache cache;
+			PlanarView view;
+			Random random;
+
+			InstancedOpaqueDrawStrategy strategy;
+			if (useCache)
+				strategy.SetVisibilityCache(&cache);
+
+			for (int frame = 0; frame <= frames; frame++)
+			{
+				Camera camera;
+				if (mostlyStatic)
+				{
+					camera.position.z = float(frame) * 0.2f;
+					camera.yaw = float(frame) * 0.002f;
+
+					for (size_t i = 0; i < scene.leaves.size() / 100; i++)
+					{
+						auto& leaf = scene.leaves[random() % scene.leaves.size()];
+						leaf->SetTranslation(leaf->GetTranslation() + double3(0.1, 0.0, 0.0));
+					}
+					scene.graph->Refresh(uint32_t(frame + 1));
+				}
+				updateView(view, camera, false);
+
+				double ms = measureMs(1, [&]() { strategy.PrepareForView(scene.root, view); items = drainItems(strategy).size(); });
+
+				// the first frame fills the cache
+				if (frame > 0)
+				{
+					frameMs[useCache] += ms;
+					tested += cache.GetStatistics(view).testedNodes;
+					cached += cache.GetStatistics(view).cachedNodes;
+				}
+			}
+		}
+
+		printf("visibility cache, %s: %d items, full culling %.3f ms, cached %.3f ms, %.1f%% of the nodes tested\n",
+			mostlyStatic ? "mostly static" : "static", int(items), frameMs[0] / frames, frameMs[1] / frames,
+			100.0 * double(tested) / double(std::max<uint64_t>(tested + cached, 1)));
+	}
+}
+
+int main(int, char** argv)
+{
+	try
+	{
+		test_versions();
+		test_matches_full_culling();
+		test_camera_cuts();
+		benchmark_visibility_cache();
+	}
+	catch (const std::runtime_error & err)
+	{
+		fprintf(stderr, "%s", err.what());
+		return 1;
+	}
+	return 0;
+}
@@ -38,3 +38,27 @@ foreach(test_src ${donut_core_tests})
 
 endforeach()
 
+
+# fuzz harnesses : built as standalone corpus replayers by default, or as
+# libFuzzer targets with DONUT_WITH_FUZZERS
+
+file(GLOB donut_core_fuzzers src/core/fuzz_*.cpp)
+
+foreach(fuzzer_src ${donut_core_fuzzers})
+
+    get_filename_component(fuzzer_name "${fuzzer_src}" NAME_WE)
+
+    add_executable("${fuzzer_name}" "${fuzzer_src}")
+    target_link_libraries("${fuzzer_name}" donut_core)
+
+    if (DONUT_WITH_FUZZERS)
+        target_compile_definitions("${fuzzer_name}" PRIVATE DONUT_LIBFUZZER)
+        target_compile_options("${fuzzer_name}" PRIVATE -fsanitize=fuzzer,address)
+        target_link_libraries("${fuzzer_name}" -fsanitize=fuzzer,address)
+    endif()
+
+    add_dependencies(donut_all_tests "${fuzzer_name}")
+
+    set_property(TARGET "${fuzzer_name}" PROPERTY FOLDER "Donut/donut_tests/donut_core_fuzzers")
+
+endforeach()